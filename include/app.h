@@ -2,17 +2,43 @@
 #define APP_H
 
 #include <stdbool.h>
+#include <stdint.h>
 
 #ifdef __cplusplus
 extern "C" {
 #endif
 
+// Boot phases, in the order they normally complete
+typedef enum {
+    APP_BOOT_PHASE_CONFIG = 0,   // NVS and the configuration cache are loaded
+    APP_BOOT_PHASE_USB,          // USB keyboard and system config are up
+    APP_BOOT_PHASE_INPUT,        // Button is armed and the flash program can run
+    APP_BOOT_PHASE_NETWORK,      // WiFi, mDNS and HTTP are initialized
+    APP_BOOT_PHASE_COUNT
+} app_boot_phase_t;
+
 /**
  * @brief Initialize all system modules in correct order
  * @return true on success, false on failure
+ * @note Returns once the keyboard, button and flash program are usable. Network
+ * services are brought up afterwards on a low-priority task.
  */
 bool app_init(void);
 
+/**
+ * @brief Get the time a boot phase completed
+ * @param phase Boot phase
+ * @return Microseconds since boot, or 0 if the phase hasn't completed (or failed)
+ */
+int64_t app_get_boot_time_us(app_boot_phase_t phase);
+
+/**
+ * @brief Get the name of a boot phase
+ * @param phase Boot phase
+ * @return Short name (e.g. "usb"), or "unknown"
+ */
+const char *app_boot_phase_name(app_boot_phase_t phase);
+
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,75 @@
+#ifndef CONFIG_BATCH_H
+#define CONFIG_BATCH_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Largest batch request and response
+#define CONFIG_BATCH_MAX_SIZE 2048
+
+/**
+ * @brief Batch operations
+ *
+ * A batch is a list of operations, each an op byte followed by its arguments.
+ * Multi-byte values are little-endian, and keys are [length u8][key] without a NUL.
+ *
+ * NVS_SET     [key][type u8][length u16][value]  type is an nvs_type_t; integers
+ *                                                take their exact size, strings
+ *                                                have no NUL
+ * NVS_GET     [key]
+ * NVS_DELETE  [key]
+ * SELECT      [id u32]                           selects a FLASH program; an id of
+ *                                                0xFFFFFFFF is followed by
+ *                                                [length u8][name]
+ * EXECUTE     [program type u8][priority u8]     program_type_t and
+ *                                                program_priority_t values
+ */
+#define CONFIG_BATCH_OP_NVS_SET 0x01
+#define CONFIG_BATCH_OP_NVS_GET 0x02
+#define CONFIG_BATCH_OP_NVS_DELETE 0x03
+#define CONFIG_BATCH_OP_SELECT 0x04
+#define CONFIG_BATCH_OP_EXECUTE 0x05
+
+/**
+ * @brief Status of the batch and of each operation
+ *
+ * The response is [status u8][operation count u16], followed by a result per
+ * operation: [status u8], then for a successful NVS_GET [type u8][length u16][value],
+ * for SELECT [id u32] and for EXECUTE [queue position u32].
+ */
+#define CONFIG_BATCH_STATUS_OK 0x00
+#define CONFIG_BATCH_STATUS_NOT_FOUND 0x01  // Key or program doesn't exist
+#define CONFIG_BATCH_STATUS_FAILED 0x02     // Operation (or the commit) failed
+#define CONFIG_BATCH_STATUS_SKIPPED 0x03    // Not run because an earlier one failed
+#define CONFIG_BATCH_STATUS_TOO_LARGE 0x04  // Value doesn't fit in the response
+
+/**
+ * @brief Run a batch of NVS and program operations
+ * @param request Batch request
+ * @param request_size Request size in bytes
+ * @param response Buffer to hold the response
+ * @param response_size Response buffer size
+ * @param out_response_length Length of the response
+ * @return true if the batch ran (see the status in the response), false if the
+ * request is malformed, in which case nothing was changed
+ * @note The whole batch is checked before any operation runs. Operations then run
+ * in order and the first failure skips the rest; a missing key on NVS_GET or
+ * NVS_DELETE is not a failure. All NVS changes are committed together at the end,
+ * in a single commit.
+ */
+bool config_batch_run(const uint8_t *request,
+                      size_t request_size,
+                      uint8_t *response,
+                      size_t response_size,
+                      size_t *out_response_length);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  // CONFIG_BATCH_H
@@ -0,0 +1,94 @@
+#ifndef LATENCY_STATS_H
+#define LATENCY_STATS_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Latency samples kept per stage; summaries cover only the most recent ones
+#define LATENCY_STATS_WINDOW 128
+
+// A button edge this soon after a wake from light sleep is taken to have caused it
+#define LATENCY_STATS_WAKE_WINDOW_US 20000
+
+/**
+ * @brief Points a keystroke passes on its way from the button to the host
+ * A trace starts at LATENCY_POINT_BUTTON (or at LATENCY_POINT_EXECUTE for runs that
+ * weren't started by the button) and follows the first report of the run. Each
+ * point only counts when the trace has just passed the point before it.
+ */
+typedef enum {
+    LATENCY_POINT_BUTTON = 0,     // Button edge seen by the ISR
+    LATENCY_POINT_EXECUTE,        // Run requested
+    LATENCY_POINT_RUN_START,      // VM task starts the run
+    LATENCY_POINT_REPORT_QUEUED,  // First report of the run queued for the keyboard
+    LATENCY_POINT_REPORT_SENT,    // That report handed to TinyUSB
+    LATENCY_POINT_REPORT_DONE,    // Host has fetched that report
+    LATENCY_POINT_COUNT
+} latency_point_t;
+
+// Stages between consecutive points, plus the whole button-to-host path
+typedef enum {
+    LATENCY_STAGE_DEBOUNCE = 0,  // BUTTON -> EXECUTE
+    LATENCY_STAGE_QUEUE,         // EXECUTE -> RUN_START
+    LATENCY_STAGE_VM,            // RUN_START -> REPORT_QUEUED
+    LATENCY_STAGE_KEYBOARD,      // REPORT_QUEUED -> REPORT_SENT
+    LATENCY_STAGE_USB,           // REPORT_SENT -> REPORT_DONE
+    LATENCY_STAGE_TOTAL,         // BUTTON -> REPORT_DONE
+    LATENCY_STAGE_WAKE,          // Wake from light sleep -> REPORT_DONE
+    LATENCY_STAGE_COUNT
+} latency_stage_t;
+
+// Summary of the recent samples of a stage, in microseconds
+typedef struct {
+    uint32_t count;    // Samples recorded since boot or the last reset
+    uint32_t samples;  // Samples the summary is computed from
+    uint32_t min_us;
+    uint32_t p50_us;
+    uint32_t p99_us;
+    uint32_t max_us;
+} latency_summary_t;
+
+/**
+ * @brief Timestamp a point of the current trace
+ * @param point Point reached
+ * @return true if the point was recorded as part of the trace
+ * @note Safe to call from an ISR
+ */
+bool latency_stats_mark(latency_point_t point);
+
+/**
+ * @brief Record that the CPU just woke from light sleep on a GPIO
+ * @note A trace started by the next button edge within LATENCY_STATS_WAKE_WINDOW_US
+ * also counts towards LATENCY_STAGE_WAKE. Safe to call from an ISR.
+ */
+void latency_stats_mark_wake(void);
+
+/**
+ * @brief Summarize the recent samples of a stage
+ * @param stage Stage to summarize
+ * @param out_summary Summary (all zero if the stage has no samples)
+ * @return true on success, false if the stage is invalid
+ */
+bool latency_stats_get(latency_stage_t stage, latency_summary_t *out_summary);
+
+/**
+ * @brief Get the name of a stage
+ * @param stage Stage
+ * @return Short name (e.g. "debounce"), or "unknown"
+ */
+const char *latency_stats_stage_name(latency_stage_t stage);
+
+/**
+ * @brief Discard all samples and the trace in progress
+ */
+void latency_stats_reset(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  // LATENCY_STATS_H
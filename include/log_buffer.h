@@ -9,12 +9,35 @@
 extern "C" {
 #endif
 
+/**
+ * @brief Position of a reader in the log history
+ * Each record has a sequence number, which is its offset in the stream of all records
+ * written since boot. Clients keep the sequence number returned by a read and pass
+ * it back to receive only the records written after it.
+ */
+typedef struct {
+    uint32_t seq;     // Sequence number of the record being read
+    uint32_t offset;  // Text bytes of it already returned
+} log_buffer_cursor_t;
+
+// Sequence number that starts a cursor at the oldest available record
+#define LOG_BUFFER_SEQ_OLDEST 0
+
 /**
  * @brief Initialize the log buffer system
  * @return true on success, false on failure
  */
 bool log_buffer_init(void);
 
+/**
+ * @brief Apply log settings from NVS (call once the configuration cache is loaded)
+ * With log_binary set, log calls store their format string and raw arguments instead
+ * of formatted text, and are formatted only when the logs are read. Calls whose
+ * format or arguments cannot be stored that way are still stored as text. Later
+ * changes to the setting are applied as they are committed.
+ */
+void log_buffer_load_settings(void);
+
 /**
  * @brief Get the number of bytes available to read from the log buffer
  * @return Number of bytes available
@@ -40,6 +63,43 @@ void log_buffer_start_read(void);
  */
 void log_buffer_clear(void);
 
+/**
+ * @brief Start a cursor at a sequence number
+ * Records that were overwritten or cleared are skipped, and sequence numbers that do
+ * not belong to this boot start the cursor at the oldest available record.
+ * @param cursor Cursor to initialize
+ * @param seq Sequence number from an earlier read, or LOG_BUFFER_SEQ_OLDEST
+ */
+void log_buffer_cursor_start(log_buffer_cursor_t *cursor, uint32_t seq);
+
+/**
+ * @brief Get the sequence number after the last complete record following a cursor
+ * Reading up to it returns whole lines, and it is where the next read should resume.
+ * @param cursor Cursor to read from
+ * @return End sequence number to pass to log_buffer_cursor_read
+ */
+uint32_t log_buffer_cursor_end(const log_buffer_cursor_t *cursor);
+
+/**
+ * @brief Read log text from a cursor and advance it
+ * Cursors are independent of each other and of log_buffer_read_chunk.
+ * @param cursor Cursor to read from
+ * @param end_seq Sequence number to stop at (see log_buffer_cursor_end)
+ * @param buffer Buffer to store the read data
+ * @param max_size Maximum number of bytes to read
+ * @return Number of bytes actually read (0 once the cursor reaches end_seq)
+ */
+uint32_t log_buffer_cursor_read(log_buffer_cursor_t *cursor,
+                                uint32_t end_seq,
+                                uint8_t *buffer,
+                                uint32_t max_size);
+
+/**
+ * @brief Get the sequence number the next log record will be written at
+ * @return Head sequence number
+ */
+uint32_t log_buffer_get_head_seq(void);
+
 /**
  * @brief Deinitialize the log buffer system and free memory
  */
@@ -0,0 +1,122 @@
+#ifndef NVS_CONFIG_H
+#define NVS_CONFIG_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "nvs.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Keys the configuration cache has room for at first; it grows as keys are added
+#define NVS_CONFIG_INITIAL_ENTRIES 32
+
+// Most change callbacks that can be registered
+#define NVS_CONFIG_MAX_CALLBACKS 12
+
+// Writes are committed to NVS once no other write follows for this long, or at
+// most NVS_CONFIG_MAX_COMMIT_DELAY_MS after the first one
+#define NVS_CONFIG_COMMIT_DELAY_MS 500
+#define NVS_CONFIG_MAX_COMMIT_DELAY_MS 2000
+
+/**
+ * @brief Callback invoked after a changed key is committed to NVS
+ * @param key Key that was set or erased
+ * @param arg Argument given when the callback was registered
+ * @note Runs on the task that committed the change, which is the cache's commit task
+ * unless nvs_config_commit() was called directly
+ */
+typedef void (*nvs_config_change_callback_t)(const char *key, void *arg);
+
+/**
+ * @brief Load the NVS_NAMESPACE configuration into RAM
+ * @return true on success, false on failure
+ * @note Call after nvs_odkey_init(). Reads are served from RAM from then on; writes
+ * update RAM right away and are committed to NVS together in the background.
+ */
+bool nvs_config_init(void);
+
+/**
+ * @brief Get the type of a key
+ * @param key Key name
+ * @param out_type Pointer to hold the type
+ * @return ESP_OK, or ESP_ERR_NVS_NOT_FOUND if the key doesn't exist
+ */
+esp_err_t nvs_config_find_key(const char *key, nvs_type_t *out_type);
+
+/**
+ * @brief Get an integer value
+ * @return ESP_OK, or ESP_ERR_NVS_NOT_FOUND if the key doesn't exist with this type
+ * @note Like nvs_get_u8() and friends, a key of another type is not found
+ */
+esp_err_t nvs_config_get_u8(const char *key, uint8_t *out_value);
+esp_err_t nvs_config_get_i8(const char *key, int8_t *out_value);
+esp_err_t nvs_config_get_u16(const char *key, uint16_t *out_value);
+esp_err_t nvs_config_get_i16(const char *key, int16_t *out_value);
+esp_err_t nvs_config_get_u32(const char *key, uint32_t *out_value);
+esp_err_t nvs_config_get_i32(const char *key, int32_t *out_value);
+esp_err_t nvs_config_get_u64(const char *key, uint64_t *out_value);
+esp_err_t nvs_config_get_i64(const char *key, int64_t *out_value);
+
+/**
+ * @brief Get a string or blob value
+ * @param key Key name
+ * @param out_value Buffer to hold the value, or NULL to only get its length
+ * @param length In: buffer size. Out: value length (including the NUL of a string)
+ * @return ESP_OK, ESP_ERR_NVS_NOT_FOUND, or ESP_ERR_NVS_INVALID_LENGTH if the buffer
+ * is too small
+ */
+esp_err_t nvs_config_get_str(const char *key, char *out_value, size_t *length);
+esp_err_t nvs_config_get_blob(const char *key, void *out_value, size_t *length);
+
+/**
+ * @brief Set an integer value
+ * @return ESP_OK, or ESP_ERR_NO_MEM if the cache can't grow to hold a new key
+ * @note Replaces a value of any type stored under the key
+ */
+esp_err_t nvs_config_set_u8(const char *key, uint8_t value);
+esp_err_t nvs_config_set_i8(const char *key, int8_t value);
+esp_err_t nvs_config_set_u16(const char *key, uint16_t value);
+esp_err_t nvs_config_set_i16(const char *key, int16_t value);
+esp_err_t nvs_config_set_u32(const char *key, uint32_t value);
+esp_err_t nvs_config_set_i32(const char *key, int32_t value);
+esp_err_t nvs_config_set_u64(const char *key, uint64_t value);
+esp_err_t nvs_config_set_i64(const char *key, int64_t value);
+
+/**
+ * @brief Set a string or blob value
+ * @return ESP_OK, or ESP_ERR_NO_MEM
+ */
+esp_err_t nvs_config_set_str(const char *key, const char *value);
+esp_err_t nvs_config_set_blob(const char *key, const void *value, size_t length);
+
+/**
+ * @brief Erase a key
+ * @return ESP_OK, or ESP_ERR_NVS_NOT_FOUND if the key doesn't exist
+ */
+esp_err_t nvs_config_erase_key(const char *key);
+
+/**
+ * @brief Commit pending writes to NVS now, rather than after the commit delay
+ * @return ESP_OK on success, or the NVS error
+ */
+esp_err_t nvs_config_commit(void);
+
+/**
+ * @brief Register a callback for changes to a key
+ * @param key Key to watch (must stay valid, e.g. one of the NVS_KEY_* strings)
+ * @param callback Invoked after a change to the key is committed
+ * @param arg Argument passed to the callback
+ * @return true on success, false if all callback slots are in use
+ */
+bool nvs_config_add_change_callback(const char *key,
+                                    nvs_config_change_callback_t callback,
+                                    void *arg);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  // NVS_CONFIG_H
@@ -31,6 +31,22 @@ extern "C" {
 #define NVS_KEY_BUTTON_DEBOUNCE_MS "button_debounce"
 #define NVS_KEY_BUTTON_REPEAT_DELAY_MS "button_repeat"
 
+// USB Configuration
+#define NVS_KEY_USB_FAST_KEYBOARD "usb_fast_kbd"
+#define NVS_KEY_USB_NKRO "usb_nkro"
+
+// Program Configuration
+#define NVS_KEY_PROGRAM_ID "program_id"
+
+// Log Configuration
+#define NVS_KEY_LOG_BINARY "log_binary"
+
+// VM Configuration
+#define NVS_KEY_VM_PROFILE "vm_profile"
+
+// Power Configuration
+#define NVS_KEY_POWER_PROFILE "power_profile"
+
 /**
  * @brief Initialize the NVS ODKey module
  *        This initializes NVS flash and ensures the ODKey namespace exists
@@ -0,0 +1,63 @@
+#ifndef POWER_H
+#define POWER_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief Power profiles, selected with the NVS key power_profile
+ */
+typedef enum {
+    POWER_PROFILE_PERFORMANCE = 0,  // Fixed CPU frequency, WiFi minimum modem sleep
+    POWER_PROFILE_BALANCED,         // CPU frequency scaling, WiFi minimum modem sleep
+    POWER_PROFILE_LOW_POWER,        // Frequency scaling, light sleep while USB is
+                                    // detached and WiFi maximum modem sleep
+    POWER_PROFILE_COUNT
+} power_profile_t;
+
+/**
+ * @brief Initialize the power module and apply the configured profile
+ * @return true on success, false on failure
+ * @note Call after nvs_config_init() and before usb_core_init(). While a USB host
+ * is attached, even with the bus suspended, the CPU stays out of light sleep and
+ * keeps the APB clock the USB peripheral needs: the USB peripheral can't wake the
+ * chip, so a host's resume would be missed. Light sleep only happens while USB is
+ * detached, and only the button wakes the device from it.
+ */
+bool power_init(void);
+
+/**
+ * @brief Get the profile in effect
+ * @return Current profile
+ */
+power_profile_t power_get_profile(void);
+
+/**
+ * @brief Get the name of a profile
+ * @param profile Profile
+ * @return Short name (e.g. "balanced"), or "unknown"
+ */
+const char *power_profile_name(power_profile_t profile);
+
+/**
+ * @brief Apply the WiFi modem sleep mode of the current profile
+ * @note Called by the WiFi module once the WiFi driver is initialized
+ */
+void power_apply_wifi_sleep(void);
+
+/**
+ * @brief Report whether a USB host is attached
+ * @param attached true once a host has attached the device, false once it is
+ * detached. Bus suspend and resume don't change it.
+ */
+void power_set_usb_attached(bool attached);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  // POWER_H
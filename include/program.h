@@ -10,16 +10,23 @@ extern "C" {
 #endif
 
 /**
- * @brief Callback function type for sending HID keyboard reports.
+ * @brief Callback function type for scheduling HID keyboard reports.
+ * @param deadline_us esp_timer_get_time() value at which the report should be sent
  * @param modifier Modifier key to send (or 0 to release all modifiers)
  * @param keys Array of keycodes to send (can be NULL to release all keys)
- * @param count Number of keycodes in the array (0-6, more than 6 will be truncated)
+ * @param count Number of keycodes in the array (0-16)
  * @return true on success, false on failure
  */
-typedef bool (*program_hid_send_callback_t)(uint8_t modifier,
+typedef bool (*program_hid_send_callback_t)(int64_t deadline_us,
+                                            uint8_t modifier,
                                             const uint8_t *keys,
                                             uint8_t count);
 
+/**
+ * @brief Callback function type for discarding scheduled HID reports not yet sent
+ */
+typedef void (*program_hid_cancel_callback_t)(void);
+
 /**
  * @brief Callback function type for program execution completion
  * @param arg Optional argument passed to the callback
@@ -28,10 +35,39 @@ typedef void (*program_execution_complete_callback_t)(void *arg);
 
 #define PROGRAM_FLASH_PAGE_SIZE 4096  // Flash page size in bytes
 #define PROGRAM_FLASH_MAX_SIZE \
-    ((1024 * 1024) - PROGRAM_FLASH_PAGE_SIZE)  // Flash program max size in bytes
+    ((1024 * 1024) / 2 - PROGRAM_FLASH_PAGE_SIZE)  // Flash program max size (A/B slot)
 #define PROGRAM_RAM_MAX_SIZE \
     (1024 * 1024)  // RAM program max size in bytes (1MB in PSRAM)
 
+// A program image may be a library of several programs (see ODKeyScript.md)
+#define PROGRAM_LIBRARY_MAGIC 0x4C4B444F  // "ODKL" little-endian
+#define PROGRAM_LIBRARY_VERSION 1
+#define PROGRAM_LIBRARY_HEADER_SIZE 8
+#define PROGRAM_LIBRARY_ENTRY_SIZE 28
+#define PROGRAM_LIBRARY_MAX_PROGRAMS 64
+#define PROGRAM_NAME_MAX_LEN 16  // Including the terminating NUL
+
+/**
+ * @brief Run priority of a program execution request
+ * @note Runs are queued; the highest priority runs first, in arrival order within a
+ * priority. A run that outranks the running program preempts it: the running
+ * program's keys are released and it is not resumed.
+ */
+typedef enum {
+    PROGRAM_PRIORITY_LOW,
+    PROGRAM_PRIORITY_NORMAL,
+    PROGRAM_PRIORITY_HIGH,
+} program_priority_t;
+
+/**
+ * @brief Information about one program of a program image
+ */
+typedef struct {
+    char name[PROGRAM_NAME_MAX_LEN];  // Empty for an image holding a single program
+    uint32_t size;                    // Program size in bytes
+    uint32_t crc;                     // CRC32 of the program bytecode
+} program_info_t;
+
 /**
  * @brief Program type
  */
@@ -42,32 +78,56 @@ typedef enum { PROGRAM_TYPE_FLASH, PROGRAM_TYPE_RAM } program_type_t;
  */
 typedef enum {
     PROGRAM_WRITE_SOURCE_NONE,
-    PROGRAM_WRITE_SOURCE_USB,
+    PROGRAM_WRITE_SOURCE_USB,       // Raw HID commands
+    PROGRAM_WRITE_SOURCE_USB_BULK,  // Vendor bulk interface
     PROGRAM_WRITE_SOURCE_HTTP
 } program_write_source_t;
 
+/**
+ * @brief Reference to a stored program image
+ * @note RAM images are immutable snapshots: a reference keeps its image readable
+ * while a newer RAM program is uploaded or the RAM program is erased. FLASH images
+ * are only retired once runs using them have been halted. Pass every reference
+ * taken with program_acquire() to program_release().
+ */
+typedef struct {
+    const uint8_t *data;  // Program image
+    uint32_t size;        // Image size in bytes
+    void *snapshot;       // RAM snapshot the reference holds (NULL for FLASH)
+} program_ref_t;
+
 /**
  * @brief Initialize program storage and VM task
- * @param hid_send_callback Callback for VM to send HID keyboard reports
+ * @param hid_send_callback Callback for VM to schedule HID keyboard reports
+ * @param hid_cancel_callback Callback for VM to discard scheduled reports on halt
  * @return true on success, false on failure
  */
-bool program_init(program_hid_send_callback_t hid_send_callback);
+bool program_init(program_hid_send_callback_t hid_send_callback,
+                  program_hid_cancel_callback_t hid_cancel_callback);
 
 /**
- * @brief Get pointer to program
+ * @brief Take a reference to a stored program image
  * @param type Program type (FLASH or RAM)
- * @param out_size Pointer to store program size
- * @return Pointer to program data, or NULL if no program or error
+ * @param out_ref Pointer to hold the reference (cleared if there is no program)
+ * @return true if a program is stored, false if no program or error
+ */
+bool program_acquire(program_type_t type, program_ref_t *out_ref);
+
+/**
+ * @brief Release a reference taken with program_acquire()
+ * @param ref Reference to release; cleared, so releasing it again does nothing
  */
-const uint8_t *program_get(program_type_t type, uint32_t *out_size);
+void program_release(program_ref_t *ref);
 
 /**
  * @brief Start writing a new program
  * @param type Program type (FLASH or RAM)
  * @param expected_program_size The expected size of the program to be written
  * @param source The source requesting the write (USB or HTTP)
- * @note For FLASH: First 4KB page is reserved for size header, program data starts at
- * page 1
+ * @note For FLASH: Writes go to the inactive A/B slot, whose first 4KB page is
+ * reserved for the slot header; program data starts at page 1
+ * @note For RAM: The new program is written to a fresh snapshot, so runs of the
+ * previous program keep going while it uploads
  * @note Can interrupt an existing write session from a different source
  * @return true on success, false on failure
  */
@@ -89,7 +149,32 @@ bool program_write_chunk(program_type_t type,
                          program_write_source_t source);
 
 /**
- * @brief Finish writing program (commits the size header for FLASH)
+ * @brief Reserve space to write program data in place, avoiding a staging copy
+ * @param type Program type (RAM only; FLASH must stage pages through
+ * program_write_chunk())
+ * @param out_size Pointer to hold the number of bytes that may be written
+ * @param source The source requesting the reservation (must match current owner)
+ * @return Pointer to write program data to, or NULL on error
+ * @note The buffer stays allocated until program_write_commit() or
+ * program_write_abort() from the same source, so end every reservation with one
+ */
+uint8_t *program_write_reserve(program_type_t type,
+                               uint32_t *out_size,
+                               program_write_source_t source);
+
+/**
+ * @brief Commit program data written through program_write_reserve()
+ * @param type Program type (RAM only)
+ * @param size Number of bytes written at the reserved pointer
+ * @param source The source requesting the commit (must match current owner)
+ * @return true on success, false on failure
+ */
+bool program_write_commit(program_type_t type,
+                          uint32_t size,
+                          program_write_source_t source);
+
+/**
+ * @brief Finish writing program (writes the slot header for FLASH)
  * @param type Program type (FLASH or RAM)
  * @param program_size The size, in bytes, of the program data
  * @param source The source requesting the finish (must match current owner)
@@ -99,6 +184,66 @@ bool program_write_finish(program_type_t type,
                           uint32_t program_size,
                           program_write_source_t source);
 
+/**
+ * @brief Abandon an unfinished write session, e.g. after a transfer error
+ * @param type Program type (FLASH or RAM)
+ * @param source The source that started the session; another source's session is
+ * left alone
+ * @note The stored program is unaffected for FLASH. For RAM it was already dropped
+ * when the session started, and runs streaming the session stop.
+ */
+void program_write_abort(program_type_t type, program_write_source_t source);
+
+/**
+ * @brief Get CRC32 hashes of each PROGRAM_FLASH_PAGE_SIZE page of a stored program
+ * @param type Program type (FLASH only)
+ * @param out_hashes Array to hold one hash per page
+ * @param max_hashes Capacity of out_hashes
+ * @param out_count Pointer to hold the number of pages hashed
+ * @return true on success, false if no program is stored or type is unsupported
+ */
+bool program_get_page_hashes(program_type_t type,
+                             uint32_t *out_hashes,
+                             uint32_t max_hashes,
+                             uint32_t *out_count);
+
+/**
+ * @brief Start a delta upload that only sends the pages that changed
+ * @param type Program type (FLASH only)
+ * @param program_size The size of the new program
+ * @param source The source requesting the write (USB or HTTP)
+ * @return true on success, false on failure
+ */
+bool program_patch_start(program_type_t type,
+                         uint32_t program_size,
+                         program_write_source_t source);
+
+/**
+ * @brief Write one changed page of a delta upload
+ * @param type Program type (FLASH only)
+ * @param page_index Index of the page within the program (ascending order)
+ * @param data PROGRAM_FLASH_PAGE_SIZE bytes of page data (zero padded)
+ * @param source The source requesting the write (must match current owner)
+ * @return true on success, false on failure
+ */
+bool program_patch_page(program_type_t type,
+                        uint32_t page_index,
+                        const uint8_t *data,
+                        program_write_source_t source);
+
+/**
+ * @brief Finish a delta upload (unchanged pages are copied from the current program)
+ * @param type Program type (FLASH only)
+ * @param program_size The size of the new program
+ * @param program_crc CRC32 of the whole new program
+ * @param source The source requesting the finish (must match current owner)
+ * @return true on success, false on failure or CRC mismatch
+ */
+bool program_patch_finish(program_type_t type,
+                          uint32_t program_size,
+                          uint32_t program_crc,
+                          program_write_source_t source);
+
 /**
  * @brief Get number of bytes written so far
  * @param type Program type (FLASH or RAM)
@@ -117,20 +262,146 @@ uint32_t program_get_expected_size(program_type_t type);
  * @brief Erase program
  * @param type Program type (FLASH or RAM)
  * @return true on success, false on failure
+ * @note Erasing FLASH halts the VM; runs of an erased RAM program finish normally
  */
 bool program_erase(program_type_t type);
 
 /**
- * @brief Execute a program from storage
+ * @brief Execute the selected program from storage at normal priority
  * @param type Program type (FLASH or RAM)
  * @param on_complete Optional callback invoked when program execution completes
  * @param on_complete_arg Optional argument passed to the completion callback
- * @return true if program started, false if no program, already running, or error
+ * @return true if program was queued, false if no program, queue full, or error
  */
 bool program_execute(program_type_t type,
                      program_execution_complete_callback_t on_complete,
                      void *on_complete_arg);
 
+/**
+ * @brief Queue the selected program from storage for execution
+ * @param type Program type (FLASH or RAM)
+ * @param priority Run priority
+ * @param on_complete Optional callback invoked when program execution completes
+ * @param on_complete_arg Optional argument passed to the completion callback
+ * @param out_position Optional output: number of runs that will execute first (0 if
+ * it starts right away)
+ * @return true if program was queued, false if no program, queue full, or error
+ * @note Activating a FLASH upload halts the running program and drops queued runs,
+ * since it retires the slot they run from. A FLASH run queued during activation
+ * waits for it and runs the new program.
+ */
+bool program_enqueue(program_type_t type,
+                     program_priority_t priority,
+                     program_execution_complete_callback_t on_complete,
+                     void *on_complete_arg,
+                     uint32_t *out_position);
+
+/**
+ * @brief Execute the program being written while the write session continues
+ * @param type Program type (RAM only)
+ * @param on_complete Optional callback invoked when program execution completes
+ * @param on_complete_arg Optional argument passed to the completion callback
+ * @return true if program was queued, false if no write session, queue full, or
+ * error
+ * @note Call after program_write_start(), which halts any running program. The VM
+ * runs up to the bytes written so far and waits for more when it catches up, so
+ * the first keystroke doesn't wait for the whole upload. Compressed programs
+ * cannot be streamed.
+ */
+bool program_execute_streaming(program_type_t type,
+                               program_execution_complete_callback_t on_complete,
+                               void *on_complete_arg);
+
+/**
+ * @brief Get the number of programs in a program image
+ * @param type Program type (FLASH or RAM)
+ * @return Number of programs in the library, 1 for a plain program, or 0 if no
+ * valid program is stored
+ */
+uint32_t program_get_count(program_type_t type);
+
+/**
+ * @brief Get information about a program in a program image
+ * @param type Program type (FLASH or RAM)
+ * @param id Index of the program (0 for a plain program)
+ * @param out_info Pointer to hold the program information
+ * @return true on success, false if there is no such program
+ * @note The crc of a plain program is only filled in for FLASH
+ */
+bool program_get_info(program_type_t type, uint32_t id, program_info_t *out_info);
+
+/**
+ * @brief Find a program in a library by name
+ * @param type Program type (FLASH or RAM)
+ * @param name Program name
+ * @param out_id Pointer to hold the index of the program
+ * @return true if found, false otherwise
+ */
+bool program_find(program_type_t type, const char *name, uint32_t *out_id);
+
+/**
+ * @brief Select the program that program_execute() runs
+ * @param type Program type (FLASH or RAM)
+ * @param id Index of the program
+ * @return true on success, false if there is no such program or its CRC is wrong
+ * @note Only the index is stored (in NVS for FLASH), so switching programs never
+ * rewrites program storage. An out-of-range selection, e.g. after a smaller
+ * library is uploaded, falls back to program 0.
+ */
+bool program_select(program_type_t type, uint32_t id);
+
+/**
+ * @brief Get the selected program index
+ * @param type Program type (FLASH or RAM)
+ * @return Index of the selected program
+ */
+uint32_t program_get_selected(program_type_t type);
+
+/**
+ * @brief Execute a program from a program image at normal priority
+ * @param type Program type (FLASH or RAM)
+ * @param id Index of the program (0 for a plain program)
+ * @param on_complete Optional callback invoked when program execution completes
+ * @param on_complete_arg Optional argument passed to the completion callback
+ * @return true if program was queued, false if no such program, queue full, or
+ * error
+ */
+bool program_execute_by_id(program_type_t type,
+                           uint32_t id,
+                           program_execution_complete_callback_t on_complete,
+                           void *on_complete_arg);
+
+/**
+ * @brief Queue a program from a program image for execution
+ * @param type Program type (FLASH or RAM)
+ * @param id Index of the program (0 for a plain program)
+ * @param priority Run priority
+ * @param on_complete Optional callback invoked when program execution completes
+ * @param on_complete_arg Optional argument passed to the completion callback
+ * @param out_position Optional output: number of runs that will execute first
+ * @return true if program was queued, false if no such program, queue full, or
+ * error
+ */
+bool program_enqueue_by_id(program_type_t type,
+                           uint32_t id,
+                           program_priority_t priority,
+                           program_execution_complete_callback_t on_complete,
+                           void *on_complete_arg,
+                           uint32_t *out_position);
+
+/**
+ * @brief Get the number of runs waiting behind the running program
+ * @return Number of queued runs
+ */
+uint32_t program_get_queue_length(void);
+
+/**
+ * @brief Wait until no program is running or queued
+ * @param timeout_ms Maximum time to wait (0 to check without blocking)
+ * @return true if idle, false on timeout
+ */
+bool program_wait_idle(uint32_t timeout_ms);
+
 /**
  * @brief Check if a program is currently running
  * @return true if running, false if idle
@@ -138,7 +409,7 @@ bool program_execute(program_type_t type,
 bool program_is_running(void);
 
 /**
- * @brief Halt the currently running program
+ * @brief Halt the currently running program and drop all queued runs
  * @return true if halted successfully, false if not running or error
  */
 bool program_halt(void);
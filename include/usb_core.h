@@ -13,6 +13,7 @@ extern "C" {
  */
 #define USB_KEYBOARD_INTERFACE_NUM 0
 #define USB_SYSTEM_CONFIG_INTERFACE_NUM 1
+#define USB_VENDOR_INTERFACE_NUM 2  // Only present when CONFIG_TINYUSB_VENDOR_COUNT > 0
 
 /**
  * @brief Initialize the USB core module
@@ -20,6 +21,12 @@ extern "C" {
  */
 bool usb_core_init(void);
 
+/**
+ * @brief Check if the keyboard interface uses the N-key rollover report descriptor
+ * @return true if NKRO mode is enabled (valid after usb_core_init())
+ */
+bool usb_core_keyboard_nkro_enabled(void);
+
 /**
  * @brief Check if USB core is ready
  * @return true if ready, false otherwise
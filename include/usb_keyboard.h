@@ -8,18 +8,31 @@
 extern "C" {
 #endif
 
+// Maximum number of keycodes in a single keyboard report
+#define USB_KEYBOARD_MAX_KEYS 16
+
+// Number of keycodes available in a boot protocol (6KRO) keyboard report
+#define USB_KEYBOARD_BOOT_MAX_KEYS 6
+
+// N-key rollover report layout: modifier byte followed by a bitmap of keycodes
+// 0x00-USB_KEYBOARD_NKRO_MAX_KEYCODE (modifier keycodes map to the modifier byte)
+#define USB_KEYBOARD_NKRO_MAX_KEYCODE 0xDF
+#define USB_KEYBOARD_NKRO_REPORT_SIZE (1 + (USB_KEYBOARD_NKRO_MAX_KEYCODE + 1) / 8)
+
 /**
  * @brief Initialize the USB keyboard module
  * @param interface_num USB HID interface number to use for keyboard reports
+ * @param nkro true if the interface uses the N-key rollover report descriptor
  * @return true on success, false on failure
  */
-bool usb_keyboard_init(uint8_t interface_num);
+bool usb_keyboard_init(uint8_t interface_num, bool nkro);
 
 /**
  * @brief Send keycodes to the USB keyboard (asynchronous)
  * @param modifier Modifier key to send (or 0 to release all modifiers)
  * @param keys Array of keycodes to send (can be NULL to release all keys)
- * @param count Number of keycodes in the array (0-6, more than 6 will be truncated)
+ * @param count Number of keycodes in the array (0-USB_KEYBOARD_MAX_KEYS, more will be
+ * truncated). Without N-key rollover, more than 6 keys are reported as rollover errors
  * @return true if report was enqueued successfully, false if queue is full or module
  * not initialized
  * @note This function is non-blocking and enqueues the report for asynchronous
@@ -28,6 +41,35 @@ bool usb_keyboard_init(uint8_t interface_num);
  */
 bool usb_keyboard_send_keys(uint8_t modifier, const uint8_t *keys, uint8_t count);
 
+/**
+ * @brief Schedule keycodes to be sent to the USB keyboard at a specific time
+ * @param deadline_us esp_timer_get_time() value at which the report should be sent
+ * (reports with a deadline in the past are sent as soon as possible)
+ * @param modifier Modifier key to send (or 0 to release all modifiers)
+ * @param keys Array of keycodes to send (can be NULL to release all keys)
+ * @param count Number of keycodes in the array (0-USB_KEYBOARD_MAX_KEYS, more will be
+ * truncated). Without N-key rollover, more than 6 keys are reported as rollover errors
+ * @return true if report was enqueued successfully, false if the queue stayed full or
+ * module not initialized
+ * @note Reports are sent in the order they are scheduled, so deadlines must not
+ * decrease. Blocks while the schedule queue is full.
+ */
+bool usb_keyboard_schedule_keys(int64_t deadline_us,
+                                uint8_t modifier,
+                                const uint8_t *keys,
+                                uint8_t count);
+
+/**
+ * @brief Discard all reports that have been scheduled but not yet sent
+ */
+void usb_keyboard_cancel_scheduled(void);
+
+/**
+ * @brief Notify the keyboard module that a keyboard report transfer has completed
+ * @note Called from the TinyUSB report complete callback
+ */
+void usb_keyboard_report_complete(void);
+
 #ifdef __cplusplus
 }
 #endif
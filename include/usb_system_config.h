@@ -23,6 +23,13 @@ bool usb_system_config_init(uint8_t interface_num);
  */
 void usb_system_config_process_command(const uint8_t *data, uint16_t len);
 
+/**
+ * @brief Notify the bulk transfer backend that vendor interface data is available
+ * @note Called from the TinyUSB vendor receive callback. Does nothing when the
+ * vendor interface is disabled (CONFIG_TINYUSB_VENDOR_COUNT = 0).
+ */
+void usb_system_config_bulk_rx_notify(void);
+
 #ifdef __cplusplus
 }
 #endif
@@ -7,14 +7,19 @@ compilation, disassembly, and USB upload.
 """
 
 import argparse
+import json
 import sys
 from pathlib import Path
 from typing import Any, Union
 
 from .config import ODKeyConfigHttp, ODKeyConfigUsb, ODKeyUploadError
+from .config.batch import BatchError, decode_response, encode_batch
 from .config.constants import PROGRAM_FLASH_MAX_SIZE, PROGRAM_RAM_MAX_SIZE
 from .odkeyscript.odkeyscript_compiler import CompileError, Compiler
-from .odkeyscript.odkeyscript_disassembler import disassemble
+from .odkeyscript.odkeyscript_compression import is_compressed
+from .odkeyscript.odkeyscript_disassembler import disassemble, opcode_names
+from .odkeyscript.odkeyscript_library import build_library
+from .odkeyscript.odkeyscript_profile import format_summary, parse_profile
 
 
 # Helper functions
@@ -74,7 +79,62 @@ def add_target_args(parser: argparse.ArgumentParser, default: str = "ram") -> No
     )
 
 
-def load_program_data(input_path: Path) -> bytes:
+def add_fast_type_args(parser: argparse.ArgumentParser) -> None:
+    """Add fast type compile arguments"""
+    parser.add_argument(
+        "--fast-type",
+        action="store_true",
+        help="Compile type commands without press/interkey waits "
+        "(for use with the usb_fast_kbd setting)",
+    )
+
+
+def add_optimize_args(parser: argparse.ArgumentParser) -> None:
+    """Add bytecode optimization compile arguments"""
+    parser.add_argument(
+        "--no-optimize",
+        dest="optimize",
+        action="store_false",
+        help="Emit bytecode without running the peephole optimizer",
+    )
+
+
+def add_legacy_loops_args(parser: argparse.ArgumentParser) -> None:
+    """Add repeat loop compile arguments"""
+    parser.add_argument(
+        "--legacy-loops",
+        action="store_true",
+        help="Compile repeat loops with SET_COUNTER/DEC/JNZ counters instead of "
+        "the VM loop stack (for firmware without PUSH_LOOP/NEXT)",
+    )
+
+
+def print_optimization(compiler: Compiler) -> None:
+    """Print the bytecode size before and after optimization"""
+    if compiler.optimize:
+        print(
+            f"Optimized from {compiler.unoptimized_size} "
+            f"to {compiler.optimized_size} bytes"
+        )
+
+
+def add_compress_args(parser: argparse.ArgumentParser) -> None:
+    """Add bytecode compression compile arguments"""
+    parser.add_argument(
+        "--compress",
+        action="store_true",
+        help="Pack the bytecode into a compressed program container "
+        "(used only when it is smaller)",
+    )
+
+
+def load_program_data(
+    input_path: Path,
+    fast_type: bool = False,
+    compress: bool = False,
+    optimize: bool = True,
+    legacy_loops: bool = False,
+) -> bytes:
     """Load program data from .odk or .bin file"""
     if input_path.suffix.lower() == ".odk":
         print(f"Compiling ODKeyScript source: {input_path}")
@@ -82,8 +142,14 @@ def load_program_data(input_path: Path) -> bytes:
             with open(input_path, "r", encoding="utf-8") as f:
                 source = f.read()
 
-            compiler = Compiler()
+            compiler = Compiler(
+                fast_type=fast_type,
+                compress=compress,
+                optimize=optimize,
+                legacy_loops=legacy_loops,
+            )
             program_data = compiler.compile(source)
+            print_optimization(compiler)
             print(f"Compiled to {len(program_data)} bytes")
             return program_data
 
@@ -144,14 +210,30 @@ def check_program_size(program_data: bytes, target: str) -> None:
         raise ValueError(f"Program too large for {target}")
 
 
+def check_streamable(program_data: bytes, args: Any) -> None:
+    """Check that an upload can be executed while it streams to the device"""
+    if args.interface != "http":
+        raise ValueError("--stream requires --interface http")
+    if args.target != "ram":
+        raise ValueError("--stream requires --target ram")
+    if is_compressed(program_data):
+        raise ValueError("Compressed programs cannot be streamed")
+
+
 def compile_command(args: Any) -> int:
     """Handle the compile command"""
     try:
         with open(args.input, "r", encoding="utf-8") as f:
             source = f.read()
 
-        compiler = Compiler()
+        compiler = Compiler(
+            fast_type=args.fast_type,
+            compress=args.compress,
+            optimize=args.optimize,
+            legacy_loops=args.legacy_loops,
+        )
         bytecode = compiler.compile(source)
+        print_optimization(compiler)
 
         with open(args.output, "wb") as f:
             f.write(bytecode)
@@ -173,7 +255,12 @@ def disassemble_command(args: Any) -> int:
         with open(args.input, "rb") as f:
             bytecode = f.read()
 
-        disassembly_lines = disassemble(bytecode)
+        profile = None
+        if args.profile:
+            with open(args.profile, "rb") as f:
+                profile = parse_profile(f.read())
+
+        disassembly_lines = disassemble(bytecode, profile)
         for line in disassembly_lines:
             print(line)
         return 0
@@ -183,11 +270,50 @@ def disassemble_command(args: Any) -> int:
         return 1
 
 
+def library_command(args: Any) -> int:
+    """Handle the library command"""
+    try:
+        programs = []
+        for input_path in args.inputs:
+            program_data = load_program_data(
+                input_path,
+                args.fast_type,
+                args.compress,
+                args.optimize,
+                args.legacy_loops,
+            )
+            programs.append((input_path.stem, program_data))
+
+        library = build_library(programs)
+        check_program_size(library, "flash")
+
+        with open(args.output, "wb") as f:
+            f.write(library)
+
+        for i, (name, program_data) in enumerate(programs):
+            print(f"{i}: {name} ({len(program_data)} bytes)")
+        print(
+            f"Wrote library of {len(programs)} programs to {args.output} "
+            f"({len(library)} bytes)"
+        )
+        return 0
+
+    except CompileError:
+        return 1
+    except Exception as e:
+        print(f"Error: {e}")
+        return 1
+
+
 def upload_command(args: Any) -> int:
     """Handle the upload command"""
     try:
-        program_data = load_program_data(args.input)
+        program_data = load_program_data(
+            args.input, args.fast_type, args.compress, args.optimize, args.legacy_loops
+        )
         check_program_size(program_data, args.target)
+        if args.stream:
+            check_streamable(program_data, args)
         
         config = create_config(args)
         
@@ -195,13 +321,18 @@ def upload_command(args: Any) -> int:
             if args.interface == "usb" and not config.find_device():
                 return 1
 
-            if not config.upload_program(program_data, target=args.target):
+            if args.stream:
+                if not config.upload_program(
+                    program_data, target=args.target, stream=True
+                ):
+                    return 1
+            elif not config.upload_program(program_data, target=args.target):
                 return 1
 
             print("Upload completed successfully!")
 
-            # Execute program if requested
-            if args.execute:
+            # Execute program if requested (streamed programs are already running)
+            if args.execute and not args.stream:
                 print(f"Executing {args.target.upper()} program...")
                 if not config.execute_program(target=args.target):
                     print("Execution failed!")
@@ -278,10 +409,18 @@ def execute_command(args: Any) -> int:
             return 1
 
         # Execute program
-        if not config.execute_program(target=args.target):
+        if args.priority != "normal" or args.wait:
+            if args.interface != "http":
+                print("Error: --priority and --wait require --interface http")
+                return 1
+            if not config.execute_program(
+                target=args.target, priority=args.priority, wait_ms=args.wait
+            ):
+                return 1
+        elif not config.execute_program(target=args.target):
             return 1
 
-        print("Execution started successfully!")
+        print("Execution queued successfully!")
         return 0
 
     except Exception as e:
@@ -291,6 +430,59 @@ def execute_command(args: Any) -> int:
         config.close()
 
 
+def programs_command(args: Any) -> int:
+    """Handle the programs command"""
+    if args.interface != "http":
+        print("Error: programs requires --interface http")
+        return 1
+
+    config = create_config(args)
+
+    try:
+        listing = config.list_programs()
+        if listing is None:
+            return 1
+
+        for program in listing["programs"]:
+            marker = "*" if program["id"] == listing["selected"] else " "
+            name = program["name"] or "(unnamed)"
+            print(
+                f"{marker} {program['id']}: {name} ({program['size']} bytes, "
+                f"crc 0x{program['crc']:08X})"
+            )
+        return 0
+
+    except Exception as e:
+        print(f"Program list failed: {e}")
+        return 1
+    finally:
+        config.close()
+
+
+def select_command(args: Any) -> int:
+    """Handle the select command"""
+    config = create_config(args)
+
+    try:
+        if args.interface == "usb" and not config.find_device():
+            return 1
+
+        # A numeric argument selects by id, anything else by name
+        program: Union[int, str] = (
+            int(args.program) if args.program.isdigit() else args.program
+        )
+        if not config.select_program(program):
+            return 1
+
+        return 0
+
+    except Exception as e:
+        print(f"Select failed: {e}")
+        return 1
+    finally:
+        config.close()
+
+
 def nvs_set_command(args: Any) -> int:
     """Handle the nvs-set command"""
     config = create_config(args)
@@ -420,6 +612,10 @@ def list_devices_command(args: Any) -> int:
 
 def log_download_command(args: Any) -> int:
     """Handle the log command"""
+    if args.follow and args.interface != "http":
+        print("Error: log --follow requires --interface http")
+        return 1
+
     config = create_config(args)
     
     try:
@@ -427,18 +623,33 @@ def log_download_command(args: Any) -> int:
             return 1
 
         # Download logs (streams to stdout or file)
+        next_seq = None
         if args.output:
             # Stream to file
             try:
                 with open(args.output, "w", encoding="utf-8") as f:
-                    config.download_logs(f)
+                    if args.follow:
+                        config.follow_logs(f, args.after)
+                    else:
+                        next_seq = config.download_logs(f, args.after)
+                print(f"\nLogs saved to {args.output}")
+            except KeyboardInterrupt:
                 print(f"\nLogs saved to {args.output}")
             except Exception as e:
                 print(f"Error saving logs to file: {e}")
                 return 1
+        elif args.follow:
+            try:
+                config.follow_logs(None, args.after)
+            except KeyboardInterrupt:
+                pass
         else:
             # Stream to stdout
-            config.download_logs()
+            next_seq = config.download_logs(None, args.after)
+
+        # Report where the next incremental download should start
+        if next_seq is not None:
+            print(f"Next log sequence: {next_seq}", file=sys.stderr)
 
         return 0
 
@@ -470,6 +681,116 @@ def log_clear_command(args: Any) -> int:
         config.close()
 
 
+def stats_command(args: Any) -> int:
+    """Handle the stats command"""
+    config = create_config(args)
+
+    try:
+        if args.interface == "usb" and not config.find_device():
+            return 1
+
+        if args.reset:
+            return 0 if config.reset_stats() else 1
+
+        stats = config.get_stats()
+        if stats is None:
+            return 1
+
+        print(
+            f"{'Stage':<10} {'Count':>8} {'Min us':>9} {'p50 us':>9} "
+            f"{'p99 us':>9} {'Max us':>9}"
+        )
+        for name, stage in stats.items():
+            keys = ["min_us", "p50_us", "p99_us", "max_us"]
+            values = [stage[k] if stage["samples"] else "-" for k in keys]
+            print(
+                f"{name:<10} {stage['count']:>8} "
+                + " ".join(f"{value:>9}" for value in values)
+            )
+        return 0
+
+    except Exception as e:
+        print(f"Stats failed: {e}")
+        return 1
+    finally:
+        config.close()
+
+
+def profile_command(args: Any) -> int:
+    """Handle the profile command"""
+    config = create_config(args)
+
+    try:
+        if args.interface == "usb" and not config.find_device():
+            return 1
+
+        if args.reset:
+            return 0 if config.reset_profile() else 1
+
+        image = config.get_profile()
+        if image is None:
+            return 1
+
+        if args.output:
+            with open(args.output, "wb") as f:
+                f.write(image)
+            print(f"Profile saved to {args.output}")
+
+        profile = parse_profile(image)
+        if args.program:
+            with open(args.program, "rb") as f:
+                lines = disassemble(f.read(), profile)
+        else:
+            lines = format_summary(profile, opcode_names())
+        for line in lines:
+            print(line)
+        return 0
+
+    except Exception as e:
+        print(f"Profile failed: {e}")
+        return 1
+    finally:
+        config.close()
+
+
+def batch_command(args: Any) -> int:
+    """Handle the batch command"""
+    try:
+        with open(args.input, "r") as f:
+            operations = json.load(f)
+        batch = encode_batch(operations)
+    except (OSError, ValueError, KeyError, BatchError) as e:
+        print(f"Error: {e}")
+        return 1
+
+    config = create_config(args)
+
+    try:
+        if args.interface == "usb" and not config.find_device():
+            return 1
+
+        response = config.run_batch(batch)
+        if response is None:
+            return 1
+
+        result = decode_response(operations, response)
+        for index, op_result in enumerate(result["results"]):
+            details = ", ".join(
+                f"{name}={value.hex() if isinstance(value, bytes) else value}"
+                for name, value in op_result.items()
+                if name not in ("op", "status")
+            )
+            print(f"{index:>3} {op_result['op']:<8} {op_result['status']:<10} {details}")
+        print(f"Batch {result['status']}")
+        return 0 if result["status"] == "ok" else 1
+
+    except Exception as e:
+        print(f"Batch failed: {e}")
+        return 1
+    finally:
+        config.close()
+
+
 def main() -> int:
     """Main CLI entry point"""
     parser = argparse.ArgumentParser(
@@ -486,12 +807,18 @@ Examples:
   %(prog)s download --target flash             # Download from flash
   %(prog)s execute                             # Execute RAM program (default)
   %(prog)s execute --target flash              # Execute flash program
+  %(prog)s library lib.bin a.odk b.odk         # Build a flash program library
+  %(prog)s programs -i http                    # List flash library programs
+  %(prog)s select b                            # Select a library program
   %(prog)s nvs-set wifi_ssid "MyNetwork"       # Set a string value
   %(prog)s nvs-set http_port 80 --type u16     # Set an integer value
   %(prog)s nvs-set cert --file cert.pem --type blob  # Set blob from file
   %(prog)s nvs-get wifi_ssid                   # Get a value
   %(prog)s nvs-get cert --output cert.pem      # Get and save to file
   %(prog)s nvs-delete wifi_ssid                # Delete a key
+  %(prog)s batch setup.json                    # Run NVS/program operations at once
+  %(prog)s stats                               # Show button-to-host latency
+  %(prog)s profile --program program.bin       # Annotate a program with its profile
   %(prog)s list-devices                        # List available HID devices
         """,
     )
@@ -504,12 +831,19 @@ Examples:
     )
     compile_parser.add_argument("input", type=Path, help="Input .odk source file")
     compile_parser.add_argument("output", type=Path, help="Output .bin bytecode file")
+    add_fast_type_args(compile_parser)
+    add_optimize_args(compile_parser)
+    add_compress_args(compile_parser)
+    add_legacy_loops_args(compile_parser)
 
     # Disassemble command
     disassemble_parser = subparsers.add_parser(
         "disassemble", help="Disassemble bytecode to text"
     )
     disassemble_parser.add_argument("input", type=Path, help="Input .bin bytecode file")
+    disassemble_parser.add_argument(
+        "--profile", type=Path, help="Annotate with a profile saved by 'profile -o'"
+    )
 
     # Upload command
     upload_parser = subparsers.add_parser(
@@ -520,11 +854,20 @@ Examples:
     )
     add_device_args(upload_parser)
     add_target_args(upload_parser, default="ram")
+    add_fast_type_args(upload_parser)
+    add_optimize_args(upload_parser)
+    add_compress_args(upload_parser)
+    add_legacy_loops_args(upload_parser)
     upload_parser.add_argument(
         "--execute",
         action="store_true",
         help="Execute program after upload",
     )
+    upload_parser.add_argument(
+        "--stream",
+        action="store_true",
+        help="Start executing a RAM program while it uploads (HTTP only)",
+    )
     upload_parser.add_argument(
         "--verbose", "-v", action="store_true", help="Enable verbose output"
     )
@@ -550,8 +893,51 @@ Examples:
         "execute", help="Execute program on ODKey device"
     )
     add_target_args(execute_parser, default="ram")
+    execute_parser.add_argument(
+        "--priority",
+        choices=["low", "normal", "high"],
+        default="normal",
+        help="Run priority; a higher-priority run preempts the running program "
+        "(HTTP only, default: normal)",
+    )
+    execute_parser.add_argument(
+        "--wait",
+        type=int,
+        default=0,
+        metavar="MS",
+        help="Wait up to MS milliseconds for all queued runs to finish (HTTP only)",
+    )
     add_device_args(execute_parser)
 
+    # Library command
+    library_parser = subparsers.add_parser(
+        "library", help="Build a flash program library from several programs"
+    )
+    library_parser.add_argument("output", type=Path, help="Output .bin library file")
+    library_parser.add_argument(
+        "inputs",
+        type=Path,
+        nargs="+",
+        help="Input files (.odk source or .bin bytecode), named by file stem",
+    )
+    add_fast_type_args(library_parser)
+    add_optimize_args(library_parser)
+    add_compress_args(library_parser)
+    add_legacy_loops_args(library_parser)
+
+    # Programs command
+    programs_parser = subparsers.add_parser(
+        "programs", help="List the programs of the flash program library (HTTP only)"
+    )
+    add_device_args(programs_parser)
+
+    # Select command
+    select_parser = subparsers.add_parser(
+        "select", help="Select the flash library program to execute"
+    )
+    select_parser.add_argument("program", help="Program id or name")
+    add_device_args(select_parser)
+
     # NVS set command
     nvs_set_parser = subparsers.add_parser("nvs-set", help="Set a value in NVS storage")
     nvs_set_parser.add_argument("key", help="NVS key (max 15 characters)")
@@ -600,6 +986,19 @@ Examples:
     log_parser.add_argument(
         "--output", "-o", type=Path, help="Save logs to file"
     )
+    log_parser.add_argument(
+        "--after",
+        type=int,
+        metavar="SEQ",
+        help="Only download logs written after this sequence number "
+        "(printed at the end of each download)",
+    )
+    log_parser.add_argument(
+        "--follow",
+        "-f",
+        action="store_true",
+        help="Keep streaming new logs as they are written (HTTP only)",
+    )
     add_device_args(log_parser)
 
     # Log clear command
@@ -608,6 +1007,37 @@ Examples:
     )
     add_device_args(log_clear_parser)
 
+    # Latency statistics command
+    stats_parser = subparsers.add_parser(
+        "stats", help="Show button-to-host latency statistics of ODKey device"
+    )
+    stats_parser.add_argument(
+        "--reset", action="store_true", help="Reset the statistics instead"
+    )
+    add_device_args(stats_parser)
+
+    # Batch command
+    batch_parser = subparsers.add_parser(
+        "batch", help="Run a JSON list of NVS and program operations in one request"
+    )
+    batch_parser.add_argument("input", type=Path, help="JSON file of operations")
+    add_device_args(batch_parser)
+
+    # VM profile command
+    profile_parser = subparsers.add_parser(
+        "profile", help="Download the VM profile of ODKey device"
+    )
+    profile_parser.add_argument(
+        "--program", type=Path, help="Disassemble this program with the profile"
+    )
+    profile_parser.add_argument(
+        "--output", "-o", type=Path, help="Save the profile image to a file"
+    )
+    profile_parser.add_argument(
+        "--reset", action="store_true", help="Reset the profile instead"
+    )
+    add_device_args(profile_parser)
+
     # List devices command
     subparsers.add_parser("list-devices", help="List available HID devices")
 
@@ -628,18 +1058,30 @@ Examples:
         return download_command(args)
     elif args.command == "execute":
         return execute_command(args)
+    elif args.command == "library":
+        return library_command(args)
+    elif args.command == "programs":
+        return programs_command(args)
+    elif args.command == "select":
+        return select_command(args)
     elif args.command == "nvs-set":
         return nvs_set_command(args)
     elif args.command == "nvs-get":
         return nvs_get_command(args)
     elif args.command == "nvs-delete":
         return nvs_delete_command(args)
+    elif args.command == "batch":
+        return batch_command(args)
     elif args.command == "list-devices":
         return list_devices_command(args)
     elif args.command == "log":
         return log_download_command(args)
     elif args.command == "log-clear":
         return log_clear_command(args)
+    elif args.command == "stats":
+        return stats_command(args)
+    elif args.command == "profile":
+        return profile_command(args)
     else:
         print(f"Unknown command: {args.command}")
         return 1
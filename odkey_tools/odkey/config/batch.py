@@ -0,0 +1,190 @@
+"""
+ODKey configuration batches
+
+Encodes a list of NVS and program operations into the binary batch run by the
+firmware (POST /api/batch or the USB batch commands) and decodes its response.
+The format matches include/config_batch.h.
+
+Operations are dictionaries:
+    {"op": "set", "key": "http_port", "type": "u16", "value": 8080}
+    {"op": "get", "key": "http_port"}
+    {"op": "delete", "key": "http_port"}
+    {"op": "select", "program": 1}          (id or name of a flash library program)
+    {"op": "execute", "target": "flash", "priority": "normal"}
+"""
+
+import struct
+from typing import Any, Dict, List
+
+# Largest batch request and response (matching CONFIG_BATCH_MAX_SIZE)
+BATCH_MAX_SIZE = 2048
+
+# Operation codes
+OP_NVS_SET = 0x01
+OP_NVS_GET = 0x02
+OP_NVS_DELETE = 0x03
+OP_SELECT = 0x04
+OP_EXECUTE = 0x05
+
+# Status of the batch and of each operation
+STATUS_NAMES = {
+    0x00: "ok",
+    0x01: "not_found",
+    0x02: "failed",
+    0x03: "skipped",
+    0x04: "too_large",
+}
+STATUS_OK = 0x00
+
+SELECT_BY_NAME = 0xFFFFFFFF
+KEY_MAX_LEN = 15
+NAME_MAX_LEN = 15
+
+# NVS types (matching ESP-IDF nvs.h) and their struct formats for integers
+TYPE_TO_BYTE = {
+    "u8": 0x01,
+    "i8": 0x11,
+    "u16": 0x02,
+    "i16": 0x12,
+    "u32": 0x04,
+    "i32": 0x14,
+    "u64": 0x08,
+    "i64": 0x18,
+    "string": 0x21,
+    "blob": 0x42,
+}
+BYTE_TO_TYPE = {v: k for k, v in TYPE_TO_BYTE.items()}
+INTEGER_FORMATS = {
+    "u8": "<B",
+    "i8": "<b",
+    "u16": "<H",
+    "i16": "<h",
+    "u32": "<I",
+    "i32": "<i",
+    "u64": "<Q",
+    "i64": "<q",
+}
+
+TARGETS = {"flash": 0, "ram": 1}
+PRIORITIES = {"low": 0, "normal": 1, "high": 2}
+
+
+class BatchError(Exception):
+    """Invalid batch operation or response"""
+
+
+def _encode_key(key: str) -> bytes:
+    data = key.encode("utf-8")
+    if not 0 < len(data) <= KEY_MAX_LEN:
+        raise BatchError(f"Invalid key '{key}' (1 to {KEY_MAX_LEN} characters)")
+    return struct.pack("<B", len(data)) + data
+
+
+def _encode_value(value_type: str, value: Any) -> bytes:
+    if value_type in INTEGER_FORMATS:
+        try:
+            return struct.pack(INTEGER_FORMATS[value_type], int(value))
+        except struct.error:
+            raise BatchError(f"Value {value} out of range for {value_type}")
+    elif value_type == "string":
+        return value.encode("utf-8")
+    elif value_type == "blob":
+        return bytes.fromhex(value) if isinstance(value, str) else bytes(value)
+    raise BatchError(f"Invalid type '{value_type}'")
+
+
+def encode_batch(operations: List[Dict[str, Any]]) -> bytes:
+    """
+    Encode operations into a batch request
+
+    Args:
+        operations: Operations (see the module documentation)
+
+    Returns:
+        Batch request
+    """
+    batch = bytearray()
+    for operation in operations:
+        op = operation.get("op")
+        if op == "set":
+            value_type = operation.get("type", "string")
+            value = _encode_value(value_type, operation["value"])
+            batch += struct.pack("<B", OP_NVS_SET) + _encode_key(operation["key"])
+            batch += struct.pack("<BH", TYPE_TO_BYTE[value_type], len(value)) + value
+        elif op in ("get", "delete"):
+            code = OP_NVS_GET if op == "get" else OP_NVS_DELETE
+            batch += struct.pack("<B", code) + _encode_key(operation["key"])
+        elif op == "select":
+            program = operation["program"]
+            if isinstance(program, int):
+                batch += struct.pack("<BI", OP_SELECT, program)
+            else:
+                name = program.encode("utf-8")
+                if not 0 < len(name) <= NAME_MAX_LEN:
+                    raise BatchError(
+                        f"Invalid program name '{program}' (1 to {NAME_MAX_LEN} characters)"
+                    )
+                batch += struct.pack("<BIB", OP_SELECT, SELECT_BY_NAME, len(name)) + name
+        elif op == "execute":
+            target = operation.get("target", "flash")
+            priority = operation.get("priority", "normal")
+            if target not in TARGETS or priority not in PRIORITIES:
+                raise BatchError(f"Invalid execute target or priority: {operation}")
+            batch += struct.pack("<BBB", OP_EXECUTE, TARGETS[target], PRIORITIES[priority])
+        else:
+            raise BatchError(f"Unknown operation '{op}'")
+
+    if len(batch) > BATCH_MAX_SIZE:
+        raise BatchError(f"Batch too large ({len(batch)} bytes, max {BATCH_MAX_SIZE})")
+    return bytes(batch)
+
+
+def decode_response(operations: List[Dict[str, Any]], response: bytes) -> Dict[str, Any]:
+    """
+    Decode a batch response
+
+    Args:
+        operations: Operations of the batch
+        response: Batch response
+
+    Returns:
+        {"status": name, "results": [{"op": op, "status": name, ...}]}, where a
+        successful get adds "type" and "value", select adds "id" and execute adds
+        "position"
+    """
+    try:
+        status, count = struct.unpack_from("<BH", response, 0)
+        if count != len(operations):
+            raise BatchError(f"Response has {count} results for {len(operations)} operations")
+
+        offset = 3
+        results = []
+        for operation in operations:
+            op_status = response[offset]
+            offset += 1
+            result = {"op": operation["op"], "status": STATUS_NAMES.get(op_status, "unknown")}
+            if op_status == STATUS_OK and operation["op"] == "get":
+                type_byte, length = struct.unpack_from("<BH", response, offset)
+                offset += 3
+                value = response[offset : offset + length]
+                offset += length
+                type_name = BYTE_TO_TYPE.get(type_byte, "unknown")
+                result["key"] = operation["key"]
+                result["type"] = type_name
+                if type_name in INTEGER_FORMATS:
+                    result["value"] = struct.unpack(INTEGER_FORMATS[type_name], value)[0]
+                elif type_name == "string":
+                    result["value"] = value.decode("utf-8")
+                else:
+                    result["value"] = bytes(value)
+            elif op_status == STATUS_OK and operation["op"] == "select":
+                (result["id"],) = struct.unpack_from("<I", response, offset)
+                offset += 4
+            elif op_status == STATUS_OK and operation["op"] == "execute":
+                (result["position"],) = struct.unpack_from("<I", response, offset)
+                offset += 4
+            results.append(result)
+    except (struct.error, IndexError):
+        raise BatchError("Truncated batch response")
+
+    return {"status": STATUS_NAMES.get(status, "unknown"), "results": results}
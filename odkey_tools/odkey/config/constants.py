@@ -6,6 +6,6 @@ These constants match the firmware definitions in include/program.h
 
 # Program size limits (matching firmware constants in include/program.h)
 PROGRAM_FLASH_PAGE_SIZE = 4096  # Flash page size in bytes
-PROGRAM_FLASH_MAX_SIZE = (1024 * 1024) - PROGRAM_FLASH_PAGE_SIZE  # ~1MB
+PROGRAM_FLASH_MAX_SIZE = (1024 * 1024) // 2 - PROGRAM_FLASH_PAGE_SIZE  # ~508KB (one A/B slot)
 PROGRAM_RAM_MAX_SIZE = 1024 * 1024  # 1MB
 
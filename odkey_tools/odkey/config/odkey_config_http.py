@@ -6,9 +6,13 @@ Provides HTTP-based system configuration functionality for ODKey devices over Wi
 """
 
 import codecs
+import gzip
 import json
+import struct
 import sys
-from typing import Any, Optional, Tuple
+import time
+import zlib
+from typing import Any, Dict, Optional, Tuple, Union
 
 try:
     import requests
@@ -46,6 +50,12 @@ TYPE_TO_BYTE = {
 # Byte to type name mapping
 BYTE_TO_TYPE = {v: k for k, v in TYPE_TO_BYTE.items()}
 
+# Flash program page size used for delta uploads (matching the ESP32 firmware)
+PROGRAM_FLASH_PAGE_SIZE = 4096
+
+# Delay before reconnecting a dropped log stream
+LOG_STREAM_RETRY_DELAY_S = 2
+
 
 class ODKeyConfigHttp:
     """ODKey HTTP system configuration interface using REST API"""
@@ -89,13 +99,16 @@ class ODKeyConfigHttp:
             print(f"Connection failed: {e}")
             return False
 
-    def upload_program(self, program_data: bytes, target: str = "flash") -> bool:
+    def upload_program(
+        self, program_data: bytes, target: str = "flash", stream: bool = False
+    ) -> bool:
         """
         Upload a program to the ODKey device
 
         Args:
             program_data: Program bytecode data
             target: Program target ("flash" or "ram")
+            stream: Start executing a RAM program while it is still uploading
 
         Returns:
             True if upload successful, False otherwise
@@ -105,13 +118,30 @@ class ODKeyConfigHttp:
             if target not in ["flash", "ram"]:
                 print(f"Error: Invalid target '{target}'")
                 return False
+            if stream and target != "ram":
+                print("Error: Only RAM programs can be streamed")
+                return False
 
             print(
                 f"Uploading program to {target.upper()} on {self.host}:{self.port}..."
             )
 
+            # Flash programs can be patched, sending only the pages that changed
+            if target == "flash":
+                patched = self._patch_flash_program(program_data)
+                if patched is not None:
+                    return patched
+
+            # Streamed uploads stay uncompressed: firmware without gzip support would
+            # start running the compressed bytes
+            if not stream:
+                uploaded = self._upload_program_gzip(program_data, target)
+                if uploaded is not None:
+                    return uploaded
+
             response = self.session.post(
                 f"{self.base_url}/api/program/{target}",
+                params={"stream": "1"} if stream else None,
                 data=program_data,
                 headers={"Content-Type": "application/octet-stream"},
                 timeout=30,
@@ -130,6 +160,108 @@ class ODKeyConfigHttp:
             print(f"Upload failed: {e}")
             return False
 
+    def _upload_program_gzip(self, program_data: bytes, target: str) -> Optional[bool]:
+        """
+        Upload a program gzip-compressed
+
+        Args:
+            program_data: Program bytecode data
+            target: Program target ("flash" or "ram")
+
+        Returns:
+            True if the upload succeeded, False on failure, or None if an uncompressed
+            upload should be used instead (nothing saved, or older firmware)
+        """
+        compressed = gzip.compress(program_data, mtime=0)
+        if len(compressed) >= len(program_data):
+            return None
+
+        response = self.session.post(
+            f"{self.base_url}/api/program/{target}",
+            data=compressed,
+            headers={
+                "Content-Type": "application/octet-stream",
+                "Content-Encoding": "gzip",
+                "X-Program-Size": str(len(program_data)),
+            },
+            timeout=30,
+        )
+        if response.status_code == 415:
+            return None
+        if response.status_code != 200:
+            print(f"Upload failed: HTTP {response.status_code}")
+            if response.text:
+                print(f"Error: {response.text}")
+            return False
+
+        # Firmware without gzip support stores the compressed bytes as they are
+        if response.json().get("size") != len(program_data):
+            return None
+
+        print(
+            f"Program uploaded successfully ({len(compressed)} of "
+            f"{len(program_data)} bytes sent)"
+        )
+        return True
+
+    def _patch_flash_program(self, program_data: bytes) -> Optional[bool]:
+        """
+        Upload only the flash program pages that differ from the stored program
+
+        Args:
+            program_data: Program bytecode data
+
+        Returns:
+            True if the patch was applied, False on failure, or None if a full upload
+            should be used instead (no stored program, nothing reusable, or older
+            firmware)
+        """
+        response = self.session.get(
+            f"{self.base_url}/api/program/flash/pages", timeout=10
+        )
+        if response.status_code != 200:
+            return None
+        stored_hashes = response.json().get("hashes", [])
+
+        # Compare zero-padded pages against the stored page hashes
+        page_count = -(-len(program_data) // PROGRAM_FLASH_PAGE_SIZE)
+        changed_pages = []
+        for index in range(page_count):
+            offset = index * PROGRAM_FLASH_PAGE_SIZE
+            page = program_data[offset : offset + PROGRAM_FLASH_PAGE_SIZE]
+            page = page.ljust(PROGRAM_FLASH_PAGE_SIZE, b"\x00")
+            if index >= len(stored_hashes) or zlib.crc32(page) != stored_hashes[index]:
+                changed_pages.append((index, page))
+
+        if len(changed_pages) == page_count:
+            return None
+
+        print(f"Sending {len(changed_pages)} of {page_count} pages (delta upload)...")
+        body = bytearray(
+            struct.pack("<II", len(program_data), zlib.crc32(program_data) & 0xFFFFFFFF)
+        )
+        for index, page in changed_pages:
+            body += struct.pack("<I", index) + page
+
+        response = self.session.post(
+            f"{self.base_url}/api/program/flash/patch",
+            data=bytes(body),
+            headers={"Content-Type": "application/octet-stream"},
+            timeout=30,
+        )
+        if response.status_code == 200:
+            print("Program uploaded successfully")
+            return True
+
+        # The stored program changed underneath us; a full upload still works
+        if response.status_code == 409:
+            return None
+
+        print(f"Delta upload failed: HTTP {response.status_code}")
+        if response.text:
+            print(f"Error: {response.text}")
+        return False
+
     def download_program(self, target: str = "flash") -> Optional[bytes]:
         """
         Download the current program from the ODKey device
@@ -150,8 +282,11 @@ class ODKeyConfigHttp:
                 f"Downloading {target.upper()} program from {self.host}:{self.port}..."
             )
 
+            # requests decodes the gzip response that the firmware sends
             response = self.session.get(
-                f"{self.base_url}/api/program/{target}", timeout=30
+                f"{self.base_url}/api/program/{target}",
+                headers={"Accept-Encoding": "gzip"},
+                timeout=30,
             )
 
             if response.status_code == 200:
@@ -314,15 +449,21 @@ class ODKeyConfigHttp:
             print(f"Delete failed: {e}")
             return False
 
-    def execute_program(self, target: str = "flash") -> bool:
+    def execute_program(
+        self, target: str = "flash", priority: str = "normal", wait_ms: int = 0
+    ) -> bool:
         """
-        Execute a program on the device
+        Queue a program for execution on the device
 
         Args:
             target: Program target ("flash" or "ram")
+            priority: Run priority ("low", "normal" or "high"); a higher-priority run
+                preempts the running program
+            wait_ms: How long the device holds the reply waiting for all queued runs
+                to finish (0 to reply immediately, at most 60000)
 
         Returns:
-            True if execution successful, False otherwise
+            True if execution was queued, False otherwise
         """
         try:
             # Validate target
@@ -331,31 +472,113 @@ class ODKeyConfigHttp:
                 return False
 
             endpoint = f"/api/program/{target}/execute"
-            response = self.session.post(f"{self.base_url}{endpoint}", timeout=30)
+            response = self.session.post(
+                f"{self.base_url}{endpoint}",
+                params={"priority": priority, "wait": wait_ms},
+                timeout=30 + wait_ms / 1000,
+            )
 
             if response.status_code == 200:
-                print(f"{target.upper()} program execution started")
+                result = response.json()
+                position = result.get("position", 0)
+                if wait_ms:
+                    if result.get("idle"):
+                        print(f"{target.upper()} program execution finished")
+                    else:
+                        print(f"{target.upper()} program still running after wait")
+                elif position:
+                    print(
+                        f"{target.upper()} program queued "
+                        f"({position} runs ahead of it)"
+                    )
+                else:
+                    print(f"{target.upper()} program execution started")
                 return True
             else:
                 print(f"Execute failed: HTTP {response.status_code}")
                 if response.text:
                     print(f"Error: {response.text}")
                 return False
-        except requests.exceptions.RequestException as e:
+        except (requests.exceptions.RequestException, json.JSONDecodeError) as e:
             print(f"Execute failed: {e}")
             return False
 
-    def download_logs(self, file_handle: Any = None) -> None:
+    def list_programs(self) -> Optional[Dict[str, Any]]:
+        """
+        List the programs of the flash program library
+
+        Returns:
+            Dict with the selected program id and a list of programs (id, name,
+            size, crc), or None on failure
+        """
+        try:
+            response = self.session.get(
+                f"{self.base_url}/api/program/flash/programs", timeout=30
+            )
+
+            if response.status_code == 200:
+                return response.json()
+            else:
+                print(f"List failed: HTTP {response.status_code}")
+                if response.text:
+                    print(f"Error: {response.text}")
+                return None
+        except (requests.exceptions.RequestException, json.JSONDecodeError) as e:
+            print(f"List failed: {e}")
+            return None
+
+    def select_program(self, program: Union[int, str]) -> bool:
+        """
+        Select the flash library program run by execute and the keyboard button
+
+        Args:
+            program: Program id or name
+
+        Returns:
+            True if the program was selected, False otherwise
+        """
+        body = {"id": program} if isinstance(program, int) else {"name": program}
+        try:
+            response = self.session.post(
+                f"{self.base_url}/api/program/flash/select", json=body, timeout=30
+            )
+
+            if response.status_code == 200:
+                print(f"FLASH program {response.json().get('id')} selected")
+                return True
+            else:
+                print(f"Select failed: HTTP {response.status_code}")
+                if response.text:
+                    print(f"Error: {response.text}")
+                return False
+        except (requests.exceptions.RequestException, json.JSONDecodeError) as e:
+            print(f"Select failed: {e}")
+            return False
+
+    def download_logs(
+        self, file_handle: Any = None, after: Optional[int] = None
+    ) -> Optional[int]:
         """
         Download logs from the device via HTTP and stream to stdout or file
         
         Args:
             file_handle: Optional file handle to write to. If None, streams to stdout.
+            after: Sequence number from an earlier download; only newer logs are sent
+
+        Returns:
+            Sequence number to pass as after next time, or None on failure
         """
+        next_seq = None
         try:
-            response = self.session.get(f"{self.base_url}/api/logs", timeout=30, stream=True)
+            params = {} if after is None else {"after": after}
+            response = self.session.get(
+                f"{self.base_url}/api/logs", params=params, timeout=30, stream=True
+            )
             
             if response.status_code == 200:
+                if "X-Log-Seq" in response.headers:
+                    next_seq = int(response.headers["X-Log-Seq"])
+
                 # Create incremental UTF-8 decoder (handles incomplete sequences automatically)
                 decoder = codecs.getincrementaldecoder('utf-8')(errors='replace')
                 
@@ -386,6 +609,59 @@ class ODKeyConfigHttp:
 
         except requests.exceptions.RequestException as e:
             print(f"Log download failed: {e}")
+            return None
+
+        return next_seq
+
+    def follow_logs(self, file_handle: Any = None, after: Optional[int] = None) -> None:
+        """
+        Stream new logs from the device as they are written, until interrupted
+
+        The device sends Server-Sent Events; each carries log lines and the sequence
+        number to resume from, which is used to reconnect without gaps.
+
+        Args:
+            file_handle: Optional file handle to write to. If None, streams to stdout.
+            after: Sequence number to start after. If None, starts with the oldest logs.
+        """
+        last_seq = after
+        while True:
+            try:
+                headers = {}
+                if last_seq is not None:
+                    headers["Last-Event-ID"] = str(last_seq)
+                response = self.session.get(
+                    f"{self.base_url}/api/logs/stream",
+                    headers=headers,
+                    timeout=(10, 60),
+                    stream=True,
+                )
+                if response.status_code == 409:
+                    # The device has not noticed that the previous stream closed yet
+                    print("Log stream busy, retrying", file=sys.stderr)
+                    time.sleep(LOG_STREAM_RETRY_DELAY_S)
+                    continue
+                if response.status_code != 200:
+                    print(f"Log stream failed: HTTP {response.status_code}")
+                    if response.text:
+                        print(f"Error: {response.text}")
+                    return
+
+                for raw_line in response.iter_lines(decode_unicode=False):
+                    line = raw_line.decode("utf-8", errors="replace")
+                    if line.startswith("data: "):
+                        text = line[len("data: ") :] + "\n"
+                        if file_handle:
+                            file_handle.write(text)
+                            file_handle.flush()
+                        else:
+                            print(text, end="", flush=True)
+                    elif line.startswith("id: "):
+                        last_seq = int(line[len("id: ") :])
+
+            except requests.exceptions.RequestException as e:
+                print(f"Log stream interrupted ({e}), reconnecting", file=sys.stderr)
+                time.sleep(LOG_STREAM_RETRY_DELAY_S)
 
     def clear_logs(self) -> bool:
         """
@@ -410,6 +686,122 @@ class ODKeyConfigHttp:
             print(f"Log clear failed: {e}")
             return False
 
+    def get_stats(self) -> Optional[Dict[str, Dict[str, int]]]:
+        """
+        Read the button-to-host latency statistics of each stage
+
+        Returns:
+            Dict of stage name to count, samples, min_us, p50_us, p99_us and max_us,
+            or None on failure
+        """
+        try:
+            response = self.session.get(f"{self.base_url}/api/stats", timeout=30)
+
+            if response.status_code == 200:
+                return response.json()["stages"]
+            else:
+                print(f"Stats failed: HTTP {response.status_code}")
+                if response.text:
+                    print(f"Error: {response.text}")
+                return None
+        except (requests.exceptions.RequestException, json.JSONDecodeError) as e:
+            print(f"Stats failed: {e}")
+            return None
+
+    def reset_stats(self) -> bool:
+        """
+        Reset the latency statistics on the device
+
+        Returns:
+            True if successful, False otherwise
+        """
+        try:
+            response = self.session.delete(f"{self.base_url}/api/stats", timeout=30)
+
+            if response.status_code == 200:
+                print("Latency statistics reset")
+                return True
+            else:
+                print(f"Stats reset failed: HTTP {response.status_code}")
+                if response.text:
+                    print(f"Error: {response.text}")
+                return False
+        except requests.exceptions.RequestException as e:
+            print(f"Stats reset failed: {e}")
+            return False
+
+    def get_profile(self) -> Optional[bytes]:
+        """
+        Download the VM profile image
+
+        Returns:
+            Profile image, or None if no profile is available or on failure
+        """
+        try:
+            response = self.session.get(f"{self.base_url}/api/profile", timeout=30)
+
+            if response.status_code == 200:
+                return response.content
+            else:
+                print(f"Profile download failed: HTTP {response.status_code}")
+                if response.text:
+                    print(f"Error: {response.text}")
+                return None
+        except requests.exceptions.RequestException as e:
+            print(f"Profile download failed: {e}")
+            return None
+
+    def reset_profile(self) -> bool:
+        """
+        Reset the VM profile on the device
+
+        Returns:
+            True if successful, False otherwise
+        """
+        try:
+            response = self.session.delete(f"{self.base_url}/api/profile", timeout=30)
+
+            if response.status_code == 200:
+                print("VM profile reset")
+                return True
+            else:
+                print(f"Profile reset failed: HTTP {response.status_code}")
+                if response.text:
+                    print(f"Error: {response.text}")
+                return False
+        except requests.exceptions.RequestException as e:
+            print(f"Profile reset failed: {e}")
+            return False
+
+    def run_batch(self, batch: bytes) -> Optional[bytes]:
+        """
+        Run a batch of NVS and program operations (see batch.py)
+
+        Args:
+            batch: Encoded batch request
+
+        Returns:
+            Batch response, or None if the batch was rejected or on failure
+        """
+        try:
+            response = self.session.post(
+                f"{self.base_url}/api/batch",
+                data=batch,
+                headers={"Content-Type": "application/octet-stream"},
+                timeout=30,
+            )
+
+            if response.status_code == 200:
+                return response.content
+            else:
+                print(f"Batch failed: HTTP {response.status_code}")
+                if response.text:
+                    print(f"Error: {response.text}")
+                return None
+        except requests.exceptions.RequestException as e:
+            print(f"Batch failed: {e}")
+            return None
+
     def close(self) -> None:
         """Close the HTTP session"""
         self.session.close()
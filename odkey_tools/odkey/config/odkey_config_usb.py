@@ -10,8 +10,9 @@ import codecs
 import struct
 import sys
 import time
+import zlib
 from pathlib import Path
-from typing import Any, Optional, Tuple
+from typing import Any, Dict, Optional, Tuple, Union
 
 try:
     import hid
@@ -19,12 +20,20 @@ except ImportError:
     print("Error: hidapi library not found. Install with: pip install hidapi")
     sys.exit(1)
 
+# Optional: pyusb enables the faster vendor bulk interface when available
+try:
+    import usb.core
+    import usb.util
+except ImportError:
+    usb = None
+
 from ..odkeyscript.odkeyscript_compiler import CompileError, Compiler
 from .constants import PROGRAM_FLASH_MAX_SIZE, PROGRAM_RAM_MAX_SIZE
 
 # Protocol constants (matching the ESP32 firmware)
 RESP_OK = 0x10
 RESP_ERROR = 0x11
+RESP_RETRY = 0x12
 
 # Flash program commands
 CMD_FLASH_PROGRAM_WRITE_START = 0x20
@@ -41,15 +50,38 @@ CMD_RAM_PROGRAM_WRITE_FINISH = 0x28
 CMD_RAM_PROGRAM_READ_START = 0x29
 CMD_RAM_PROGRAM_READ_CHUNK = 0x2A
 CMD_RAM_PROGRAM_EXECUTE = 0x2B
+
+# Streaming program write commands
+CMD_FLASH_PROGRAM_STREAM_START = 0x2C
+CMD_RAM_PROGRAM_STREAM_START = 0x2D
+CMD_PROGRAM_STREAM_CHUNK = 0x2E
+
+# Flash program library commands
+CMD_FLASH_PROGRAM_SELECT = 0x2F
+SELECT_BY_NAME = 0xFFFFFFFF
+PROGRAM_NAME_MAX_LEN = 16
+
 CMD_NVS_SET_START = 0x30
 CMD_NVS_SET_DATA = 0x31
 CMD_NVS_SET_FINISH = 0x32
 CMD_NVS_GET_START = 0x33
 CMD_NVS_GET_DATA = 0x34
 CMD_NVS_DELETE = 0x35
+CMD_BATCH_START = 0x36
+CMD_BATCH_DATA = 0x37
+CMD_BATCH_FINISH = 0x38
+CMD_BATCH_READ_CHUNK = 0x39
 CMD_LOG_READ_START = 0x40
 CMD_LOG_READ_CHUNK = 0x41
 CMD_LOG_CLEAR = 0x42
+CMD_STATS_READ = 0x50
+CMD_STATS_RESET = 0x51
+CMD_PROFILE_READ_START = 0x52
+CMD_PROFILE_READ_CHUNK = 0x53
+CMD_PROFILE_RESET = 0x54
+
+# Latency stages reported by CMD_STATS_READ, by index
+STATS_STAGE_NAMES = ["debounce", "queue", "vm", "keyboard", "usb", "total", "wake"]
 
 # NVS type constants (matching ESP-IDF nvs.h)
 NVS_TYPE_U8 = 0x01
@@ -86,6 +118,17 @@ DATA_PAYLOAD_SIZE = 60  # 60 bytes of data payload (bytes 4-63)
 USB_VID = 0x05AC
 USB_PID = 0x0250
 
+# Streaming upload constants
+STREAM_WINDOW = 32  # Maximum unacknowledged chunks in flight
+STREAM_ACK_TIMEOUT_MS = 2000
+STREAM_MAX_TIMEOUTS = 3
+
+# Vendor bulk interface (optional, requires pyusb)
+BULK_INTERFACE_CLASS = 0xFF  # Vendor specific
+BULK_HEADER_SIZE = 12  # command(1) + reserved(3) + length(4) + crc32(4)
+BULK_TIMEOUT_MS = 5000
+BULK_READ_SIZE = 4096
+
 
 class ODKeyUploadError(Exception):
     """Exception raised for ODKey upload errors"""
@@ -110,6 +153,9 @@ class ODKeyConfigUsb:
         self.interface_num = 1  # Raw HID interface (Interface 1 in firmware)
         self.usb_vid = vid
         self.usb_pid = pid
+        self.bulk_device: Optional[Any] = None
+        self.bulk_ep_out: Optional[Any] = None
+        self.bulk_ep_in: Optional[Any] = None
 
     def find_device(self) -> bool:
         """
@@ -156,16 +202,145 @@ class ODKeyConfigUsb:
             print(f"Error finding device: {e}")
             return False
 
-    def send_command(self, command: int, data: bytes) -> Tuple[bool, bytes]:
+    def _open_bulk(self) -> bool:
         """
-        Send a command to the device and wait for response
+        Open the vendor bulk interface if pyusb and the interface are available
+
+        Returns:
+            True if the bulk endpoints are ready, False to fall back to Raw HID
+        """
+        if self.bulk_device is not None:
+            return True
+        if usb is None:
+            return False
+
+        try:
+            device = usb.core.find(idVendor=self.usb_vid, idProduct=self.usb_pid)
+            if device is None:
+                return False
+
+            config = device.get_active_configuration()
+            interface = usb.util.find_descriptor(
+                config, bInterfaceClass=BULK_INTERFACE_CLASS
+            )
+            if interface is None:
+                return False
+
+            ep_out = usb.util.find_descriptor(
+                interface,
+                custom_match=lambda e: usb.util.endpoint_direction(e.bEndpointAddress)
+                == usb.util.ENDPOINT_OUT,
+            )
+            ep_in = usb.util.find_descriptor(
+                interface,
+                custom_match=lambda e: usb.util.endpoint_direction(e.bEndpointAddress)
+                == usb.util.ENDPOINT_IN,
+            )
+            if ep_out is None or ep_in is None:
+                return False
+
+            usb.util.claim_interface(device, interface.bInterfaceNumber)
+        except Exception as e:
+            # Typically missing permissions or (on Windows) no WinUSB driver bound
+            print(f"Bulk interface not available ({e}), using Raw HID")
+            return False
+
+        self.bulk_device = device
+        self.bulk_ep_out = ep_out
+        self.bulk_ep_in = ep_in
+        return True
+
+    def _bulk_read_frame(self) -> Tuple[int, bytes]:
+        """
+        Read one response frame from the bulk interface
+
+        Returns:
+            Tuple of (response_id, payload)
+        """
+        assert self.bulk_ep_in is not None
+        header = bytes(self.bulk_ep_in.read(BULK_HEADER_SIZE, BULK_TIMEOUT_MS))
+        if len(header) < BULK_HEADER_SIZE:
+            raise ODKeyUploadError("Short bulk response header")
+        response_id = header[0]
+        length, crc = struct.unpack("<II", header[4:12])
+
+        payload = bytearray()
+        while len(payload) < length:
+            payload += bytes(
+                self.bulk_ep_in.read(
+                    min(BULK_READ_SIZE, length - len(payload)), BULK_TIMEOUT_MS
+                )
+            )
+        if length and zlib.crc32(payload) & 0xFFFFFFFF != crc:
+            raise ODKeyUploadError("Bulk response CRC mismatch")
+        return response_id, bytes(payload)
+
+    def _bulk_upload_program(self, cmd_stream_start: int, program_data: bytes) -> bool:
+        """
+        Upload program data in a single frame over the vendor bulk interface
 
         Args:
-            command: Command code for the command
-            data: Command data (will be placed in bytes 4-63)
+            cmd_stream_start: Stream start command for the target
+            program_data: Compiled program bytecode
 
         Returns:
-            Tuple of (success, response_data)
+            True if the device committed the program, False otherwise
+        """
+        assert self.bulk_ep_out is not None
+        program_size = len(program_data)
+        crc = zlib.crc32(program_data) & 0xFFFFFFFF
+        header = struct.pack("<B3xII", cmd_stream_start, program_size, crc)
+
+        print("Uploading over bulk interface...")
+        start_time = time.time()
+        try:
+            self.bulk_ep_out.write(header + program_data, BULK_TIMEOUT_MS)
+            response_id, _ = self._bulk_read_frame()
+        except Exception as e:
+            print(f"Bulk upload failed: {e}")
+            return False
+
+        if response_id != RESP_OK:
+            print("Device rejected bulk upload (CRC mismatch or write error)")
+            return False
+
+        elapsed = max(time.time() - start_time, 1e-6)
+        print(f"Uploaded {program_size} bytes in {elapsed:.2f}s "
+              f"({program_size / elapsed / 1024:.1f} KB/s)")
+        return True
+
+    def _bulk_download_logs(self) -> Optional[bytes]:
+        """
+        Download the whole log buffer over the vendor bulk interface
+
+        Returns:
+            Log data, or None if the transfer failed
+        """
+        assert self.bulk_ep_out is not None
+        try:
+            self.bulk_ep_out.write(
+                struct.pack("<B3xII", CMD_LOG_READ_START, 0, 0), BULK_TIMEOUT_MS
+            )
+            log_data = bytearray()
+            while True:
+                response_id, payload = self._bulk_read_frame()
+                if response_id != RESP_OK:
+                    return None
+                if not payload:
+                    return bytes(log_data)
+                log_data += payload
+        except Exception as e:
+            print(f"Bulk log download failed: {e}")
+            return None
+
+    def _write_packet(self, command: int, data: bytes, seq: int = 0) -> None:
+        """
+        Write a single command packet to the device without waiting for a response
+
+        Args:
+            command: Command code for the command
+            data: Command data (will be placed in bytes 4-63)
+            seq: 24-bit sequence number for bytes 1-3 (streamed chunks only)
         """
         if not self.device:
             raise ODKeyUploadError("Device not connected")
@@ -173,7 +348,7 @@ class ODKeyConfigUsb:
         # Construct the command payload (64 bytes)
         payload = bytearray(RAW_HID_REPORT_SIZE)
         payload[0] = command  # Command code in first byte
-        # Bytes 1-3 reserved for future use
+        payload[1:4] = struct.pack("<I", seq)[:3]  # Sequence number (otherwise zero)
         payload[4 : 4 + len(data)] = data  # Data payload in bytes 4-63
 
         # Wrap with HID report ID (hidapi requirement)
@@ -181,9 +356,25 @@ class ODKeyConfigUsb:
         hid_packet[0] = 0  # Report ID (stripped by hidapi before sending to device)
         hid_packet[1:] = payload  # Actual command payload
 
+        # Send command (hidapi expects bytes, not bytearray)
+        self.device.write(bytes(hid_packet))
+
+    def send_command(self, command: int, data: bytes) -> Tuple[bool, bytes]:
+        """
+        Send a command to the device and wait for response
+
+        Args:
+            command: Command code for the command
+            data: Command data (will be placed in bytes 4-63)
+
+        Returns:
+            Tuple of (success, response_data)
+        """
+        if not self.device:
+            raise ODKeyUploadError("Device not connected")
+
         try:
-            # Send command (hidapi expects bytes, not bytearray)
-            self.device.write(bytes(hid_packet))
+            self._write_packet(command, data)
 
             # Wait for response (with timeout)
             timeout = 5.0  # 5 second timeout
@@ -265,9 +456,37 @@ class ODKeyConfigUsb:
             cmd_chunk = CMD_RAM_PROGRAM_WRITE_CHUNK
             cmd_finish = CMD_RAM_PROGRAM_WRITE_FINISH
 
+        size_data = struct.pack("<I", program_size)  # 32-bit little-endian
+
+        cmd_stream_start = (
+            CMD_FLASH_PROGRAM_STREAM_START
+            if target == "flash"
+            else CMD_RAM_PROGRAM_STREAM_START
+        )
+
+        # Use the vendor bulk interface when it is available
+        if self._open_bulk():
+            if not self._bulk_upload_program(cmd_stream_start, program_data):
+                return False
+            print("Program uploaded successfully!")
+            return True
+
+        # Prefer the windowed streaming transfer, fall back to one round trip per chunk
+        streamed = self._stream_program(cmd_stream_start, program_data)
+        if streamed is not None:
+            if not streamed:
+                return False
+            print("Finishing write session...")
+            success, response = self.send_command(cmd_finish, size_data)
+            if not success:
+                print("Failed to finish write session (CRC mismatch or write error)")
+                return False
+            print("Program uploaded successfully!")
+            return True
+        print("Streaming upload not available, using per-chunk upload")
+
         # Step 1: Send WRITE_START command
         print("Starting write session...")
-        size_data = struct.pack("<I", program_size)  # 32-bit little-endian
         success, response = self.send_command(cmd_start, size_data)
         if not success:
             print("Failed to start write session")
@@ -311,6 +530,85 @@ class ODKeyConfigUsb:
         print("Program uploaded successfully!")
         return True
 
+    def _stream_program(self, cmd_stream_start: int, program_data: bytes) -> Optional[bool]:
+        """
+        Upload program data with the windowed streaming protocol
+
+        Chunks carry a sequence number and are sent without waiting for individual
+        responses. The device acknowledges cumulatively and asks for a resend if it
+        sees a gap. A CRC32 of the whole program is checked by the device on finish.
+
+        Args:
+            cmd_stream_start: Stream start command for the target
+            program_data: Compiled program bytecode
+
+        Returns:
+            True if all chunks were acknowledged, False on failure, or None if the
+            device refused to start a stream (e.g. older firmware)
+        """
+        program_size = len(program_data)
+        crc = zlib.crc32(program_data) & 0xFFFFFFFF
+
+        print("Starting streaming write session...")
+        success, response = self.send_command(
+            cmd_stream_start, struct.pack("<II", program_size, crc)
+        )
+        if not success:
+            return None
+
+        total_chunks = (program_size + DATA_PAYLOAD_SIZE - 1) // DATA_PAYLOAD_SIZE
+        next_seq = 0
+        acked = 0
+        timeouts = 0
+        start_time = time.time()
+
+        try:
+            while acked < total_chunks:
+                # Keep up to STREAM_WINDOW chunks in flight
+                while next_seq < total_chunks and next_seq - acked < STREAM_WINDOW:
+                    offset = next_seq * DATA_PAYLOAD_SIZE
+                    chunk_data = program_data[offset : offset + DATA_PAYLOAD_SIZE]
+                    chunk_data = chunk_data.ljust(DATA_PAYLOAD_SIZE, b"\x00")
+                    self._write_packet(CMD_PROGRAM_STREAM_CHUNK, chunk_data, next_seq)
+                    next_seq += 1
+
+                response_raw = self.device.read(RAW_HID_REPORT_SIZE, STREAM_ACK_TIMEOUT_MS)
+                if not response_raw:
+                    timeouts += 1
+                    if timeouts > STREAM_MAX_TIMEOUTS:
+                        print("Timeout waiting for stream acknowledgement")
+                        return False
+                    print(f"No acknowledgement, resending from chunk {acked}")
+                    next_seq = acked
+                    continue
+                timeouts = 0
+
+                response = bytes(response_raw)
+                response_id = response[0]
+                seq = struct.unpack("<I", response[4:8])[0]
+                if response_id == RESP_OK:
+                    acked = max(acked, seq)
+                elif response_id == RESP_RETRY:
+                    print(f"Device requested resend from chunk {seq}")
+                    acked = max(acked, seq)
+                    next_seq = min(next_seq, seq)
+                else:
+                    print(f"Device reported an error at chunk {acked}")
+                    return False
+
+                bytes_acked = min(acked * DATA_PAYLOAD_SIZE, program_size)
+                progress = (bytes_acked / program_size) * 100
+                print(f"Progress: {progress:.1f}% ({bytes_acked}/{program_size} bytes)")
+
+        except Exception as e:
+            print(f"Error streaming program: {e}")
+            return False
+
+        elapsed = max(time.time() - start_time, 1e-6)
+        print(f"Streamed {program_size} bytes in {elapsed:.2f}s "
+              f"({program_size / elapsed / 1024:.1f} KB/s)")
+        return True
+
     def download_program(self, target: str = "flash") -> bytes:
         """
         Download a program from the device
@@ -412,12 +710,49 @@ class ODKeyConfigUsb:
         success, response = self.send_command(cmd, b"")
 
         if success:
-            print(f"{target.upper()} program execution started")
+            (position,) = struct.unpack_from("<I", response, 4)
+            if position:
+                print(f"{target.upper()} program queued ({position} runs ahead of it)")
+            else:
+                print(f"{target.upper()} program execution started")
         else:
             print(f"Failed to execute {target} program")
 
         return success
 
+    def select_program(self, program: Union[int, str]) -> bool:
+        """
+        Select the flash library program run by execute and the keyboard button
+
+        Args:
+            program: Program id or name
+
+        Returns:
+            True if the program was selected, False otherwise
+        """
+        if not self.device:
+            raise ODKeyUploadError("Device not connected")
+
+        if isinstance(program, int):
+            data = struct.pack("<I", program)
+        else:
+            name = program.encode("utf-8")
+            if len(name) >= PROGRAM_NAME_MAX_LEN:
+                raise ODKeyUploadError(
+                    f"Program name too long (max {PROGRAM_NAME_MAX_LEN - 1} characters)"
+                )
+            data = struct.pack(f"<I{PROGRAM_NAME_MAX_LEN}s", SELECT_BY_NAME, name)
+
+        success, response = self.send_command(CMD_FLASH_PROGRAM_SELECT, data)
+
+        if success:
+            (program_id,) = struct.unpack_from("<I", response, 4)
+            print(f"FLASH program {program_id} selected")
+        else:
+            print(f"Failed to select FLASH program '{program}'")
+
+        return success
+
     def nvs_set_int(self, key: str, value: int, type_str: str) -> None:
         """
         Set an integer value in NVS
@@ -738,7 +1073,9 @@ class ODKeyConfigUsb:
             print(f"NVS delete failed: {e}")
             return False
 
-    def download_logs(self, file_handle: Any = None) -> None:
+    def download_logs(
+        self, file_handle: Any = None, after: Optional[int] = None
+    ) -> Optional[int]:
         """
         Download logs from the device and stream to stdout or file line by line.
         
@@ -747,17 +1084,36 @@ class ODKeyConfigUsb:
         
         Args:
             file_handle: Optional file handle to write to. If None, streams to stdout.
+            after: Sequence number from an earlier download; only newer logs are sent
+
+        Returns:
+            Sequence number to pass as after next time, or None if unknown
         """
         if not self.device:
             print("Device not connected")
-            return
+            return None
+
+        # Use the vendor bulk interface when it is available (full downloads only)
+        if after is None and self._open_bulk():
+            log_data = self._bulk_download_logs()
+            if log_data is not None:
+                text = log_data.decode("utf-8", errors="replace")
+                if file_handle:
+                    file_handle.write(text)
+                    file_handle.flush()
+                else:
+                    print(text, end="", flush=True)
+                return None
+            print("Falling back to Raw HID log download")
 
         try:
-            # Send LOG_READ_START command
-            success, response = self.send_command(CMD_LOG_READ_START, b"")
+            # Send LOG_READ_START command; the response holds the next sequence number
+            start = struct.pack("<I", after or 0)
+            success, response = self.send_command(CMD_LOG_READ_START, start)
             if not success:
                 print("Failed to start log download")
-                return
+                return None
+            (next_seq,) = struct.unpack_from("<I", response, 4)
 
             # Create incremental UTF-8 decoder (handles incomplete sequences automatically)
             decoder = codecs.getincrementaldecoder('utf-8')(errors='replace')
@@ -815,6 +1171,9 @@ class ODKeyConfigUsb:
 
         except Exception as e:
             print(f"Log download failed: {e}")
+            return None
+
+        return next_seq
 
 
     def clear_logs(self) -> bool:
@@ -842,11 +1201,154 @@ class ODKeyConfigUsb:
             print(f"Log clear failed: {e}")
             return False
 
+    def get_stats(self) -> Optional[Dict[str, Dict[str, int]]]:
+        """
+        Read the button-to-host latency statistics of each stage
+
+        Returns:
+            Dict of stage name to count, samples, min_us, p50_us, p99_us and max_us,
+            or None on failure
+        """
+        if not self.device:
+            print("Device not connected")
+            return None
+
+        stats = {}
+        stage = 0
+        stage_count = 1
+        while stage < stage_count:
+            success, response = self.send_command(CMD_STATS_READ, bytes([stage]))
+            if not success:
+                print(f"Failed to read latency statistics of stage {stage}")
+                return None
+            stage_count = response[4]
+            values = struct.unpack_from("<IIIIII", response, 8)
+            name = (
+                STATS_STAGE_NAMES[stage]
+                if stage < len(STATS_STAGE_NAMES)
+                else f"stage{stage}"
+            )
+            stats[name] = dict(
+                zip(["count", "samples", "min_us", "p50_us", "p99_us", "max_us"], values)
+            )
+            stage += 1
+        return stats
+
+    def reset_stats(self) -> bool:
+        """
+        Reset the latency statistics on the device
+
+        Returns:
+            True if successful, False otherwise
+        """
+        if not self.device:
+            print("Device not connected")
+            return False
+
+        success, _ = self.send_command(CMD_STATS_RESET, b"")
+        if not success:
+            print("Failed to reset latency statistics")
+            return False
+
+        print("Latency statistics reset")
+        return True
+
+    def get_profile(self) -> Optional[bytes]:
+        """
+        Download the VM profile image
+
+        Returns:
+            Profile image, or None if no profile is available or on failure
+        """
+        if not self.device:
+            print("Device not connected")
+            return None
+
+        success, response = self.send_command(CMD_PROFILE_READ_START, b"")
+        if not success:
+            print("No profile available (profiling disabled or a program is running)")
+            return None
+
+        image_size = struct.unpack_from("<I", response, 4)[0]
+        image = bytearray()
+        while len(image) < image_size:
+            success, response = self.send_command(CMD_PROFILE_READ_CHUNK, b"")
+            if not success:
+                print("Failed to read profile chunk")
+                return None
+            image.extend(response[4 : 4 + min(60, image_size - len(image))])
+        return bytes(image)
+
+    def reset_profile(self) -> bool:
+        """
+        Reset the VM profile on the device
+
+        Returns:
+            True if successful, False otherwise
+        """
+        if not self.device:
+            print("Device not connected")
+            return False
+
+        success, _ = self.send_command(CMD_PROFILE_RESET, b"")
+        if not success:
+            print("Failed to reset VM profile")
+            return False
+
+        print("VM profile reset")
+        return True
+
+    def run_batch(self, batch: bytes) -> Optional[bytes]:
+        """
+        Run a batch of NVS and program operations (see batch.py)
+
+        Args:
+            batch: Encoded batch request
+
+        Returns:
+            Batch response, or None if the batch was rejected or on failure
+        """
+        if not self.device:
+            print("Device not connected")
+            return None
+
+        success, _ = self.send_command(CMD_BATCH_START, struct.pack("<I", len(batch)))
+        if not success:
+            print("Failed to start batch")
+            return None
+
+        for offset in range(0, len(batch), DATA_PAYLOAD_SIZE):
+            chunk = batch[offset : offset + DATA_PAYLOAD_SIZE]
+            success, _ = self.send_command(CMD_BATCH_DATA, chunk)
+            if not success:
+                print("Failed to send batch data")
+                return None
+
+        success, response = self.send_command(CMD_BATCH_FINISH, b"")
+        if not success:
+            print("Batch rejected (malformed or too large)")
+            return None
+
+        response_size = struct.unpack_from("<I", response, 4)[0]
+        result = bytearray()
+        while len(result) < response_size:
+            success, response = self.send_command(CMD_BATCH_READ_CHUNK, b"")
+            if not success:
+                print("Failed to read batch response")
+                return None
+            result.extend(response[4 : 4 + min(60, response_size - len(result))])
+        return bytes(result)
+
     def close(self) -> None:
         """Close the device connection"""
         if self.device:
             self.device.close()
             self.device = None
+        if self.bulk_device is not None:
+            usb.util.dispose_resources(self.bulk_device)
+            self.bulk_device = None
+            self.bulk_ep_out = None
+            self.bulk_ep_in = None
 
 
 def compile_odkeyscript(source_file: Path) -> bytes:
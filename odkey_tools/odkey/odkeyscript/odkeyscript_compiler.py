@@ -10,6 +10,9 @@ from dataclasses import dataclass
 from enum import Enum
 from typing import List, Tuple
 
+from .odkeyscript_compression import compress_program
+from .odkeyscript_optimizer import Optimizer
+
 
 class Opcode(Enum):
     """ODKeyScript Virtual Machine Opcodes"""
@@ -21,6 +24,10 @@ class Opcode(Enum):
     SET_COUNTER = 0x14
     DEC = 0x15
     JNZ = 0x16
+    PRESS = 0x17
+    TYPE = 0x18
+    PUSH_LOOP = 0x19
+    NEXT = 0x1A
 
 
 class TokenType(Enum):
@@ -56,6 +63,10 @@ class CompileError(Exception):
     column: int
 
 
+class _LoopStackOverflow(Exception):
+    """Raised when repeat loops nest deeper than the VM's loop stack"""
+
+
 class Lexer:
     """Lexical analyzer for ODKeyScript"""
 
@@ -392,8 +403,35 @@ class Lexer:
 class Compiler:
     """ODKeyScript compiler"""
 
-    def __init__(self) -> None:
+    # Maximum keys per keydn/keyup/press (more than 6 requires an NKRO-mode device)
+    MAX_KEYS = 16
+    # Maximum characters per TYPE instruction (longer strings use several)
+    MAX_TYPE_CHARS = 255
+    # Maximum repeat loops open at once on the VM's loop stack (VM_MAX_LOOP_DEPTH)
+    MAX_LOOP_DEPTH = 16
+
+    def __init__(
+        self,
+        fast_type: bool = False,
+        compress: bool = False,
+        optimize: bool = True,
+        legacy_loops: bool = False,
+    ) -> None:
         self.bytecode: List[int] = []
+        # Fast type mode compiles type without press/interkey WAITs so the device
+        # sends keystrokes back-to-back at the keyboard endpoint rate
+        self.fast_type: bool = fast_type
+        # Compress mode packs the bytecode into a compressed program container
+        # when that makes it smaller
+        self.compress: bool = compress
+        # Optimize mode runs the peephole optimizer over the emitted bytecode
+        self.optimize: bool = optimize
+        # Legacy loops mode compiles repeat with SET_COUNTER/DEC/JNZ counters
+        # instead of the VM's PUSH_LOOP/NEXT loop stack. It is also used when loops
+        # nest deeper than the loop stack.
+        self.legacy_loops: bool = legacy_loops
+        self.unoptimized_size: int = 0  # Bytecode size before optimization
+        self.optimized_size: int = 0  # Bytecode size after optimization
         self.current_press_time: int = 30  # Default 30ms
         self.current_interkey_time: int = 30  # Default 30ms
         self.counter_index: int = 0
@@ -407,8 +445,30 @@ class Compiler:
     def compile(self, source: str) -> bytes:
         """Compile ODKeyScript source to bytecode"""
         lexer = Lexer(source)
-        self._compile_statements(lexer)
-        return bytes(self.bytecode)
+        try:
+            self._compile_statements(lexer)
+        except _LoopStackOverflow:
+            legacy = Compiler(
+                fast_type=self.fast_type,
+                compress=self.compress,
+                optimize=self.optimize,
+                legacy_loops=True,
+            )
+            bytecode = legacy.compile(source)
+            self.legacy_loops = True
+            self.unoptimized_size = legacy.unoptimized_size
+            self.optimized_size = legacy.optimized_size
+            return bytecode
+        bytecode = bytes(self.bytecode)
+        self.unoptimized_size = len(bytecode)
+        if self.optimize:
+            bytecode = Optimizer().optimize(bytecode)
+        self.optimized_size = len(bytecode)
+        if self.compress and bytecode:
+            compressed = compress_program(bytecode)
+            if len(compressed) < len(bytecode):
+                return compressed
+        return bytecode
 
     def _compile_statements(self, lexer: Lexer) -> None:
         """Compile a sequence of statements"""
@@ -454,6 +514,13 @@ class Compiler:
                 f"Expected command, got {token.type}", token.line, token.column
             )
 
+    @staticmethod
+    def _is_key(token: Token) -> bool:
+        """Check whether a token names a key (the digit keys lex as numbers)"""
+        return token.type == TokenType.KEY or (
+            token.type == TokenType.NUMBER and token.value in Lexer.KEY_MAP
+        )
+
     def _compile_press_time(self, lexer: Lexer) -> None:
         """Compile press_time command"""
         lexer.tokens.pop(0)  # Remove 'press_time'
@@ -517,11 +584,13 @@ class Compiler:
                         f"Unknown modifier: {token.value}", token.line, token.column
                     )
                 lexer.tokens.pop(0)
-            elif token.type == TokenType.KEY:
+            elif self._is_key(token):
                 if token.value in Lexer.KEY_MAP:
-                    if len(keys) >= 6:
+                    if len(keys) >= self.MAX_KEYS:
                         raise CompileError(
-                            "Too many keys (maximum 6)", token.line, token.column
+                            f"Too many keys (maximum {self.MAX_KEYS})",
+                            token.line,
+                            token.column,
                         )
                     keys.append(Lexer.KEY_MAP[token.value])
                 else:
@@ -542,11 +611,12 @@ class Compiler:
         """Compile keyup command"""
         lexer.tokens.pop(0)  # Remove 'keyup'
 
-        # Check if it's a bare keyup (release all)
-        if not lexer.tokens or lexer.tokens[0].type in [
-            TokenType.EOF,
-            TokenType.COMMENT,
-        ]:
+        # Check if it's a bare keyup (release all), which may be followed by anything
+        # but a modifier or key: the end of the file, a comment, another command or
+        # the end of a block
+        if not lexer.tokens or not (
+            lexer.tokens[0].type == TokenType.MODIFIER or self._is_key(lexer.tokens[0])
+        ):
             self.bytecode.append(Opcode.KEYUP_ALL.value)
             return
 
@@ -565,11 +635,13 @@ class Compiler:
                         f"Unknown modifier: {token.value}", token.line, token.column
                     )
                 lexer.tokens.pop(0)
-            elif token.type == TokenType.KEY:
+            elif self._is_key(token):
                 if token.value in Lexer.KEY_MAP:
-                    if len(keys) >= 6:
+                    if len(keys) >= self.MAX_KEYS:
                         raise CompileError(
-                            "Too many keys (maximum 6)", token.line, token.column
+                            f"Too many keys (maximum {self.MAX_KEYS})",
+                            token.line,
+                            token.column,
                         )
                     keys.append(Lexer.KEY_MAP[token.value])
                 else:
@@ -605,11 +677,13 @@ class Compiler:
                         f"Unknown modifier: {token.value}", token.line, token.column
                     )
                 lexer.tokens.pop(0)
-            elif token.type == TokenType.KEY:
+            elif self._is_key(token):
                 if token.value in Lexer.KEY_MAP:
-                    if len(keys) >= 6:
+                    if len(keys) >= self.MAX_KEYS:
                         raise CompileError(
-                            "Too many keys (maximum 6)", token.line, token.column
+                            f"Too many keys (maximum {self.MAX_KEYS})",
+                            token.line,
+                            token.column,
                         )
                     keys.append(Lexer.KEY_MAP[token.value])
                 else:
@@ -627,6 +701,15 @@ class Compiler:
                 0,
             )
 
+        # A single key is one PRESS instruction
+        if len(keys) == 1:
+            self.bytecode.append(Opcode.PRESS.value)
+            self.bytecode.append(modifiers)
+            self.bytecode.append(keys[0])
+            self.bytecode.extend(self._uint16_to_bytes(self.current_press_time))
+            self.bytecode.extend(self._uint16_to_bytes(self.current_interkey_time))
+            return
+
         # Emit KEYDN + WAIT + KEYUP + WAIT sequence
         self.bytecode.append(Opcode.KEYDN.value)
         self.bytecode.append(modifiers)
@@ -658,43 +741,56 @@ class Compiler:
         string = lexer.tokens[0].value
         lexer.tokens.pop(0)  # Remove string
 
-        # For each character, emit KEYDN + WAIT + KEYUP + interkey_time
-        for i, char in enumerate(string):
+        if self.fast_type:
+            self._compile_fast_type(string)
+            return
+
+        # Emit TYPE instructions of up to MAX_TYPE_CHARS characters each. TYPE waits
+        # interkey_time between its characters but not after the last one, so
+        # consecutive chunks are separated by an explicit WAIT.
+        pairs: List[int] = []
+        for char in string:
             if char == " ":
-                # Space key
-                self.bytecode.append(Opcode.KEYDN.value)
-                self.bytecode.append(0)  # No modifiers
-                self.bytecode.append(1)  # One key
-                self.bytecode.append(Lexer.KEY_MAP["SPACE"])
+                key_code, modifiers = Lexer.KEY_MAP["SPACE"], 0
+            else:
+                key_code, modifiers = self._char_to_keycode(char)
+            pairs.extend([modifiers, key_code])
 
+        for start in range(0, len(pairs), self.MAX_TYPE_CHARS * 2):
+            if start > 0:
                 self.bytecode.append(Opcode.WAIT.value)
-                self.bytecode.extend(self._uint16_to_bytes(self.current_press_time))
+                self.bytecode.extend(self._uint16_to_bytes(self.current_interkey_time))
 
-                self.bytecode.append(Opcode.KEYUP.value)
-                self.bytecode.append(0)  # No modifiers
-                self.bytecode.append(1)  # One key
-                self.bytecode.append(Lexer.KEY_MAP["SPACE"])
+            chunk = pairs[start : start + self.MAX_TYPE_CHARS * 2]
+            self.bytecode.append(Opcode.TYPE.value)
+            self.bytecode.extend(self._uint16_to_bytes(self.current_press_time))
+            self.bytecode.extend(self._uint16_to_bytes(self.current_interkey_time))
+            self.bytecode.append(len(chunk) // 2)
+            self.bytecode.extend(chunk)
+
+    def _compile_fast_type(self, string: str) -> None:
+        """Compile type string without waits, one report per character"""
+        # Each KEYDN replaces the previously pressed key, so the host sees the release
+        # of one character and the press of the next in a single report. A character
+        # that repeats the previous key needs an explicit release in between.
+        previous_key_code = None
+        for char in string:
+            if char == " ":
+                key_code, modifiers = Lexer.KEY_MAP["SPACE"], 0
             else:
-                # Map character to key code and modifiers
                 key_code, modifiers = self._char_to_keycode(char)
 
-                self.bytecode.append(Opcode.KEYDN.value)
-                self.bytecode.append(modifiers)
-                self.bytecode.append(1)  # One key
-                self.bytecode.append(key_code)
+            if key_code == previous_key_code:
+                self.bytecode.append(Opcode.KEYUP_ALL.value)
 
-                self.bytecode.append(Opcode.WAIT.value)
-                self.bytecode.extend(self._uint16_to_bytes(self.current_press_time))
-
-                self.bytecode.append(Opcode.KEYUP.value)
-                self.bytecode.append(modifiers)
-                self.bytecode.append(1)  # One key
-                self.bytecode.append(key_code)
+            self.bytecode.append(Opcode.KEYDN.value)
+            self.bytecode.append(modifiers)
+            self.bytecode.append(1)  # One key
+            self.bytecode.append(key_code)
+            previous_key_code = key_code
 
-            # Add interkey_time delay between keystrokes (except after the last character)
-            if i < len(string) - 1:
-                self.bytecode.append(Opcode.WAIT.value)
-                self.bytecode.extend(self._uint16_to_bytes(self.current_interkey_time))
+        if string:
+            self.bytecode.append(Opcode.KEYUP_ALL.value)
 
     def _compile_repeat(self, lexer: Lexer) -> None:
         """Compile repeat command"""
@@ -708,9 +804,11 @@ class Compiler:
             )
 
         count = int(lexer.tokens[0].value)
-        if count < 0 or count > 65535:
+        max_count = 65535 if self.legacy_loops else 0xFFFFFFFF
+        if count < 0 or count > max_count:
             raise CompileError(
-                "repeat count must be between 0 and 65535",
+                f"repeat count must be between 0 and {max_count}"
+                + (" with legacy loops" if self.legacy_loops else ""),
                 lexer.tokens[0].line,
                 lexer.tokens[0].column,
             )
@@ -729,6 +827,8 @@ class Compiler:
         lexer.tokens.pop(0)  # Remove '{'
 
         # Check for nested loop limit
+        if not self.legacy_loops and len(self.loop_stack) >= self.MAX_LOOP_DEPTH:
+            raise _LoopStackOverflow()
         if len(self.loop_stack) >= self.max_counters:
             raise CompileError(
                 f"Too many nested loops (maximum {self.max_counters})",
@@ -736,14 +836,18 @@ class Compiler:
                 lexer.tokens[0].column,
             )
 
-        # Allocate counter
-        counter_index = self.counter_index
-        self.counter_index += 1
-
-        # Set counter to repeat count
-        self.bytecode.append(Opcode.SET_COUNTER.value)
-        self.bytecode.append(counter_index)
-        self.bytecode.extend(self._uint16_to_bytes(count))
+        if self.legacy_loops:
+            # Allocate counter and set it to the repeat count
+            counter_index = self.counter_index
+            self.counter_index += 1
+            self.bytecode.append(Opcode.SET_COUNTER.value)
+            self.bytecode.append(counter_index)
+            self.bytecode.extend(self._uint16_to_bytes(count))
+        else:
+            # Push the repeat count onto the loop stack
+            counter_index = -1
+            self.bytecode.append(Opcode.PUSH_LOOP.value)
+            self.bytecode.extend(self._uint32_to_bytes(count))
 
         # Mark loop start
         loop_start = len(self.bytecode)
@@ -767,12 +871,13 @@ class Compiler:
 
         lexer.tokens.pop(0)  # Remove '}'
 
-        # Emit loop control
-        self.bytecode.append(Opcode.DEC.value)
-        self.bytecode.append(counter_index)
-
-        # Emit conditional jump back to loop start
-        self.bytecode.append(Opcode.JNZ.value)
+        # Emit loop control and the jump back to loop start
+        if self.legacy_loops:
+            self.bytecode.append(Opcode.DEC.value)
+            self.bytecode.append(counter_index)
+            self.bytecode.append(Opcode.JNZ.value)
+        else:
+            self.bytecode.append(Opcode.NEXT.value)
         self.bytecode.extend(self._uint32_to_bytes(loop_start))
 
         # Update loop stack
@@ -0,0 +1,239 @@
+#!/usr/bin/env python3
+"""
+ODKeyScript Program Compression
+
+Packs ODKeyScript bytecode into the compressed program container understood by
+the ODKey VM. The bytecode is split into blocks of at most BLOCK_SIZE bytes on
+instruction boundaries and each block is compressed independently in the LZ4
+block format, so the device can decompress one block at a time into a small
+window while the program runs.
+"""
+
+import struct
+from typing import List, Tuple
+
+from .odkeyscript_disassembler import Opcode
+
+# Container layout (see ODKeyScript.md)
+MAGIC = b"ODKZ"
+VERSION = 1
+HEADER_SIZE = 12
+BLOCK_ENTRY_SIZE = 8
+BLOCK_SIZE = 2048  # Must not exceed the VM's window size
+
+# LZ4 block format parameters
+MIN_MATCH = 4
+MAX_DISTANCE = 0xFFFF
+LAST_LITERALS = 5  # The last 5 bytes of a block are always literals
+MATCH_SAFE_DISTANCE = 12  # The last match must start this far before the end
+
+
+def is_compressed(data: bytes) -> bool:
+    """Return True if data is a compressed program container"""
+    return data[: len(MAGIC)] == MAGIC
+
+
+def instruction_length(bytecode: bytes, offset: int) -> int:
+    """Return the length of the instruction at offset"""
+    opcode = bytecode[offset]
+    if opcode in (Opcode.KEYDN, Opcode.KEYUP):
+        if offset + 3 > len(bytecode):
+            raise ValueError(f"Truncated instruction at offset 0x{offset:04X}")
+        return 3 + bytecode[offset + 2]
+    if opcode == Opcode.TYPE:
+        if offset + 6 > len(bytecode):
+            raise ValueError(f"Truncated instruction at offset 0x{offset:04X}")
+        return 6 + 2 * bytecode[offset + 5]
+    lengths = {
+        Opcode.KEYUP_ALL: 1,
+        Opcode.WAIT: 3,
+        Opcode.SET_COUNTER: 4,
+        Opcode.DEC: 2,
+        Opcode.JNZ: 5,
+        Opcode.PRESS: 7,
+        Opcode.PUSH_LOOP: 5,
+        Opcode.NEXT: 5,
+    }
+    if opcode not in lengths:
+        raise ValueError(f"Unknown opcode 0x{opcode:02X} at offset 0x{offset:04X}")
+    return lengths[opcode]
+
+
+def split_blocks(
+    bytecode: bytes, block_size: int = BLOCK_SIZE
+) -> List[Tuple[int, int]]:
+    """Split bytecode into (start, end) blocks that never split an instruction"""
+    blocks = []
+    start = 0
+    offset = 0
+    while offset < len(bytecode):
+        length = instruction_length(bytecode, offset)
+        if offset + length > len(bytecode):
+            raise ValueError(f"Truncated instruction at offset 0x{offset:04X}")
+        if length > block_size:
+            raise ValueError(
+                f"Instruction at offset 0x{offset:04X} exceeds the block size"
+            )
+        if offset + length - start > block_size:
+            blocks.append((start, offset))
+            start = offset
+        offset += length
+    if offset > start:
+        blocks.append((start, offset))
+    return blocks
+
+
+def _encode_length(value: int) -> bytes:
+    """Encode the part of a literal or match length that does not fit the token"""
+    out = bytearray()
+    while value >= 255:
+        out.append(255)
+        value -= 255
+    out.append(value)
+    return bytes(out)
+
+
+def _encode_sequence(
+    literals: bytes, distance: int = 0, match_length: int = 0
+) -> bytes:
+    """Encode one LZ4 sequence (a final sequence has no match)"""
+    out = bytearray()
+    literal_nibble = min(len(literals), 15)
+    match_nibble = min(match_length - MIN_MATCH, 15) if match_length else 0
+    out.append((literal_nibble << 4) | match_nibble)
+    if literal_nibble == 15:
+        out += _encode_length(len(literals) - 15)
+    out += literals
+    if match_length:
+        out += struct.pack("<H", distance)
+        if match_nibble == 15:
+            out += _encode_length(match_length - MIN_MATCH - 15)
+    return bytes(out)
+
+
+def lz4_compress_block(data: bytes) -> bytes:
+    """Compress data in the LZ4 block format using a greedy hash-chain matcher"""
+    out = bytearray()
+    last_positions = {}  # 4-byte sequence -> most recent position
+    anchor = 0
+    pos = 0
+    match_limit = len(data) - MATCH_SAFE_DISTANCE
+    while pos < match_limit:
+        key = data[pos : pos + MIN_MATCH]
+        candidate = last_positions.get(key)
+        last_positions[key] = pos
+        if candidate is None or pos - candidate > MAX_DISTANCE:
+            pos += 1
+            continue
+
+        length = MIN_MATCH
+        max_length = len(data) - LAST_LITERALS - pos
+        while length < max_length and data[candidate + length] == data[pos + length]:
+            length += 1
+
+        out += _encode_sequence(data[anchor:pos], pos - candidate, length)
+        for i in range(pos + 1, min(pos + length, match_limit)):
+            last_positions[data[i : i + MIN_MATCH]] = i
+        pos += length
+        anchor = pos
+
+    out += _encode_sequence(data[anchor:])
+    return bytes(out)
+
+
+def lz4_decompress_block(data: bytes, max_size: int) -> bytes:
+    """Decompress an LZ4 block, failing if it would exceed max_size bytes"""
+    out = bytearray()
+    pos = 0
+
+    def read_length(value: int) -> int:
+        nonlocal pos
+        if value != 15:
+            return value
+        while True:
+            if pos >= len(data):
+                raise ValueError("Truncated length")
+            extra = data[pos]
+            pos += 1
+            value += extra
+            if extra != 255:
+                return value
+
+    while pos < len(data):
+        token = data[pos]
+        pos += 1
+        literal_length = read_length(token >> 4)
+        if pos + literal_length > len(data):
+            raise ValueError("Truncated literals")
+        out += data[pos : pos + literal_length]
+        pos += literal_length
+        if pos >= len(data):
+            break
+
+        if pos + 2 > len(data):
+            raise ValueError("Truncated match offset")
+        distance = data[pos] | (data[pos + 1] << 8)
+        pos += 2
+        if distance == 0 or distance > len(out):
+            raise ValueError("Invalid match offset")
+        match_length = read_length(token & 0x0F) + MIN_MATCH
+        for _ in range(match_length):
+            out.append(out[-distance])
+        if len(out) > max_size:
+            raise ValueError("Block too large")
+
+    if len(out) > max_size:
+        raise ValueError("Block too large")
+    return bytes(out)
+
+
+def compress_program(bytecode: bytes, block_size: int = BLOCK_SIZE) -> bytes:
+    """Pack bytecode into a compressed program container"""
+    if not bytecode:
+        raise ValueError("Cannot compress an empty program")
+    blocks = split_blocks(bytecode, block_size)
+    if len(blocks) > 0xFFFF:
+        raise ValueError("Program has too many blocks")
+
+    table = bytearray()
+    data = bytearray()
+    for start, end in blocks:
+        table += struct.pack("<II", start, len(data))
+        data += lz4_compress_block(bytecode[start:end])
+
+    header = MAGIC + struct.pack("<BBHI", VERSION, 0, len(blocks), len(bytecode))
+    return header + bytes(table) + bytes(data)
+
+
+def decompress_program(container: bytes) -> bytes:
+    """Unpack a compressed program container back to bytecode"""
+    if not is_compressed(container) or len(container) < HEADER_SIZE:
+        raise ValueError("Not a compressed program container")
+    version, _, block_count, uncompressed_size = struct.unpack_from(
+        "<BBHI", container, len(MAGIC)
+    )
+    if version != VERSION:
+        raise ValueError(f"Unsupported container version {version}")
+
+    table_end = HEADER_SIZE + block_count * BLOCK_ENTRY_SIZE
+    if block_count == 0 or table_end > len(container):
+        raise ValueError("Invalid block table")
+    entries = [
+        struct.unpack_from("<II", container, HEADER_SIZE + i * BLOCK_ENTRY_SIZE)
+        for i in range(block_count)
+    ]
+    data = container[table_end:]
+
+    bytecode = bytearray()
+    for i, (start, data_offset) in enumerate(entries):
+        if i + 1 < block_count:
+            end, data_end = entries[i + 1]
+        else:
+            end, data_end = uncompressed_size, len(data)
+        if start != len(bytecode) or not 0 < end - start <= BLOCK_SIZE:
+            raise ValueError(f"Invalid block {i}")
+        block = lz4_decompress_block(data[data_offset:data_end], end - start)
+        if len(block) != end - start:
+            raise ValueError(f"Block {i} has the wrong size")
+        bytecode += block
+    return bytes(bytecode)
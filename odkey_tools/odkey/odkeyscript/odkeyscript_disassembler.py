@@ -6,7 +6,10 @@ Disassembles ODKeyScript bytecode back to a human-readable format.
 """
 
 import sys
-from typing import List
+from typing import TYPE_CHECKING, Dict, List, Optional
+
+if TYPE_CHECKING:
+    from .odkeyscript_profile import Profile
 
 
 class Opcode:
@@ -19,6 +22,10 @@ class Opcode:
     SET_COUNTER = 0x14
     DEC = 0x15
     JNZ = 0x16
+    PRESS = 0x17
+    TYPE = 0x18
+    PUSH_LOOP = 0x19
+    NEXT = 0x1A
 
 
 # Key mappings (reverse lookup)
@@ -198,9 +205,54 @@ def format_keys(keys: List[int]) -> str:
     return " ".join(key_names)
 
 
-def disassemble(bytecode: bytes) -> List[str]:
-    """Disassemble bytecode to human-readable format"""
+def format_key_press(modifier_byte: int, key: int) -> str:
+    """Format a single key with its modifiers as MOD+MOD+KEY"""
+    names = format_modifiers(modifier_byte).split()
+    names.append(format_keys([key]))
+    return "+".join(names)
+
+
+def opcode_names() -> Dict[int, str]:
+    """Map opcode values to their names"""
+    return {
+        value: name
+        for name, value in vars(Opcode).items()
+        if not name.startswith("_") and isinstance(value, int)
+    }
+
+
+def disassemble(bytecode: bytes, profile: Optional["Profile"] = None) -> List[str]:
+    """
+    Disassemble bytecode, a compressed program container, or a library
+
+    With a profile downloaded from the device, instructions are annotated with their
+    PC samples and WAIT timing errors. In a library, only the program the profile
+    was recorded from (by size) is annotated.
+    """
+    # Imported here because these modules use Opcode from this one
+    from .odkeyscript_compression import decompress_program, is_compressed
+    from .odkeyscript_library import is_library, parse_library
+    from .odkeyscript_profile import annotate, format_summary
+
     instructions = []
+    if is_library(bytecode):
+        programs = parse_library(bytecode)
+        instructions.append(f"; Program library: {len(programs)} programs")
+        for i, (name, program) in enumerate(programs):
+            instructions.append("")
+            instructions.append(f"; Program {i}: {name} ({len(program)} bytes)")
+            profiled = profile is not None and len(program) == profile.program_size
+            instructions += disassemble(program, profile if profiled else None)
+        return instructions
+    if profile is not None:
+        instructions += format_summary(profile, opcode_names())
+    if is_compressed(bytecode):
+        container_size = len(bytecode)
+        bytecode = decompress_program(bytecode)
+        instructions.append(
+            f"; Compressed program: {container_size} bytes, "
+            f"{len(bytecode)} bytes uncompressed"
+        )
     pc = 0
 
     while pc < len(bytecode):
@@ -303,9 +355,63 @@ def disassemble(bytecode: bytes) -> List[str]:
             pc += 4
             instructions.append(f"0x{pc-5:04X}: JNZ 0x{address:04X}")
 
+        elif opcode == Opcode.PUSH_LOOP:
+            if pc + 4 > len(bytecode):
+                instructions.append(f"0x{pc-1:04X}: PUSH_LOOP (incomplete)")
+                break
+
+            count = bytes_to_uint32(bytecode, pc)
+            pc += 4
+            instructions.append(f"0x{pc-5:04X}: PUSH_LOOP {count}")
+
+        elif opcode == Opcode.NEXT:
+            if pc + 4 > len(bytecode):
+                instructions.append(f"0x{pc-1:04X}: NEXT (incomplete)")
+                break
+
+            address = bytes_to_uint32(bytecode, pc)
+            pc += 4
+            instructions.append(f"0x{pc-5:04X}: NEXT 0x{address:04X}")
+
+        elif opcode == Opcode.PRESS:
+            if pc + 6 > len(bytecode):
+                instructions.append(f"0x{pc-1:04X}: PRESS (incomplete)")
+                break
+
+            key_str = format_key_press(bytecode[pc], bytecode[pc + 1])
+            press_ms = bytes_to_uint16(bytecode, pc + 2)
+            gap_ms = bytes_to_uint16(bytecode, pc + 4)
+            pc += 6
+            instructions.append(f"0x{pc-7:04X}: PRESS {key_str} {press_ms} {gap_ms}")
+
+        elif opcode == Opcode.TYPE:
+            if pc + 5 > len(bytecode):
+                instructions.append(f"0x{pc-1:04X}: TYPE (incomplete)")
+                break
+
+            press_ms = bytes_to_uint16(bytecode, pc)
+            gap_ms = bytes_to_uint16(bytecode, pc + 2)
+            count = bytecode[pc + 4]
+            pc += 5
+
+            if pc + 2 * count > len(bytecode):
+                instructions.append(f"0x{pc-6:04X}: TYPE (incomplete)")
+                break
+
+            key_strs = [
+                format_key_press(bytecode[pc + 2 * i], bytecode[pc + 2 * i + 1])
+                for i in range(count)
+            ]
+            pc += 2 * count
+            instructions.append(
+                f"0x{pc-2*count-6:04X}: TYPE {press_ms} {gap_ms} {' '.join(key_strs)}"
+            )
+
         else:
             instructions.append(f"0x{pc-1:04X}: UNKNOWN_OPCODE 0x{opcode:02X}")
 
+    if profile is not None:
+        instructions = annotate(instructions, profile)
     return instructions
 
 
@@ -0,0 +1,88 @@
+#!/usr/bin/env python3
+"""
+ODKeyScript Program Libraries
+
+Packs several ODKeyScript programs into a single program image understood by the
+ODKey firmware. The image starts with a directory of named entries, so the device
+can switch between programs by index without rewriting its program storage.
+"""
+
+import struct
+import zlib
+from typing import List, Tuple
+
+# Library layout (see ODKeyScript.md)
+MAGIC = b"ODKL"
+VERSION = 1
+HEADER_SIZE = 8
+ENTRY_SIZE = 28
+NAME_SIZE = 16  # Including the terminating NUL
+MAX_PROGRAMS = 64
+
+
+def is_library(data: bytes) -> bool:
+    """Return True if data is a program library"""
+    return data[: len(MAGIC)] == MAGIC
+
+
+def build_library(programs: List[Tuple[str, bytes]]) -> bytes:
+    """Pack (name, bytecode) pairs into a program library"""
+    if not programs:
+        raise ValueError("A library needs at least one program")
+    if len(programs) > MAX_PROGRAMS:
+        raise ValueError(f"A library holds at most {MAX_PROGRAMS} programs")
+
+    names = set()
+    table = bytearray()
+    data = bytearray()
+    offset = HEADER_SIZE + len(programs) * ENTRY_SIZE
+    for name, bytecode in programs:
+        encoded = name.encode("utf-8")
+        if not encoded or len(encoded) >= NAME_SIZE:
+            raise ValueError(
+                f"Program name '{name}' must be 1-{NAME_SIZE - 1} bytes long"
+            )
+        if name in names:
+            raise ValueError(f"Duplicate program name '{name}'")
+        if not bytecode:
+            raise ValueError(f"Program '{name}' is empty")
+        if is_library(bytecode):
+            raise ValueError(f"Program '{name}' is itself a library")
+        names.add(name)
+
+        table += struct.pack(
+            f"<{NAME_SIZE}sIII",
+            encoded,
+            offset + len(data),
+            len(bytecode),
+            zlib.crc32(bytecode),
+        )
+        data += bytecode
+
+    header = MAGIC + struct.pack("<BBH", VERSION, 0, len(programs))
+    return header + bytes(table) + bytes(data)
+
+
+def parse_library(image: bytes) -> List[Tuple[str, bytes]]:
+    """Unpack a program library into (name, bytecode) pairs"""
+    if not is_library(image) or len(image) < HEADER_SIZE:
+        raise ValueError("Not a program library")
+    version, _, count = struct.unpack_from("<BBH", image, len(MAGIC))
+    if version != VERSION:
+        raise ValueError(f"Unsupported library version {version}")
+    if not 0 < count <= MAX_PROGRAMS or HEADER_SIZE + count * ENTRY_SIZE > len(image):
+        raise ValueError("Invalid library directory")
+
+    programs = []
+    for i in range(count):
+        raw_name, offset, size, crc = struct.unpack_from(
+            f"<{NAME_SIZE}sIII", image, HEADER_SIZE + i * ENTRY_SIZE
+        )
+        if size == 0 or offset + size > len(image):
+            raise ValueError(f"Library program {i} is out of bounds")
+        bytecode = image[offset : offset + size]
+        if zlib.crc32(bytecode) != crc:
+            raise ValueError(f"Library program {i} has the wrong CRC")
+        name = raw_name.split(b"\0", 1)[0].decode("utf-8", errors="replace")
+        programs.append((name, bytecode))
+    return programs
@@ -0,0 +1,402 @@
+#!/usr/bin/env python3
+"""
+ODKeyScript Peephole Optimizer
+
+Rewrites compiled bytecode into smaller bytecode with the same behavior. The
+bytecode is parsed into an instruction list with jump targets resolved to
+instructions, local rewrites are applied until none matches, and the result is
+emitted with jump addresses relocated.
+
+Every rewrite keeps the timing of the HID reports. The only reports removed are
+ones the host never sees held: a KEYUP_ALL with nothing pressed sends nothing,
+and a KEYDN immediately replaced by a KEYDN of a superset of its keys lasts for
+zero time.
+"""
+
+from dataclasses import dataclass, field
+from typing import Dict, List, Optional, Tuple
+
+from .odkeyscript_compression import instruction_length
+from .odkeyscript_disassembler import Opcode
+
+MAX_U16 = 0xFFFF
+MAX_U32 = 0xFFFFFFFF
+# Bytes spent on loop control: SET_COUNTER (4) + DEC (2) + JNZ (5)
+LEGACY_LOOP_OVERHEAD = 11
+# Bytes spent on loop control: PUSH_LOOP (5) + NEXT (5)
+LOOP_OVERHEAD = 10
+# Instructions that keep their target as an instruction
+JUMPS = (Opcode.JNZ, Opcode.NEXT)
+
+
+@dataclass(eq=False)
+class Instruction:
+    """One instruction; JNZ/NEXT keep their target as an instruction, not an address"""
+
+    opcode: int
+    operands: bytearray = field(default_factory=bytearray)
+    target: Optional["Instruction"] = None
+
+    def size(self) -> int:
+        return 1 + (4 if self.opcode in JUMPS else len(self.operands))
+
+    def u16(self, offset: int) -> int:
+        return self.operands[offset] | (self.operands[offset + 1] << 8)
+
+    def set_u16(self, offset: int, value: int) -> None:
+        self.operands[offset] = value & 0xFF
+        self.operands[offset + 1] = (value >> 8) & 0xFF
+
+    def u32(self, offset: int) -> int:
+        return int.from_bytes(self.operands[offset : offset + 4], "little")
+
+    def set_u32(self, offset: int, value: int) -> None:
+        self.operands[offset : offset + 4] = value.to_bytes(4, "little")
+
+    def copy(self) -> "Instruction":
+        return Instruction(self.opcode, bytearray(self.operands), self.target)
+
+
+def parse(bytecode: bytes) -> List[Instruction]:
+    """Parse bytecode into an instruction list with resolved jump targets"""
+    instructions: List[Instruction] = []
+    by_offset: Dict[int, Instruction] = {}
+    addresses: List[Tuple[Instruction, int]] = []
+    offset = 0
+    while offset < len(bytecode):
+        length = instruction_length(bytecode, offset)
+        if offset + length > len(bytecode):
+            raise ValueError(f"Truncated instruction at offset 0x{offset:04X}")
+        instruction = Instruction(bytecode[offset])
+        if instruction.opcode in JUMPS:
+            address = int.from_bytes(bytecode[offset + 1 : offset + 5], "little")
+            addresses.append((instruction, address))
+        else:
+            instruction.operands = bytearray(bytecode[offset + 1 : offset + length])
+        instructions.append(instruction)
+        by_offset[offset] = instruction
+        offset += length
+
+    for instruction, address in addresses:
+        if address not in by_offset:
+            raise ValueError(f"Jump to 0x{address:04X} is not an instruction")
+        instruction.target = by_offset[address]
+    return instructions
+
+
+def emit(instructions: List[Instruction]) -> bytes:
+    """Emit an instruction list as bytecode with jump addresses relocated"""
+    offsets: Dict[int, int] = {}
+    offset = 0
+    for instruction in instructions:
+        offsets[id(instruction)] = offset
+        offset += instruction.size()
+
+    bytecode = bytearray()
+    for instruction in instructions:
+        bytecode.append(instruction.opcode)
+        if instruction.opcode in JUMPS:
+            assert instruction.target is not None
+            bytecode += offsets[id(instruction.target)].to_bytes(4, "little")
+        else:
+            bytecode += instruction.operands
+    return bytes(bytecode)
+
+
+def _jump_sources(instructions: List[Instruction]) -> Dict[int, List[Instruction]]:
+    """Map each jump target (by id) to the JNZ/NEXT instructions that jump to it"""
+    sources: Dict[int, List[Instruction]] = {}
+    for instruction in instructions:
+        if instruction.opcode in JUMPS and instruction.target is not None:
+            sources.setdefault(id(instruction.target), []).append(instruction)
+    return sources
+
+
+def _key_state(instruction: Instruction) -> Tuple[int, frozenset]:
+    """Return the (modifier, keys) operands of a KEYDN/KEYUP"""
+    return instruction.operands[0], frozenset(instruction.operands[2:])
+
+
+class Optimizer:
+    """Peephole optimizer for compiled ODKeyScript bytecode"""
+
+    def optimize(self, bytecode: bytes) -> bytes:
+        """Optimize bytecode, returning the (possibly unchanged) result"""
+        if not bytecode:
+            return bytecode
+        instructions = parse(bytecode)
+        changed = True
+        while changed:
+            changed = False
+            for rewrite in (
+                self._collapse_loops,
+                self._merge_waits,
+                self._drop_redundant_releases,
+                self._fold_key_presses,
+            ):
+                instructions, rewritten = rewrite(instructions)
+                changed |= rewritten
+        if not instructions:
+            # The VM rejects empty programs; KEYUP_ALL with nothing pressed is a no-op
+            instructions = [Instruction(Opcode.KEYUP_ALL)]
+        return emit(instructions)
+
+    def _merge_waits(
+        self, instructions: List[Instruction]
+    ) -> Tuple[List[Instruction], bool]:
+        """Merge adjacent WAITs, fold WAITs into a preceding PRESS, drop WAIT 0"""
+        sources = _jump_sources(instructions)
+        result: List[Instruction] = []
+        changed = False
+        for instruction in instructions:
+            if instruction.opcode == Opcode.WAIT and id(instruction) not in sources:
+                ms = instruction.u16(0)
+                previous = result[-1] if result else None
+                if ms == 0:
+                    changed = True
+                    continue
+                if previous is not None and previous.opcode == Opcode.WAIT:
+                    if previous.u16(0) + ms <= MAX_U16:
+                        previous.set_u16(0, previous.u16(0) + ms)
+                        changed = True
+                        continue
+                if previous is not None and previous.opcode == Opcode.PRESS:
+                    if previous.u16(4) + ms <= MAX_U16:
+                        previous.set_u16(4, previous.u16(4) + ms)
+                        changed = True
+                        continue
+            result.append(instruction)
+        return result, changed
+
+    def _drop_redundant_releases(
+        self, instructions: List[Instruction]
+    ) -> Tuple[List[Instruction], bool]:
+        """Drop KEYUP_ALL when no key or modifier can be pressed"""
+        sources = _jump_sources(instructions)
+        result: List[Instruction] = []
+        changed = False
+        # Exact (modifier, keys) state, or None where it depends on the path taken
+        state: Optional[Tuple[int, frozenset]] = (0, frozenset())
+        for instruction in instructions:
+            if id(instruction) in sources:
+                state = None
+
+            if instruction.opcode == Opcode.KEYDN:
+                state = _key_state(instruction)
+            elif instruction.opcode == Opcode.KEYUP:
+                if state is not None:
+                    modifier, keys = _key_state(instruction)
+                    state = (state[0] & ~modifier, state[1] - keys)
+            elif instruction.opcode == Opcode.PRESS or (
+                instruction.opcode == Opcode.TYPE and instruction.operands[4] > 0
+            ):
+                state = (0, frozenset())
+            elif instruction.opcode == Opcode.KEYUP_ALL:
+                if state == (0, frozenset()) and id(instruction) not in sources:
+                    changed = True
+                    continue
+                state = (0, frozenset())
+            result.append(instruction)
+        return result, changed
+
+    def _fold_key_presses(
+        self, instructions: List[Instruction]
+    ) -> Tuple[List[Instruction], bool]:
+        """Drop a KEYDN that the next KEYDN replaces with a superset of its keys"""
+        sources = _jump_sources(instructions)
+        result: List[Instruction] = []
+        changed = False
+        for index, instruction in enumerate(instructions):
+            following = None
+            if index + 1 < len(instructions):
+                following = instructions[index + 1]
+            if (
+                instruction.opcode == Opcode.KEYDN
+                and following is not None
+                and following.opcode == Opcode.KEYDN
+                and id(following) not in sources
+            ):
+                modifier, keys = _key_state(instruction)
+                next_modifier, next_keys = _key_state(following)
+                if (modifier & ~next_modifier) == 0 and keys <= next_keys:
+                    # Jumps here now land on the KEYDN that replaces this one
+                    for jump in sources.pop(id(instruction), []):
+                        jump.target = following
+                        sources.setdefault(id(following), []).append(jump)
+                    changed = True
+                    continue
+            result.append(instruction)
+        return result, changed
+
+    def _collapse_loops(
+        self, instructions: List[Instruction]
+    ) -> Tuple[List[Instruction], bool]:
+        """Collapse, flatten or unroll repeat loops that have a cheaper form
+
+        A loop is PUSH_LOOP n, body, NEXT to the body, or in legacy form SET_COUNTER
+        c n, body, DEC c, JNZ to the body, and runs its body max(n, 1) times. Loops
+        whose body is empty or runs once are removed, loops of WAITs become one
+        WAIT, a loop whose whole body is another loop is merged into the inner loop
+        (hoisting the inner loop setup out of the body), and loops whose unrolled
+        body is no larger than the loop are unrolled.
+        """
+        sources = _jump_sources(instructions)
+        index_of = {id(instruction): i for i, instruction in enumerate(instructions)}
+        counter_uses: Dict[int, int] = {}
+        for instruction in instructions:
+            if instruction.opcode in (Opcode.SET_COUNTER, Opcode.DEC):
+                counter = instruction.operands[0]
+                counter_uses[counter] = counter_uses.get(counter, 0) + 1
+
+        # Find loops that can be rewritten, keyed by their (start, end) range
+        candidates: List[Tuple[int, int, List[Instruction]]] = []
+        for end, jump in enumerate(instructions):
+            if jump.opcode not in JUMPS or jump.target is None:
+                continue
+            body_start = index_of[id(jump.target)]
+            start = body_start - 1
+            if start < 0:
+                continue
+            setup = instructions[start]
+            if jump.opcode == Opcode.NEXT:
+                if setup.opcode != Opcode.PUSH_LOOP or body_start > end:
+                    continue
+                body_end = end
+                count = max(setup.u32(0), 1)
+            else:
+                if body_start > end - 1:
+                    continue
+                dec = instructions[end - 1]
+                if (
+                    setup.opcode != Opcode.SET_COUNTER
+                    or dec.opcode != Opcode.DEC
+                    or setup.operands[0] != dec.operands[0]
+                    or counter_uses.get(setup.operands[0]) != 2
+                ):
+                    continue
+                body_end = end - 1
+                count = max(setup.u16(1), 1)
+            if not self._is_self_contained(
+                instructions, index_of, sources, start, body_end, end, jump
+            ):
+                continue
+            body = instructions[body_start:body_end]
+            replacement = self._loop_replacement(body, count, jump.opcode == Opcode.JNZ)
+            if replacement is not None:
+                candidates.append((start, end, replacement))
+
+        # Rewrite innermost loops first; enclosing loops are retried next pass
+        candidates.sort(key=lambda candidate: candidate[1] - candidate[0])
+        chosen: List[Tuple[int, int, List[Instruction]]] = []
+        for candidate in candidates:
+            if all(
+                candidate[1] < other[0] or candidate[0] > other[1] for other in chosen
+            ):
+                chosen.append(candidate)
+        if not chosen:
+            return instructions, False
+
+        # Jumps to a rewritten loop land on its replacement, or on whatever follows
+        # when it has none (which may itself be a rewritten loop)
+        chosen.sort(key=lambda candidate: candidate[0])
+        landings: Dict[int, Optional[Instruction]] = {}
+        result: List[Instruction] = []
+        position = 0
+        for start, end, replacement in chosen:
+            result.extend(instructions[position:start])
+            following = instructions[end + 1] if end + 1 < len(instructions) else None
+            landings[id(instructions[start])] = (
+                replacement[0] if replacement else following
+            )
+            result.extend(replacement)
+            position = end + 1
+        result.extend(instructions[position:])
+
+        for instruction in result:
+            target = instruction.target
+            while target is not None and id(target) in landings:
+                target = landings[id(target)]
+            if instruction.opcode in JUMPS and target is None:
+                return instructions, False  # Would jump past the end of the program
+            instruction.target = target
+        return result, True
+
+    def _is_self_contained(
+        self,
+        instructions: List[Instruction],
+        index_of: Dict[int, int],
+        sources: Dict[int, List[Instruction]],
+        start: int,
+        body_end: int,
+        end: int,
+        jump: Instruction,
+    ) -> bool:
+        """Check that nothing jumps into the loop and the body jumps only within"""
+        body_start = start + 1
+        for i in range(body_start, end + 1):
+            for source in sources.get(id(instructions[i]), []):
+                if source is jump:
+                    continue
+                if not body_start <= index_of[id(source)] < body_end:
+                    return False
+        for i in range(body_start, body_end):
+            target = instructions[i].target
+            if instructions[i].opcode in JUMPS:
+                if target is None or not body_start <= index_of[id(target)] < body_end:
+                    return False
+        return True
+
+    def _loop_replacement(
+        self, body: List[Instruction], count: int, legacy: bool
+    ) -> Optional[List[Instruction]]:
+        """Return cheaper instructions for a loop running body count times"""
+        if not body:
+            return []
+        if count == 1:
+            return body
+
+        if all(instruction.opcode == Opcode.WAIT for instruction in body):
+            total = sum(instruction.u16(0) for instruction in body) * count
+            if total <= MAX_U16:
+                wait = Instruction(Opcode.WAIT, bytearray(2))
+                wait.set_u16(0, total)
+                return [wait]
+
+        # The body is exactly one inner loop: run it count times as often. Copied:
+        # the body must stay untouched unless this rewrite is chosen.
+        inner_setup, inner_jump = body[0], body[-1]
+        if (
+            len(body) >= 2
+            and inner_setup.opcode == Opcode.PUSH_LOOP
+            and inner_jump.opcode == Opcode.NEXT
+            and inner_jump.target is body[1]
+        ):
+            total = max(inner_setup.u32(0), 1) * count
+            if total <= MAX_U32:
+                setup = inner_setup.copy()
+                setup.set_u32(0, total)
+                return [setup] + body[1:]
+        if (
+            len(body) >= 3
+            and inner_setup.opcode == Opcode.SET_COUNTER
+            and inner_jump.opcode == Opcode.JNZ
+            and inner_jump.target is body[1]
+            and body[-2].opcode == Opcode.DEC
+            and body[-2].operands[0] == inner_setup.operands[0]
+        ):
+            total = max(inner_setup.u16(1), 1) * count
+            if total <= MAX_U16:
+                setup = inner_setup.copy()
+                setup.set_u16(1, total)
+                return [setup] + body[1:]
+
+        if any(instruction.opcode in JUMPS for instruction in body):
+            return None
+        body_size = sum(instruction.size() for instruction in body)
+        overhead = LEGACY_LOOP_OVERHEAD if legacy else LOOP_OVERHEAD
+        if body_size * count <= body_size + overhead:
+            unrolled = list(body)
+            for _ in range(count - 1):
+                unrolled.extend(instruction.copy() for instruction in body)
+            return unrolled
+        return None
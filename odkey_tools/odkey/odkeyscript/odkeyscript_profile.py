@@ -0,0 +1,130 @@
+#!/usr/bin/env python3
+"""
+ODKeyScript VM Profiles
+
+Parses the VM profile image downloaded from an ODKey device and formats it for
+display next to a disassembly.
+"""
+
+import struct
+from dataclasses import dataclass, field
+from typing import Dict, List, Tuple
+
+# Profile image layout (see README.md)
+MAGIC = b"ODKP"
+VERSION = 1
+HEADER_FORMAT = "<4sBBBxIIIIIIIIiiqI"
+OPCODE_FORMAT = "<IQ"
+PC_FORMAT = "<IIIi"
+
+
+@dataclass
+class PcProfile:
+    """Samples and WAIT timing errors recorded at one program offset"""
+
+    hits: int
+    waits: int
+    wait_error_max_us: int
+
+
+@dataclass
+class Profile:
+    """Profile of the runs of one program"""
+
+    program_hash: int
+    program_size: int
+    runs: int
+    instructions: int
+    cpu_mhz: int
+    sample_period: int
+    pc_dropped: int
+    wait_count: int
+    wait_error_min_us: int
+    wait_error_max_us: int
+    wait_error_sum_us: int
+    opcodes: Dict[int, Tuple[int, int]] = field(default_factory=dict)
+    pcs: Dict[int, PcProfile] = field(default_factory=dict)
+
+
+def parse_profile(data: bytes) -> Profile:
+    """Parse a profile image"""
+    header_size = struct.calcsize(HEADER_FORMAT)
+    if len(data) < header_size:
+        raise ValueError("Profile image is truncated")
+
+    fields = struct.unpack_from(HEADER_FORMAT, data)
+    magic, version, opcode_base, opcode_slots = fields[:4]
+    if magic != MAGIC:
+        raise ValueError("Not a profile image")
+    if version != VERSION:
+        raise ValueError(f"Unsupported profile version {version}")
+    profile = Profile(*fields[4:-1])
+    pc_entries = fields[-1]
+
+    opcode_size = struct.calcsize(OPCODE_FORMAT)
+    pc_size = struct.calcsize(PC_FORMAT)
+    if len(data) < header_size + opcode_slots * opcode_size + pc_entries * pc_size:
+        raise ValueError("Profile image is truncated")
+
+    offset = header_size
+    for i in range(opcode_slots):
+        count, cycles = struct.unpack_from(OPCODE_FORMAT, data, offset)
+        if count:
+            profile.opcodes[opcode_base + i] = (count, cycles)
+        offset += opcode_size
+    for _ in range(pc_entries):
+        pc, hits, waits, wait_error_max_us = struct.unpack_from(PC_FORMAT, data, offset)
+        profile.pcs[pc] = PcProfile(hits, waits, wait_error_max_us)
+        offset += pc_size
+    return profile
+
+
+def format_summary(profile: Profile, opcode_names: Dict[int, str]) -> List[str]:
+    """Format the totals and the per-opcode table of a profile as comment lines"""
+    lines = [
+        f"; Profile: {profile.runs} runs, {profile.instructions} instructions, "
+        f"program 0x{profile.program_hash:08X} ({profile.program_size} bytes)"
+    ]
+    if profile.wait_count:
+        mean_us = profile.wait_error_sum_us // profile.wait_count
+        lines.append(
+            f"; WAIT timing error: {profile.wait_count} waits, "
+            f"min {profile.wait_error_min_us} us, mean {mean_us} us, "
+            f"max {profile.wait_error_max_us} us"
+        )
+    if profile.pc_dropped:
+        lines.append(f"; PC table full: {profile.pc_dropped} samples dropped")
+
+    lines.append(f"; {'Opcode':<12} {'Count':>10} {'Cycles':>12} {'Cycles/op':>10}")
+    cpu_mhz = profile.cpu_mhz or 1
+    for opcode, (count, cycles) in sorted(
+        profile.opcodes.items(), key=lambda item: item[1][1], reverse=True
+    ):
+        name = opcode_names.get(opcode, f"0x{opcode:02X}")
+        lines.append(f"; {name:<12} {count:>10} {cycles:>12} {cycles // count:>10}")
+    total_cycles = sum(cycles for _, cycles in profile.opcodes.values())
+    lines.append(f"; Interpretation time: {total_cycles / cpu_mhz / 1000:.1f} ms")
+    return lines
+
+
+def annotate(lines: List[str], profile: Profile) -> List[str]:
+    """Append the samples and WAIT timing errors of each offset to disassembly lines"""
+    annotated = []
+    for line in lines:
+        address, _, _ = line.partition(":")
+        entry = None
+        if address.startswith("0x"):
+            try:
+                entry = profile.pcs.get(int(address, 16))
+            except ValueError:
+                pass
+        if entry is not None:
+            notes = []
+            if entry.hits:
+                notes.append(f"samples={entry.hits}")
+            if entry.waits:
+                notes.append(f"waits={entry.waits}")
+                notes.append(f"late_max={entry.wait_error_max_us}us")
+            line = f"{line:<48} ; {' '.join(notes)}"
+        annotated.append(line)
+    return annotated
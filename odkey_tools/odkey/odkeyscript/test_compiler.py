@@ -4,6 +4,8 @@ Test script for ODKeyScript compiler
 """
 
 from .odkeyscript_compiler import CompileError, Compiler
+from .odkeyscript_compression import compress_program, decompress_program, is_compressed
+from .odkeyscript_library import build_library, is_library, parse_library
 
 
 def test_compiler() -> None:
@@ -28,6 +30,11 @@ def test_compiler() -> None:
             "source": "keydn M_LEFTSHIFT A B C\npause 100\nkeyup",
             "description": "Hold Shift+A+B+C for 100ms, then release all",
         },
+        {
+            "name": "More than 6 keys",
+            "source": "keydn A B C D E F G H\npause 100\nkeyup",
+            "description": "Hold 8 keys at once (requires NKRO mode on the device)",
+        },
         {
             "name": "Type string",
             "source": 'type "Hello World!"',
@@ -86,7 +93,7 @@ def test_compiler() -> None:
         },
         {
             "name": "Too many keys",
-            "source": "keydn A B C D E F G",
+            "source": "keydn A B C D E F G H I J K L M N O P Q",
             "expected": "Too many keys error",
         },
         {
@@ -96,7 +103,13 @@ def test_compiler() -> None:
         },
         {
             "name": "Repeat count too large",
+            "source": "repeat 4294967296 { press A }",
+            "expected": "Repeat count too large error",
+        },
+        {
+            "name": "Legacy loop repeat count too large",
             "source": "repeat 65536 { press A }",
+            "options": {"legacy_loops": True},
             "expected": "Repeat count too large error",
         },
         {
@@ -127,13 +140,159 @@ def test_compiler() -> None:
         print(f"   Expected: {test_case['expected']}")
 
         try:
-            bytecode = compiler.compile(test_case["source"])
+            bytecode = Compiler(**test_case.get("options", {})).compile(
+                test_case["source"]
+            )
             print(f"   ❌ Unexpected success: {len(bytecode)} bytes")
         except CompileError as e:
             print(f"   ✅ Expected error: {e.message}")
         except Exception as e:
             print(f"   ❌ Unexpected error: {e}")
 
+    # Test optimizer rewrites
+    print("\n\nOptimizer Test Cases")
+    print("=" * 50)
+
+    optimizer_cases = [
+        {
+            "name": "Adjacent pauses merge",
+            "source": "pause 10\npause 20",
+            "expected": [0x13, 30, 0],
+        },
+        {
+            "name": "Pause folds into press gap",
+            "source": "press A\npause 100",
+            "expected": [0x17, 0, 0x04, 30, 0, 130, 0],
+        },
+        {
+            "name": "Release with nothing pressed is dropped",
+            "source": 'type "a"\nkeyup',
+            "expected": [0x18, 30, 0, 30, 0, 1, 0, 0x04],
+        },
+        {
+            "name": "Key press folds into superset",
+            "source": "keydn A\nkeydn M_LEFTSHIFT A B\nkeyup",
+            "expected": [0x10, 0x02, 2, 0x04, 0x05, 0x12],
+        },
+        {
+            "name": "Loop of pauses collapses",
+            "source": "repeat 3 { pause 10 }",
+            "expected": [0x13, 30, 0],
+        },
+        {
+            "name": "Single-iteration loop is removed",
+            "source": "repeat 1 { press A }",
+            "expected": [0x17, 0, 0x04, 30, 0, 30, 0],
+        },
+        {
+            "name": "Nested loops flatten",
+            "source": "repeat 2 { repeat 3 { press A } }",
+            "expected": [0x19, 6, 0, 0, 0]
+            + [0x17, 0, 0x04, 30, 0, 30, 0]
+            + [0x1A, 5, 0, 0, 0],
+        },
+        {
+            "name": "Nested legacy loops flatten",
+            "source": "repeat 2 { repeat 3 { press A } }",
+            "options": {"legacy_loops": True},
+            "expected": [0x14, 1, 6, 0]
+            + [0x17, 0, 0x04, 30, 0, 30, 0]
+            + [0x15, 1, 0x16, 4, 0, 0, 0],
+        },
+        {
+            "name": "Loops nested deeper than the loop stack use counters",
+            "source": "repeat 1 { " * 17 + "repeat 3 { press A }" + " }" * 17,
+            "expected": [0x14, 17, 3, 0]
+            + [0x17, 0, 0x04, 30, 0, 30, 0]
+            + [0x15, 17, 0x16, 4, 0, 0, 0],
+        },
+    ]
+
+    for i, test_case in enumerate(optimizer_cases, 1):
+        print(f"\n{i}. {test_case['name']}")
+        print(f"   Source: {test_case['source']}")
+
+        try:
+            optimizing_compiler = Compiler(**test_case.get("options", {}))
+            bytecode = optimizing_compiler.compile(test_case["source"])
+            if list(bytecode) == test_case["expected"]:
+                print(
+                    f"   ✅ Success: {optimizing_compiler.unoptimized_size} -> "
+                    f"{optimizing_compiler.optimized_size} bytes"
+                )
+            else:
+                hex_bytes = " ".join(f"{b:02x}" for b in bytecode)
+                print(f"   ❌ Unexpected bytecode: {hex_bytes}")
+        except Exception as e:
+            print(f"   ❌ Error: {e}")
+
+    # Test compression round trips
+    print("\n\nCompression Test Cases")
+    print("=" * 50)
+
+    compression_cases = [
+        {
+            "name": "Single instruction",
+            "source": "press A",
+        },
+        {
+            "name": "Repetitive typing",
+            "source": 'type "' + "Hello World! " * 40 + '"',
+        },
+        {
+            "name": "Multiple blocks with loops",
+            "source": "repeat 5 {\n"
+            + 'type "The quick brown fox jumps over the lazy dog. "\n' * 30
+            + "}",
+        },
+    ]
+
+    for i, test_case in enumerate(compression_cases, 1):
+        print(f"\n{i}. {test_case['name']}")
+
+        try:
+            bytecode = Compiler().compile(test_case["source"])
+            container = compress_program(bytecode)
+            if not is_compressed(container):
+                print("   ❌ Container magic missing")
+            elif decompress_program(container) != bytecode:
+                print("   ❌ Round trip mismatch")
+            else:
+                print(f"   ✅ Success: {len(bytecode)} -> {len(container)} bytes")
+
+            emitted = Compiler(compress=True).compile(test_case["source"])
+            if len(emitted) > len(bytecode):
+                print(f"   ❌ Compressed output larger: {len(emitted)} bytes")
+        except Exception as e:
+            print(f"   ❌ Error: {e}")
+
+    # Test program library round trips
+    print("\n\nLibrary Test Cases")
+    print("=" * 50)
+
+    try:
+        programs = [
+            ("hello", Compiler().compile('type "Hello"')),
+            ("enter", Compiler().compile("press ENTER")),
+            ("packed", Compiler(compress=True).compile('type "' + "ab" * 200 + '"')),
+        ]
+        library = build_library(programs)
+        if not is_library(library):
+            print("   ❌ Library magic missing")
+        elif parse_library(library) != programs:
+            print("   ❌ Library round trip mismatch")
+        else:
+            print(f"   ✅ Success: {len(programs)} programs in {len(library)} bytes")
+    except Exception as e:
+        print(f"   ❌ Error: {e}")
+
+    for name in ("", "x" * 16):
+        try:
+            build_library([(name, b"\x12")])
+            print(f"   ❌ Accepted invalid name '{name}'")
+        except ValueError:
+            print(f"   ✅ Rejected invalid name '{name}'")
+
 
 if __name__ == "__main__":
     test_compiler()
@@ -2,11 +2,15 @@
 #include "button.h"
 #include "esp_event.h"
 #include "esp_log.h"
+#include "esp_timer.h"
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
 #include "http_service.h"
+#include "log_buffer.h"
 #include "mdns_service.h"
+#include "nvs_config.h"
 #include "nvs_odkey.h"
+#include "power.h"
 #include "program.h"
 #include "usb_core.h"
 #include "usb_keyboard.h"
@@ -18,6 +22,59 @@ static const char *TAG = "app";
 
 #define BUTTON_GPIO 5
 
+// Network bring-up runs below everything the keyboard needs, so a button press
+// during boot isn't held up by WiFi initialization
+#define NETWORK_INIT_TASK_STACK_SIZE 4096
+#define NETWORK_INIT_TASK_PRIORITY 1
+
+// Completion time of each boot phase (0 = not completed)
+static int64_t g_boot_times_us[APP_BOOT_PHASE_COUNT];
+
+static const char *const g_boot_phase_names[APP_BOOT_PHASE_COUNT] = {
+    [APP_BOOT_PHASE_CONFIG] = "config",
+    [APP_BOOT_PHASE_USB] = "usb",
+    [APP_BOOT_PHASE_INPUT] = "input",
+    [APP_BOOT_PHASE_NETWORK] = "network",
+};
+
+static void mark_boot_phase(app_boot_phase_t phase) {
+    g_boot_times_us[phase] = esp_timer_get_time();
+    ESP_LOGI(TAG,
+             "Boot phase '%s' done at %lld ms",
+             g_boot_phase_names[phase],
+             (long long)(g_boot_times_us[phase] / 1000));
+}
+
+// Bring up WiFi, mDNS and HTTP, then exit
+static void network_init_task(void *pvParameters) {
+    (void)pvParameters;
+
+    // Initialize WiFi
+    if (!wifi_init()) {
+        ESP_LOGE(TAG, "Failed to initialize WiFi. Skipping other network services.");
+        vTaskDelete(NULL);
+        return;
+    }
+
+    // Initialize mDNS service
+    if (!mdns_service_init()) {
+        ESP_LOGW(TAG, "Failed to initialize mDNS service, continuing without it");
+    }
+
+    // Initialize HTTP service module
+    if (!http_service_init()) {
+        ESP_LOGE(TAG, "Failed to initialize HTTP service");
+    }
+
+    // Start WiFi connection
+    if (!wifi_start()) {
+        ESP_LOGE(TAG, "Failed to start WiFi");
+    }
+
+    mark_boot_phase(APP_BOOT_PHASE_NETWORK);
+    vTaskDelete(NULL);
+}
+
 bool app_init(void) {
     // Initialize NVS ODKey module
     if (!nvs_odkey_init()) {
@@ -25,11 +82,27 @@ bool app_init(void) {
         return false;
     }
 
+    // Load the configuration once; modules read it from RAM from here on
+    if (!nvs_config_init()) {
+        ESP_LOGE(TAG, "Failed to load configuration cache");
+        return false;
+    }
+
+    // Apply log settings now that the configuration is available
+    log_buffer_load_settings();
+    mark_boot_phase(APP_BOOT_PHASE_CONFIG);
+
+    // Apply the power profile before USB comes up, so USB can hold off light sleep
+    if (!power_init()) {
+        ESP_LOGE(TAG, "Failed to initialize power management");
+        return false;
+    }
+
     // Initialize event loop
     ESP_ERROR_CHECK(esp_event_loop_create_default());
 
     // Initialize program
-    if (!program_init(usb_keyboard_send_keys)) {
+    if (!program_init(usb_keyboard_schedule_keys, usb_keyboard_cancel_scheduled)) {
         ESP_LOGE(TAG, "Failed to initialize program");
         return false;
     }
@@ -41,7 +114,8 @@ bool app_init(void) {
     }
 
     // Initialize USB keyboard module
-    if (!usb_keyboard_init(USB_KEYBOARD_INTERFACE_NUM)) {
+    if (!usb_keyboard_init(USB_KEYBOARD_INTERFACE_NUM,
+                           usb_core_keyboard_nkro_enabled())) {
         ESP_LOGE(TAG, "Failed to initialize USB keyboard");
         return false;
     }
@@ -51,33 +125,40 @@ bool app_init(void) {
         ESP_LOGE(TAG, "Failed to initialize USB system config");
         return false;
     }
+    mark_boot_phase(APP_BOOT_PHASE_USB);
 
     // Initialize button
     if (!button_init(BUTTON_GPIO)) {
         ESP_LOGE(TAG, "Failed to initialize button");
         return false;
     }
+    mark_boot_phase(APP_BOOT_PHASE_INPUT);
 
-    // Initialize WiFi
-    if (!wifi_init()) {
-        ESP_LOGE(TAG, "Failed to initialize WiFi. Skipping other network services.");
-    } else {
-        // Initialize mDNS service
-        if (!mdns_service_init()) {
-            ESP_LOGW(TAG, "Failed to initialize mDNS service, continuing without it");
-        }
-
-        // Initialize HTTP service module
-        if (!http_service_init()) {
-            ESP_LOGE(TAG, "Failed to initialize HTTP service");
-        }
-
-        // Start WiFi connection
-        if (!wifi_start()) {
-            ESP_LOGE(TAG, "Failed to start WiFi");
-        }
+    // Network services come up in the background; the device works over USB
+    // without them
+    if (xTaskCreate(network_init_task,
+                    "network_init",
+                    NETWORK_INIT_TASK_STACK_SIZE,
+                    NULL,
+                    NETWORK_INIT_TASK_PRIORITY,
+                    NULL) != pdPASS) {
+        ESP_LOGE(TAG, "Failed to create network init task");
     }
 
     ESP_LOGI(TAG, "System ready! Press button on GPIO %d to run program", BUTTON_GPIO);
     return true;
 }
+
+int64_t app_get_boot_time_us(app_boot_phase_t phase) {
+    if (phase >= APP_BOOT_PHASE_COUNT) {
+        return 0;
+    }
+    return g_boot_times_us[phase];
+}
+
+const char *app_boot_phase_name(app_boot_phase_t phase) {
+    if (phase >= APP_BOOT_PHASE_COUNT) {
+        return "unknown";
+    }
+    return g_boot_phase_names[phase];
+}
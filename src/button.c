@@ -1,9 +1,11 @@
 #include "button.h"
 #include "driver/gpio.h"
 #include "esp_log.h"
+#include "esp_sleep.h"
 #include "freertos/FreeRTOS.h"
 #include "freertos/timers.h"
-#include "nvs.h"
+#include "latency_stats.h"
+#include "nvs_config.h"
 #include "nvs_odkey.h"
 #include "program.h"
 
@@ -27,6 +29,8 @@ static struct {
 static void IRAM_ATTR button_isr_handler(void *arg) {
     (void)arg;
 
+    latency_stats_mark(LATENCY_POINT_BUTTON);
+
     // Disable interrupt temporarily
     gpio_intr_disable(g_button_state.gpio_pin);
     g_button_state.interrupt_enabled = false;
@@ -90,45 +94,52 @@ static void program_completion_callback(void *arg) {
     }
 }
 
-bool button_init(uint8_t gpio_pin) {
-    // Read configuration from NVS with defaults
-    nvs_handle_t nvs_handle;
-    esp_err_t ret = nvs_open(NVS_NAMESPACE, NVS_READONLY, &nvs_handle);
-    if (ret != ESP_OK) {
-        ESP_LOGE(TAG, "Failed to open NVS: %s", esp_err_to_name(ret));
-        return false;
-    }
-
-    // Read debounce delay with default
-    uint32_t debounce_ms = BUTTON_DEFAULT_DEBOUNCE_MS;
-    size_t required_size = sizeof(debounce_ms);
-    ret = nvs_get_blob(
-        nvs_handle, NVS_KEY_BUTTON_DEBOUNCE_MS, &debounce_ms, &required_size);
+// Read a button delay from the configuration, keeping the default if it is missing
+static uint32_t load_delay_ms(const char *key, uint32_t default_ms, const char *name) {
+    uint32_t delay_ms = default_ms;
+    size_t required_size = sizeof(delay_ms);
+    esp_err_t ret = nvs_config_get_blob(key, &delay_ms, &required_size);
     if (ret == ESP_ERR_NVS_NOT_FOUND) {
         ESP_LOGD(TAG,
-                 "Button debounce not found in NVS, using default %lu ms",
-                 (unsigned long)debounce_ms);
+                 "Button %s not found in NVS, using default %lu ms",
+                 name,
+                 (unsigned long)default_ms);
     } else if (ret != ESP_OK) {
         ESP_LOGW(
-            TAG, "Failed to read button debounce from NVS: %s", esp_err_to_name(ret));
+            TAG, "Failed to read button %s from NVS: %s", name, esp_err_to_name(ret));
+        delay_ms = default_ms;
     }
+    return delay_ms;
+}
 
-    // Read repeat delay with default
-    uint32_t repeat_delay_ms = BUTTON_DEFAULT_REPEAT_DELAY_MS;
-    required_size = sizeof(repeat_delay_ms);
-    ret = nvs_get_blob(
-        nvs_handle, NVS_KEY_BUTTON_REPEAT_DELAY_MS, &repeat_delay_ms, &required_size);
-    if (ret == ESP_ERR_NVS_NOT_FOUND) {
-        ESP_LOGD(TAG,
-                 "Button repeat delay not found in NVS, using default %lu ms",
-                 (unsigned long)repeat_delay_ms);
-    } else if (ret != ESP_OK) {
-        ESP_LOGW(TAG,
-                 "Failed to read button repeat delay from NVS: %s",
-                 esp_err_to_name(ret));
+// Apply changed delays to the next press; invalid values keep the current ones
+static void button_config_changed(const char *key, void *arg) {
+    (void)key;
+    (void)arg;
+
+    uint32_t debounce_ms = load_delay_ms(
+        NVS_KEY_BUTTON_DEBOUNCE_MS, BUTTON_DEFAULT_DEBOUNCE_MS, "debounce");
+    uint32_t repeat_delay_ms = load_delay_ms(
+        NVS_KEY_BUTTON_REPEAT_DELAY_MS, BUTTON_DEFAULT_REPEAT_DELAY_MS, "repeat delay");
+    if (debounce_ms == 0 || repeat_delay_ms == 0) {
+        ESP_LOGE(TAG, "Button delays must be greater than 0, keeping current ones");
+        return;
     }
 
-    nvs_close(nvs_handle);
+    g_button_state.debounce_ms = debounce_ms;
+    g_button_state.repeat_delay_ms = repeat_delay_ms;
+    ESP_LOGI(TAG,
+             "Button delays changed to %lu ms debounce and %lu ms repeat delay",
+             (unsigned long)debounce_ms,
+             (unsigned long)repeat_delay_ms);
+}
+
+bool button_init(uint8_t gpio_pin) {
+    // Read configuration with defaults
+    uint32_t debounce_ms = load_delay_ms(
+        NVS_KEY_BUTTON_DEBOUNCE_MS, BUTTON_DEFAULT_DEBOUNCE_MS, "debounce");
+    uint32_t repeat_delay_ms = load_delay_ms(
+        NVS_KEY_BUTTON_REPEAT_DELAY_MS, BUTTON_DEFAULT_REPEAT_DELAY_MS, "repeat delay");
 
     if (debounce_ms == 0) {
         ESP_LOGE(TAG, "Debounce time must be greater than 0");
@@ -152,16 +163,27 @@ bool button_init(uint8_t gpio_pin) {
         .mode = GPIO_MODE_INPUT,
         .pull_up_en = GPIO_PULLUP_ENABLE,
         .pull_down_en = GPIO_PULLDOWN_DISABLE,
-        .intr_type = GPIO_INTR_NEGEDGE,  // Falling edge (button press)
+        // Low level (button press). The ISR disables the interrupt until the button
+        // is released, and a level can also wake the CPU from light sleep.
+        .intr_type = GPIO_INTR_LOW_LEVEL,
     };
 
-    ret = gpio_config(&io_conf);
+    esp_err_t ret = gpio_config(&io_conf);
     if (ret != ESP_OK) {
         ESP_LOGE(
             TAG, "Failed to configure GPIO %d: %s", gpio_pin, esp_err_to_name(ret));
         return false;
     }
 
+    // Wake from light sleep on a press
+    ret = gpio_wakeup_enable(gpio_pin, GPIO_INTR_LOW_LEVEL);
+    if (ret == ESP_OK) {
+        ret = esp_sleep_enable_gpio_wakeup();
+    }
+    if (ret != ESP_OK) {
+        ESP_LOGW(TAG, "Failed to enable wake on button: %s", esp_err_to_name(ret));
+    }
+
     // Create unified button timer (will be reconfigured for different delays)
     g_button_state.button_timer =
         xTimerCreate("button_timer",
@@ -195,6 +217,12 @@ bool button_init(uint8_t gpio_pin) {
     gpio_intr_enable(gpio_pin);
     g_button_state.interrupt_enabled = true;
 
+    // Pick up changed delays without a reboot
+    nvs_config_add_change_callback(
+        NVS_KEY_BUTTON_DEBOUNCE_MS, button_config_changed, NULL);
+    nvs_config_add_change_callback(
+        NVS_KEY_BUTTON_REPEAT_DELAY_MS, button_config_changed, NULL);
+
     ESP_LOGI(
         TAG,
         "Button initialized on GPIO %d with %lu ms debounce and %lu ms repeat delay",
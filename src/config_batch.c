@@ -0,0 +1,432 @@
+#include "config_batch.h"
+#include <stdlib.h>
+#include <string.h>
+#include "buffer_utils.h"
+#include "esp_log.h"
+#include "nvs_config.h"
+#include "program.h"
+
+static const char *TAG = "config_batch";
+
+// Largest string or blob value an NVS_SET can carry
+#define CONFIG_BATCH_MAX_VALUE_SIZE 1024
+
+#define RESPONSE_HEADER_SIZE 3  // status(1) + operation count(2)
+#define SELECT_BY_NAME UINT32_MAX
+
+// A parsed operation; value and name point into the request
+typedef struct {
+    uint8_t op;
+    char key[NVS_KEY_NAME_MAX_SIZE];
+    uint8_t type;  // NVS_SET value type or EXECUTE program type
+    uint8_t priority;
+    uint32_t id;
+    char name[PROGRAM_NAME_MAX_LEN];
+    const uint8_t *value;
+    uint16_t value_length;
+} batch_op_t;
+
+// Read position in a request
+typedef struct {
+    const uint8_t *data;
+    size_t size;
+    size_t offset;
+} batch_reader_t;
+
+static bool read_u8(batch_reader_t *reader, uint8_t *out) {
+    if (!bu_read_u8(
+            &reader->data[reader->offset], reader->size - reader->offset, out)) {
+        return false;
+    }
+    reader->offset += 1;
+    return true;
+}
+
+static bool read_u16(batch_reader_t *reader, uint16_t *out) {
+    if (!bu_read_u16_le(
+            &reader->data[reader->offset], reader->size - reader->offset, out)) {
+        return false;
+    }
+    reader->offset += 2;
+    return true;
+}
+
+static bool read_u32(batch_reader_t *reader, uint32_t *out) {
+    if (!bu_read_u32_le(
+            &reader->data[reader->offset], reader->size - reader->offset, out)) {
+        return false;
+    }
+    reader->offset += 4;
+    return true;
+}
+
+// Read a [length u8][text] string into a NUL-terminated buffer of max_size bytes
+static bool read_string(batch_reader_t *reader, char *out, size_t max_size) {
+    uint8_t length;
+    if (!read_u8(reader, &length) || length == 0 || length >= max_size ||
+        !bu_read_bytes(&reader->data[reader->offset],
+                       reader->size - reader->offset,
+                       (uint8_t *)out,
+                       length)) {
+        return false;
+    }
+    out[length] = '\0';
+    reader->offset += length;
+    return strlen(out) == length;
+}
+
+// Size an integer NVS type takes, or 0 for strings and blobs
+static size_t integer_size(uint8_t type) {
+    switch (type) {
+    case NVS_TYPE_U8:
+    case NVS_TYPE_I8:
+        return 1;
+    case NVS_TYPE_U16:
+    case NVS_TYPE_I16:
+        return 2;
+    case NVS_TYPE_U32:
+    case NVS_TYPE_I32:
+        return 4;
+    case NVS_TYPE_U64:
+    case NVS_TYPE_I64:
+        return 8;
+    default:
+        return 0;
+    }
+}
+
+// Parse and check the next operation
+static bool parse_op(batch_reader_t *reader, batch_op_t *op) {
+    memset(op, 0, sizeof(*op));
+    if (!read_u8(reader, &op->op)) {
+        return false;
+    }
+
+    switch (op->op) {
+    case CONFIG_BATCH_OP_NVS_SET: {
+        if (!read_string(reader, op->key, sizeof(op->key)) ||
+            !read_u8(reader, &op->type) || !read_u16(reader, &op->value_length) ||
+            op->value_length > reader->size - reader->offset) {
+            return false;
+        }
+        op->value = &reader->data[reader->offset];
+        reader->offset += op->value_length;
+
+        size_t size = integer_size(op->type);
+        if (size != 0) {
+            return op->value_length == size;
+        }
+        if (op->type == NVS_TYPE_STR) {
+            // The NUL is added when the value is stored
+            return op->value_length <= CONFIG_BATCH_MAX_VALUE_SIZE &&
+                   memchr(op->value, '\0', op->value_length) == NULL;
+        }
+        return op->type == NVS_TYPE_BLOB &&
+               op->value_length <= CONFIG_BATCH_MAX_VALUE_SIZE;
+    }
+    case CONFIG_BATCH_OP_NVS_GET:
+    case CONFIG_BATCH_OP_NVS_DELETE:
+        return read_string(reader, op->key, sizeof(op->key));
+    case CONFIG_BATCH_OP_SELECT:
+        if (!read_u32(reader, &op->id)) {
+            return false;
+        }
+        return op->id != SELECT_BY_NAME ||
+               read_string(reader, op->name, sizeof(op->name));
+    case CONFIG_BATCH_OP_EXECUTE:
+        return read_u8(reader, &op->type) && read_u8(reader, &op->priority) &&
+               (op->type == PROGRAM_TYPE_FLASH || op->type == PROGRAM_TYPE_RAM) &&
+               op->priority <= PROGRAM_PRIORITY_HIGH;
+    default:
+        return false;
+    }
+}
+
+// Response bytes an operation's result takes, not counting an NVS_GET value
+static size_t result_size(const batch_op_t *op) {
+    switch (op->op) {
+    case CONFIG_BATCH_OP_NVS_GET:
+        return 1 + 3;  // status + type + length, when found
+    case CONFIG_BATCH_OP_SELECT:
+    case CONFIG_BATCH_OP_EXECUTE:
+        return 1 + 4;
+    default:
+        return 1;
+    }
+}
+
+static uint64_t read_integer(const uint8_t *src, size_t size) {
+    uint64_t value = 0;
+    for (size_t i = 0; i < size; i++) {
+        value |= (uint64_t)src[i] << (i * 8);
+    }
+    return value;
+}
+
+static void write_integer(uint8_t *dst, uint64_t value, size_t size) {
+    for (size_t i = 0; i < size; i++) {
+        dst[i] = (value >> (i * 8)) & 0xFF;
+    }
+}
+
+static esp_err_t run_nvs_set(const batch_op_t *op) {
+    uint64_t value = read_integer(op->value, integer_size(op->type));
+    switch (op->type) {
+    case NVS_TYPE_U8:
+        return nvs_config_set_u8(op->key, (uint8_t)value);
+    case NVS_TYPE_I8:
+        return nvs_config_set_i8(op->key, (int8_t)value);
+    case NVS_TYPE_U16:
+        return nvs_config_set_u16(op->key, (uint16_t)value);
+    case NVS_TYPE_I16:
+        return nvs_config_set_i16(op->key, (int16_t)value);
+    case NVS_TYPE_U32:
+        return nvs_config_set_u32(op->key, (uint32_t)value);
+    case NVS_TYPE_I32:
+        return nvs_config_set_i32(op->key, (int32_t)value);
+    case NVS_TYPE_U64:
+        return nvs_config_set_u64(op->key, value);
+    case NVS_TYPE_I64:
+        return nvs_config_set_i64(op->key, (int64_t)value);
+    case NVS_TYPE_STR: {
+        char *str = malloc(op->value_length + 1);
+        if (str == NULL) {
+            return ESP_ERR_NO_MEM;
+        }
+        memcpy(str, op->value, op->value_length);
+        str[op->value_length] = '\0';
+        esp_err_t err = nvs_config_set_str(op->key, str);
+        free(str);
+        return err;
+    }
+    case NVS_TYPE_BLOB:
+        return nvs_config_set_blob(op->key, op->value, op->value_length);
+    default:
+        return ESP_ERR_INVALID_ARG;
+    }
+}
+
+// Read a value into dst as [type][length u16][value], with at most max_size bytes
+// of value
+static uint8_t run_nvs_get(const batch_op_t *op,
+                           uint8_t *dst,
+                           size_t max_size,
+                           size_t *out_length) {
+    nvs_type_t type;
+    if (nvs_config_find_key(op->key, &type) != ESP_OK) {
+        return CONFIG_BATCH_STATUS_NOT_FOUND;
+    }
+
+    uint8_t *value = &dst[3];
+    size_t length = integer_size(type);
+    esp_err_t err = ESP_OK;
+    if (length > max_size) {
+        return CONFIG_BATCH_STATUS_TOO_LARGE;
+    }
+    switch (type) {
+    case NVS_TYPE_U8:
+        err = nvs_config_get_u8(op->key, value);
+        break;
+    case NVS_TYPE_I8:
+        err = nvs_config_get_i8(op->key, (int8_t *)value);
+        break;
+    case NVS_TYPE_U16: {
+        uint16_t v;
+        err = nvs_config_get_u16(op->key, &v);
+        write_integer(value, v, length);
+    } break;
+    case NVS_TYPE_I16: {
+        int16_t v;
+        err = nvs_config_get_i16(op->key, &v);
+        write_integer(value, (uint16_t)v, length);
+    } break;
+    case NVS_TYPE_U32: {
+        uint32_t v;
+        err = nvs_config_get_u32(op->key, &v);
+        write_integer(value, v, length);
+    } break;
+    case NVS_TYPE_I32: {
+        int32_t v;
+        err = nvs_config_get_i32(op->key, &v);
+        write_integer(value, (uint32_t)v, length);
+    } break;
+    case NVS_TYPE_U64: {
+        uint64_t v;
+        err = nvs_config_get_u64(op->key, &v);
+        write_integer(value, v, length);
+    } break;
+    case NVS_TYPE_I64: {
+        int64_t v;
+        err = nvs_config_get_i64(op->key, &v);
+        write_integer(value, (uint64_t)v, length);
+    } break;
+    case NVS_TYPE_STR:
+        // The stored length includes the NUL, which the response leaves out (but
+        // which still needs room in the buffer)
+        length = max_size;
+        err = nvs_config_get_str(op->key, (char *)value, &length);
+        length -= 1;
+        break;
+    case NVS_TYPE_BLOB:
+        length = max_size;
+        err = nvs_config_get_blob(op->key, value, &length);
+        break;
+    default:
+        return CONFIG_BATCH_STATUS_FAILED;
+    }
+
+    if (err == ESP_ERR_NVS_INVALID_LENGTH) {
+        return CONFIG_BATCH_STATUS_TOO_LARGE;
+    } else if (err != ESP_OK) {
+        return CONFIG_BATCH_STATUS_FAILED;
+    }
+
+    dst[0] = type;
+    write_integer(&dst[1], length, 2);
+    *out_length = 3 + length;
+    return CONFIG_BATCH_STATUS_OK;
+}
+
+static uint8_t run_select(const batch_op_t *op, uint8_t *dst) {
+    uint32_t id = op->id;
+    if (id == SELECT_BY_NAME) {
+        if (!program_find(PROGRAM_TYPE_FLASH, op->name, &id)) {
+            return CONFIG_BATCH_STATUS_NOT_FOUND;
+        }
+    } else if (id >= program_get_count(PROGRAM_TYPE_FLASH)) {
+        return CONFIG_BATCH_STATUS_NOT_FOUND;
+    }
+
+    if (!program_select(PROGRAM_TYPE_FLASH, id)) {
+        return CONFIG_BATCH_STATUS_FAILED;
+    }
+    write_integer(dst, id, 4);
+    return CONFIG_BATCH_STATUS_OK;
+}
+
+bool config_batch_run(const uint8_t *request,
+                      size_t request_size,
+                      uint8_t *response,
+                      size_t response_size,
+                      size_t *out_response_length) {
+    if (request == NULL || response == NULL || out_response_length == NULL) {
+        return false;
+    }
+
+    // Check the whole batch, and that the results will fit, before changing anything
+    batch_reader_t reader = {.data = request, .size = request_size, .offset = 0};
+    batch_op_t op;
+    size_t count = 0;
+    size_t reserved = RESPONSE_HEADER_SIZE;
+    while (reader.offset < request_size) {
+        if (!parse_op(&reader, &op)) {
+            ESP_LOGE(TAG,
+                     "Malformed operation %lu at offset %lu",
+                     (unsigned long)count,
+                     (unsigned long)reader.offset);
+            return false;
+        }
+        count++;
+        reserved += result_size(&op);
+    }
+    if (count == 0 || count > UINT16_MAX || reserved > response_size) {
+        ESP_LOGE(TAG, "Batch of %lu operations not accepted", (unsigned long)count);
+        return false;
+    }
+
+    // Run the operations; reserved keeps room for the results still to come
+    reader.offset = 0;
+    reserved -= RESPONSE_HEADER_SIZE;
+    size_t length = RESPONSE_HEADER_SIZE;
+    bool failed = false;
+    while (reader.offset < request_size) {
+        parse_op(&reader, &op);
+        reserved -= result_size(&op);
+
+        uint8_t *result = &response[length];
+        size_t result_length = 1;
+        uint8_t status = CONFIG_BATCH_STATUS_SKIPPED;
+        if (!failed) {
+            switch (op.op) {
+            case CONFIG_BATCH_OP_NVS_SET: {
+                esp_err_t err = run_nvs_set(&op);
+                if (err != ESP_OK) {
+                    ESP_LOGE(TAG,
+                             "Failed to set '%s': %s",
+                             op.key,
+                             esp_err_to_name(err));
+                    status = CONFIG_BATCH_STATUS_FAILED;
+                } else {
+                    status = CONFIG_BATCH_STATUS_OK;
+                }
+            } break;
+            case CONFIG_BATCH_OP_NVS_GET: {
+                size_t value_length = 0;
+                size_t space = response_size - length - reserved - 1;
+                status = run_nvs_get(&op, &result[1], space - 3, &value_length);
+                if (status == CONFIG_BATCH_STATUS_OK) {
+                    result_length += value_length;
+                }
+            } break;
+            case CONFIG_BATCH_OP_NVS_DELETE: {
+                esp_err_t err = nvs_config_erase_key(op.key);
+                if (err == ESP_ERR_NVS_NOT_FOUND) {
+                    status = CONFIG_BATCH_STATUS_NOT_FOUND;
+                } else if (err != ESP_OK) {
+                    ESP_LOGE(TAG,
+                             "Failed to erase '%s': %s",
+                             op.key,
+                             esp_err_to_name(err));
+                    status = CONFIG_BATCH_STATUS_FAILED;
+                } else {
+                    status = CONFIG_BATCH_STATUS_OK;
+                }
+            } break;
+            case CONFIG_BATCH_OP_SELECT:
+                status = run_select(&op, &result[1]);
+                if (status == CONFIG_BATCH_STATUS_OK) {
+                    result_length += 4;
+                } else {
+                    // Runs after it would start the wrong program
+                    failed = true;
+                }
+                break;
+            case CONFIG_BATCH_OP_EXECUTE: {
+                uint32_t position;
+                if (program_enqueue((program_type_t)op.type,
+                                    (program_priority_t)op.priority,
+                                    NULL,
+                                    NULL,
+                                    &position)) {
+                    write_integer(&result[1], position, 4);
+                    result_length += 4;
+                    status = CONFIG_BATCH_STATUS_OK;
+                } else {
+                    status = CONFIG_BATCH_STATUS_FAILED;
+                }
+            } break;
+            }
+            failed |= (status == CONFIG_BATCH_STATUS_FAILED);
+        }
+
+        result[0] = status;
+        length += result_length;
+    }
+
+    // One commit for every change the batch made
+    esp_err_t err = nvs_config_commit();
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to commit batch: %s", esp_err_to_name(err));
+        failed = true;
+    }
+
+    response[0] = failed ? CONFIG_BATCH_STATUS_FAILED : CONFIG_BATCH_STATUS_OK;
+    write_integer(&response[1], count, 2);
+    *out_response_length = length;
+
+    ESP_LOGI(TAG,
+             "Batch of %lu operations %s",
+             (unsigned long)count,
+             failed ? "failed" : "completed");
+    return true;
+}
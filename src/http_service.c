@@ -1,15 +1,30 @@
 #include "http_service.h"
+#include <stdlib.h>
 #include <string.h>
 #include <sys/time.h>
+#include "app.h"
 #include "cJSON.h"
+#include "config_batch.h"
 #include "esp_event.h"
 #include "esp_http_server.h"
 #include "esp_log.h"
 #include "esp_wifi.h"
+#include "esp_heap_caps.h"
+#include "esp_rom_crc.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/queue.h"
+#include "freertos/semphr.h"
+#include "freertos/task.h"
+#include "buffer_utils.h"
+#include "latency_stats.h"
 #include "log_buffer.h"
 #include "mdns.h"
+#include "nvs_config.h"
 #include "nvs_odkey.h"
 #include "program.h"
+#include "rom/miniz.h"
+#include "usb_keyboard.h"
+#include "vm_task.h"
 #include "wifi.h"
 
 static const char *TAG = "http_service";
@@ -18,24 +33,118 @@ static const char *TAG = "http_service";
 #define HTTP_SERVICE_PORT_DEFAULT 80
 
 // HTTP Service Configuration
-#define HTTP_SERVICE_MAX_URI_HANDLERS 16
+#define HTTP_SERVICE_MAX_URI_HANDLERS 25
 #define HTTP_SERVICE_MAX_RESP_HEADERS 8
-#define HTTP_SERVICE_MAX_OPEN_SOCKETS \
-    1  // Single connection to prevent concurrent uploads
+#define HTTP_SERVICE_MAX_OPEN_SOCKETS 5
 
 struct http_service_config_t {
     uint16_t service_port;
-    char api_key[64];
+    char api_key[64];  // Guarded by g_api_key_lock once the service is running
 } g_http_service_config = {0};
 
+// The API key can change while workers are checking it
+static portMUX_TYPE g_api_key_lock = portMUX_INITIALIZER_UNLOCKED;
+
 // HTTP service handle
 static httpd_handle_t g_service = NULL;
 
-// Global buffer for all HTTP operations
+// Request workers. The server task hands each request to a worker, so a slow
+// transfer on one connection does not hold up requests on the others. Each worker
+// has its own buffers in PSRAM.
+#define HTTP_SERVICE_WORKER_COUNT 3
+#define HTTP_SERVICE_WORKER_STACK_SIZE 4096
+#define HTTP_SERVICE_WORKER_PRIORITY 5
 #define HTTP_SERVICE_RESPONSE_BUFFER_SIZE 4096
 #define HTTP_SERVICE_WORKING_BUFFER_SIZE 4096
-static uint8_t g_response_buffer[HTTP_SERVICE_RESPONSE_BUFFER_SIZE];
-static uint8_t g_working_buffer[HTTP_SERVICE_WORKING_BUFFER_SIZE];
+
+typedef struct {
+    uint8_t response[HTTP_SERVICE_RESPONSE_BUFFER_SIZE];
+    uint8_t working[HTTP_SERVICE_WORKING_BUFFER_SIZE];
+} http_buffers_t;
+
+typedef struct {
+    esp_err_t (*handler)(httpd_req_t *req);
+    bool writes_program;  // Serialized with other program writes
+} http_route_t;
+
+typedef struct {
+    httpd_req_t *req;
+    const http_route_t *route;
+} http_job_t;
+
+static http_buffers_t *g_worker_buffers = NULL;
+static QueueHandle_t g_job_queue = NULL;
+
+// Held by requests that write or erase programs. The program module arbitrates
+// between HTTP and USB by program_write_source_t, so this keeps concurrent HTTP
+// requests from interleaving within the HTTP source's session.
+static SemaphoreHandle_t g_program_write_mutex = NULL;
+
+// Gzip program transfers. Uploads with "Content-Encoding: gzip" give the decompressed
+// size in X-Program-Size and are inflated while they're written. Uploads hold
+// g_program_write_mutex, so they share one inflate state; a download allocates its
+// compressor only while it runs, and is sent uncompressed if that fails.
+#define GZIP_HEADER_SIZE 10
+#define GZIP_TRAILER_SIZE 8
+#define GZIP_FLAG_FHCRC 0x02
+#define GZIP_FLAG_FEXTRA 0x04
+#define GZIP_FLAG_FNAME 0x08
+#define GZIP_FLAG_FCOMMENT 0x10
+
+typedef struct {
+    tinfl_decompressor inflator;
+    uint8_t dictionary[TINFL_LZ_DICT_SIZE];
+} http_inflate_t;
+
+static http_inflate_t *g_inflate = NULL;
+
+// Largest single receive for RAM program uploads, which land directly in PSRAM
+// rather than in the working buffer
+#define HTTP_SERVICE_RAM_RECV_SIZE (32 * 1024)
+
+// Longest an execute request may wait for the run queue to drain ("?wait=<ms>")
+#define HTTP_SERVICE_MAX_EXECUTE_WAIT_MS (60 * 1000)
+
+// Live log stream (GET /api/logs/stream). A single stream runs in its own task so the
+// server keeps handling other requests.
+#define HTTP_SERVICE_LOG_STREAM_TASK_STACK_SIZE 4096
+#define HTTP_SERVICE_LOG_STREAM_TASK_PRIORITY 3
+#define HTTP_SERVICE_LOG_STREAM_POLL_MS 250
+#define HTTP_SERVICE_LOG_STREAM_KEEPALIVE_MS (15 * 1000)
+#define HTTP_SERVICE_LOG_STREAM_READ_SIZE 256
+#define HTTP_SERVICE_LOG_STREAM_EVENT_SIZE 1024
+
+static volatile bool g_log_stream_active = false;
+static uint32_t g_log_stream_start_seq = 0;
+static uint8_t g_log_stream_text[HTTP_SERVICE_LOG_STREAM_READ_SIZE];
+static char g_log_stream_event[HTTP_SERVICE_LOG_STREAM_EVENT_SIZE];
+
+// WebSocket control channel (GET /api/ws). Frames are handled on the server task, so
+// a command doesn't wait for a worker. Requests are [op][tag][payload], replies are
+// [op | WS_REPLY_FLAG][tag][status][data] (see README.md).
+#define HTTP_SERVICE_WS_MAX_FRAME_SIZE 128
+#define HTTP_SERVICE_WS_MAX_REPLY_SIZE 16
+#define WS_REQUEST_HEADER_SIZE 2
+#define WS_REPLY_HEADER_SIZE 3
+
+#define WS_OP_AUTH 0x01
+#define WS_OP_EXECUTE 0x02
+#define WS_OP_HALT 0x03
+#define WS_OP_KEYS 0x04
+#define WS_OP_STATUS 0x05
+#define WS_REPLY_FLAG 0x80
+#define WS_EVENT_RUN_COMPLETE 0xC0  // [event][tag of the EXECUTE request]
+
+#define WS_STATUS_OK 0x00
+#define WS_STATUS_BAD_REQUEST 0x01
+#define WS_STATUS_UNAUTHORIZED 0x02
+#define WS_STATUS_FAILED 0x03
+#define WS_STATUS_BUSY 0x04
+
+#define WS_PROGRAM_SELECTED UINT32_MAX  // EXECUTE id that runs the selected program
+
+// Session context of an authorized WebSocket client
+static uint8_t g_ws_authorized;
 
 // Event handler instances
 static esp_event_handler_instance_t g_wifi_event_instance = NULL;
@@ -47,20 +156,12 @@ static void stop_http_service(void);
 
 // Get HTTP service configuration from NVS or use defaults
 static bool load_http_service_configuration(struct http_service_config_t *config) {
-    nvs_handle_t nvs_handle;
     esp_err_t err;
 
     memset(config, 0, sizeof(*config));
 
-    // Try to open NVS
-    err = nvs_open(NVS_NAMESPACE, NVS_READONLY, &nvs_handle);
-    if (err != ESP_OK) {
-        ESP_LOGE(TAG, "Failed to open NVS");
-        return false;
-    }
-
     // Try to get service port
-    err = nvs_get_u16(nvs_handle, NVS_KEY_HTTP_SERVER_PORT, &config->service_port);
+    err = nvs_config_get_u16(NVS_KEY_HTTP_SERVER_PORT, &config->service_port);
     if (err == ESP_OK) {
         ESP_LOGI(TAG, "Found service port in NVS: %d", config->service_port);
     } else {
@@ -70,8 +171,7 @@ static bool load_http_service_configuration(struct http_service_config_t *config
 
     // Try to get API key
     size_t required_size = sizeof(config->api_key);
-    err =
-        nvs_get_str(nvs_handle, NVS_KEY_HTTP_API_KEY, config->api_key, &required_size);
+    err = nvs_config_get_str(NVS_KEY_HTTP_API_KEY, config->api_key, &required_size);
     if (err == ESP_OK) {
         ESP_LOGI(TAG, "Found API key in NVS");
     } else {
@@ -79,14 +179,52 @@ static bool load_http_service_configuration(struct http_service_config_t *config
         config->api_key[0] = '\0';
     }
 
-    nvs_close(nvs_handle);
     return true;
 }
 
+// Pick up a changed API key without restarting the service. The port only takes
+// effect the next time the service starts.
+static void api_key_changed(const char *key, void *arg) {
+    (void)key;
+    (void)arg;
+
+    char api_key[sizeof(g_http_service_config.api_key)];
+    size_t required_size = sizeof(api_key);
+    if (nvs_config_get_str(NVS_KEY_HTTP_API_KEY, api_key, &required_size) != ESP_OK) {
+        api_key[0] = '\0';
+    }
+    portENTER_CRITICAL(&g_api_key_lock);
+    memcpy(g_http_service_config.api_key, api_key, sizeof(api_key));
+    portEXIT_CRITICAL(&g_api_key_lock);
+    ESP_LOGI(TAG, "API key %s", api_key[0] != '\0' ? "updated" : "cleared");
+}
+
+static bool api_key_configured(void) {
+    portENTER_CRITICAL(&g_api_key_lock);
+    bool configured = g_http_service_config.api_key[0] != '\0';
+    portEXIT_CRITICAL(&g_api_key_lock);
+    return configured;
+}
+
+// Compare a key sent by a client with the API key; nothing matches an empty one
+static bool api_key_matches(const void *key, size_t key_len) {
+    portENTER_CRITICAL(&g_api_key_lock);
+    size_t api_key_len = strlen(g_http_service_config.api_key);
+    bool matches = api_key_len != 0 && key_len == api_key_len &&
+                   memcmp(key, g_http_service_config.api_key, key_len) == 0;
+    portEXIT_CRITICAL(&g_api_key_lock);
+    return matches;
+}
+
+// Get the buffers of the worker handling a request
+static http_buffers_t *request_buffers(httpd_req_t *req) {
+    return (http_buffers_t *)req->user_ctx;
+}
+
 // Authentication middleware
 static esp_err_t check_api_key(httpd_req_t *req) {
     // If no API key is configured, return 401
-    if (strlen(g_http_service_config.api_key) == 0) {
+    if (!api_key_configured()) {
         ESP_LOGW(TAG, "API key not configured, rejecting request");
         httpd_resp_set_status(req, "401 Unauthorized");
         httpd_resp_set_type(req, "application/json");
@@ -106,8 +244,9 @@ static esp_err_t check_api_key(httpd_req_t *req) {
         return ESP_FAIL;
     }
 
-    // Use working buffer for header value
-    if (auth_header_len + 1 > HTTP_SERVICE_WORKING_BUFFER_SIZE) {
+    // A valid header is "Bearer " followed by the API key
+    char auth_header[sizeof("Bearer ") + sizeof(g_http_service_config.api_key)];
+    if (auth_header_len + 1 > sizeof(auth_header)) {
         ESP_LOGE(
             TAG, "Authorization header too large: %lu", (unsigned long)auth_header_len);
         httpd_resp_set_status(req, "400 Bad Request");
@@ -117,8 +256,6 @@ static esp_err_t check_api_key(httpd_req_t *req) {
                         HTTPD_RESP_USE_STRLEN);
         return ESP_FAIL;
     }
-    char *auth_header = (char *)g_working_buffer;
-
     // Get the header value
     if (httpd_req_get_hdr_value_str(
             req, "Authorization", auth_header, auth_header_len + 1) != ESP_OK) {
@@ -144,7 +281,7 @@ static esp_err_t check_api_key(httpd_req_t *req) {
 
     // Extract token
     const char *token = auth_header + strlen(bearer_prefix);
-    if (strcmp(token, g_http_service_config.api_key) != 0) {
+    if (!api_key_matches(token, strlen(token))) {
         ESP_LOGW(TAG, "Invalid API key");
         httpd_resp_set_status(req, "401 Unauthorized");
         httpd_resp_set_type(req, "application/json");
@@ -155,8 +292,297 @@ static esp_err_t check_api_key(httpd_req_t *req) {
     return ESP_OK;
 }
 
+// Receive exactly len bytes of the request body
+static bool recv_exact(httpd_req_t *req, uint8_t *buffer, size_t len) {
+    size_t received = 0;
+    while (received < len) {
+        int ret = httpd_req_recv(req, (char *)buffer + received, len - received);
+        if (ret <= 0) {
+            return false;
+        }
+        received += ret;
+    }
+    return true;
+}
+
+// Skip count bytes of the request body
+static bool recv_skip(httpd_req_t *req, size_t count, size_t *consumed) {
+    uint8_t byte;
+    for (size_t i = 0; i < count; i++) {
+        if (!recv_exact(req, &byte, 1)) {
+            return false;
+        }
+    }
+    *consumed += count;
+    return true;
+}
+
+// Skip a NUL-terminated field of the request body
+static bool recv_skip_string(httpd_req_t *req, size_t *consumed) {
+    uint8_t byte;
+    do {
+        if (!recv_exact(req, &byte, 1)) {
+            return false;
+        }
+        (*consumed)++;
+    } while (byte != 0);
+    return true;
+}
+
+// Receive the gzip header of the request body (RFC 1952), counting its bytes
+static bool recv_gzip_header(httpd_req_t *req, size_t *consumed) {
+    uint8_t header[GZIP_HEADER_SIZE];
+    if (!recv_exact(req, header, sizeof(header))) {
+        return false;
+    }
+    *consumed = sizeof(header);
+
+    // ID1, ID2 and the deflate compression method
+    if (header[0] != 0x1F || header[1] != 0x8B || header[2] != 8) {
+        return false;
+    }
+
+    uint8_t flags = header[3];
+    if (flags & GZIP_FLAG_FEXTRA) {
+        uint8_t extra_size[2];
+        if (!recv_exact(req, extra_size, sizeof(extra_size))) {
+            return false;
+        }
+        *consumed += sizeof(extra_size);
+        uint16_t extra_len = extra_size[0] | (extra_size[1] << 8);
+        if (!recv_skip(req, extra_len, consumed)) {
+            return false;
+        }
+    }
+    if ((flags & GZIP_FLAG_FNAME) && !recv_skip_string(req, consumed)) {
+        return false;
+    }
+    if ((flags & GZIP_FLAG_FCOMMENT) && !recv_skip_string(req, consumed)) {
+        return false;
+    }
+    if ((flags & GZIP_FLAG_FHCRC) && !recv_skip(req, 2, consumed)) {
+        return false;
+    }
+    return true;
+}
+
+// Get the program size of an upload, which is the body size unless it is
+// gzip-encoded
+static esp_err_t get_upload_size(httpd_req_t *req,
+                                 size_t *out_program_size,
+                                 bool *out_gzip) {
+    *out_program_size = req->content_len;
+    *out_gzip = false;
+
+    char value[16];
+    if (httpd_req_get_hdr_value_str(req, "Content-Encoding", value, sizeof(value)) !=
+            ESP_OK ||
+        strcmp(value, "identity") == 0) {
+        return ESP_OK;
+    }
+    if (strcmp(value, "gzip") != 0) {
+        ESP_LOGE(TAG, "Unsupported upload encoding: %s", value);
+        httpd_resp_set_status(req, "415 Unsupported Media Type");
+        httpd_resp_set_hdr(req, "Accept-Encoding", "gzip");
+        httpd_resp_set_type(req, "application/json");
+        httpd_resp_send(req,
+                        "{\"error\":\"Unsupported Content-Encoding\"}",
+                        HTTPD_RESP_USE_STRLEN);
+        return ESP_FAIL;
+    }
+
+    char size[12];
+    if (httpd_req_get_hdr_value_str(req, "X-Program-Size", size, sizeof(size)) !=
+        ESP_OK) {
+        ESP_LOGE(TAG, "Gzip upload without X-Program-Size header");
+        httpd_resp_set_status(req, "400 Bad Request");
+        httpd_resp_set_type(req, "application/json");
+        httpd_resp_send(req,
+                        "{\"error\":\"Missing X-Program-Size header\"}",
+                        HTTPD_RESP_USE_STRLEN);
+        return ESP_FAIL;
+    }
+    *out_program_size = strtoul(size, NULL, 10);
+    *out_gzip = true;
+    return ESP_OK;
+}
+
+// Receive a gzip-encoded request body, writing the inflated program through
+// program_write_chunk() and checking the gzip CRC and size against it
+static esp_err_t recv_gzip_program(httpd_req_t *req,
+                                   program_type_t type,
+                                   size_t program_size,
+                                   uint8_t *buffer,
+                                   size_t buffer_size) {
+    size_t header_size;
+    if (!recv_gzip_header(req, &header_size) ||
+        req->content_len < header_size + GZIP_TRAILER_SIZE) {
+        ESP_LOGE(TAG, "Invalid gzip header");
+        httpd_resp_set_status(req, "400 Bad Request");
+        httpd_resp_set_type(req, "application/json");
+        httpd_resp_send(
+            req, "{\"error\":\"Invalid gzip header\"}", HTTPD_RESP_USE_STRLEN);
+        return ESP_FAIL;
+    }
+
+    // Only the deflate data reaches the inflator, so it never reads the trailer
+    size_t deflate_remaining = req->content_len - header_size - GZIP_TRAILER_SIZE;
+    size_t input_len = 0;
+    size_t input_pos = 0;
+    size_t dictionary_pos = 0;
+    size_t written = 0;
+    uint32_t crc = 0;
+
+    tinfl_init(&g_inflate->inflator);
+    tinfl_status status;
+    do {
+        if (input_pos == input_len && deflate_remaining > 0) {
+            size_t chunk_size =
+                deflate_remaining > buffer_size ? buffer_size : deflate_remaining;
+            int ret = httpd_req_recv(req, (char *)buffer, chunk_size);
+            if (ret <= 0) {
+                ESP_LOGE(TAG, "Failed to receive data chunk");
+                httpd_resp_set_status(req, "500 Internal Server Error");
+                httpd_resp_set_type(req, "application/json");
+                httpd_resp_send(req,
+                                "{\"error\":\"Failed to receive data\"}",
+                                HTTPD_RESP_USE_STRLEN);
+                return ESP_FAIL;
+            }
+            deflate_remaining -= ret;
+            input_len = ret;
+            input_pos = 0;
+        }
+
+        // The dictionary doubles as the output buffer, wrapping around
+        size_t input_bytes = input_len - input_pos;
+        size_t output_bytes = TINFL_LZ_DICT_SIZE - dictionary_pos;
+        uint8_t *output = g_inflate->dictionary + dictionary_pos;
+        uint32_t flags = deflate_remaining > 0 ? TINFL_FLAG_HAS_MORE_INPUT : 0;
+        status = tinfl_decompress(&g_inflate->inflator,
+                                  buffer + input_pos,
+                                  &input_bytes,
+                                  g_inflate->dictionary,
+                                  output,
+                                  &output_bytes,
+                                  flags);
+        input_pos += input_bytes;
+
+        // Flash writes take at most a page at a time
+        crc = esp_rom_crc32_le(crc, output, output_bytes);
+        for (size_t offset = 0; offset < output_bytes;
+             offset += PROGRAM_FLASH_PAGE_SIZE) {
+            size_t piece = output_bytes - offset > PROGRAM_FLASH_PAGE_SIZE
+                               ? PROGRAM_FLASH_PAGE_SIZE
+                               : output_bytes - offset;
+            if (!program_write_chunk(
+                    type, output + offset, piece, PROGRAM_WRITE_SOURCE_HTTP)) {
+                ESP_LOGE(TAG, "Failed to write inflated program data");
+                httpd_resp_set_status(req, "500 Internal Server Error");
+                httpd_resp_set_type(req, "application/json");
+                httpd_resp_send(req,
+                                "{\"error\":\"Failed to write program\"}",
+                                HTTPD_RESP_USE_STRLEN);
+                return ESP_FAIL;
+            }
+        }
+        written += output_bytes;
+        dictionary_pos = (dictionary_pos + output_bytes) & (TINFL_LZ_DICT_SIZE - 1);
+    } while (status == TINFL_STATUS_NEEDS_MORE_INPUT ||
+             status == TINFL_STATUS_HAS_MORE_OUTPUT);
+
+    // The trailer holds the CRC32 and size of the uncompressed data
+    uint8_t trailer[GZIP_TRAILER_SIZE];
+    uint32_t trailer_crc = 0;
+    uint32_t trailer_size = 0;
+    if (status != TINFL_STATUS_DONE || input_pos != input_len ||
+        deflate_remaining != 0 || !recv_exact(req, trailer, sizeof(trailer)) ||
+        !bu_read_u32_le(trailer, sizeof(trailer), &trailer_crc) ||
+        !bu_read_u32_le(trailer + 4, sizeof(trailer) - 4, &trailer_size) ||
+        trailer_crc != crc || trailer_size != written || written != program_size) {
+        ESP_LOGE(TAG,
+                 "Invalid gzip data (status %d, %lu of %lu bytes inflated)",
+                 status,
+                 (unsigned long)written,
+                 (unsigned long)program_size);
+        httpd_resp_set_status(req, "400 Bad Request");
+        httpd_resp_set_type(req, "application/json");
+        httpd_resp_send(
+            req, "{\"error\":\"Invalid gzip data\"}", HTTPD_RESP_USE_STRLEN);
+        return ESP_FAIL;
+    }
+    return ESP_OK;
+}
+
+// Check if a download may be gzip-encoded
+static bool accepts_gzip(httpd_req_t *req) {
+    char value[64];
+    if (httpd_req_get_hdr_value_str(req, "Accept-Encoding", value, sizeof(value)) !=
+        ESP_OK) {
+        return false;
+    }
+    return strstr(value, "gzip") != NULL && strstr(value, "gzip;q=0") == NULL;
+}
+
+// Send a program image, gzip-encoded when the client accepts it. Uncompressed images
+// are sent straight from the caller's memory.
+static esp_err_t send_program(httpd_req_t *req, const uint8_t *data, uint32_t size) {
+    httpd_resp_set_hdr(req, "Vary", "Accept-Encoding");
+
+    tdefl_compressor *compressor = NULL;
+    if (accepts_gzip(req)) {
+        compressor = heap_caps_malloc(sizeof(tdefl_compressor), MALLOC_CAP_SPIRAM);
+        if (compressor == NULL) {
+            ESP_LOGW(TAG, "No memory to compress program, sending it uncompressed");
+        }
+    }
+    if (compressor == NULL) {
+        httpd_resp_set_hdr(req, "Content-Length", NULL);  // Will be set automatically
+        return httpd_resp_send(req, (const char *)data, size);
+    }
+
+    // Header without a name or timestamp, from an unknown OS
+    static const uint8_t header[GZIP_HEADER_SIZE] = {
+        0x1F, 0x8B, 8, 0, 0, 0, 0, 0, 0, 0xFF};
+    httpd_resp_set_hdr(req, "Content-Encoding", "gzip");
+    esp_err_t ret = httpd_resp_send_chunk(req, (const char *)header, sizeof(header));
+
+    uint8_t *output = request_buffers(req)->response;
+    size_t input_pos = 0;
+    tdefl_status status = tdefl_init(compressor, NULL, NULL, TDEFL_DEFAULT_MAX_PROBES);
+    while (ret == ESP_OK && status == TDEFL_STATUS_OKAY) {
+        size_t input_bytes = size - input_pos;
+        size_t output_bytes = HTTP_SERVICE_RESPONSE_BUFFER_SIZE;
+        status = tdefl_compress(compressor,
+                                data + input_pos,
+                                &input_bytes,
+                                output,
+                                &output_bytes,
+                                TDEFL_FINISH);
+        input_pos += input_bytes;
+        if (output_bytes > 0) {
+            ret = httpd_resp_send_chunk(req, (const char *)output, output_bytes);
+        }
+    }
+    free(compressor);
+
+    if (ret != ESP_OK || status != TDEFL_STATUS_DONE) {
+        ESP_LOGE(TAG, "Failed to send compressed program (status %d)", status);
+        return ESP_FAIL;
+    }
+
+    uint8_t trailer[GZIP_TRAILER_SIZE];
+    bu_write_u32_le(trailer, sizeof(trailer), esp_rom_crc32_le(0, data, size));
+    bu_write_u32_le(trailer + 4, sizeof(trailer) - 4, size);
+    if (httpd_resp_send_chunk(req, (const char *)trailer, sizeof(trailer)) != ESP_OK) {
+        return ESP_FAIL;
+    }
+    return httpd_resp_send_chunk(req, NULL, 0);
+}
+
 // Program upload handler - POST /api/program/flash
 static esp_err_t flash_program_upload_handler(httpd_req_t *req) {
+    http_buffers_t *buffers = request_buffers(req);
     ESP_LOGI(TAG, "Flash program upload request received");
 
     // Check authentication
@@ -176,9 +602,15 @@ static esp_err_t flash_program_upload_handler(httpd_req_t *req) {
         return ESP_FAIL;
     }
 
-    if (content_length > PROGRAM_FLASH_MAX_SIZE) {
+    size_t program_size;
+    bool gzip;
+    if (get_upload_size(req, &program_size, &gzip) != ESP_OK) {
+        return ESP_FAIL;
+    }
+
+    if (program_size > PROGRAM_FLASH_MAX_SIZE) {
         ESP_LOGE(
-            TAG, "Flash program too large: %lu bytes", (unsigned long)content_length);
+            TAG, "Flash program too large: %lu bytes", (unsigned long)program_size);
         httpd_resp_set_status(req, "413 Payload Too Large");
         httpd_resp_set_type(req, "application/json");
         httpd_resp_send(
@@ -188,7 +620,7 @@ static esp_err_t flash_program_upload_handler(httpd_req_t *req) {
 
     // Start program storage write session
     if (!program_write_start(
-            PROGRAM_TYPE_FLASH, content_length, PROGRAM_WRITE_SOURCE_HTTP)) {
+            PROGRAM_TYPE_FLASH, program_size, PROGRAM_WRITE_SOURCE_HTTP)) {
         ESP_LOGE(TAG, "Failed to start flash program storage write session");
         httpd_resp_set_status(req, "500 Internal Server Error");
         httpd_resp_set_type(req, "application/json");
@@ -199,45 +631,53 @@ static esp_err_t flash_program_upload_handler(httpd_req_t *req) {
     }
 
     // Get session buffer for this connection
-    uint8_t *buffer = g_working_buffer;
+    uint8_t *buffer = buffers->working;
     size_t buffer_size = HTTP_SERVICE_WORKING_BUFFER_SIZE;
 
-    // Read and write program data in chunks
-    size_t bytes_remaining = content_length;
-
-    while (bytes_remaining > 0) {
-        size_t chunk_size =
-            (bytes_remaining > buffer_size) ? buffer_size : bytes_remaining;
-
-        // Read chunk from HTTP request
-        int ret = httpd_req_recv(req, (char *)buffer, chunk_size);
-        if (ret <= 0) {
-            ESP_LOGE(TAG, "Failed to receive data chunk");
-            httpd_resp_set_status(req, "500 Internal Server Error");
-            httpd_resp_set_type(req, "application/json");
-            httpd_resp_send(
-                req, "{\"error\":\"Failed to receive data\"}", HTTPD_RESP_USE_STRLEN);
+    if (gzip) {
+        if (recv_gzip_program(
+                req, PROGRAM_TYPE_FLASH, program_size, buffer, buffer_size) != ESP_OK) {
             return ESP_FAIL;
         }
+    } else {
+        // Read and write program data in chunks
+        size_t bytes_remaining = content_length;
 
-        // Write chunk to program storage
-        if (!program_write_chunk(
-                PROGRAM_TYPE_FLASH, buffer, ret, PROGRAM_WRITE_SOURCE_HTTP)) {
-            ESP_LOGE(TAG, "Failed to write chunk to flash program");
-            httpd_resp_set_status(req, "500 Internal Server Error");
-            httpd_resp_set_type(req, "application/json");
-            httpd_resp_send(req,
-                            "{\"error\":\"Failed to write to flash program\"}",
-                            HTTPD_RESP_USE_STRLEN);
-            return ESP_FAIL;
-        }
+        while (bytes_remaining > 0) {
+            size_t chunk_size =
+                (bytes_remaining > buffer_size) ? buffer_size : bytes_remaining;
 
-        bytes_remaining -= ret;
+            // Read chunk from HTTP request
+            int ret = httpd_req_recv(req, (char *)buffer, chunk_size);
+            if (ret <= 0) {
+                ESP_LOGE(TAG, "Failed to receive data chunk");
+                httpd_resp_set_status(req, "500 Internal Server Error");
+                httpd_resp_set_type(req, "application/json");
+                httpd_resp_send(req,
+                                "{\"error\":\"Failed to receive data\"}",
+                                HTTPD_RESP_USE_STRLEN);
+                return ESP_FAIL;
+            }
+
+            // Write chunk to program storage
+            if (!program_write_chunk(
+                    PROGRAM_TYPE_FLASH, buffer, ret, PROGRAM_WRITE_SOURCE_HTTP)) {
+                ESP_LOGE(TAG, "Failed to write chunk to flash program");
+                httpd_resp_set_status(req, "500 Internal Server Error");
+                httpd_resp_set_type(req, "application/json");
+                httpd_resp_send(req,
+                                "{\"error\":\"Failed to write to flash program\"}",
+                                HTTPD_RESP_USE_STRLEN);
+                return ESP_FAIL;
+            }
+
+            bytes_remaining -= ret;
+        }
     }
 
     // Finish program storage write session
     if (!program_write_finish(
-            PROGRAM_TYPE_FLASH, content_length, PROGRAM_WRITE_SOURCE_HTTP)) {
+            PROGRAM_TYPE_FLASH, program_size, PROGRAM_WRITE_SOURCE_HTTP)) {
         ESP_LOGE(TAG, "Failed to finish flash program write session");
         httpd_resp_set_status(req, "500 Internal Server Error");
         httpd_resp_set_type(req, "application/json");
@@ -248,14 +688,15 @@ static esp_err_t flash_program_upload_handler(httpd_req_t *req) {
     }
 
     ESP_LOGI(TAG,
-             "Flash program upload completed successfully: %lu bytes",
-             (unsigned long)content_length);
+             "Flash program upload completed successfully: %lu bytes%s",
+             (unsigned long)program_size,
+             gzip ? " (gzip)" : "");
     httpd_resp_set_type(req, "application/json");
     char response[64];
     snprintf(response,
              sizeof(response),
              "{\"success\":true,\"size\":%lu}",
-             (unsigned long)content_length);
+             (unsigned long)program_size);
     httpd_resp_send(req, response, HTTPD_RESP_USE_STRLEN);
     return ESP_OK;
 }
@@ -270,10 +711,8 @@ static esp_err_t flash_program_download_handler(httpd_req_t *req) {
     }
 
     // Get flash program
-    uint32_t program_size;
-    const uint8_t *program_data = program_get(PROGRAM_TYPE_FLASH, &program_size);
-
-    if (program_data == NULL || program_size == 0) {
+    program_ref_t program;
+    if (!program_acquire(PROGRAM_TYPE_FLASH, &program)) {
         ESP_LOGW(TAG, "No program stored in flash");
         httpd_resp_set_status(req, "404 Not Found");
         httpd_resp_set_type(req, "application/json");
@@ -285,10 +724,10 @@ static esp_err_t flash_program_download_handler(httpd_req_t *req) {
     httpd_resp_set_type(req, "application/octet-stream");
     httpd_resp_set_hdr(
         req, "Content-Disposition", "attachment; filename=\"program.bin\"");
-    httpd_resp_set_hdr(req, "Content-Length", NULL);  // Will be set automatically
 
     // Send program data
-    esp_err_t ret = httpd_resp_send(req, (const char *)program_data, program_size);
+    esp_err_t ret = send_program(req, program.data, program.size);
+    program_release(&program);
     if (ret != ESP_OK) {
         ESP_LOGE(TAG, "Failed to send flash program data");
         return ESP_FAIL;
@@ -296,7 +735,187 @@ static esp_err_t flash_program_download_handler(httpd_req_t *req) {
 
     ESP_LOGI(TAG,
              "Flash program download completed: %lu bytes",
-             (unsigned long)program_size);
+             (unsigned long)program.size);
+    return ESP_OK;
+}
+
+// Flash program page hashes handler - GET /api/program/flash/pages
+static esp_err_t flash_program_pages_handler(httpd_req_t *req) {
+    http_buffers_t *buffers = request_buffers(req);
+    ESP_LOGI(TAG, "Flash program page hashes request received");
+
+    // Check authentication
+    if (check_api_key(req) != ESP_OK) {
+        return ESP_FAIL;
+    }
+
+    program_ref_t program;
+    uint32_t page_count = 0;
+    uint32_t *hashes = (uint32_t *)buffers->working;
+    bool stored = program_acquire(PROGRAM_TYPE_FLASH, &program);
+    uint32_t program_size = program.size;
+    program_release(&program);
+    if (!stored ||
+        !program_get_page_hashes(PROGRAM_TYPE_FLASH,
+                                 hashes,
+                                 HTTP_SERVICE_WORKING_BUFFER_SIZE / sizeof(uint32_t),
+                                 &page_count)) {
+        ESP_LOGW(TAG, "No program stored in flash");
+        httpd_resp_set_status(req, "404 Not Found");
+        httpd_resp_set_type(req, "application/json");
+        httpd_resp_send(req, "{\"error\":\"No program found\"}", HTTPD_RESP_USE_STRLEN);
+        return ESP_FAIL;
+    }
+
+    // {"size":N,"page_size":4096,"hashes":[h0,h1,...]}
+    char *response = (char *)buffers->response;
+    size_t response_size = HTTP_SERVICE_RESPONSE_BUFFER_SIZE;
+    int len = snprintf(response,
+                       response_size,
+                       "{\"size\":%lu,\"page_size\":%d,\"hashes\":[",
+                       (unsigned long)program_size,
+                       PROGRAM_FLASH_PAGE_SIZE);
+    for (uint32_t i = 0; i < page_count && len < (int)response_size; i++) {
+        len += snprintf(response + len,
+                        response_size - len,
+                        "%s%lu",
+                        (i == 0) ? "" : ",",
+                        (unsigned long)hashes[i]);
+    }
+    if (len < (int)response_size) {
+        len += snprintf(response + len, response_size - len, "]}");
+    }
+    if (len >= (int)response_size) {
+        ESP_LOGE(TAG, "Page hash response too large");
+        httpd_resp_set_status(req, "500 Internal Server Error");
+        httpd_resp_set_type(req, "application/json");
+        httpd_resp_send(
+            req, "{\"error\":\"Response too large\"}", HTTPD_RESP_USE_STRLEN);
+        return ESP_FAIL;
+    }
+
+    httpd_resp_set_type(req, "application/json");
+    httpd_resp_send(req, response, len);
+    return ESP_OK;
+}
+
+// Flash program delta upload handler - POST /api/program/flash/patch
+// Body: size(u32 LE) crc32(u32 LE), then for each changed page in ascending order:
+// page index (u32 LE) followed by PROGRAM_FLASH_PAGE_SIZE bytes of zero-padded data
+static esp_err_t flash_program_patch_handler(httpd_req_t *req) {
+    http_buffers_t *buffers = request_buffers(req);
+    ESP_LOGI(TAG, "Flash program patch request received");
+
+    // Check authentication
+    if (check_api_key(req) != ESP_OK) {
+        return ESP_FAIL;
+    }
+
+    const size_t record_size = sizeof(uint32_t) + PROGRAM_FLASH_PAGE_SIZE;
+    size_t content_length = req->content_len;
+    if (content_length < 2 * sizeof(uint32_t) ||
+        (content_length - 2 * sizeof(uint32_t)) % record_size != 0) {
+        ESP_LOGE(TAG, "Invalid patch length: %lu bytes", (unsigned long)content_length);
+        httpd_resp_set_status(req, "400 Bad Request");
+        httpd_resp_set_type(req, "application/json");
+        httpd_resp_send(req, "{\"error\":\"Invalid patch\"}", HTTPD_RESP_USE_STRLEN);
+        return ESP_FAIL;
+    }
+
+    uint32_t header[2];
+    if (!recv_exact(req, (uint8_t *)header, sizeof(header))) {
+        ESP_LOGE(TAG, "Failed to receive patch header");
+        httpd_resp_set_status(req, "500 Internal Server Error");
+        httpd_resp_set_type(req, "application/json");
+        httpd_resp_send(
+            req, "{\"error\":\"Failed to receive data\"}", HTTPD_RESP_USE_STRLEN);
+        return ESP_FAIL;
+    }
+    uint32_t program_size = header[0];
+    uint32_t program_crc = header[1];
+
+    if (program_size == 0) {
+        ESP_LOGE(TAG, "Patched program is empty");
+        httpd_resp_set_status(req, "400 Bad Request");
+        httpd_resp_set_type(req, "application/json");
+        httpd_resp_send(
+            req, "{\"error\":\"Invalid program size\"}", HTTPD_RESP_USE_STRLEN);
+        return ESP_FAIL;
+    }
+
+    if (program_size > PROGRAM_FLASH_MAX_SIZE) {
+        ESP_LOGE(TAG,
+                 "Patched program too large: %lu bytes",
+                 (unsigned long)program_size);
+        httpd_resp_set_status(req, "413 Payload Too Large");
+        httpd_resp_set_type(req, "application/json");
+        httpd_resp_send(
+            req, "{\"error\":\"Program too large\"}", HTTPD_RESP_USE_STRLEN);
+        return ESP_FAIL;
+    }
+
+    if (!program_patch_start(
+            PROGRAM_TYPE_FLASH, program_size, PROGRAM_WRITE_SOURCE_HTTP)) {
+        ESP_LOGE(TAG, "Failed to start flash program patch session");
+        httpd_resp_set_status(req, "500 Internal Server Error");
+        httpd_resp_set_type(req, "application/json");
+        httpd_resp_send(req,
+                        "{\"error\":\"Failed to start flash program storage\"}",
+                        HTTPD_RESP_USE_STRLEN);
+        return ESP_FAIL;
+    }
+
+    // Write each changed page as it arrives
+    size_t page_count = (content_length - sizeof(header)) / record_size;
+    for (size_t i = 0; i < page_count; i++) {
+        uint32_t page_index;
+        if (!recv_exact(req, (uint8_t *)&page_index, sizeof(page_index)) ||
+            !recv_exact(req, buffers->working, PROGRAM_FLASH_PAGE_SIZE)) {
+            ESP_LOGE(TAG, "Failed to receive patch page");
+            httpd_resp_set_status(req, "500 Internal Server Error");
+            httpd_resp_set_type(req, "application/json");
+            httpd_resp_send(
+                req, "{\"error\":\"Failed to receive data\"}", HTTPD_RESP_USE_STRLEN);
+            return ESP_FAIL;
+        }
+
+        if (!program_patch_page(PROGRAM_TYPE_FLASH,
+                                page_index,
+                                buffers->working,
+                                PROGRAM_WRITE_SOURCE_HTTP)) {
+            ESP_LOGE(TAG, "Failed to write patch page %lu", (unsigned long)page_index);
+            httpd_resp_set_status(req, "400 Bad Request");
+            httpd_resp_set_type(req, "application/json");
+            httpd_resp_send(
+                req, "{\"error\":\"Invalid patch page\"}", HTTPD_RESP_USE_STRLEN);
+            return ESP_FAIL;
+        }
+    }
+
+    // Copy the unchanged pages and activate the new program
+    if (!program_patch_finish(
+            PROGRAM_TYPE_FLASH, program_size, program_crc, PROGRAM_WRITE_SOURCE_HTTP)) {
+        ESP_LOGE(TAG, "Failed to finish flash program patch session");
+        httpd_resp_set_status(req, "409 Conflict");
+        httpd_resp_set_type(req, "application/json");
+        httpd_resp_send(req,
+                        "{\"error\":\"Patch does not apply to the stored program\"}",
+                        HTTPD_RESP_USE_STRLEN);
+        return ESP_FAIL;
+    }
+
+    ESP_LOGI(TAG,
+             "Flash program patch completed: %lu bytes, %lu pages sent",
+             (unsigned long)program_size,
+             (unsigned long)page_count);
+    httpd_resp_set_type(req, "application/json");
+    char response[80];
+    snprintf(response,
+             sizeof(response),
+             "{\"success\":true,\"size\":%lu,\"pages_sent\":%lu}",
+             (unsigned long)program_size,
+             (unsigned long)page_count);
+    httpd_resp_send(req, response, HTTPD_RESP_USE_STRLEN);
     return ESP_OK;
 }
 
@@ -326,8 +945,22 @@ static esp_err_t flash_program_delete_handler(httpd_req_t *req) {
     return ESP_OK;
 }
 
-// Log download handler - GET /api/logs
+// Parse the optional "?after=<seq>" query of a log request
+static uint32_t query_log_seq(httpd_req_t *req) {
+    char query[64];
+    char value[12];
+    if (httpd_req_get_url_query_str(req, query, sizeof(query)) != ESP_OK ||
+        httpd_query_key_value(query, "after", value, sizeof(value)) != ESP_OK) {
+        return LOG_BUFFER_SEQ_OLDEST;
+    }
+    return (uint32_t)strtoul(value, NULL, 10);
+}
+
+// Log download handler - GET /api/logs[?after=<seq>]
+// Replies with the log text and an X-Log-Seq header. Passing that value back as
+// "after" returns only the records written since.
 static esp_err_t log_download_handler(httpd_req_t *req) {
+    http_buffers_t *buffers = request_buffers(req);
     ESP_LOGI(TAG, "Log download request received");
 
     // Check authentication
@@ -335,32 +968,36 @@ static esp_err_t log_download_handler(httpd_req_t *req) {
         return ESP_FAIL;
     }
 
+    // Read up to the newest complete record
+    log_buffer_cursor_t cursor;
+    log_buffer_cursor_start(&cursor, query_log_seq(req));
+    uint32_t end_seq = log_buffer_cursor_end(&cursor);
+    char seq_header[12];
+    snprintf(seq_header, sizeof(seq_header), "%lu", (unsigned long)end_seq);
+
     // Set headers for file download
     httpd_resp_set_type(req, "text/plain");
     httpd_resp_set_hdr(req, "Content-Disposition", "attachment; filename=\"logs.txt\"");
     httpd_resp_set_hdr(req, "Content-Length", NULL);  // Will be set automatically
-
-    // Start reading from the beginning of available logs
-    log_buffer_start_read();
+    httpd_resp_set_hdr(req, "X-Log-Seq", seq_header);
 
     // Send log data in chunks using the global response buffer
     uint32_t total_sent = 0;
     uint32_t chunk_size;
 
     do {
-        chunk_size =
-            log_buffer_read_chunk(g_response_buffer, HTTP_SERVICE_RESPONSE_BUFFER_SIZE);
+        chunk_size = log_buffer_cursor_read(
+            &cursor, end_seq, buffers->response, HTTP_SERVICE_RESPONSE_BUFFER_SIZE);
         if (chunk_size > 0) {
             esp_err_t ret =
-                httpd_resp_send_chunk(req, (const char *)g_response_buffer, chunk_size);
+                httpd_resp_send_chunk(req, (const char *)buffers->response, chunk_size);
             if (ret != ESP_OK) {
                 ESP_LOGE(TAG, "Failed to send log chunk");
                 return ESP_FAIL;
             }
             total_sent += chunk_size;
         }
-    } while (chunk_size == HTTP_SERVICE_RESPONSE_BUFFER_SIZE);  // Continue until we get
-                                                                // less than full buffer
+    } while (chunk_size > 0);
 
     // Send final chunk to complete the response
     httpd_resp_send_chunk(req, NULL, 0);
@@ -369,6 +1006,148 @@ static esp_err_t log_download_handler(httpd_req_t *req) {
     return ESP_OK;
 }
 
+// Send the buffered part of a log stream event
+static bool log_stream_flush(httpd_req_t *req, size_t *length) {
+    if (*length == 0) {
+        return true;
+    }
+    esp_err_t ret = httpd_resp_send_chunk(req, g_log_stream_event, *length);
+    *length = 0;
+    return ret == ESP_OK;
+}
+
+// Log stream task: sends new records as Server-Sent Events until the client goes
+// away. Each event carries the lines as "data:" fields and the sequence number to
+// resume from as its id, so EventSource clients reconnect without gaps or repeats.
+static void log_stream_task(void *pvParameters) {
+    httpd_req_t *req = (httpd_req_t *)pvParameters;
+
+    httpd_resp_set_type(req, "text/event-stream");
+    httpd_resp_set_hdr(req, "Cache-Control", "no-cache");
+
+    log_buffer_cursor_t cursor;
+    log_buffer_cursor_start(&cursor, g_log_stream_start_seq);
+
+    // Sending the headers right away lets the client know the stream is open
+    bool connected =
+        httpd_resp_send_chunk(req, ": connected\n\n", HTTPD_RESP_USE_STRLEN) == ESP_OK;
+    TickType_t last_sent = xTaskGetTickCount();
+
+    while (connected) {
+        uint32_t end_seq = log_buffer_cursor_end(&cursor);
+        if (end_seq == cursor.seq) {
+            if (xTaskGetTickCount() - last_sent >=
+                pdMS_TO_TICKS(HTTP_SERVICE_LOG_STREAM_KEEPALIVE_MS)) {
+                // Comments keep idle connections open and detect closed ones
+                esp_err_t ret = httpd_resp_send_chunk(
+                    req, ": keepalive\n\n", HTTPD_RESP_USE_STRLEN);
+                connected = (ret == ESP_OK);
+                last_sent = xTaskGetTickCount();
+            }
+            vTaskDelay(pdMS_TO_TICKS(HTTP_SERVICE_LOG_STREAM_POLL_MS));
+            continue;
+        }
+
+        // Prefix each line with "data: ", flushing before the event buffer fills
+        size_t length = 0;
+        bool line_start = true;
+        while (connected) {
+            uint32_t text_length = log_buffer_cursor_read(
+                &cursor, end_seq, g_log_stream_text, sizeof(g_log_stream_text));
+            if (text_length == 0) {
+                break;
+            }
+            for (uint32_t i = 0; i < text_length && connected; i++) {
+                if (length + 8 > sizeof(g_log_stream_event)) {
+                    connected = log_stream_flush(req, &length);
+                }
+                if (line_start) {
+                    memcpy(&g_log_stream_event[length], "data: ", 6);
+                    length += 6;
+                }
+                g_log_stream_event[length++] = (char)g_log_stream_text[i];
+                line_start = (g_log_stream_text[i] == '\n');
+            }
+        }
+
+        // End the event with its id
+        if (connected) {
+            if (length + 24 > sizeof(g_log_stream_event)) {
+                connected = log_stream_flush(req, &length);
+            }
+            length += snprintf(&g_log_stream_event[length],
+                               sizeof(g_log_stream_event) - length,
+                               "%sid: %lu\n\n",
+                               line_start ? "" : "\n",
+                               (unsigned long)end_seq);
+            connected = connected && log_stream_flush(req, &length);
+            last_sent = xTaskGetTickCount();
+        }
+    }
+
+    ESP_LOGI(TAG, "Log stream closed");
+    httpd_req_async_handler_complete(req);
+    g_log_stream_active = false;
+    vTaskDelete(NULL);
+}
+
+// Log stream handler - GET /api/logs/stream[?after=<seq>]
+static esp_err_t log_stream_handler(httpd_req_t *req) {
+    ESP_LOGI(TAG, "Log stream request received");
+
+    // Check authentication
+    if (check_api_key(req) != ESP_OK) {
+        return ESP_FAIL;
+    }
+
+    if (g_log_stream_active) {
+        httpd_resp_set_status(req, "409 Conflict");
+        httpd_resp_set_type(req, "application/json");
+        httpd_resp_send(
+            req, "{\"error\":\"A log stream is already open\"}", HTTPD_RESP_USE_STRLEN);
+        return ESP_FAIL;
+    }
+
+    // Resume after the last event an EventSource client saw, or the "after" query
+    char last_event_id[12];
+    if (httpd_req_get_hdr_value_str(
+            req, "Last-Event-ID", last_event_id, sizeof(last_event_id)) == ESP_OK) {
+        g_log_stream_start_seq = (uint32_t)strtoul(last_event_id, NULL, 10);
+    } else {
+        g_log_stream_start_seq = query_log_seq(req);
+    }
+
+    // Hand the connection to the stream task
+    httpd_req_t *stream_req = NULL;
+    if (httpd_req_async_handler_begin(req, &stream_req) != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to start log stream");
+        httpd_resp_set_status(req, "500 Internal Server Error");
+        httpd_resp_set_type(req, "application/json");
+        httpd_resp_send(
+            req, "{\"error\":\"Failed to start log stream\"}", HTTPD_RESP_USE_STRLEN);
+        return ESP_FAIL;
+    }
+
+    g_log_stream_active = true;
+    if (xTaskCreate(log_stream_task,
+                    "http_logs",
+                    HTTP_SERVICE_LOG_STREAM_TASK_STACK_SIZE,
+                    stream_req,
+                    HTTP_SERVICE_LOG_STREAM_TASK_PRIORITY,
+                    NULL) != pdPASS) {
+        ESP_LOGE(TAG, "Failed to create log stream task");
+        g_log_stream_active = false;
+        httpd_resp_set_status(stream_req, "500 Internal Server Error");
+        httpd_resp_set_type(stream_req, "application/json");
+        httpd_resp_send(stream_req,
+                        "{\"error\":\"Failed to start log stream\"}",
+                        HTTPD_RESP_USE_STRLEN);
+        httpd_req_async_handler_complete(stream_req);
+        return ESP_FAIL;
+    }
+    return ESP_OK;
+}
+
 // Log delete handler - DELETE /api/logs
 static esp_err_t log_delete_handler(httpd_req_t *req) {
     ESP_LOGI(TAG, "Log delete request received");
@@ -387,6 +1166,242 @@ static esp_err_t log_delete_handler(httpd_req_t *req) {
     return ESP_OK;
 }
 
+// Boot timing handler - GET /api/boot
+static esp_err_t boot_status_handler(httpd_req_t *req) {
+    http_buffers_t *buffers = request_buffers(req);
+
+    // Check authentication
+    if (check_api_key(req) != ESP_OK) {
+        return ESP_FAIL;
+    }
+
+    // Respond with the completion time of each boot phase in milliseconds, or null
+    // for phases that haven't completed
+    char *response = (char *)buffers->response;
+    size_t response_size = HTTP_SERVICE_RESPONSE_BUFFER_SIZE;
+    size_t length = snprintf(response, response_size, "{");
+    for (int i = 0; i < APP_BOOT_PHASE_COUNT && length < response_size; i++) {
+        int64_t time_us = app_get_boot_time_us((app_boot_phase_t)i);
+        const char *separator = (i > 0) ? "," : "";
+        const char *name = app_boot_phase_name((app_boot_phase_t)i);
+        if (time_us > 0) {
+            length += snprintf(response + length,
+                               response_size - length,
+                               "%s\"%s_ms\":%lld.%03d",
+                               separator,
+                               name,
+                               (long long)(time_us / 1000),
+                               (int)(time_us % 1000));
+        } else {
+            length += snprintf(response + length,
+                               response_size - length,
+                               "%s\"%s_ms\":null",
+                               separator,
+                               name);
+        }
+    }
+    if (length < response_size) {
+        snprintf(response + length, response_size - length, "}");
+    }
+
+    httpd_resp_set_type(req, "application/json");
+    httpd_resp_send(req, response, HTTPD_RESP_USE_STRLEN);
+    return ESP_OK;
+}
+
+// Latency statistics handler - GET /api/stats
+static esp_err_t stats_get_handler(httpd_req_t *req) {
+    http_buffers_t *buffers = request_buffers(req);
+
+    // Check authentication
+    if (check_api_key(req) != ESP_OK) {
+        return ESP_FAIL;
+    }
+
+    char *response = (char *)buffers->response;
+    size_t response_size = HTTP_SERVICE_RESPONSE_BUFFER_SIZE;
+    size_t length = snprintf(
+        response, response_size, "{\"window\":%d,\"stages\":{", LATENCY_STATS_WINDOW);
+    for (int i = 0; i < LATENCY_STAGE_COUNT && length < response_size; i++) {
+        latency_summary_t summary;
+        latency_stats_get((latency_stage_t)i, &summary);
+        length += snprintf(response + length,
+                           response_size - length,
+                           "%s\"%s\":{\"count\":%lu,\"samples\":%lu,\"min_us\":%lu,"
+                           "\"p50_us\":%lu,\"p99_us\":%lu,\"max_us\":%lu}",
+                           (i > 0) ? "," : "",
+                           latency_stats_stage_name((latency_stage_t)i),
+                           (unsigned long)summary.count,
+                           (unsigned long)summary.samples,
+                           (unsigned long)summary.min_us,
+                           (unsigned long)summary.p50_us,
+                           (unsigned long)summary.p99_us,
+                           (unsigned long)summary.max_us);
+    }
+    if (length < response_size) {
+        snprintf(response + length, response_size - length, "}}");
+    }
+
+    httpd_resp_set_type(req, "application/json");
+    httpd_resp_send(req, response, HTTPD_RESP_USE_STRLEN);
+    return ESP_OK;
+}
+
+// Latency statistics reset handler - DELETE /api/stats
+static esp_err_t stats_delete_handler(httpd_req_t *req) {
+    // Check authentication
+    if (check_api_key(req) != ESP_OK) {
+        return ESP_FAIL;
+    }
+
+    latency_stats_reset();
+
+    ESP_LOGI(TAG, "Latency statistics reset");
+    httpd_resp_set_type(req, "application/json");
+    httpd_resp_send(req, "{\"success\":true}", HTTPD_RESP_USE_STRLEN);
+    return ESP_OK;
+}
+
+// VM profile handler - GET /api/profile
+static esp_err_t profile_get_handler(httpd_req_t *req) {
+    // Check authentication
+    if (check_api_key(req) != ESP_OK) {
+        return ESP_FAIL;
+    }
+
+    if (vm_task_is_running()) {
+        httpd_resp_set_status(req, "409 Conflict");
+        httpd_resp_set_type(req, "application/json");
+        httpd_resp_send(
+            req, "{\"error\":\"Program is running\"}", HTTPD_RESP_USE_STRLEN);
+        return ESP_FAIL;
+    }
+
+    size_t image_max = VM_TASK_PROFILE_IMAGE_MAX_SIZE;
+    uint8_t *image = heap_caps_malloc(image_max, MALLOC_CAP_SPIRAM);
+    if (image == NULL) {
+        httpd_resp_set_status(req, "500 Internal Server Error");
+        httpd_resp_set_type(req, "application/json");
+        httpd_resp_send(req, "{\"error\":\"Out of memory\"}", HTTPD_RESP_USE_STRLEN);
+        return ESP_FAIL;
+    }
+
+    size_t image_size = vm_task_get_profile_image(image, image_max);
+    if (image_size == 0) {
+        free(image);
+        httpd_resp_set_status(req, "404 Not Found");
+        httpd_resp_set_type(req, "application/json");
+        httpd_resp_send(
+            req, "{\"error\":\"No profile recorded\"}", HTTPD_RESP_USE_STRLEN);
+        return ESP_FAIL;
+    }
+
+    httpd_resp_set_type(req, "application/octet-stream");
+    httpd_resp_set_hdr(
+        req, "Content-Disposition", "attachment; filename=\"profile.bin\"");
+    esp_err_t err = httpd_resp_send(req, (const char *)image, image_size);
+    free(image);
+    return err;
+}
+
+// VM profile reset handler - DELETE /api/profile
+static esp_err_t profile_delete_handler(httpd_req_t *req) {
+    // Check authentication
+    if (check_api_key(req) != ESP_OK) {
+        return ESP_FAIL;
+    }
+
+    vm_task_reset_profile();
+
+    ESP_LOGI(TAG, "VM profile reset");
+    httpd_resp_set_type(req, "application/json");
+    httpd_resp_send(req, "{\"success\":true}", HTTPD_RESP_USE_STRLEN);
+    return ESP_OK;
+}
+
+// Parse the optional "?priority=low|normal|high" query of an execute request
+static bool query_priority(httpd_req_t *req, program_priority_t *out_priority) {
+    char query[64];
+    char value[8];
+    *out_priority = PROGRAM_PRIORITY_NORMAL;
+    if (httpd_req_get_url_query_str(req, query, sizeof(query)) != ESP_OK ||
+        httpd_query_key_value(query, "priority", value, sizeof(value)) != ESP_OK) {
+        return true;
+    }
+
+    if (strcmp(value, "low") == 0) {
+        *out_priority = PROGRAM_PRIORITY_LOW;
+    } else if (strcmp(value, "high") == 0) {
+        *out_priority = PROGRAM_PRIORITY_HIGH;
+    } else if (strcmp(value, "normal") != 0) {
+        return false;
+    }
+    return true;
+}
+
+// Parse the optional "?wait=<ms>" query of an execute request
+static uint32_t query_wait_ms(httpd_req_t *req) {
+    char query[64];
+    char value[12];
+    if (httpd_req_get_url_query_str(req, query, sizeof(query)) != ESP_OK ||
+        httpd_query_key_value(query, "wait", value, sizeof(value)) != ESP_OK) {
+        return 0;
+    }
+
+    unsigned long wait_ms = strtoul(value, NULL, 10);
+    return wait_ms > HTTP_SERVICE_MAX_EXECUTE_WAIT_MS ? HTTP_SERVICE_MAX_EXECUTE_WAIT_MS
+                                                      : (uint32_t)wait_ms;
+}
+
+// Queue a program run and reply with its queue position. With "?wait=<ms>", the
+// reply is held until the run queue drains or the wait times out.
+static esp_err_t execute_program_request(httpd_req_t *req,
+                                         program_type_t type,
+                                         const char *type_name) {
+    program_priority_t priority;
+    if (!query_priority(req, &priority)) {
+        httpd_resp_set_status(req, "400 Bad Request");
+        httpd_resp_set_type(req, "application/json");
+        httpd_resp_send(req,
+                        "{\"error\":\"Priority must be low, normal or high\"}",
+                        HTTPD_RESP_USE_STRLEN);
+        return ESP_FAIL;
+    }
+
+    uint32_t position;
+    if (!program_enqueue(type, priority, NULL, NULL, &position)) {
+        ESP_LOGW(TAG, "%s program execution failed", type_name);
+        char response[64];
+        snprintf(response,
+                 sizeof(response),
+                 "{\"error\":\"%s program cannot be executed\"}",
+                 type_name);
+        httpd_resp_set_status(req, "422 Unprocessable Entity");
+        httpd_resp_set_type(req, "application/json");
+        httpd_resp_send(req, response, HTTPD_RESP_USE_STRLEN);
+        return ESP_FAIL;
+    }
+
+    ESP_LOGI(TAG,
+             "%s program execution queued at position %lu",
+             type_name,
+             (unsigned long)position);
+
+    // Blocks on the VM task's idle event rather than polling
+    uint32_t wait_ms = query_wait_ms(req);
+    bool idle = program_wait_idle(wait_ms);
+
+    char response[64];
+    snprintf(response,
+             sizeof(response),
+             "{\"success\":true,\"position\":%lu,\"idle\":%s}",
+             (unsigned long)position,
+             idle ? "true" : "false");
+    httpd_resp_set_type(req, "application/json");
+    httpd_resp_send(req, response, HTTPD_RESP_USE_STRLEN);
+    return ESP_OK;
+}
+
 // Flash program execute handler - POST /api/program/flash/execute
 static esp_err_t flash_program_execute_handler(httpd_req_t *req) {
     ESP_LOGI(TAG, "Flash program execute request received");
@@ -396,23 +1411,165 @@ static esp_err_t flash_program_execute_handler(httpd_req_t *req) {
         return ESP_FAIL;
     }
 
-    if (!program_execute(PROGRAM_TYPE_FLASH, NULL, NULL)) {
-        ESP_LOGW(TAG, "Flash program execution failed");
-        httpd_resp_set_status(req, "422 Unprocessable Entity");
+    return execute_program_request(req, PROGRAM_TYPE_FLASH, "Flash");
+}
+
+// Flash program directory handler - GET /api/program/flash/programs
+static esp_err_t flash_program_list_handler(httpd_req_t *req) {
+    http_buffers_t *buffers = request_buffers(req);
+    ESP_LOGI(TAG, "Flash program list request received");
+
+    // Check authentication
+    if (check_api_key(req) != ESP_OK) {
+        return ESP_FAIL;
+    }
+
+    uint32_t count = program_get_count(PROGRAM_TYPE_FLASH);
+    if (count == 0) {
+        ESP_LOGW(TAG, "No program stored in flash");
+        httpd_resp_set_status(req, "404 Not Found");
+        httpd_resp_set_type(req, "application/json");
+        httpd_resp_send(req, "{\"error\":\"No program found\"}", HTTPD_RESP_USE_STRLEN);
+        return ESP_FAIL;
+    }
+
+    // {"selected":N,"programs":[{"id":0,"name":"...","size":N,"crc":N},...]}
+    cJSON *json = cJSON_CreateObject();
+    cJSON_AddNumberToObject(json, "selected", program_get_selected(PROGRAM_TYPE_FLASH));
+    cJSON *programs = cJSON_AddArrayToObject(json, "programs");
+    for (uint32_t id = 0; id < count; id++) {
+        program_info_t info;
+        if (!program_get_info(PROGRAM_TYPE_FLASH, id, &info)) {
+            continue;
+        }
+        cJSON *program = cJSON_CreateObject();
+        cJSON_AddNumberToObject(program, "id", id);
+        cJSON_AddStringToObject(program, "name", info.name);
+        cJSON_AddNumberToObject(program, "size", info.size);
+        cJSON_AddNumberToObject(program, "crc", info.crc);
+        cJSON_AddItemToArray(programs, program);
+    }
+
+    char *response = (char *)buffers->response;
+    bool printed = cJSON_PrintPreallocated(
+        json, response, HTTP_SERVICE_RESPONSE_BUFFER_SIZE, false);
+    cJSON_Delete(json);
+    if (!printed) {
+        ESP_LOGE(TAG, "Program list response too large");
+        httpd_resp_set_status(req, "500 Internal Server Error");
+        httpd_resp_set_type(req, "application/json");
+        httpd_resp_send(
+            req, "{\"error\":\"Response too large\"}", HTTPD_RESP_USE_STRLEN);
+        return ESP_FAIL;
+    }
+
+    httpd_resp_set_type(req, "application/json");
+    httpd_resp_send(req, response, HTTPD_RESP_USE_STRLEN);
+    return ESP_OK;
+}
+
+// Flash program select handler - POST /api/program/flash/select
+// Body: {"id":N} or {"name":"..."}
+static esp_err_t flash_program_select_handler(httpd_req_t *req) {
+    http_buffers_t *buffers = request_buffers(req);
+    ESP_LOGI(TAG, "Flash program select request received");
+
+    // Check authentication
+    if (check_api_key(req) != ESP_OK) {
+        return ESP_FAIL;
+    }
+
+    size_t content_length = req->content_len;
+    if (content_length == 0 || content_length + 1 > HTTP_SERVICE_WORKING_BUFFER_SIZE) {
+        ESP_LOGE(TAG, "Invalid content length: %lu", (unsigned long)content_length);
+        httpd_resp_set_status(req, "400 Bad Request");
+        httpd_resp_set_type(req, "application/json");
+        httpd_resp_send(
+            req, "{\"error\":\"Invalid content length\"}", HTTPD_RESP_USE_STRLEN);
+        return ESP_FAIL;
+    }
+
+    char *json_body = (char *)buffers->working;
+    if (!recv_exact(req, (uint8_t *)json_body, content_length)) {
+        ESP_LOGE(TAG, "Failed to receive JSON body");
+        httpd_resp_set_status(req, "400 Bad Request");
         httpd_resp_set_type(req, "application/json");
         httpd_resp_send(req,
-                        "{\"error\":\"Flash program cannot be executed\"}",
+                        "{\"error\":\"Failed to receive request body\"}",
                         HTTPD_RESP_USE_STRLEN);
         return ESP_FAIL;
     }
-    ESP_LOGI(TAG, "Flash program execution started");
+    json_body[content_length] = '\0';
+
+    cJSON *json = cJSON_Parse(json_body);
+    if (json == NULL) {
+        ESP_LOGE(TAG, "Invalid JSON format");
+        httpd_resp_set_status(req, "400 Bad Request");
+        httpd_resp_set_type(req, "application/json");
+        httpd_resp_send(
+            req, "{\"error\":\"Invalid JSON format\"}", HTTPD_RESP_USE_STRLEN);
+        return ESP_FAIL;
+    }
+
+    cJSON *id_json = cJSON_GetObjectItem(json, "id");
+    cJSON *name_json = cJSON_GetObjectItem(json, "name");
+    uint32_t id = 0;
+    bool found;
+    if (cJSON_IsNumber(id_json) && cJSON_GetNumberValue(id_json) >= 0) {
+        id = (uint32_t)cJSON_GetNumberValue(id_json);
+        found = id < program_get_count(PROGRAM_TYPE_FLASH);
+    } else if (cJSON_IsString(name_json)) {
+        found = program_find(PROGRAM_TYPE_FLASH, cJSON_GetStringValue(name_json), &id);
+    } else {
+        cJSON_Delete(json);
+        ESP_LOGE(TAG, "Missing program id or name");
+        httpd_resp_set_status(req, "400 Bad Request");
+        httpd_resp_set_type(req, "application/json");
+        httpd_resp_send(
+            req, "{\"error\":\"Missing program id or name\"}", HTTPD_RESP_USE_STRLEN);
+        return ESP_FAIL;
+    }
+    cJSON_Delete(json);
+
+    if (!found) {
+        ESP_LOGW(TAG, "Program to select not found");
+        httpd_resp_set_status(req, "404 Not Found");
+        httpd_resp_set_type(req, "application/json");
+        httpd_resp_send(req, "{\"error\":\"No such program\"}", HTTPD_RESP_USE_STRLEN);
+        return ESP_FAIL;
+    }
+
+    if (!program_select(PROGRAM_TYPE_FLASH, id)) {
+        ESP_LOGE(TAG, "Failed to select flash program %lu", (unsigned long)id);
+        httpd_resp_set_status(req, "500 Internal Server Error");
+        httpd_resp_set_type(req, "application/json");
+        httpd_resp_send(
+            req, "{\"error\":\"Failed to select program\"}", HTTPD_RESP_USE_STRLEN);
+        return ESP_FAIL;
+    }
+
+    char response[48];
+    snprintf(
+        response, sizeof(response), "{\"success\":true,\"id\":%lu}", (unsigned long)id);
     httpd_resp_set_type(req, "application/json");
-    httpd_resp_send(req, "{\"success\":true}", HTTPD_RESP_USE_STRLEN);
+    httpd_resp_send(req, response, HTTPD_RESP_USE_STRLEN);
     return ESP_OK;
 }
 
+// Check whether a query string flag such as "?stream=1" is set
+static bool query_flag_enabled(httpd_req_t *req, const char *key) {
+    char query[64];
+    char value[8];
+    if (httpd_req_get_url_query_str(req, query, sizeof(query)) != ESP_OK ||
+        httpd_query_key_value(query, key, value, sizeof(value)) != ESP_OK) {
+        return false;
+    }
+    return strcmp(value, "1") == 0 || strcmp(value, "true") == 0;
+}
+
 // RAM program upload handler - POST /api/program/ram
 static esp_err_t ram_program_upload_handler(httpd_req_t *req) {
+    http_buffers_t *buffers = request_buffers(req);
     ESP_LOGI(TAG, "RAM program upload request received");
 
     // Check authentication
@@ -432,9 +1589,14 @@ static esp_err_t ram_program_upload_handler(httpd_req_t *req) {
         return ESP_FAIL;
     }
 
-    if (content_length > PROGRAM_RAM_MAX_SIZE) {
-        ESP_LOGE(
-            TAG, "RAM program too large: %lu bytes", (unsigned long)content_length);
+    size_t program_size;
+    bool gzip;
+    if (get_upload_size(req, &program_size, &gzip) != ESP_OK) {
+        return ESP_FAIL;
+    }
+
+    if (program_size > PROGRAM_RAM_MAX_SIZE) {
+        ESP_LOGE(TAG, "RAM program too large: %lu bytes", (unsigned long)program_size);
         httpd_resp_set_status(req, "413 Payload Too Large");
         httpd_resp_set_type(req, "application/json");
         httpd_resp_send(
@@ -444,7 +1606,7 @@ static esp_err_t ram_program_upload_handler(httpd_req_t *req) {
 
     // Start RAM program storage write session
     if (!program_write_start(
-            PROGRAM_TYPE_RAM, content_length, PROGRAM_WRITE_SOURCE_HTTP)) {
+            PROGRAM_TYPE_RAM, program_size, PROGRAM_WRITE_SOURCE_HTTP)) {
         ESP_LOGE(TAG, "Failed to start RAM program storage write session");
         httpd_resp_set_status(req, "500 Internal Server Error");
         httpd_resp_set_type(req, "application/json");
@@ -454,47 +1616,103 @@ static esp_err_t ram_program_upload_handler(httpd_req_t *req) {
         return ESP_FAIL;
     }
 
-    // Get session buffer for this connection
-    uint8_t *buffer = g_working_buffer;
-    size_t buffer_size = HTTP_SERVICE_WORKING_BUFFER_SIZE;
-
-    // Read and write program data in chunks
-    size_t bytes_remaining = content_length;
-
-    while (bytes_remaining > 0) {
-        size_t chunk_size =
-            (bytes_remaining > buffer_size) ? buffer_size : bytes_remaining;
+    // Streaming uploads start executing as soon as the first bytes arrive
+    bool stream = query_flag_enabled(req, "stream");
+    if (stream && !program_execute_streaming(PROGRAM_TYPE_RAM, NULL, NULL)) {
+        ESP_LOGE(TAG, "Failed to start streaming RAM program execution");
+        httpd_resp_set_status(req, "500 Internal Server Error");
+        httpd_resp_set_type(req, "application/json");
+        httpd_resp_send(req,
+                        "{\"error\":\"Failed to start program execution\"}",
+                        HTTPD_RESP_USE_STRLEN);
+        return ESP_FAIL;
+    }
 
-        // Read chunk from HTTP request
-        int ret = httpd_req_recv(req, (char *)buffer, chunk_size);
-        if (ret <= 0) {
-            ESP_LOGE(TAG, "Failed to receive data chunk");
-            httpd_resp_set_status(req, "500 Internal Server Error");
-            httpd_resp_set_type(req, "application/json");
-            httpd_resp_send(
-                req, "{\"error\":\"Failed to receive data\"}", HTTPD_RESP_USE_STRLEN);
+    if (gzip) {
+        if (recv_gzip_program(req,
+                              PROGRAM_TYPE_RAM,
+                              program_size,
+                              buffers->working,
+                              HTTP_SERVICE_WORKING_BUFFER_SIZE) != ESP_OK) {
+            if (stream) {
+                program_halt();  // Otherwise it waits for the rest forever
+            }
             return ESP_FAIL;
         }
+    } else {
+        // Receive straight into the RAM program buffer; there is no staging copy
+        size_t bytes_remaining = content_length;
+
+        while (bytes_remaining > 0) {
+            uint32_t space = 0;
+            uint8_t *buffer = program_write_reserve(
+                PROGRAM_TYPE_RAM, &space, PROGRAM_WRITE_SOURCE_HTTP);
+            if (buffer == NULL || space < bytes_remaining) {
+                ESP_LOGE(TAG, "Failed to reserve RAM program storage");
+                // Ends the reservation, which otherwise keeps the buffer
+                program_write_abort(PROGRAM_TYPE_RAM, PROGRAM_WRITE_SOURCE_HTTP);
+                if (stream) {
+                    program_halt();  // Otherwise it waits for the rest forever
+                }
+                httpd_resp_set_status(req, "500 Internal Server Error");
+                httpd_resp_set_type(req, "application/json");
+                httpd_resp_send(
+                    req,
+                    "{\"error\":\"Failed to write to RAM program storage\"}",
+                    HTTPD_RESP_USE_STRLEN);
+                return ESP_FAIL;
+            }
+
+            size_t chunk_size = (bytes_remaining > HTTP_SERVICE_RAM_RECV_SIZE)
+                                    ? HTTP_SERVICE_RAM_RECV_SIZE
+                                    : bytes_remaining;
+
+            // Read chunk from HTTP request
+            int ret = httpd_req_recv(req, (char *)buffer, chunk_size);
+            if (ret <= 0) {
+                ESP_LOGE(TAG, "Failed to receive data chunk");
+                // Ends the reservation, which otherwise keeps the buffer
+                program_write_abort(PROGRAM_TYPE_RAM, PROGRAM_WRITE_SOURCE_HTTP);
+                if (stream) {
+                    program_halt();  // Otherwise it waits for the rest forever
+                }
+                httpd_resp_set_status(req, "500 Internal Server Error");
+                httpd_resp_set_type(req, "application/json");
+                httpd_resp_send(req,
+                                "{\"error\":\"Failed to receive data\"}",
+                                HTTPD_RESP_USE_STRLEN);
+                return ESP_FAIL;
+            }
+
+            // Commit the received bytes to RAM program storage
+            if (!program_write_commit(
+                    PROGRAM_TYPE_RAM, ret, PROGRAM_WRITE_SOURCE_HTTP)) {
+                ESP_LOGE(TAG, "Failed to write chunk to RAM program storage");
+                // Drop the half-written session
+                program_write_abort(PROGRAM_TYPE_RAM, PROGRAM_WRITE_SOURCE_HTTP);
+                if (stream) {
+                    program_halt();  // Otherwise it waits for the rest forever
+                }
+                httpd_resp_set_status(req, "500 Internal Server Error");
+                httpd_resp_set_type(req, "application/json");
+                httpd_resp_send(
+                    req,
+                    "{\"error\":\"Failed to write to RAM program storage\"}",
+                    HTTPD_RESP_USE_STRLEN);
+                return ESP_FAIL;
+            }
 
-        // Write chunk to RAM program storage
-        if (!program_write_chunk(
-                PROGRAM_TYPE_RAM, buffer, ret, PROGRAM_WRITE_SOURCE_HTTP)) {
-            ESP_LOGE(TAG, "Failed to write chunk to RAM program storage");
-            httpd_resp_set_status(req, "500 Internal Server Error");
-            httpd_resp_set_type(req, "application/json");
-            httpd_resp_send(req,
-                            "{\"error\":\"Failed to write to RAM program storage\"}",
-                            HTTPD_RESP_USE_STRLEN);
-            return ESP_FAIL;
+            bytes_remaining -= ret;
         }
-
-        bytes_remaining -= ret;
     }
 
     // Finish RAM program storage write session
     if (!program_write_finish(
-            PROGRAM_TYPE_RAM, content_length, PROGRAM_WRITE_SOURCE_HTTP)) {
+            PROGRAM_TYPE_RAM, program_size, PROGRAM_WRITE_SOURCE_HTTP)) {
         ESP_LOGE(TAG, "Failed to finish RAM program storage write session");
+        if (stream) {
+            program_halt();  // Otherwise it waits for the rest forever
+        }
         httpd_resp_set_status(req, "500 Internal Server Error");
         httpd_resp_set_type(req, "application/json");
         httpd_resp_send(req,
@@ -504,14 +1722,15 @@ static esp_err_t ram_program_upload_handler(httpd_req_t *req) {
     }
 
     ESP_LOGI(TAG,
-             "RAM program upload completed successfully: %lu bytes",
-             (unsigned long)content_length);
+             "RAM program upload completed successfully: %lu bytes%s",
+             (unsigned long)program_size,
+             gzip ? " (gzip)" : "");
     httpd_resp_set_type(req, "application/json");
     char response[64];
     snprintf(response,
              sizeof(response),
              "{\"success\":true,\"size\":%lu}",
-             (unsigned long)content_length);
+             (unsigned long)program_size);
     httpd_resp_send(req, response, HTTPD_RESP_USE_STRLEN);
     return ESP_OK;
 }
@@ -525,11 +1744,10 @@ static esp_err_t ram_program_download_handler(httpd_req_t *req) {
         return ESP_FAIL;
     }
 
-    // Get RAM program from storage
-    uint32_t program_size;
-    const uint8_t *program_data = program_get(PROGRAM_TYPE_RAM, &program_size);
-
-    if (program_data == NULL || program_size == 0) {
+    // Take a reference to the RAM program, so an upload finishing meanwhile leaves
+    // the snapshot being sent alone
+    program_ref_t program;
+    if (!program_acquire(PROGRAM_TYPE_RAM, &program)) {
         ESP_LOGW(TAG, "No RAM program stored");
         httpd_resp_set_status(req, "404 Not Found");
         httpd_resp_set_type(req, "application/json");
@@ -542,17 +1760,17 @@ static esp_err_t ram_program_download_handler(httpd_req_t *req) {
     httpd_resp_set_type(req, "application/octet-stream");
     httpd_resp_set_hdr(
         req, "Content-Disposition", "attachment; filename=\"ram_program.bin\"");
-    httpd_resp_set_hdr(req, "Content-Length", NULL);  // Will be set automatically
 
-    // Send program data
-    esp_err_t ret = httpd_resp_send(req, (const char *)program_data, program_size);
+    // Send program data straight from the snapshot
+    esp_err_t ret = send_program(req, program.data, program.size);
+    program_release(&program);
     if (ret != ESP_OK) {
         ESP_LOGE(TAG, "Failed to send RAM program data");
         return ESP_FAIL;
     }
 
     ESP_LOGI(
-        TAG, "RAM program download completed: %lu bytes", (unsigned long)program_size);
+        TAG, "RAM program download completed: %lu bytes", (unsigned long)program.size);
     return ESP_OK;
 }
 
@@ -590,24 +1808,12 @@ static esp_err_t ram_program_execute_handler(httpd_req_t *req) {
         return ESP_FAIL;
     }
 
-    if (!program_execute(PROGRAM_TYPE_RAM, NULL, NULL)) {
-        ESP_LOGW(TAG, "RAM program execution failed");
-        httpd_resp_set_status(req, "422 Unprocessable Entity");
-        httpd_resp_set_type(req, "application/json");
-        httpd_resp_send(req,
-                        "{\"error\":\"RAM program cannot be executed\"}",
-                        HTTPD_RESP_USE_STRLEN);
-        return ESP_FAIL;
-    }
-
-    ESP_LOGI(TAG, "RAM program execution started");
-    httpd_resp_set_type(req, "application/json");
-    httpd_resp_send(req, "{\"success\":true}", HTTPD_RESP_USE_STRLEN);
-    return ESP_OK;
+    return execute_program_request(req, PROGRAM_TYPE_RAM, "RAM");
 }
 
 // NVS get handler - GET /api/nvs/{key}
 static esp_err_t nvs_get_handler(httpd_req_t *req) {
+    http_buffers_t *buffers = request_buffers(req);
     ESP_LOGI(TAG, "NVS get request received");
 
     // Check authentication
@@ -628,24 +1834,11 @@ static esp_err_t nvs_get_handler(httpd_req_t *req) {
         return ESP_FAIL;
     }
 
-    // Open NVS namespace
-    nvs_handle_t nvs_handle;
-    esp_err_t err = nvs_open(NVS_NAMESPACE, NVS_READONLY, &nvs_handle);
-    if (err != ESP_OK) {
-        ESP_LOGE(TAG, "Failed to open NVS: %s", esp_err_to_name(err));
-        httpd_resp_set_status(req, "500 Internal Server Error");
-        httpd_resp_set_type(req, "application/json");
-        httpd_resp_send(
-            req, "{\"error\":\"Failed to open NVS\"}", HTTPD_RESP_USE_STRLEN);
-        return ESP_FAIL;
-    }
-
     // Get key type
     nvs_type_t nvs_type;
-    err = nvs_find_key(nvs_handle, key, &nvs_type);
+    esp_err_t err = nvs_config_find_key(key, &nvs_type);
     if (err != ESP_OK) {
         ESP_LOGW(TAG, "Key not found: %s", key);
-        nvs_close(nvs_handle);
         httpd_resp_set_status(req, "404 Not Found");
         httpd_resp_set_type(req, "application/json");
         httpd_resp_send(req, "{\"error\":\"Key not found\"}", HTTPD_RESP_USE_STRLEN);
@@ -653,18 +1846,17 @@ static esp_err_t nvs_get_handler(httpd_req_t *req) {
     }
 
     // Get session buffer for this connection
-    uint8_t *session_buffer = g_working_buffer;
+    uint8_t *session_buffer = buffers->working;
     size_t buffer_size = HTTP_SERVICE_WORKING_BUFFER_SIZE;
 
     // Use dedicated response buffer
-    char *response = (char *)g_response_buffer;
+    char *response = (char *)buffers->response;
     size_t response_size = HTTP_SERVICE_RESPONSE_BUFFER_SIZE;
     err = ESP_FAIL;
 
     switch (nvs_type) {
     case NVS_TYPE_ANY:
         ESP_LOGE(TAG, "NVS_TYPE_ANY not supported");
-        nvs_close(nvs_handle);
         httpd_resp_set_status(req, "500 Internal Server Error");
         httpd_resp_set_type(req, "application/json");
         httpd_resp_send(
@@ -672,35 +1864,35 @@ static esp_err_t nvs_get_handler(httpd_req_t *req) {
         return ESP_FAIL;
     case NVS_TYPE_U8: {
         uint8_t value;
-        err = nvs_get_u8(nvs_handle, key, &value);
+        err = nvs_config_get_u8(key, &value);
         if (err == ESP_OK) {
             snprintf(response, response_size, "{\"type\":\"u8\",\"value\":%d}", value);
         }
     } break;
     case NVS_TYPE_I8: {
         int8_t value;
-        err = nvs_get_i8(nvs_handle, key, &value);
+        err = nvs_config_get_i8(key, &value);
         if (err == ESP_OK) {
             snprintf(response, response_size, "{\"type\":\"i8\",\"value\":%d}", value);
         }
     } break;
     case NVS_TYPE_U16: {
         uint16_t value;
-        err = nvs_get_u16(nvs_handle, key, &value);
+        err = nvs_config_get_u16(key, &value);
         if (err == ESP_OK) {
             snprintf(response, response_size, "{\"type\":\"u16\",\"value\":%d}", value);
         }
     } break;
     case NVS_TYPE_I16: {
         int16_t value;
-        err = nvs_get_i16(nvs_handle, key, &value);
+        err = nvs_config_get_i16(key, &value);
         if (err == ESP_OK) {
             snprintf(response, response_size, "{\"type\":\"i16\",\"value\":%d}", value);
         }
     } break;
     case NVS_TYPE_U32: {
         uint32_t value;
-        err = nvs_get_u32(nvs_handle, key, &value);
+        err = nvs_config_get_u32(key, &value);
         if (err == ESP_OK) {
             snprintf(response,
                      response_size,
@@ -710,7 +1902,7 @@ static esp_err_t nvs_get_handler(httpd_req_t *req) {
     } break;
     case NVS_TYPE_I32: {
         int32_t value;
-        err = nvs_get_i32(nvs_handle, key, &value);
+        err = nvs_config_get_i32(key, &value);
         if (err == ESP_OK) {
             snprintf(response,
                      response_size,
@@ -720,7 +1912,7 @@ static esp_err_t nvs_get_handler(httpd_req_t *req) {
     } break;
     case NVS_TYPE_U64: {
         uint64_t value;
-        err = nvs_get_u64(nvs_handle, key, &value);
+        err = nvs_config_get_u64(key, &value);
         if (err == ESP_OK) {
             snprintf(response,
                      response_size,
@@ -730,7 +1922,7 @@ static esp_err_t nvs_get_handler(httpd_req_t *req) {
     } break;
     case NVS_TYPE_I64: {
         int64_t value;
-        err = nvs_get_i64(nvs_handle, key, &value);
+        err = nvs_config_get_i64(key, &value);
         if (err == ESP_OK) {
             snprintf(response,
                      response_size,
@@ -740,9 +1932,9 @@ static esp_err_t nvs_get_handler(httpd_req_t *req) {
     } break;
     case NVS_TYPE_STR: {
         // Use working buffer for string value
-        char *str_value = (char *)g_working_buffer;
+        char *str_value = (char *)buffers->working;
         size_t required_size = HTTP_SERVICE_WORKING_BUFFER_SIZE;
-        err = nvs_get_str(nvs_handle, key, str_value, &required_size);
+        err = nvs_config_get_str(key, str_value, &required_size);
         if (err == ESP_OK) {
             int written = snprintf(response,
                                    response_size,
@@ -750,7 +1942,6 @@ static esp_err_t nvs_get_handler(httpd_req_t *req) {
                                    str_value);
             if (written >= response_size) {
                 ESP_LOGE(TAG, "NVS string value too large for response buffer");
-                nvs_close(nvs_handle);
                 httpd_resp_set_status(req, "500 Internal Server Error");
                 httpd_resp_set_type(req, "application/json");
                 httpd_resp_send(
@@ -761,10 +1952,9 @@ static esp_err_t nvs_get_handler(httpd_req_t *req) {
     } break;
     case NVS_TYPE_BLOB: {
         size_t required_size = buffer_size;
-        err = nvs_get_blob(nvs_handle, key, session_buffer, &required_size);
+        err = nvs_config_get_blob(key, session_buffer, &required_size);
         if (err == ESP_OK) {
             // Return raw binary data
-            nvs_close(nvs_handle);
             httpd_resp_set_type(req, "application/octet-stream");
             httpd_resp_send(req, (const char *)session_buffer, required_size);
             return ESP_OK;
@@ -772,8 +1962,6 @@ static esp_err_t nvs_get_handler(httpd_req_t *req) {
     } break;
     }
 
-    nvs_close(nvs_handle);
-
     if (err != ESP_OK) {
         ESP_LOGE(TAG, "Failed to get NVS value: %s", esp_err_to_name(err));
         httpd_resp_set_status(req, "500 Internal Server Error");
@@ -790,6 +1978,7 @@ static esp_err_t nvs_get_handler(httpd_req_t *req) {
 
 // NVS set handler - POST /api/nvs/{key}
 static esp_err_t nvs_set_handler(httpd_req_t *req) {
+    http_buffers_t *buffers = request_buffers(req);
     ESP_LOGI(TAG, "NVS set request received");
 
     // Check authentication
@@ -830,7 +2019,7 @@ static esp_err_t nvs_set_handler(httpd_req_t *req) {
             req, "{\"error\":\"Request body too large\"}", HTTPD_RESP_USE_STRLEN);
         return ESP_FAIL;
     }
-    char *json_body = (char *)g_working_buffer;
+    char *json_body = (char *)buffers->working;
 
     int ret = httpd_req_recv(req, json_body, content_length);
     if (ret <= 0) {
@@ -881,25 +2070,12 @@ static esp_err_t nvs_set_handler(httpd_req_t *req) {
         return ESP_FAIL;
     }
 
-    // Open NVS namespace
-    nvs_handle_t nvs_handle;
-    esp_err_t err = nvs_open(NVS_NAMESPACE, NVS_READWRITE, &nvs_handle);
-    if (err != ESP_OK) {
-        ESP_LOGE(TAG, "Failed to open NVS: %s", esp_err_to_name(err));
-        cJSON_Delete(json);
-        httpd_resp_set_status(req, "500 Internal Server Error");
-        httpd_resp_set_type(req, "application/json");
-        httpd_resp_send(
-            req, "{\"error\":\"Failed to open NVS\"}", HTTPD_RESP_USE_STRLEN);
-        return ESP_FAIL;
-    }
-
     // Write value based on type
-    err = ESP_FAIL;
+    esp_err_t err = ESP_FAIL;
     if (strcmp(type_str, "u8") == 0) {
         if (cJSON_IsNumber(value_json)) {
             uint8_t value = (uint8_t)cJSON_GetNumberValue(value_json);
-            err = nvs_set_u8(nvs_handle, key, value);
+            err = nvs_config_set_u8(key, value);
         } else {
             ESP_LOGE(TAG, "Invalid value type for u8");
             err = ESP_ERR_INVALID_ARG;
@@ -907,7 +2083,7 @@ static esp_err_t nvs_set_handler(httpd_req_t *req) {
     } else if (strcmp(type_str, "i8") == 0) {
         if (cJSON_IsNumber(value_json)) {
             int8_t value = (int8_t)cJSON_GetNumberValue(value_json);
-            err = nvs_set_i8(nvs_handle, key, value);
+            err = nvs_config_set_i8(key, value);
         } else {
             ESP_LOGE(TAG, "Invalid value type for i8");
             err = ESP_ERR_INVALID_ARG;
@@ -915,7 +2091,7 @@ static esp_err_t nvs_set_handler(httpd_req_t *req) {
     } else if (strcmp(type_str, "u16") == 0) {
         if (cJSON_IsNumber(value_json)) {
             uint16_t value = (uint16_t)cJSON_GetNumberValue(value_json);
-            err = nvs_set_u16(nvs_handle, key, value);
+            err = nvs_config_set_u16(key, value);
         } else {
             ESP_LOGE(TAG, "Invalid value type for u16");
             err = ESP_ERR_INVALID_ARG;
@@ -923,7 +2099,7 @@ static esp_err_t nvs_set_handler(httpd_req_t *req) {
     } else if (strcmp(type_str, "i16") == 0) {
         if (cJSON_IsNumber(value_json)) {
             int16_t value = (int16_t)cJSON_GetNumberValue(value_json);
-            err = nvs_set_i16(nvs_handle, key, value);
+            err = nvs_config_set_i16(key, value);
         } else {
             ESP_LOGE(TAG, "Invalid value type for i16");
             err = ESP_ERR_INVALID_ARG;
@@ -931,7 +2107,7 @@ static esp_err_t nvs_set_handler(httpd_req_t *req) {
     } else if (strcmp(type_str, "u32") == 0) {
         if (cJSON_IsNumber(value_json)) {
             uint32_t value = (uint32_t)cJSON_GetNumberValue(value_json);
-            err = nvs_set_u32(nvs_handle, key, value);
+            err = nvs_config_set_u32(key, value);
         } else {
             ESP_LOGE(TAG, "Invalid value type for u32");
             err = ESP_ERR_INVALID_ARG;
@@ -939,7 +2115,7 @@ static esp_err_t nvs_set_handler(httpd_req_t *req) {
     } else if (strcmp(type_str, "i32") == 0) {
         if (cJSON_IsNumber(value_json)) {
             int32_t value = (int32_t)cJSON_GetNumberValue(value_json);
-            err = nvs_set_i32(nvs_handle, key, value);
+            err = nvs_config_set_i32(key, value);
         } else {
             ESP_LOGE(TAG, "Invalid value type for i32");
             err = ESP_ERR_INVALID_ARG;
@@ -947,7 +2123,7 @@ static esp_err_t nvs_set_handler(httpd_req_t *req) {
     } else if (strcmp(type_str, "u64") == 0) {
         if (cJSON_IsNumber(value_json)) {
             uint64_t value = (uint64_t)cJSON_GetNumberValue(value_json);
-            err = nvs_set_u64(nvs_handle, key, value);
+            err = nvs_config_set_u64(key, value);
         } else {
             ESP_LOGE(TAG, "Invalid value type for u64");
             err = ESP_ERR_INVALID_ARG;
@@ -955,7 +2131,7 @@ static esp_err_t nvs_set_handler(httpd_req_t *req) {
     } else if (strcmp(type_str, "i64") == 0) {
         if (cJSON_IsNumber(value_json)) {
             int64_t value = (int64_t)cJSON_GetNumberValue(value_json);
-            err = nvs_set_i64(nvs_handle, key, value);
+            err = nvs_config_set_i64(key, value);
         } else {
             ESP_LOGE(TAG, "Invalid value type for i64");
             err = ESP_ERR_INVALID_ARG;
@@ -963,7 +2139,7 @@ static esp_err_t nvs_set_handler(httpd_req_t *req) {
     } else if (strcmp(type_str, "str") == 0) {
         if (cJSON_IsString(value_json)) {
             const char *value_str = cJSON_GetStringValue(value_json);
-            err = nvs_set_str(nvs_handle, key, value_str);
+            err = nvs_config_set_str(key, value_str);
         } else {
             ESP_LOGE(TAG, "Invalid value type for str");
             err = ESP_ERR_INVALID_ARG;
@@ -971,7 +2147,7 @@ static esp_err_t nvs_set_handler(httpd_req_t *req) {
     } else if (strcmp(type_str, "blob") == 0) {
         // For blob type, read binary data directly from request body
         // Use global buffer for this connection
-        uint8_t *session_buffer = g_working_buffer;
+        uint8_t *session_buffer = buffers->working;
 
         // Read binary data directly into session buffer
         int ret = httpd_req_recv(req, (char *)session_buffer, content_length);
@@ -979,7 +2155,7 @@ static esp_err_t nvs_set_handler(httpd_req_t *req) {
             ESP_LOGE(TAG, "Failed to receive blob data");
             err = ESP_ERR_INVALID_ARG;
         } else {
-            err = nvs_set_blob(nvs_handle, key, session_buffer, ret);
+            err = nvs_config_set_blob(key, session_buffer, ret);
         }
     } else {
         ESP_LOGE(TAG, "Unsupported type: %s", type_str);
@@ -988,7 +2164,6 @@ static esp_err_t nvs_set_handler(httpd_req_t *req) {
 
     if (err != ESP_OK) {
         ESP_LOGE(TAG, "Failed to set NVS value: %s", esp_err_to_name(err));
-        nvs_close(nvs_handle);
         cJSON_Delete(json);
         httpd_resp_set_status(req, "500 Internal Server Error");
         httpd_resp_set_type(req, "application/json");
@@ -997,20 +2172,6 @@ static esp_err_t nvs_set_handler(httpd_req_t *req) {
         return ESP_FAIL;
     }
 
-    // Commit changes
-    err = nvs_commit(nvs_handle);
-    if (err != ESP_OK) {
-        ESP_LOGE(TAG, "Failed to commit NVS: %s", esp_err_to_name(err));
-        nvs_close(nvs_handle);
-        cJSON_Delete(json);
-        httpd_resp_set_status(req, "500 Internal Server Error");
-        httpd_resp_set_type(req, "application/json");
-        httpd_resp_send(
-            req, "{\"error\":\"Failed to commit changes\"}", HTTPD_RESP_USE_STRLEN);
-        return ESP_FAIL;
-    }
-
-    nvs_close(nvs_handle);
     cJSON_Delete(json);
 
     ESP_LOGI(TAG, "NVS set completed: key='%s'", key);
@@ -1041,50 +2202,441 @@ static esp_err_t nvs_delete_handler(httpd_req_t *req) {
         return ESP_FAIL;
     }
 
-    // Open NVS namespace
-    nvs_handle_t nvs_handle;
-    esp_err_t err = nvs_open(NVS_NAMESPACE, NVS_READWRITE, &nvs_handle);
-    if (err != ESP_OK) {
-        ESP_LOGE(TAG, "Failed to open NVS: %s", esp_err_to_name(err));
+    // Delete key
+    esp_err_t err = nvs_config_erase_key(key);
+    if (err != ESP_OK && err != ESP_ERR_NVS_NOT_FOUND) {
+        ESP_LOGE(TAG, "Failed to erase NVS key: %s", esp_err_to_name(err));
         httpd_resp_set_status(req, "500 Internal Server Error");
         httpd_resp_set_type(req, "application/json");
         httpd_resp_send(
-            req, "{\"error\":\"Failed to open NVS\"}", HTTPD_RESP_USE_STRLEN);
+            req, "{\"error\":\"Failed to delete key\"}", HTTPD_RESP_USE_STRLEN);
         return ESP_FAIL;
     }
 
-    // Delete key
-    err = nvs_erase_key(nvs_handle, key);
-    if (err != ESP_OK && err != ESP_ERR_NVS_NOT_FOUND) {
-        ESP_LOGE(TAG, "Failed to erase NVS key: %s", esp_err_to_name(err));
-        nvs_close(nvs_handle);
-        httpd_resp_set_status(req, "500 Internal Server Error");
+    ESP_LOGI(TAG, "NVS delete completed: key='%s'", key);
+    httpd_resp_set_type(req, "application/json");
+    httpd_resp_send(req, "{\"success\":true}", HTTPD_RESP_USE_STRLEN);
+    return ESP_OK;
+}
+
+// Batch handler - POST /api/batch
+// Body: binary batch (see config_batch.h); the binary response is returned as is
+static esp_err_t batch_handler(httpd_req_t *req) {
+    http_buffers_t *buffers = request_buffers(req);
+    ESP_LOGI(TAG, "Batch request received");
+
+    // Check authentication
+    if (check_api_key(req) != ESP_OK) {
+        return ESP_FAIL;
+    }
+
+    size_t content_length = req->content_len;
+    if (content_length == 0 || content_length > CONFIG_BATCH_MAX_SIZE) {
+        ESP_LOGE(TAG, "Invalid content length: %lu", (unsigned long)content_length);
+        httpd_resp_set_status(req, "400 Bad Request");
         httpd_resp_set_type(req, "application/json");
         httpd_resp_send(
-            req, "{\"error\":\"Failed to delete key\"}", HTTPD_RESP_USE_STRLEN);
+            req, "{\"error\":\"Invalid content length\"}", HTTPD_RESP_USE_STRLEN);
         return ESP_FAIL;
     }
 
-    // Commit changes
-    err = nvs_commit(nvs_handle);
-    if (err != ESP_OK) {
-        ESP_LOGE(TAG, "Failed to commit NVS: %s", esp_err_to_name(err));
-        nvs_close(nvs_handle);
-        httpd_resp_set_status(req, "500 Internal Server Error");
+    uint8_t *batch = buffers->working;
+    if (!recv_exact(req, batch, content_length)) {
+        ESP_LOGE(TAG, "Failed to receive batch");
+        httpd_resp_set_status(req, "400 Bad Request");
+        httpd_resp_set_type(req, "application/json");
+        httpd_resp_send(req,
+                        "{\"error\":\"Failed to receive request body\"}",
+                        HTTPD_RESP_USE_STRLEN);
+        return ESP_FAIL;
+    }
+
+    size_t response_length;
+    if (!config_batch_run(batch,
+                          content_length,
+                          buffers->response,
+                          CONFIG_BATCH_MAX_SIZE,
+                          &response_length)) {
+        httpd_resp_set_status(req, "400 Bad Request");
         httpd_resp_set_type(req, "application/json");
         httpd_resp_send(
-            req, "{\"error\":\"Failed to commit changes\"}", HTTPD_RESP_USE_STRLEN);
+            req, "{\"error\":\"Malformed batch\"}", HTTPD_RESP_USE_STRLEN);
+        return ESP_OK;
+    }
+
+    httpd_resp_set_type(req, "application/octet-stream");
+    httpd_resp_send(req, (const char *)buffers->response, response_length);
+    return ESP_OK;
+}
+
+// The WebSocket session context is static, so there is nothing to free
+static void ws_session_ctx_free(void *ctx) {
+    (void)ctx;
+}
+
+// Send a binary WebSocket reply to a request frame
+static esp_err_t ws_reply(httpd_req_t *req,
+                          uint8_t op,
+                          uint8_t tag,
+                          uint8_t status,
+                          const uint8_t *data,
+                          size_t data_len) {
+    uint8_t reply[HTTP_SERVICE_WS_MAX_REPLY_SIZE];
+    reply[0] = op | WS_REPLY_FLAG;
+    reply[1] = tag;
+    reply[2] = status;
+    if (data_len > 0) {
+        memcpy(reply + WS_REPLY_HEADER_SIZE, data, data_len);
+    }
+
+    httpd_ws_frame_t frame = {.final = true,
+                              .fragmented = false,
+                              .type = HTTPD_WS_TYPE_BINARY,
+                              .payload = reply,
+                              .len = WS_REPLY_HEADER_SIZE + data_len};
+    return httpd_ws_send_frame(req, &frame);
+}
+
+// Runs on the server task; sends the completion event of a run queued by EXECUTE
+static void ws_send_run_complete(void *arg) {
+    uintptr_t value = (uintptr_t)arg;
+    int fd = (int)(value >> 8);
+    uint8_t event[2] = {WS_EVENT_RUN_COMPLETE, (uint8_t)value};
+
+    // The client may have gone, and its socket been reused, since the run was queued
+    if (g_service == NULL ||
+        httpd_ws_get_fd_info(g_service, fd) != HTTPD_WS_CLIENT_WEBSOCKET ||
+        httpd_sess_get_ctx(g_service, fd) != &g_ws_authorized) {
+        return;
+    }
+
+    httpd_ws_frame_t frame = {.final = true,
+                              .fragmented = false,
+                              .type = HTTPD_WS_TYPE_BINARY,
+                              .payload = event,
+                              .len = sizeof(event)};
+    if (httpd_ws_send_frame_async(g_service, fd, &frame) != ESP_OK) {
+        ESP_LOGW(TAG, "Failed to send WebSocket run completion event");
+    }
+}
+
+// VM task completion callback of a run queued by EXECUTE. The socket and tag are
+// packed into the argument, since the callbacks of dropped runs are never called to
+// free an allocated one.
+static void ws_run_complete(void *arg) {
+    httpd_handle_t service = g_service;
+    if (service == NULL ||
+        httpd_queue_work(service, ws_send_run_complete, arg) != ESP_OK) {
+        ESP_LOGW(TAG, "Failed to queue WebSocket run completion event");
+    }
+}
+
+// AUTH: [api key]. A wrong key closes the connection.
+static esp_err_t ws_auth_request(httpd_req_t *req,
+                                 uint8_t tag,
+                                 const uint8_t *payload,
+                                 size_t payload_len) {
+    if (!api_key_matches(payload, payload_len)) {
+        ESP_LOGW(TAG, "WebSocket client sent an invalid API key");
+        ws_reply(req, WS_OP_AUTH, tag, WS_STATUS_UNAUTHORIZED, NULL, 0);
         return ESP_FAIL;
     }
 
-    nvs_close(nvs_handle);
+    // The server keeps the context for the rest of the session
+    req->sess_ctx = &g_ws_authorized;
+    req->free_ctx = ws_session_ctx_free;
+    ESP_LOGI(TAG, "WebSocket client authorized");
+    return ws_reply(req, WS_OP_AUTH, tag, WS_STATUS_OK, NULL, 0);
+}
 
-    ESP_LOGI(TAG, "NVS delete completed: key='%s'", key);
-    httpd_resp_set_type(req, "application/json");
-    httpd_resp_send(req, "{\"success\":true}", HTTPD_RESP_USE_STRLEN);
+// EXECUTE: [type u8][priority u8][id u32] -> [position u32]
+static esp_err_t ws_execute_request(httpd_req_t *req,
+                                    uint8_t tag,
+                                    const uint8_t *payload,
+                                    size_t payload_len) {
+    uint32_t id;
+    if (payload_len != 6 || payload[0] > PROGRAM_TYPE_RAM ||
+        payload[1] > PROGRAM_PRIORITY_HIGH ||
+        !bu_read_u32_le(payload + 2, payload_len - 2, &id)) {
+        return ws_reply(req, WS_OP_EXECUTE, tag, WS_STATUS_BAD_REQUEST, NULL, 0);
+    }
+    program_type_t type = (program_type_t)payload[0];
+    program_priority_t priority = (program_priority_t)payload[1];
+
+    void *arg = (void *)(((uintptr_t)httpd_req_to_sockfd(req) << 8) | tag);
+    uint32_t position;
+    bool queued;
+    if (id == WS_PROGRAM_SELECTED) {
+        queued = program_enqueue(type, priority, ws_run_complete, arg, &position);
+    } else {
+        queued = program_enqueue_by_id(
+            type, id, priority, ws_run_complete, arg, &position);
+    }
+    if (!queued) {
+        ESP_LOGW(TAG, "WebSocket program execution failed");
+        return ws_reply(req, WS_OP_EXECUTE, tag, WS_STATUS_FAILED, NULL, 0);
+    }
+
+    uint8_t data[4];
+    bu_write_u32_le(data, sizeof(data), position);
+    return ws_reply(req, WS_OP_EXECUTE, tag, WS_STATUS_OK, data, sizeof(data));
+}
+
+// KEYS: repeated [modifier u8][count u8][keycodes] -> [reports sent u8]. Reports are
+// sent as soon as possible, but they join the keyboard queue behind those a running
+// program has already scheduled (up to 50ms ahead), so they can land between its
+// reports, e.g. in the middle of a chord.
+static esp_err_t ws_keys_request(httpd_req_t *req,
+                                 uint8_t tag,
+                                 const uint8_t *payload,
+                                 size_t payload_len) {
+    // Check the whole frame first, so a malformed one sends nothing
+    size_t offset = 0;
+    while (offset < payload_len) {
+        if (payload_len - offset < 2 || payload[offset + 1] > USB_KEYBOARD_MAX_KEYS ||
+            payload_len - offset - 2 < payload[offset + 1]) {
+            return ws_reply(req, WS_OP_KEYS, tag, WS_STATUS_BAD_REQUEST, NULL, 0);
+        }
+        offset += 2 + payload[offset + 1];
+    }
+
+    uint8_t sent = 0;
+    uint8_t status = WS_STATUS_OK;
+    for (offset = 0; offset < payload_len; offset += 2 + payload[offset + 1]) {
+        if (!usb_keyboard_send_keys(
+                payload[offset], payload + offset + 2, payload[offset + 1])) {
+            ESP_LOGW(TAG, "Keyboard queue full, dropping WebSocket key reports");
+            status = WS_STATUS_BUSY;
+            break;
+        }
+        sent++;
+    }
+    return ws_reply(req, WS_OP_KEYS, tag, status, &sent, sizeof(sent));
+}
+
+// STATUS: -> [running u8][queue length u32][selected flash u32][selected ram u32]
+static esp_err_t ws_status_request(httpd_req_t *req, uint8_t tag) {
+    uint8_t data[13];
+    data[0] = program_is_running() ? 1 : 0;
+    bu_write_u32_le(data + 1, 4, program_get_queue_length());
+    bu_write_u32_le(data + 5, 4, program_get_selected(PROGRAM_TYPE_FLASH));
+    bu_write_u32_le(data + 9, 4, program_get_selected(PROGRAM_TYPE_RAM));
+    return ws_reply(req, WS_OP_STATUS, tag, WS_STATUS_OK, data, sizeof(data));
+}
+
+// WebSocket control channel - GET /api/ws
+static esp_err_t ws_handler(httpd_req_t *req) {
+    // The server has completed the handshake; the client authorizes with AUTH
+    if (req->method == HTTP_GET) {
+        ESP_LOGI(TAG, "WebSocket client connected");
+        return ESP_OK;
+    }
+
+    uint8_t request[HTTP_SERVICE_WS_MAX_FRAME_SIZE];
+    httpd_ws_frame_t frame = {.type = HTTPD_WS_TYPE_BINARY, .payload = NULL};
+    if (httpd_ws_recv_frame(req, &frame, 0) != ESP_OK) {
+        ESP_LOGW(TAG, "Failed to receive WebSocket frame");
+        return ESP_FAIL;
+    }
+    if (frame.type != HTTPD_WS_TYPE_BINARY || frame.len < WS_REQUEST_HEADER_SIZE ||
+        frame.len > sizeof(request)) {
+        ESP_LOGW(TAG,
+                 "Invalid WebSocket frame (type %d, %lu bytes)",
+                 frame.type,
+                 (unsigned long)frame.len);
+        return ESP_FAIL;
+    }
+    frame.payload = request;
+    if (httpd_ws_recv_frame(req, &frame, sizeof(request)) != ESP_OK) {
+        ESP_LOGW(TAG, "Failed to receive WebSocket frame");
+        return ESP_FAIL;
+    }
+
+    uint8_t op = request[0];
+    uint8_t tag = request[1];
+    const uint8_t *payload = request + WS_REQUEST_HEADER_SIZE;
+    size_t payload_len = frame.len - WS_REQUEST_HEADER_SIZE;
+
+    if (op == WS_OP_AUTH) {
+        return ws_auth_request(req, tag, payload, payload_len);
+    }
+    if (req->sess_ctx != &g_ws_authorized) {
+        ESP_LOGW(TAG, "WebSocket request before AUTH");
+        ws_reply(req, op, tag, WS_STATUS_UNAUTHORIZED, NULL, 0);
+        return ESP_FAIL;
+    }
+
+    switch (op) {
+    case WS_OP_EXECUTE:
+        return ws_execute_request(req, tag, payload, payload_len);
+    case WS_OP_HALT:
+        return ws_reply(
+            req, op, tag, program_halt() ? WS_STATUS_OK : WS_STATUS_FAILED, NULL, 0);
+    case WS_OP_KEYS:
+        return ws_keys_request(req, tag, payload, payload_len);
+    case WS_OP_STATUS:
+        return ws_status_request(req, tag);
+    default:
+        return ws_reply(req, op, tag, WS_STATUS_BAD_REQUEST, NULL, 0);
+    }
+}
+
+// Worker task: runs queued requests with its own buffers
+static void http_worker_task(void *pvParameters) {
+    http_buffers_t *buffers = (http_buffers_t *)pvParameters;
+
+    http_job_t job;
+    for (;;) {
+        if (xQueueReceive(g_job_queue, &job, portMAX_DELAY) != pdTRUE) {
+            continue;
+        }
+
+        // Handlers find the buffers through the request (see request_buffers)
+        httpd_req_t *req = job.req;
+        req->user_ctx = buffers;
+
+        esp_err_t ret;
+        if (job.route->writes_program &&
+            xSemaphoreTake(g_program_write_mutex, 0) != pdTRUE) {
+            ESP_LOGW(TAG, "Program write rejected, another one is in progress");
+            httpd_resp_set_status(req, "409 Conflict");
+            httpd_resp_set_type(req, "application/json");
+            httpd_resp_send(req,
+                            "{\"error\":\"Another program write is in progress\"}",
+                            HTTPD_RESP_USE_STRLEN);
+            ret = ESP_OK;
+        } else {
+            ret = job.route->handler(req);
+            if (job.route->writes_program) {
+                xSemaphoreGive(g_program_write_mutex);
+            }
+        }
+
+        // Like the server does for synchronous handlers, close the connection of a
+        // failed request, since its body may not have been read
+        if (ret != ESP_OK) {
+            httpd_sess_trigger_close(req->handle, httpd_req_to_sockfd(req));
+        }
+        httpd_req_async_handler_complete(req);
+    }
+}
+
+// Handler registered for every worker route; queues the request for a worker
+static esp_err_t dispatch_request(httpd_req_t *req) {
+    http_job_t job = {.req = NULL, .route = (const http_route_t *)req->user_ctx};
+
+    if (uxQueueSpacesAvailable(g_job_queue) == 0) {
+        ESP_LOGW(TAG, "All HTTP workers busy, rejecting request");
+        httpd_resp_set_status(req, "503 Service Unavailable");
+        httpd_resp_set_type(req, "application/json");
+        httpd_resp_send(req, "{\"error\":\"Server busy\"}", HTTPD_RESP_USE_STRLEN);
+        return ESP_FAIL;
+    }
+
+    if (httpd_req_async_handler_begin(req, &job.req) != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to queue HTTP request");
+        httpd_resp_set_status(req, "500 Internal Server Error");
+        httpd_resp_set_type(req, "application/json");
+        httpd_resp_send(
+            req, "{\"error\":\"Failed to queue request\"}", HTTPD_RESP_USE_STRLEN);
+        return ESP_FAIL;
+    }
+
+    // Only this task queues jobs, so the space checked above is still free
+    xQueueSend(g_job_queue, &job, 0);
     return ESP_OK;
 }
 
+// Requests run on the worker pool (see dispatch_request)
+static http_route_t g_flash_program_upload_route = {
+    .handler = flash_program_upload_handler, .writes_program = true};
+static http_route_t g_flash_program_download_route = {
+    .handler = flash_program_download_handler, .writes_program = false};
+static http_route_t g_flash_program_delete_route = {
+    .handler = flash_program_delete_handler, .writes_program = true};
+static http_route_t g_flash_program_pages_route = {
+    .handler = flash_program_pages_handler, .writes_program = false};
+static http_route_t g_flash_program_patch_route = {
+    .handler = flash_program_patch_handler, .writes_program = true};
+static http_route_t g_flash_program_execute_route = {
+    .handler = flash_program_execute_handler, .writes_program = false};
+static http_route_t g_flash_program_list_route = {
+    .handler = flash_program_list_handler, .writes_program = false};
+static http_route_t g_flash_program_select_route = {
+    .handler = flash_program_select_handler, .writes_program = true};
+static http_route_t g_ram_program_upload_route = {
+    .handler = ram_program_upload_handler, .writes_program = true};
+static http_route_t g_ram_program_download_route = {
+    .handler = ram_program_download_handler, .writes_program = false};
+static http_route_t g_ram_program_delete_route = {
+    .handler = ram_program_delete_handler, .writes_program = true};
+static http_route_t g_ram_program_execute_route = {
+    .handler = ram_program_execute_handler, .writes_program = false};
+static http_route_t g_log_download_route = {
+    .handler = log_download_handler, .writes_program = false};
+static http_route_t g_log_delete_route = {
+    .handler = log_delete_handler, .writes_program = false};
+static http_route_t g_boot_status_route = {
+    .handler = boot_status_handler, .writes_program = false};
+static http_route_t g_stats_get_route = {
+    .handler = stats_get_handler, .writes_program = false};
+static http_route_t g_stats_delete_route = {
+    .handler = stats_delete_handler, .writes_program = false};
+static http_route_t g_profile_get_route = {
+    .handler = profile_get_handler, .writes_program = false};
+static http_route_t g_profile_delete_route = {
+    .handler = profile_delete_handler, .writes_program = false};
+static http_route_t g_nvs_get_route = {
+    .handler = nvs_get_handler, .writes_program = false};
+static http_route_t g_nvs_set_route = {
+    .handler = nvs_set_handler, .writes_program = false};
+static http_route_t g_nvs_delete_route = {
+    .handler = nvs_delete_handler, .writes_program = false};
+// Batches can select a library program, so they are serialized with program writes
+static http_route_t g_batch_route = {.handler = batch_handler, .writes_program = true};
+
+// Create the request workers and their buffers
+static bool start_workers(void) {
+    g_worker_buffers = heap_caps_malloc(
+        HTTP_SERVICE_WORKER_COUNT * sizeof(http_buffers_t), MALLOC_CAP_SPIRAM);
+    if (g_worker_buffers == NULL) {
+        ESP_LOGE(TAG, "Failed to allocate HTTP worker buffers in PSRAM");
+        return false;
+    }
+
+    g_inflate = heap_caps_malloc(sizeof(http_inflate_t), MALLOC_CAP_SPIRAM);
+    if (g_inflate == NULL) {
+        ESP_LOGE(TAG, "Failed to allocate gzip inflate state in PSRAM");
+        return false;
+    }
+
+    g_program_write_mutex = xSemaphoreCreateMutex();
+    if (g_program_write_mutex == NULL) {
+        ESP_LOGE(TAG, "Failed to create program write mutex");
+        return false;
+    }
+
+    // Each open connection has at most one request in flight
+    g_job_queue = xQueueCreate(HTTP_SERVICE_MAX_OPEN_SOCKETS, sizeof(http_job_t));
+    if (g_job_queue == NULL) {
+        ESP_LOGE(TAG, "Failed to create HTTP job queue");
+        return false;
+    }
+
+    for (int i = 0; i < HTTP_SERVICE_WORKER_COUNT; i++) {
+        if (xTaskCreate(http_worker_task,
+                        "http_worker",
+                        HTTP_SERVICE_WORKER_STACK_SIZE,
+                        &g_worker_buffers[i],
+                        HTTP_SERVICE_WORKER_PRIORITY,
+                        NULL) != pdPASS) {
+            ESP_LOGE(TAG, "Failed to create HTTP worker task");
+            return false;
+        }
+    }
+    return true;
+}
+
 // WiFi event handler for HTTP service
 static void http_service_wifi_event_handler(void *arg,
                                             esp_event_base_t event_base,
@@ -1108,6 +2660,11 @@ bool http_service_init(void) {
         return false;
     }
     ESP_LOGI(TAG, "HTTP service configuration loaded");
+    nvs_config_add_change_callback(NVS_KEY_HTTP_API_KEY, api_key_changed, NULL);
+
+    if (!start_workers()) {
+        return false;
+    }
 
     // Register event handlers
     esp_err_t ret =
@@ -1154,10 +2711,12 @@ static esp_err_t start_http_service(void) {
     config.max_resp_headers = HTTP_SERVICE_MAX_RESP_HEADERS;
     config.max_open_sockets = HTTP_SERVICE_MAX_OPEN_SOCKETS;
     config.uri_match_fn = httpd_uri_match_wildcard;
+    config.lru_purge_enable = true;
 
-    ESP_LOGI(
-        TAG,
-        "HTTP server configured for single connection (prevents concurrent uploads)");
+    ESP_LOGI(TAG,
+             "HTTP server configured for %d connections and %d workers",
+             HTTP_SERVICE_MAX_OPEN_SOCKETS,
+             HTTP_SERVICE_WORKER_COUNT);
 
     // Start the httpd service
     ESP_LOGI(TAG, "Starting HTTP service on port %d", config.server_port);
@@ -1171,8 +2730,8 @@ static esp_err_t start_http_service(void) {
     // Flash program management endpoints
     httpd_uri_t program_upload_uri = {.uri = "/api/program/flash",
                                       .method = HTTP_POST,
-                                      .handler = flash_program_upload_handler,
-                                      .user_ctx = NULL};
+                                      .handler = dispatch_request,
+                                      .user_ctx = &g_flash_program_upload_route};
     if (httpd_register_uri_handler(g_service, &program_upload_uri) != ESP_OK) {
         ESP_LOGE(TAG, "Failed to register flash program upload URI");
         httpd_stop(g_service);
@@ -1182,8 +2741,8 @@ static esp_err_t start_http_service(void) {
 
     httpd_uri_t program_download_uri = {.uri = "/api/program/flash",
                                         .method = HTTP_GET,
-                                        .handler = flash_program_download_handler,
-                                        .user_ctx = NULL};
+                                        .handler = dispatch_request,
+                                        .user_ctx = &g_flash_program_download_route};
     if (httpd_register_uri_handler(g_service, &program_download_uri) != ESP_OK) {
         ESP_LOGE(TAG, "Failed to register flash program download URI");
         httpd_stop(g_service);
@@ -1193,8 +2752,8 @@ static esp_err_t start_http_service(void) {
 
     httpd_uri_t program_delete_uri = {.uri = "/api/program/flash",
                                       .method = HTTP_DELETE,
-                                      .handler = flash_program_delete_handler,
-                                      .user_ctx = NULL};
+                                      .handler = dispatch_request,
+                                      .user_ctx = &g_flash_program_delete_route};
     if (httpd_register_uri_handler(g_service, &program_delete_uri) != ESP_OK) {
         ESP_LOGE(TAG, "Failed to register flash program delete URI");
         httpd_stop(g_service);
@@ -1202,10 +2761,33 @@ static esp_err_t start_http_service(void) {
         return ESP_FAIL;
     }
 
-    httpd_uri_t flash_program_execute_uri = {.uri = "/api/program/flash/execute",
-                                             .method = HTTP_POST,
-                                             .handler = flash_program_execute_handler,
-                                             .user_ctx = NULL};
+    httpd_uri_t flash_program_pages_uri = {.uri = "/api/program/flash/pages",
+                                           .method = HTTP_GET,
+                                           .handler = dispatch_request,
+                                           .user_ctx = &g_flash_program_pages_route};
+    if (httpd_register_uri_handler(g_service, &flash_program_pages_uri) != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to register flash program pages URI");
+        httpd_stop(g_service);
+        g_service = NULL;
+        return ESP_FAIL;
+    }
+
+    httpd_uri_t flash_program_patch_uri = {.uri = "/api/program/flash/patch",
+                                           .method = HTTP_POST,
+                                           .handler = dispatch_request,
+                                           .user_ctx = &g_flash_program_patch_route};
+    if (httpd_register_uri_handler(g_service, &flash_program_patch_uri) != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to register flash program patch URI");
+        httpd_stop(g_service);
+        g_service = NULL;
+        return ESP_FAIL;
+    }
+
+    httpd_uri_t flash_program_execute_uri = {
+        .uri = "/api/program/flash/execute",
+        .method = HTTP_POST,
+        .handler = dispatch_request,
+        .user_ctx = &g_flash_program_execute_route};
     if (httpd_register_uri_handler(g_service, &flash_program_execute_uri) != ESP_OK) {
         ESP_LOGE(TAG, "Failed to register flash program execute URI");
         httpd_stop(g_service);
@@ -1213,11 +2795,33 @@ static esp_err_t start_http_service(void) {
         return ESP_FAIL;
     }
 
+    httpd_uri_t flash_program_list_uri = {.uri = "/api/program/flash/programs",
+                                          .method = HTTP_GET,
+                                          .handler = dispatch_request,
+                                          .user_ctx = &g_flash_program_list_route};
+    if (httpd_register_uri_handler(g_service, &flash_program_list_uri) != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to register flash program list URI");
+        httpd_stop(g_service);
+        g_service = NULL;
+        return ESP_FAIL;
+    }
+
+    httpd_uri_t flash_program_select_uri = {.uri = "/api/program/flash/select",
+                                            .method = HTTP_POST,
+                                            .handler = dispatch_request,
+                                            .user_ctx = &g_flash_program_select_route};
+    if (httpd_register_uri_handler(g_service, &flash_program_select_uri) != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to register flash program select URI");
+        httpd_stop(g_service);
+        g_service = NULL;
+        return ESP_FAIL;
+    }
+
     // RAM program management endpoints
     httpd_uri_t ram_program_upload_uri = {.uri = "/api/program/ram",
                                           .method = HTTP_POST,
-                                          .handler = ram_program_upload_handler,
-                                          .user_ctx = NULL};
+                                          .handler = dispatch_request,
+                                          .user_ctx = &g_ram_program_upload_route};
     if (httpd_register_uri_handler(g_service, &ram_program_upload_uri) != ESP_OK) {
         ESP_LOGE(TAG, "Failed to register RAM program upload URI");
         httpd_stop(g_service);
@@ -1227,8 +2831,8 @@ static esp_err_t start_http_service(void) {
 
     httpd_uri_t ram_program_download_uri = {.uri = "/api/program/ram",
                                             .method = HTTP_GET,
-                                            .handler = ram_program_download_handler,
-                                            .user_ctx = NULL};
+                                            .handler = dispatch_request,
+                                            .user_ctx = &g_ram_program_download_route};
     if (httpd_register_uri_handler(g_service, &ram_program_download_uri) != ESP_OK) {
         ESP_LOGE(TAG, "Failed to register RAM program download URI");
         httpd_stop(g_service);
@@ -1238,8 +2842,8 @@ static esp_err_t start_http_service(void) {
 
     httpd_uri_t ram_program_delete_uri = {.uri = "/api/program/ram",
                                           .method = HTTP_DELETE,
-                                          .handler = ram_program_delete_handler,
-                                          .user_ctx = NULL};
+                                          .handler = dispatch_request,
+                                          .user_ctx = &g_ram_program_delete_route};
     if (httpd_register_uri_handler(g_service, &ram_program_delete_uri) != ESP_OK) {
         ESP_LOGE(TAG, "Failed to register RAM program delete URI");
         httpd_stop(g_service);
@@ -1249,8 +2853,8 @@ static esp_err_t start_http_service(void) {
 
     httpd_uri_t ram_program_execute_uri = {.uri = "/api/program/ram/execute",
                                            .method = HTTP_POST,
-                                           .handler = ram_program_execute_handler,
-                                           .user_ctx = NULL};
+                                           .handler = dispatch_request,
+                                           .user_ctx = &g_ram_program_execute_route};
     if (httpd_register_uri_handler(g_service, &ram_program_execute_uri) != ESP_OK) {
         ESP_LOGE(TAG, "Failed to register RAM program execute URI");
         httpd_stop(g_service);
@@ -1261,8 +2865,8 @@ static esp_err_t start_http_service(void) {
     // Log download endpoint
     httpd_uri_t log_download_uri = {.uri = "/api/logs",
                                     .method = HTTP_GET,
-                                    .handler = log_download_handler,
-                                    .user_ctx = NULL};
+                                    .handler = dispatch_request,
+                                    .user_ctx = &g_log_download_route};
     if (httpd_register_uri_handler(g_service, &log_download_uri) != ESP_OK) {
         ESP_LOGE(TAG, "Failed to register log download URI");
         httpd_stop(g_service);
@@ -1270,11 +2874,23 @@ static esp_err_t start_http_service(void) {
         return ESP_FAIL;
     }
 
+    // Log stream endpoint
+    httpd_uri_t log_stream_uri = {.uri = "/api/logs/stream",
+                                  .method = HTTP_GET,
+                                  .handler = log_stream_handler,
+                                  .user_ctx = NULL};
+    if (httpd_register_uri_handler(g_service, &log_stream_uri) != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to register log stream URI");
+        httpd_stop(g_service);
+        g_service = NULL;
+        return ESP_FAIL;
+    }
+
     // Log delete endpoint
     httpd_uri_t log_delete_uri = {.uri = "/api/logs",
                                   .method = HTTP_DELETE,
-                                  .handler = log_delete_handler,
-                                  .user_ctx = NULL};
+                                  .handler = dispatch_request,
+                                  .user_ctx = &g_log_delete_route};
     if (httpd_register_uri_handler(g_service, &log_delete_uri) != ESP_OK) {
         ESP_LOGE(TAG, "Failed to register log delete URI");
         httpd_stop(g_service);
@@ -1282,11 +2898,69 @@ static esp_err_t start_http_service(void) {
         return ESP_FAIL;
     }
 
+    // Boot timing endpoint
+    httpd_uri_t boot_status_uri = {.uri = "/api/boot",
+                                   .method = HTTP_GET,
+                                   .handler = dispatch_request,
+                                   .user_ctx = &g_boot_status_route};
+    if (httpd_register_uri_handler(g_service, &boot_status_uri) != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to register boot status URI");
+        httpd_stop(g_service);
+        g_service = NULL;
+        return ESP_FAIL;
+    }
+
+    // Latency statistics endpoints
+    httpd_uri_t stats_get_uri = {.uri = "/api/stats",
+                                 .method = HTTP_GET,
+                                 .handler = dispatch_request,
+                                 .user_ctx = &g_stats_get_route};
+    if (httpd_register_uri_handler(g_service, &stats_get_uri) != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to register stats URI");
+        httpd_stop(g_service);
+        g_service = NULL;
+        return ESP_FAIL;
+    }
+
+    httpd_uri_t stats_delete_uri = {.uri = "/api/stats",
+                                    .method = HTTP_DELETE,
+                                    .handler = dispatch_request,
+                                    .user_ctx = &g_stats_delete_route};
+    if (httpd_register_uri_handler(g_service, &stats_delete_uri) != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to register stats reset URI");
+        httpd_stop(g_service);
+        g_service = NULL;
+        return ESP_FAIL;
+    }
+
+    // VM profile endpoints
+    httpd_uri_t profile_get_uri = {.uri = "/api/profile",
+                                   .method = HTTP_GET,
+                                   .handler = dispatch_request,
+                                   .user_ctx = &g_profile_get_route};
+    if (httpd_register_uri_handler(g_service, &profile_get_uri) != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to register profile URI");
+        httpd_stop(g_service);
+        g_service = NULL;
+        return ESP_FAIL;
+    }
+
+    httpd_uri_t profile_delete_uri = {.uri = "/api/profile",
+                                      .method = HTTP_DELETE,
+                                      .handler = dispatch_request,
+                                      .user_ctx = &g_profile_delete_route};
+    if (httpd_register_uri_handler(g_service, &profile_delete_uri) != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to register profile reset URI");
+        httpd_stop(g_service);
+        g_service = NULL;
+        return ESP_FAIL;
+    }
+
     // NVS management endpoints
     httpd_uri_t nvs_get_uri = {.uri = "/api/nvs/*",
                                .method = HTTP_GET,
-                               .handler = nvs_get_handler,
-                               .user_ctx = NULL};
+                               .handler = dispatch_request,
+                               .user_ctx = &g_nvs_get_route};
     if (httpd_register_uri_handler(g_service, &nvs_get_uri) != ESP_OK) {
         ESP_LOGE(TAG, "Failed to register NVS get URI");
         httpd_stop(g_service);
@@ -1296,8 +2970,8 @@ static esp_err_t start_http_service(void) {
 
     httpd_uri_t nvs_set_uri = {.uri = "/api/nvs/*",
                                .method = HTTP_POST,
-                               .handler = nvs_set_handler,
-                               .user_ctx = NULL};
+                               .handler = dispatch_request,
+                               .user_ctx = &g_nvs_set_route};
     if (httpd_register_uri_handler(g_service, &nvs_set_uri) != ESP_OK) {
         ESP_LOGE(TAG, "Failed to register NVS set URI");
         httpd_stop(g_service);
@@ -1307,8 +2981,8 @@ static esp_err_t start_http_service(void) {
 
     httpd_uri_t nvs_delete_uri = {.uri = "/api/nvs/*",
                                   .method = HTTP_DELETE,
-                                  .handler = nvs_delete_handler,
-                                  .user_ctx = NULL};
+                                  .handler = dispatch_request,
+                                  .user_ctx = &g_nvs_delete_route};
     if (httpd_register_uri_handler(g_service, &nvs_delete_uri) != ESP_OK) {
         ESP_LOGE(TAG, "Failed to register NVS delete URI");
         httpd_stop(g_service);
@@ -1316,6 +2990,31 @@ static esp_err_t start_http_service(void) {
         return ESP_FAIL;
     }
 
+    // Batch endpoint
+    httpd_uri_t batch_uri = {.uri = "/api/batch",
+                             .method = HTTP_POST,
+                             .handler = dispatch_request,
+                             .user_ctx = &g_batch_route};
+    if (httpd_register_uri_handler(g_service, &batch_uri) != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to register batch URI");
+        httpd_stop(g_service);
+        g_service = NULL;
+        return ESP_FAIL;
+    }
+
+    // WebSocket control channel, handled on the server task (see ws_handler)
+    httpd_uri_t ws_uri = {.uri = "/api/ws",
+                          .method = HTTP_GET,
+                          .handler = ws_handler,
+                          .user_ctx = NULL,
+                          .is_websocket = true};
+    if (httpd_register_uri_handler(g_service, &ws_uri) != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to register WebSocket URI");
+        httpd_stop(g_service);
+        g_service = NULL;
+        return ESP_FAIL;
+    }
+
     // Add HTTP service to mDNS
     esp_err_t mdns_err = mdns_service_add(
         NULL, "_http", "_tcp", g_http_service_config.service_port, NULL, 0);
@@ -0,0 +1,155 @@
+#include "latency_stats.h"
+#include <stdlib.h>
+#include <string.h>
+#include "esp_attr.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+
+// Recent samples of one stage, as a ring
+typedef struct {
+    uint32_t samples_us[LATENCY_STATS_WINDOW];
+    uint32_t next;   // Ring index of the next sample
+    uint32_t count;  // Samples recorded since boot or the last reset
+} stage_samples_t;
+
+// Stage state and the trace in progress (protected by g_lock)
+static portMUX_TYPE g_lock = portMUX_INITIALIZER_UNLOCKED;
+static stage_samples_t g_stages[LATENCY_STAGE_COUNT];
+static bool g_tracing = false;
+static latency_point_t g_last_point;  // Last point the trace passed
+static int64_t g_last_time_us;        // Time it passed that point
+static bool g_from_button = false;    // The trace started at a button edge
+static int64_t g_button_time_us;      // Time of that edge
+static bool g_from_wake = false;      // That edge woke the CPU from light sleep
+static int64_t g_wake_time_us;        // Time it woke
+static bool g_wake_pending = false;   // A wake not yet claimed by a button edge
+static int64_t g_pending_wake_us;     // Time of that wake
+
+static const char *const g_stage_names[LATENCY_STAGE_COUNT] = {
+    [LATENCY_STAGE_DEBOUNCE] = "debounce",
+    [LATENCY_STAGE_QUEUE] = "queue",
+    [LATENCY_STAGE_VM] = "vm",
+    [LATENCY_STAGE_KEYBOARD] = "keyboard",
+    [LATENCY_STAGE_USB] = "usb",
+    [LATENCY_STAGE_TOTAL] = "total",
+    [LATENCY_STAGE_WAKE] = "wake",
+};
+
+// Add a sample to a stage (g_lock held)
+static void IRAM_ATTR record_sample_unsafe(latency_stage_t stage, int64_t elapsed_us) {
+    stage_samples_t *samples = &g_stages[stage];
+    samples->samples_us[samples->next] =
+        (elapsed_us > UINT32_MAX) ? UINT32_MAX : (uint32_t)elapsed_us;
+    samples->next = (samples->next + 1) % LATENCY_STATS_WINDOW;
+    samples->count++;
+}
+
+// Start a new trace at a point (g_lock held)
+static void IRAM_ATTR start_trace_unsafe(latency_point_t point, int64_t now_us) {
+    g_tracing = true;
+    g_last_point = point;
+    g_last_time_us = now_us;
+    g_from_button = (point == LATENCY_POINT_BUTTON);
+    g_button_time_us = now_us;
+
+    // Only the edge that caused a wake is timed from it
+    g_from_wake = g_from_button && g_wake_pending &&
+                  now_us - g_pending_wake_us <= LATENCY_STATS_WAKE_WINDOW_US;
+    g_wake_time_us = g_pending_wake_us;
+    g_wake_pending = false;
+}
+
+void IRAM_ATTR latency_stats_mark_wake(void) {
+    int64_t now_us = esp_timer_get_time();
+
+    portENTER_CRITICAL_SAFE(&g_lock);
+    g_wake_pending = true;
+    g_pending_wake_us = now_us;
+    portEXIT_CRITICAL_SAFE(&g_lock);
+}
+
+bool IRAM_ATTR latency_stats_mark(latency_point_t point) {
+    if (point >= LATENCY_POINT_COUNT) {
+        return false;
+    }
+
+    int64_t now_us = esp_timer_get_time();
+    bool recorded = true;
+
+    portENTER_CRITICAL_SAFE(&g_lock);
+    if (point == LATENCY_POINT_BUTTON) {
+        start_trace_unsafe(point, now_us);
+    } else if (g_tracing && g_last_point == point - 1) {
+        // The stage ending at a point has the index of the point before it
+        record_sample_unsafe((latency_stage_t)(point - 1), now_us - g_last_time_us);
+        g_last_point = point;
+        g_last_time_us = now_us;
+        if (point == LATENCY_POINT_REPORT_DONE) {
+            if (g_from_button) {
+                record_sample_unsafe(LATENCY_STAGE_TOTAL, now_us - g_button_time_us);
+            }
+            if (g_from_wake) {
+                record_sample_unsafe(LATENCY_STAGE_WAKE, now_us - g_wake_time_us);
+            }
+            g_tracing = false;
+        }
+    } else if (point == LATENCY_POINT_EXECUTE) {
+        // A run that wasn't started by the button (or a button auto-repeat)
+        start_trace_unsafe(point, now_us);
+    } else {
+        recorded = false;
+    }
+    portEXIT_CRITICAL_SAFE(&g_lock);
+
+    return recorded;
+}
+
+static int compare_u32(const void *a, const void *b) {
+    uint32_t x = *(const uint32_t *)a;
+    uint32_t y = *(const uint32_t *)b;
+    return (x > y) - (x < y);
+}
+
+bool latency_stats_get(latency_stage_t stage, latency_summary_t *out_summary) {
+    if (stage >= LATENCY_STAGE_COUNT || out_summary == NULL) {
+        return false;
+    }
+
+    // Copy the samples out so sorting them doesn't hold the lock
+    uint32_t sorted[LATENCY_STATS_WINDOW];
+    memset(out_summary, 0, sizeof(*out_summary));
+    portENTER_CRITICAL(&g_lock);
+    const stage_samples_t *samples = &g_stages[stage];
+    uint32_t n = (samples->count < LATENCY_STATS_WINDOW) ? samples->count
+                                                          : LATENCY_STATS_WINDOW;
+    memcpy(sorted, samples->samples_us, n * sizeof(uint32_t));
+    out_summary->count = samples->count;
+    portEXIT_CRITICAL(&g_lock);
+
+    out_summary->samples = n;
+    if (n == 0) {
+        return true;
+    }
+
+    qsort(sorted, n, sizeof(uint32_t), compare_u32);
+    out_summary->min_us = sorted[0];
+    out_summary->p50_us = sorted[(n - 1) * 50 / 100];
+    out_summary->p99_us = sorted[(n - 1) * 99 / 100];
+    out_summary->max_us = sorted[n - 1];
+    return true;
+}
+
+const char *latency_stats_stage_name(latency_stage_t stage) {
+    if (stage >= LATENCY_STAGE_COUNT) {
+        return "unknown";
+    }
+    return g_stage_names[stage];
+}
+
+void latency_stats_reset(void) {
+    portENTER_CRITICAL(&g_lock);
+    memset(g_stages, 0, sizeof(g_stages));
+    g_tracing = false;
+    g_wake_pending = false;
+    portEXIT_CRITICAL(&g_lock);
+}
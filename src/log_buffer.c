@@ -1,30 +1,573 @@
 #include "log_buffer.h"
 #include <stdarg.h>
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <string.h>
 #include "esp_heap_caps.h"
 #include "esp_log.h"
+#include "esp_memory_utils.h"
 #include "freertos/FreeRTOS.h"
 #include "freertos/semphr.h"
+#include "nvs_config.h"
+#include "nvs_odkey.h"
 
 static const char *TAG = "log_buffer";
 
-// Log buffer size: 32KB (now using PSRAM)
+// Log buffer size: 32KB (now using PSRAM). Must be a multiple of the record alignment.
 #define LOG_BUFFER_SIZE (32 * 1024)
 
-// Ring buffer for storing logs (allocated in PSRAM)
+// Log records in the ring: an 8-byte header followed by the payload, padded so the
+// next header is 8-byte aligned and never wraps around the end of the ring. Text
+// records hold the formatted line. Binary records hold the format string pointer and
+// the raw arguments, and are only formatted when they are read.
+#define LOG_RECORD_MAGIC 0x4C52         // "RL"
+#define LOG_RECORD_MAGIC_BINARY 0x4C42  // "BL"
+#define LOG_RECORD_ALIGN 8
+#define LOG_RECORD_HEADER_SIZE 8
+
+// Format buffers, claimed per log call so concurrent callers never share one. A call
+// that finds them all in use drops its record instead of waiting.
+#define LOG_FORMAT_SLOTS 8
+#define LOG_FORMAT_SLOT_SIZE 512
+
+// Longest single conversion specification that binary records can render
+#define LOG_SPEC_MAX_LENGTH 24
+
+// Marks a binary string argument stored as a pointer into flash instead of inline
+#define LOG_STRING_POINTER 0xFFFF
+
+typedef struct {
+    _Atomic uint32_t pos;  // Ring position of this record; written last to commit it
+    uint16_t length;       // Payload length in bytes
+    uint16_t magic;
+} log_record_header_t;
+
+// Argument types of printf conversions, as read with va_arg
+typedef enum {
+    LOG_ARG_NONE,  // "%%"
+    LOG_ARG_INT,
+    LOG_ARG_LONG,
+    LOG_ARG_LONG_LONG,
+    LOG_ARG_SIZE,
+    LOG_ARG_INTMAX,
+    LOG_ARG_PTRDIFF,
+    LOG_ARG_DOUBLE,
+    LOG_ARG_POINTER,
+    LOG_ARG_STRING,
+    LOG_ARG_UNSUPPORTED,
+} log_arg_type_t;
+
+// Ring buffer for storing logs (allocated in PSRAM). Positions are free-running byte
+// counts, so unsigned differences stay correct across 32-bit wraparound.
 static uint8_t *g_log_buffer = NULL;
-static uint32_t g_write_pos = 0;
-static uint32_t g_read_pos = 0;
-static bool g_buffer_full = false;  // Distinguish between full and empty states
-static SemaphoreHandle_t g_buffer_mutex = NULL;
+static _Atomic uint32_t g_head = 0;       // End of the last reserved record
+static _Atomic uint32_t g_clear_pos = 0;  // Records before this were cleared
+static _Atomic uint32_t g_dropped = 0;    // Records dropped for lack of a buffer
 
-// Global buffer for log formatting
-static char g_log_format_buffer[2 * 1024];
+// Reader state (protected by g_read_mutex; writers never take it)
+static SemaphoreHandle_t g_read_mutex = NULL;
+static log_buffer_cursor_t g_read_cursor = {0};  // Used by log_buffer_read_chunk
+
+// Text of the binary record at g_rendered_pos (protected by g_read_mutex)
+static uint8_t g_render_payload[LOG_FORMAT_SLOT_SIZE];
+static char g_render_text[LOG_FORMAT_SLOT_SIZE];
+static bool g_rendered = false;
+static uint32_t g_rendered_pos = 0;
+static uint32_t g_rendered_length = 0;
+static uint32_t g_rendered_stored_length = 0;
+
+// Store new records in binary form (see log_buffer_load_settings)
+static _Atomic bool g_binary_mode = false;
+
+static char g_format_slots[LOG_FORMAT_SLOTS][LOG_FORMAT_SLOT_SIZE];
+static _Atomic uint32_t g_format_slots_in_use = 0;
 
 // Store the original vprintf function
 static vprintf_like_t g_original_vprintf = NULL;
 
+static uint32_t record_total_size(uint32_t length) {
+    return (LOG_RECORD_HEADER_SIZE + length + LOG_RECORD_ALIGN - 1) &
+           ~(uint32_t)(LOG_RECORD_ALIGN - 1);
+}
+
+static log_record_header_t *record_header(uint32_t pos) {
+    return (log_record_header_t *)&g_log_buffer[pos % LOG_BUFFER_SIZE];
+}
+
+// Copy between a linear buffer and the ring starting at a ring position, in at most
+// two pieces
+static void ring_copy_in(uint32_t pos, const void *data, uint32_t length) {
+    uint32_t offset = pos % LOG_BUFFER_SIZE;
+    uint32_t first = LOG_BUFFER_SIZE - offset;
+    if (first > length) {
+        first = length;
+    }
+    memcpy(&g_log_buffer[offset], data, first);
+    memcpy(g_log_buffer, (const uint8_t *)data + first, length - first);
+}
+
+static void ring_copy_out(uint32_t pos, void *data, uint32_t length) {
+    uint32_t offset = pos % LOG_BUFFER_SIZE;
+    uint32_t first = LOG_BUFFER_SIZE - offset;
+    if (first > length) {
+        first = length;
+    }
+    memcpy(data, &g_log_buffer[offset], first);
+    memcpy((uint8_t *)data + first, g_log_buffer, length - first);
+}
+
+static int claim_format_slot(void) {
+    uint32_t in_use = atomic_load(&g_format_slots_in_use);
+    for (;;) {
+        uint32_t free_slots = ~in_use & ((1u << LOG_FORMAT_SLOTS) - 1);
+        if (free_slots == 0) {
+            return -1;
+        }
+        int slot = __builtin_ctz(free_slots);
+        if (atomic_compare_exchange_weak(
+                &g_format_slots_in_use, &in_use, in_use | (1u << slot))) {
+            return slot;
+        }
+    }
+}
+
+static void release_format_slot(int slot) {
+    atomic_fetch_and(&g_format_slots_in_use, ~(1u << slot));
+}
+
+// Append a record. Writers reserve space with a single atomic add, so they never wait
+// for each other; the oldest records are overwritten. Formatting happens before the
+// reservation, so the window in which a writer could itself be lapped is two short
+// copies.
+static void ring_write(const void *payload, uint32_t length, uint16_t magic) {
+    uint32_t pos = atomic_fetch_add(&g_head, record_total_size(length));
+
+    ring_copy_in(pos + LOG_RECORD_HEADER_SIZE, payload, length);
+
+    log_record_header_t *header = record_header(pos);
+    header->length = (uint16_t)length;
+    header->magic = magic;
+    atomic_store_explicit(&header->pos, pos, memory_order_release);
+}
+
+// Parse the conversion specification following a '%'. Returns a pointer past it, the
+// type of its argument and the number of '*' width/precision arguments before that.
+static const char *parse_spec(const char *p, log_arg_type_t *out_type, int *out_stars) {
+    int stars = 0;
+    while (*p != '\0' && strchr("-+ #0", *p) != NULL) {
+        p++;
+    }
+    for (int field = 0; field < 2; field++) {
+        // Width, then precision
+        if (field == 1) {
+            if (*p != '.') {
+                break;
+            }
+            p++;
+        }
+        if (*p == '*') {
+            stars++;
+            p++;
+        } else {
+            while (*p >= '0' && *p <= '9') {
+                p++;
+            }
+        }
+    }
+
+    log_arg_type_t integer = LOG_ARG_INT;
+    bool length_modified = true;
+    switch (*p) {
+    case 'h':
+        p += (p[1] == 'h') ? 2 : 1;
+        break;
+    case 'l':
+        if (p[1] == 'l') {
+            integer = LOG_ARG_LONG_LONG;
+            p += 2;
+        } else {
+            integer = LOG_ARG_LONG;
+            p++;
+        }
+        break;
+    case 'z':
+        integer = LOG_ARG_SIZE;
+        p++;
+        break;
+    case 'j':
+        integer = LOG_ARG_INTMAX;
+        p++;
+        break;
+    case 't':
+        integer = LOG_ARG_PTRDIFF;
+        p++;
+        break;
+    case 'L':
+        integer = LOG_ARG_UNSUPPORTED;  // long double
+        p++;
+        break;
+    default:
+        length_modified = false;
+        break;
+    }
+
+    *out_stars = stars;
+    switch (*p) {
+    case 'd':
+    case 'i':
+    case 'u':
+    case 'x':
+    case 'X':
+    case 'o':
+        *out_type = integer;
+        break;
+    case 'c':
+        *out_type = length_modified ? LOG_ARG_UNSUPPORTED : LOG_ARG_INT;
+        break;
+    case 'f':
+    case 'F':
+    case 'e':
+    case 'E':
+    case 'g':
+    case 'G':
+    case 'a':
+    case 'A':
+        *out_type = length_modified ? LOG_ARG_UNSUPPORTED : LOG_ARG_DOUBLE;
+        break;
+    case 'p':
+        *out_type = LOG_ARG_POINTER;
+        break;
+    case 's':
+        *out_type = length_modified ? LOG_ARG_UNSUPPORTED : LOG_ARG_STRING;
+        break;
+    case '%':
+        *out_type = (stars == 0) ? LOG_ARG_NONE : LOG_ARG_UNSUPPORTED;
+        break;
+    default:
+        *out_type = LOG_ARG_UNSUPPORTED;  // Including %n
+        return p;
+    }
+    return p + 1;
+}
+
+// Size of an argument's value in a binary record (strings are variable length)
+static uint32_t arg_size(log_arg_type_t type) {
+    switch (type) {
+    case LOG_ARG_INT:
+        return sizeof(int);
+    case LOG_ARG_LONG:
+        return sizeof(long);
+    case LOG_ARG_LONG_LONG:
+        return sizeof(long long);
+    case LOG_ARG_SIZE:
+        return sizeof(size_t);
+    case LOG_ARG_INTMAX:
+        return sizeof(intmax_t);
+    case LOG_ARG_PTRDIFF:
+        return sizeof(ptrdiff_t);
+    case LOG_ARG_DOUBLE:
+        return sizeof(double);
+    case LOG_ARG_POINTER:
+        return sizeof(void *);
+    default:
+        return 0;
+    }
+}
+
+// Encode a log call as a binary record payload: the format string pointer followed by
+// each argument's raw value. Strings in flash (tags, literals) are stored as pointers
+// and others are copied. Returns the payload length, or 0 if the call has to be logged
+// as text instead.
+static uint32_t encode_binary(uint8_t *payload, const char *fmt, va_list args) {
+    if (!esp_ptr_in_drom(fmt)) {
+        return 0;  // The format string might not outlive the call
+    }
+
+    uint32_t length = 0;
+    memcpy(payload, &fmt, sizeof(fmt));
+    length += sizeof(fmt);
+
+    for (const char *p = fmt; *p != '\0';) {
+        if (*p++ != '%') {
+            continue;
+        }
+        log_arg_type_t type;
+        int stars;
+        p = parse_spec(p, &type, &stars);
+        if (type == LOG_ARG_UNSUPPORTED) {
+            return 0;
+        }
+
+        for (int i = 0; i < stars; i++) {
+            int star = va_arg(args, int);
+            if (length + sizeof(star) > LOG_FORMAT_SLOT_SIZE - 1) {
+                return 0;
+            }
+            memcpy(&payload[length], &star, sizeof(star));
+            length += sizeof(star);
+        }
+
+        union {
+            int i;
+            long l;
+            long long ll;
+            size_t z;
+            intmax_t j;
+            ptrdiff_t t;
+            double d;
+            const void *p;
+        } value;
+        switch (type) {
+        case LOG_ARG_NONE:
+            continue;
+        case LOG_ARG_INT:
+            value.i = va_arg(args, int);
+            break;
+        case LOG_ARG_LONG:
+            value.l = va_arg(args, long);
+            break;
+        case LOG_ARG_LONG_LONG:
+            value.ll = va_arg(args, long long);
+            break;
+        case LOG_ARG_SIZE:
+            value.z = va_arg(args, size_t);
+            break;
+        case LOG_ARG_INTMAX:
+            value.j = va_arg(args, intmax_t);
+            break;
+        case LOG_ARG_PTRDIFF:
+            value.t = va_arg(args, ptrdiff_t);
+            break;
+        case LOG_ARG_DOUBLE:
+            value.d = va_arg(args, double);
+            break;
+        case LOG_ARG_POINTER:
+            value.p = va_arg(args, const void *);
+            break;
+        case LOG_ARG_STRING: {
+            const char *string = va_arg(args, const char *);
+            uint16_t marker = LOG_STRING_POINTER;
+            if (string == NULL || esp_ptr_in_drom(string)) {
+                if (length + sizeof(marker) + sizeof(string) >
+                    LOG_FORMAT_SLOT_SIZE - 1) {
+                    return 0;
+                }
+                memcpy(&payload[length], &marker, sizeof(marker));
+                memcpy(&payload[length + sizeof(marker)], &string, sizeof(string));
+                length += sizeof(marker) + sizeof(string);
+                continue;
+            }
+
+            // Strings too long to copy are truncated as text instead
+            uint32_t space = LOG_FORMAT_SLOT_SIZE - 1 - length;
+            if (space <= sizeof(marker)) {
+                return 0;
+            }
+            marker = (uint16_t)strnlen(string, space - sizeof(marker));
+            if (marker == space - sizeof(marker)) {
+                return 0;
+            }
+            memcpy(&payload[length], &marker, sizeof(marker));
+            memcpy(&payload[length + sizeof(marker)], string, marker);
+            length += sizeof(marker) + marker;
+            continue;
+        }
+        default:
+            return 0;
+        }
+
+        uint32_t size = arg_size(type);
+        if (length + size > LOG_FORMAT_SLOT_SIZE - 1) {
+            return 0;
+        }
+        memcpy(&payload[length], &value, size);
+        length += size;
+    }
+    return length;
+}
+
+// Format a single conversion specification with its '*' arguments and value
+#define RENDER_SPEC(text, size, spec, stars, star, value)                             \
+    ((stars) == 0   ? snprintf((text), (size), (spec), (value))                      \
+     : (stars) == 1 ? snprintf((text), (size), (spec), (star)[0], (value))           \
+                    : snprintf((text), (size), (spec), (star)[0], (star)[1], (value)))
+
+// Format a binary record payload into text. Returns the text length (truncated to fit,
+// like text records).
+static uint32_t render_binary(char *text, const uint8_t *payload, uint32_t length) {
+    const uint32_t size = LOG_FORMAT_SLOT_SIZE;
+    const char *fmt;
+    if (length < sizeof(fmt)) {
+        return 0;
+    }
+    memcpy(&fmt, payload, sizeof(fmt));
+    if (!esp_ptr_in_drom(fmt)) {
+        return 0;  // Not a record this firmware wrote
+    }
+
+    uint32_t offset = sizeof(fmt);
+    uint32_t out = 0;
+    const char *p = fmt;
+    while (*p != '\0' && out < size - 1) {
+        if (*p != '%') {
+            text[out++] = *p++;
+            continue;
+        }
+
+        const char *spec_start = p;
+        log_arg_type_t type;
+        int stars;
+        p = parse_spec(p + 1, &type, &stars);
+        uint32_t spec_length = (uint32_t)(p - spec_start);
+        if (type == LOG_ARG_UNSUPPORTED || spec_length >= LOG_SPEC_MAX_LENGTH) {
+            break;  // Never encoded, so the record is damaged
+        }
+        if (type == LOG_ARG_NONE) {
+            text[out++] = '%';
+            continue;
+        }
+        char spec[LOG_SPEC_MAX_LENGTH];
+        memcpy(spec, spec_start, spec_length);
+        spec[spec_length] = '\0';
+
+        int star[2] = {0, 0};
+        if (offset + stars * sizeof(int) > length) {
+            break;
+        }
+        memcpy(star, &payload[offset], stars * sizeof(int));
+        offset += stars * sizeof(int);
+
+        char *dest = &text[out];
+        uint32_t space = size - out;
+        int written;
+        if (type == LOG_ARG_STRING) {
+            uint16_t marker;
+            if (offset + sizeof(marker) > length) {
+                break;
+            }
+            memcpy(&marker, &payload[offset], sizeof(marker));
+            offset += sizeof(marker);
+
+            const char *string;
+            char copy[LOG_FORMAT_SLOT_SIZE];
+            if (marker == LOG_STRING_POINTER) {
+                if (offset + sizeof(string) > length) {
+                    break;
+                }
+                memcpy(&string, &payload[offset], sizeof(string));
+                offset += sizeof(string);
+            } else {
+                if (offset + marker > length) {
+                    break;
+                }
+                memcpy(copy, &payload[offset], marker);
+                copy[marker] = '\0';
+                string = copy;
+                offset += marker;
+            }
+            written = RENDER_SPEC(dest, space, spec, stars, star, string);
+        } else {
+            uint32_t value_size = arg_size(type);
+            if (offset + value_size > length) {
+                break;
+            }
+            union {
+                int i;
+                long l;
+                long long ll;
+                size_t z;
+                intmax_t j;
+                ptrdiff_t t;
+                double d;
+                void *p;
+            } value;
+            memcpy(&value, &payload[offset], value_size);
+            offset += value_size;
+
+            switch (type) {
+            case LOG_ARG_INT:
+                written = RENDER_SPEC(dest, space, spec, stars, star, value.i);
+                break;
+            case LOG_ARG_LONG:
+                written = RENDER_SPEC(dest, space, spec, stars, star, value.l);
+                break;
+            case LOG_ARG_LONG_LONG:
+                written = RENDER_SPEC(dest, space, spec, stars, star, value.ll);
+                break;
+            case LOG_ARG_SIZE:
+                written = RENDER_SPEC(dest, space, spec, stars, star, value.z);
+                break;
+            case LOG_ARG_INTMAX:
+                written = RENDER_SPEC(dest, space, spec, stars, star, value.j);
+                break;
+            case LOG_ARG_PTRDIFF:
+                written = RENDER_SPEC(dest, space, spec, stars, star, value.t);
+                break;
+            case LOG_ARG_DOUBLE:
+                written = RENDER_SPEC(dest, space, spec, stars, star, value.d);
+                break;
+            default:
+                written = RENDER_SPEC(dest, space, spec, stars, star, value.p);
+                break;
+            }
+        }
+        if (written < 0) {
+            break;
+        }
+        out += ((uint32_t)written < space) ? (uint32_t)written : space - 1;
+    }
+    return out;
+}
+
+// Compare free-running ring positions
+static bool seq_before(uint32_t a, uint32_t b) {
+    return (int32_t)(a - b) < 0;
+}
+
+// Check whether a position still lies within the retained part of the ring
+static bool record_overwritten(uint32_t pos) {
+    return atomic_load(&g_head) - pos > LOG_BUFFER_SIZE;
+}
+
+// Check whether a committed, intact record starts at a position
+static bool record_valid(uint32_t pos, uint16_t *out_length, bool *out_binary) {
+    log_record_header_t *header = record_header(pos);
+    if (atomic_load_explicit(&header->pos, memory_order_acquire) != pos) {
+        return false;
+    }
+    uint16_t length = header->length;
+    uint16_t magic = header->magic;
+    if ((magic != LOG_RECORD_MAGIC && magic != LOG_RECORD_MAGIC_BINARY) ||
+        length >= LOG_FORMAT_SLOT_SIZE) {
+        return false;
+    }
+    *out_length = length;
+    *out_binary = (magic == LOG_RECORD_MAGIC_BINARY);
+    return true;
+}
+
+// Find the oldest complete record that has not been cleared or overwritten
+static uint32_t find_oldest_record(void) {
+    uint32_t head = atomic_load(&g_head);
+    uint32_t clear_pos = atomic_load(&g_clear_pos);
+    if (head - clear_pos <= LOG_BUFFER_SIZE) {
+        return clear_pos;  // Always a record boundary
+    }
+
+    // The ring has wrapped, so the record boundary nearest the overwrite point is
+    // unknown. Scan for the first header that stamps its own position.
+    uint16_t length;
+    bool binary;
+    for (uint32_t pos = head - LOG_BUFFER_SIZE; pos != head; pos += LOG_RECORD_ALIGN) {
+        if (record_valid(pos, &length, &binary) && !record_overwritten(pos)) {
+            return pos;
+        }
+    }
+    return head;
+}
+
 // Custom vprintf handler that writes to both ring buffer and original output
 static int log_buffer_vprintf_handler(const char *fmt, va_list args) {
     // Create a copy of va_list for the second use
@@ -34,31 +577,34 @@ static int log_buffer_vprintf_handler(const char *fmt, va_list args) {
     // First, call the original vprintf to maintain serial output
     int result = g_original_vprintf(fmt, args);
 
-    // Then write to our ring buffer using the copy
-    if (xSemaphoreTake(g_buffer_mutex, portMAX_DELAY) == pdTRUE) {
-        // Use global buffer for formatting - no stack allocation
-        int len =
-            vsnprintf(g_log_format_buffer, sizeof(g_log_format_buffer), fmt, args_copy);
-
-        if (len > 0) {
-            // Truncate if too long to fit in our buffer
-            if (len >= sizeof(g_log_format_buffer)) {
-                len = sizeof(g_log_format_buffer) - 1;
+    if (g_log_buffer != NULL) {
+        int slot = claim_format_slot();
+        if (slot >= 0) {
+            char *text = g_format_slots[slot];
+            uint32_t binary_length = 0;
+            if (atomic_load(&g_binary_mode)) {
+                va_list binary_args;
+                va_copy(binary_args, args_copy);
+                binary_length = encode_binary((uint8_t *)text, fmt, binary_args);
+                va_end(binary_args);
             }
 
-            // Write to ring buffer
-            for (int i = 0; i < len; i++) {
-                g_log_buffer[g_write_pos] = g_log_format_buffer[i];
-                g_write_pos = (g_write_pos + 1) % LOG_BUFFER_SIZE;
-
-                // Check if we've wrapped around (write_pos wrapped back to 0)
-                if (g_write_pos == 0 && !g_buffer_full) {
-                    g_buffer_full = true;
+            if (binary_length > 0) {
+                ring_write(text, binary_length, LOG_RECORD_MAGIC_BINARY);
+            } else {
+                int len = vsnprintf(text, LOG_FORMAT_SLOT_SIZE, fmt, args_copy);
+                if (len > 0) {
+                    // Truncate if too long to fit in our buffer
+                    if (len >= LOG_FORMAT_SLOT_SIZE) {
+                        len = LOG_FORMAT_SLOT_SIZE - 1;
+                    }
+                    ring_write(text, (uint32_t)len, LOG_RECORD_MAGIC);
                 }
             }
+            release_format_slot(slot);
+        } else {
+            atomic_fetch_add(&g_dropped, 1);
         }
-
-        xSemaphoreGive(g_buffer_mutex);
     }
 
     // Clean up the va_list copy
@@ -68,9 +614,9 @@ static int log_buffer_vprintf_handler(const char *fmt, va_list args) {
 }
 
 bool log_buffer_init(void) {
-    // Create mutex for thread safety
-    g_buffer_mutex = xSemaphoreCreateMutex();
-    if (g_buffer_mutex == NULL) {
+    // Create mutex for readers; writers are lock-free
+    g_read_mutex = xSemaphoreCreateMutex();
+    if (g_read_mutex == NULL) {
         ESP_LOGE(TAG, "Failed to create mutex");
         return false;
     }
@@ -79,16 +625,19 @@ bool log_buffer_init(void) {
     g_log_buffer = heap_caps_malloc(LOG_BUFFER_SIZE, MALLOC_CAP_SPIRAM);
     if (g_log_buffer == NULL) {
         ESP_LOGE(TAG, "Failed to allocate log buffer in PSRAM");
-        vSemaphoreDelete(g_buffer_mutex);
-        g_buffer_mutex = NULL;
+        vSemaphoreDelete(g_read_mutex);
+        g_read_mutex = NULL;
         return false;
     }
 
     // Initialize buffer state
     memset(g_log_buffer, 0, LOG_BUFFER_SIZE);
-    g_write_pos = 0;
-    g_read_pos = 0;
-    g_buffer_full = false;
+    atomic_store(&g_head, 0);
+    atomic_store(&g_clear_pos, 0);
+    atomic_store(&g_dropped, 0);
+    g_read_cursor.seq = 0;
+    g_read_cursor.offset = 0;
+    g_rendered = false;
 
     // Store the original vprintf and set our custom handler
     g_original_vprintf = esp_log_set_vprintf(log_buffer_vprintf_handler);
@@ -97,118 +646,270 @@ bool log_buffer_init(void) {
     return true;
 }
 
+static void log_settings_changed(const char *key, void *arg) {
+    (void)key;
+    (void)arg;
+    log_buffer_load_settings();
+}
+
+void log_buffer_load_settings(void) {
+    // Follow later changes without a reboot
+    static bool watching = false;
+    if (!watching) {
+        watching = nvs_config_add_change_callback(
+            NVS_KEY_LOG_BINARY, log_settings_changed, NULL);
+    }
+
+    uint8_t value = 0;
+    esp_err_t ret = nvs_config_get_u8(NVS_KEY_LOG_BINARY, &value);
+    if (ret != ESP_OK && ret != ESP_ERR_NVS_NOT_FOUND) {
+        ESP_LOGW(TAG,
+                 "Failed to read %s from NVS: %s",
+                 NVS_KEY_LOG_BINARY,
+                 esp_err_to_name(ret));
+    }
+
+    atomic_store(&g_binary_mode, value != 0);
+    if (value != 0) {
+        ESP_LOGI(TAG, "Binary log records enabled");
+    }
+}
+
 uint32_t log_buffer_get_available(void) {
-    if (g_buffer_mutex == NULL) {
+    if (g_read_mutex == NULL) {
         return 0;
     }
 
     uint32_t available = 0;
-    if (xSemaphoreTake(g_buffer_mutex, portMAX_DELAY) == pdTRUE) {
-        if (g_buffer_full) {
-            // Buffer is full, all data is available
+    if (xSemaphoreTake(g_read_mutex, portMAX_DELAY) == pdTRUE) {
+        // Counts stored bytes, so binary records make this an estimate of the text
+        available = atomic_load(&g_head) - g_read_cursor.seq;
+        if (available > LOG_BUFFER_SIZE) {
             available = LOG_BUFFER_SIZE;
-        } else {
-            // Buffer not full, available data is from read_pos to write_pos
-            available = g_write_pos - g_read_pos;
         }
-        xSemaphoreGive(g_buffer_mutex);
+        xSemaphoreGive(g_read_mutex);
     }
 
     return available;
 }
 
-uint32_t log_buffer_read_chunk(uint8_t *buffer, uint32_t max_size) {
-    if (buffer == NULL || max_size == 0 || g_buffer_mutex == NULL) {
-        return 0;
-    }
-
+// Read text from a cursor, up to end_seq if bounded or else up to the newest record.
+// Must be called with g_read_mutex held.
+static uint32_t read_unsafe(log_buffer_cursor_t *cursor,
+                            uint32_t end_seq,
+                            bool bounded,
+                            uint8_t *buffer,
+                            uint32_t max_size) {
     uint32_t bytes_read = 0;
-    if (xSemaphoreTake(g_buffer_mutex, portMAX_DELAY) == pdTRUE) {
-        // Calculate how many bytes we can read from current read position
-        uint32_t available = 0;
-        if (g_buffer_full) {
-            // Buffer is full, all LOG_BUFFER_SIZE bytes are available
-            // Calculate how much we can read from current read_pos
-            if (g_read_pos == g_write_pos) {
-                // Special case: we're at the start of a full buffer, all data available
-                available = LOG_BUFFER_SIZE;
-            } else if (g_read_pos < g_write_pos) {
-                // Normal case: read_pos to write_pos
-                available = g_write_pos - g_read_pos;
-            } else {
-                // Wrapped case: from read_pos to end, then from start to write_pos
-                available = LOG_BUFFER_SIZE - g_read_pos + g_write_pos;
-            }
+    while (bytes_read < max_size &&
+           seq_before(cursor->seq, bounded ? end_seq : atomic_load(&g_head))) {
+        uint16_t length;
+        bool binary;
+        if (g_rendered && g_rendered_pos == cursor->seq) {
+            // Already rendered; the text stays intact even if the ring laps it
+            binary = true;
+            length = (uint16_t)g_rendered_stored_length;
         } else {
-            // Buffer not full, available data is from read_pos to write_pos
-            available = g_write_pos - g_read_pos;
-        }
+            if (record_overwritten(cursor->seq)) {
+                // End a partially returned line before skipping what was lost
+                if (cursor->offset > 0) {
+                    buffer[bytes_read++] = '\n';
+                }
+                cursor->seq = find_oldest_record();
+                cursor->offset = 0;
+                continue;
+            }
+            if (!record_valid(cursor->seq, &length, &binary)) {
+                if (record_overwritten(cursor->seq)) {
+                    continue;  // Lapped while checking; resynchronize above
+                }
+                break;  // Not committed yet
+            }
 
-        if (available > 0) {
-            uint32_t to_read = (available < max_size) ? available : max_size;
+            if (binary) {
+                // Render the record once, even if it is returned over several chunks
+                ring_copy_out(
+                    cursor->seq + LOG_RECORD_HEADER_SIZE, g_render_payload, length);
+                atomic_thread_fence(memory_order_acquire);
+                if (record_overwritten(cursor->seq)) {
+                    continue;
+                }
+                g_rendered_length =
+                    render_binary(g_render_text, g_render_payload, length);
+                g_rendered_stored_length = length;
+                g_rendered_pos = cursor->seq;
+                g_rendered = true;
+            }
+        }
+        uint32_t text_length = binary ? g_rendered_length : length;
 
-            // Read data from ring buffer
-            for (uint32_t i = 0; i < to_read; i++) {
-                buffer[i] = g_log_buffer[g_read_pos];
-                g_read_pos = (g_read_pos + 1) % LOG_BUFFER_SIZE;
-                bytes_read++;
+        uint32_t to_read = text_length - cursor->offset;
+        if (to_read > max_size - bytes_read) {
+            to_read = max_size - bytes_read;
+        }
+        if (binary) {
+            memcpy(&buffer[bytes_read], &g_render_text[cursor->offset], to_read);
+        } else {
+            ring_copy_out(cursor->seq + LOG_RECORD_HEADER_SIZE + cursor->offset,
+                          &buffer[bytes_read],
+                          to_read);
+
+            // A writer may have overwritten the record while it was being copied
+            atomic_thread_fence(memory_order_acquire);
+            if (record_overwritten(cursor->seq)) {
+                continue;
             }
         }
 
-        xSemaphoreGive(g_buffer_mutex);
+        bytes_read += to_read;
+        cursor->offset += to_read;
+        if (cursor->offset == text_length) {
+            cursor->seq += record_total_size(length);
+            cursor->offset = 0;
+        }
+    }
+    return bytes_read;
+}
+
+uint32_t log_buffer_read_chunk(uint8_t *buffer, uint32_t max_size) {
+    if (buffer == NULL || max_size == 0 || g_read_mutex == NULL) {
+        return 0;
+    }
+
+    uint32_t bytes_read = 0;
+    if (xSemaphoreTake(g_read_mutex, portMAX_DELAY) == pdTRUE) {
+        bytes_read = read_unsafe(&g_read_cursor, 0, false, buffer, max_size);
+        xSemaphoreGive(g_read_mutex);
     }
 
     return bytes_read;
 }
 
 void log_buffer_start_read(void) {
-    if (g_buffer_mutex == NULL) {
+    if (g_read_mutex == NULL) {
         return;
     }
 
-    if (xSemaphoreTake(g_buffer_mutex, portMAX_DELAY) == pdTRUE) {
+    if (xSemaphoreTake(g_read_mutex, portMAX_DELAY) == pdTRUE) {
         // Reset read pointer to the oldest available data
-        if (g_buffer_full) {
-            // Buffer has been full, start from write position (oldest data)
-            g_read_pos = g_write_pos;
-        } else {
-            // Buffer never filled, start from beginning
-            g_read_pos = 0;
-        }
+        g_read_cursor.seq = find_oldest_record();
+        g_read_cursor.offset = 0;
 
-        xSemaphoreGive(g_buffer_mutex);
+        uint32_t dropped = atomic_exchange(&g_dropped, 0);
+        xSemaphoreGive(g_read_mutex);
+
+        if (dropped > 0) {
+            ESP_LOGW(TAG, "%lu log records dropped", (unsigned long)dropped);
+        }
     }
 }
 
 void log_buffer_clear(void) {
-    if (g_buffer_mutex == NULL) {
+    if (g_read_mutex == NULL) {
+        return;
+    }
+
+    if (xSemaphoreTake(g_read_mutex, portMAX_DELAY) == pdTRUE) {
+        // Records are not erased; readers just start after the current end
+        uint32_t head = atomic_load(&g_head);
+        atomic_store(&g_clear_pos, head);
+        g_read_cursor.seq = head;
+        g_read_cursor.offset = 0;
+        xSemaphoreGive(g_read_mutex);
+    }
+}
+
+void log_buffer_cursor_start(log_buffer_cursor_t *cursor, uint32_t seq) {
+    cursor->seq = 0;
+    cursor->offset = 0;
+    if (g_read_mutex == NULL) {
         return;
     }
 
-    if (xSemaphoreTake(g_buffer_mutex, portMAX_DELAY) == pdTRUE) {
-        g_write_pos = 0;
-        g_read_pos = 0;
-        g_buffer_full = false;
-        if (g_log_buffer != NULL) {
-            memset(g_log_buffer, 0, LOG_BUFFER_SIZE);
+    if (xSemaphoreTake(g_read_mutex, portMAX_DELAY) == pdTRUE) {
+        uint32_t oldest = find_oldest_record();
+        uint32_t head = atomic_load(&g_head);
+        uint16_t length;
+        bool binary;
+        if (seq == LOG_BUFFER_SEQ_OLDEST || seq - oldest > head - oldest) {
+            // Overwritten, cleared or from before a reboot; resume from the oldest
+            cursor->seq = oldest;
+        } else if (seq == head || record_valid(seq, &length, &binary)) {
+            cursor->seq = seq;
+        } else {
+            // Not a record boundary; start at the first record after it
+            uint32_t pos = oldest;
+            while (seq_before(pos, seq) && record_valid(pos, &length, &binary)) {
+                pos += record_total_size(length);
+            }
+            cursor->seq = pos;
         }
-        xSemaphoreGive(g_buffer_mutex);
+        xSemaphoreGive(g_read_mutex);
+    }
+}
+
+uint32_t log_buffer_cursor_end(const log_buffer_cursor_t *cursor) {
+    if (g_read_mutex == NULL) {
+        return cursor->seq;
+    }
+
+    uint32_t pos = cursor->seq;
+    if (xSemaphoreTake(g_read_mutex, portMAX_DELAY) == pdTRUE) {
+        // Stop before the first record that is still being written
+        uint32_t head = atomic_load(&g_head);
+        uint16_t length;
+        bool binary;
+        if (record_overwritten(pos)) {
+            pos = find_oldest_record();
+        }
+        while (seq_before(pos, head) && record_valid(pos, &length, &binary)) {
+            pos += record_total_size(length);
+        }
+        xSemaphoreGive(g_read_mutex);
+    }
+    return pos;
+}
+
+uint32_t log_buffer_cursor_read(log_buffer_cursor_t *cursor,
+                                uint32_t end_seq,
+                                uint8_t *buffer,
+                                uint32_t max_size) {
+    if (buffer == NULL || max_size == 0 || g_read_mutex == NULL) {
+        return 0;
+    }
+
+    uint32_t bytes_read = 0;
+    if (xSemaphoreTake(g_read_mutex, portMAX_DELAY) == pdTRUE) {
+        bytes_read = read_unsafe(cursor, end_seq, true, buffer, max_size);
+        xSemaphoreGive(g_read_mutex);
     }
+
+    return bytes_read;
+}
+
+uint32_t log_buffer_get_head_seq(void) {
+    return atomic_load(&g_head);
 }
 
 void log_buffer_deinit(void) {
-    if (g_buffer_mutex != NULL) {
-        if (xSemaphoreTake(g_buffer_mutex, portMAX_DELAY) == pdTRUE) {
+    if (g_read_mutex != NULL) {
+        if (xSemaphoreTake(g_read_mutex, portMAX_DELAY) == pdTRUE) {
+            // Stop capturing before freeing the ring
+            if (g_original_vprintf != NULL) {
+                esp_log_set_vprintf(g_original_vprintf);
+            }
+
             // Free PSRAM buffer
             if (g_log_buffer != NULL) {
-                heap_caps_free(g_log_buffer);
+                uint8_t *buffer = g_log_buffer;
                 g_log_buffer = NULL;
+                heap_caps_free(buffer);
             }
-            xSemaphoreGive(g_buffer_mutex);
+            xSemaphoreGive(g_read_mutex);
 
             // Delete mutex
-            vSemaphoreDelete(g_buffer_mutex);
-            g_buffer_mutex = NULL;
+            vSemaphoreDelete(g_read_mutex);
+            g_read_mutex = NULL;
         }
     }
 }
@@ -6,6 +6,8 @@
 
 static const char *TAG = "main";
 
+// Unit tests provide their own app_main()
+#ifndef PIO_UNIT_TESTING
 void app_main() {
     // Initialize log buffer first to capture all logs from startup
     if (!log_buffer_init()) {
@@ -23,3 +25,4 @@ void app_main() {
     // Application is now event-driven - the main task can exit now
     ESP_LOGI(TAG, "ODKey initialized successfully, main task exiting. Godspeed!");
 }
+#endif  // PIO_UNIT_TESTING
@@ -2,6 +2,7 @@
 #include <string.h>
 #include "esp_log.h"
 #include "mdns.h"
+#include "nvs_config.h"
 #include "nvs_odkey.h"
 
 static const char *TAG = "mdns_service";
@@ -10,54 +11,40 @@ static const char *TAG = "mdns_service";
 #define MDNS_HOSTNAME_DEFAULT "odkey"
 #define MDNS_INSTANCE_DEFAULT "ODKey Device"
 
-bool mdns_service_init(void) {
-    // Initialize mDNS
-    esp_err_t err = mdns_init();
-    if (err != ESP_OK) {
-        ESP_LOGE(TAG, "Failed to initialize mDNS: %s", esp_err_to_name(err));
-        return false;
-    }
-
-    // Load mDNS configuration from NVS
-    nvs_handle_t nvs_handle;
-    err = nvs_open(NVS_NAMESPACE, NVS_READONLY, &nvs_handle);
-    if (err != ESP_OK) {
-        ESP_LOGW(TAG, "Failed to open NVS for mDNS config, using defaults");
-        mdns_hostname_set(MDNS_HOSTNAME_DEFAULT);
-        mdns_instance_name_set(MDNS_INSTANCE_DEFAULT);
-        ESP_LOGI(
-            TAG, "mDNS initialized with defaults: %s.local", MDNS_HOSTNAME_DEFAULT);
-        return true;
+// Read a string setting, keeping the default if it is missing
+static void load_name(const char *key,
+                      const char *default_value,
+                      char *out_value,
+                      size_t size,
+                      const char *name) {
+    size_t required_size = size;
+    if (nvs_config_get_str(key, out_value, &required_size) == ESP_OK) {
+        ESP_LOGI(TAG, "Found mDNS %s in NVS: %s", name, out_value);
+    } else {
+        ESP_LOGI(TAG, "mDNS %s not found in NVS, using default", name);
+        strncpy(out_value, default_value, size - 1);
+        out_value[size - 1] = '\0';
     }
+}
 
-    // Try to get mDNS hostname
+// Apply the configured hostname and instance name
+static bool apply_mdns_configuration(void) {
     char hostname[32];
-    size_t required_size = sizeof(hostname);
-    err = nvs_get_str(nvs_handle, NVS_KEY_MDNS_HOSTNAME, hostname, &required_size);
-    if (err == ESP_OK) {
-        ESP_LOGI(TAG, "Found mDNS hostname in NVS: %s", hostname);
-    } else {
-        ESP_LOGI(TAG, "mDNS hostname not found in NVS, using default");
-        strncpy(hostname, MDNS_HOSTNAME_DEFAULT, sizeof(hostname) - 1);
-        hostname[sizeof(hostname) - 1] = '\0';
-    }
+    load_name(NVS_KEY_MDNS_HOSTNAME,
+              MDNS_HOSTNAME_DEFAULT,
+              hostname,
+              sizeof(hostname),
+              "hostname");
 
-    // Try to get mDNS instance name
     char instance[64];
-    required_size = sizeof(instance);
-    err = nvs_get_str(nvs_handle, NVS_KEY_MDNS_INSTANCE, instance, &required_size);
-    if (err == ESP_OK) {
-        ESP_LOGI(TAG, "Found mDNS instance in NVS: %s", instance);
-    } else {
-        ESP_LOGI(TAG, "mDNS instance not found in NVS, using default");
-        strncpy(instance, MDNS_INSTANCE_DEFAULT, sizeof(instance) - 1);
-        instance[sizeof(instance) - 1] = '\0';
-    }
-
-    nvs_close(nvs_handle);
+    load_name(NVS_KEY_MDNS_INSTANCE,
+              MDNS_INSTANCE_DEFAULT,
+              instance,
+              sizeof(instance),
+              "instance");
 
     // Set hostname
-    err = mdns_hostname_set(hostname);
+    esp_err_t err = mdns_hostname_set(hostname);
     if (err != ESP_OK) {
         ESP_LOGE(TAG, "Failed to set mDNS hostname: %s", esp_err_to_name(err));
         return false;
@@ -70,6 +57,30 @@ bool mdns_service_init(void) {
         return false;
     }
 
-    ESP_LOGI(TAG, "mDNS service initialized: %s.local", hostname);
+    ESP_LOGI(TAG, "mDNS service advertised as %s.local", hostname);
+    return true;
+}
+
+static void mdns_config_changed(const char *key, void *arg) {
+    (void)key;
+    (void)arg;
+    apply_mdns_configuration();
+}
+
+bool mdns_service_init(void) {
+    // Initialize mDNS
+    esp_err_t err = mdns_init();
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to initialize mDNS: %s", esp_err_to_name(err));
+        return false;
+    }
+
+    if (!apply_mdns_configuration()) {
+        return false;
+    }
+
+    // Rename the device without a reboot
+    nvs_config_add_change_callback(NVS_KEY_MDNS_HOSTNAME, mdns_config_changed, NULL);
+    nvs_config_add_change_callback(NVS_KEY_MDNS_INSTANCE, mdns_config_changed, NULL);
     return true;
 }
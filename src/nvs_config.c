@@ -0,0 +1,542 @@
+#include "nvs_config.h"
+#include <stdlib.h>
+#include <string.h>
+#include "esp_log.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "freertos/task.h"
+#include "nvs_odkey.h"
+
+static const char *TAG = "nvs_config";
+
+#define NVS_CONFIG_TASK_STACK_SIZE 4096
+#define NVS_CONFIG_TASK_PRIORITY 2
+
+// One cached key. Integers of every width are held as their raw 64-bit value.
+typedef struct {
+    char key[NVS_KEY_NAME_MAX_SIZE];  // Empty for a free slot
+    nvs_type_t type;                  // NVS_TYPE_ANY once erased
+    nvs_type_t stored_type;           // Type stored in NVS (NVS_TYPE_ANY if none)
+    bool dirty;                       // Changed since the last commit
+    uint64_t integer;                 // Integer value
+    void *data;                       // String (with its NUL) or blob value
+    size_t length;                    // Length of data
+} config_entry_t;
+
+typedef struct {
+    const char *key;
+    nvs_config_change_callback_t callback;
+    void *arg;
+} config_callback_t;
+
+static config_entry_t *g_entries = NULL;
+static size_t g_entry_capacity = 0;
+static config_callback_t g_callbacks[NVS_CONFIG_MAX_CALLBACKS];
+static size_t g_callback_count = 0;
+static SemaphoreHandle_t g_config_mutex = NULL;
+static TaskHandle_t g_commit_task = NULL;
+
+// Find the entry of a key, including an erased entry that is not yet committed
+static config_entry_t *find_entry_unsafe(const char *key) {
+    for (size_t i = 0; i < g_entry_capacity; i++) {
+        if (g_entries[i].key[0] != '\0' && strcmp(g_entries[i].key, key) == 0) {
+            return &g_entries[i];
+        }
+    }
+    return NULL;
+}
+
+// Make room for more keys. Entry pointers are invalidated.
+static bool grow_entries_unsafe(void) {
+    size_t capacity =
+        (g_entry_capacity == 0) ? NVS_CONFIG_INITIAL_ENTRIES : 2 * g_entry_capacity;
+    config_entry_t *entries = realloc(g_entries, capacity * sizeof(*entries));
+    if (entries == NULL) {
+        return false;
+    }
+    memset(&entries[g_entry_capacity],
+           0,
+           (capacity - g_entry_capacity) * sizeof(*entries));
+    g_entries = entries;
+    g_entry_capacity = capacity;
+    return true;
+}
+
+// Find the entry of a key or claim a free one for it, growing the cache if it is
+// full. Returns NULL if it can't grow.
+static config_entry_t *claim_entry_unsafe(const char *key) {
+    config_entry_t *entry = find_entry_unsafe(key);
+    if (entry != NULL) {
+        return entry;
+    }
+
+    size_t i = 0;
+    while (i < g_entry_capacity && g_entries[i].key[0] != '\0') {
+        i++;
+    }
+    if (i == g_entry_capacity && !grow_entries_unsafe()) {
+        return NULL;
+    }
+
+    entry = &g_entries[i];
+    memset(entry, 0, sizeof(*entry));
+    strcpy(entry->key, key);
+    entry->type = NVS_TYPE_ANY;
+    entry->stored_type = NVS_TYPE_ANY;
+    return entry;
+}
+
+static void free_entry_unsafe(config_entry_t *entry) {
+    free(entry->data);
+    memset(entry, 0, sizeof(*entry));
+}
+
+static bool valid_key(const char *key) {
+    size_t len = strlen(key);
+    return len > 0 && len < NVS_KEY_NAME_MAX_SIZE;
+}
+
+#define LOAD_INTEGER(nvs_get, c_type)                 \
+    do {                                              \
+        c_type value;                                 \
+        err = nvs_get(nvs_handle, info->key, &value); \
+        entry->integer = (uint64_t)value;             \
+    } while (0)
+
+// Read one key from NVS into the cache
+static esp_err_t load_entry(nvs_handle_t nvs_handle, const nvs_entry_info_t *info) {
+    config_entry_t *entry = claim_entry_unsafe(info->key);
+    if (entry == NULL) {
+        return ESP_ERR_NO_MEM;
+    }
+
+    esp_err_t err;
+    switch (info->type) {
+    case NVS_TYPE_U8:
+        LOAD_INTEGER(nvs_get_u8, uint8_t);
+        break;
+    case NVS_TYPE_I8:
+        LOAD_INTEGER(nvs_get_i8, int8_t);
+        break;
+    case NVS_TYPE_U16:
+        LOAD_INTEGER(nvs_get_u16, uint16_t);
+        break;
+    case NVS_TYPE_I16:
+        LOAD_INTEGER(nvs_get_i16, int16_t);
+        break;
+    case NVS_TYPE_U32:
+        LOAD_INTEGER(nvs_get_u32, uint32_t);
+        break;
+    case NVS_TYPE_I32:
+        LOAD_INTEGER(nvs_get_i32, int32_t);
+        break;
+    case NVS_TYPE_U64:
+        LOAD_INTEGER(nvs_get_u64, uint64_t);
+        break;
+    case NVS_TYPE_I64:
+        LOAD_INTEGER(nvs_get_i64, int64_t);
+        break;
+    case NVS_TYPE_STR:
+    case NVS_TYPE_BLOB: {
+        size_t length = 0;
+        err = info->type == NVS_TYPE_STR
+                  ? nvs_get_str(nvs_handle, info->key, NULL, &length)
+                  : nvs_get_blob(nvs_handle, info->key, NULL, &length);
+        if (err != ESP_OK) {
+            break;
+        }
+        entry->data = malloc(length > 0 ? length : 1);
+        if (entry->data == NULL) {
+            err = ESP_ERR_NO_MEM;
+            break;
+        }
+        entry->length = length;
+        err = info->type == NVS_TYPE_STR
+                  ? nvs_get_str(nvs_handle, info->key, entry->data, &length)
+                  : nvs_get_blob(nvs_handle, info->key, entry->data, &length);
+    } break;
+    default:
+        err = ESP_ERR_NVS_TYPE_MISMATCH;
+        break;
+    }
+
+    if (err != ESP_OK) {
+        free_entry_unsafe(entry);
+        return err;
+    }
+    entry->type = info->type;
+    entry->stored_type = info->type;
+    return ESP_OK;
+}
+
+// Write one dirty entry to NVS (without committing)
+static esp_err_t store_entry(nvs_handle_t nvs_handle, const config_entry_t *entry) {
+    // Erased keys, and keys whose type changed, lose their stored item first
+    if (entry->stored_type != NVS_TYPE_ANY && entry->stored_type != entry->type) {
+        esp_err_t err = nvs_erase_key(nvs_handle, entry->key);
+        if (err != ESP_OK && err != ESP_ERR_NVS_NOT_FOUND) {
+            return err;
+        }
+    }
+
+    switch (entry->type) {
+    case NVS_TYPE_ANY:
+        return ESP_OK;
+    case NVS_TYPE_U8:
+        return nvs_set_u8(nvs_handle, entry->key, (uint8_t)entry->integer);
+    case NVS_TYPE_I8:
+        return nvs_set_i8(nvs_handle, entry->key, (int8_t)entry->integer);
+    case NVS_TYPE_U16:
+        return nvs_set_u16(nvs_handle, entry->key, (uint16_t)entry->integer);
+    case NVS_TYPE_I16:
+        return nvs_set_i16(nvs_handle, entry->key, (int16_t)entry->integer);
+    case NVS_TYPE_U32:
+        return nvs_set_u32(nvs_handle, entry->key, (uint32_t)entry->integer);
+    case NVS_TYPE_I32:
+        return nvs_set_i32(nvs_handle, entry->key, (int32_t)entry->integer);
+    case NVS_TYPE_U64:
+        return nvs_set_u64(nvs_handle, entry->key, entry->integer);
+    case NVS_TYPE_I64:
+        return nvs_set_i64(nvs_handle, entry->key, (int64_t)entry->integer);
+    case NVS_TYPE_STR:
+        return nvs_set_str(nvs_handle, entry->key, (const char *)entry->data);
+    case NVS_TYPE_BLOB:
+        return nvs_set_blob(nvs_handle, entry->key, entry->data, entry->length);
+    default:
+        return ESP_ERR_NVS_TYPE_MISMATCH;
+    }
+}
+
+// Commit task: batches writes that follow close behind each other into one commit
+static void config_commit_task(void *pvParameters) {
+    (void)pvParameters;
+
+    for (;;) {
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+
+        TickType_t first_write = xTaskGetTickCount();
+        while (xTaskGetTickCount() - first_write <
+                   pdMS_TO_TICKS(NVS_CONFIG_MAX_COMMIT_DELAY_MS) &&
+               ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(NVS_CONFIG_COMMIT_DELAY_MS)) >
+                   0) {
+        }
+
+        // A failed commit leaves the entries dirty for the next one
+        nvs_config_commit();
+    }
+}
+
+bool nvs_config_init(void) {
+    g_config_mutex = xSemaphoreCreateMutex();
+    if (g_config_mutex == NULL) {
+        ESP_LOGE(TAG, "Failed to create config mutex");
+        return false;
+    }
+
+    nvs_handle_t nvs_handle;
+    esp_err_t err = nvs_open(NVS_NAMESPACE, NVS_READONLY, &nvs_handle);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to open NVS: %s", esp_err_to_name(err));
+        return false;
+    }
+
+    size_t count = 0;
+    nvs_iterator_t iterator = NULL;
+    err = nvs_entry_find(NVS_DEFAULT_PART_NAME, NVS_NAMESPACE, NVS_TYPE_ANY, &iterator);
+    while (err == ESP_OK) {
+        nvs_entry_info_t info;
+        nvs_entry_info(iterator, &info);
+        esp_err_t load_err = load_entry(nvs_handle, &info);
+        if (load_err == ESP_OK) {
+            count++;
+        } else {
+            ESP_LOGW(
+                TAG, "Failed to cache key %s: %s", info.key, esp_err_to_name(load_err));
+        }
+        err = nvs_entry_next(&iterator);
+    }
+    nvs_release_iterator(iterator);
+    nvs_close(nvs_handle);
+
+    if (err != ESP_ERR_NVS_NOT_FOUND) {
+        ESP_LOGE(TAG, "Failed to list NVS keys: %s", esp_err_to_name(err));
+        return false;
+    }
+
+    if (xTaskCreate(config_commit_task,
+                    "nvs_config",
+                    NVS_CONFIG_TASK_STACK_SIZE,
+                    NULL,
+                    NVS_CONFIG_TASK_PRIORITY,
+                    &g_commit_task) != pdPASS) {
+        ESP_LOGE(TAG, "Failed to create config commit task");
+        return false;
+    }
+
+    ESP_LOGI(TAG, "Configuration cache loaded (%lu keys)", (unsigned long)count);
+    return true;
+}
+
+esp_err_t nvs_config_find_key(const char *key, nvs_type_t *out_type) {
+    esp_err_t err = ESP_ERR_NVS_NOT_FOUND;
+    xSemaphoreTake(g_config_mutex, portMAX_DELAY);
+    config_entry_t *entry = find_entry_unsafe(key);
+    if (entry != NULL && entry->type != NVS_TYPE_ANY) {
+        *out_type = entry->type;
+        err = ESP_OK;
+    }
+    xSemaphoreGive(g_config_mutex);
+    return err;
+}
+
+static esp_err_t get_integer(const char *key, nvs_type_t type, uint64_t *out_value) {
+    esp_err_t err = ESP_ERR_NVS_NOT_FOUND;
+    xSemaphoreTake(g_config_mutex, portMAX_DELAY);
+    config_entry_t *entry = find_entry_unsafe(key);
+    if (entry != NULL && entry->type == type) {
+        *out_value = entry->integer;
+        err = ESP_OK;
+    }
+    xSemaphoreGive(g_config_mutex);
+    return err;
+}
+
+static esp_err_t get_data(const char *key,
+                          nvs_type_t type,
+                          void *out_value,
+                          size_t *length) {
+    esp_err_t err = ESP_ERR_NVS_NOT_FOUND;
+    xSemaphoreTake(g_config_mutex, portMAX_DELAY);
+    config_entry_t *entry = find_entry_unsafe(key);
+    if (entry != NULL && entry->type == type) {
+        if (out_value == NULL) {
+            err = ESP_OK;
+        } else if (*length < entry->length) {
+            err = ESP_ERR_NVS_INVALID_LENGTH;
+        } else {
+            memcpy(out_value, entry->data, entry->length);
+            err = ESP_OK;
+        }
+        *length = entry->length;
+    }
+    xSemaphoreGive(g_config_mutex);
+    return err;
+}
+
+// Store a value in the cache and schedule its commit. data, if any, is copied.
+static esp_err_t set_value(const char *key,
+                           nvs_type_t type,
+                           uint64_t integer,
+                           const void *data,
+                           size_t length) {
+    if (!valid_key(key)) {
+        return ESP_ERR_NVS_KEY_TOO_LONG;
+    }
+
+    void *copy = NULL;
+    if (type == NVS_TYPE_STR || type == NVS_TYPE_BLOB) {
+        copy = malloc(length > 0 ? length : 1);
+        if (copy == NULL) {
+            return ESP_ERR_NO_MEM;
+        }
+        memcpy(copy, data, length);
+    }
+
+    xSemaphoreTake(g_config_mutex, portMAX_DELAY);
+    config_entry_t *entry = claim_entry_unsafe(key);
+    if (entry == NULL) {
+        xSemaphoreGive(g_config_mutex);
+        free(copy);
+        ESP_LOGE(TAG, "No memory to cache %s", key);
+        return ESP_ERR_NO_MEM;
+    }
+
+    // Rewriting the current value doesn't cost a commit
+    bool unchanged = entry->type == type && entry->integer == integer &&
+                     entry->length == length &&
+                     (copy == NULL || memcmp(entry->data, copy, length) == 0);
+    if (unchanged) {
+        xSemaphoreGive(g_config_mutex);
+        free(copy);
+        return ESP_OK;
+    }
+
+    free(entry->data);
+    entry->type = type;
+    entry->integer = integer;
+    entry->data = copy;
+    entry->length = length;
+    entry->dirty = true;
+    xSemaphoreGive(g_config_mutex);
+
+    xTaskNotifyGive(g_commit_task);
+    return ESP_OK;
+}
+
+#define CONFIG_INTEGER_ACCESSORS(suffix, c_type, nvs_type)                    \
+    esp_err_t nvs_config_get_##suffix(const char *key, c_type *out_value) {  \
+        uint64_t value;                                                       \
+        esp_err_t err = get_integer(key, nvs_type, &value);                   \
+        if (err == ESP_OK) {                                                  \
+            *out_value = (c_type)value;                                       \
+        }                                                                     \
+        return err;                                                           \
+    }                                                                         \
+    esp_err_t nvs_config_set_##suffix(const char *key, c_type value) {       \
+        return set_value(key, nvs_type, (uint64_t)value, NULL, 0);            \
+    }
+
+CONFIG_INTEGER_ACCESSORS(u8, uint8_t, NVS_TYPE_U8)
+CONFIG_INTEGER_ACCESSORS(i8, int8_t, NVS_TYPE_I8)
+CONFIG_INTEGER_ACCESSORS(u16, uint16_t, NVS_TYPE_U16)
+CONFIG_INTEGER_ACCESSORS(i16, int16_t, NVS_TYPE_I16)
+CONFIG_INTEGER_ACCESSORS(u32, uint32_t, NVS_TYPE_U32)
+CONFIG_INTEGER_ACCESSORS(i32, int32_t, NVS_TYPE_I32)
+CONFIG_INTEGER_ACCESSORS(u64, uint64_t, NVS_TYPE_U64)
+CONFIG_INTEGER_ACCESSORS(i64, int64_t, NVS_TYPE_I64)
+
+esp_err_t nvs_config_get_str(const char *key, char *out_value, size_t *length) {
+    return get_data(key, NVS_TYPE_STR, out_value, length);
+}
+
+esp_err_t nvs_config_get_blob(const char *key, void *out_value, size_t *length) {
+    return get_data(key, NVS_TYPE_BLOB, out_value, length);
+}
+
+esp_err_t nvs_config_set_str(const char *key, const char *value) {
+    return set_value(key, NVS_TYPE_STR, 0, value, strlen(value) + 1);
+}
+
+esp_err_t nvs_config_set_blob(const char *key, const void *value, size_t length) {
+    return set_value(key, NVS_TYPE_BLOB, 0, value, length);
+}
+
+esp_err_t nvs_config_erase_key(const char *key) {
+    xSemaphoreTake(g_config_mutex, portMAX_DELAY);
+    config_entry_t *entry = find_entry_unsafe(key);
+    if (entry == NULL || entry->type == NVS_TYPE_ANY) {
+        xSemaphoreGive(g_config_mutex);
+        return ESP_ERR_NVS_NOT_FOUND;
+    }
+
+    // A key that never reached NVS just goes away
+    if (entry->stored_type == NVS_TYPE_ANY) {
+        free_entry_unsafe(entry);
+        xSemaphoreGive(g_config_mutex);
+        return ESP_OK;
+    }
+
+    free(entry->data);
+    entry->type = NVS_TYPE_ANY;
+    entry->integer = 0;
+    entry->data = NULL;
+    entry->length = 0;
+    entry->dirty = true;
+    xSemaphoreGive(g_config_mutex);
+
+    xTaskNotifyGive(g_commit_task);
+    return ESP_OK;
+}
+
+esp_err_t nvs_config_commit(void) {
+    size_t changed_count = 0;
+
+    xSemaphoreTake(g_config_mutex, portMAX_DELAY);
+
+    size_t dirty_count = 0;
+    for (size_t i = 0; i < g_entry_capacity; i++) {
+        dirty_count += (g_entries[i].key[0] != '\0' && g_entries[i].dirty);
+    }
+    if (dirty_count == 0) {
+        xSemaphoreGive(g_config_mutex);
+        return ESP_OK;
+    }
+
+    // Names of the committed keys, for the change callbacks
+    char(*changed)[NVS_KEY_NAME_MAX_SIZE] = malloc(dirty_count * sizeof(*changed));
+    if (changed == NULL) {
+        xSemaphoreGive(g_config_mutex);
+        ESP_LOGE(TAG, "No memory to commit configuration");
+        return ESP_ERR_NO_MEM;
+    }
+
+    nvs_handle_t nvs_handle;
+    esp_err_t err = nvs_open(NVS_NAMESPACE, NVS_READWRITE, &nvs_handle);
+    if (err != ESP_OK) {
+        xSemaphoreGive(g_config_mutex);
+        free(changed);
+        ESP_LOGE(TAG, "Failed to open NVS: %s", esp_err_to_name(err));
+        return err;
+    }
+
+    for (size_t i = 0; i < g_entry_capacity && err == ESP_OK; i++) {
+        if (g_entries[i].key[0] != '\0' && g_entries[i].dirty) {
+            err = store_entry(nvs_handle, &g_entries[i]);
+            if (err != ESP_OK) {
+                ESP_LOGE(TAG,
+                         "Failed to write %s to NVS: %s",
+                         g_entries[i].key,
+                         esp_err_to_name(err));
+            }
+        }
+    }
+    if (err == ESP_OK) {
+        err = nvs_commit(nvs_handle);
+    }
+    nvs_close(nvs_handle);
+
+    if (err != ESP_OK) {
+        xSemaphoreGive(g_config_mutex);
+        free(changed);
+        ESP_LOGE(TAG, "Failed to commit configuration: %s", esp_err_to_name(err));
+        return err;
+    }
+
+    for (size_t i = 0; i < g_entry_capacity; i++) {
+        config_entry_t *entry = &g_entries[i];
+        if (entry->key[0] == '\0' || !entry->dirty) {
+            continue;
+        }
+        strcpy(changed[changed_count++], entry->key);
+        if (entry->type == NVS_TYPE_ANY) {
+            free_entry_unsafe(entry);
+        } else {
+            entry->dirty = false;
+            entry->stored_type = entry->type;
+        }
+    }
+    xSemaphoreGive(g_config_mutex);
+
+    ESP_LOGI(TAG, "Committed %lu configuration keys", (unsigned long)changed_count);
+
+    // Callbacks may read the cache, so they run without the mutex held
+    for (size_t i = 0; i < changed_count; i++) {
+        for (size_t j = 0; j < g_callback_count; j++) {
+            if (strcmp(g_callbacks[j].key, changed[i]) == 0) {
+                g_callbacks[j].callback(changed[i], g_callbacks[j].arg);
+            }
+        }
+    }
+    free(changed);
+    return ESP_OK;
+}
+
+bool nvs_config_add_change_callback(const char *key,
+                                    nvs_config_change_callback_t callback,
+                                    void *arg) {
+    bool added = false;
+    xSemaphoreTake(g_config_mutex, portMAX_DELAY);
+    if (g_callback_count < NVS_CONFIG_MAX_CALLBACKS) {
+        g_callbacks[g_callback_count].key = key;
+        g_callbacks[g_callback_count].callback = callback;
+        g_callbacks[g_callback_count].arg = arg;
+        g_callback_count++;
+        added = true;
+    }
+    xSemaphoreGive(g_config_mutex);
+
+    if (!added) {
+        ESP_LOGE(TAG, "No room for a change callback for %s", key);
+    }
+    return added;
+}
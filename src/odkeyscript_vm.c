@@ -1,11 +1,8 @@
 #include "odkeyscript_vm.h"
+#include <stdlib.h>
 #include <string.h>
 #include "buffer_utils.h"
-#include "esp_log.h"
-#include "freertos/FreeRTOS.h"
-#include "freertos/task.h"
-#include "usb_keyboard.h"
-#include "usb_keyboard_keys.h"
+#include "odkeyscript_vm_port.h"
 
 static const char *TAG = "odkeyscript_vm";
 
@@ -17,23 +14,67 @@ static const char *TAG = "odkeyscript_vm";
 #define OPCODE_SET_COUNTER 0x14
 #define OPCODE_DEC 0x15
 #define OPCODE_JNZ 0x16
+#define OPCODE_PRESS 0x17
+#define OPCODE_TYPE 0x18
+#define OPCODE_PUSH_LOOP 0x19
+#define OPCODE_NEXT 0x1A
+
+// TYPE header: press_ms (2), gap_ms (2), count (1), then count modifier/key pairs
+#define TYPE_HEADER_SIZE 5
+
+// Longest possible instruction (a TYPE with 255 characters)
+#define VM_MAX_INSTRUCTION_SIZE (1 + TYPE_HEADER_SIZE + 2 * 255)
 
 // Helper function to send HID report using callback
 static bool vm_send_hid_report(vm_context_t *ctx,
                                uint8_t modifier,
                                const uint8_t *keys,
                                uint8_t count) {
-    if (ctx->hid_callback) {
+    if (ctx->hid_callback == NULL) {
+        return false;
+    }
+    if (ctx->profile == NULL) {
         return ctx->hid_callback(modifier, keys, count);
     }
-    return false;
+
+    // Profiled opcodes are charged for interpretation only, not for the callbacks
+    uint32_t start = VM_CYCLE_COUNT();
+    bool sent = ctx->hid_callback(modifier, keys, count);
+    ctx->profile_callback_cycles += VM_CYCLE_COUNT() - start;
+    return sent;
 }
 
 // Helper function to sleep for specified milliseconds using callback
 static void vm_sleep_ms(vm_context_t *ctx, uint16_t ms) {
-    if (ctx->delay_callback) {
+    if (ctx->delay_callback == NULL) {
+        return;
+    }
+    if (ctx->profile == NULL) {
         ctx->delay_callback(ms);
+        return;
     }
+
+    uint32_t start = VM_CYCLE_COUNT();
+    ctx->delay_callback(ms);
+    ctx->profile_callback_cycles += VM_CYCLE_COUNT() - start;
+}
+
+// Helper function to clear the first count legacy counters for a run, allocating
+// the counter array the first time a program needs it
+static bool vm_clear_counters(vm_context_t *ctx, uint16_t count) {
+    if (count == 0) {
+        return true;
+    }
+    if (ctx->counters == NULL) {
+        ctx->counters = VM_MALLOC(VM_MAX_COUNTERS * sizeof(uint16_t));
+        if (ctx->counters == NULL) {
+            VM_LOGE(TAG, "Failed to allocate loop counters");
+            return false;
+        }
+    }
+    memset(ctx->counters, 0, count * sizeof(uint16_t));
+    ctx->counters_cleared = count;
+    return true;
 }
 
 // Helper function to clear the zero flag (called by all opcodes except DEC)
@@ -52,136 +93,1399 @@ static bool vm_read_u8(vm_context_t *ctx, uint8_t *out) {
     return true;
 }
 
-static bool vm_read_u16_le(vm_context_t *ctx, uint16_t *out) {
-    if (!bu_read_u16_le(&ctx->program[ctx->pc], ctx->program_size - ctx->pc, out)) {
-        ctx->error = VM_ERROR_INVALID_ADDRESS;
+static bool vm_read_u16_le(vm_context_t *ctx, uint16_t *out) {
+    if (!bu_read_u16_le(&ctx->program[ctx->pc], ctx->program_size - ctx->pc, out)) {
+        ctx->error = VM_ERROR_INVALID_ADDRESS;
+        ctx->state = VM_STATE_ERROR;
+        return false;
+    }
+    ctx->pc += 2;
+    return true;
+}
+
+static bool vm_read_u32_le(vm_context_t *ctx, uint32_t *out) {
+    if (!bu_read_u32_le(&ctx->program[ctx->pc], ctx->program_size - ctx->pc, out)) {
+        ctx->error = VM_ERROR_INVALID_ADDRESS;
+        ctx->state = VM_STATE_ERROR;
+        return false;
+    }
+    ctx->pc += 4;
+    return true;
+}
+
+static bool vm_read_bytes(vm_context_t *ctx, uint8_t *dst, size_t count) {
+    if (!bu_read_bytes(
+            &ctx->program[ctx->pc], ctx->program_size - ctx->pc, dst, count)) {
+        ctx->error = VM_ERROR_INVALID_ADDRESS;
+        ctx->state = VM_STATE_ERROR;
+        return false;
+    }
+    ctx->pc += count;
+    return true;
+}
+
+// Unchecked fetch helpers for verified programs (operands known to be in bounds).
+// For compressed programs the current instruction is always inside the window.
+static inline uint8_t vm_fetch_u8(vm_context_t *ctx) {
+    return ctx->program[ctx->pc++ - ctx->window_start];
+}
+
+static inline uint16_t vm_fetch_u16_le(vm_context_t *ctx) {
+    const uint8_t *p = &ctx->program[ctx->pc - ctx->window_start];
+    ctx->pc += 2;
+    return (uint16_t)(p[0] | (p[1] << 8));
+}
+
+static inline uint32_t vm_fetch_u32_le(vm_context_t *ctx) {
+    const uint8_t *p = &ctx->program[ctx->pc - ctx->window_start];
+    ctx->pc += 4;
+    return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) |
+           ((uint32_t)p[3] << 24);
+}
+
+// Helper function to release all currently pressed keys
+static void vm_release_all_keys(vm_context_t *ctx) {
+    if (ctx->current_key_count > 0 || ctx->current_modifier != 0) {
+        VM_LOGD(TAG,
+                "Releasing all keys (modifier: 0x%02X, keys: %d)",
+                ctx->current_modifier,
+                ctx->current_key_count);
+
+        vm_send_hid_report(ctx, 0, NULL, 0);
+        ctx->current_modifier = 0;
+        ctx->current_key_count = 0;
+        memset(ctx->current_keys, 0, sizeof(ctx->current_keys));
+        ctx->keys_released++;
+    }
+}
+
+// Helper function to send the current key state as a HID report (keycode order)
+static bool vm_send_key_state(vm_context_t *ctx) {
+    uint8_t keys[VM_MAX_KEYS_PRESSED];
+    uint8_t count = 0;
+    for (uint32_t word = 0; word < VM_KEY_BITMAP_WORDS; word++) {
+        uint32_t bits = ctx->current_keys[word];
+        while (bits != 0 && count < VM_MAX_KEYS_PRESSED) {
+            keys[count++] = (uint8_t)(word * 32 + __builtin_ctz(bits));
+            bits &= bits - 1;
+        }
+    }
+    ctx->current_key_count = count;
+
+    return vm_send_hid_report(ctx, ctx->current_modifier, keys, count);
+}
+
+// Replace the pressed key state with the given keys and send a report
+static void vm_press_keys(vm_context_t *ctx,
+                          uint8_t modifier,
+                          const uint8_t *keys,
+                          uint8_t key_count) {
+    ctx->current_modifier = modifier;
+    memset(ctx->current_keys, 0, sizeof(ctx->current_keys));
+    for (uint8_t i = 0; i < key_count; i++) {
+        ctx->current_keys[keys[i] >> 5] |= 1u << (keys[i] & 31);
+    }
+
+    if (!vm_send_key_state(ctx)) {
+        ctx->error = VM_ERROR_HID_ERROR;
+        ctx->state = VM_STATE_ERROR;
+        return;
+    }
+
+    ctx->zero_flag = false;
+    ctx->keys_pressed++;
+}
+
+// Remove the given keys from the pressed key state and send a report
+static void vm_release_keys(vm_context_t *ctx,
+                            uint8_t modifier,
+                            const uint8_t *keys,
+                            uint8_t key_count) {
+    ctx->current_modifier &= ~modifier;
+    for (uint8_t i = 0; i < key_count; i++) {
+        ctx->current_keys[keys[i] >> 5] &= ~(1u << (keys[i] & 31));
+    }
+
+    if (!vm_send_key_state(ctx)) {
+        ctx->error = VM_ERROR_HID_ERROR;
+        ctx->state = VM_STATE_ERROR;
+        return;
+    }
+
+    ctx->zero_flag = false;
+    ctx->keys_released++;
+}
+
+// Press one key, hold it for press_ms, release it, then wait gap_ms if requested
+static void vm_tap_key(vm_context_t *ctx,
+                       uint8_t modifier,
+                       uint8_t key,
+                       uint16_t press_ms,
+                       bool gap,
+                       uint16_t gap_ms) {
+    vm_press_keys(ctx, modifier, &key, 1);
+    if (ctx->state == VM_STATE_ERROR) {
+        return;
+    }
+    vm_sleep_ms(ctx, press_ms);
+
+    vm_release_keys(ctx, modifier, &key, 1);
+    if (ctx->state == VM_STATE_ERROR) {
+        return;
+    }
+    if (gap) {
+        vm_sleep_ms(ctx, gap_ms);
+    }
+    ctx->zero_flag = false;
+}
+
+// Type the next character of a TYPE instruction, returning true after the last one
+static bool vm_type_next(vm_context_t *ctx,
+                         const uint8_t *pairs,
+                         uint8_t count,
+                         uint16_t press_ms,
+                         uint16_t gap_ms) {
+    if (ctx->type_index >= count) {
+        // Empty string
+        ctx->type_index = 0;
+        ctx->zero_flag = false;
+        return true;
+    }
+
+    uint8_t index = ctx->type_index++;
+    bool last = (ctx->type_index == count);
+    vm_tap_key(ctx, pairs[index * 2], pairs[index * 2 + 1], press_ms, !last, gap_ms);
+    if (last) {
+        ctx->type_index = 0;
+    }
+    return last;
+}
+
+bool vm_init(vm_context_t *ctx) {
+    if (ctx == NULL) {
+        return false;
+    }
+
+    memset(ctx, 0, sizeof(vm_context_t));
+    ctx->state = VM_STATE_READY;
+    ctx->current_press_time = 50;  // Default 50ms press time
+    ctx->zero_flag = false;
+    ctx->hid_callback = NULL;
+    ctx->delay_callback = NULL;
+
+    VM_LOGD(TAG, "VM initialized");
+    return true;
+}
+
+void vm_deinit(vm_context_t *ctx) {
+    if (ctx == NULL) {
+        return;
+    }
+
+    VM_FREE(ctx->counters);
+    ctx->counters = NULL;
+    ctx->counters_cleared = 0;
+}
+
+void vm_reset(vm_context_t *ctx) {
+    if (ctx == NULL) {
+        return;
+    }
+
+    // Release any pressed keys before resetting
+    vm_release_all_keys(ctx);
+
+    // Reset the run state, keeping the callbacks. The window, loop stack and
+    // counters are left alone: each run fills its window before reading it, pushes
+    // loops before popping them and clears the counters it uses when it starts.
+    ctx->program = NULL;
+    ctx->program_size = 0;
+    ctx->decoded = NULL;
+    ctx->pc = 0;
+    ctx->compressed = false;
+    memset(&ctx->container, 0, sizeof(ctx->container));
+    ctx->window_start = 0;
+    ctx->window_end = 0;
+    ctx->stream_callback = NULL;
+    ctx->stream_available = 0;
+    ctx->loop_depth = 0;
+    ctx->counters_cleared = 0;
+    ctx->current_modifier = 0;
+    memset(ctx->current_keys, 0, sizeof(ctx->current_keys));
+    ctx->current_key_count = 0;
+    ctx->current_press_time = 50;  // Default 50ms press time
+    ctx->state = VM_STATE_READY;
+    ctx->error = VM_ERROR_NONE;
+    ctx->zero_flag = false;
+    ctx->verified = false;
+    ctx->type_index = 0;
+    ctx->instructions_executed = 0;
+    ctx->keys_pressed = 0;
+    ctx->keys_released = 0;
+    ctx->profile = NULL;
+    ctx->profile_pc = 0;
+    ctx->profile_callback_cycles = 0;
+
+    VM_LOGD(TAG, "VM reset");
+}
+
+// Helper function to validate a single instruction and compute its length
+static vm_error_t vm_verify_instruction(const uint8_t *program,
+                                        uint32_t program_size,
+                                        uint32_t offset,
+                                        uint32_t *length) {
+    const uint8_t *operands = &program[offset + 1];
+    size_t remaining = program_size - offset - 1;
+
+    switch (program[offset]) {
+    case OPCODE_KEYDN:
+    case OPCODE_KEYUP: {
+        // modifier keycount key1 key2 ... keyN
+        uint8_t key_count;
+        if (!bu_read_u8(operands + 1, remaining > 0 ? remaining - 1 : 0, &key_count)) {
+            return VM_ERROR_INVALID_ADDRESS;
+        }
+        if (key_count > VM_MAX_KEYS_PRESSED) {
+            return VM_ERROR_INVALID_OPERAND;
+        }
+        if (remaining < 2u + key_count) {
+            return VM_ERROR_INVALID_ADDRESS;
+        }
+        *length = 3 + key_count;
+        return VM_ERROR_NONE;
+    }
+
+    case OPCODE_KEYUP_ALL:
+        *length = 1;
+        return VM_ERROR_NONE;
+
+    case OPCODE_WAIT:
+        // time_ms
+        if (remaining < 2) {
+            return VM_ERROR_INVALID_ADDRESS;
+        }
+        *length = 3;
+        return VM_ERROR_NONE;
+
+    case OPCODE_SET_COUNTER:
+        // counter_id value
+        if (remaining < 3) {
+            return VM_ERROR_INVALID_ADDRESS;
+        }
+        if (operands[0] >= (VM_MAX_COUNTERS - 1)) {
+            return VM_ERROR_INVALID_ADDRESS;
+        }
+        *length = 4;
+        return VM_ERROR_NONE;
+
+    case OPCODE_DEC:
+        // counter_id
+        if (remaining < 1) {
+            return VM_ERROR_INVALID_ADDRESS;
+        }
+        if (operands[0] >= (VM_MAX_COUNTERS - 1)) {
+            return VM_ERROR_INVALID_ADDRESS;
+        }
+        *length = 2;
+        return VM_ERROR_NONE;
+
+    case OPCODE_JNZ:
+        // address (target is checked once all instruction boundaries are known)
+        if (remaining < 4) {
+            return VM_ERROR_INVALID_ADDRESS;
+        }
+        *length = 5;
+        return VM_ERROR_NONE;
+
+    case OPCODE_PRESS:
+        // modifier key press_ms gap_ms
+        if (remaining < 6) {
+            return VM_ERROR_INVALID_ADDRESS;
+        }
+        *length = 7;
+        return VM_ERROR_NONE;
+
+    case OPCODE_TYPE:
+        // press_ms gap_ms count (modifier key)*count
+        if (remaining < TYPE_HEADER_SIZE ||
+            remaining < TYPE_HEADER_SIZE + 2u * operands[4]) {
+            return VM_ERROR_INVALID_ADDRESS;
+        }
+        *length = 1 + TYPE_HEADER_SIZE + 2 * operands[4];
+        return VM_ERROR_NONE;
+
+    case OPCODE_PUSH_LOOP:
+        // count
+        if (remaining < 4) {
+            return VM_ERROR_INVALID_ADDRESS;
+        }
+        *length = 5;
+        return VM_ERROR_NONE;
+
+    case OPCODE_NEXT:
+        // address (checked against the loop being closed)
+        if (remaining < 4) {
+            return VM_ERROR_INVALID_ADDRESS;
+        }
+        *length = 5;
+        return VM_ERROR_NONE;
+
+    default:
+        return VM_ERROR_INVALID_OPCODE;
+    }
+}
+
+bool vm_is_compressed(const uint8_t *program, uint32_t program_size) {
+    uint32_t magic;
+    return program != NULL && bu_read_u32_le(program, program_size, &magic) &&
+           magic == VM_CONTAINER_MAGIC;
+}
+
+// Helper function to parse a container header and sanity-check its block table
+static bool vm_container_parse(const uint8_t *program,
+                               uint32_t program_size,
+                               vm_container_t *container) {
+    if (!vm_is_compressed(program, program_size) ||
+        program_size < VM_CONTAINER_HEADER_SIZE ||
+        program[4] != VM_CONTAINER_VERSION) {
+        return false;
+    }
+
+    uint16_t block_count;
+    uint32_t uncompressed_size;
+    bu_read_u16_le(&program[6], 2, &block_count);
+    bu_read_u32_le(&program[8], 4, &uncompressed_size);
+    uint32_t table_size = (uint32_t)block_count * VM_CONTAINER_BLOCK_ENTRY_SIZE;
+    if (block_count == 0 || uncompressed_size == 0 ||
+        table_size > program_size - VM_CONTAINER_HEADER_SIZE) {
+        return false;
+    }
+
+    container->blocks = &program[VM_CONTAINER_HEADER_SIZE];
+    container->data = container->blocks + table_size;
+    container->data_size = program_size - VM_CONTAINER_HEADER_SIZE - table_size;
+    container->block_count = block_count;
+    container->uncompressed_size = uncompressed_size;
+
+    // Blocks must cover the program in order, none larger than the window, and
+    // their compressed data must appear in the same order
+    uint32_t previous_start = 0;
+    uint32_t previous_data_offset = 0;
+    for (uint32_t i = 0; i < block_count; i++) {
+        const uint8_t *entry = &container->blocks[i * VM_CONTAINER_BLOCK_ENTRY_SIZE];
+        uint32_t start;
+        uint32_t data_offset;
+        bu_read_u32_le(entry, 4, &start);
+        bu_read_u32_le(entry + 4, 4, &data_offset);
+        if (i == 0) {
+            if (start != 0 || data_offset != 0) {
+                return false;
+            }
+        } else if (start <= previous_start ||
+                   start - previous_start > VM_COMPRESSED_BLOCK_SIZE ||
+                   data_offset < previous_data_offset) {
+            return false;
+        }
+        if (data_offset > container->data_size) {
+            return false;
+        }
+        previous_start = start;
+        previous_data_offset = data_offset;
+    }
+    return uncompressed_size > previous_start &&
+           uncompressed_size - previous_start <= VM_COMPRESSED_BLOCK_SIZE;
+}
+
+// Helper function to decompress an LZ4 block, returning its size or -1 if the
+// data is malformed or would overflow dst
+static int32_t vm_lz4_decompress(const uint8_t *src,
+                                 uint32_t src_size,
+                                 uint8_t *dst,
+                                 uint32_t dst_capacity) {
+    uint32_t in = 0;
+    uint32_t out = 0;
+
+    while (in < src_size) {
+        uint8_t token = src[in++];
+
+        // Literal run, with 255-continued length extension
+        uint32_t literal_length = token >> 4;
+        if (literal_length == 15) {
+            uint8_t extra;
+            do {
+                if (in >= src_size) {
+                    return -1;
+                }
+                extra = src[in++];
+                literal_length += extra;
+            } while (extra == 255);
+        }
+        if (literal_length > src_size - in || literal_length > dst_capacity - out) {
+            return -1;
+        }
+        memcpy(&dst[out], &src[in], literal_length);
+        in += literal_length;
+        out += literal_length;
+
+        // The last sequence ends after its literals
+        if (in >= src_size) {
+            break;
+        }
+
+        // Match: 16-bit back-reference offset, then length extension
+        if (src_size - in < 2) {
+            return -1;
+        }
+        uint32_t distance = (uint32_t)(src[in] | (src[in + 1] << 8));
+        in += 2;
+        if (distance == 0 || distance > out) {
+            return -1;
+        }
+        uint32_t match_length = (token & 0x0F) + 4;
+        if ((token & 0x0F) == 15) {
+            uint8_t extra;
+            do {
+                if (in >= src_size) {
+                    return -1;
+                }
+                extra = src[in++];
+                match_length += extra;
+            } while (extra == 255);
+        }
+        if (match_length > dst_capacity - out) {
+            return -1;
+        }
+        // Byte by byte: matches may overlap their own output
+        for (uint32_t i = 0; i < match_length; i++) {
+            dst[out] = dst[out - distance];
+            out++;
+        }
+    }
+
+    return (int32_t)out;
+}
+
+// Helper function to get the program offset of a container block's first byte
+static uint32_t vm_container_block_start(const vm_container_t *container,
+                                         uint32_t index) {
+    const uint8_t *entry = &container->blocks[index * VM_CONTAINER_BLOCK_ENTRY_SIZE];
+    uint32_t start;
+    bu_read_u32_le(entry, 4, &start);
+    return start;
+}
+
+// Helper function to decompress one container block into dst, which must have
+// room for VM_COMPRESSED_BLOCK_SIZE bytes
+static bool vm_container_load_block(const vm_container_t *container,
+                                    uint32_t index,
+                                    uint8_t *dst,
+                                    uint32_t *start,
+                                    uint32_t *length) {
+    const uint8_t *entry = &container->blocks[index * VM_CONTAINER_BLOCK_ENTRY_SIZE];
+    uint32_t data_offset;
+    uint32_t end;
+    uint32_t data_end;
+    bu_read_u32_le(entry, 4, start);
+    bu_read_u32_le(entry + 4, 4, &data_offset);
+    if (index + 1 < container->block_count) {
+        bu_read_u32_le(entry + VM_CONTAINER_BLOCK_ENTRY_SIZE, 4, &end);
+        bu_read_u32_le(entry + VM_CONTAINER_BLOCK_ENTRY_SIZE + 4, 4, &data_end);
+    } else {
+        end = container->uncompressed_size;
+        data_end = container->data_size;
+    }
+    *length = end - *start;
+
+    int32_t decompressed = vm_lz4_decompress(
+        &container->data[data_offset], data_end - data_offset, dst, *length);
+    return decompressed == (int32_t)*length;
+}
+
+// Helper function to find the container block holding a program offset
+static uint32_t vm_container_find_block(const vm_container_t *container,
+                                        uint32_t offset) {
+    uint32_t low = 0;
+    uint32_t high = container->block_count - 1;
+    while (low < high) {
+        uint32_t mid = low + (high - low + 1) / 2;
+        if (vm_container_block_start(container, mid) <= offset) {
+            low = mid;
+        } else {
+            high = mid - 1;
+        }
+    }
+    return low;
+}
+
+// Loop nesting tracked across the blocks of a program during verification
+typedef struct {
+    uint32_t loop_starts[VM_MAX_LOOP_DEPTH];  // Body offset of each open PUSH_LOOP
+    uint8_t loop_depth;
+    uint16_t counters;  // Highest legacy counter ID used + 1
+} vm_verify_state_t;
+
+// Helper function to validate the instructions in code, which holds program bytes
+// [base, base + code_size), and mark where each one outside a PUSH_LOOP loop starts
+// in the bitmap. Only those are valid JNZ targets, so JNZ cannot unbalance the loop
+// stack.
+static vm_error_t vm_verify_code(const uint8_t *code,
+                                 uint32_t code_size,
+                                 uint32_t base,
+                                 uint8_t *boundaries,
+                                 vm_verify_state_t *state,
+                                 uint32_t *error_offset) {
+    uint32_t offset = 0;
+    uint32_t length = 0;
+    while (offset < code_size) {
+        uint32_t address = base + offset;
+        *error_offset = address;
+        vm_error_t error = vm_verify_instruction(code, code_size, offset, &length);
+        if (error != VM_ERROR_NONE) {
+            return error;
+        }
+
+        uint8_t opcode = code[offset];
+        if (opcode == OPCODE_NEXT) {
+            uint32_t target;
+            bu_read_u32_le(&code[offset + 1], 4, &target);
+            if (state->loop_depth == 0) {
+                return VM_ERROR_INVALID_PROGRAM;
+            }
+            if (target != state->loop_starts[state->loop_depth - 1]) {
+                return VM_ERROR_INVALID_ADDRESS;
+            }
+        }
+
+        if (state->loop_depth == 0) {
+            boundaries[address / 8] |= (uint8_t)(1 << (address % 8));
+        } else if (opcode == OPCODE_JNZ) {
+            return VM_ERROR_INVALID_ADDRESS;
+        }
+
+        if (opcode == OPCODE_SET_COUNTER || opcode == OPCODE_DEC) {
+            if (code[offset + 1] >= state->counters) {
+                state->counters = code[offset + 1] + 1;
+            }
+        } else if (opcode == OPCODE_PUSH_LOOP) {
+            if (state->loop_depth >= VM_MAX_LOOP_DEPTH) {
+                return VM_ERROR_INVALID_OPERAND;
+            }
+            state->loop_starts[state->loop_depth++] = address + length;
+        } else if (opcode == OPCODE_NEXT) {
+            state->loop_depth--;
+        }
+        offset += length;
+    }
+    return VM_ERROR_NONE;
+}
+
+// Helper function to check that every jump in validated code lands on an
+// instruction boundary
+static vm_error_t vm_verify_jumps(const uint8_t *code,
+                                  uint32_t code_size,
+                                  uint32_t base,
+                                  uint32_t program_size,
+                                  const uint8_t *boundaries,
+                                  uint32_t *error_offset) {
+    uint32_t offset = 0;
+    uint32_t length = 0;
+    while (offset < code_size) {
+        vm_verify_instruction(code, code_size, offset, &length);
+        if (code[offset] == OPCODE_JNZ) {
+            uint32_t address;
+            bu_read_u32_le(&code[offset + 1], 4, &address);
+            if (address >= program_size ||
+                (boundaries[address / 8] & (1 << (address % 8))) == 0) {
+                *error_offset = base + offset;
+                return VM_ERROR_INVALID_ADDRESS;
+            }
+        }
+        offset += length;
+    }
+    return VM_ERROR_NONE;
+}
+
+// Helper function to run one verification pass over every block of a container
+static vm_error_t vm_verify_container(const vm_container_t *container,
+                                      uint8_t *block,
+                                      uint8_t *boundaries,
+                                      vm_verify_state_t *state,
+                                      bool check_jumps,
+                                      uint32_t *error_offset) {
+    for (uint32_t i = 0; i < container->block_count; i++) {
+        uint32_t start;
+        uint32_t length;
+        if (!vm_container_load_block(container, i, block, &start, &length)) {
+            *error_offset = start;
+            return VM_ERROR_INVALID_PROGRAM;
+        }
+
+        vm_error_t error;
+        if (check_jumps) {
+            error = vm_verify_jumps(block,
+                                    length,
+                                    start,
+                                    container->uncompressed_size,
+                                    boundaries,
+                                    error_offset);
+        } else {
+            error = vm_verify_code(
+                block, length, start, boundaries, state, error_offset);
+        }
+        if (error != VM_ERROR_NONE) {
+            return error;
+        }
+    }
+    return VM_ERROR_NONE;
+}
+
+// Helper function to verify a program, also returning the number of legacy counters
+// it uses
+static vm_error_t vm_verify_program(const uint8_t *program,
+                                    uint32_t program_size,
+                                    uint16_t *counters) {
+    if (program == NULL || program_size == 0) {
+        return VM_ERROR_INVALID_PROGRAM;
+    }
+
+    vm_container_t container;
+    bool compressed = vm_is_compressed(program, program_size);
+    if (compressed && !vm_container_parse(program, program_size, &container)) {
+        VM_LOGE(TAG, "Invalid compressed program container");
+        return VM_ERROR_INVALID_PROGRAM;
+    }
+    uint32_t code_size = compressed ? container.uncompressed_size : program_size;
+
+    // One bit per program byte, set where an instruction starts
+    size_t bitmap_size = (code_size + 7) / 8;
+    uint8_t *boundaries = VM_CALLOC(1, bitmap_size);
+    if (boundaries == NULL) {
+        VM_LOGW(TAG,
+                "Failed to allocate %lu bytes for program verification",
+                (unsigned long)bitmap_size);
+        return VM_ERROR_OUT_OF_MEMORY;
+    }
+
+    // First pass validates every instruction and records where each one starts;
+    // the second checks that every jump lands on an instruction boundary
+    vm_error_t error;
+    uint32_t offset = 0;
+    vm_verify_state_t state = {0};
+    if (!compressed) {
+        error = vm_verify_code(program, program_size, 0, boundaries, &state, &offset);
+        if (error == VM_ERROR_NONE && state.loop_depth == 0) {
+            error = vm_verify_jumps(
+                program, program_size, 0, program_size, boundaries, &offset);
+        }
+    } else {
+        // Blocks are decompressed into a scratch buffer one at a time, twice
+        uint8_t *block = VM_MALLOC(VM_COMPRESSED_BLOCK_SIZE);
+        if (block == NULL) {
+            VM_FREE(boundaries);
+            VM_LOGW(TAG, "Failed to allocate block buffer for program verification");
+            return VM_ERROR_OUT_OF_MEMORY;
+        }
+        error = vm_verify_container(
+            &container, block, boundaries, &state, false, &offset);
+        if (error == VM_ERROR_NONE && state.loop_depth == 0) {
+            error = vm_verify_container(
+                &container, block, boundaries, &state, true, &offset);
+        }
+        VM_FREE(block);
+    }
+
+    VM_FREE(boundaries);
+
+    // Every PUSH_LOOP needs its NEXT
+    if (error == VM_ERROR_NONE && state.loop_depth > 0) {
+        error = VM_ERROR_INVALID_PROGRAM;
+        offset = code_size;
+    }
+
+    if (error != VM_ERROR_NONE) {
+        VM_LOGE(TAG,
+                "Program verification failed at offset %lu: %s",
+                (unsigned long)offset,
+                vm_error_to_string(error));
+    } else if (counters != NULL) {
+        *counters = state.counters;
+    }
+    return error;
+}
+
+vm_error_t vm_verify(const uint8_t *program, uint32_t program_size) {
+    return vm_verify_program(program, program_size, NULL);
+}
+
+// Decode a compressed container by decompressing it into a temporary buffer
+static vm_error_t vm_decode_compressed(const uint8_t *program,
+                                       uint32_t program_size,
+                                       uint32_t program_hash,
+                                       size_t max_decoded_size,
+                                       vm_decoded_program_t *decoded) {
+    vm_container_t container;
+    vm_error_t error = vm_verify(program, program_size);
+    if (error != VM_ERROR_NONE) {
+        return error;
+    }
+    vm_container_parse(program, program_size, &container);
+
+    // Blocks are decompressed in place, so leave room for a full last block
+    uint32_t last_start =
+        vm_container_block_start(&container, container.block_count - 1);
+    uint8_t *plain = VM_MALLOC(last_start + VM_COMPRESSED_BLOCK_SIZE);
+    if (plain == NULL) {
+        VM_LOGW(TAG,
+                "Failed to allocate %lu bytes to decompress program",
+                (unsigned long)container.uncompressed_size);
+        return VM_ERROR_OUT_OF_MEMORY;
+    }
+
+    for (uint32_t i = 0; i < container.block_count; i++) {
+        uint32_t start = vm_container_block_start(&container, i);
+        uint32_t length;
+        vm_container_load_block(&container, i, &plain[start], &start, &length);
+    }
+
+    error = vm_decode(
+        plain, container.uncompressed_size, program_hash, max_decoded_size, decoded);
+    if (error == VM_ERROR_NONE) {
+        decoded->program_size = program_size;
+    }
+    VM_FREE(plain);
+    return error;
+}
+
+vm_error_t vm_decode(const uint8_t *program,
+                     uint32_t program_size,
+                     uint32_t program_hash,
+                     size_t max_decoded_size,
+                     vm_decoded_program_t *decoded) {
+    if (decoded == NULL) {
+        return VM_ERROR_INVALID_PROGRAM;
+    }
+    memset(decoded, 0, sizeof(*decoded));
+
+    if (vm_is_compressed(program, program_size)) {
+        return vm_decode_compressed(
+            program, program_size, program_hash, max_decoded_size, decoded);
+    }
+
+    uint16_t counters = 0;
+    vm_error_t error = vm_verify_program(program, program_size, &counters);
+    if (error != VM_ERROR_NONE) {
+        return error;
+    }
+
+    // Count instructions and keycodes so everything can be allocated up front
+    uint32_t instruction_count = 0;
+    uint32_t keys_size = 0;
+    uint32_t offset = 0;
+    uint32_t length = 0;
+    while (offset < program_size) {
+        vm_verify_instruction(program, program_size, offset, &length);
+        if (program[offset] == OPCODE_KEYDN || program[offset] == OPCODE_KEYUP) {
+            keys_size += program[offset + 2];
+        } else if (program[offset] == OPCODE_TYPE) {
+            keys_size += length - 1;
+        }
+        instruction_count++;
+        offset += length;
+    }
+
+    size_t decoded_size =
+        (size_t)instruction_count * sizeof(vm_instruction_t) + keys_size;
+    if (decoded_size > max_decoded_size) {
+        VM_LOGW(TAG,
+                "Decoded program too large: %lu bytes (max: %lu)",
+                (unsigned long)decoded_size,
+                (unsigned long)max_decoded_size);
+        return VM_ERROR_OUT_OF_MEMORY;
+    }
+
+    vm_instruction_t *instructions =
+        VM_MALLOC(instruction_count * sizeof(vm_instruction_t));
+    uint8_t *keys = keys_size > 0 ? VM_MALLOC(keys_size) : NULL;
+    // Bytecode offset of each instruction, used to resolve jump targets
+    uint32_t *offsets = VM_MALLOC(instruction_count * sizeof(uint32_t));
+    if (instructions == NULL || (keys_size > 0 && keys == NULL) || offsets == NULL) {
+        VM_LOGE(TAG,
+                "Failed to allocate %lu bytes for decoded program",
+                (unsigned long)decoded_size);
+        VM_FREE(instructions);
+        VM_FREE(keys);
+        VM_FREE(offsets);
+        return VM_ERROR_OUT_OF_MEMORY;
+    }
+
+    // Decode each instruction into its fixed-size form
+    uint32_t index = 0;
+    uint32_t key_offset = 0;
+    offset = 0;
+    while (offset < program_size) {
+        const uint8_t *operands = &program[offset + 1];
+        vm_instruction_t *instruction = &instructions[index];
+
+        vm_verify_instruction(program, program_size, offset, &length);
+        memset(instruction, 0, sizeof(*instruction));
+        instruction->opcode = program[offset];
+        offsets[index] = offset;
+
+        switch (instruction->opcode) {
+        case OPCODE_KEYDN:
+        case OPCODE_KEYUP:
+            instruction->arg = operands[0];
+            instruction->key_count = operands[1];
+            instruction->operand = key_offset;
+            if (instruction->key_count > 0) {
+                memcpy(&keys[key_offset], &operands[2], instruction->key_count);
+                key_offset += instruction->key_count;
+            }
+            break;
+
+        case OPCODE_WAIT:
+            instruction->operand = (uint32_t)(operands[0] | (operands[1] << 8));
+            break;
+
+        case OPCODE_SET_COUNTER:
+            instruction->arg = operands[0];
+            instruction->operand = (uint32_t)(operands[1] | (operands[2] << 8));
+            break;
+
+        case OPCODE_DEC:
+            instruction->arg = operands[0];
+            break;
+
+        case OPCODE_JNZ:
+        case OPCODE_NEXT:
+            // Byte offset for now, resolved to an index below
+            bu_read_u32_le(operands, 4, &instruction->operand);
+            break;
+
+        case OPCODE_PUSH_LOOP:
+            bu_read_u32_le(operands, 4, &instruction->operand);
+            break;
+
+        case OPCODE_PRESS:
+            instruction->arg = operands[0];
+            instruction->key = operands[1];
+            bu_read_u32_le(&operands[2], 4, &instruction->operand);
+            break;
+
+        case OPCODE_TYPE:
+            // The key pool holds the timing header followed by the pairs
+            instruction->key_count = operands[4];
+            instruction->operand = key_offset;
+            memcpy(&keys[key_offset], operands, length - 1);
+            key_offset += length - 1;
+            break;
+
+        default:
+            break;
+        }
+
+        index++;
+        offset += length;
+    }
+
+    // Resolve jump targets; offsets is sorted and the verifier guarantees a match
+    for (uint32_t i = 0; i < instruction_count; i++) {
+        if (instructions[i].opcode != OPCODE_JNZ &&
+            instructions[i].opcode != OPCODE_NEXT) {
+            continue;
+        }
+        uint32_t low = 0;
+        uint32_t high = instruction_count - 1;
+        while (low < high) {
+            uint32_t mid = low + (high - low) / 2;
+            if (offsets[mid] < instructions[i].operand) {
+                low = mid + 1;
+            } else {
+                high = mid;
+            }
+        }
+        instructions[i].operand = low;
+    }
+
+    VM_FREE(offsets);
+
+    decoded->instructions = instructions;
+    decoded->instruction_count = instruction_count;
+    decoded->keys = keys;
+    decoded->keys_size = keys_size;
+    decoded->program_size = program_size;
+    decoded->program_hash = program_hash;
+    decoded->counters = counters;
+
+    VM_LOGI(TAG,
+            "Decoded program: %lu instructions (%lu bytes)",
+            (unsigned long)instruction_count,
+            (unsigned long)decoded_size);
+    return VM_ERROR_NONE;
+}
+
+void vm_decoded_free(vm_decoded_program_t *decoded) {
+    if (decoded == NULL) {
+        return;
+    }
+
+    VM_FREE(decoded->instructions);
+    VM_FREE(decoded->keys);
+    memset(decoded, 0, sizeof(*decoded));
+}
+
+vm_error_t vm_start(vm_context_t *ctx,
+                    const uint8_t *program,
+                    uint32_t program_size,
+                    vm_hid_callback_t hid_callback,
+                    vm_delay_callback_t delay_callback) {
+    vm_verification_t verification = {0};
+    return vm_start_with_verification(
+        ctx, program, program_size, &verification, hid_callback, delay_callback);
+}
+
+vm_error_t vm_start_with_verification(vm_context_t *ctx,
+                                      const uint8_t *program,
+                                      uint32_t program_size,
+                                      vm_verification_t *verification,
+                                      vm_hid_callback_t hid_callback,
+                                      vm_delay_callback_t delay_callback) {
+    if (ctx == NULL || program == NULL || program_size == 0 || verification == NULL ||
+        hid_callback == NULL || delay_callback == NULL) {
+        return VM_ERROR_INVALID_PROGRAM;
+    }
+
+    // Verify the whole program up front so execution can skip runtime checks.
+    // Compressed programs have no checked fallback: the checked path reads the
+    // program directly instead of through the window.
+    bool compressed = vm_is_compressed(program, program_size);
+    vm_error_t verify_result;
+    uint16_t counters = 0;
+    if (verification->valid) {
+        verify_result = verification->error;
+        counters = verification->counters;
+    } else {
+        verify_result = vm_verify_program(program, program_size, &counters);
+        verification->valid = (verify_result != VM_ERROR_OUT_OF_MEMORY);
+        verification->error = verify_result;
+        verification->counters = counters;
+    }
+    if (verify_result == VM_ERROR_OUT_OF_MEMORY && !compressed) {
+        VM_LOGW(TAG, "Program not verified, falling back to checked execution");
+    } else if (verify_result != VM_ERROR_NONE) {
+        return verify_result;
+    }
+
+    // Initialize VM state. Unverified programs clear every counter when they first
+    // use one.
+    vm_reset(ctx);
+    if (!vm_clear_counters(ctx, counters)) {
+        return VM_ERROR_OUT_OF_MEMORY;
+    }
+    if (compressed) {
+        // The window starts empty, so the first step loads block 0
+        vm_container_parse(program, program_size, &ctx->container);
+        ctx->compressed = true;
+        ctx->program = ctx->window;
+        ctx->program_size = ctx->container.uncompressed_size;
+        VM_LOGI(TAG,
+                "Compressed program: %lu bytes in %u blocks",
+                (unsigned long)program_size,
+                (unsigned)ctx->container.block_count);
+    } else {
+        ctx->program = program;
+        ctx->program_size = program_size;
+    }
+    ctx->pc = 0;
+    ctx->state = VM_STATE_RUNNING;
+    ctx->verified = (verify_result == VM_ERROR_NONE);
+    ctx->hid_callback = hid_callback;
+    ctx->delay_callback = delay_callback;
+
+    VM_LOGI(TAG,
+            "Starting VM execution (program size: %lu bytes)",
+            (unsigned long)ctx->program_size);
+    return VM_ERROR_NONE;
+}
+
+vm_error_t vm_start_streaming(vm_context_t *ctx,
+                              const uint8_t *program,
+                              uint32_t program_size,
+                              vm_hid_callback_t hid_callback,
+                              vm_delay_callback_t delay_callback,
+                              vm_stream_callback_t stream_callback) {
+    if (ctx == NULL || program == NULL || program_size == 0 || hid_callback == NULL ||
+        delay_callback == NULL || stream_callback == NULL) {
+        return VM_ERROR_INVALID_PROGRAM;
+    }
+
+    // Initialize VM state; nothing is known to be available until the first step
+    vm_reset(ctx);
+    ctx->program = program;
+    ctx->program_size = program_size;
+    ctx->pc = 0;
+    ctx->state = VM_STATE_RUNNING;
+    ctx->verified = false;
+    ctx->stream_callback = stream_callback;
+    ctx->stream_available = 0;
+    ctx->hid_callback = hid_callback;
+    ctx->delay_callback = delay_callback;
+
+    VM_LOGI(TAG,
+            "Starting VM execution (streaming program: %lu bytes)",
+            (unsigned long)program_size);
+    return VM_ERROR_NONE;
+}
+
+// Helper function to wait until the whole instruction at the program counter of a
+// streaming program has been written. Returns false if it is not available yet.
+static bool vm_stream_ready(vm_context_t *ctx) {
+    // Instruction lengths depend on their operands, so wait for the longest one
+    uint32_t needed = ctx->program_size - ctx->pc > VM_MAX_INSTRUCTION_SIZE
+                          ? ctx->pc + VM_MAX_INSTRUCTION_SIZE
+                          : ctx->program_size;
+    if (ctx->stream_available >= needed) {
+        return true;
+    }
+
+    if (!ctx->stream_callback(needed, &ctx->stream_available)) {
+        ctx->error = VM_ERROR_INVALID_PROGRAM;
+        ctx->state = VM_STATE_ERROR;
+        vm_release_all_keys(ctx);
+        VM_LOGE(TAG,
+                "Program stream ended at %lu of %lu bytes",
+                (unsigned long)ctx->stream_available,
+                (unsigned long)ctx->program_size);
+        return false;
+    }
+    return ctx->stream_available >= needed;
+}
+
+vm_error_t vm_start_decoded(vm_context_t *ctx,
+                            const vm_decoded_program_t *decoded,
+                            vm_hid_callback_t hid_callback,
+                            vm_delay_callback_t delay_callback) {
+    if (ctx == NULL || decoded == NULL || decoded->instructions == NULL ||
+        decoded->instruction_count == 0 || hid_callback == NULL ||
+        delay_callback == NULL) {
+        return VM_ERROR_INVALID_PROGRAM;
+    }
+
+    // Initialize VM state
+    vm_reset(ctx);
+    if (!vm_clear_counters(ctx, decoded->counters)) {
+        return VM_ERROR_OUT_OF_MEMORY;
+    }
+    ctx->decoded = decoded;
+    ctx->program_size = decoded->program_size;
+    ctx->pc = 0;
+    ctx->state = VM_STATE_RUNNING;
+    ctx->verified = true;
+    ctx->hid_callback = hid_callback;
+    ctx->delay_callback = delay_callback;
+
+    VM_LOGI(TAG,
+            "Starting VM execution (decoded program: %lu instructions)",
+            (unsigned long)decoded->instruction_count);
+    return VM_ERROR_NONE;
+}
+
+// Execute the next instruction of a decoded program
+static vm_error_t vm_step_decoded(vm_context_t *ctx) {
+    const vm_instruction_t *instruction = &ctx->decoded->instructions[ctx->pc++];
+    if (ctx->type_index == 0) {
+        ctx->instructions_executed++;
+    }
+
+    switch (instruction->opcode) {
+    case OPCODE_KEYDN:
+        vm_press_keys(ctx,
+                      instruction->arg,
+                      &ctx->decoded->keys[instruction->operand],
+                      instruction->key_count);
+        break;
+
+    case OPCODE_KEYUP:
+        vm_release_keys(ctx,
+                        instruction->arg,
+                        &ctx->decoded->keys[instruction->operand],
+                        instruction->key_count);
+        break;
+
+    case OPCODE_KEYUP_ALL:
+        vm_release_all_keys(ctx);
+        ctx->zero_flag = false;
+        break;
+
+    case OPCODE_WAIT:
+        vm_sleep_ms(ctx, (uint16_t)instruction->operand);
+        ctx->zero_flag = false;
+        break;
+
+    case OPCODE_SET_COUNTER:
+        ctx->counters[instruction->arg] = (uint16_t)instruction->operand;
+        ctx->zero_flag = false;
+        break;
+
+    case OPCODE_DEC:
+        if (ctx->counters[instruction->arg] > 0) {
+            ctx->counters[instruction->arg]--;
+        }
+        ctx->zero_flag = (ctx->counters[instruction->arg] == 0);
+        break;
+
+    case OPCODE_JNZ:
+        if (!ctx->zero_flag) {
+            ctx->pc = instruction->operand;
+        }
+        ctx->zero_flag = false;
+        break;
+
+    case OPCODE_PUSH_LOOP:
+        ctx->loop_stack[ctx->loop_depth++] = instruction->operand;
+        ctx->zero_flag = false;
+        break;
+
+    case OPCODE_NEXT:
+        if (ctx->loop_stack[ctx->loop_depth - 1] > 1) {
+            ctx->loop_stack[ctx->loop_depth - 1]--;
+            ctx->pc = instruction->operand;
+        } else {
+            ctx->loop_depth--;
+        }
+        ctx->zero_flag = false;
+        break;
+
+    case OPCODE_PRESS:
+        vm_tap_key(ctx,
+                   instruction->arg,
+                   instruction->key,
+                   (uint16_t)instruction->operand,
+                   true,
+                   (uint16_t)(instruction->operand >> 16));
+        break;
+
+    case OPCODE_TYPE: {
+        const uint8_t *header = &ctx->decoded->keys[instruction->operand];
+        if (!vm_type_next(ctx,
+                          &header[TYPE_HEADER_SIZE],
+                          instruction->key_count,
+                          (uint16_t)(header[0] | (header[1] << 8)),
+                          (uint16_t)(header[2] | (header[3] << 8)))) {
+            ctx->pc--;  // Stay on this instruction for the next character
+        }
+        break;
+    }
+
+    default:
+        // Unreachable for decoded programs
+        ctx->error = VM_ERROR_INVALID_OPCODE;
         ctx->state = VM_STATE_ERROR;
-        return false;
+        break;
     }
-    ctx->pc += 2;
-    return true;
-}
 
-static bool vm_read_u32_le(vm_context_t *ctx, uint32_t *out) {
-    if (!bu_read_u32_le(&ctx->program[ctx->pc], ctx->program_size - ctx->pc, out)) {
-        ctx->error = VM_ERROR_INVALID_ADDRESS;
-        ctx->state = VM_STATE_ERROR;
-        return false;
+    if (ctx->state == VM_STATE_ERROR) {
+        vm_release_all_keys(ctx);
+        VM_LOGE(TAG, "Program failed with error: %s", vm_error_to_string(ctx->error));
     }
-    ctx->pc += 4;
-    return true;
+
+    return ctx->error;
 }
 
-static bool vm_read_bytes(vm_context_t *ctx, uint8_t *dst, size_t count) {
-    if (!bu_read_bytes(
-            &ctx->program[ctx->pc], ctx->program_size - ctx->pc, dst, count)) {
-        ctx->error = VM_ERROR_INVALID_ADDRESS;
-        ctx->state = VM_STATE_ERROR;
+// Helper function to decompress the block holding the program counter into the
+// window
+static bool vm_load_window(vm_context_t *ctx) {
+    uint32_t index = vm_container_find_block(&ctx->container, ctx->pc);
+    uint32_t start;
+    uint32_t length;
+    if (!vm_container_load_block(
+            &ctx->container, index, ctx->window, &start, &length)) {
+        ctx->window_start = 0;
+        ctx->window_end = 0;
         return false;
     }
-    ctx->pc += count;
+    ctx->window_start = start;
+    ctx->window_end = start + length;
+    VM_LOGD(TAG,
+            "Loaded program block %lu (offsets %lu-%lu)",
+            (unsigned long)index,
+            (unsigned long)start,
+            (unsigned long)(ctx->window_end - 1));
     return true;
 }
 
-// Helper function to release all currently pressed keys
-static void vm_release_all_keys(vm_context_t *ctx) {
-    if (ctx->current_key_count > 0 || ctx->current_modifier != 0) {
-        ESP_LOGD(TAG,
-                 "Releasing all keys (modifier: 0x%02X, keys: %d)",
-                 ctx->current_modifier,
-                 ctx->current_key_count);
+// Execute the next opcode of a verified program without bounds or operand checks
+static vm_error_t vm_step_verified(vm_context_t *ctx) {
+    uint32_t start = ctx->pc;
+    uint8_t opcode = vm_fetch_u8(ctx);
+    if (ctx->type_index == 0) {
+        ctx->instructions_executed++;
+    }
 
-        vm_send_hid_report(ctx, 0, NULL, 0);
-        ctx->current_modifier = 0;
-        ctx->current_key_count = 0;
-        memset(ctx->current_keys, 0, sizeof(ctx->current_keys));
-        ctx->keys_released++;
+    switch (opcode) {
+    case OPCODE_KEYDN: {
+        uint8_t modifier = vm_fetch_u8(ctx);
+        uint8_t key_count = vm_fetch_u8(ctx);
+        const uint8_t *keys = &ctx->program[ctx->pc - ctx->window_start];
+        ctx->pc += key_count;
+        vm_press_keys(ctx, modifier, keys, key_count);
+        break;
     }
-}
 
-bool vm_init(vm_context_t *ctx) {
-    if (ctx == NULL) {
-        return false;
+    case OPCODE_KEYUP: {
+        uint8_t modifier = vm_fetch_u8(ctx);
+        uint8_t key_count = vm_fetch_u8(ctx);
+        const uint8_t *keys = &ctx->program[ctx->pc - ctx->window_start];
+        ctx->pc += key_count;
+        vm_release_keys(ctx, modifier, keys, key_count);
+        break;
     }
 
-    memset(ctx, 0, sizeof(vm_context_t));
-    ctx->state = VM_STATE_READY;
-    ctx->current_press_time = 50;  // Default 50ms press time
-    ctx->zero_flag = false;
-    ctx->hid_callback = NULL;
-    ctx->delay_callback = NULL;
+    case OPCODE_KEYUP_ALL:
+        vm_release_all_keys(ctx);
+        ctx->zero_flag = false;
+        break;
 
-    ESP_LOGD(TAG, "VM initialized");
-    return true;
-}
+    case OPCODE_WAIT:
+        vm_sleep_ms(ctx, vm_fetch_u16_le(ctx));
+        ctx->zero_flag = false;
+        break;
 
-void vm_reset(vm_context_t *ctx) {
-    if (ctx == NULL) {
-        return;
+    case OPCODE_SET_COUNTER: {
+        uint8_t counter_id = vm_fetch_u8(ctx);
+        ctx->counters[counter_id] = vm_fetch_u16_le(ctx);
+        ctx->zero_flag = false;
+        break;
     }
 
-    // Release any pressed keys before resetting
-    vm_release_all_keys(ctx);
+    case OPCODE_DEC: {
+        uint8_t counter_id = vm_fetch_u8(ctx);
+        if (ctx->counters[counter_id] > 0) {
+            ctx->counters[counter_id]--;
+        }
+        ctx->zero_flag = (ctx->counters[counter_id] == 0);
+        break;
+    }
 
-    // Save callbacks before reset
-    vm_hid_callback_t hid_cb = ctx->hid_callback;
-    vm_delay_callback_t delay_cb = ctx->delay_callback;
+    case OPCODE_JNZ: {
+        uint32_t address = vm_fetch_u32_le(ctx);
+        if (!ctx->zero_flag) {
+            ctx->pc = address;
+        }
+        ctx->zero_flag = false;
+        break;
+    }
 
-    // Reset all state
-    memset(ctx, 0, sizeof(vm_context_t));
-    ctx->state = VM_STATE_READY;
-    ctx->current_press_time = 50;  // Default 50ms press time
-    ctx->zero_flag = false;
-    ctx->hid_callback = hid_cb;
-    ctx->delay_callback = delay_cb;
+    case OPCODE_PUSH_LOOP:
+        ctx->loop_stack[ctx->loop_depth++] = vm_fetch_u32_le(ctx);
+        ctx->zero_flag = false;
+        break;
 
-    ESP_LOGD(TAG, "VM reset");
-}
+    case OPCODE_NEXT: {
+        uint32_t address = vm_fetch_u32_le(ctx);
+        if (ctx->loop_stack[ctx->loop_depth - 1] > 1) {
+            ctx->loop_stack[ctx->loop_depth - 1]--;
+            ctx->pc = address;
+        } else {
+            ctx->loop_depth--;
+        }
+        ctx->zero_flag = false;
+        break;
+    }
 
-vm_error_t vm_start(vm_context_t *ctx,
-                    const uint8_t *program,
-                    uint32_t program_size,
-                    vm_hid_callback_t hid_callback,
-                    vm_delay_callback_t delay_callback) {
-    if (ctx == NULL || program == NULL || program_size == 0 || hid_callback == NULL ||
-        delay_callback == NULL) {
-        return VM_ERROR_INVALID_PROGRAM;
+    case OPCODE_PRESS: {
+        uint8_t modifier = vm_fetch_u8(ctx);
+        uint8_t key = vm_fetch_u8(ctx);
+        uint16_t press_ms = vm_fetch_u16_le(ctx);
+        uint16_t gap_ms = vm_fetch_u16_le(ctx);
+        vm_tap_key(ctx, modifier, key, press_ms, true, gap_ms);
+        break;
     }
 
-    // Initialize VM state
-    vm_reset(ctx);
-    ctx->program = program;
-    ctx->program_size = program_size;
-    ctx->pc = 0;
-    ctx->state = VM_STATE_RUNNING;
-    ctx->hid_callback = hid_callback;
-    ctx->delay_callback = delay_callback;
+    case OPCODE_TYPE: {
+        uint16_t press_ms = vm_fetch_u16_le(ctx);
+        uint16_t gap_ms = vm_fetch_u16_le(ctx);
+        uint8_t count = vm_fetch_u8(ctx);
+        const uint8_t *pairs = &ctx->program[ctx->pc - ctx->window_start];
+        if (vm_type_next(ctx, pairs, count, press_ms, gap_ms)) {
+            ctx->pc += 2u * count;
+        } else {
+            ctx->pc = start;  // Stay on this instruction for the next character
+        }
+        break;
+    }
 
-    ESP_LOGI(TAG,
-             "Starting VM execution (program size: %lu bytes)",
-             (unsigned long)program_size);
-    return VM_ERROR_NONE;
-}
+    default:
+        // Unreachable for verified programs
+        ctx->error = VM_ERROR_INVALID_OPCODE;
+        ctx->state = VM_STATE_ERROR;
+        break;
+    }
 
-vm_error_t vm_step(vm_context_t *ctx) {
-    if (ctx == NULL || ctx->state != VM_STATE_RUNNING) {
-        return VM_ERROR_INVALID_PROGRAM;
+    if (ctx->state == VM_STATE_ERROR) {
+        vm_release_all_keys(ctx);
+        VM_LOGE(TAG, "Program failed with error: %s", vm_error_to_string(ctx->error));
     }
 
+    return ctx->error;
+}
+
+// Execute the next instruction of the program
+static vm_error_t vm_execute_next(vm_context_t *ctx) {
     // Check if we've reached the end of the program
-    if (ctx->pc >= ctx->program_size) {
+    uint32_t program_end =
+        ctx->decoded != NULL ? ctx->decoded->instruction_count : ctx->program_size;
+    if (ctx->pc >= program_end) {
         vm_release_all_keys(ctx);
         ctx->state = VM_STATE_FINISHED;
-        ESP_LOGI(TAG, "Program completed successfully");
+        VM_LOGI(TAG, "Program completed successfully");
         return VM_ERROR_NONE;
     }
 
-    // Execute next opcode
+    if (ctx->decoded != NULL) {
+        return vm_step_decoded(ctx);
+    }
+
+    // Instructions never span blocks, so the window only changes between them
+    if (ctx->compressed &&
+        (ctx->pc < ctx->window_start || ctx->pc >= ctx->window_end) &&
+        !vm_load_window(ctx)) {
+        ctx->error = VM_ERROR_INVALID_PROGRAM;
+        ctx->state = VM_STATE_ERROR;
+        vm_release_all_keys(ctx);
+        VM_LOGE(TAG,
+                "Failed to decompress program block at PC %lu",
+                (unsigned long)ctx->pc);
+        return ctx->error;
+    }
+
+    if (ctx->verified) {
+        return vm_step_verified(ctx);
+    }
+
+    // An interrupted stream wait returns without executing anything, so the caller
+    // can act on whatever interrupted it
+    if (ctx->stream_callback != NULL) {
+        if (!vm_stream_ready(ctx)) {
+            return ctx->error;
+        }
+        if (ctx->pc == 0 && vm_is_compressed(ctx->program, ctx->stream_available)) {
+            ctx->error = VM_ERROR_INVALID_PROGRAM;
+            ctx->state = VM_STATE_ERROR;
+            VM_LOGE(TAG, "Compressed programs cannot be streamed");
+            return ctx->error;
+        }
+    }
+
+    // Execute next opcode (uncompressed programs only)
+    uint32_t start = ctx->pc;
     uint8_t opcode = ctx->program[ctx->pc];
     ctx->pc++;
-    ctx->instructions_executed++;
+    if (ctx->type_index == 0) {
+        ctx->instructions_executed++;
+    }
 
-    ESP_LOGD(
+    VM_LOGD(
         TAG, "Executing opcode 0x%02X at PC %lu", opcode, (unsigned long)(ctx->pc - 1));
 
     switch (opcode) {
@@ -208,28 +1512,12 @@ vm_error_t vm_step(vm_context_t *ctx) {
             break;
         }
 
-        // Update current state
-        ctx->current_modifier = modifier;
-        ctx->current_key_count = key_count;
-        memset(ctx->current_keys, 0, sizeof(ctx->current_keys));
-        if (key_count > 0) {
-            memcpy(ctx->current_keys, keys, key_count);
-        }
-
-        // Send HID report
-        if (!vm_send_hid_report(ctx,
-                                ctx->current_modifier,
-                                ctx->current_keys,
-                                ctx->current_key_count)) {
-            ctx->error = VM_ERROR_HID_ERROR;
-            ctx->state = VM_STATE_ERROR;
+        vm_press_keys(ctx, modifier, keys, key_count);
+        if (ctx->state == VM_STATE_ERROR) {
             break;
         }
 
-        vm_clear_zero_flag(ctx);
-        ctx->keys_pressed++;
-
-        ESP_LOGD(TAG, "KEYDN: modifier=0x%02X, keys=%d", modifier, key_count);
+        VM_LOGD(TAG, "KEYDN: modifier=0x%02X, keys=%d", modifier, key_count);
         break;
     }
 
@@ -256,46 +1544,12 @@ vm_error_t vm_step(vm_context_t *ctx) {
             break;
         }
 
-        // Remove keys from current state
-        // Remove modifiers
-        ctx->current_modifier &= ~modifier;
-
-        // Remove keys from current_keys array
-        uint8_t new_keys[VM_MAX_KEYS_PRESSED];
-        uint8_t new_key_count = 0;
-
-        // Copy keys that are NOT in the release list
-        for (uint8_t i = 0; i < ctx->current_key_count; i++) {
-            bool should_keep = true;
-            for (uint8_t j = 0; j < key_count; j++) {
-                if (ctx->current_keys[i] == keys[j]) {
-                    should_keep = false;
-                    break;
-                }
-            }
-            if (should_keep) {
-                new_keys[new_key_count++] = ctx->current_keys[i];
-            }
-        }
-
-        // Update current keys with filtered list
-        ctx->current_key_count = new_key_count;
-        memcpy(ctx->current_keys, new_keys, new_key_count);
-
-        // Send HID report with updated state
-        if (!vm_send_hid_report(ctx,
-                                ctx->current_modifier,
-                                ctx->current_keys,
-                                ctx->current_key_count)) {
-            ctx->error = VM_ERROR_HID_ERROR;
-            ctx->state = VM_STATE_ERROR;
+        vm_release_keys(ctx, modifier, keys, key_count);
+        if (ctx->state == VM_STATE_ERROR) {
             break;
         }
 
-        vm_clear_zero_flag(ctx);
-        ctx->keys_released++;
-
-        ESP_LOGD(TAG, "KEYUP: modifier=0x%02X, keys=%d", modifier, key_count);
+        VM_LOGD(TAG, "KEYUP: modifier=0x%02X, keys=%d", modifier, key_count);
         break;
     }
 
@@ -303,7 +1557,7 @@ vm_error_t vm_step(vm_context_t *ctx) {
         // KEYUP_ALL - release all keys
         vm_release_all_keys(ctx);
         vm_clear_zero_flag(ctx);
-        ESP_LOGD(TAG, "KEYUP_ALL: released all keys");
+        VM_LOGD(TAG, "KEYUP_ALL: released all keys");
         break;
     }
 
@@ -314,7 +1568,7 @@ vm_error_t vm_step(vm_context_t *ctx) {
             break;
         }
 
-        ESP_LOGD(TAG, "WAIT: %d ms", time_ms);
+        VM_LOGD(TAG, "WAIT: %d ms", time_ms);
         vm_sleep_ms(ctx, time_ms);
         vm_clear_zero_flag(ctx);
         break;
@@ -338,9 +1592,16 @@ vm_error_t vm_step(vm_context_t *ctx) {
             break;
         }
 
+        if (ctx->counters_cleared < VM_MAX_COUNTERS &&
+            !vm_clear_counters(ctx, VM_MAX_COUNTERS)) {
+            ctx->error = VM_ERROR_OUT_OF_MEMORY;
+            ctx->state = VM_STATE_ERROR;
+            break;
+        }
+
         ctx->counters[counter_id] = value;
         vm_clear_zero_flag(ctx);
-        ESP_LOGD(TAG, "SET_COUNTER: counter[%d] = %d", counter_id, value);
+        VM_LOGD(TAG, "SET_COUNTER: counter[%d] = %d", counter_id, value);
         break;
     }
 
@@ -357,17 +1618,24 @@ vm_error_t vm_step(vm_context_t *ctx) {
             break;
         }
 
+        if (ctx->counters_cleared < VM_MAX_COUNTERS &&
+            !vm_clear_counters(ctx, VM_MAX_COUNTERS)) {
+            ctx->error = VM_ERROR_OUT_OF_MEMORY;
+            ctx->state = VM_STATE_ERROR;
+            break;
+        }
+
         if (ctx->counters[counter_id] > 0) {
             ctx->counters[counter_id]--;
         }
         ctx->zero_flag =
             (ctx->counters[counter_id] == 0);  // Set flag if decrement resulted in zero
 
-        ESP_LOGD(TAG,
-                 "DEC: counter[%d] = %d, zero_flag = %s",
-                 counter_id,
-                 ctx->counters[counter_id],
-                 ctx->zero_flag ? "true" : "false");
+        VM_LOGD(TAG,
+                "DEC: counter[%d] = %d, zero_flag = %s",
+                counter_id,
+                ctx->counters[counter_id],
+                ctx->zero_flag ? "true" : "false");
         break;
     }
 
@@ -386,19 +1654,114 @@ vm_error_t vm_step(vm_context_t *ctx) {
 
         if (!ctx->zero_flag) {
             ctx->pc = address;
-            ESP_LOGD(TAG, "JNZ: zero_flag=false, jumping to %lu", address);
+            VM_LOGD(TAG, "JNZ: zero_flag=false, jumping to %lu", (unsigned long)address);
+        } else {
+            VM_LOGD(TAG, "JNZ: zero_flag=true, not jumping");
+        }
+        vm_clear_zero_flag(ctx);
+        break;
+    }
+
+    case OPCODE_PUSH_LOOP: {
+        // PUSH_LOOP count - run the loop body up to the matching NEXT count times
+        uint32_t count;
+        if (!vm_read_u32_le(ctx, &count)) {
+            break;
+        }
+
+        if (ctx->loop_depth >= VM_MAX_LOOP_DEPTH) {
+            ctx->error = VM_ERROR_INVALID_OPERAND;
+            ctx->state = VM_STATE_ERROR;
+            break;
+        }
+
+        ctx->loop_stack[ctx->loop_depth++] = count;
+        vm_clear_zero_flag(ctx);
+        VM_LOGD(TAG,
+                "PUSH_LOOP: count=%lu, depth=%u",
+                (unsigned long)count,
+                ctx->loop_depth);
+        break;
+    }
+
+    case OPCODE_NEXT: {
+        // NEXT address - jump back to the loop body until its count runs out
+        uint32_t address;
+        if (!vm_read_u32_le(ctx, &address)) {
+            break;
+        }
+
+        if (ctx->loop_depth == 0) {
+            ctx->error = VM_ERROR_INVALID_PROGRAM;
+            ctx->state = VM_STATE_ERROR;
+            break;
+        }
+
+        if (address >= ctx->program_size) {
+            ctx->error = VM_ERROR_INVALID_ADDRESS;
+            ctx->state = VM_STATE_ERROR;
+            break;
+        }
+
+        uint32_t *count = &ctx->loop_stack[ctx->loop_depth - 1];
+        if (*count > 1) {
+            (*count)--;
+            ctx->pc = address;
+            VM_LOGD(TAG,
+                    "NEXT: %lu left, jumping to %lu",
+                    (unsigned long)*count,
+                    (unsigned long)address);
         } else {
-            ESP_LOGD(TAG, "JNZ: zero_flag=true, not jumping");
+            ctx->loop_depth--;
+            VM_LOGD(TAG, "NEXT: loop done, depth=%u", ctx->loop_depth);
         }
         vm_clear_zero_flag(ctx);
         break;
     }
 
+    case OPCODE_PRESS: {
+        // PRESS modifier key press_ms gap_ms
+        uint8_t modifier, key;
+        uint16_t press_ms, gap_ms;
+        if (!vm_read_u8(ctx, &modifier) || !vm_read_u8(ctx, &key) ||
+            !vm_read_u16_le(ctx, &press_ms) || !vm_read_u16_le(ctx, &gap_ms)) {
+            break;
+        }
+
+        vm_tap_key(ctx, modifier, key, press_ms, true, gap_ms);
+        VM_LOGD(TAG, "PRESS: modifier=0x%02X, key=0x%02X", modifier, key);
+        break;
+    }
+
+    case OPCODE_TYPE: {
+        // TYPE press_ms gap_ms count (modifier key)*count
+        uint16_t press_ms, gap_ms;
+        uint8_t count;
+        if (!vm_read_u16_le(ctx, &press_ms) || !vm_read_u16_le(ctx, &gap_ms) ||
+            !vm_read_u8(ctx, &count)) {
+            break;
+        }
+
+        if (ctx->program_size - ctx->pc < 2u * count) {
+            ctx->error = VM_ERROR_INVALID_ADDRESS;
+            ctx->state = VM_STATE_ERROR;
+            break;
+        }
+
+        if (vm_type_next(ctx, &ctx->program[ctx->pc], count, press_ms, gap_ms)) {
+            ctx->pc += 2u * count;
+            VM_LOGD(TAG, "TYPE: %d characters", count);
+        } else {
+            ctx->pc = start;  // Stay on this instruction for the next character
+        }
+        break;
+    }
+
     default: {
-        ESP_LOGE(TAG,
-                 "Invalid opcode: 0x%02X at PC %lu",
-                 opcode,
-                 (unsigned long)(ctx->pc - 1));
+        VM_LOGE(TAG,
+                "Invalid opcode: 0x%02X at PC %lu",
+                opcode,
+                (unsigned long)(ctx->pc - 1));
         ctx->error = VM_ERROR_INVALID_OPCODE;
         ctx->state = VM_STATE_ERROR;
         break;
@@ -408,12 +1771,87 @@ vm_error_t vm_step(vm_context_t *ctx) {
     // Handle errors
     if (ctx->state == VM_STATE_ERROR) {
         vm_release_all_keys(ctx);
-        ESP_LOGE(TAG, "Program failed with error: %s", vm_error_to_string(ctx->error));
+        VM_LOGE(TAG, "Program failed with error: %s", vm_error_to_string(ctx->error));
     }
 
     return ctx->error;
 }
 
+// Find or add the PC table entry of a PC. Returns NULL if the table is full.
+static vm_profile_pc_t *vm_profile_pc_entry(vm_profile_t *profile, uint32_t pc) {
+    uint32_t slot = (pc * 2654435761u) % VM_PROFILE_PC_SLOTS;
+    for (uint32_t probe = 0; probe < VM_PROFILE_PC_SLOTS; probe++) {
+        vm_profile_pc_t *entry = &profile->pcs[slot];
+        if (entry->hits == 0 && entry->waits == 0) {
+            entry->pc = pc;
+            profile->pc_entries++;
+            return entry;
+        }
+        if (entry->pc == pc) {
+            return entry;
+        }
+        slot = (slot + 1) % VM_PROFILE_PC_SLOTS;
+    }
+    profile->pc_dropped++;
+    return NULL;
+}
+
+// Execute the next instruction, adding it to the attached profile
+static vm_error_t vm_step_profiled(vm_context_t *ctx) {
+    vm_profile_t *profile = ctx->profile;
+    uint32_t pc = ctx->pc;
+    uint32_t executed = ctx->instructions_executed;
+    bool typing = ctx->type_index != 0;
+
+    ctx->profile_pc = pc;
+    ctx->profile_callback_cycles = 0;
+    uint32_t start = VM_CYCLE_COUNT();
+    vm_error_t result = vm_execute_next(ctx);
+    uint32_t cycles = VM_CYCLE_COUNT() - start - ctx->profile_callback_cycles;
+
+    // Nothing ran if the program ended or was waiting for streamed data. Each
+    // character of a TYPE counts as a dispatch of it.
+    if (ctx->instructions_executed == executed && !typing) {
+        return result;
+    }
+
+    // The instruction stays in the window (or its block) until the next step
+    uint8_t opcode = ctx->decoded != NULL ? ctx->decoded->instructions[pc].opcode
+                                          : ctx->program[pc - ctx->window_start];
+    if (opcode >= VM_PROFILE_OPCODE_BASE &&
+        opcode < VM_PROFILE_OPCODE_BASE + VM_PROFILE_OPCODE_SLOTS) {
+        vm_profile_opcode_t *counter =
+            &profile->opcodes[opcode - VM_PROFILE_OPCODE_BASE];
+        counter->count++;
+        counter->cycles += cycles;
+    }
+    if (!typing) {
+        profile->instructions++;
+    }
+
+    if (profile->sample_countdown > 0) {
+        profile->sample_countdown--;
+    } else {
+        profile->sample_countdown = VM_PROFILE_PC_SAMPLE_PERIOD - 1;
+        vm_profile_pc_t *entry = vm_profile_pc_entry(profile, pc);
+        if (entry != NULL) {
+            entry->hits++;
+        }
+    }
+    return result;
+}
+
+vm_error_t vm_step(vm_context_t *ctx) {
+    if (ctx == NULL || ctx->state != VM_STATE_RUNNING) {
+        return VM_ERROR_INVALID_PROGRAM;
+    }
+
+    if (ctx->profile != NULL) {
+        return vm_step_profiled(ctx);
+    }
+    return vm_execute_next(ctx);
+}
+
 bool vm_running(const vm_context_t *ctx) {
     return ctx != NULL && ctx->state == VM_STATE_RUNNING;
 }
@@ -432,6 +1870,8 @@ const char *vm_error_to_string(vm_error_t error) {
         return "HID error";
     case VM_ERROR_INVALID_PROGRAM:
         return "Invalid program";
+    case VM_ERROR_OUT_OF_MEMORY:
+        return "Out of memory";
     default:
         return "Unknown error";
     }
@@ -473,3 +1913,41 @@ void vm_get_stats(const vm_context_t *ctx,
     if (keys_released)
         *keys_released = ctx->keys_released;
 }
+
+void vm_set_profile(vm_context_t *ctx, vm_profile_t *profile) {
+    if (ctx == NULL) {
+        return;
+    }
+    ctx->profile = profile;
+}
+
+void vm_profile_reset(vm_profile_t *profile) {
+    if (profile == NULL) {
+        return;
+    }
+    memset(profile, 0, sizeof(*profile));
+}
+
+void vm_profile_wait_error(vm_context_t *ctx, int32_t error_us) {
+    if (ctx == NULL || ctx->profile == NULL) {
+        return;
+    }
+
+    vm_profile_t *profile = ctx->profile;
+    if (profile->wait_count == 0 || error_us < profile->wait_error_min_us) {
+        profile->wait_error_min_us = error_us;
+    }
+    if (profile->wait_count == 0 || error_us > profile->wait_error_max_us) {
+        profile->wait_error_max_us = error_us;
+    }
+    profile->wait_count++;
+    profile->wait_error_sum_us += error_us;
+
+    vm_profile_pc_t *entry = vm_profile_pc_entry(profile, ctx->profile_pc);
+    if (entry != NULL) {
+        if (entry->waits == 0 || error_us > entry->wait_error_max_us) {
+            entry->wait_error_max_us = error_us;
+        }
+        entry->waits++;
+    }
+}
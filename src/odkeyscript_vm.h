@@ -16,7 +16,8 @@ typedef enum {
     VM_ERROR_INVALID_OPERAND,
     VM_ERROR_INVALID_ADDRESS,
     VM_ERROR_HID_ERROR,
-    VM_ERROR_INVALID_PROGRAM
+    VM_ERROR_INVALID_PROGRAM,
+    VM_ERROR_OUT_OF_MEMORY
 } vm_error_t;
 
 // VM State
@@ -32,24 +33,143 @@ typedef enum {
 typedef bool (*vm_hid_callback_t)(uint8_t modifier, const uint8_t *keys, uint8_t count);
 typedef void (*vm_delay_callback_t)(uint16_t ms);
 
+/**
+ * @brief Callback function type for waiting on a streaming program's data
+ * @param needed Number of program bytes, from the start, the VM needs
+ * @param available Output: number of program bytes available now
+ * @return false if the stream failed and will never reach needed bytes
+ * @note Blocks until needed bytes are available or the wait is interrupted;
+ * an interrupted wait returns true with fewer than needed bytes available.
+ */
+typedef bool (*vm_stream_callback_t)(uint32_t needed, uint32_t *available);
+
 // VM Configuration
-#define VM_MAX_COUNTERS 256
-#define VM_MAX_KEYS_PRESSED 6
+#define VM_MAX_COUNTERS 256     // Legacy SET_COUNTER/DEC counters
+#define VM_MAX_LOOP_DEPTH 16    // PUSH_LOOP/NEXT loops open at once
+#define VM_MAX_KEYS_PRESSED 16  // Per KEYDN/KEYUP (more than 6 requires NKRO mode)
+#define VM_KEY_BITMAP_WORDS (256 / 32)
+
+// Compressed program container (see ODKeyScript.md)
+#define VM_CONTAINER_MAGIC 0x5A4B444F  // "ODKZ" little-endian
+#define VM_CONTAINER_VERSION 1
+#define VM_CONTAINER_HEADER_SIZE 12
+#define VM_CONTAINER_BLOCK_ENTRY_SIZE 8
+#define VM_COMPRESSED_BLOCK_SIZE 2048  // Max uncompressed bytes per block
+
+// Profiling (see vm_profile_t)
+#define VM_PROFILE_OPCODE_BASE 0x10    // Opcode counted in the first opcode slot
+#define VM_PROFILE_OPCODE_SLOTS 32     // Opcodes 0x10-0x2F
+#define VM_PROFILE_PC_SLOTS 256        // Distinct PCs the PC table can hold
+#define VM_PROFILE_PC_SAMPLE_PERIOD 8  // Instructions per PC table sample
+
+// Dispatches and interpretation cost of one opcode
+typedef struct {
+    uint32_t count;
+    uint64_t cycles;  // CPU cycles, excluding time spent in the HID and delay callbacks
+} vm_profile_opcode_t;
+
+// PC table entry
+typedef struct {
+    uint32_t pc;
+    uint32_t hits;              // Samples taken at this PC
+    uint32_t waits;             // WAIT timing errors recorded at this PC
+    int32_t wait_error_max_us;  // Largest of them
+} vm_profile_pc_t;
+
+/**
+ * @brief Profile of the programs run while it was attached to a VM context
+ * PCs are the program offsets of instructions, decompressed for compressed programs
+ * (instruction indices when running a decoded program). The PC table is open
+ * addressed; an entry with no hits and no waits is unused.
+ */
+typedef struct {
+    uint32_t instructions;
+    vm_profile_opcode_t opcodes[VM_PROFILE_OPCODE_SLOTS];
+    vm_profile_pc_t pcs[VM_PROFILE_PC_SLOTS];
+    uint32_t pc_entries;        // Used PC table entries
+    uint32_t pc_dropped;        // Samples and waits lost because the table is full
+    uint32_t sample_countdown;  // Instructions until the next PC sample
+
+    // Actual minus scheduled time of each WAIT (see vm_profile_wait_error())
+    uint32_t wait_count;
+    int32_t wait_error_min_us;
+    int32_t wait_error_max_us;
+    int64_t wait_error_sum_us;
+} vm_profile_t;
+
+// Pre-decoded instruction (fixed size, jump targets resolved to instruction indices)
+typedef struct {
+    uint8_t opcode;
+    uint8_t arg;        // Modifier (KEYDN/KEYUP/PRESS) or counter ID (SET_COUNTER/DEC)
+    uint8_t key_count;  // Keycodes (KEYDN/KEYUP) or characters (TYPE) in the key pool
+    uint8_t key;        // Keycode (PRESS)
+    uint32_t operand;   // Key pool offset, WAIT/SET_COUNTER/PUSH_LOOP value, JNZ/NEXT
+                        // target index, or PRESS press time | gap time << 16
+} vm_instruction_t;
+
+// Pre-decoded program produced by vm_decode()
+typedef struct {
+    vm_instruction_t *instructions;
+    uint32_t instruction_count;
+    uint8_t *keys;  // Key pool referenced by KEYDN/KEYUP/TYPE instructions
+    uint32_t keys_size;
+    uint32_t program_size;  // Size of the bytecode this was decoded from
+    uint32_t program_hash;  // Caller-supplied hash of the bytecode
+    uint16_t counters;      // Legacy counters used (highest counter ID + 1)
+} vm_decoded_program_t;
+
+// Outcome of verifying a program, kept with it so later runs skip vm_verify()
+typedef struct {
+    bool valid;         // The fields below describe the program (zero to clear)
+    vm_error_t error;   // Verification result
+    uint16_t counters;  // Legacy counters used (when the program passed)
+} vm_verification_t;
+
+// Parsed compressed program container (points into the container bytes)
+typedef struct {
+    const uint8_t *blocks;  // Block table: u32 uncompressed offset, u32 data offset
+    const uint8_t *data;    // LZ4-compressed block data
+    uint32_t data_size;
+    uint16_t block_count;
+    uint32_t uncompressed_size;
+} vm_container_t;
 
 // VM Context structure
 typedef struct {
     // Program memory
     const uint8_t *program;
     uint32_t program_size;
-    uint32_t pc;  // Program counter
+    const vm_decoded_program_t *decoded;  // Non-NULL when running a decoded program
+    uint32_t pc;  // Program counter (instruction index for decoded programs)
+
+    // Compressed programs run from a window holding one decompressed block;
+    // program points at window and window_start is the program offset of its
+    // first byte (always 0 for uncompressed programs)
+    bool compressed;
+    vm_container_t container;
+    uint32_t window_start;
+    uint32_t window_end;
+    uint8_t window[VM_COMPRESSED_BLOCK_SIZE];
+
+    // Streaming programs are still being written while they run; the VM only
+    // executes instructions that lie entirely below stream_available
+    vm_stream_callback_t stream_callback;  // Non-NULL when streaming
+    uint32_t stream_available;
+
+    // Repeat count remaining in each open PUSH_LOOP loop
+    uint32_t loop_stack[VM_MAX_LOOP_DEPTH];
+    uint8_t loop_depth;
 
-    // Counters for repeat loops
-    uint16_t counters[VM_MAX_COUNTERS];
+    // Counters for legacy SET_COUNTER/DEC loops, allocated (VM_MAX_COUNTERS) the
+    // first time a program uses them and kept for later runs. Only the first
+    // counters_cleared are valid for the current run.
+    uint16_t *counters;
+    uint16_t counters_cleared;
 
-    // Current key state
+    // Current key state (one bit per HID keycode)
     uint8_t current_modifier;
-    uint8_t current_keys[VM_MAX_KEYS_PRESSED];
-    uint8_t current_key_count;
+    uint32_t current_keys[VM_KEY_BITMAP_WORDS];
+    uint8_t current_key_count;  // Number of keys in the last report sent
 
     // Current press time setting
     uint16_t current_press_time;
@@ -58,6 +178,11 @@ typedef struct {
     vm_state_t state;
     vm_error_t error;
     bool zero_flag;  // Set when a counter reaches zero, cleared by other operations
+    bool verified;   // Program passed vm_verify(), so vm_step() skips runtime checks
+
+    // Characters of the TYPE instruction at pc already typed (TYPE runs one
+    // character per vm_step() call so halts take effect between characters)
+    uint8_t type_index;
 
     // Callbacks
     vm_hid_callback_t hid_callback;
@@ -67,6 +192,11 @@ typedef struct {
     uint32_t instructions_executed;
     uint32_t keys_pressed;
     uint32_t keys_released;
+
+    // Profiling (profile is NULL when disabled)
+    vm_profile_t *profile;
+    uint32_t profile_pc;               // PC of the instruction being executed
+    uint32_t profile_callback_cycles;  // Cycles spent in callbacks by that instruction
 } vm_context_t;
 
 /**
@@ -76,8 +206,48 @@ typedef struct {
  */
 bool vm_init(vm_context_t *ctx);
 
+/**
+ * @brief Release memory owned by a VM context
+ * @param ctx VM context (vm_init() it again before reuse)
+ */
+void vm_deinit(vm_context_t *ctx);
+
+/**
+ * @brief Check whether a program is a compressed program container
+ * @param program Pointer to program bytes
+ * @param program_size Size of program in bytes
+ * @return true if the program starts with the container magic
+ */
+bool vm_is_compressed(const uint8_t *program, uint32_t program_size);
+
+/**
+ * @brief Verify an ODKeyScript program before execution
+ *
+ * Walks the whole program once and checks that every opcode is valid, every
+ * operand fits within the program, key counts do not exceed VM_MAX_KEYS_PRESSED,
+ * counter IDs are in range, and every jump lands on an instruction boundary.
+ * PUSH_LOOP/NEXT loops must nest properly, at most VM_MAX_LOOP_DEPTH deep, with
+ * each NEXT jumping back to the start of its loop; JNZ jumps may neither leave
+ * nor enter such a loop.
+ * Compressed containers are decompressed one block at a time; every block must
+ * decompress cleanly and no instruction may span two blocks.
+ *
+ * @param program Pointer to program bytecode
+ * @param program_size Size of program in bytes
+ * @return VM_ERROR_NONE if the program is valid, VM_ERROR_OUT_OF_MEMORY if the
+ * verifier could not allocate its working memory, or the error the program would
+ * have raised at runtime
+ */
+vm_error_t vm_verify(const uint8_t *program, uint32_t program_size);
+
 /**
  * @brief Start execution of an ODKeyScript program
+ *
+ * The program is verified with vm_verify() first and rejected if it is invalid.
+ * Verified programs are executed without per-instruction bounds checks.
+ * Compressed containers are decompressed into the context's window one block at
+ * a time as execution reaches them, so they must pass verification to run.
+ *
  * @param ctx VM context (must be initialized)
  * @param program Pointer to program bytecode
  * @param program_size Size of program in bytes
@@ -91,6 +261,96 @@ vm_error_t vm_start(vm_context_t *ctx,
                     vm_hid_callback_t hid_callback,
                     vm_delay_callback_t delay_callback);
 
+/**
+ * @brief Start execution of a program, reusing an earlier verification result
+ *
+ * Like vm_start(), but the program is only verified if verification is not yet
+ * valid, and the result is stored there for the next run. The caller must clear
+ * verification whenever the program changes. Running out of memory while
+ * verifying is not stored, so a later run tries again.
+ *
+ * @param ctx VM context (must be initialized)
+ * @param program Pointer to program bytecode
+ * @param program_size Size of program in bytes
+ * @param verification Verification result of this program
+ * @param hid_callback Function to call for HID reports
+ * @param delay_callback Function to call for delays
+ * @return VM error code
+ */
+vm_error_t vm_start_with_verification(vm_context_t *ctx,
+                                      const uint8_t *program,
+                                      uint32_t program_size,
+                                      vm_verification_t *verification,
+                                      vm_hid_callback_t hid_callback,
+                                      vm_delay_callback_t delay_callback);
+
+/**
+ * @brief Start execution of a program that is still being written
+ *
+ * The program cannot be verified up front, so it runs with runtime checks.
+ * Before each instruction the VM asks stream_callback for the bytes it needs
+ * and waits until they are available, so program bytes must be appended in
+ * order and never change once written. Compressed containers cannot be
+ * streamed.
+ *
+ * @param ctx VM context (must be initialized)
+ * @param program Pointer to the program buffer (must remain valid during
+ * execution)
+ * @param program_size Final size of the program in bytes
+ * @param hid_callback Function to call for HID reports
+ * @param delay_callback Function to call for delays
+ * @param stream_callback Function to call to wait for program bytes
+ * @return VM error code
+ */
+vm_error_t vm_start_streaming(vm_context_t *ctx,
+                              const uint8_t *program,
+                              uint32_t program_size,
+                              vm_hid_callback_t hid_callback,
+                              vm_delay_callback_t delay_callback,
+                              vm_stream_callback_t stream_callback);
+
+/**
+ * @brief Decode a program into a fixed-size instruction array
+ *
+ * The program is verified with vm_verify() and then converted into an array of
+ * vm_instruction_t allocated in PSRAM, with JNZ and NEXT targets resolved to
+ * instruction indices. Release the result with vm_decoded_free(). Compressed
+ * containers are decompressed into a temporary buffer first; program_size in the
+ * result is the size of the container so it still matches the cache key.
+ *
+ * @param program Pointer to program bytecode
+ * @param program_size Size of program in bytes
+ * @param program_hash Hash of the bytecode, stored in the result for cache lookups
+ * @param max_decoded_size Maximum number of bytes the decoded program may occupy
+ * @param decoded Output: decoded program
+ * @return VM_ERROR_NONE on success, VM_ERROR_OUT_OF_MEMORY if the decoded program
+ * would exceed max_decoded_size or could not be allocated, or a verification error
+ */
+vm_error_t vm_decode(const uint8_t *program,
+                     uint32_t program_size,
+                     uint32_t program_hash,
+                     size_t max_decoded_size,
+                     vm_decoded_program_t *decoded);
+
+/**
+ * @brief Free memory owned by a decoded program
+ * @param decoded Decoded program to release (safe to call on a zeroed struct)
+ */
+void vm_decoded_free(vm_decoded_program_t *decoded);
+
+/**
+ * @brief Start execution of a pre-decoded program
+ * @param ctx VM context (must be initialized)
+ * @param decoded Decoded program (must remain valid during execution)
+ * @param hid_callback Function to call for HID reports
+ * @param delay_callback Function to call for delays
+ * @return VM error code
+ */
+vm_error_t vm_start_decoded(vm_context_t *ctx,
+                            const vm_decoded_program_t *decoded,
+                            vm_hid_callback_t hid_callback,
+                            vm_delay_callback_t delay_callback);
+
 /**
  * @brief Execute the next opcode in the program
  * @param ctx VM context (must be started)
@@ -138,6 +398,27 @@ void vm_get_stats(const vm_context_t *ctx,
                   uint32_t *keys_pressed,
                   uint32_t *keys_released);
 
+/**
+ * @brief Attach a profile to a started VM, or detach it with NULL
+ * @param ctx VM context (attach after vm_start() and friends, which detach it)
+ * @param profile Profile to add this run's counters to
+ */
+void vm_set_profile(vm_context_t *ctx, vm_profile_t *profile);
+
+/**
+ * @brief Clear a profile
+ * @param profile Profile to clear
+ */
+void vm_profile_reset(vm_profile_t *profile);
+
+/**
+ * @brief Record the timing error of the WAIT being executed
+ * @param ctx VM context with a profile attached (no-op otherwise)
+ * @param error_us Time the wait actually ended minus the time it was scheduled to
+ * @note Call from the delay callback
+ */
+void vm_profile_wait_error(vm_context_t *ctx, int32_t error_us);
+
 /**
  * @brief Reset VM context to initial state
  * @param ctx VM context to reset
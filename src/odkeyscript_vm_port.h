@@ -0,0 +1,68 @@
+#ifndef ODKEYSCRIPT_VM_PORT_H
+#define ODKEYSCRIPT_VM_PORT_H
+
+// Platform services used by the VM core. Firmware builds map them onto ESP-IDF.
+// Defining ODKEYSCRIPT_VM_HOST maps them onto the C library instead, so the VM can
+// be built and benchmarked on a development machine (see test/host).
+
+#include <stdint.h>
+
+#ifdef ODKEYSCRIPT_VM_HOST
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+// Host builds only log when ODKEYSCRIPT_VM_HOST_LOG is defined. Disabled messages
+// are still type-checked.
+#ifdef ODKEYSCRIPT_VM_HOST_LOG
+#define VM_LOG_ENABLED 1
+#else
+#define VM_LOG_ENABLED 0
+#endif
+
+#define VM_LOG(level, tag, format, ...)                                           \
+    do {                                                                          \
+        if (VM_LOG_ENABLED) {                                                     \
+            fprintf(stderr, level " (%s) " format "\n", tag, ##__VA_ARGS__);      \
+        }                                                                         \
+    } while (0)
+
+#define VM_LOGE(tag, format, ...) VM_LOG("E", tag, format, ##__VA_ARGS__)
+#define VM_LOGW(tag, format, ...) VM_LOG("W", tag, format, ##__VA_ARGS__)
+#define VM_LOGI(tag, format, ...) VM_LOG("I", tag, format, ##__VA_ARGS__)
+#define VM_LOGD(tag, format, ...) VM_LOG("D", tag, format, ##__VA_ARGS__)
+
+#define VM_MALLOC(size) malloc(size)
+#define VM_CALLOC(count, size) calloc(count, size)
+#define VM_FREE(ptr) free(ptr)
+
+// Hosts have no portable cycle counter, so profiles count nanoseconds instead
+static inline uint32_t vm_port_cycle_count(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint32_t)((uint64_t)now.tv_sec * 1000000000u + (uint64_t)now.tv_nsec);
+}
+#define VM_CYCLE_COUNT() vm_port_cycle_count()
+
+#else
+
+#include "esp_cpu.h"
+#include "esp_heap_caps.h"
+#include "esp_log.h"
+
+#define VM_LOGE ESP_LOGE
+#define VM_LOGW ESP_LOGW
+#define VM_LOGI ESP_LOGI
+#define VM_LOGD ESP_LOGD
+
+// Programs and their decoded forms can be large, so they live in PSRAM
+#define VM_MALLOC(size) heap_caps_malloc(size, MALLOC_CAP_SPIRAM)
+#define VM_CALLOC(count, size) heap_caps_calloc(count, size, MALLOC_CAP_SPIRAM)
+#define VM_FREE(ptr) heap_caps_free(ptr)
+
+#define VM_CYCLE_COUNT() esp_cpu_get_cycle_count()
+
+#endif  // ODKEYSCRIPT_VM_HOST
+
+#endif  // ODKEYSCRIPT_VM_PORT_H
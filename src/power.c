@@ -0,0 +1,239 @@
+#include "power.h"
+#include "esp_attr.h"
+#include "esp_log.h"
+#include "esp_pm.h"
+#include "esp_sleep.h"
+#include "esp_timer.h"
+#include "esp_wifi.h"
+#include "freertos/FreeRTOS.h"
+#include "latency_stats.h"
+#include "nvs_config.h"
+#include "nvs_odkey.h"
+#include "sdkconfig.h"
+
+static const char *TAG = "power";
+
+// Lowest CPU frequency for the profiles that scale it
+#define POWER_MIN_CPU_FREQ_MHZ CONFIG_XTAL_FREQ
+
+// How long the CPU stays out of light sleep at boot and after a wake on the button,
+// so a host can enumerate the device
+#define POWER_USB_GRACE_US (5 * 1000 * 1000)
+
+static const char *const g_profile_names[POWER_PROFILE_COUNT] = {
+    [POWER_PROFILE_PERFORMANCE] = "performance",
+    [POWER_PROFILE_BALANCED] = "balanced",
+    [POWER_PROFILE_LOW_POWER] = "low_power",
+};
+
+static struct {
+    power_profile_t profile;
+#if CONFIG_PM_ENABLE
+    // Both locks keep the APB clock at its maximum, which USB needs and which also
+    // keeps the CPU out of light sleep
+    esp_pm_lock_handle_t usb_lock;    // Held while a USB host is attached
+    esp_pm_lock_handle_t grace_lock;  // Held while waiting for a host
+    esp_timer_handle_t grace_timer;   // Releases grace_lock
+    bool usb_attached;
+    bool grace_held;
+#endif  // CONFIG_PM_ENABLE
+} g_power_state = {0};
+
+#if CONFIG_PM_ENABLE
+static portMUX_TYPE g_lock = portMUX_INITIALIZER_UNLOCKED;
+
+// Hold grace_lock for another POWER_USB_GRACE_US
+static void start_usb_grace(void) {
+    portENTER_CRITICAL_SAFE(&g_lock);
+    bool acquire = !g_power_state.grace_held && !g_power_state.usb_attached;
+    g_power_state.grace_held |= acquire;
+    portEXIT_CRITICAL_SAFE(&g_lock);
+
+    if (acquire) {
+        esp_pm_lock_acquire(g_power_state.grace_lock);
+        esp_timer_stop(g_power_state.grace_timer);
+        esp_timer_start_once(g_power_state.grace_timer, POWER_USB_GRACE_US);
+    }
+}
+
+static void grace_timer_callback(void *arg) {
+    (void)arg;
+
+    portENTER_CRITICAL(&g_lock);
+    bool release = g_power_state.grace_held;
+    g_power_state.grace_held = false;
+    portEXIT_CRITICAL(&g_lock);
+
+    if (release) {
+        esp_pm_lock_release(g_power_state.grace_lock);
+    }
+}
+
+#if CONFIG_PM_LIGHT_SLEEP_CALLBACKS
+// Runs on the idle task right after each light sleep
+static esp_err_t light_sleep_exit_callback(int64_t sleep_time_us, void *arg) {
+    (void)sleep_time_us;
+    (void)arg;
+
+    if (esp_sleep_get_wakeup_cause() == ESP_SLEEP_WAKEUP_GPIO) {
+        latency_stats_mark_wake();
+        // Stay awake while waiting for a host
+        start_usb_grace();
+    }
+    return ESP_OK;
+}
+#endif  // CONFIG_PM_LIGHT_SLEEP_CALLBACKS
+#endif  // CONFIG_PM_ENABLE
+
+// Read the profile from the configuration, defaulting to performance
+static power_profile_t load_profile(void) {
+    uint8_t value = POWER_PROFILE_PERFORMANCE;
+    esp_err_t ret = nvs_config_get_u8(NVS_KEY_POWER_PROFILE, &value);
+    if (ret != ESP_OK && ret != ESP_ERR_NVS_NOT_FOUND) {
+        ESP_LOGW(
+            TAG, "Failed to read power profile from NVS: %s", esp_err_to_name(ret));
+    }
+    if (value >= POWER_PROFILE_COUNT) {
+        ESP_LOGW(TAG, "Invalid power profile %u, using performance", value);
+        value = POWER_PROFILE_PERFORMANCE;
+    }
+    return (power_profile_t)value;
+}
+
+// Configure frequency scaling and light sleep for a profile
+static bool apply_pm_config(power_profile_t profile) {
+#if CONFIG_PM_ENABLE
+    esp_pm_config_t pm_config = {
+        .max_freq_mhz = CONFIG_ESP_DEFAULT_CPU_FREQ_MHZ,
+        .min_freq_mhz = (profile == POWER_PROFILE_PERFORMANCE)
+                            ? CONFIG_ESP_DEFAULT_CPU_FREQ_MHZ
+                            : POWER_MIN_CPU_FREQ_MHZ,
+        .light_sleep_enable = (profile == POWER_PROFILE_LOW_POWER),
+    };
+#if !CONFIG_FREERTOS_USE_TICKLESS_IDLE
+    if (pm_config.light_sleep_enable) {
+        ESP_LOGW(TAG, "Tickless idle is disabled in this build, not using light sleep");
+        pm_config.light_sleep_enable = false;
+    }
+#endif  // !CONFIG_FREERTOS_USE_TICKLESS_IDLE
+
+    esp_err_t ret = esp_pm_configure(&pm_config);
+    if (ret != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to configure power management: %s", esp_err_to_name(ret));
+        return false;
+    }
+    return true;
+#else
+    if (profile != POWER_PROFILE_PERFORMANCE) {
+        ESP_LOGW(TAG, "Power management is disabled in this build, using full power");
+    }
+    return true;
+#endif  // CONFIG_PM_ENABLE
+}
+
+void power_apply_wifi_sleep(void) {
+    wifi_ps_type_t ps_type = (g_power_state.profile == POWER_PROFILE_LOW_POWER)
+                                 ? WIFI_PS_MAX_MODEM
+                                 : WIFI_PS_MIN_MODEM;
+
+    // Fails harmlessly until the WiFi driver is initialized, which applies it then
+    esp_err_t ret = esp_wifi_set_ps(ps_type);
+    if (ret != ESP_OK && ret != ESP_ERR_WIFI_NOT_INIT) {
+        ESP_LOGW(TAG, "Failed to set WiFi modem sleep: %s", esp_err_to_name(ret));
+    }
+}
+
+// Switch profiles without a reboot; an invalid profile keeps the current one
+static void power_config_changed(const char *key, void *arg) {
+    (void)key;
+    (void)arg;
+
+    power_profile_t profile = load_profile();
+    if (profile == g_power_state.profile || !apply_pm_config(profile)) {
+        return;
+    }
+
+    g_power_state.profile = profile;
+    power_apply_wifi_sleep();
+    ESP_LOGI(TAG, "Power profile changed to %s", power_profile_name(profile));
+}
+
+bool power_init(void) {
+#if CONFIG_PM_ENABLE
+    if (esp_pm_lock_create(ESP_PM_APB_FREQ_MAX, 0, "usb", &g_power_state.usb_lock) !=
+            ESP_OK ||
+        esp_pm_lock_create(
+            ESP_PM_APB_FREQ_MAX, 0, "usb_grace", &g_power_state.grace_lock) != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to create power management locks");
+        return false;
+    }
+
+    const esp_timer_create_args_t timer_args = {
+        .callback = grace_timer_callback,
+        .name = "usb_grace",
+    };
+    if (esp_timer_create(&timer_args, &g_power_state.grace_timer) != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to create USB grace timer");
+        return false;
+    }
+
+#if CONFIG_PM_LIGHT_SLEEP_CALLBACKS
+    esp_pm_sleep_cbs_register_config_t cbs_config = {
+        .exit_cb = light_sleep_exit_callback,
+    };
+    if (esp_pm_light_sleep_register_cbs(&cbs_config) != ESP_OK) {
+        ESP_LOGW(TAG, "Failed to register light sleep callback, not timing wakes");
+    }
+#endif  // CONFIG_PM_LIGHT_SLEEP_CALLBACKS
+
+    // Give the host time to enumerate the device before light sleep is allowed
+    start_usb_grace();
+#endif  // CONFIG_PM_ENABLE
+
+    power_profile_t profile = load_profile();
+    if (!apply_pm_config(profile)) {
+        // Power management is left as configured at boot, i.e. full power
+        profile = POWER_PROFILE_PERFORMANCE;
+    }
+    g_power_state.profile = profile;
+
+    nvs_config_add_change_callback(NVS_KEY_POWER_PROFILE, power_config_changed, NULL);
+
+    ESP_LOGI(TAG, "Power profile: %s", power_profile_name(profile));
+    return true;
+}
+
+power_profile_t power_get_profile(void) {
+    return g_power_state.profile;
+}
+
+const char *power_profile_name(power_profile_t profile) {
+    if (profile >= POWER_PROFILE_COUNT) {
+        return "unknown";
+    }
+    return g_profile_names[profile];
+}
+
+void power_set_usb_attached(bool attached) {
+#if CONFIG_PM_ENABLE
+    if (g_power_state.usb_lock == NULL) {
+        return;
+    }
+
+    portENTER_CRITICAL(&g_lock);
+    bool changed = (g_power_state.usb_attached != attached);
+    g_power_state.usb_attached = attached;
+    portEXIT_CRITICAL(&g_lock);
+
+    if (!changed) {
+        return;
+    }
+    if (attached) {
+        esp_pm_lock_acquire(g_power_state.usb_lock);
+    } else {
+        esp_pm_lock_release(g_power_state.usb_lock);
+    }
+#else
+    (void)attached;
+#endif  // CONFIG_PM_ENABLE
+}
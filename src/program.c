@@ -1,27 +1,59 @@
 #include "program.h"
+#include <string.h>
+#include "buffer_utils.h"
 #include "esp_log.h"
+#include "esp_rom_crc.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "latency_stats.h"
+#include "nvs_config.h"
+#include "nvs_odkey.h"
 #include "program_flash.h"
 #include "program_ram.h"
 #include "vm_task.h"
 
 static const char *TAG = "program";
 
-// Store the external HID callback
+// Store the external HID callbacks
 static program_hid_send_callback_t g_external_hid_callback = NULL;
+static program_hid_cancel_callback_t g_external_hid_cancel_callback = NULL;
+
+// Selected program of each type's library (persisted in NVS for FLASH)
+static uint32_t g_selected_program[2] = {0};
+
+// Held while queueing a flash run and while the flash program is activated or
+// erased, so no run is queued with a pointer into a slot that is being retired
+static SemaphoreHandle_t g_flash_run_mutex = NULL;
 
 // Private callback that forwards to the external callback
-static bool program_hid_send_callback(uint8_t modifier,
+static bool program_hid_send_callback(int64_t deadline_us,
+                                      uint8_t modifier,
                                       const uint8_t *keys,
                                       uint8_t count) {
     if (g_external_hid_callback != NULL) {
-        return g_external_hid_callback(modifier, keys, count);
+        return g_external_hid_callback(deadline_us, modifier, keys, count);
     }
     return false;
 }
 
-bool program_init(program_hid_send_callback_t hid_send_callback) {
-    // Store the external callback
+// Private callback that forwards to the external cancel callback
+static void program_hid_cancel_callback(void) {
+    if (g_external_hid_cancel_callback != NULL) {
+        g_external_hid_cancel_callback();
+    }
+}
+
+bool program_init(program_hid_send_callback_t hid_send_callback,
+                  program_hid_cancel_callback_t hid_cancel_callback) {
+    // Store the external callbacks
     g_external_hid_callback = hid_send_callback;
+    g_external_hid_cancel_callback = hid_cancel_callback;
+
+    g_flash_run_mutex = xSemaphoreCreateMutex();
+    if (g_flash_run_mutex == NULL) {
+        ESP_LOGE(TAG, "Failed to create flash run mutex");
+        return false;
+    }
 
     // Initialize flash program
     if (!program_flash_init()) {
@@ -35,8 +67,14 @@ bool program_init(program_hid_send_callback_t hid_send_callback) {
         return false;
     }
 
-    // Initialize VM task with our private callback
-    if (!vm_task_init(program_hid_send_callback)) {
+    // Restore the selected flash program; a missing key selects program 0
+    uint16_t program_id;
+    if (nvs_config_get_u16(NVS_KEY_PROGRAM_ID, &program_id) == ESP_OK) {
+        g_selected_program[PROGRAM_TYPE_FLASH] = program_id;
+    }
+
+    // Initialize VM task with our private callbacks
+    if (!vm_task_init(program_hid_send_callback, program_hid_cancel_callback)) {
         ESP_LOGE(TAG, "Failed to initialize VM task");
         return false;
     }
@@ -45,40 +83,80 @@ bool program_init(program_hid_send_callback_t hid_send_callback) {
     return true;
 }
 
-const uint8_t *program_get(program_type_t type, uint32_t *out_size) {
-    if (out_size == NULL) {
-        ESP_LOGE(TAG, "out_size parameter cannot be NULL");
-        return NULL;
+bool program_acquire(program_type_t type, program_ref_t *out_ref) {
+    if (out_ref == NULL) {
+        ESP_LOGE(TAG, "out_ref parameter cannot be NULL");
+        return false;
     }
+    memset(out_ref, 0, sizeof(*out_ref));
 
     switch (type) {
     case PROGRAM_TYPE_FLASH:
-        return program_flash_get(out_size);
+        out_ref->data = program_flash_get(&out_ref->size);
+        break;
 
     case PROGRAM_TYPE_RAM:
-        return program_ram_get(out_size);
+        out_ref->snapshot = program_ram_acquire(&out_ref->data, &out_ref->size);
+        break;
 
     default:
         ESP_LOGE(TAG, "Invalid program type: %d", type);
-        *out_size = 0;
-        return NULL;
+        return false;
+    }
+
+    if (out_ref->data == NULL || out_ref->size == 0) {
+        program_release(out_ref);
+        return false;
     }
+    return true;
 }
 
-bool program_write_start(program_type_t type,
-                         uint32_t expected_program_size,
-                         program_write_source_t source) {
-    // Auto-halt VM if running
-    if (vm_task_is_running()) {
-        ESP_LOGI(TAG, "Halting VM for program upload");
+void program_release(program_ref_t *ref) {
+    if (ref == NULL) {
+        return;
+    }
+    program_ram_release(ref->snapshot);
+    memset(ref, 0, sizeof(*ref));
+}
+
+// VM task callbacks for runs holding a RAM snapshot (NULL for FLASH runs)
+static void release_run_snapshot(void *arg) {
+    program_ram_release(arg);
+}
+
+static bool wait_run_snapshot(void *arg,
+                              uint32_t needed,
+                              uint32_t *out_available,
+                              uint32_t timeout_ms) {
+    return program_ram_wait_bytes_written(arg, needed, out_available, timeout_ms);
+}
+
+// Stop flash runs and hold off new ones until end_flash_change(). The previous flash
+// slot is erased in the background once it is retired, so it must not be executing.
+static void begin_flash_change(const char *reason) {
+    xSemaphoreTake(g_flash_run_mutex, portMAX_DELAY);
+    if (vm_task_is_busy()) {
+        ESP_LOGI(TAG, "Halting VM for program %s", reason);
         vm_task_halt();
     }
+}
+
+static void end_flash_change(void) {
+    xSemaphoreGive(g_flash_run_mutex);
+}
 
+bool program_write_start(program_type_t type,
+                         uint32_t expected_program_size,
+                         program_write_source_t source) {
     switch (type) {
     case PROGRAM_TYPE_FLASH:
+        // The upload goes to the inactive slot, so the running program keeps going
+        // until program_write_finish() activates it
         return program_flash_write_start(expected_program_size, source);
 
     case PROGRAM_TYPE_RAM:
+        // Runs hold a reference to the snapshot they execute, which the upload
+        // leaves alone
         return program_ram_write_start(expected_program_size, source);
 
     default:
@@ -104,12 +182,46 @@ bool program_write_chunk(program_type_t type,
     }
 }
 
+uint8_t *program_write_reserve(program_type_t type,
+                               uint32_t *out_size,
+                               program_write_source_t source) {
+    switch (type) {
+    case PROGRAM_TYPE_RAM:
+        return program_ram_write_reserve(out_size, source);
+
+    case PROGRAM_TYPE_FLASH:
+    default:
+        ESP_LOGE(TAG, "Direct writes not supported for program type: %d", type);
+        if (out_size)
+            *out_size = 0;
+        return NULL;
+    }
+}
+
+bool program_write_commit(program_type_t type,
+                          uint32_t size,
+                          program_write_source_t source) {
+    switch (type) {
+    case PROGRAM_TYPE_RAM:
+        return program_ram_write_commit(size, source);
+
+    case PROGRAM_TYPE_FLASH:
+    default:
+        ESP_LOGE(TAG, "Direct writes not supported for program type: %d", type);
+        return false;
+    }
+}
+
 bool program_write_finish(program_type_t type,
                           uint32_t program_size,
                           program_write_source_t source) {
     switch (type) {
-    case PROGRAM_TYPE_FLASH:
-        return program_flash_write_finish(program_size, source);
+    case PROGRAM_TYPE_FLASH: {
+        begin_flash_change("activation");
+        bool result = program_flash_write_finish(program_size, source);
+        end_flash_change();
+        return result;
+    }
 
     case PROGRAM_TYPE_RAM:
         return program_ram_write_finish(program_size, source);
@@ -120,12 +232,83 @@ bool program_write_finish(program_type_t type,
     }
 }
 
-bool program_erase(program_type_t type) {
+void program_write_abort(program_type_t type, program_write_source_t source) {
     switch (type) {
     case PROGRAM_TYPE_FLASH:
-        return program_flash_erase();
+        program_flash_write_abort(source);
+        break;
+
+    case PROGRAM_TYPE_RAM:
+        program_ram_write_abort(source);
+        break;
+
+    default:
+        ESP_LOGE(TAG, "Invalid program type: %d", type);
+        break;
+    }
+}
+
+bool program_get_page_hashes(program_type_t type,
+                             uint32_t *out_hashes,
+                             uint32_t max_hashes,
+                             uint32_t *out_count) {
+    if (type != PROGRAM_TYPE_FLASH) {
+        ESP_LOGE(TAG, "Page hashes are only supported for flash programs");
+        return false;
+    }
+    return program_flash_get_page_hashes(out_hashes, max_hashes, out_count);
+}
+
+bool program_patch_start(program_type_t type,
+                         uint32_t program_size,
+                         program_write_source_t source) {
+    if (type != PROGRAM_TYPE_FLASH) {
+        ESP_LOGE(TAG, "Delta uploads are only supported for flash programs");
+        return false;
+    }
+
+    // Like a full upload, the running program is only halted on activation
+    return program_flash_patch_start(program_size, source);
+}
+
+bool program_patch_page(program_type_t type,
+                        uint32_t page_index,
+                        const uint8_t *data,
+                        program_write_source_t source) {
+    if (type != PROGRAM_TYPE_FLASH) {
+        ESP_LOGE(TAG, "Delta uploads are only supported for flash programs");
+        return false;
+    }
+    return program_flash_patch_page(page_index, data, source);
+}
+
+bool program_patch_finish(program_type_t type,
+                          uint32_t program_size,
+                          uint32_t program_crc,
+                          program_write_source_t source) {
+    if (type != PROGRAM_TYPE_FLASH) {
+        ESP_LOGE(TAG, "Delta uploads are only supported for flash programs");
+        return false;
+    }
+
+    begin_flash_change("activation");
+    bool result = program_flash_patch_finish(program_size, program_crc, source);
+    end_flash_change();
+    return result;
+}
+
+bool program_erase(program_type_t type) {
+    switch (type) {
+    case PROGRAM_TYPE_FLASH: {
+        // Queued runs point into program storage
+        begin_flash_change("erase");
+        bool result = program_flash_erase();
+        end_flash_change();
+        return result;
+    }
 
     case PROGRAM_TYPE_RAM:
+        // Runs already queued hold their own reference to the snapshot
         return program_ram_erase();
 
     default:
@@ -162,35 +345,339 @@ uint32_t program_get_expected_size(program_type_t type) {
     }
 }
 
+// Get the number of programs in a library image, or 0 if the image is not a valid
+// library. Entries are validated when they are looked up.
+static uint32_t library_program_count(const uint8_t *image, uint32_t image_size) {
+    uint32_t magic;
+    uint16_t count;
+    if (!bu_read_u32_le(image, image_size, &magic) || magic != PROGRAM_LIBRARY_MAGIC ||
+        image_size < PROGRAM_LIBRARY_HEADER_SIZE ||
+        image[4] != PROGRAM_LIBRARY_VERSION ||
+        !bu_read_u16_le(&image[6], image_size - 6, &count)) {
+        return 0;
+    }
+    if (count == 0 || count > PROGRAM_LIBRARY_MAX_PROGRAMS ||
+        image_size < PROGRAM_LIBRARY_HEADER_SIZE + count * PROGRAM_LIBRARY_ENTRY_SIZE) {
+        return 0;
+    }
+    return count;
+}
+
+// Locate a program within a stored program image. Libraries index their directory
+// directly by id; any other image is a single program with id 0. On success the
+// image stays referenced through out_image until the caller releases it.
+static const uint8_t *locate_program(program_type_t type,
+                                     uint32_t id,
+                                     program_info_t *out_info,
+                                     program_ref_t *out_image) {
+    memset(out_info, 0, sizeof(*out_info));
+
+    if (!program_acquire(type, out_image)) {
+        return NULL;
+    }
+    const uint8_t *image = out_image->data;
+    uint32_t image_size = out_image->size;
+
+    uint32_t count = library_program_count(image, image_size);
+    if (count == 0) {
+        if (id != 0) {
+            program_release(out_image);
+            return NULL;
+        }
+        out_info->size = image_size;
+        uint32_t hash;
+        if (type == PROGRAM_TYPE_FLASH && program_flash_get_hash(&hash)) {
+            out_info->crc = hash;
+        }
+        return image;
+    }
+
+    if (id >= count) {
+        program_release(out_image);
+        return NULL;
+    }
+
+    // name[16] offset(4) size(4) crc(4), with offset relative to the image start
+    const uint8_t *entry =
+        &image[PROGRAM_LIBRARY_HEADER_SIZE + id * PROGRAM_LIBRARY_ENTRY_SIZE];
+    uint32_t offset, size, crc;
+    bu_read_u32_le(&entry[PROGRAM_NAME_MAX_LEN], 4, &offset);
+    bu_read_u32_le(&entry[PROGRAM_NAME_MAX_LEN + 4], 4, &size);
+    bu_read_u32_le(&entry[PROGRAM_NAME_MAX_LEN + 8], 4, &crc);
+    if (size == 0 || offset > image_size || size > image_size - offset) {
+        ESP_LOGE(TAG, "Library program %lu is out of bounds", (unsigned long)id);
+        program_release(out_image);
+        return NULL;
+    }
+
+    memcpy(out_info->name, entry, PROGRAM_NAME_MAX_LEN);
+    out_info->name[PROGRAM_NAME_MAX_LEN - 1] = '\0';
+    out_info->size = size;
+    out_info->crc = crc;
+    return &image[offset];
+}
+
+uint32_t program_get_count(program_type_t type) {
+    program_ref_t image;
+    if (!program_acquire(type, &image)) {
+        return 0;
+    }
+
+    uint32_t count = library_program_count(image.data, image.size);
+    program_release(&image);
+    return count == 0 ? 1 : count;
+}
+
+bool program_get_info(program_type_t type, uint32_t id, program_info_t *out_info) {
+    if (out_info == NULL) {
+        ESP_LOGE(TAG, "out_info parameter cannot be NULL");
+        return false;
+    }
+    program_ref_t image;
+    bool found = locate_program(type, id, out_info, &image) != NULL;
+    program_release(&image);
+    return found;
+}
+
+bool program_find(program_type_t type, const char *name, uint32_t *out_id) {
+    if (name == NULL || out_id == NULL) {
+        return false;
+    }
+
+    // Libraries hold at most PROGRAM_LIBRARY_MAX_PROGRAMS entries, so a scan is cheap
+    uint32_t count = program_get_count(type);
+    for (uint32_t id = 0; id < count; id++) {
+        program_info_t info;
+        program_ref_t image;
+        bool found = locate_program(type, id, &info, &image) != NULL &&
+                     info.name[0] != '\0' &&
+                     strncmp(info.name, name, PROGRAM_NAME_MAX_LEN) == 0;
+        program_release(&image);
+        if (found) {
+            *out_id = id;
+            return true;
+        }
+    }
+    return false;
+}
+
+bool program_select(program_type_t type, uint32_t id) {
+    if (type != PROGRAM_TYPE_FLASH && type != PROGRAM_TYPE_RAM) {
+        ESP_LOGE(TAG, "Invalid program type: %d", type);
+        return false;
+    }
+
+    program_info_t info;
+    program_ref_t image;
+    const uint8_t *program = locate_program(type, id, &info, &image);
+    if (program == NULL) {
+        ESP_LOGE(TAG, "No program %lu to select", (unsigned long)id);
+        return false;
+    }
+
+    // Selection is rare, so catch a damaged library now rather than at the button
+    bool damaged = info.crc != 0 && esp_rom_crc32_le(0, program, info.size) != info.crc;
+    program_release(&image);
+    if (damaged) {
+        ESP_LOGE(TAG, "Program %lu failed its CRC check", (unsigned long)id);
+        return false;
+    }
+
+    if (type == PROGRAM_TYPE_FLASH) {
+        esp_err_t err = nvs_config_set_u16(NVS_KEY_PROGRAM_ID, (uint16_t)id);
+        if (err != ESP_OK) {
+            ESP_LOGE(TAG, "Failed to save program selection: %s", esp_err_to_name(err));
+            return false;
+        }
+    }
+
+    g_selected_program[type] = id;
+    ESP_LOGI(TAG,
+             "Selected program %lu (\"%s\", %lu bytes)",
+             (unsigned long)id,
+             info.name,
+             (unsigned long)info.size);
+    return true;
+}
+
+uint32_t program_get_selected(program_type_t type) {
+    if (type != PROGRAM_TYPE_FLASH && type != PROGRAM_TYPE_RAM) {
+        return 0;
+    }
+    return g_selected_program[type];
+}
+
 bool program_execute(program_type_t type,
                      program_execution_complete_callback_t on_complete,
                      void *on_complete_arg) {
-    if (vm_task_is_running()) {
-        ESP_LOGE(TAG, "Program already running");
-        return false;
+    return program_enqueue(
+        type, PROGRAM_PRIORITY_NORMAL, on_complete, on_complete_arg, NULL);
+}
+
+bool program_enqueue(program_type_t type,
+                     program_priority_t priority,
+                     program_execution_complete_callback_t on_complete,
+                     void *on_complete_arg,
+                     uint32_t *out_position) {
+    uint32_t id = program_get_selected(type);
+    if (id != 0 && id >= program_get_count(type)) {
+        ESP_LOGW(TAG,
+                 "Selected program %lu no longer exists, running program 0",
+                 (unsigned long)id);
+        id = 0;
     }
+    return program_enqueue_by_id(
+        type, id, priority, on_complete, on_complete_arg, out_position);
+}
 
-    // Load program from storage
-    uint32_t program_size;
-    const uint8_t *program = program_get(type, &program_size);
+bool program_execute_by_id(program_type_t type,
+                           uint32_t id,
+                           program_execution_complete_callback_t on_complete,
+                           void *on_complete_arg) {
+    return program_enqueue_by_id(
+        type, id, PROGRAM_PRIORITY_NORMAL, on_complete, on_complete_arg, NULL);
+}
+
+// Queue a run of a stored program; the run takes over the image reference
+static bool enqueue_located_program(program_type_t type,
+                                    uint32_t id,
+                                    program_priority_t priority,
+                                    program_execution_complete_callback_t on_complete,
+                                    void *on_complete_arg,
+                                    uint32_t *out_position) {
+    program_info_t info;
+    program_ref_t image;
+    const uint8_t *program = locate_program(type, id, &info, &image);
+    uint32_t program_size = info.size;
 
     if (program == NULL || program_size == 0) {
-        ESP_LOGI(TAG, "No valid program in storage for type %d", type);
+        ESP_LOGI(TAG,
+                 "No valid program %lu in storage for type %d",
+                 (unsigned long)id,
+                 type);
         return false;
     }
 
-    ESP_LOGI(TAG, "Loaded program (%lu bytes)", (unsigned long)program_size);
+    ESP_LOGI(TAG,
+             "Loaded program %lu (%lu bytes)",
+             (unsigned long)id,
+             (unsigned long)program_size);
+
+    // Start program execution with completion callback. Flash programs are re-run
+    // often (e.g. button auto-repeat), so run them from the decoded program cache; RAM
+    // programs execute straight from the bytecode, verified on their first run only.
+    // Library programs other than the first are keyed by the image hash mixed with
+    // their id.
+    bool started;
+    uint32_t program_hash;
+    if (type == PROGRAM_TYPE_FLASH && program_flash_get_hash(&program_hash)) {
+        if (id != 0) {
+            program_hash =
+                esp_rom_crc32_le(program_hash, (const uint8_t *)&id, sizeof(id));
+        }
+        started = vm_task_start_cached_program(program,
+                                               program_size,
+                                               program_hash,
+                                               release_run_snapshot,
+                                               image.snapshot,
+                                               (vm_run_priority_t)priority,
+                                               on_complete,
+                                               on_complete_arg,
+                                               out_position);
+    } else {
+        // RAM snapshots never change once written, so they keep the verification
+        // result of each program
+        vm_verification_t *verification =
+            program_ram_get_verification(image.snapshot, id);
+        started = vm_task_start_program(program,
+                                        program_size,
+                                        release_run_snapshot,
+                                        image.snapshot,
+                                        verification,
+                                        (vm_run_priority_t)priority,
+                                        on_complete,
+                                        on_complete_arg,
+                                        out_position);
+    }
 
-    // Start program execution with completion callback
-    if (!vm_task_start_program(program, program_size, on_complete, on_complete_arg)) {
-        ESP_LOGW(TAG, "Failed to start program execution");
+    if (!started) {
+        ESP_LOGW(TAG, "Failed to queue program execution");
+        program_release(&image);
         return false;
     }
 
-    ESP_LOGI(TAG, "Program execution started");
+    ESP_LOGI(TAG, "Program execution queued");
     return true;
 }
 
+bool program_enqueue_by_id(program_type_t type,
+                           uint32_t id,
+                           program_priority_t priority,
+                           program_execution_complete_callback_t on_complete,
+                           void *on_complete_arg,
+                           uint32_t *out_position) {
+    latency_stats_mark(LATENCY_POINT_EXECUTE);
+
+    // Activation halts the VM and switches slots under the same mutex, so a flash
+    // run is either dropped by the halt or queued from the new slot
+    if (type == PROGRAM_TYPE_FLASH) {
+        xSemaphoreTake(g_flash_run_mutex, portMAX_DELAY);
+    }
+    bool queued = enqueue_located_program(
+        type, id, priority, on_complete, on_complete_arg, out_position);
+    if (type == PROGRAM_TYPE_FLASH) {
+        xSemaphoreGive(g_flash_run_mutex);
+    }
+    return queued;
+}
+
+bool program_execute_streaming(program_type_t type,
+                               program_execution_complete_callback_t on_complete,
+                               void *on_complete_arg) {
+    if (type != PROGRAM_TYPE_RAM) {
+        ESP_LOGE(TAG, "Streaming execution is only supported for RAM programs");
+        return false;
+    }
+
+    // The run holds the write session's snapshot, so a later upload can't pull
+    // the program out from under it
+    const uint8_t *program;
+    uint32_t program_size;
+    program_ram_snapshot_t *snapshot =
+        program_ram_acquire_streaming(&program, &program_size);
+    if (snapshot == NULL) {
+        ESP_LOGI(TAG, "No RAM program write in progress to stream");
+        return false;
+    }
+
+    if (!vm_task_start_streaming_program(program,
+                                         program_size,
+                                         wait_run_snapshot,
+                                         release_run_snapshot,
+                                         snapshot,
+                                         VM_RUN_PRIORITY_NORMAL,
+                                         on_complete,
+                                         on_complete_arg,
+                                         NULL)) {
+        ESP_LOGW(TAG, "Failed to start streaming program execution");
+        program_ram_release(snapshot);
+        return false;
+    }
+
+    ESP_LOGI(TAG,
+             "Streaming program execution started (%lu bytes)",
+             (unsigned long)program_size);
+    return true;
+}
+
+uint32_t program_get_queue_length(void) {
+    return vm_task_get_queue_length();
+}
+
+bool program_wait_idle(uint32_t timeout_ms) {
+    return vm_task_wait_idle(timeout_ms);
+}
+
 bool program_is_running(void) {
     return vm_task_is_running();
 }
@@ -1,16 +1,46 @@
 #include "program_flash.h"
+#include <stddef.h>
 #include <string.h>
 #include "esp_flash.h"
 #include "esp_log.h"
 #include "esp_partition.h"
+#include "esp_rom_crc.h"
 #include "freertos/FreeRTOS.h"
 #include "freertos/semphr.h"
+#include "freertos/task.h"
 #include "spi_flash_mmap.h"
 
 static const char *TAG = "program_flash";
 
 #define PROGRAM_STORAGE_PARTITION_LABEL "odkey_programs"
 
+// The partition is split into two slots, each a header page followed by program
+// pages. Uploads go to the inactive slot and activation writes its header, so the
+// active program stays readable throughout. The header with the highest sequence
+// number wins.
+#define PROGRAM_FLASH_SLOT_COUNT 2
+#define PROGRAM_FLASH_SLOT_SIZE (PROGRAM_FLASH_PAGE_SIZE + PROGRAM_FLASH_MAX_SIZE)
+#define PROGRAM_FLASH_SLOT_PAGES (PROGRAM_FLASH_SLOT_SIZE / PROGRAM_FLASH_PAGE_SIZE)
+#define PROGRAM_FLASH_HEADER_MAGIC 0x504B444F  // "ODKP"
+#define PROGRAM_FLASH_NO_SLOT -1
+
+// Background erase task configuration
+#define ERASE_TASK_STACK_SIZE 3072
+#define ERASE_TASK_PRIORITY 1
+
+/**
+ * @brief Slot header stored at the start of each slot's first page
+ * @note Pre-A/B firmware stored only a uint32_t size at offset 0; that layout is
+ * still recognized as slot 0 with sequence 0.
+ */
+typedef struct {
+    uint32_t magic;         // PROGRAM_FLASH_HEADER_MAGIC
+    uint32_t sequence;      // Incremented on every activation
+    uint32_t program_size;  // Program size in bytes
+    uint32_t program_crc;   // CRC32 of the program bytecode
+    uint32_t header_crc;    // CRC32 of the fields above
+} program_flash_header_t;
+
 /**
  * @brief Program storage write state (private to this module)
  */
@@ -30,6 +60,20 @@ static esp_partition_mmap_handle_t g_mmap_handle = 0;
 // Mutex to protect shared state
 static SemaphoreHandle_t g_write_state_mutex = NULL;
 
+// CRC32 of the stored program, computed on first request and cleared on write/erase
+static uint32_t g_program_hash = 0;
+static bool g_program_hash_valid = false;
+
+// Slot state (protected by g_write_state_mutex)
+static int g_active_slot = PROGRAM_FLASH_NO_SLOT;  // Slot holding the active program
+static uint32_t g_active_size = 0;                 // Active program size
+static uint32_t g_active_sequence = 0;             // Active header sequence number
+static int g_target_slot = 0;                      // Slot that receives uploads
+static uint32_t g_target_erased_pages = 0;  // Leading target slot pages known erased
+
+// Background erase task handle
+static TaskHandle_t g_erase_task_handle = NULL;
+
 // Chunked write state for flash
 static struct {
     uint32_t expected_size;                   // Expected program size
@@ -38,6 +82,9 @@ static struct {
     uint8_t buffer[PROGRAM_FLASH_PAGE_SIZE];  // 4KB page buffer
     program_storage_write_state_t state;      // IDLE, WRITING, ERROR
     program_write_source_t current_source;    // Current owner of write session
+    bool patch;                               // Unsent pages come from patch_slot
+    int patch_slot;                           // Slot holding the program being patched
+    uint32_t patch_pages;                     // Program pages available in patch_slot
 } g_write_state = {0};
 
 // Helper function to convert source enum to string
@@ -45,6 +92,8 @@ static const char *source_to_string(program_write_source_t source) {
     switch (source) {
     case PROGRAM_WRITE_SOURCE_USB:
         return "USB";
+    case PROGRAM_WRITE_SOURCE_USB_BULK:
+        return "USB bulk";
     case PROGRAM_WRITE_SOURCE_HTTP:
         return "HTTP";
     case PROGRAM_WRITE_SOURCE_NONE:
@@ -61,6 +110,107 @@ static void reset_write_state_unsafe(void) {
     memset(g_write_state.buffer, 0, sizeof(g_write_state.buffer));
     g_write_state.state = PROGRAM_STORAGE_STATE_IDLE;
     g_write_state.current_source = PROGRAM_WRITE_SOURCE_NONE;
+    g_write_state.patch = false;
+    g_write_state.patch_slot = PROGRAM_FLASH_NO_SLOT;
+    g_write_state.patch_pages = 0;
+}
+
+// Number of pages a program of the given size occupies
+static uint32_t program_page_count(uint32_t program_size) {
+    return (program_size + PROGRAM_FLASH_PAGE_SIZE - 1) / PROGRAM_FLASH_PAGE_SIZE;
+}
+
+// Offset of a slot within the partition
+static uint32_t slot_offset(int slot) {
+    return (uint32_t)slot * PROGRAM_FLASH_SLOT_SIZE;
+}
+
+// CRC32 of the header fields that precede header_crc
+static uint32_t header_crc(const program_flash_header_t *header) {
+    return esp_rom_crc32_le(
+        0, (const uint8_t *)header, offsetof(program_flash_header_t, header_crc));
+}
+
+// Read and validate a slot header, returns false if the slot holds no program
+static bool read_slot_header(int slot, program_flash_header_t *out_header) {
+    memcpy(out_header, g_mmap_data + slot_offset(slot), sizeof(*out_header));
+    if (out_header->magic == PROGRAM_FLASH_HEADER_MAGIC) {
+        return (out_header->header_crc == header_crc(out_header)) &&
+               (out_header->program_size != 0) &&
+               (out_header->program_size <= PROGRAM_FLASH_MAX_SIZE);
+    }
+
+    // Pre-A/B layout: a bare size at the start of the partition
+    uint32_t legacy_size = out_header->magic;
+    if (slot == 0 && legacy_size != 0 && legacy_size <= PROGRAM_FLASH_MAX_SIZE) {
+        out_header->sequence = 0;
+        out_header->program_size = legacy_size;
+        return true;
+    }
+    return false;
+}
+
+// Check whether a page of the target slot is still erased (assumes mutex is held)
+static bool target_page_is_erased_unsafe(uint32_t page) {
+    const uint32_t *words = (const uint32_t *)(g_mmap_data +
+                                               slot_offset(g_target_slot) +
+                                               page * PROGRAM_FLASH_PAGE_SIZE);
+    for (uint32_t i = 0; i < PROGRAM_FLASH_PAGE_SIZE / sizeof(uint32_t); i++) {
+        if (words[i] != 0xFFFFFFFF) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Erase the next not-yet-erased page of the target slot (assumes mutex is held).
+// The header page is always erased first so a stale header can never describe
+// partially erased program pages.
+static bool erase_next_target_page_unsafe(void) {
+    uint32_t page = g_target_erased_pages;
+    if (!target_page_is_erased_unsafe(page)) {
+        esp_err_t ret = esp_partition_erase_range(
+            g_program_partition,
+            slot_offset(g_target_slot) + page * PROGRAM_FLASH_PAGE_SIZE,
+            PROGRAM_FLASH_PAGE_SIZE);
+        if (ret != ESP_OK) {
+            ESP_LOGE(TAG, "Failed to erase slot page: %s", esp_err_to_name(ret));
+            return false;
+        }
+    }
+    g_target_erased_pages++;
+    return true;
+}
+
+// Background task that keeps the target slot erased ahead of the next upload
+static void erase_task(void *pvParameters) {
+    for (;;) {
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+
+        // Erase a page per mutex hold so reads and uploads are never stalled long
+        bool done = false;
+        while (!done) {
+            if (xSemaphoreTake(g_write_state_mutex, portMAX_DELAY) != pdTRUE) {
+                break;
+            }
+            done = (g_write_state.state == PROGRAM_STORAGE_STATE_WRITING) ||
+                   (g_target_erased_pages >= PROGRAM_FLASH_SLOT_PAGES) ||
+                   !erase_next_target_page_unsafe();
+            if (done && g_target_erased_pages >= PROGRAM_FLASH_SLOT_PAGES) {
+                ESP_LOGI(TAG, "Slot %d erased and ready for upload", g_target_slot);
+            }
+            xSemaphoreGive(g_write_state_mutex);
+            taskYIELD();
+        }
+    }
+}
+
+// Mark the target slot dirty and let the background task clean it (mutex held)
+static void schedule_target_erase_unsafe(void) {
+    g_target_erased_pages = 0;
+    if (g_erase_task_handle != NULL) {
+        xTaskNotifyGive(g_erase_task_handle);
+    }
 }
 
 // Internal function to write a full page to flash (assumes mutex is held)
@@ -77,13 +227,16 @@ static bool write_page_to_flash_unsafe(const uint8_t *page_data, size_t page_siz
         return false;
     }
 
-    if (g_write_state.bytes_written + page_size > g_program_partition->size) {
-        ESP_LOGE(TAG, "Page would exceed partition size");
+    if (g_write_state.bytes_written + page_size > PROGRAM_FLASH_SLOT_SIZE) {
+        ESP_LOGE(TAG, "Page would exceed slot size");
         return false;
     }
 
-    esp_err_t ret = esp_partition_write(
-        g_program_partition, g_write_state.bytes_written, page_data, page_size);
+    esp_err_t ret = esp_partition_write(g_program_partition,
+                                        slot_offset(g_target_slot) +
+                                            g_write_state.bytes_written,
+                                        page_data,
+                                        page_size);
     if (ret != ESP_OK) {
         ESP_LOGE(TAG, "Failed to write page: %s", esp_err_to_name(ret));
         return false;
@@ -141,6 +294,52 @@ bool program_flash_init(void) {
 
     ESP_LOGI(TAG, "Created mmap for program storage");
 
+    if (g_program_partition->size <
+        PROGRAM_FLASH_SLOT_COUNT * PROGRAM_FLASH_SLOT_SIZE) {
+        ESP_LOGE(TAG,
+                 "Program storage partition too small for %d slots of %lu bytes",
+                 PROGRAM_FLASH_SLOT_COUNT,
+                 (unsigned long)PROGRAM_FLASH_SLOT_SIZE);
+        return false;
+    }
+
+    // Pick the active slot: the valid header with the highest sequence number
+    for (int slot = 0; slot < PROGRAM_FLASH_SLOT_COUNT; slot++) {
+        program_flash_header_t header;
+        if (!read_slot_header(slot, &header)) {
+            continue;
+        }
+        if (g_active_slot == PROGRAM_FLASH_NO_SLOT ||
+            header.sequence > g_active_sequence) {
+            g_active_slot = slot;
+            g_active_size = header.program_size;
+            g_active_sequence = header.sequence;
+            g_program_hash = header.program_crc;
+            g_program_hash_valid = (header.magic == PROGRAM_FLASH_HEADER_MAGIC);
+        }
+    }
+    g_target_slot = (g_active_slot == PROGRAM_FLASH_NO_SLOT) ? 0 : 1 - g_active_slot;
+
+    ESP_LOGI(TAG,
+             "Active program slot: %d (%lu bytes, sequence %lu), upload slot: %d",
+             g_active_slot,
+             (unsigned long)g_active_size,
+             (unsigned long)g_active_sequence,
+             g_target_slot);
+
+    // Prepare the upload slot in the background
+    BaseType_t task_ret = xTaskCreate(erase_task,
+                                      "program_erase",
+                                      ERASE_TASK_STACK_SIZE,
+                                      NULL,
+                                      ERASE_TASK_PRIORITY,
+                                      &g_erase_task_handle);
+    if (task_ret != pdPASS) {
+        ESP_LOGE(TAG, "Failed to create erase task");
+        return false;
+    }
+    schedule_target_erase_unsafe();
+
     return true;
 }
 
@@ -158,36 +357,21 @@ static const uint8_t *program_flash_get_unsafe(uint32_t *out_size) {
         return NULL;
     }
 
-    // Check if we're currently in a write operation
-    if (g_write_state.state != PROGRAM_STORAGE_STATE_IDLE) {
-        ESP_LOGD(TAG,
-                 "Cannot get program while write operation is in progress (state: %d)",
-                 g_write_state.state);
-        *out_size = 0;
-        return NULL;
-    }
-
-    // Use mmap data
-    const uint8_t *data = g_mmap_data;
-
-    // Read program size from first 4 bytes
-    uint32_t program_size = 0;
-    memcpy(&program_size, data, sizeof(program_size));
-
-    // Check if partition is empty (all zeros) or has invalid size
-    if ((program_size == 0) || (program_size > PROGRAM_FLASH_MAX_SIZE)) {
-        ESP_LOGD(TAG,
-                 "No valid program in storage (size: %lu)",
-                 (unsigned long)program_size);
+    // Uploads go to the other slot, so the active program stays usable during writes
+    if (g_active_slot == PROGRAM_FLASH_NO_SLOT) {
+        ESP_LOGD(TAG, "No valid program in storage");
         *out_size = 0;
         return NULL;
     }
 
-    ESP_LOGI(TAG, "Found program in storage: %lu bytes", (unsigned long)program_size);
-    *out_size = program_size;
+    ESP_LOGD(TAG,
+             "Found program in slot %d: %lu bytes",
+             g_active_slot,
+             (unsigned long)g_active_size);
+    *out_size = g_active_size;
 
-    // Return pointer to program data (skip the size header page)
-    return data + PROGRAM_FLASH_PAGE_SIZE;
+    // Return pointer to program data (skip the slot header page)
+    return g_mmap_data + slot_offset(g_active_slot) + PROGRAM_FLASH_PAGE_SIZE;
 }
 
 const uint8_t *program_flash_get(uint32_t *out_size) {
@@ -211,8 +395,37 @@ const uint8_t *program_flash_get(uint32_t *out_size) {
     return result;
 }
 
+bool program_flash_get_hash(uint32_t *out_hash) {
+    if (out_hash == NULL || g_write_state_mutex == NULL) {
+        return false;
+    }
+
+    if (xSemaphoreTake(g_write_state_mutex, portMAX_DELAY) != pdTRUE) {
+        ESP_LOGE(TAG, "Failed to take write state mutex");
+        return false;
+    }
+
+    uint32_t program_size = 0;
+    const uint8_t *program = program_flash_get_unsafe(&program_size);
+    if (program != NULL && !g_program_hash_valid) {
+        g_program_hash = esp_rom_crc32_le(0, program, program_size);
+        g_program_hash_valid = true;
+        ESP_LOGD(TAG, "Computed program hash: 0x%08lX", (unsigned long)g_program_hash);
+    }
+    if (program != NULL) {
+        *out_hash = g_program_hash;
+    }
+
+    xSemaphoreGive(g_write_state_mutex);
+    return program != NULL;
+}
+
+// Internal function to start a write session (assumes mutex is held). Returns false
+// with out_erasing set when the target slot still needs erasing; one more page has
+// been erased and the caller should release the mutex and try again.
 static bool program_flash_write_start_unsafe(uint32_t expected_program_size,
-                                             program_write_source_t source) {
+                                             program_write_source_t source,
+                                             bool *out_erasing) {
     // Validate expected program size
     if (expected_program_size == 0) {
         ESP_LOGE(TAG, "Expected program size cannot be zero");
@@ -229,11 +442,10 @@ static bool program_flash_write_start_unsafe(uint32_t expected_program_size,
 
     // Calculate sectors needed (round up to 4KB boundaries)
     // ESP32 flash sectors are 4KB (0x1000 bytes)
-    // We need to erase: reserved first page + program data
+    // We need: slot header page + program data
     uint32_t total_size_needed = PROGRAM_FLASH_PAGE_SIZE + expected_program_size;
     uint32_t sectors_needed =
         (total_size_needed + (PROGRAM_FLASH_PAGE_SIZE - 1)) / PROGRAM_FLASH_PAGE_SIZE;
-    uint32_t erase_size = sectors_needed * PROGRAM_FLASH_PAGE_SIZE;
 
     // Check if we're interrupting an existing write session
     if (g_write_state.state == PROGRAM_STORAGE_STATE_WRITING &&
@@ -244,52 +456,89 @@ static bool program_flash_write_start_unsafe(uint32_t expected_program_size,
                  source_to_string(g_write_state.current_source));
     }
 
+    // An earlier unfinished session left data in the target slot. End it now so it
+    // stops writing there while the slot is erased again.
+    if (g_write_state.state != PROGRAM_STORAGE_STATE_IDLE) {
+        reset_write_state_unsafe();
+        g_target_erased_pages = 0;
+    }
+
+    // Normally the background task has already erased the slot; catch up on the next
+    // sector it has not reached yet
+    if (g_target_erased_pages < sectors_needed) {
+        *out_erasing = erase_next_target_page_unsafe();
+        return false;
+    }
+
     ESP_LOGI(TAG,
-             "Starting chunked write for %s (program: %lu bytes, erasing: %lu bytes, "
-             "sectors: %lu)",
+             "Starting chunked write for %s into slot %d (program: %lu bytes, sectors: "
+             "%lu)",
              source_to_string(source),
+             g_target_slot,
              (unsigned long)expected_program_size,
-             (unsigned long)erase_size,
              (unsigned long)sectors_needed);
 
-    // Erase only the necessary sectors
-    esp_err_t ret = esp_partition_erase_range(g_program_partition, 0, erase_size);
-    if (ret != ESP_OK) {
-        ESP_LOGE(TAG, "Failed to erase partition range: %s", esp_err_to_name(ret));
-        return false;
-    }
-
     // Initialize write state
     g_write_state.bytes_written =
         PROGRAM_FLASH_PAGE_SIZE;  // Skip over the entire first page (reserved for
-                                  // size header)
+                                  // slot header)
     g_write_state.expected_size = expected_program_size;
     g_write_state.buffer_offset = 0;
     memset(g_write_state.buffer, 0, sizeof(g_write_state.buffer));
     g_write_state.state = PROGRAM_STORAGE_STATE_WRITING;
     g_write_state.current_source = source;
+    g_write_state.patch = false;
 
     return true;
 }
 
-bool program_flash_write_start(uint32_t expected_program_size,
-                               program_write_source_t source) {
+// Start a write or patch session. Any erasing left over is done a page per mutex
+// hold, like the background task does, so program reads are never stalled for long.
+static bool write_start(uint32_t expected_program_size,
+                        program_write_source_t source,
+                        bool patch) {
     if (g_program_partition == NULL || g_write_state_mutex == NULL) {
         ESP_LOGE(TAG, "Program storage not initialized");
         return false;
     }
 
-    // Lock mutex to protect shared state
-    if (xSemaphoreTake(g_write_state_mutex, portMAX_DELAY) != pdTRUE) {
-        ESP_LOGE(TAG, "Failed to take write state mutex");
-        return false;
-    }
+    bool result;
+    bool erasing;
+    do {
+        // Lock mutex to protect shared state
+        if (xSemaphoreTake(g_write_state_mutex, portMAX_DELAY) != pdTRUE) {
+            ESP_LOGE(TAG, "Failed to take write state mutex");
+            return false;
+        }
 
-    bool result = program_flash_write_start_unsafe(expected_program_size, source);
-    xSemaphoreGive(g_write_state_mutex);
+        erasing = false;
+        result =
+            program_flash_write_start_unsafe(expected_program_size, source, &erasing);
+        if (result && patch) {
+            g_write_state.patch = true;
+            g_write_state.patch_slot = g_active_slot;
+            g_write_state.patch_pages = (g_active_slot == PROGRAM_FLASH_NO_SLOT)
+                                            ? 0
+                                            : program_page_count(g_active_size);
+            ESP_LOGI(TAG,
+                     "Patching program from slot %d (%lu pages available)",
+                     g_write_state.patch_slot,
+                     (unsigned long)g_write_state.patch_pages);
+        }
+
+        xSemaphoreGive(g_write_state_mutex);
+        if (erasing) {
+            taskYIELD();
+        }
+    } while (erasing);
     return result;
 }
 
+bool program_flash_write_start(uint32_t expected_program_size,
+                               program_write_source_t source) {
+    return write_start(expected_program_size, source, false);
+}
+
 static bool program_flash_write_chunk_unsafe(const uint8_t *data,
                                              uint32_t size,
                                              program_write_source_t source) {
@@ -472,23 +721,42 @@ static bool program_flash_write_finish_unsafe(uint32_t program_size,
         return false;
     }
 
-    // Write the size header at offset 0 (this makes the program "valid")
-    // Use uint32_t for consistent cross-platform compatibility
-    uint32_t size_header = program_size;
-    esp_err_t ret =
-        esp_partition_write(g_program_partition, 0, &size_header, sizeof(size_header));
+    // Write the slot header (this atomically makes the new program active)
+    const uint8_t *program =
+        g_mmap_data + slot_offset(g_target_slot) + PROGRAM_FLASH_PAGE_SIZE;
+    program_flash_header_t header = {
+        .magic = PROGRAM_FLASH_HEADER_MAGIC,
+        .sequence = g_active_sequence + 1,
+        .program_size = program_size,
+        .program_crc = esp_rom_crc32_le(0, program, program_size),
+    };
+    header.header_crc = header_crc(&header);
+    esp_err_t ret = esp_partition_write(
+        g_program_partition, slot_offset(g_target_slot), &header, sizeof(header));
     if (ret != ESP_OK) {
-        ESP_LOGE(TAG, "Failed to write size header: %s", esp_err_to_name(ret));
+        ESP_LOGE(TAG, "Failed to write slot header: %s", esp_err_to_name(ret));
         g_write_state.state = PROGRAM_STORAGE_STATE_ERROR;
         return false;
     }
 
+    // Switch slots; the previous program's slot becomes the next upload target
+    int previous_slot = g_active_slot;
+    g_active_slot = g_target_slot;
+    g_active_size = program_size;
+    g_active_sequence = header.sequence;
+    g_program_hash = header.program_crc;
+    g_program_hash_valid = true;
+    g_target_slot = (previous_slot == PROGRAM_FLASH_NO_SLOT) ? 1 - g_active_slot
+                                                             : previous_slot;
+
     ESP_LOGI(TAG,
-             "Successfully completed chunked write: %lu bytes",
-             (unsigned long)program_size);
+             "Successfully completed chunked write: %lu bytes (slot %d active)",
+             (unsigned long)program_size,
+             g_active_slot);
 
-    // Reset state
+    // Reset state and prepare the old slot for the next upload
     reset_write_state_unsafe();
+    schedule_target_erase_unsafe();
     return true;
 }
 
@@ -509,24 +777,215 @@ bool program_flash_write_finish(uint32_t program_size, program_write_source_t so
     return result;
 }
 
+void program_flash_write_abort(program_write_source_t source) {
+    if (g_write_state_mutex == NULL ||
+        xSemaphoreTake(g_write_state_mutex, portMAX_DELAY) != pdTRUE) {
+        return;
+    }
+
+    if (g_write_state.state != PROGRAM_STORAGE_STATE_IDLE &&
+        g_write_state.current_source == source) {
+        ESP_LOGI(TAG, "Write session aborted by %s", source_to_string(source));
+        reset_write_state_unsafe();
+        schedule_target_erase_unsafe();
+    }
+    xSemaphoreGive(g_write_state_mutex);
+}
+
+bool program_flash_get_page_hashes(uint32_t *out_hashes,
+                                   uint32_t max_hashes,
+                                   uint32_t *out_count) {
+    if (out_hashes == NULL || out_count == NULL || g_write_state_mutex == NULL) {
+        return false;
+    }
+
+    if (xSemaphoreTake(g_write_state_mutex, portMAX_DELAY) != pdTRUE) {
+        ESP_LOGE(TAG, "Failed to take write state mutex");
+        return false;
+    }
+
+    uint32_t program_size = 0;
+    const uint8_t *program = program_flash_get_unsafe(&program_size);
+    uint32_t page_count = program_page_count(program_size);
+    bool result = (program != NULL) && (page_count <= max_hashes);
+    if (result) {
+        // Pages are hashed including the zero padding after the program
+        for (uint32_t page = 0; page < page_count; page++) {
+            out_hashes[page] = esp_rom_crc32_le(
+                0, program + page * PROGRAM_FLASH_PAGE_SIZE, PROGRAM_FLASH_PAGE_SIZE);
+        }
+        *out_count = page_count;
+    }
+
+    xSemaphoreGive(g_write_state_mutex);
+    return result;
+}
+
+// Copy program pages from the patched slot up to (not including) end_page
+// (assumes mutex is held)
+static bool copy_patch_pages_unsafe(uint32_t end_page) {
+    for (;;) {
+        uint32_t page = g_write_state.bytes_written / PROGRAM_FLASH_PAGE_SIZE - 1;
+        if (page >= end_page) {
+            return true;
+        }
+        if (page >= g_write_state.patch_pages) {
+            ESP_LOGE(TAG,
+                     "Page %lu not sent and not present in the current program",
+                     (unsigned long)page);
+            return false;
+        }
+
+        // Flash writes can't source from mapped flash, so bounce through RAM
+        memcpy(g_write_state.buffer,
+               g_mmap_data + slot_offset(g_write_state.patch_slot) +
+                   (page + 1) * PROGRAM_FLASH_PAGE_SIZE,
+               PROGRAM_FLASH_PAGE_SIZE);
+        if (!write_page_to_flash_unsafe(g_write_state.buffer,
+                                        PROGRAM_FLASH_PAGE_SIZE)) {
+            return false;
+        }
+    }
+}
+
+static bool check_patch_session_unsafe(program_write_source_t source) {
+    if (g_write_state.state != PROGRAM_STORAGE_STATE_WRITING || !g_write_state.patch) {
+        ESP_LOGE(TAG, "Not in a patch session (state: %d)", g_write_state.state);
+        return false;
+    }
+
+    if (g_write_state.current_source != source) {
+        ESP_LOGE(TAG,
+                 "Source mismatch: expected %s, got %s",
+                 source_to_string(g_write_state.current_source),
+                 source_to_string(source));
+        return false;
+    }
+    return true;
+}
+
+bool program_flash_patch_start(uint32_t program_size, program_write_source_t source) {
+    return write_start(program_size, source, true);
+}
+
+bool program_flash_patch_page(uint32_t page_index,
+                              const uint8_t *data,
+                              program_write_source_t source) {
+    if (data == NULL || g_write_state_mutex == NULL) {
+        return false;
+    }
+
+    if (xSemaphoreTake(g_write_state_mutex, portMAX_DELAY) != pdTRUE) {
+        ESP_LOGE(TAG, "Failed to take write state mutex");
+        return false;
+    }
+
+    bool result = check_patch_session_unsafe(source);
+    if (result) {
+        uint32_t next_page = g_write_state.bytes_written / PROGRAM_FLASH_PAGE_SIZE - 1;
+        if (page_index < next_page ||
+            page_index >= program_page_count(g_write_state.expected_size)) {
+            ESP_LOGE(TAG,
+                     "Patch page %lu out of order or out of range (next: %lu)",
+                     (unsigned long)page_index,
+                     (unsigned long)next_page);
+            result = false;
+        } else {
+            // Pages the host skipped are unchanged, so copy them over first
+            result = copy_patch_pages_unsafe(page_index) &&
+                     write_page_to_flash_unsafe(data, PROGRAM_FLASH_PAGE_SIZE);
+        }
+        if (!result) {
+            g_write_state.state = PROGRAM_STORAGE_STATE_ERROR;
+        }
+    }
+
+    xSemaphoreGive(g_write_state_mutex);
+    return result;
+}
+
+bool program_flash_patch_finish(uint32_t program_size,
+                                uint32_t program_crc,
+                                program_write_source_t source) {
+    if (g_write_state_mutex == NULL) {
+        ESP_LOGE(TAG, "Program storage not initialized");
+        return false;
+    }
+
+    if (xSemaphoreTake(g_write_state_mutex, portMAX_DELAY) != pdTRUE) {
+        ESP_LOGE(TAG, "Failed to take write state mutex");
+        return false;
+    }
+
+    bool result = check_patch_session_unsafe(source);
+    if (result && (program_size != g_write_state.expected_size ||
+                   !copy_patch_pages_unsafe(program_page_count(program_size)))) {
+        result = false;
+    }
+
+    // Only activate the patched program if it matches what the host intended
+    if (result) {
+        uint32_t crc = esp_rom_crc32_le(0,
+                                        g_mmap_data + slot_offset(g_target_slot) +
+                                            PROGRAM_FLASH_PAGE_SIZE,
+                                        program_size);
+        if (crc != program_crc) {
+            ESP_LOGE(TAG,
+                     "Patched program CRC mismatch: expected 0x%08lX, got 0x%08lX",
+                     (unsigned long)program_crc,
+                     (unsigned long)crc);
+            result = false;
+        }
+    }
+
+    if (result) {
+        result = program_flash_write_finish_unsafe(program_size, source);
+    } else if (g_write_state.state == PROGRAM_STORAGE_STATE_WRITING) {
+        g_write_state.state = PROGRAM_STORAGE_STATE_ERROR;
+    }
+
+    xSemaphoreGive(g_write_state_mutex);
+    return result;
+}
+
 bool program_flash_erase(void) {
-    if (g_program_partition == NULL) {
+    if (g_program_partition == NULL || g_write_state_mutex == NULL) {
         ESP_LOGE(TAG, "Program storage not initialized");
         return false;
     }
 
+    if (xSemaphoreTake(g_write_state_mutex, portMAX_DELAY) != pdTRUE) {
+        ESP_LOGE(TAG, "Failed to take write state mutex");
+        return false;
+    }
+
     ESP_LOGI(TAG, "Erasing program from flash storage");
 
-    // Erase the entire partition
-    esp_err_t ret =
-        esp_partition_erase_range(g_program_partition, 0, g_program_partition->size);
-    if (ret != ESP_OK) {
-        ESP_LOGE(TAG, "Failed to erase partition: %s", esp_err_to_name(ret));
-        return false;
+    // Erasing the active slot's header page removes the program; the rest of the
+    // slot is cleaned up in the background when it next becomes the upload target
+    bool result = true;
+
+    // Make sure an older header in the upload slot can't take over after a reboot
+    if (g_target_erased_pages == 0 && !erase_next_target_page_unsafe()) {
+        result = false;
+    }
+
+    if (result && g_active_slot != PROGRAM_FLASH_NO_SLOT) {
+        esp_err_t ret = esp_partition_erase_range(
+            g_program_partition, slot_offset(g_active_slot), PROGRAM_FLASH_PAGE_SIZE);
+        if (ret != ESP_OK) {
+            ESP_LOGE(TAG, "Failed to erase slot header: %s", esp_err_to_name(ret));
+            result = false;
+        } else {
+            g_active_slot = PROGRAM_FLASH_NO_SLOT;
+            g_active_size = 0;
+            g_program_hash_valid = false;
+            ESP_LOGI(TAG, "Successfully erased program from flash storage");
+        }
     }
 
-    ESP_LOGI(TAG, "Successfully erased program from flash storage");
-    return true;
+    xSemaphoreGive(g_write_state_mutex);
+    return result;
 }
 
 uint32_t program_flash_get_bytes_written(void) {
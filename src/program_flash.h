@@ -23,7 +23,17 @@ bool program_flash_init(void);
 const uint8_t *program_flash_get(uint32_t *out_size);
 
 /**
- * @brief Start writing a new program to flash (erases only necessary sectors)
+ * @brief Get a hash of the program in flash
+ * @param out_hash Pointer to hold the CRC32 of the program bytecode
+ * @return true if a valid program is stored, false otherwise
+ * @note The hash is computed on first use and cached until the program changes
+ */
+bool program_flash_get_hash(uint32_t *out_hash);
+
+/**
+ * @brief Start writing a new program to the inactive flash slot
+ * @note The slot is normally erased in the background ahead of time; any sectors
+ * not yet erased are erased here. The active program stays readable until finish.
  * @param expected_program_size The expected size of the program to be written
  * @param source The source requesting the write (USB or HTTP)
  * @return true on success, false on failure
@@ -43,13 +53,64 @@ bool program_flash_write_chunk(const uint8_t *data,
                                program_write_source_t source);
 
 /**
- * @brief Finish writing program to flash (commits the size header)
+ * @brief Finish writing program to flash (writes the slot header, making it active)
  * @param program_size The size, in bytes, of the program data
  * @param source The source requesting the finish (must match current owner)
  * @return true on success, false on failure
  */
 bool program_flash_write_finish(uint32_t program_size, program_write_source_t source);
 
+/**
+ * @brief Abandon the write or patch session of a source, if it has one
+ * @param source The source that started the session
+ * @note The partly written target slot is erased again in the background
+ */
+void program_flash_write_abort(program_write_source_t source);
+
+/**
+ * @brief Get CRC32 hashes of each page of the program in flash
+ * @param out_hashes Array to hold one hash per PROGRAM_FLASH_PAGE_SIZE page
+ * @param max_hashes Capacity of out_hashes
+ * @param out_count Pointer to hold the number of pages hashed
+ * @return true if a valid program is stored and fits in out_hashes, false otherwise
+ * @note The last page is hashed including its zero padding
+ */
+bool program_flash_get_page_hashes(uint32_t *out_hashes,
+                                   uint32_t max_hashes,
+                                   uint32_t *out_count);
+
+/**
+ * @brief Start a patch session that builds a new program from the current one
+ * @param program_size The size of the new program
+ * @param source The source requesting the write (USB or HTTP)
+ * @return true on success, false on failure
+ * @note Pages not sent with program_flash_patch_page() are copied from the
+ * current program
+ */
+bool program_flash_patch_start(uint32_t program_size, program_write_source_t source);
+
+/**
+ * @brief Write one changed page of the new program
+ * @param page_index Index of the page within the program (ascending order)
+ * @param data PROGRAM_FLASH_PAGE_SIZE bytes of page data (zero padded)
+ * @param source The source requesting the write (must match current owner)
+ * @return true on success, false on failure
+ */
+bool program_flash_patch_page(uint32_t page_index,
+                              const uint8_t *data,
+                              program_write_source_t source);
+
+/**
+ * @brief Finish a patch session, activating the new program if its CRC matches
+ * @param program_size The size of the new program
+ * @param program_crc CRC32 of the whole new program
+ * @param source The source requesting the finish (must match current owner)
+ * @return true on success, false on failure
+ */
+bool program_flash_patch_finish(uint32_t program_size,
+                                uint32_t program_crc,
+                                program_write_source_t source);
+
 /**
  * @brief Get number of bytes written so far
  * @return Number of bytes written
@@ -63,7 +124,7 @@ uint32_t program_flash_get_bytes_written(void);
 uint32_t program_flash_get_expected_size(void);
 
 /**
- * @brief Erase program from flash
+ * @brief Erase program from flash (invalidates the active slot header)
  * @return true on success, false on failure
  */
 bool program_flash_erase(void);
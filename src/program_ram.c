@@ -3,7 +3,9 @@
 #include "esp_heap_caps.h"
 #include "esp_log.h"
 #include "freertos/FreeRTOS.h"
+#include "freertos/event_groups.h"
 #include "freertos/semphr.h"
+#include "freertos/task.h"
 
 static const char *TAG = "program_ram";
 
@@ -19,15 +21,31 @@ typedef enum {
 // Mutex to protect RAM state
 static SemaphoreHandle_t g_ram_write_state_mutex = NULL;
 
+// Signals streaming readers whenever the write session makes progress or ends
+static EventGroupHandle_t g_ram_write_events = NULL;
+#define RAM_WRITE_PROGRESS_BIT (1 << 0)
+
+// Reference-counted program buffer in PSRAM, sized for one program. Only its write
+// session writes to it; once the session finishes it is never modified, so holders
+// of a reference keep reading it while newer programs are uploaded.
+struct program_ram_snapshot {
+    uint32_t refs;  // References held (protected by g_ram_write_state_mutex)
+    uint32_t size;  // Program size once the write session finished, else 0
+    // Verification of each library program, filled in by its first run
+    vm_verification_t verification[PROGRAM_LIBRARY_MAX_PROGRAMS];
+    uint8_t data[];
+};
+
 // RAM write state
 static struct {
     uint32_t expected_size;                 // Expected program size
-    uint32_t bytes_written;                 // Total bytes written to RAM buffer
-    uint32_t buffer_offset;                 // Current position in write buffer
-    uint8_t *buffer;                        // 1MB write buffer (allocated in PSRAM)
+    uint32_t bytes_written;                 // Total bytes written to the session
+    program_ram_snapshot_t *session;        // Snapshot being written (WRITING, ERROR)
     program_storage_write_state_t state;    // IDLE, WRITING, ERROR
     program_write_source_t current_source;  // Current owner of write session
-    uint32_t stored_program_size;           // Stored program size (set in finish)
+    program_ram_snapshot_t *stored;         // Stored program (set in finish)
+    program_ram_snapshot_t *reserved;       // Snapshot reserved for direct writes
+    program_write_source_t reserved_by;     // Source holding the reservation
 } g_ram_write_state = {0};
 
 // Helper function to convert source enum to string
@@ -35,6 +53,8 @@ static const char *source_to_string(program_write_source_t source) {
     switch (source) {
     case PROGRAM_WRITE_SOURCE_USB:
         return "USB";
+    case PROGRAM_WRITE_SOURCE_USB_BULK:
+        return "USB bulk";
     case PROGRAM_WRITE_SOURCE_HTTP:
         return "HTTP";
     case PROGRAM_WRITE_SOURCE_NONE:
@@ -43,17 +63,36 @@ static const char *source_to_string(program_write_source_t source) {
     }
 }
 
-// Internal function to reset RAM write state (assumes mutex is held)
+// Internal function to drop a snapshot reference, freeing the snapshot with the
+// last one (assumes mutex is held)
+static void release_snapshot_unsafe(program_ram_snapshot_t *snapshot) {
+    if (snapshot != NULL && --snapshot->refs == 0) {
+        heap_caps_free(snapshot);
+    }
+}
+
+// Internal function to end a source's reservation, dropping its reference to the
+// reserved snapshot (assumes mutex is held)
+static void release_reservation_unsafe(program_write_source_t source) {
+    if (g_ram_write_state.reserved != NULL && g_ram_write_state.reserved_by == source) {
+        release_snapshot_unsafe(g_ram_write_state.reserved);
+        g_ram_write_state.reserved = NULL;
+        g_ram_write_state.reserved_by = PROGRAM_WRITE_SOURCE_NONE;
+    }
+}
+
+// Internal function to reset RAM write state (assumes mutex is held). A reservation
+// is left alone: its holder may still be writing to the snapshot, which stays
+// allocated until the reservation is committed or aborted.
 static void reset_ram_write_state_unsafe(void) {
     g_ram_write_state.bytes_written = 0;
     g_ram_write_state.expected_size = 0;
-    g_ram_write_state.buffer_offset = 0;
-    if (g_ram_write_state.buffer != NULL) {
-        memset(g_ram_write_state.buffer, 0, PROGRAM_RAM_MAX_SIZE);
-    }
+    release_snapshot_unsafe(g_ram_write_state.session);
+    g_ram_write_state.session = NULL;
     g_ram_write_state.state = PROGRAM_STORAGE_STATE_IDLE;
     g_ram_write_state.current_source = PROGRAM_WRITE_SOURCE_NONE;
-    g_ram_write_state.stored_program_size = 0;
+    release_snapshot_unsafe(g_ram_write_state.stored);
+    g_ram_write_state.stored = NULL;
 }
 
 bool program_ram_init(void) {
@@ -64,83 +103,102 @@ bool program_ram_init(void) {
         return false;
     }
 
-    // Allocate program buffer in PSRAM
-    g_ram_write_state.buffer =
-        heap_caps_malloc(PROGRAM_RAM_MAX_SIZE, MALLOC_CAP_SPIRAM);
-    if (g_ram_write_state.buffer == NULL) {
-        ESP_LOGE(TAG, "Failed to allocate program buffer in PSRAM");
+    g_ram_write_events = xEventGroupCreate();
+    if (g_ram_write_events == NULL) {
+        ESP_LOGE(TAG, "Failed to create RAM write event group");
         vSemaphoreDelete(g_ram_write_state_mutex);
         g_ram_write_state_mutex = NULL;
         return false;
     }
 
-    // Initialize buffer state
-    memset(g_ram_write_state.buffer, 0, PROGRAM_RAM_MAX_SIZE);
+    // Each upload allocates its own snapshot in PSRAM when it starts
     g_ram_write_state.bytes_written = 0;
     g_ram_write_state.expected_size = 0;
-    g_ram_write_state.buffer_offset = 0;
+    g_ram_write_state.session = NULL;
     g_ram_write_state.state = PROGRAM_STORAGE_STATE_IDLE;
     g_ram_write_state.current_source = PROGRAM_WRITE_SOURCE_NONE;
-    g_ram_write_state.stored_program_size = 0;
+    g_ram_write_state.stored = NULL;
+    g_ram_write_state.reserved = NULL;
+    g_ram_write_state.reserved_by = PROGRAM_WRITE_SOURCE_NONE;
 
-    ESP_LOGI(TAG, "RAM storage initialized (%d bytes in PSRAM)", PROGRAM_RAM_MAX_SIZE);
+    ESP_LOGI(TAG,
+             "RAM storage initialized (programs up to %d bytes in PSRAM)",
+             PROGRAM_RAM_MAX_SIZE);
     return true;
 }
 
-// Internal function to get RAM program data (assumes mutex is held)
-static const uint8_t *program_ram_get_unsafe(uint32_t *out_size) {
-    if (out_size == NULL) {
-        ESP_LOGE(TAG, "out_size parameter cannot be NULL");
-        return NULL;
-    }
-
+// Internal function to take a reference to the stored RAM program (assumes mutex is
+// held)
+static program_ram_snapshot_t *program_ram_acquire_unsafe(const uint8_t **out_data,
+                                                          uint32_t *out_size) {
     // Check if we're currently in a write operation
     if (g_ram_write_state.state != PROGRAM_STORAGE_STATE_IDLE) {
         ESP_LOGD(
             TAG,
             "Cannot get RAM program while write operation is in progress (state: %d)",
             g_ram_write_state.state);
-        *out_size = 0;
         return NULL;
     }
 
     // Check if we have a valid program
-    if (g_ram_write_state.stored_program_size == 0) {
+    program_ram_snapshot_t *snapshot = g_ram_write_state.stored;
+    if (snapshot == NULL) {
         ESP_LOGD(TAG, "No valid RAM program in storage");
-        *out_size = 0;
         return NULL;
     }
 
-    ESP_LOGI(TAG,
+    ESP_LOGD(TAG,
              "Found RAM program in storage: %lu bytes",
-             (unsigned long)g_ram_write_state.stored_program_size);
-    *out_size = g_ram_write_state.stored_program_size;
-
-    // Return pointer to RAM program buffer
-    return g_ram_write_state.buffer;
+             (unsigned long)snapshot->size);
+    snapshot->refs++;
+    *out_data = snapshot->data;
+    *out_size = snapshot->size;
+    return snapshot;
 }
 
-const uint8_t *program_ram_get(uint32_t *out_size) {
+program_ram_snapshot_t *program_ram_acquire(const uint8_t **out_data,
+                                            uint32_t *out_size) {
+    if (out_data == NULL || out_size == NULL) {
+        ESP_LOGE(TAG, "Output parameters cannot be NULL");
+        return NULL;
+    }
+    *out_data = NULL;
+    *out_size = 0;
+
     if (g_ram_write_state_mutex == NULL) {
         ESP_LOGE(TAG, "RAM storage not initialized");
-        if (out_size)
-            *out_size = 0;
         return NULL;
     }
 
     // Lock mutex to protect RAM state
     if (xSemaphoreTake(g_ram_write_state_mutex, portMAX_DELAY) != pdTRUE) {
         ESP_LOGE(TAG, "Failed to take RAM write state mutex");
-        if (out_size)
-            *out_size = 0;
         return NULL;
     }
 
-    const uint8_t *result = program_ram_get_unsafe(out_size);
+    program_ram_snapshot_t *result = program_ram_acquire_unsafe(out_data, out_size);
     xSemaphoreGive(g_ram_write_state_mutex);
     return result;
 }
 
+void program_ram_release(program_ram_snapshot_t *snapshot) {
+    if (snapshot == NULL || g_ram_write_state_mutex == NULL) {
+        return;
+    }
+
+    xSemaphoreTake(g_ram_write_state_mutex, portMAX_DELAY);
+    release_snapshot_unsafe(snapshot);
+    xSemaphoreGive(g_ram_write_state_mutex);
+}
+
+vm_verification_t *program_ram_get_verification(program_ram_snapshot_t *snapshot,
+                                                uint32_t id) {
+    if (snapshot == NULL || id >= PROGRAM_LIBRARY_MAX_PROGRAMS) {
+        return NULL;
+    }
+    return &snapshot->verification[id];
+}
+
 static bool program_ram_write_start_unsafe(uint32_t expected_program_size,
                                            program_write_source_t source) {
     // Validate expected program size
@@ -171,16 +229,27 @@ static bool program_ram_write_start_unsafe(uint32_t expected_program_size,
              source_to_string(source),
              (unsigned long)expected_program_size);
 
+    // Drop the interrupted session and the stored program before allocating, so
+    // their memory can be reused unless someone still holds a reference
+    reset_ram_write_state_unsafe();
+    program_ram_snapshot_t *snapshot = heap_caps_malloc(
+        sizeof(program_ram_snapshot_t) + expected_program_size, MALLOC_CAP_SPIRAM);
+    if (snapshot == NULL) {
+        ESP_LOGE(TAG,
+                 "Failed to allocate %lu byte RAM program in PSRAM",
+                 (unsigned long)expected_program_size);
+        return false;
+    }
+    snapshot->refs = 1;  // Held by the write session
+    snapshot->size = 0;
+    memset(snapshot->verification, 0, sizeof(snapshot->verification));
+
     // Initialize RAM write state
     g_ram_write_state.expected_size = expected_program_size;
     g_ram_write_state.bytes_written = 0;
-    g_ram_write_state.buffer_offset = 0;
-    if (g_ram_write_state.buffer != NULL) {
-        memset(g_ram_write_state.buffer, 0, PROGRAM_RAM_MAX_SIZE);
-    }
+    g_ram_write_state.session = snapshot;
     g_ram_write_state.state = PROGRAM_STORAGE_STATE_WRITING;
     g_ram_write_state.current_source = source;
-    g_ram_write_state.stored_program_size = 0;
 
     return true;
 }
@@ -200,6 +269,7 @@ bool program_ram_write_start(uint32_t expected_program_size,
 
     bool result = program_ram_write_start_unsafe(expected_program_size, source);
     xSemaphoreGive(g_ram_write_state_mutex);
+    xEventGroupSetBits(g_ram_write_events, RAM_WRITE_PROGRESS_BIT);
     return result;
 }
 
@@ -251,24 +321,134 @@ static bool program_ram_write_chunk_unsafe(const uint8_t *data,
         return false;
     }
 
-    // Check if we would exceed buffer size
-    if (g_ram_write_state.buffer_offset + size > PROGRAM_RAM_MAX_SIZE) {
+    // Simple memcpy to the snapshot, which holds exactly the expected size
+    memcpy(g_ram_write_state.session->data + g_ram_write_state.bytes_written,
+           data,
+           size);
+    g_ram_write_state.bytes_written += size;
+
+    ESP_LOGD(TAG,
+             "Buffered %lu bytes to RAM, total written: %lu/%lu",
+             (unsigned long)size,
+             (unsigned long)g_ram_write_state.bytes_written,
+             (unsigned long)g_ram_write_state.expected_size);
+
+    return true;
+}
+
+bool program_ram_write_chunk(const uint8_t *data,
+                             uint32_t size,
+                             program_write_source_t source) {
+    if (g_ram_write_state_mutex == NULL) {
+        ESP_LOGE(TAG, "RAM storage not initialized");
+        return false;
+    }
+
+    // Lock mutex to protect RAM state
+    if (xSemaphoreTake(g_ram_write_state_mutex, portMAX_DELAY) != pdTRUE) {
+        ESP_LOGE(TAG, "Failed to take RAM write state mutex");
+        return false;
+    }
+
+    bool result = program_ram_write_chunk_unsafe(data, size, source);
+    xSemaphoreGive(g_ram_write_state_mutex);
+    xEventGroupSetBits(g_ram_write_events, RAM_WRITE_PROGRESS_BIT);
+    return result;
+}
+
+static uint8_t *program_ram_write_reserve_unsafe(uint32_t *out_size,
+                                               program_write_source_t source) {
+    if (g_ram_write_state.state != PROGRAM_STORAGE_STATE_WRITING) {
+        ESP_LOGE(TAG,
+                 "RAM program storage write reserve called but not in writing state "
+                 "(state: %d)",
+                 g_ram_write_state.state);
+        return NULL;
+    }
+
+    if (g_ram_write_state.current_source != source) {
         ESP_LOGE(TAG,
-                 "Write would exceed buffer size: %lu + %lu > %lu",
-                 (unsigned long)g_ram_write_state.buffer_offset,
+                 "Source mismatch: expected %s, got %s",
+                 source_to_string(g_ram_write_state.current_source),
+                 source_to_string(source));
+        return NULL;
+    }
+
+    // The reservation holds its own reference, so the snapshot outlives the session
+    // if another source replaces it while the caller is still writing
+    release_reservation_unsafe(source);
+    g_ram_write_state.reserved = g_ram_write_state.session;
+    g_ram_write_state.reserved->refs++;
+    g_ram_write_state.reserved_by = source;
+
+    // The snapshot holds exactly the expected size
+    *out_size = g_ram_write_state.expected_size - g_ram_write_state.bytes_written;
+    return g_ram_write_state.session->data + g_ram_write_state.bytes_written;
+}
+
+uint8_t *program_ram_write_reserve(uint32_t *out_size, program_write_source_t source) {
+    if (out_size == NULL) {
+        ESP_LOGE(TAG, "out_size parameter cannot be NULL");
+        return NULL;
+    }
+    *out_size = 0;
+
+    if (g_ram_write_state_mutex == NULL) {
+        ESP_LOGE(TAG, "RAM storage not initialized");
+        return NULL;
+    }
+
+    // Lock mutex to protect RAM state
+    if (xSemaphoreTake(g_ram_write_state_mutex, portMAX_DELAY) != pdTRUE) {
+        ESP_LOGE(TAG, "Failed to take RAM write state mutex");
+        return NULL;
+    }
+
+    uint8_t *result = program_ram_write_reserve_unsafe(out_size, source);
+    xSemaphoreGive(g_ram_write_state_mutex);
+    return result;
+}
+
+static bool program_ram_write_commit_unsafe(uint32_t size,
+                                            program_write_source_t source) {
+    if (g_ram_write_state.state != PROGRAM_STORAGE_STATE_WRITING) {
+        ESP_LOGE(TAG,
+                 "RAM program storage write commit called but not in writing state "
+                 "(state: %d)",
+                 g_ram_write_state.state);
+        return false;
+    }
+
+    if (g_ram_write_state.current_source != source) {
+        ESP_LOGE(TAG,
+                 "Source mismatch: expected %s, got %s",
+                 source_to_string(g_ram_write_state.current_source),
+                 source_to_string(source));
+        return false;
+    }
+
+    if (g_ram_write_state.reserved != g_ram_write_state.session) {
+        ESP_LOGE(TAG, "RAM program storage write commit called without a reservation");
+        g_ram_write_state.state = PROGRAM_STORAGE_STATE_ERROR;
+        return false;
+    }
+
+    if (size == 0 ||
+        size > g_ram_write_state.expected_size - g_ram_write_state.bytes_written) {
+        ESP_LOGE(TAG,
+                 "Invalid commit size: %lu bytes (%lu/%lu written)",
                  (unsigned long)size,
-                 (unsigned long)PROGRAM_RAM_MAX_SIZE);
+                 (unsigned long)g_ram_write_state.bytes_written,
+                 (unsigned long)g_ram_write_state.expected_size);
         g_ram_write_state.state = PROGRAM_STORAGE_STATE_ERROR;
         return false;
     }
 
-    // Simple memcpy to RAM buffer (no page alignment needed)
-    memcpy(g_ram_write_state.buffer + g_ram_write_state.buffer_offset, data, size);
-    g_ram_write_state.buffer_offset += size;
+    // The data is already in place, just advance past it
     g_ram_write_state.bytes_written += size;
 
     ESP_LOGD(TAG,
-             "Buffered %lu bytes to RAM, total written: %lu/%lu",
+             "Committed %lu bytes to RAM, total written: %lu/%lu",
              (unsigned long)size,
              (unsigned long)g_ram_write_state.bytes_written,
              (unsigned long)g_ram_write_state.expected_size);
@@ -276,9 +456,7 @@ static bool program_ram_write_chunk_unsafe(const uint8_t *data,
     return true;
 }
 
-bool program_ram_write_chunk(const uint8_t *data,
-                             uint32_t size,
-                             program_write_source_t source) {
+bool program_ram_write_commit(uint32_t size, program_write_source_t source) {
     if (g_ram_write_state_mutex == NULL) {
         ESP_LOGE(TAG, "RAM storage not initialized");
         return false;
@@ -290,8 +468,10 @@ bool program_ram_write_chunk(const uint8_t *data,
         return false;
     }
 
-    bool result = program_ram_write_chunk_unsafe(data, size, source);
+    bool result = program_ram_write_commit_unsafe(size, source);
+    release_reservation_unsafe(source);  // Ends with its commit, successful or not
     xSemaphoreGive(g_ram_write_state_mutex);
+    xEventGroupSetBits(g_ram_write_events, RAM_WRITE_PROGRESS_BIT);
     return result;
 }
 
@@ -339,8 +519,11 @@ static bool program_ram_write_finish_unsafe(uint32_t program_size,
         return false;
     }
 
-    // Program is already in the buffer, just mark it as stored
-    g_ram_write_state.stored_program_size = program_size;
+    // Program is already in the snapshot, which becomes the stored program and is
+    // never written again. The session's reference passes to the store.
+    g_ram_write_state.session->size = program_size;
+    g_ram_write_state.stored = g_ram_write_state.session;
+    g_ram_write_state.session = NULL;
     g_ram_write_state.state = PROGRAM_STORAGE_STATE_IDLE;
     g_ram_write_state.current_source = PROGRAM_WRITE_SOURCE_NONE;
 
@@ -365,17 +548,38 @@ bool program_ram_write_finish(uint32_t program_size, program_write_source_t sour
 
     bool result = program_ram_write_finish_unsafe(program_size, source);
     xSemaphoreGive(g_ram_write_state_mutex);
+    xEventGroupSetBits(g_ram_write_events, RAM_WRITE_PROGRESS_BIT);
     return result;
 }
 
+void program_ram_write_abort(program_write_source_t source) {
+    if (g_ram_write_state_mutex == NULL ||
+        xSemaphoreTake(g_ram_write_state_mutex, portMAX_DELAY) != pdTRUE) {
+        return;
+    }
+
+    if (g_ram_write_state.state != PROGRAM_STORAGE_STATE_IDLE &&
+        g_ram_write_state.current_source == source) {
+        ESP_LOGI(TAG, "RAM write session aborted by %s", source_to_string(source));
+        reset_ram_write_state_unsafe();
+    }
+    release_reservation_unsafe(source);
+    xSemaphoreGive(g_ram_write_state_mutex);
+
+    // Streaming runs waiting on the session see that it is gone
+    xEventGroupSetBits(g_ram_write_events, RAM_WRITE_PROGRESS_BIT);
+}
+
 bool program_ram_erase(void) {
     ESP_LOGI(TAG, "Erasing program from RAM storage");
 
     if (g_ram_write_state_mutex != NULL) {
         if (xSemaphoreTake(g_ram_write_state_mutex, portMAX_DELAY) == pdTRUE) {
-            // Zero the RAM buffer and reset state
+            // Drop the stored program; runs and downloads holding a reference to
+            // it keep their copy until they are done
             reset_ram_write_state_unsafe();
             xSemaphoreGive(g_ram_write_state_mutex);
+            xEventGroupSetBits(g_ram_write_events, RAM_WRITE_PROGRESS_BIT);
         }
     }
 
@@ -410,3 +614,97 @@ uint32_t program_ram_get_expected_size(void) {
     xSemaphoreGive(g_ram_write_state_mutex);
     return ram_expected_size;
 }
+
+program_ram_snapshot_t *program_ram_acquire_streaming(const uint8_t **out_data,
+                                                      uint32_t *out_size) {
+    if (out_data == NULL || out_size == NULL) {
+        ESP_LOGE(TAG, "Output parameters cannot be NULL");
+        return NULL;
+    }
+    *out_data = NULL;
+    *out_size = 0;
+
+    if (g_ram_write_state_mutex == NULL) {
+        ESP_LOGE(TAG, "RAM storage not initialized");
+        return NULL;
+    }
+
+    if (xSemaphoreTake(g_ram_write_state_mutex, portMAX_DELAY) != pdTRUE) {
+        ESP_LOGE(TAG, "Failed to take RAM write state mutex");
+        return NULL;
+    }
+
+    program_ram_snapshot_t *result = NULL;
+    if (g_ram_write_state.state == PROGRAM_STORAGE_STATE_WRITING) {
+        result = g_ram_write_state.session;
+        result->refs++;
+        *out_data = result->data;
+        *out_size = g_ram_write_state.expected_size;
+    } else {
+        ESP_LOGD(TAG, "No RAM write session to stream from");
+    }
+    xSemaphoreGive(g_ram_write_state_mutex);
+    return result;
+}
+
+bool program_ram_wait_bytes_written(program_ram_snapshot_t *snapshot,
+                                    uint32_t needed,
+                                    uint32_t *out_available,
+                                    uint32_t timeout_ms) {
+    if (snapshot == NULL || out_available == NULL) {
+        ESP_LOGE(TAG, "Snapshot and out_available parameters cannot be NULL");
+        return false;
+    }
+    *out_available = 0;
+
+    if (g_ram_write_state_mutex == NULL) {
+        ESP_LOGE(TAG, "RAM storage not initialized");
+        return false;
+    }
+
+    TickType_t start = xTaskGetTickCount();
+    TickType_t timeout = pdMS_TO_TICKS(timeout_ms);
+    for (;;) {
+        if (xSemaphoreTake(g_ram_write_state_mutex, portMAX_DELAY) != pdTRUE) {
+            ESP_LOGE(TAG, "Failed to take RAM write state mutex");
+            return false;
+        }
+
+        // A finished session leaves the program in the snapshot, so it stays
+        // readable even once it is replaced or erased. An unfinished one that is no
+        // longer being written will never complete.
+        bool alive;
+        if (snapshot->size > 0) {
+            *out_available = snapshot->size;
+            alive = needed <= snapshot->size;
+        } else if (snapshot == g_ram_write_state.session &&
+                   g_ram_write_state.state == PROGRAM_STORAGE_STATE_WRITING) {
+            *out_available = g_ram_write_state.bytes_written;
+            alive = true;
+        } else {
+            alive = false;
+        }
+
+        // Clear the progress bit while holding the mutex, so any write after this
+        // check sets it again and wakes the wait below
+        xEventGroupClearBits(g_ram_write_events, RAM_WRITE_PROGRESS_BIT);
+        xSemaphoreGive(g_ram_write_state_mutex);
+
+        if (!alive) {
+            return false;
+        }
+        if (*out_available >= needed) {
+            return true;
+        }
+
+        TickType_t elapsed = xTaskGetTickCount() - start;
+        if (elapsed >= timeout) {
+            return true;
+        }
+        xEventGroupWaitBits(g_ram_write_events,
+                            RAM_WRITE_PROGRESS_BIT,
+                            pdFALSE,
+                            pdFALSE,
+                            timeout - elapsed);
+    }
+}
@@ -3,12 +3,21 @@
 
 #include <stdbool.h>
 #include <stdint.h>
+#include "odkeyscript_vm.h"
 #include "program.h"
 
 #ifdef __cplusplus
 extern "C" {
 #endif
 
+/**
+ * @brief Immutable, reference-counted copy of a RAM program
+ * @note Each write session writes a fresh snapshot, which becomes the stored program
+ * when the session finishes and is never modified afterwards. A snapshot stays
+ * valid until its last reference is released, even after it is replaced or erased.
+ */
+typedef struct program_ram_snapshot program_ram_snapshot_t;
+
 /**
  * @brief Initialize RAM program
  * @return true on success, false on failure
@@ -16,17 +25,40 @@ extern "C" {
 bool program_ram_init(void);
 
 /**
- * @brief Get pointer to program in RAM
+ * @brief Take a reference to the program in RAM
+ * @param out_data Pointer to hold a pointer to the program data
  * @param out_size Pointer to hold program size
- * @return Pointer to program data, or NULL if no program or error
+ * @return The snapshot holding the program, or NULL if no program or error
+ * @note The data stays valid until the snapshot is passed to program_ram_release()
  */
-const uint8_t *program_ram_get(uint32_t *out_size);
+program_ram_snapshot_t *program_ram_acquire(const uint8_t **out_data,
+                                            uint32_t *out_size);
+
+/**
+ * @brief Release a reference taken by program_ram_acquire() or
+ * program_ram_acquire_streaming()
+ * @param snapshot Snapshot to release (NULL is ignored)
+ */
+void program_ram_release(program_ram_snapshot_t *snapshot);
+
+/**
+ * @brief Get the verification result kept with a program in a snapshot
+ * @param snapshot Snapshot holding the program (a reference must be held)
+ * @param id Library program id (0 for a single program)
+ * @return Verification result for vm_task_start_program(), or NULL if id is out of
+ * range
+ * @note Only the VM task reads or fills in the result, one run at a time
+ */
+vm_verification_t *program_ram_get_verification(program_ram_snapshot_t *snapshot,
+                                                uint32_t id);
 
 /**
  * @brief Start writing a new program to RAM
  * @param expected_program_size The expected size of the program to be written
  * @param source The source requesting the write (USB or HTTP)
  * @return true on success, false on failure
+ * @note Allocates a new snapshot and drops the stored program; programs still
+ * running from the old snapshot are unaffected.
  */
 bool program_ram_write_start(uint32_t expected_program_size,
                              program_write_source_t source);
@@ -42,6 +74,28 @@ bool program_ram_write_chunk(const uint8_t *data,
                              uint32_t size,
                              program_write_source_t source);
 
+/**
+ * @brief Reserve the unwritten remainder of the session's snapshot for direct writes
+ * @param out_size Pointer to hold the number of bytes that may be written
+ * @param source The source requesting the reservation (must match current owner)
+ * @return Pointer to the next unwritten byte of the snapshot, or NULL on error
+ * @note Lets a source receive straight into the buffer instead of staging data
+ * for program_ram_write_chunk(). Bytes written there are only kept once they are
+ * passed to program_ram_write_commit(). The reservation keeps the snapshot
+ * allocated until that commit or program_ram_write_abort(), so the pointer stays
+ * writable even if another source replaces the session meanwhile; the commit then
+ * fails.
+ */
+uint8_t *program_ram_write_reserve(uint32_t *out_size, program_write_source_t source);
+
+/**
+ * @brief Commit bytes written through program_ram_write_reserve()
+ * @param size Number of bytes written at the reserved pointer
+ * @param source The source requesting the commit (must match current owner)
+ * @return true on success, false on failure
+ */
+bool program_ram_write_commit(uint32_t size, program_write_source_t source);
+
 /**
  * @brief Finish writing program to RAM
  * @param program_size The size, in bytes, of the program data
@@ -50,6 +104,13 @@ bool program_ram_write_chunk(const uint8_t *data,
  */
 bool program_ram_write_finish(uint32_t program_size, program_write_source_t source);
 
+/**
+ * @brief Abandon the write session of a source, if it has one
+ * @param source The source that started the session
+ * @note Also ends the source's reservation, even if its session was replaced
+ */
+void program_ram_write_abort(program_write_source_t source);
+
 /**
  * @brief Get number of bytes written so far
  * @return Number of bytes written
@@ -62,9 +123,38 @@ uint32_t program_ram_get_bytes_written(void);
  */
 uint32_t program_ram_get_expected_size(void);
 
+/**
+ * @brief Take a reference to the snapshot of the write session in progress, for
+ * streaming execution
+ * @param out_data Pointer to hold a pointer to the snapshot's data
+ * @param out_size Pointer to hold the size the program will have once written
+ * @return The session's snapshot, or NULL if no write session is in progress
+ * @note Only the first program_ram_get_bytes_written() bytes are valid; use
+ * program_ram_wait_bytes_written() to wait for more. Release the snapshot with
+ * program_ram_release().
+ */
+program_ram_snapshot_t *program_ram_acquire_streaming(const uint8_t **out_data,
+                                                      uint32_t *out_size);
+
+/**
+ * @brief Wait until a number of bytes of a snapshot have been written
+ * @param snapshot Snapshot from program_ram_acquire_streaming()
+ * @param needed Number of bytes, from the start of the program, to wait for
+ * @param out_available Pointer to hold the number of bytes written so far
+ * @param timeout_ms Maximum time to wait
+ * @return false if the snapshot's write session failed or was replaced before it
+ * finished, so the bytes will never arrive; true otherwise (check out_available in
+ * case of a timeout)
+ */
+bool program_ram_wait_bytes_written(program_ram_snapshot_t *snapshot,
+                                    uint32_t needed,
+                                    uint32_t *out_available,
+                                    uint32_t timeout_ms);
+
 /**
  * @brief Erase program from RAM
  * @return true on success, false on failure
+ * @note References to the erased program stay valid until they are released
  */
 bool program_ram_erase(void);
 
@@ -5,6 +5,9 @@
 #include "esp_log.h"
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
+#include "nvs_config.h"
+#include "nvs_odkey.h"
+#include "power.h"
 #include "sdkconfig.h"
 #include "tinyusb.h"
 #include "tinyusb_default_config.h"
@@ -33,15 +36,92 @@ static const char *report_type_to_string(uint8_t report_type) {
 
 #define RAW_HID_REPORT_SIZE 64  // 64 bytes for full flash alignment
 
+// Keyboard endpoint polling intervals for normal and high-throughput modes
+#define KEYBOARD_EP_INTERVAL_MS 10
+#define KEYBOARD_FAST_EP_INTERVAL_MS 1
+
+// Keyboard endpoint sizes for boot (6KRO) and N-key rollover reports
+#define KEYBOARD_EP_SIZE 8
+#define KEYBOARD_NKRO_EP_SIZE 32
+
+// Keyboard mode read from NVS at init
+static bool g_keyboard_nkro = false;
+
+// Vendor (bulk) transfer interface endpoint size
+#define VENDOR_EP_SIZE 64
+
 /************* TinyUSB descriptors ****************/
+#if CFG_TUD_VENDOR > 0
+#define USB_INTERFACE_COUNT 3
+#define TUSB_DESC_TOTAL_LEN                                                  \
+    (TUD_CONFIG_DESC_LEN + TUD_HID_DESC_LEN + TUD_HID_INOUT_DESC_LEN + \
+     TUD_VENDOR_DESC_LEN)
+// Interface 2: Vendor bulk transfer interface (optional, CONFIG_TINYUSB_VENDOR_COUNT)
+#define VENDOR_INTERFACE_DESCRIPTOR                                 \
+    , TUD_VENDOR_DESCRIPTOR(USB_VENDOR_INTERFACE_NUM,               \
+                            6,    /* String index */                \
+                            0x03, /* EP Out address */              \
+                            0x83, /* EP In address */               \
+                            VENDOR_EP_SIZE)
+#else
+#define USB_INTERFACE_COUNT 2
 #define TUSB_DESC_TOTAL_LEN \
     (TUD_CONFIG_DESC_LEN + TUD_HID_DESC_LEN + TUD_HID_INOUT_DESC_LEN)
+#define VENDOR_INTERFACE_DESCRIPTOR
+#endif  // CFG_TUD_VENDOR
 
 /**
  * @brief Keyboard HID report descriptor (Interface 0)
  */
 const uint8_t keyboard_report_descriptor[] = {TUD_HID_REPORT_DESC_KEYBOARD()};
 
+/**
+ * @brief N-key rollover keyboard HID report descriptor (Interface 0, usb_nkro mode)
+ *
+ * Same modifiers and LEDs as the boot keyboard, followed by one bit per keycode
+ * instead of a 6-key array. Hosts that select boot protocol still get boot reports.
+ */
+// clang-format off
+const uint8_t keyboard_nkro_report_descriptor[] = {
+    0x05, 0x01,        // Usage Page (Generic Desktop)
+    0x09, 0x06,        // Usage (Keyboard)
+    0xA1, 0x01,        // Collection (Application)
+
+    // Modifier byte
+    0x05, 0x07,        // Usage Page (Keyboard/Keypad)
+    0x19, 0xE0,        // Usage Minimum (Left Control)
+    0x29, 0xE7,        // Usage Maximum (Right GUI)
+    0x15, 0x00,        // Logical Minimum (0)
+    0x25, 0x01,        // Logical Maximum (1)
+    0x75, 0x01,        // Report Size (1 bit)
+    0x95, 0x08,        // Report Count (8)
+    0x81, 0x02,        // Input (Data, Variable, Absolute)
+
+    // LED output report
+    0x05, 0x08,        // Usage Page (LEDs)
+    0x19, 0x01,        // Usage Minimum (Num Lock)
+    0x29, 0x05,        // Usage Maximum (Kana)
+    0x75, 0x01,        // Report Size (1 bit)
+    0x95, 0x05,        // Report Count (5)
+    0x91, 0x02,        // Output (Data, Variable, Absolute)
+    0x75, 0x03,        // Report Size (3 bits)
+    0x95, 0x01,        // Report Count (1)
+    0x91, 0x01,        // Output (Constant) - padding
+
+    // Key bitmap
+    0x05, 0x07,        // Usage Page (Keyboard/Keypad)
+    0x19, 0x00,        // Usage Minimum (0)
+    0x29, USB_KEYBOARD_NKRO_MAX_KEYCODE,  // Usage Maximum
+    0x15, 0x00,        // Logical Minimum (0)
+    0x25, 0x01,        // Logical Maximum (1)
+    0x75, 0x01,        // Report Size (1 bit)
+    0x95, USB_KEYBOARD_NKRO_MAX_KEYCODE + 1,  // Report Count (one bit per keycode)
+    0x81, 0x02,        // Input (Data, Variable, Absolute)
+
+    0xC0,              // End Collection
+};
+// clang-format on
+
 /**
  * @brief Raw HID report descriptor (Interface 1)
  */
@@ -82,37 +162,64 @@ const char *hid_string_descriptor[] = {
     "123456",                       // 3: Serial #
     "ODKey HID Keyboard",           // 4: HID Keyboard
     "ODKey Programming Interface",  // 5: HID Programming
+    "ODKey Bulk Transfer",          // 6: Vendor bulk transfer
 };
 
 /**
  * @brief Configuration descriptor
  *
- * This defines 1 configuration with 2 HID interfaces
+ * This defines 1 configuration with 2 HID interfaces and an optional vendor interface
  */
-static const uint8_t hid_configuration_descriptor[] = {
-    // Configuration number, interface count, string index, total length, attribute,
-    // power in mA
-    TUD_CONFIG_DESCRIPTOR(1, 2, 0, TUSB_DESC_TOTAL_LEN, 0, 100),
-
-    // Interface 0: Keyboard (boot protocol)
-    TUD_HID_DESCRIPTOR(USB_KEYBOARD_INTERFACE_NUM,
-                       4,
-                       HID_ITF_PROTOCOL_KEYBOARD,
-                       sizeof(keyboard_report_descriptor),
-                       0x81,  // EP In address
-                       8,     // EP size
-                       10),   // EP interval
-
-    // Interface 1: Raw HID (no boot protocol)
-    TUD_HID_INOUT_DESCRIPTOR(USB_SYSTEM_CONFIG_INTERFACE_NUM,
-                             5,
-                             HID_ITF_PROTOCOL_NONE,
-                             sizeof(raw_hid_report_descriptor),
-                             0x82,  // EP In address
-                             0x02,  // EP Out address
-                             64,    // EP size
-                             1),    // EP interval
-};
+#define HID_CONFIGURATION_DESCRIPTOR(                                                \
+    keyboard_report_desc_len, keyboard_ep_size, keyboard_ep_interval)               \
+    /* Configuration number, interface count, string index, total length,         \
+     * attribute, power in mA */                                                   \
+    TUD_CONFIG_DESCRIPTOR(1,                                                       \
+                          USB_INTERFACE_COUNT,                                     \
+                          0,                                                       \
+                          TUSB_DESC_TOTAL_LEN,                                     \
+                          TUSB_DESC_CONFIG_ATT_REMOTE_WAKEUP,                      \
+                          100),                                                    \
+                                                                                   \
+        /* Interface 0: Keyboard (boot protocol) */                                \
+        TUD_HID_DESCRIPTOR(USB_KEYBOARD_INTERFACE_NUM,                             \
+                           4,                                                      \
+                           HID_ITF_PROTOCOL_KEYBOARD,                              \
+                           keyboard_report_desc_len,                               \
+                           0x81, /* EP In address */                               \
+                           keyboard_ep_size,                                       \
+                           keyboard_ep_interval),                                  \
+                                                                                   \
+        /* Interface 1: Raw HID (no boot protocol) */                              \
+        TUD_HID_INOUT_DESCRIPTOR(USB_SYSTEM_CONFIG_INTERFACE_NUM,                  \
+                                 5,                                                \
+                                 HID_ITF_PROTOCOL_NONE,                            \
+                                 sizeof(raw_hid_report_descriptor),                \
+                                 0x82, /* EP In address */                         \
+                                 0x02, /* EP Out address */                        \
+                                 64,   /* EP size */                               \
+                                 1)    /* EP interval */                           \
+        VENDOR_INTERFACE_DESCRIPTOR
+
+static const uint8_t hid_configuration_descriptor[] = {HID_CONFIGURATION_DESCRIPTOR(
+    sizeof(keyboard_report_descriptor), KEYBOARD_EP_SIZE, KEYBOARD_EP_INTERVAL_MS)};
+
+// Same configuration with the keyboard endpoint polled every frame
+static const uint8_t hid_configuration_descriptor_fast[] = {
+    HID_CONFIGURATION_DESCRIPTOR(sizeof(keyboard_report_descriptor),
+                                 KEYBOARD_EP_SIZE,
+                                 KEYBOARD_FAST_EP_INTERVAL_MS)};
+
+// N-key rollover variants of the above
+static const uint8_t hid_configuration_descriptor_nkro[] = {
+    HID_CONFIGURATION_DESCRIPTOR(sizeof(keyboard_nkro_report_descriptor),
+                                 KEYBOARD_NKRO_EP_SIZE,
+                                 KEYBOARD_EP_INTERVAL_MS)};
+
+static const uint8_t hid_configuration_descriptor_nkro_fast[] = {
+    HID_CONFIGURATION_DESCRIPTOR(sizeof(keyboard_nkro_report_descriptor),
+                                 KEYBOARD_NKRO_EP_SIZE,
+                                 KEYBOARD_FAST_EP_INTERVAL_MS)};
 
 // Device descriptor
 static const tusb_desc_device_t device_descriptor = {
@@ -138,7 +245,8 @@ static const tusb_desc_device_t device_descriptor = {
 // Application returns a pointer to the descriptor
 uint8_t const *tud_hid_descriptor_report_cb(uint8_t instance) {
     if (instance == 0) {
-        return keyboard_report_descriptor;
+        return g_keyboard_nkro ? keyboard_nkro_report_descriptor
+                               : keyboard_report_descriptor;
     } else if (instance == 1) {
         return raw_hid_report_descriptor;
     }
@@ -216,6 +324,26 @@ void tud_hid_set_report_cb(uint8_t instance,
     }
 }
 
+// Invoked when a report has been sent to the host
+void tud_hid_report_complete_cb(uint8_t instance, uint8_t const *report, uint16_t len) {
+    (void)report;
+    (void)len;
+
+    if (instance == USB_KEYBOARD_INTERFACE_NUM) {
+        usb_keyboard_report_complete();
+    }
+}
+
+#if CFG_TUD_VENDOR > 0
+// Invoked when data is received on the vendor bulk OUT endpoint
+void tud_vendor_rx_cb(uint8_t itf, uint8_t const *buffer, uint16_t bufsize) {
+    (void)itf;
+    (void)buffer;
+    (void)bufsize;
+    usb_system_config_bulk_rx_notify();
+}
+#endif  // CFG_TUD_VENDOR
+
 // Invoked when received SET_PROTOCOL request
 void tud_hid_set_protocol_cb(uint8_t instance, uint8_t protocol) {
     ESP_LOGI(TAG, "SET_PROTOCOL request: instance=%d, protocol=%d", instance, protocol);
@@ -223,13 +351,27 @@ void tud_hid_set_protocol_cb(uint8_t instance, uint8_t protocol) {
     (void)protocol;
 }
 
+// Invoked when the host suspends the bus, e.g. because it is going to sleep. The
+// device stays out of light sleep, since only the button could wake it and the
+// host's resume would be missed.
+void tud_suspend_cb(bool remote_wakeup_en) {
+    ESP_LOGI(TAG, "USB suspended (remote wakeup %s)", remote_wakeup_en ? "on" : "off");
+}
+
+// Invoked when the bus resumes
+void tud_resume_cb(void) {
+    ESP_LOGI(TAG, "USB resumed");
+}
+
 static void device_event_handler(tinyusb_event_t *event, void *arg) {
     switch (event->id) {
     case TINYUSB_EVENT_ATTACHED:
         ESP_LOGI(TAG, "USB device attached");
+        power_set_usb_attached(true);
         break;
     case TINYUSB_EVENT_DETACHED:
         ESP_LOGI(TAG, "USB device detached");
+        power_set_usb_attached(false);
         break;
     default:
         ESP_LOGW(TAG, "Unknown USB event: %d", event->id);
@@ -237,7 +379,36 @@ static void device_event_handler(tinyusb_event_t *event, void *arg) {
     }
 }
 
+// Helper function to read a boolean (u8) USB setting from NVS
+static bool read_usb_setting(const char *key) {
+    uint8_t value = 0;
+    esp_err_t ret = nvs_config_get_u8(key, &value);
+    if (ret != ESP_OK && ret != ESP_ERR_NVS_NOT_FOUND) {
+        ESP_LOGW(TAG, "Failed to read %s from NVS: %s", key, esp_err_to_name(ret));
+    }
+
+    return value != 0;
+}
+
 bool usb_core_init(void) {
+    // Select keyboard report format and endpoint interval from NVS settings
+    bool fast_keyboard = read_usb_setting(NVS_KEY_USB_FAST_KEYBOARD);
+    g_keyboard_nkro = read_usb_setting(NVS_KEY_USB_NKRO);
+
+    const uint8_t *configuration_descriptor;
+    if (g_keyboard_nkro) {
+        configuration_descriptor = fast_keyboard
+                                       ? hid_configuration_descriptor_nkro_fast
+                                       : hid_configuration_descriptor_nkro;
+    } else {
+        configuration_descriptor = fast_keyboard ? hid_configuration_descriptor_fast
+                                                 : hid_configuration_descriptor;
+    }
+    ESP_LOGI(TAG,
+             "Keyboard mode: %s, %d ms interval",
+             g_keyboard_nkro ? "NKRO" : "6KRO",
+             fast_keyboard ? KEYBOARD_FAST_EP_INTERVAL_MS : KEYBOARD_EP_INTERVAL_MS);
+
     // Initialize TinyUSB with default configuration
     tinyusb_config_t tusb_cfg = TINYUSB_DEFAULT_CONFIG(device_event_handler);
 
@@ -246,12 +417,12 @@ bool usb_core_init(void) {
 
     // Override specific descriptor fields
     tusb_cfg.descriptor.device = &device_descriptor;
-    tusb_cfg.descriptor.full_speed_config = hid_configuration_descriptor;
+    tusb_cfg.descriptor.full_speed_config = configuration_descriptor;
     tusb_cfg.descriptor.string = hid_string_descriptor;
     tusb_cfg.descriptor.string_count =
         sizeof(hid_string_descriptor) / sizeof(hid_string_descriptor[0]);
 #if (TUD_OPT_HIGH_SPEED)
-    tusb_cfg.descriptor.high_speed_config = hid_configuration_descriptor;
+    tusb_cfg.descriptor.high_speed_config = configuration_descriptor;
 #endif  // TUD_OPT_HIGH_SPEED
 
     esp_err_t ret = tinyusb_driver_install(&tusb_cfg);
@@ -265,3 +436,7 @@ bool usb_core_init(void) {
 
     return true;
 }
+
+bool usb_core_keyboard_nkro_enabled(void) {
+    return g_keyboard_nkro;
+}
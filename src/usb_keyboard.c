@@ -2,31 +2,102 @@
 #include <stdio.h>
 #include <string.h>
 #include "esp_log.h"
+#include "esp_timer.h"
 #include "freertos/FreeRTOS.h"
 #include "freertos/queue.h"
+#include "freertos/semphr.h"
 #include "freertos/task.h"
+#include "latency_stats.h"
 #include "tinyusb.h"
 #include "usb_keyboard_keys.h"
 
 static const char *TAG = "usb_keyboard";
 
 // Queue and task configuration
-#define KEYBOARD_QUEUE_DEPTH 10
+#define KEYBOARD_QUEUE_DEPTH 64
 #define KEYBOARD_TASK_STACK_SIZE 4096
 #define KEYBOARD_TASK_PRIORITY 6
 
+// Maximum time to block while scheduling a report into a full queue
+#define KEYBOARD_SCHEDULE_TIMEOUT_MS 1000
+// Maximum time to sleep waiting for the HID endpoint (covers suspend / unmounted)
+#define KEYBOARD_READY_TIMEOUT_MS 10
+
+// Keycode reported in every slot of a boot report when too many keys are held
+#define KEYBOARD_ERROR_ROLLOVER 0x01
+
 // Queue item structure
 typedef struct {
+    int64_t deadline_us;  // esp_timer time at which to send (0 = as soon as possible)
     uint8_t modifier;
-    uint8_t keys[6];
+    uint8_t keys[USB_KEYBOARD_MAX_KEYS];
     uint8_t count;
+    bool traced;  // First report of a run traced by latency_stats
 } keyboard_report_t;
 
 // Private variables
 static bool g_initialized = false;
 static uint8_t g_interface_num = 0;
+static bool g_nkro = false;
 static QueueHandle_t g_keyboard_queue = NULL;
 static TaskHandle_t g_keyboard_task_handle = NULL;
+static esp_timer_handle_t g_deadline_timer = NULL;
+
+// Serializes sending the head of the queue against usb_keyboard_cancel_scheduled()
+static SemaphoreHandle_t g_send_mutex = NULL;
+// Incremented by usb_keyboard_cancel_scheduled() to abandon a peeked report
+static volatile uint32_t g_cancel_generation = 0;
+
+// esp_timer callback - wakes the keyboard task when a report's deadline is reached
+static void deadline_timer_callback(void *arg) {
+    (void)arg;
+    xTaskNotifyGive(g_keyboard_task_handle);
+}
+
+// Sleep until the given deadline, or until woken early by a cancel
+static void wait_for_deadline(int64_t deadline_us, uint32_t generation) {
+    for (;;) {
+        int64_t remaining_us = deadline_us - esp_timer_get_time();
+        if (remaining_us <= 0 || generation != g_cancel_generation) {
+            return;
+        }
+
+        if (esp_timer_start_once(g_deadline_timer, (uint64_t)remaining_us) != ESP_OK) {
+            vTaskDelay(pdMS_TO_TICKS(remaining_us / 1000) + 1);
+            continue;
+        }
+        ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(remaining_us / 1000) + 2);
+        esp_timer_stop(g_deadline_timer);
+    }
+}
+
+// Helper function to send a report in the format the host currently expects
+static void send_report(const keyboard_report_t *report) {
+    // Hosts (e.g. BIOS) may switch the interface to boot protocol, which only
+    // understands the fixed 6KRO layout
+    if (g_nkro && tud_hid_n_get_protocol(g_interface_num) == HID_PROTOCOL_REPORT) {
+        uint8_t buffer[USB_KEYBOARD_NKRO_REPORT_SIZE] = {0};
+        buffer[0] = report->modifier;
+        for (uint8_t i = 0; i < report->count; i++) {
+            uint8_t key = report->keys[i];
+            if (key >= KEY_LEFTCTRL && key <= KEY_LEFTCTRL + 7) {
+                buffer[0] |= 1 << (key - KEY_LEFTCTRL);
+            } else if (key <= USB_KEYBOARD_NKRO_MAX_KEYCODE) {
+                buffer[1 + key / 8] |= 1 << (key % 8);
+            }
+        }
+        tud_hid_n_report(g_interface_num, 0, buffer, sizeof(buffer));
+        return;
+    }
+
+    uint8_t keys[USB_KEYBOARD_BOOT_MAX_KEYS] = {0};
+    if (report->count > USB_KEYBOARD_BOOT_MAX_KEYS) {
+        memset(keys, KEYBOARD_ERROR_ROLLOVER, sizeof(keys));
+    } else {
+        memcpy(keys, report->keys, report->count);
+    }
+    tud_hid_n_keyboard_report(g_interface_num, 0, report->modifier, keys);
+}
 
 // Keyboard task function
 static void keyboard_task(void *pvParameters) {
@@ -34,24 +105,43 @@ static void keyboard_task(void *pvParameters) {
 
     for (;;) {
         keyboard_report_t report;
-        // Wait for a keyboard report from the queue
-        if (xQueueReceive(g_keyboard_queue, &report, portMAX_DELAY) == pdTRUE) {
-            // Wait for USB HID to be ready before sending
-            while (!tud_hid_n_ready(g_interface_num)) {
-                vTaskDelay(pdMS_TO_TICKS(1));
-            }
+        // Wait for a keyboard report from the queue (left in place until it is sent)
+        if (xQueuePeek(g_keyboard_queue, &report, portMAX_DELAY) != pdTRUE) {
+            continue;
+        }
+        uint32_t generation = g_cancel_generation;
+
+        // Hold the report until its scheduled time
+        wait_for_deadline(report.deadline_us, generation);
+
+        // Wake a suspended host (if it allows that) to take the report
+        if (tud_suspended()) {
+            tud_remote_wakeup();
+        }
+
+        // Wait for USB HID to be ready; woken by tud_hid_report_complete_cb()
+        while (!tud_hid_n_ready(g_interface_num) && generation == g_cancel_generation) {
+            ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(KEYBOARD_READY_TIMEOUT_MS));
+        }
 
+        xSemaphoreTake(g_send_mutex, portMAX_DELAY);
+        if (generation == g_cancel_generation) {
             // Send the HID keyboard report
-            tud_hid_n_keyboard_report(g_interface_num, 0, report.modifier, report.keys);
+            send_report(&report);
+            if (report.traced) {
+                latency_stats_mark(LATENCY_POINT_REPORT_SENT);
+            }
+            xQueueReceive(g_keyboard_queue, &report, 0);
             ESP_LOGD(TAG,
                      "Sent keyboard report: modifier=0x%02X, keys=%d",
                      report.modifier,
                      report.count);
         }
+        xSemaphoreGive(g_send_mutex);
     }
 }
 
-bool usb_keyboard_init(uint8_t interface_num) {
+bool usb_keyboard_init(uint8_t interface_num, bool nkro) {
     if (g_initialized) {
         return true;
     }
@@ -63,6 +153,29 @@ bool usb_keyboard_init(uint8_t interface_num) {
         return false;
     }
 
+    g_send_mutex = xSemaphoreCreateMutex();
+    if (g_send_mutex == NULL) {
+        ESP_LOGE(TAG, "Failed to create send mutex");
+        vQueueDelete(g_keyboard_queue);
+        g_keyboard_queue = NULL;
+        return false;
+    }
+
+    // Create timer for releasing reports at their deadline
+    const esp_timer_create_args_t timer_args = {.callback = deadline_timer_callback,
+                                                .arg = NULL,
+                                                .dispatch_method = ESP_TIMER_TASK,
+                                                .name = "kbd_deadline"};
+    esp_err_t err = esp_timer_create(&timer_args, &g_deadline_timer);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to create deadline timer: %s", esp_err_to_name(err));
+        vSemaphoreDelete(g_send_mutex);
+        g_send_mutex = NULL;
+        vQueueDelete(g_keyboard_queue);
+        g_keyboard_queue = NULL;
+        return false;
+    }
+
     // Create the keyboard task
     BaseType_t ret = xTaskCreate(keyboard_task,
                                  "keyboard_task",
@@ -72,40 +185,57 @@ bool usb_keyboard_init(uint8_t interface_num) {
                                  &g_keyboard_task_handle);
     if (ret != pdPASS) {
         ESP_LOGE(TAG, "Failed to create keyboard task");
+        esp_timer_delete(g_deadline_timer);
+        g_deadline_timer = NULL;
+        vSemaphoreDelete(g_send_mutex);
+        g_send_mutex = NULL;
         vQueueDelete(g_keyboard_queue);
         g_keyboard_queue = NULL;
         return false;
     }
 
     g_interface_num = interface_num;
+    g_nkro = nkro;
     g_initialized = true;
-    ESP_LOGI(TAG, "USB keyboard module initialized on interface %d", interface_num);
+    ESP_LOGI(TAG,
+             "USB keyboard module initialized on interface %d (%s)",
+             interface_num,
+             nkro ? "NKRO" : "6KRO");
 
     return true;
 }
 
-bool usb_keyboard_send_keys(uint8_t modifier, const uint8_t *keys, uint8_t count) {
+// Helper function to build a report and enqueue it
+static bool enqueue_report(int64_t deadline_us,
+                           uint8_t modifier,
+                           const uint8_t *keys,
+                           uint8_t count,
+                           TickType_t timeout) {
     if (!g_initialized || g_keyboard_queue == NULL) {
         return false;
     }
 
     // Create keyboard report structure
     keyboard_report_t report;
+    report.deadline_us = deadline_us;
     report.modifier = modifier;
-    report.count = (count > 6) ? 6 : count;
+    report.count = (count > USB_KEYBOARD_MAX_KEYS) ? USB_KEYBOARD_MAX_KEYS : count;
 
     // Initialize keys array to zero
     memset(report.keys, 0, sizeof(report.keys));
 
-    // Copy keycodes to array (up to 6)
+    // Copy keycodes to array (up to USB_KEYBOARD_MAX_KEYS)
     if (keys != NULL && count > 0) {
         for (uint8_t i = 0; i < report.count; i++) {
             report.keys[i] = keys[i];
         }
     }
 
-    // Try to enqueue the report (non-blocking)
-    BaseType_t ret = xQueueSend(g_keyboard_queue, &report, 0);
+    // Follow the report through the keyboard task if it starts a traced run
+    report.traced = latency_stats_mark(LATENCY_POINT_REPORT_QUEUED);
+
+    // Try to enqueue the report
+    BaseType_t ret = xQueueSend(g_keyboard_queue, &report, timeout);
     if (ret != pdTRUE) {
         ESP_LOGW(TAG, "Keyboard queue is full, dropping report");
         return false;
@@ -113,3 +243,40 @@ bool usb_keyboard_send_keys(uint8_t modifier, const uint8_t *keys, uint8_t count
 
     return true;
 }
+
+bool usb_keyboard_send_keys(uint8_t modifier, const uint8_t *keys, uint8_t count) {
+    return enqueue_report(0, modifier, keys, count, 0);
+}
+
+bool usb_keyboard_schedule_keys(int64_t deadline_us,
+                                uint8_t modifier,
+                                const uint8_t *keys,
+                                uint8_t count) {
+    return enqueue_report(deadline_us,
+                          modifier,
+                          keys,
+                          count,
+                          pdMS_TO_TICKS(KEYBOARD_SCHEDULE_TIMEOUT_MS));
+}
+
+void usb_keyboard_cancel_scheduled(void) {
+    if (!g_initialized) {
+        return;
+    }
+
+    xSemaphoreTake(g_send_mutex, portMAX_DELAY);
+    g_cancel_generation++;
+    xQueueReset(g_keyboard_queue);
+    xSemaphoreGive(g_send_mutex);
+
+    // Wake the task if it is sleeping on a deadline
+    xTaskNotifyGive(g_keyboard_task_handle);
+    ESP_LOGD(TAG, "Cancelled scheduled keyboard reports");
+}
+
+void usb_keyboard_report_complete(void) {
+    latency_stats_mark(LATENCY_POINT_REPORT_DONE);
+    if (g_keyboard_task_handle != NULL) {
+        xTaskNotifyGive(g_keyboard_task_handle);
+    }
+}
@@ -1,27 +1,45 @@
 #include "usb_system_config.h"
 #include <string.h>
 #include "buffer_utils.h"
+#include "config_batch.h"
+#include "esp_heap_caps.h"
 #include "esp_log.h"
+#include "esp_rom_crc.h"
 #include "freertos/FreeRTOS.h"
 #include "freertos/queue.h"
 #include "freertos/semphr.h"
 #include "freertos/task.h"
+#include "latency_stats.h"
 #include "log_buffer.h"
-#include "nvs.h"
+#include "nvs_config.h"
 #include "nvs_flash.h"
 #include "program.h"
 #include "tinyusb.h"
+#include "vm_task.h"
 
 static const char *TAG = "usb_system_config";
 
 // NVS transfer buffer size
 #define NVS_TRANSFER_BUFFER_SIZE 1024
 
-// Command processing task configuration
-#define COMMAND_QUEUE_DEPTH 5
+// Streaming program upload configuration. The host may have up to
+// PROGRAM_STREAM_WINDOW unacknowledged chunks in flight, and the device sends a
+// cumulative acknowledgement every PROGRAM_STREAM_ACK_INTERVAL chunks.
+#define PROGRAM_STREAM_WINDOW 32
+#define PROGRAM_STREAM_ACK_INTERVAL (PROGRAM_STREAM_WINDOW / 2)
+
+// Command processing task configuration (queue holds a full stream window)
+#define COMMAND_QUEUE_DEPTH (PROGRAM_STREAM_WINDOW + 4)
 #define COMMAND_TASK_STACK_SIZE 4096
 #define COMMAND_TASK_PRIORITY 4
 
+// Bulk (vendor interface) transfer backend configuration
+#define BULK_TASK_STACK_SIZE 4096
+#define BULK_TASK_PRIORITY 4
+#define BULK_HEADER_SIZE 12  // command(1) + reserved(3) + length(4) + crc(4)
+#define BULK_BUFFER_SIZE PROGRAM_FLASH_PAGE_SIZE
+#define BULK_TIMEOUT_MS 1000
+
 // Command queue item structure
 typedef struct {
     uint8_t data[64];  // Full 64-byte packet
@@ -31,6 +49,7 @@ typedef struct {
 // Command codes for Raw HID protocol (first byte of 64-byte packet)
 #define RESP_OK 0x10     // Success response
 #define RESP_ERROR 0x11  // Error response
+#define RESP_RETRY 0x12  // Stream chunk out of sequence, resend from the given sequence
 
 #define CMD_FLASH_PROGRAM_WRITE_START 0x20   // Start FLASH program write session
 #define CMD_FLASH_PROGRAM_WRITE_CHUNK 0x21   // Write FLASH program data chunk
@@ -44,15 +63,28 @@ typedef struct {
 #define CMD_RAM_PROGRAM_READ_START 0x29      // Start RAM program read session
 #define CMD_RAM_PROGRAM_READ_CHUNK 0x2A      // Read next RAM program data chunk
 #define CMD_RAM_PROGRAM_EXECUTE 0x2B         // Execute RAM program
+#define CMD_FLASH_PROGRAM_STREAM_START 0x2C  // Start streaming FLASH program write
+#define CMD_RAM_PROGRAM_STREAM_START 0x2D    // Start streaming RAM program write
+#define CMD_PROGRAM_STREAM_CHUNK 0x2E        // Streamed program data (no response)
+#define CMD_FLASH_PROGRAM_SELECT 0x2F        // Select FLASH library program
 #define CMD_NVS_SET_START 0x30               // Start NVS set operation
 #define CMD_NVS_SET_DATA 0x31                // Send NVS value data chunk
 #define CMD_NVS_SET_FINISH 0x32              // Finish NVS set operation
 #define CMD_NVS_GET_START 0x33               // Start NVS get operation
 #define CMD_NVS_GET_DATA 0x34                // Read NVS value data chunk
 #define CMD_NVS_DELETE 0x35                  // Delete NVS key
-#define CMD_LOG_READ_START 0x40              // Start streaming logs
+#define CMD_BATCH_START 0x36                 // Start batch write session
+#define CMD_BATCH_DATA 0x37                  // Write batch data chunk
+#define CMD_BATCH_FINISH 0x38                // Run batch, start response read session
+#define CMD_BATCH_READ_CHUNK 0x39            // Read next batch response chunk
+#define CMD_LOG_READ_START 0x40              // Start streaming logs (after a seq)
 #define CMD_LOG_READ_CHUNK 0x41              // Read log data chunk
 #define CMD_LOG_CLEAR 0x42                   // Clear the log buffer
+#define CMD_STATS_READ 0x50                  // Read latency statistics of a stage
+#define CMD_STATS_RESET 0x51                 // Reset latency statistics
+#define CMD_PROFILE_READ_START 0x52          // Start VM profile read session
+#define CMD_PROFILE_READ_CHUNK 0x53          // Read next VM profile data chunk
+#define CMD_PROFILE_RESET 0x54               // Reset the VM profile
 
 // Upload/Download/NVS state
 typedef enum {
@@ -63,6 +95,7 @@ typedef enum {
     TRANSFER_STATE_NVS_GETTING,
     TRANSFER_STATE_RAM_WRITING,
     TRANSFER_STATE_LOG_STREAMING,
+    TRANSFER_STATE_BATCH_WRITING,
     TRANSFER_STATE_ERROR
 } transfer_state_t;
 
@@ -71,8 +104,16 @@ static struct {
     size_t total_program_size;
     size_t program_bytes_read;
     const uint8_t *program_data;
+    program_ref_t program_ref;  // Program held by a program read session
     uint8_t interface_num;
 
+    // Streaming write state (sequence number is in bytes 1-3 of each chunk)
+    bool stream_active;
+    uint32_t stream_next_seq;
+    uint32_t stream_expected_crc;
+    uint32_t stream_crc;
+    bool stream_retry_sent;
+
     // NVS transfer state
     uint8_t nvs_value_type;
     char nvs_key[NVS_KEY_NAME_MAX_SIZE];
@@ -81,8 +122,22 @@ static struct {
     // NVS transfer buffer
     uint8_t nvs_transfer_buffer[NVS_TRANSFER_BUFFER_SIZE];
     size_t nvs_transfer_buffer_transferred;
+
+    // Log streaming state
+    log_buffer_cursor_t log_cursor;
+    uint32_t log_end_seq;
+
+    // Batch write state
+    size_t batch_length;
+    size_t batch_received;
 } g_transfer_state = {0};
 
+// VM profile image being read (allocated on first use)
+static uint8_t *g_profile_image = NULL;
+
+// Batch request followed by its response (allocated on first use)
+static uint8_t *g_batch_buffer = NULL;
+
 // Command processing queue and task
 static QueueHandle_t g_command_queue = NULL;
 static TaskHandle_t g_command_task_handle = NULL;
@@ -112,12 +167,239 @@ static void command_processing_task(void *pvParameters) {
     }
 }
 
+#if CFG_TUD_VENDOR > 0
+/************* Bulk transfer backend ****************/
+// Frames on the vendor interface start with a 12-byte header:
+//   command(1) reserved(3) length(4 LE) crc32(4 LE)
+// followed by `length` payload bytes. Responses use the same header.
+//   CMD_*_PROGRAM_STREAM_START + program bytes -> RESP_OK/RESP_ERROR once committed
+//   CMD_LOG_READ_START -> RESP_OK frames of log data, ending with a zero-length frame
+
+static TaskHandle_t g_bulk_task_handle = NULL;
+static uint8_t g_bulk_buffer[BULK_BUFFER_SIZE];
+
+// Read exactly size bytes from the bulk OUT endpoint
+static bool bulk_read(uint8_t *dst, uint32_t size, TickType_t timeout) {
+    uint32_t received = 0;
+    while (received < size) {
+        uint32_t n = tud_vendor_n_read(0, dst + received, size - received);
+        if (n > 0) {
+            received += n;
+            continue;
+        }
+        // Woken by tud_vendor_rx_cb()
+        if (ulTaskNotifyTake(pdTRUE, timeout) == 0 && tud_vendor_n_available(0) == 0) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Discard incoming data until the host stops sending
+static void bulk_drain(void) {
+    while (bulk_read(g_bulk_buffer, 1, pdMS_TO_TICKS(100))) {
+        tud_vendor_n_read(0, g_bulk_buffer, sizeof(g_bulk_buffer));
+    }
+}
+
+// Write all data to the bulk IN endpoint
+static bool bulk_write(const uint8_t *src, uint32_t size) {
+    uint32_t sent = 0;
+    TickType_t start = xTaskGetTickCount();
+    while (sent < size) {
+        uint32_t n = tud_vendor_n_write(0, src + sent, size - sent);
+        if (n > 0) {
+            sent += n;
+            start = xTaskGetTickCount();
+            continue;
+        }
+        tud_vendor_n_write_flush(0);
+        if (!tud_vendor_n_mounted(0) ||
+            (xTaskGetTickCount() - start) > pdMS_TO_TICKS(BULK_TIMEOUT_MS)) {
+            ESP_LOGE(TAG, "Bulk write timed out");
+            return false;
+        }
+        vTaskDelay(pdMS_TO_TICKS(1));
+    }
+    tud_vendor_n_write_flush(0);
+    return true;
+}
+
+static bool bulk_send_header(uint8_t response_id, uint32_t length, uint32_t crc) {
+    uint8_t header[BULK_HEADER_SIZE] = {0};
+    header[0] = response_id;
+    bu_write_u32_le(&header[4], sizeof(header) - 4, length);
+    bu_write_u32_le(&header[8], sizeof(header) - 8, crc);
+    return bulk_write(header, sizeof(header));
+}
+
+// Handle a program write frame: header is followed by program_size program bytes.
+// Bulk writes have their own write source, so they can't interleave with a Raw HID
+// write session.
+static void bulk_handle_program_write(program_type_t program_type,
+                                      uint32_t program_size,
+                                      uint32_t expected_crc) {
+    uint32_t max_size = (program_type == PROGRAM_TYPE_FLASH) ? PROGRAM_FLASH_MAX_SIZE
+                                                             : PROGRAM_RAM_MAX_SIZE;
+    if (program_size == 0 || program_size > max_size ||
+        !program_write_start(
+            program_type, program_size, PROGRAM_WRITE_SOURCE_USB_BULK)) {
+        ESP_LOGE(TAG,
+                 "Failed to start bulk write of %lu bytes",
+                 (unsigned long)program_size);
+        bulk_drain();
+        bulk_send_header(RESP_ERROR, 0, 0);
+        return;
+    }
+
+    ESP_LOGI(
+        TAG, "Bulk write started, program: %lu bytes", (unsigned long)program_size);
+
+    // Feed program storage a flash page at a time
+    uint32_t crc = 0;
+    uint32_t remaining = program_size;
+    while (remaining > 0) {
+        uint32_t chunk_size =
+            (remaining < BULK_BUFFER_SIZE) ? remaining : BULK_BUFFER_SIZE;
+        if (!bulk_read(g_bulk_buffer, chunk_size, pdMS_TO_TICKS(BULK_TIMEOUT_MS))) {
+            ESP_LOGE(TAG,
+                     "Bulk write timed out with %lu bytes remaining",
+                     (unsigned long)remaining);
+            // Late bytes of this transfer must not be taken for the next header
+            program_write_abort(program_type, PROGRAM_WRITE_SOURCE_USB_BULK);
+            bulk_drain();
+            bulk_send_header(RESP_ERROR, 0, 0);
+            return;
+        }
+        if (!program_write_chunk(program_type,
+                                 g_bulk_buffer,
+                                 chunk_size,
+                                 PROGRAM_WRITE_SOURCE_USB_BULK)) {
+            ESP_LOGE(TAG, "Failed to write bulk chunk to program storage");
+            program_write_abort(program_type, PROGRAM_WRITE_SOURCE_USB_BULK);
+            bulk_drain();
+            bulk_send_header(RESP_ERROR, 0, 0);
+            return;
+        }
+        crc = esp_rom_crc32_le(crc, g_bulk_buffer, chunk_size);
+        remaining -= chunk_size;
+    }
+
+    if (crc != expected_crc) {
+        ESP_LOGE(TAG,
+                 "Bulk write CRC mismatch: expected 0x%08lX, got 0x%08lX",
+                 (unsigned long)expected_crc,
+                 (unsigned long)crc);
+        program_write_abort(program_type, PROGRAM_WRITE_SOURCE_USB_BULK);
+        bulk_send_header(RESP_ERROR, 0, 0);
+        return;
+    }
+
+    if (!program_write_finish(
+            program_type, program_size, PROGRAM_WRITE_SOURCE_USB_BULK)) {
+        ESP_LOGE(TAG, "Failed to finish bulk write session");
+        program_write_abort(program_type, PROGRAM_WRITE_SOURCE_USB_BULK);
+        bulk_send_header(RESP_ERROR, 0, 0);
+        return;
+    }
+
+    ESP_LOGI(TAG,
+             "Bulk write completed successfully: %lu bytes",
+             (unsigned long)program_size);
+    bulk_send_header(RESP_OK, 0, 0);
+}
+
+// Handle a log read frame: stream the log buffer as data frames
+static void bulk_handle_log_read(void) {
+    log_buffer_start_read();
+    for (;;) {
+        uint32_t bytes_read =
+            log_buffer_read_chunk(g_bulk_buffer, sizeof(g_bulk_buffer));
+        if (!bulk_send_header(RESP_OK,
+                              bytes_read,
+                              esp_rom_crc32_le(0, g_bulk_buffer, bytes_read))) {
+            return;
+        }
+        if (bytes_read == 0) {
+            return;
+        }
+        if (!bulk_write(g_bulk_buffer, bytes_read)) {
+            return;
+        }
+    }
+}
+
+// Bulk transfer task function
+static void bulk_transfer_task(void *pvParameters) {
+    ESP_LOGI(TAG, "Bulk transfer task started");
+
+    for (;;) {
+        uint8_t header[BULK_HEADER_SIZE];
+        if (!bulk_read(header, sizeof(header), portMAX_DELAY)) {
+            continue;
+        }
+
+        uint32_t length, crc;
+        bu_read_u32_le(&header[4], sizeof(header) - 4, &length);
+        bu_read_u32_le(&header[8], sizeof(header) - 8, &crc);
+
+        switch (header[0]) {
+        case CMD_FLASH_PROGRAM_STREAM_START:
+            bulk_handle_program_write(PROGRAM_TYPE_FLASH, length, crc);
+            break;
+
+        case CMD_RAM_PROGRAM_STREAM_START:
+            bulk_handle_program_write(PROGRAM_TYPE_RAM, length, crc);
+            break;
+
+        case CMD_LOG_READ_START:
+            bulk_handle_log_read();
+            break;
+
+        default:
+            ESP_LOGW(TAG, "Unknown bulk command: 0x%02X", header[0]);
+            bulk_drain();
+            bulk_send_header(RESP_ERROR, 0, 0);
+            break;
+        }
+    }
+}
+
+static bool bulk_transfer_init(void) {
+    BaseType_t ret = xTaskCreate(bulk_transfer_task,
+                                 "usb_bulk",
+                                 BULK_TASK_STACK_SIZE,
+                                 NULL,
+                                 BULK_TASK_PRIORITY,
+                                 &g_bulk_task_handle);
+    if (ret != pdPASS) {
+        ESP_LOGE(TAG, "Failed to create bulk transfer task");
+        return false;
+    }
+    return true;
+}
+
+void usb_system_config_bulk_rx_notify(void) {
+    if (g_bulk_task_handle != NULL) {
+        xTaskNotifyGive(g_bulk_task_handle);
+    }
+}
+#else
+static bool bulk_transfer_init(void) {
+    return true;
+}
+
+void usb_system_config_bulk_rx_notify(void) {
+}
+#endif  // CFG_TUD_VENDOR
+
 bool usb_system_config_init(uint8_t interface_num) {
     // Reset transfer state
     g_transfer_state.state = TRANSFER_STATE_IDLE;
     g_transfer_state.total_program_size = 0;
     g_transfer_state.program_bytes_read = 0;
     g_transfer_state.program_data = NULL;
+    memset(&g_transfer_state.program_ref, 0, sizeof(g_transfer_state.program_ref));
     g_transfer_state.interface_num = interface_num;
     // Reset NVS state
     g_transfer_state.nvs_value_type = 0;
@@ -148,6 +430,11 @@ bool usb_system_config_init(uint8_t interface_num) {
         return false;
     }
 
+    // Start the bulk transfer backend (vendor interface builds only)
+    if (!bulk_transfer_init()) {
+        return false;
+    }
+
     ESP_LOGI(
         TAG, "System configuration module initialized on interface %d", interface_num);
     return true;
@@ -206,8 +493,36 @@ static void send_response_with_data(uint8_t response_id,
     }
 }
 
+// Helper function to send a stream acknowledgement or retry request
+static void send_stream_response(uint8_t response_id, uint32_t next_seq) {
+    uint8_t seq_data[4];
+    seq_data[0] = (uint8_t)(next_seq & 0xFF);
+    seq_data[1] = (uint8_t)((next_seq >> 8) & 0xFF);
+    seq_data[2] = (uint8_t)((next_seq >> 16) & 0xFF);
+    seq_data[3] = (uint8_t)((next_seq >> 24) & 0xFF);
+    send_response_with_data(response_id, seq_data, 4);
+}
+
+// Helper function to verify the whole-transfer CRC of a streamed write (if any)
+static bool check_stream_crc(void) {
+    if (!g_transfer_state.stream_active) {
+        return true;
+    }
+    g_transfer_state.stream_active = false;
+
+    if (g_transfer_state.stream_crc != g_transfer_state.stream_expected_crc) {
+        ESP_LOGE(TAG,
+                 "Stream CRC mismatch: expected 0x%08lX, got 0x%08lX",
+                 (unsigned long)g_transfer_state.stream_expected_crc,
+                 (unsigned long)g_transfer_state.stream_crc);
+        return false;
+    }
+    return true;
+}
+
 // Handle CMD_FLASH_PROGRAM_WRITE_START command
 static void handle_flash_program_write_start(uint32_t program_size) {
+    g_transfer_state.stream_active = false;
     if ((program_size == 0) || (program_size > PROGRAM_FLASH_MAX_SIZE)) {
         ESP_LOGE(TAG, "Invalid program size: %lu", (unsigned long)program_size);
         send_response(RESP_ERROR);
@@ -287,6 +602,11 @@ static void handle_flash_program_write_finish(uint32_t program_size) {
         send_response(RESP_ERROR);
         return;
     }
+    if (!check_stream_crc()) {
+        g_transfer_state.state = TRANSFER_STATE_ERROR;
+        send_response(RESP_ERROR);
+        return;
+    }
 
     // Finish program storage write session
     if (!program_write_finish(
@@ -306,23 +626,29 @@ static void handle_flash_program_write_finish(uint32_t program_size) {
     send_response(RESP_OK);
 }
 
+// Start a read session of a stored program, holding a reference to it until the
+// session ends
+static bool start_program_read(program_type_t type) {
+    program_release(&g_transfer_state.program_ref);
+    if (!program_acquire(type, &g_transfer_state.program_ref)) {
+        return false;
+    }
+
+    g_transfer_state.state = TRANSFER_STATE_READING;
+    g_transfer_state.total_program_size = g_transfer_state.program_ref.size;
+    g_transfer_state.program_bytes_read = 0;
+    g_transfer_state.program_data = g_transfer_state.program_ref.data;
+    return true;
+}
+
 // Handle CMD_FLASH_PROGRAM_READ_START command
 static void handle_flash_program_read_start(void) {
-    // Get program from storage
-    uint32_t program_size;
-    const uint8_t *program_data = program_get(PROGRAM_TYPE_FLASH, &program_size);
-
-    if (program_data == NULL || program_size == 0) {
+    if (!start_program_read(PROGRAM_TYPE_FLASH)) {
         ESP_LOGE(TAG, "No program stored in flash");
         send_response(RESP_ERROR);
         return;
     }
-
-    // Initialize read state
-    g_transfer_state.state = TRANSFER_STATE_READING;
-    g_transfer_state.total_program_size = program_size;
-    g_transfer_state.program_bytes_read = 0;
-    g_transfer_state.program_data = program_data;
+    uint32_t program_size = g_transfer_state.total_program_size;
 
     ESP_LOGI(
         TAG, "Read session started, program: %lu bytes", (unsigned long)program_size);
@@ -337,7 +663,8 @@ static void handle_flash_program_read_start(void) {
     send_response_with_data(RESP_OK, size_data, 4);
 }
 
-// Handle CMD_FLASH_PROGRAM_READ_CHUNK and CMD_RAM_PROGRAM_READ_CHUNK command
+// Handle CMD_FLASH_PROGRAM_READ_CHUNK, CMD_RAM_PROGRAM_READ_CHUNK,
+// CMD_PROFILE_READ_CHUNK and CMD_BATCH_READ_CHUNK command
 static void handle_program_read_chunk(void) {
     if (g_transfer_state.state != TRANSFER_STATE_READING) {
         ESP_LOGE(TAG, "PROGRAM_READ_CHUNK received but not in reading state");
@@ -361,9 +688,13 @@ static void handle_program_read_chunk(void) {
     const uint8_t *chunk_data =
         g_transfer_state.program_data + g_transfer_state.program_bytes_read;
 
-    // Pad chunk to 60 bytes if needed
+    // Pad the last chunk to 60 bytes if needed; full chunks go straight from the
+    // program
     uint8_t padded_chunk[60] = {0};
-    memcpy(padded_chunk, chunk_data, chunk_size);
+    if (chunk_size < sizeof(padded_chunk)) {
+        memcpy(padded_chunk, chunk_data, chunk_size);
+        chunk_data = padded_chunk;
+    }
 
     // Update read position
     g_transfer_state.program_bytes_read += chunk_size;
@@ -374,7 +705,7 @@ static void handle_program_read_chunk(void) {
              (unsigned long)g_transfer_state.total_program_size);
 
     // Send chunk data
-    send_response_with_data(RESP_OK, padded_chunk, 60);
+    send_response_with_data(RESP_OK, chunk_data, 60);
 
     // If we've read all data, reset state
     if (g_transfer_state.program_bytes_read >= g_transfer_state.total_program_size) {
@@ -385,22 +716,68 @@ static void handle_program_read_chunk(void) {
         g_transfer_state.total_program_size = 0;
         g_transfer_state.program_bytes_read = 0;
         g_transfer_state.program_data = NULL;
+        program_release(&g_transfer_state.program_ref);
     }
 }
 
 // Handle CMD_FLASH_PROGRAM_EXECUTE command
 static void handle_flash_program_execute(void) {
-    if (!program_execute(PROGRAM_TYPE_FLASH, NULL, NULL)) {
+    uint32_t position;
+    if (!program_enqueue(
+            PROGRAM_TYPE_FLASH, PROGRAM_PRIORITY_NORMAL, NULL, NULL, &position)) {
         ESP_LOGW(TAG, "FLASH program execution failed");
         send_response(RESP_ERROR);
         return;
     }
-    ESP_LOGI(TAG, "FLASH program execution started");
-    send_response(RESP_OK);
+    ESP_LOGI(TAG,
+             "FLASH program execution queued at position %lu",
+             (unsigned long)position);
+
+    // Respond with the queue position (bytes 4-7)
+    uint8_t response[4];
+    bu_write_u32_le(response, sizeof(response), position);
+    send_response_with_data(RESP_OK, response, sizeof(response));
+}
+
+// Handle CMD_FLASH_PROGRAM_SELECT command. An id of 0xFFFFFFFF selects by the
+// NUL-padded name that follows it instead.
+static void handle_flash_program_select(const uint8_t *data, uint16_t len) {
+    uint32_t id;
+    if (!bu_read_u32_le(&data[4], len - 4, &id)) {
+        ESP_LOGE(TAG, "Failed to read program id");
+        send_response(RESP_ERROR);
+        return;
+    }
+
+    if (id == UINT32_MAX) {
+        char name[PROGRAM_NAME_MAX_LEN + 1] = {0};
+        if (len < 8 + PROGRAM_NAME_MAX_LEN) {
+            ESP_LOGE(TAG, "FLASH_PROGRAM_SELECT name too short");
+            send_response(RESP_ERROR);
+            return;
+        }
+        memcpy(name, &data[8], PROGRAM_NAME_MAX_LEN);
+        if (!program_find(PROGRAM_TYPE_FLASH, name, &id)) {
+            ESP_LOGW(TAG, "FLASH program '%s' not found", name);
+            send_response(RESP_ERROR);
+            return;
+        }
+    }
+
+    if (!program_select(PROGRAM_TYPE_FLASH, id)) {
+        ESP_LOGW(TAG, "Failed to select FLASH program %lu", (unsigned long)id);
+        send_response(RESP_ERROR);
+        return;
+    }
+
+    uint8_t response[4];
+    bu_write_u32_le(response, sizeof(response), id);
+    send_response_with_data(RESP_OK, response, sizeof(response));
 }
 
 // Handle CMD_RAM_PROGRAM_WRITE_START command
 static void handle_ram_program_write_start(uint32_t program_size) {
+    g_transfer_state.stream_active = false;
     if ((program_size == 0) || (program_size > PROGRAM_RAM_MAX_SIZE)) {
         ESP_LOGE(TAG, "Invalid RAM program size: %lu", (unsigned long)program_size);
         send_response(RESP_ERROR);
@@ -482,6 +859,11 @@ static void handle_ram_program_write_finish(uint32_t program_size) {
         send_response(RESP_ERROR);
         return;
     }
+    if (!check_stream_crc()) {
+        g_transfer_state.state = TRANSFER_STATE_ERROR;
+        send_response(RESP_ERROR);
+        return;
+    }
 
     // Finish RAM program storage write session
     if (!program_write_finish(
@@ -501,34 +883,120 @@ static void handle_ram_program_write_finish(uint32_t program_size) {
     send_response(RESP_OK);
 }
 
+// Handle CMD_FLASH_PROGRAM_STREAM_START and CMD_RAM_PROGRAM_STREAM_START commands
+static void handle_program_stream_start(program_type_t program_type,
+                                        uint32_t program_size,
+                                        uint32_t crc) {
+    if (program_type == PROGRAM_TYPE_FLASH) {
+        handle_flash_program_write_start(program_size);
+    } else {
+        handle_ram_program_write_start(program_size);
+    }
+    if (g_transfer_state.state != TRANSFER_STATE_WRITING &&
+        g_transfer_state.state != TRANSFER_STATE_RAM_WRITING) {
+        return;
+    }
+
+    g_transfer_state.stream_active = true;
+    g_transfer_state.stream_next_seq = 0;
+    g_transfer_state.stream_expected_crc = crc;
+    g_transfer_state.stream_crc = 0;
+    g_transfer_state.stream_retry_sent = false;
+
+    ESP_LOGI(TAG,
+             "Streaming write started (window %d, CRC 0x%08lX)",
+             PROGRAM_STREAM_WINDOW,
+             (unsigned long)crc);
+}
+
+// Handle CMD_PROGRAM_STREAM_CHUNK command
+static void handle_program_stream_chunk(uint32_t seq,
+                                        const uint8_t *chunk_data,
+                                        uint16_t chunk_size) {
+    if (!g_transfer_state.stream_active ||
+        (g_transfer_state.state != TRANSFER_STATE_WRITING &&
+         g_transfer_state.state != TRANSFER_STATE_RAM_WRITING)) {
+        // Not answered: the host stops streaming after the first error response
+        ESP_LOGD(TAG, "PROGRAM_STREAM_CHUNK received but no stream is active");
+        return;
+    }
+
+    // Chunks are only written in order. Duplicates of already written chunks (after
+    // a retry) are dropped, and a gap is reported once so the host can resend.
+    if (seq != g_transfer_state.stream_next_seq) {
+        if (seq > g_transfer_state.stream_next_seq &&
+            !g_transfer_state.stream_retry_sent) {
+            ESP_LOGW(TAG,
+                     "Stream chunk %lu out of sequence, expected %lu",
+                     (unsigned long)seq,
+                     (unsigned long)g_transfer_state.stream_next_seq);
+            g_transfer_state.stream_retry_sent = true;
+            send_stream_response(RESP_RETRY, g_transfer_state.stream_next_seq);
+        }
+        return;
+    }
+    g_transfer_state.stream_retry_sent = false;
+
+    program_type_t program_type = (g_transfer_state.state == TRANSFER_STATE_WRITING)
+                                      ? PROGRAM_TYPE_FLASH
+                                      : PROGRAM_TYPE_RAM;
+    size_t expected_size = program_get_expected_size(program_type);
+    size_t bytes_written = program_get_bytes_written(program_type);
+    size_t program_bytes_remaining = expected_size - bytes_written;
+    size_t actual_chunk_size =
+        (program_bytes_remaining < chunk_size) ? program_bytes_remaining : chunk_size;
+
+    if (actual_chunk_size == 0 ||
+        !program_write_chunk(
+            program_type, chunk_data, actual_chunk_size, PROGRAM_WRITE_SOURCE_USB)) {
+        ESP_LOGE(TAG, "Failed to write stream chunk %lu", (unsigned long)seq);
+        g_transfer_state.state = TRANSFER_STATE_ERROR;
+        g_transfer_state.stream_active = false;
+        send_response(RESP_ERROR);
+        return;
+    }
+
+    g_transfer_state.stream_crc =
+        esp_rom_crc32_le(g_transfer_state.stream_crc, chunk_data, actual_chunk_size);
+    g_transfer_state.stream_next_seq++;
+
+    // Acknowledge cumulatively every ACK_INTERVAL chunks and after the last chunk
+    bool complete = (bytes_written + actual_chunk_size) >= expected_size;
+    if (complete ||
+        (g_transfer_state.stream_next_seq % PROGRAM_STREAM_ACK_INTERVAL) == 0) {
+        send_stream_response(RESP_OK, g_transfer_state.stream_next_seq);
+    }
+}
+
 // Handle CMD_RAM_PROGRAM_EXECUTE command
 static void handle_ram_program_execute(void) {
-    if (!program_execute(PROGRAM_TYPE_RAM, NULL, NULL)) {
+    uint32_t position;
+    if (!program_enqueue(
+            PROGRAM_TYPE_RAM, PROGRAM_PRIORITY_NORMAL, NULL, NULL, &position)) {
         ESP_LOGW(TAG, "RAM program execution failed");
         send_response(RESP_ERROR);
         return;
     }
-    ESP_LOGI(TAG, "RAM program execution started");
-    send_response(RESP_OK);
+    ESP_LOGI(TAG,
+             "RAM program execution queued at position %lu",
+             (unsigned long)position);
+
+    // Respond with the queue position (bytes 4-7)
+    uint8_t response[4];
+    bu_write_u32_le(response, sizeof(response), position);
+    send_response_with_data(RESP_OK, response, sizeof(response));
 }
 
 // Handle CMD_RAM_PROGRAM_READ_START command
 static void handle_ram_program_read_start(void) {
-    // Get RAM program from storage
-    uint32_t program_size;
-    const uint8_t *program_data = program_get(PROGRAM_TYPE_RAM, &program_size);
-
-    if (program_data == NULL || program_size == 0) {
+    // The session reads its own snapshot, so uploads may replace the program
+    // meanwhile
+    if (!start_program_read(PROGRAM_TYPE_RAM)) {
         ESP_LOGE(TAG, "No RAM program stored");
         send_response(RESP_ERROR);
         return;
     }
-
-    // Initialize read state
-    g_transfer_state.state = TRANSFER_STATE_READING;
-    g_transfer_state.total_program_size = program_size;
-    g_transfer_state.program_bytes_read = 0;
-    g_transfer_state.program_data = program_data;
+    uint32_t program_size = g_transfer_state.total_program_size;
 
     ESP_LOGI(TAG,
              "RAM read session started, program: %lu bytes",
@@ -693,37 +1161,26 @@ static void handle_nvs_set_finish(void) {
         return;
     }
 
-    // Open NVS namespace
-    nvs_handle_t nvs_handle;
-    esp_err_t err = nvs_open("odkey", NVS_READWRITE, &nvs_handle);
-    if (err != ESP_OK) {
-        ESP_LOGE(TAG, "Failed to open NVS: %s", esp_err_to_name(err));
-        send_response(RESP_ERROR);
-        return;
-    }
-
     // Write value based on type
-    err = ESP_FAIL;
+    esp_err_t err = ESP_FAIL;
     switch (g_transfer_state.nvs_value_type) {
     case NVS_TYPE_U8:
-        err = nvs_set_u8(nvs_handle,
-                         g_transfer_state.nvs_key,
-                         g_transfer_state.nvs_transfer_buffer[0]);
+        err = nvs_config_set_u8(g_transfer_state.nvs_key,
+                                g_transfer_state.nvs_transfer_buffer[0]);
         break;
     case NVS_TYPE_I8:
-        err = nvs_set_i8(nvs_handle,
-                         g_transfer_state.nvs_key,
-                         (int8_t)g_transfer_state.nvs_transfer_buffer[0]);
+        err = nvs_config_set_i8(g_transfer_state.nvs_key,
+                                (int8_t)g_transfer_state.nvs_transfer_buffer[0]);
         break;
     case NVS_TYPE_U16: {
         uint16_t value = g_transfer_state.nvs_transfer_buffer[0] |
                          (g_transfer_state.nvs_transfer_buffer[1] << 8);
-        err = nvs_set_u16(nvs_handle, g_transfer_state.nvs_key, value);
+        err = nvs_config_set_u16(g_transfer_state.nvs_key, value);
     } break;
     case NVS_TYPE_I16: {
         int16_t value = g_transfer_state.nvs_transfer_buffer[0] |
                         (g_transfer_state.nvs_transfer_buffer[1] << 8);
-        err = nvs_set_i16(nvs_handle, g_transfer_state.nvs_key, value);
+        err = nvs_config_set_i16(g_transfer_state.nvs_key, value);
     } break;
     case NVS_TYPE_U32: {
         uint32_t value;
@@ -733,7 +1190,7 @@ static void handle_nvs_set_finish(void) {
             ESP_LOGE(TAG, "Failed to read u32 value");
             err = ESP_FAIL;
         } else {
-            err = nvs_set_u32(nvs_handle, g_transfer_state.nvs_key, value);
+            err = nvs_config_set_u32(g_transfer_state.nvs_key, value);
         }
     } break;
     case NVS_TYPE_I32: {
@@ -744,7 +1201,7 @@ static void handle_nvs_set_finish(void) {
             ESP_LOGE(TAG, "Failed to read i32 value");
             err = ESP_FAIL;
         } else {
-            err = nvs_set_i32(nvs_handle, g_transfer_state.nvs_key, (int32_t)value);
+            err = nvs_config_set_i32(g_transfer_state.nvs_key, (int32_t)value);
         }
     } break;
     case NVS_TYPE_U64: {
@@ -756,7 +1213,7 @@ static void handle_nvs_set_finish(void) {
                          ((uint64_t)g_transfer_state.nvs_transfer_buffer[5] << 40) |
                          ((uint64_t)g_transfer_state.nvs_transfer_buffer[6] << 48) |
                          ((uint64_t)g_transfer_state.nvs_transfer_buffer[7] << 56);
-        err = nvs_set_u64(nvs_handle, g_transfer_state.nvs_key, value);
+        err = nvs_config_set_u64(g_transfer_state.nvs_key, value);
     } break;
     case NVS_TYPE_I64: {
         uint32_t low, high;
@@ -769,40 +1226,26 @@ static void handle_nvs_set_finish(void) {
             err = ESP_FAIL;
         } else {
             int64_t value = (int64_t)low | ((int64_t)high << 32);
-            err = nvs_set_i64(nvs_handle, g_transfer_state.nvs_key, value);
+            err = nvs_config_set_i64(g_transfer_state.nvs_key, value);
         }
     } break;
     case NVS_TYPE_STR:
-        err = nvs_set_str(nvs_handle,
-                          g_transfer_state.nvs_key,
-                          (const char *)g_transfer_state.nvs_transfer_buffer);
+        err = nvs_config_set_str(g_transfer_state.nvs_key,
+                                 (const char *)g_transfer_state.nvs_transfer_buffer);
         break;
     case NVS_TYPE_BLOB:
-        err = nvs_set_blob(nvs_handle,
-                           g_transfer_state.nvs_key,
-                           g_transfer_state.nvs_transfer_buffer,
-                           g_transfer_state.nvs_value_length);
+        err = nvs_config_set_blob(g_transfer_state.nvs_key,
+                                  g_transfer_state.nvs_transfer_buffer,
+                                  g_transfer_state.nvs_value_length);
         break;
     }
 
     if (err != ESP_OK) {
         ESP_LOGE(TAG, "Failed to set NVS value: %s", esp_err_to_name(err));
-        nvs_close(nvs_handle);
-        send_response(RESP_ERROR);
-        return;
-    }
-
-    // Commit changes
-    err = nvs_commit(nvs_handle);
-    if (err != ESP_OK) {
-        ESP_LOGE(TAG, "Failed to commit NVS: %s", esp_err_to_name(err));
-        nvs_close(nvs_handle);
         send_response(RESP_ERROR);
         return;
     }
 
-    nvs_close(nvs_handle);
-
     ESP_LOGI(TAG, "NVS set completed: key='%s'", g_transfer_state.nvs_key);
     g_transfer_state.state = TRANSFER_STATE_IDLE;
     send_response(RESP_OK);
@@ -825,21 +1268,11 @@ static void handle_nvs_get_start(const uint8_t *data) {
         return;
     }
 
-    // Open NVS namespace
-    nvs_handle_t nvs_handle;
-    esp_err_t err = nvs_open("odkey", NVS_READONLY, &nvs_handle);
-    if (err != ESP_OK) {
-        ESP_LOGE(TAG, "Failed to open NVS: %s", esp_err_to_name(err));
-        send_response(RESP_ERROR);
-        return;
-    }
-
-    // Get key type using nvs_find_key
+    // Get key type
     nvs_type_t nvs_type;
-    err = nvs_find_key(nvs_handle, g_transfer_state.nvs_key, &nvs_type);
+    esp_err_t err = nvs_config_find_key(g_transfer_state.nvs_key, &nvs_type);
     if (err != ESP_OK) {
         ESP_LOGE(TAG, "Failed to find NVS key: %s", esp_err_to_name(err));
-        nvs_close(nvs_handle);
         send_response(RESP_ERROR);
         return;
     }
@@ -853,7 +1286,7 @@ static void handle_nvs_get_start(const uint8_t *data) {
     switch (g_transfer_state.nvs_value_type) {
     case NVS_TYPE_U8: {
         uint8_t value;
-        err = nvs_get_u8(nvs_handle, g_transfer_state.nvs_key, &value);
+        err = nvs_config_get_u8(g_transfer_state.nvs_key, &value);
         if (err == ESP_OK) {
             g_transfer_state.nvs_transfer_buffer[0] = value;
             value_size = 1;
@@ -861,7 +1294,7 @@ static void handle_nvs_get_start(const uint8_t *data) {
     } break;
     case NVS_TYPE_I8: {
         int8_t value;
-        err = nvs_get_i8(nvs_handle, g_transfer_state.nvs_key, &value);
+        err = nvs_config_get_i8(g_transfer_state.nvs_key, &value);
         if (err == ESP_OK) {
             g_transfer_state.nvs_transfer_buffer[0] = (uint8_t)value;
             value_size = 1;
@@ -869,7 +1302,7 @@ static void handle_nvs_get_start(const uint8_t *data) {
     } break;
     case NVS_TYPE_U16: {
         uint16_t value;
-        err = nvs_get_u16(nvs_handle, g_transfer_state.nvs_key, &value);
+        err = nvs_config_get_u16(g_transfer_state.nvs_key, &value);
         if (err == ESP_OK) {
             g_transfer_state.nvs_transfer_buffer[0] = value & 0xFF;
             g_transfer_state.nvs_transfer_buffer[1] = (value >> 8) & 0xFF;
@@ -878,7 +1311,7 @@ static void handle_nvs_get_start(const uint8_t *data) {
     } break;
     case NVS_TYPE_I16: {
         int16_t value;
-        err = nvs_get_i16(nvs_handle, g_transfer_state.nvs_key, &value);
+        err = nvs_config_get_i16(g_transfer_state.nvs_key, &value);
         if (err == ESP_OK) {
             g_transfer_state.nvs_transfer_buffer[0] = value & 0xFF;
             g_transfer_state.nvs_transfer_buffer[1] = (value >> 8) & 0xFF;
@@ -887,7 +1320,7 @@ static void handle_nvs_get_start(const uint8_t *data) {
     } break;
     case NVS_TYPE_U32: {
         uint32_t value;
-        err = nvs_get_u32(nvs_handle, g_transfer_state.nvs_key, &value);
+        err = nvs_config_get_u32(g_transfer_state.nvs_key, &value);
         if (err == ESP_OK) {
             g_transfer_state.nvs_transfer_buffer[0] = value & 0xFF;
             g_transfer_state.nvs_transfer_buffer[1] = (value >> 8) & 0xFF;
@@ -898,7 +1331,7 @@ static void handle_nvs_get_start(const uint8_t *data) {
     } break;
     case NVS_TYPE_I32: {
         int32_t value;
-        err = nvs_get_i32(nvs_handle, g_transfer_state.nvs_key, &value);
+        err = nvs_config_get_i32(g_transfer_state.nvs_key, &value);
         if (err == ESP_OK) {
             g_transfer_state.nvs_transfer_buffer[0] = value & 0xFF;
             g_transfer_state.nvs_transfer_buffer[1] = (value >> 8) & 0xFF;
@@ -909,7 +1342,7 @@ static void handle_nvs_get_start(const uint8_t *data) {
     } break;
     case NVS_TYPE_U64: {
         uint64_t value;
-        err = nvs_get_u64(nvs_handle, g_transfer_state.nvs_key, &value);
+        err = nvs_config_get_u64(g_transfer_state.nvs_key, &value);
         if (err == ESP_OK) {
             for (int i = 0; i < 8; i++) {
                 g_transfer_state.nvs_transfer_buffer[i] = (value >> (i * 8)) & 0xFF;
@@ -919,7 +1352,7 @@ static void handle_nvs_get_start(const uint8_t *data) {
     } break;
     case NVS_TYPE_I64: {
         int64_t value;
-        err = nvs_get_i64(nvs_handle, g_transfer_state.nvs_key, &value);
+        err = nvs_config_get_i64(g_transfer_state.nvs_key, &value);
         if (err == ESP_OK) {
             for (int i = 0; i < 8; i++) {
                 g_transfer_state.nvs_transfer_buffer[i] = (value >> (i * 8)) & 0xFF;
@@ -929,28 +1362,24 @@ static void handle_nvs_get_start(const uint8_t *data) {
     } break;
     case NVS_TYPE_STR: {
         size_t required_size = sizeof(g_transfer_state.nvs_transfer_buffer);
-        err = nvs_get_str(nvs_handle,
-                          g_transfer_state.nvs_key,
-                          (char *)g_transfer_state.nvs_transfer_buffer,
-                          &required_size);
+        err = nvs_config_get_str(g_transfer_state.nvs_key,
+                                 (char *)g_transfer_state.nvs_transfer_buffer,
+                                 &required_size);
         if (err == ESP_OK) {
             value_size = required_size - 1;  // Exclude null terminator
         }
     } break;
     case NVS_TYPE_BLOB: {
         size_t required_size = sizeof(g_transfer_state.nvs_transfer_buffer);
-        err = nvs_get_blob(nvs_handle,
-                           g_transfer_state.nvs_key,
-                           g_transfer_state.nvs_transfer_buffer,
-                           &required_size);
+        err = nvs_config_get_blob(g_transfer_state.nvs_key,
+                                  g_transfer_state.nvs_transfer_buffer,
+                                  &required_size);
         if (err == ESP_OK) {
             value_size = required_size;
         }
     } break;
     }
 
-    nvs_close(nvs_handle);
-
     if (err != ESP_OK) {
         ESP_LOGE(TAG, "Failed to get NVS value: %s", esp_err_to_name(err));
         send_response(RESP_ERROR);
@@ -1038,47 +1467,35 @@ static void handle_nvs_delete(const uint8_t *data) {
         return;
     }
 
-    // Open NVS namespace
-    nvs_handle_t nvs_handle;
-    esp_err_t err = nvs_open("odkey", NVS_READWRITE, &nvs_handle);
-    if (err != ESP_OK) {
-        ESP_LOGE(TAG, "Failed to open NVS: %s", esp_err_to_name(err));
-        send_response(RESP_ERROR);
-        return;
-    }
-
     // Delete key
-    err = nvs_erase_key(nvs_handle, g_transfer_state.nvs_key);
+    esp_err_t err = nvs_config_erase_key(g_transfer_state.nvs_key);
     if (err != ESP_OK && err != ESP_ERR_NVS_NOT_FOUND) {
         ESP_LOGE(TAG, "Failed to erase NVS key: %s", esp_err_to_name(err));
-        nvs_close(nvs_handle);
         send_response(RESP_ERROR);
         return;
     }
 
-    // Commit changes
-    err = nvs_commit(nvs_handle);
-    if (err != ESP_OK) {
-        ESP_LOGE(TAG, "Failed to commit NVS: %s", esp_err_to_name(err));
-        nvs_close(nvs_handle);
-        send_response(RESP_ERROR);
-        return;
-    }
-
-    nvs_close(nvs_handle);
-
     ESP_LOGI(TAG, "NVS delete completed: key='%s'", g_transfer_state.nvs_key);
     send_response(RESP_OK);
 }
 
-// Handle CMD_LOG_READ_START command
-static void handle_log_read_start(void) {
-    // Start reading from the beginning of the buffer
-    log_buffer_start_read();
+// Handle CMD_LOG_READ_START command. Bytes 4-7 hold the sequence number to read
+// after (0 for the whole buffer); the response holds the one to pass next time.
+static void handle_log_read_start(const uint8_t *data, uint16_t len) {
+    uint32_t seq = LOG_BUFFER_SEQ_OLDEST;
+    if (len >= 8) {
+        bu_read_u32_le(&data[4], len - 4, &seq);
+    }
+
+    // Stream up to the newest complete record
+    log_buffer_cursor_start(&g_transfer_state.log_cursor, seq);
+    g_transfer_state.log_end_seq = log_buffer_cursor_end(&g_transfer_state.log_cursor);
 
     g_transfer_state.state = TRANSFER_STATE_LOG_STREAMING;
 
-    send_response(RESP_OK);
+    uint8_t response[4];
+    bu_write_u32_le(response, sizeof(response), g_transfer_state.log_end_seq);
+    send_response_with_data(RESP_OK, response, sizeof(response));
 }
 
 // Handle CMD_LOG_READ_CHUNK command (host requests log data)
@@ -1089,7 +1506,10 @@ static void handle_log_read_chunk(void) {
     }
 
     uint8_t chunk_buffer[60] = {0};
-    uint32_t bytes_read = log_buffer_read_chunk(chunk_buffer, sizeof(chunk_buffer));
+    uint32_t bytes_read = log_buffer_cursor_read(&g_transfer_state.log_cursor,
+                                                 g_transfer_state.log_end_seq,
+                                                 chunk_buffer,
+                                                 sizeof(chunk_buffer));
 
     if (bytes_read > 0) {
         send_response_with_data(RESP_OK, chunk_buffer, bytes_read);
@@ -1106,6 +1526,164 @@ static void handle_log_clear(void) {
     send_response(RESP_OK);
 }
 
+// Handle CMD_STATS_READ command. Byte 4 holds the stage; the response holds the
+// number of stages, then the stage's sample count, summarized samples, min, p50, p99
+// and max latency in microseconds (u32 each, from byte 8).
+static void handle_stats_read(const uint8_t *data) {
+    latency_summary_t summary;
+    if (!latency_stats_get((latency_stage_t)data[4], &summary)) {
+        ESP_LOGE(TAG, "Invalid latency stage: %d", data[4]);
+        send_response(RESP_ERROR);
+        return;
+    }
+
+    uint8_t response[28] = {0};
+    response[0] = LATENCY_STAGE_COUNT;
+    bu_write_u32_le(&response[4], sizeof(response) - 4, summary.count);
+    bu_write_u32_le(&response[8], sizeof(response) - 8, summary.samples);
+    bu_write_u32_le(&response[12], sizeof(response) - 12, summary.min_us);
+    bu_write_u32_le(&response[16], sizeof(response) - 16, summary.p50_us);
+    bu_write_u32_le(&response[20], sizeof(response) - 20, summary.p99_us);
+    bu_write_u32_le(&response[24], sizeof(response) - 24, summary.max_us);
+    send_response_with_data(RESP_OK, response, sizeof(response));
+}
+
+// Handle CMD_STATS_RESET command
+static void handle_stats_reset(void) {
+    latency_stats_reset();
+    send_response(RESP_OK);
+}
+
+// Handle CMD_PROFILE_READ_START command. The image is read with
+// CMD_PROFILE_READ_CHUNK like a program.
+static void handle_profile_read_start(void) {
+    if (g_profile_image == NULL) {
+        g_profile_image =
+            heap_caps_malloc(VM_TASK_PROFILE_IMAGE_MAX_SIZE, MALLOC_CAP_SPIRAM);
+        if (g_profile_image == NULL) {
+            ESP_LOGE(TAG, "Failed to allocate profile image buffer");
+            send_response(RESP_ERROR);
+            return;
+        }
+    }
+
+    size_t image_size =
+        vm_task_get_profile_image(g_profile_image, VM_TASK_PROFILE_IMAGE_MAX_SIZE);
+    if (image_size == 0) {
+        ESP_LOGE(TAG, "No profile available (none recorded or program running)");
+        send_response(RESP_ERROR);
+        return;
+    }
+
+    program_release(&g_transfer_state.program_ref);
+    g_transfer_state.state = TRANSFER_STATE_READING;
+    g_transfer_state.total_program_size = image_size;
+    g_transfer_state.program_bytes_read = 0;
+    g_transfer_state.program_data = g_profile_image;
+
+    uint8_t size_data[4];
+    bu_write_u32_le(size_data, sizeof(size_data), image_size);
+    send_response_with_data(RESP_OK, size_data, sizeof(size_data));
+}
+
+// Handle CMD_PROFILE_RESET command
+static void handle_profile_reset(void) {
+    vm_task_reset_profile();
+    send_response(RESP_OK);
+}
+
+// Handle CMD_BATCH_START command
+static void handle_batch_start(const uint8_t *data) {
+    uint32_t batch_length;
+    bu_read_u32_le(&data[4], 4, &batch_length);
+    if (batch_length == 0 || batch_length > CONFIG_BATCH_MAX_SIZE) {
+        ESP_LOGE(TAG, "Invalid batch length: %lu", (unsigned long)batch_length);
+        send_response(RESP_ERROR);
+        return;
+    }
+
+    if (g_batch_buffer == NULL) {
+        g_batch_buffer = heap_caps_malloc(2 * CONFIG_BATCH_MAX_SIZE, MALLOC_CAP_SPIRAM);
+        if (g_batch_buffer == NULL) {
+            ESP_LOGE(TAG, "Failed to allocate batch buffer");
+            send_response(RESP_ERROR);
+            return;
+        }
+    }
+
+    g_transfer_state.state = TRANSFER_STATE_BATCH_WRITING;
+    g_transfer_state.batch_length = batch_length;
+    g_transfer_state.batch_received = 0;
+
+    ESP_LOGD(TAG, "Batch started: %lu bytes", (unsigned long)batch_length);
+    send_response(RESP_OK);
+}
+
+// Handle CMD_BATCH_DATA command
+static void handle_batch_data(const uint8_t *data) {
+    if (g_transfer_state.state != TRANSFER_STATE_BATCH_WRITING) {
+        ESP_LOGE(TAG, "BATCH_DATA received but not in batch writing state");
+        send_response(RESP_ERROR);
+        return;
+    }
+
+    // Calculate how many bytes to copy (60 bytes max)
+    size_t bytes_remaining =
+        g_transfer_state.batch_length - g_transfer_state.batch_received;
+    size_t bytes_to_copy = (bytes_remaining > 60) ? 60 : bytes_remaining;
+    if (bytes_to_copy == 0) {
+        ESP_LOGE(TAG, "All batch data already received");
+        g_transfer_state.state = TRANSFER_STATE_ERROR;
+        send_response(RESP_ERROR);
+        return;
+    }
+
+    memcpy(&g_batch_buffer[g_transfer_state.batch_received], &data[4], bytes_to_copy);
+    g_transfer_state.batch_received += bytes_to_copy;
+    send_response(RESP_OK);
+}
+
+// Handle CMD_BATCH_FINISH command. The response is read with CMD_BATCH_READ_CHUNK
+// like a program.
+static void handle_batch_finish(void) {
+    if (g_transfer_state.state != TRANSFER_STATE_BATCH_WRITING) {
+        ESP_LOGE(TAG, "BATCH_FINISH received but not in batch writing state");
+        send_response(RESP_ERROR);
+        return;
+    }
+
+    if (g_transfer_state.batch_received != g_transfer_state.batch_length) {
+        ESP_LOGE(TAG,
+                 "Batch incomplete: received %lu, expected %lu",
+                 (unsigned long)g_transfer_state.batch_received,
+                 (unsigned long)g_transfer_state.batch_length);
+        g_transfer_state.state = TRANSFER_STATE_ERROR;
+        send_response(RESP_ERROR);
+        return;
+    }
+
+    uint8_t *response = &g_batch_buffer[CONFIG_BATCH_MAX_SIZE];
+    size_t response_length;
+    if (!config_batch_run(g_batch_buffer,
+                          g_transfer_state.batch_length,
+                          response,
+                          CONFIG_BATCH_MAX_SIZE,
+                          &response_length)) {
+        g_transfer_state.state = TRANSFER_STATE_IDLE;
+        send_response(RESP_ERROR);
+        return;
+    }
+
+    g_transfer_state.state = TRANSFER_STATE_READING;
+    g_transfer_state.total_program_size = response_length;
+    g_transfer_state.program_bytes_read = 0;
+    g_transfer_state.program_data = response;
+
+    uint8_t size_data[4];
+    bu_write_u32_le(size_data, sizeof(size_data), response_length);
+    send_response_with_data(RESP_OK, size_data, sizeof(size_data));
+}
+
 void usb_system_config_process_command(const uint8_t *data, uint16_t len) {
     // Validate input
     if (data == NULL || len == 0 || len > 64) {
@@ -1150,6 +1728,11 @@ static void process_command_internal(const uint8_t *data, uint16_t len) {
 
     uint8_t command = data[0];  // Command code is currently only on the first byte
 
+    // A program read session ends when any other session replaces it
+    if (g_transfer_state.state != TRANSFER_STATE_READING) {
+        program_release(&g_transfer_state.program_ref);
+    }
+
     switch (command) {
     case CMD_FLASH_PROGRAM_WRITE_START:
         if (len < 8)  // Need command code + 4 bytes for program size
@@ -1209,6 +1792,16 @@ static void process_command_internal(const uint8_t *data, uint16_t len) {
         handle_flash_program_execute();
         break;
 
+    case CMD_FLASH_PROGRAM_SELECT:
+        if (len < 8)  // Need command code + 4 bytes for program id
+        {
+            ESP_LOGE(TAG, "FLASH_PROGRAM_SELECT command too short");
+            send_response(RESP_ERROR);
+            return;
+        }
+        handle_flash_program_select(data, len);
+        break;
+
     case CMD_RAM_PROGRAM_WRITE_START:
         if (len < 8)  // Need command code + 4 bytes for program size
         {
@@ -1260,6 +1853,43 @@ static void process_command_internal(const uint8_t *data, uint16_t len) {
         handle_ram_program_execute();
         break;
 
+    case CMD_FLASH_PROGRAM_STREAM_START:
+    case CMD_RAM_PROGRAM_STREAM_START:
+        if (len < 12)  // Need command code + program size(4) + CRC(4)
+        {
+            ESP_LOGE(TAG, "PROGRAM_STREAM_START command too short");
+            send_response(RESP_ERROR);
+            return;
+        } else {
+            uint32_t program_size, crc;
+            if (!bu_read_u32_le(&data[4], len - 4, &program_size) ||
+                !bu_read_u32_le(&data[8], len - 8, &crc)) {
+                ESP_LOGE(TAG, "Failed to read stream parameters");
+                send_response(RESP_ERROR);
+                return;
+            }
+            handle_program_stream_start(command == CMD_FLASH_PROGRAM_STREAM_START
+                                            ? PROGRAM_TYPE_FLASH
+                                            : PROGRAM_TYPE_RAM,
+                                        program_size,
+                                        crc);
+        }
+        break;
+
+    case CMD_PROGRAM_STREAM_CHUNK:
+        if (len != 64)  // Must be exactly 64 bytes
+        {
+            ESP_LOGE(TAG, "PROGRAM_STREAM_CHUNK must be exactly 64 bytes, got %d", len);
+            send_response(RESP_ERROR);
+            return;
+        } else {
+            // Sequence number is 24-bit little-endian in bytes 1-3
+            uint32_t seq = (uint32_t)data[1] | ((uint32_t)data[2] << 8) |
+                           ((uint32_t)data[3] << 16);
+            handle_program_stream_chunk(seq, &data[4], 60);
+        }
+        break;
+
     case CMD_RAM_PROGRAM_READ_START:
         handle_ram_program_read_start();
         break;
@@ -1313,8 +1943,31 @@ static void process_command_internal(const uint8_t *data, uint16_t len) {
         }
         break;
 
+    case CMD_BATCH_START:
+        if (len < 8)  // Need command code + length(4) = 8 bytes
+        {
+            ESP_LOGE(TAG, "BATCH_START command too short");
+            send_response(RESP_ERROR);
+            return;
+        } else {
+            handle_batch_start(data);
+        }
+        break;
+
+    case CMD_BATCH_DATA:
+        handle_batch_data(data);
+        break;
+
+    case CMD_BATCH_FINISH:
+        handle_batch_finish();
+        break;
+
+    case CMD_BATCH_READ_CHUNK:
+        handle_program_read_chunk();
+        break;
+
     case CMD_LOG_READ_START:
-        handle_log_read_start();
+        handle_log_read_start(data, len);
         break;
 
     case CMD_LOG_READ_CHUNK:
@@ -1325,6 +1978,31 @@ static void process_command_internal(const uint8_t *data, uint16_t len) {
         handle_log_clear();
         break;
 
+    case CMD_STATS_READ:
+        if (len < 5) {
+            ESP_LOGE(TAG, "STATS_READ command too short");
+            send_response(RESP_ERROR);
+            return;
+        }
+        handle_stats_read(data);
+        break;
+
+    case CMD_STATS_RESET:
+        handle_stats_reset();
+        break;
+
+    case CMD_PROFILE_READ_START:
+        handle_profile_read_start();
+        break;
+
+    case CMD_PROFILE_READ_CHUNK:
+        handle_program_read_chunk();
+        break;
+
+    case CMD_PROFILE_RESET:
+        handle_profile_reset();
+        break;
+
     default:
         ESP_LOGW(TAG, "Unknown command: 0x%02X", command);
         send_response(RESP_ERROR);
@@ -1,68 +1,397 @@
 #include "vm_task.h"
+#include <string.h>
+#include "buffer_utils.h"
+#include "esp_heap_caps.h"
 #include "esp_log.h"
+#include "esp_rom_crc.h"
+#include "esp_rom_sys.h"
+#include "esp_timer.h"
 #include "freertos/FreeRTOS.h"
-#include "freertos/queue.h"
 #include "freertos/semphr.h"
 #include "freertos/task.h"
+#include "latency_stats.h"
+#include "nvs_config.h"
+#include "nvs_odkey.h"
 #include "odkeyscript_vm.h"
 
 static const char *TAG = "vm_task";
 
 #define VM_TASK_STACK_SIZE 4096
 #define VM_TASK_PRIORITY 5
-
-// VM task state
-typedef enum { VM_TASK_STATE_IDLE, VM_TASK_STATE_RUNNING } vm_task_state_t;
+#define VM_TASK_DECODE_CACHE_MAX_SIZE (512 * 1024)
+#define VM_TASK_QUEUE_DEPTH 8  // Runs waiting behind the running program
+
+// Deadlines closer than this are busy-waited instead of sleeping on the timer
+#define VM_TASK_SPIN_THRESHOLD_US 200
+// If execution falls further behind schedule than this, resynchronize to now
+#define VM_TASK_MAX_LATENESS_US (100 * 1000)
+// How far ahead of real time the VM interprets and schedules reports
+#define VM_TASK_LOOKAHEAD_US (50 * 1000)
+// Longest a streaming program waits for data before checking for a halt request
+#define VM_TASK_STREAM_WAIT_MS 10
+
+// Profile image layout (see vm_task_get_profile_image())
+#define VM_TASK_PROFILE_MAGIC "ODKP"
+#define VM_TASK_PROFILE_VERSION 1
+#define VM_TASK_PROFILE_HEADER_SIZE 60
+#define VM_TASK_PROFILE_OPCODE_SIZE 12  // count(4) cycles(8)
+#define VM_TASK_PROFILE_PC_SIZE 16      // pc(4) hits(4) waits(4) wait_error_max_us(4)
+
+_Static_assert(VM_TASK_PROFILE_HEADER_SIZE +
+                       VM_PROFILE_OPCODE_SLOTS * VM_TASK_PROFILE_OPCODE_SIZE +
+                       VM_PROFILE_PC_SLOTS * VM_TASK_PROFILE_PC_SIZE <=
+                   VM_TASK_PROFILE_IMAGE_MAX_SIZE,
+               "VM_TASK_PROFILE_IMAGE_MAX_SIZE is too small");
 
 // Program start request structure
 typedef struct {
     const uint8_t *program;
     uint32_t program_size;
+    bool cacheable;         // Use the decoded program cache
+    uint32_t program_hash;  // Cache key (valid when cacheable)
+    vm_stream_wait_callback_t stream_wait_callback;  // Non-NULL when streaming
+    vm_program_release_callback_t release_callback;  // Called when done with program
+    void *program_arg;  // Passed to stream_wait_callback and release_callback
+    vm_verification_t *verification;  // Verification kept with the program, or NULL
+    vm_run_priority_t priority;
     vm_execution_complete_callback_t completion_callback;
     void *completion_callback_arg;
 } vm_program_request_t;
 
 // Global state
 static TaskHandle_t g_vm_task_handle = NULL;
-static QueueHandle_t g_program_queue = NULL;
 static SemaphoreHandle_t g_state_mutex = NULL;
-static EventGroupHandle_t g_halt_event_group = NULL;
-static vm_task_state_t g_task_state = VM_TASK_STATE_IDLE;
+static EventGroupHandle_t g_halt_event_group = NULL;  // Halt, timing and state bits
+static esp_timer_handle_t g_deadline_timer = NULL;
+static int64_t g_deadline_us = 0;  // Program time: deadline of the next report
+
+// Run queue (protected by g_state_mutex), ordered by priority and then by arrival
+static vm_program_request_t g_run_queue[VM_TASK_QUEUE_DEPTH];
+static uint32_t g_run_queue_length = 0;
+static vm_run_priority_t g_running_priority = VM_RUN_PRIORITY_NORMAL;
+static bool g_preempt_requested = false;  // HALT_BIT was set to run a queued program
 static vm_hid_send_callback_t g_hid_send_callback = NULL;
+static vm_hid_cancel_callback_t g_hid_cancel_callback = NULL;
+static vm_stream_wait_callback_t g_stream_wait_callback = NULL;
+static void *g_stream_wait_arg = NULL;
 
 // VM context (owned by VM task)
 static vm_context_t g_vm_context;
 
-// Event group bits
+// Decoded program cache (owned by VM task)
+static vm_decoded_program_t g_decode_cache = {0};
+static uint32_t g_uncacheable_hash = 0;  // Last hash that was too large to decode
+static bool g_uncacheable_hash_valid = false;
+
+// Verification of the last cacheable program that ran from bytecode (too large to
+// decode, or profiled), keyed like the decode cache
+static vm_verification_t g_bytecode_verification = {0};
+static uint32_t g_bytecode_verification_hash = 0;
+static uint32_t g_bytecode_verification_size = 0;
+
+// Profile, allocated when profiling is first enabled. The VM task only touches it
+// while RUNNING_BIT is set; other tasks only touch it with g_state_mutex held while
+// RUNNING_BIT is clear.
+static vm_profile_t *g_profile = NULL;
+static uint32_t g_profile_runs = 0;          // Runs added to the profile
+static uint32_t g_profile_program_hash = 0;  // Program the profile belongs to
+static uint32_t g_profile_program_size = 0;
+static bool g_profile_reset_pending = false;  // Reset requested during a run
+
+// Event group bits. The state bits are only changed with g_state_mutex held, so
+// they can be read without it.
 #define HALT_BIT (1 << 0)
+#define DEADLINE_BIT (1 << 1)
+#define RUNNING_BIT (1 << 2)   // A program is running
+#define IDLE_BIT (1 << 3)      // No program is running or queued
+#define FINISHED_BIT (1 << 4)  // Set when a run ends; cleared by vm_task_halt()
+
+// esp_timer callback - wakes the VM task when the current deadline is reached
+static void deadline_timer_callback(void *arg) {
+    (void)arg;
+    xEventGroupSetBits(g_halt_event_group, DEADLINE_BIT);
+}
 
-// Delay callback for VM - interruptible by halt request
-static void delay_callback(uint16_t ms) {
-    // Wait for either the delay time or a halt signal
-    EventBits_t bits =
+// Sleep until an absolute esp_timer time - interruptible by halt request
+static void wait_until(int64_t target_us) {
+    int64_t remaining_us = target_us - esp_timer_get_time();
+    if (remaining_us <= 0) {
+        return;
+    }
+
+    if (remaining_us < VM_TASK_SPIN_THRESHOLD_US) {
+        esp_rom_delay_us((uint32_t)remaining_us);
+        return;
+    }
+
+    // Wait for either the deadline timer or a halt signal
+    xEventGroupClearBits(g_halt_event_group, DEADLINE_BIT);
+    if (esp_timer_start_once(g_deadline_timer, (uint64_t)remaining_us) != ESP_OK) {
+        // Fall back to a tick-based wait
         xEventGroupWaitBits(g_halt_event_group,
                             HALT_BIT,
-                            pdFALSE,  // Don't clear the bit when we get it
+                            pdFALSE,
+                            pdFALSE,
+                            pdMS_TO_TICKS(remaining_us / 1000) + 1);
+        return;
+    }
+
+    EventBits_t bits =
+        xEventGroupWaitBits(g_halt_event_group,
+                            HALT_BIT | DEADLINE_BIT,
+                            pdFALSE,  // Don't clear the bits when we get them
                             pdFALSE,  // Wait for any bit (not all bits)
-                            pdMS_TO_TICKS(ms));
+                            pdMS_TO_TICKS(remaining_us / 1000) + 2);
 
     // If we got the halt bit, we were interrupted
     if (bits & HALT_BIT) {
+        esp_timer_stop(g_deadline_timer);
         ESP_LOGD(TAG, "Delay interrupted by halt request");
     }
 }
 
+// HID callback for VM - schedules the report at the current program time
+static bool hid_callback(uint8_t modifier, const uint8_t *keys, uint8_t count) {
+    return g_hid_send_callback(g_deadline_us, modifier, keys, count);
+}
+
+// Record how far past the deadline of a WAIT the VM resumed when profiling. The VM
+// normally resumes VM_TASK_LOOKAHEAD_US early; a positive error means reports after
+// the WAIT were scheduled late.
+static void record_wait_error(int64_t resume_us) {
+    if (g_vm_context.profile == NULL) {
+        return;
+    }
+
+    int64_t error_us = resume_us - g_deadline_us;
+    if (error_us > INT32_MAX) {
+        error_us = INT32_MAX;
+    } else if (error_us < INT32_MIN) {
+        error_us = INT32_MIN;
+    }
+    vm_profile_wait_error(&g_vm_context, (int32_t)error_us);
+}
+
+// Delay callback for VM - interruptible by halt request
+//
+// Delays advance an absolute program clock by exactly the requested time, and every
+// report is scheduled at the current program time, so time spent interpreting between
+// waits never accumulates. The VM only sleeps to stay within VM_TASK_LOOKAHEAD_US of
+// real time; the keyboard task sends each report when its deadline arrives.
+static void delay_callback(uint16_t ms) {
+    g_deadline_us += (int64_t)ms * 1000;
+
+    int64_t now_us = esp_timer_get_time();
+    if (g_deadline_us < now_us - VM_TASK_MAX_LATENESS_US) {
+        // Too far behind (e.g. host stopped polling); don't burst to catch up
+        ESP_LOGD(TAG,
+                 "Behind schedule by %lld us, resynchronizing",
+                 (long long)(now_us - g_deadline_us));
+        record_wait_error(now_us);
+        g_deadline_us = now_us;
+        return;
+    }
+
+    wait_until(g_deadline_us - VM_TASK_LOOKAHEAD_US);
+    record_wait_error(esp_timer_get_time());
+}
+
 // Helper function to check halt request
 static bool halt_requested(void) {
     EventBits_t bits = xEventGroupGetBits(g_halt_event_group);
     return (bits & HALT_BIT) != 0;
 }
 
-// Helper function to set task state
-static void set_task_state(vm_task_state_t state) {
+// Stream callback for VM - waits for program data, interruptible by halt request
+static bool stream_callback(uint32_t needed, uint32_t *available) {
+    bool stalled = false;
+    while (!halt_requested()) {
+        if (!g_stream_wait_callback(
+                g_stream_wait_arg, needed, available, VM_TASK_STREAM_WAIT_MS)) {
+            return false;
+        }
+        if (*available >= needed) {
+            break;
+        }
+        if (!stalled) {
+            ESP_LOGD(TAG,
+                     "Waiting for program data (%lu of %lu bytes)",
+                     (unsigned long)*available,
+                     (unsigned long)needed);
+            stalled = true;
+        }
+    }
+
+    // Time spent waiting for data must not be made up by bursting reports
+    if (stalled && g_deadline_us < esp_timer_get_time()) {
+        g_deadline_us = esp_timer_get_time();
+    }
+    return true;
+}
+
+// Helper function to check whether a run is in progress (g_state_mutex held)
+static bool run_in_progress(void) {
+    return (xEventGroupGetBits(g_halt_event_group) & RUNNING_BIT) != 0;
+}
+
+// Take the next request off the run queue and mark it running. Clearing the halt
+// bits under the mutex orders this against vm_task_halt(), so a halt issued while
+// the queue is being popped either empties the queue first or stops this run.
+static bool pop_run_request(vm_program_request_t *out_request) {
     xSemaphoreTake(g_state_mutex, portMAX_DELAY);
-    g_task_state = state;
+    if (g_run_queue_length == 0) {
+        xSemaphoreGive(g_state_mutex);
+        return false;
+    }
+
+    *out_request = g_run_queue[0];
+    g_run_queue_length--;
+    memmove(&g_run_queue[0],
+            &g_run_queue[1],
+            g_run_queue_length * sizeof(vm_program_request_t));
+
+    xEventGroupClearBits(g_halt_event_group, HALT_BIT | DEADLINE_BIT);
+    g_preempt_requested = false;
+    g_running_priority = out_request->priority;
+    xEventGroupSetBits(g_halt_event_group, RUNNING_BIT);
     xSemaphoreGive(g_state_mutex);
+    return true;
+}
+
+// Hand a request's program back to its owner
+static void release_program(const vm_program_request_t *request) {
+    if (request->release_callback != NULL) {
+        request->release_callback(request->program_arg);
+    }
+}
+
+// Mark the current run as ended, waking anyone waiting for it to stop
+static void finish_run(void) {
+    xSemaphoreTake(g_state_mutex, portMAX_DELAY);
+    xEventGroupClearBits(g_halt_event_group, RUNNING_BIT);
+    xEventGroupSetBits(g_halt_event_group,
+                       FINISHED_BIT | (g_run_queue_length == 0 ? IDLE_BIT : 0));
+    xSemaphoreGive(g_state_mutex);
+}
+
+// Check whether the current run was stopped to make way for a higher-priority one
+static bool take_preempt_request(void) {
+    xSemaphoreTake(g_state_mutex, portMAX_DELAY);
+    bool preempted = g_preempt_requested;
+    g_preempt_requested = false;
+    xSemaphoreGive(g_state_mutex);
+    return preempted;
+}
+
+// Get the profile ready for a run when profiling is enabled, starting it over if the
+// program changed or a reset was requested. Streamed programs aren't profiled.
+static bool prepare_profile(const vm_program_request_t *request) {
+    uint8_t enabled = 0;
+    if (nvs_config_get_u8(NVS_KEY_VM_PROFILE, &enabled) != ESP_OK || enabled == 0 ||
+        request->stream_wait_callback != NULL) {
+        return false;
+    }
+
+    if (g_profile == NULL) {
+        g_profile = heap_caps_calloc(1, sizeof(vm_profile_t), MALLOC_CAP_SPIRAM);
+        if (g_profile == NULL) {
+            ESP_LOGE(TAG, "Failed to allocate profile");
+            return false;
+        }
+    }
+
+    uint32_t hash = request->cacheable
+                        ? request->program_hash
+                        : esp_rom_crc32_le(0, request->program, request->program_size);
+
+    xSemaphoreTake(g_state_mutex, portMAX_DELAY);
+    bool reset = g_profile_reset_pending;
+    g_profile_reset_pending = false;
+    xSemaphoreGive(g_state_mutex);
+
+    if (reset || g_profile_runs == 0 || g_profile_program_hash != hash ||
+        g_profile_program_size != request->program_size) {
+        vm_profile_reset(g_profile);
+        g_profile_runs = 0;
+        g_profile_program_hash = hash;
+        g_profile_program_size = request->program_size;
+    }
+    return true;
+}
+
+// Helper function to start the VM, decoding into the cache when requested. Profiled
+// runs execute from bytecode so that PCs are program offsets.
+static vm_error_t start_vm(const vm_program_request_t *request, bool profiling) {
+    if (request->stream_wait_callback != NULL) {
+        g_stream_wait_callback = request->stream_wait_callback;
+        g_stream_wait_arg = request->program_arg;
+        return vm_start_streaming(&g_vm_context,
+                                  request->program,
+                                  request->program_size,
+                                  hid_callback,
+                                  delay_callback,
+                                  stream_callback);
+    }
+
+    if (request->cacheable && !profiling) {
+        bool cache_hit = g_decode_cache.instructions != NULL &&
+                         g_decode_cache.program_hash == request->program_hash &&
+                         g_decode_cache.program_size == request->program_size;
+        bool uncacheable =
+            g_uncacheable_hash_valid && g_uncacheable_hash == request->program_hash;
+
+        if (cache_hit) {
+            ESP_LOGI(TAG,
+                     "Using cached decoded program (hash: 0x%08lX)",
+                     (unsigned long)request->program_hash);
+        } else if (!uncacheable) {
+            vm_decoded_free(&g_decode_cache);
+            vm_error_t result = vm_decode(request->program,
+                                          request->program_size,
+                                          request->program_hash,
+                                          VM_TASK_DECODE_CACHE_MAX_SIZE,
+                                          &g_decode_cache);
+            if (result == VM_ERROR_OUT_OF_MEMORY) {
+                g_uncacheable_hash = request->program_hash;
+                g_uncacheable_hash_valid = true;
+            }
+            if (result != VM_ERROR_NONE) {
+                ESP_LOGW(TAG,
+                         "Program not cached (%s), executing from bytecode",
+                         vm_error_to_string(result));
+            }
+        }
+
+        if (g_decode_cache.instructions != NULL && !uncacheable) {
+            return vm_start_decoded(
+                &g_vm_context, &g_decode_cache, hid_callback, delay_callback);
+        }
+    }
+
+    // Programs are only verified on their first run from bytecode
+    vm_verification_t *verification = request->verification;
+    if (request->cacheable) {
+        if (g_bytecode_verification_hash != request->program_hash ||
+            g_bytecode_verification_size != request->program_size) {
+            memset(&g_bytecode_verification, 0, sizeof(g_bytecode_verification));
+            g_bytecode_verification_hash = request->program_hash;
+            g_bytecode_verification_size = request->program_size;
+        }
+        verification = &g_bytecode_verification;
+    }
+    if (verification != NULL) {
+        return vm_start_with_verification(&g_vm_context,
+                                          request->program,
+                                          request->program_size,
+                                          verification,
+                                          hid_callback,
+                                          delay_callback);
+    }
+    return vm_start(&g_vm_context,
+                    request->program,
+                    request->program_size,
+                    hid_callback,
+                    delay_callback);
 }
 
 // VM task function
@@ -78,23 +407,27 @@ static void vm_task_function(void *pvParameters) {
     }
 
     for (;;) {
-        if (xQueueReceive(g_program_queue, &request, portMAX_DELAY) != pdTRUE) {
+        if (!pop_run_request(&request)) {
+            ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
             continue;
         }
 
-        xEventGroupClearBits(g_halt_event_group, HALT_BIT);
-        set_task_state(VM_TASK_STATE_RUNNING);
+        latency_stats_mark(LATENCY_POINT_RUN_START);
+        g_deadline_us = esp_timer_get_time();
 
         ESP_LOGI(TAG,
-                 "Starting program execution (%lu bytes)",
-                 (unsigned long)request.program_size);
+                 "Starting program execution (%lu bytes, priority %d)",
+                 (unsigned long)request.program_size,
+                 request.priority);
 
         // Start VM
-        if (vm_start(&g_vm_context,
-                     request.program,
-                     request.program_size,
-                     g_hid_send_callback,
-                     delay_callback) == VM_ERROR_NONE) {
+        bool profiling = prepare_profile(&request);
+        if (start_vm(&request, profiling) == VM_ERROR_NONE) {
+            if (profiling) {
+                vm_set_profile(&g_vm_context, g_profile);
+                g_profile_runs++;
+            }
+
             // Run VM step by step
             vm_error_t result = VM_ERROR_NONE;
             while (vm_running(&g_vm_context) && !halt_requested()) {
@@ -106,8 +439,18 @@ static void vm_task_function(void *pvParameters) {
             }
 
             if (halt_requested()) {
-                ESP_LOGI(TAG, "Program halted by request");
+                // Drop reports scheduled ahead of time and release anything the host
+                // may still be holding
+                g_hid_cancel_callback();
+                g_hid_send_callback(esp_timer_get_time(), 0, NULL, 0);
+                ESP_LOGI(TAG,
+                         "Program %s",
+                         take_preempt_request() ? "preempted by a higher-priority run"
+                                                : "halted by request");
             } else {
+                // Don't report completion until the last scheduled report is due
+                wait_until(g_deadline_us);
+
                 ESP_LOGI(TAG, "Program completed successfully");
                 uint32_t instructions, keys_pressed, keys_released;
                 vm_get_stats(
@@ -123,7 +466,8 @@ static void vm_task_function(void *pvParameters) {
             ESP_LOGE(TAG, "Failed to start VM");
         }
 
-        set_task_state(VM_TASK_STATE_IDLE);
+        finish_run();
+        release_program(&request);
         // Invoke completion callback
         if (request.completion_callback != NULL) {
             request.completion_callback(request.completion_callback_arg);
@@ -131,17 +475,19 @@ static void vm_task_function(void *pvParameters) {
     }
 }
 
-bool vm_task_init(vm_hid_send_callback_t hid_send_callback) {
+bool vm_task_init(vm_hid_send_callback_t hid_send_callback,
+                  vm_hid_cancel_callback_t hid_cancel_callback) {
     if (g_vm_task_handle != NULL) {
         return true;  // Already initialized
     }
 
-    if (hid_send_callback == NULL) {
-        ESP_LOGE(TAG, "HID send callback cannot be NULL");
+    if (hid_send_callback == NULL || hid_cancel_callback == NULL) {
+        ESP_LOGE(TAG, "HID callbacks cannot be NULL");
         return false;
     }
 
     g_hid_send_callback = hid_send_callback;
+    g_hid_cancel_callback = hid_cancel_callback;
 
     // Create mutex for state protection
     g_state_mutex = xSemaphoreCreateMutex();
@@ -157,11 +503,16 @@ bool vm_task_init(vm_hid_send_callback_t hid_send_callback) {
         vSemaphoreDelete(g_state_mutex);
         return false;
     }
-
-    // Create queue for program requests
-    g_program_queue = xQueueCreate(1, sizeof(vm_program_request_t));
-    if (g_program_queue == NULL) {
-        ESP_LOGE(TAG, "Failed to create program queue");
+    xEventGroupSetBits(g_halt_event_group, IDLE_BIT);
+
+    // Create timer for absolute-deadline delays
+    const esp_timer_create_args_t timer_args = {.callback = deadline_timer_callback,
+                                                .arg = NULL,
+                                                .dispatch_method = ESP_TIMER_TASK,
+                                                .name = "vm_deadline"};
+    esp_err_t err = esp_timer_create(&timer_args, &g_deadline_timer);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to create deadline timer: %s", esp_err_to_name(err));
         vEventGroupDelete(g_halt_event_group);
         vSemaphoreDelete(g_state_mutex);
         return false;
@@ -176,7 +527,7 @@ bool vm_task_init(vm_hid_send_callback_t hid_send_callback) {
                                  &g_vm_task_handle);
     if (ret != pdPASS) {
         ESP_LOGE(TAG, "Failed to create VM task");
-        vQueueDelete(g_program_queue);
+        esp_timer_delete(g_deadline_timer);
         vEventGroupDelete(g_halt_event_group);
         vSemaphoreDelete(g_state_mutex);
         return false;
@@ -186,41 +537,136 @@ bool vm_task_init(vm_hid_send_callback_t hid_send_callback) {
     return true;
 }
 
-bool vm_task_start_program(const uint8_t *program,
-                           uint32_t program_size,
-                           vm_execution_complete_callback_t completion_callback,
-                           void *completion_callback_arg) {
+// Helper function to validate and queue a program start request. Requests run in
+// priority order, first come first served within a priority; one that outranks the
+// running program preempts it.
+static bool queue_program_request(const vm_program_request_t *request,
+                                  uint32_t *out_position) {
     if (g_vm_task_handle == NULL) {
         ESP_LOGE(TAG, "VM task not initialized");
         return false;
     }
 
-    if (program == NULL || program_size == 0) {
+    if (request->program == NULL || request->program_size == 0 ||
+        request->priority < VM_RUN_PRIORITY_LOW ||
+        request->priority > VM_RUN_PRIORITY_HIGH) {
         ESP_LOGE(TAG, "Invalid program parameters");
         return false;
     }
 
-    // Check if already running
-    if (vm_task_is_running()) {
-        ESP_LOGW(TAG, "Program already running, ignoring start request");
+    xSemaphoreTake(g_state_mutex, portMAX_DELAY);
+    if (g_run_queue_length >= VM_TASK_QUEUE_DEPTH) {
+        xSemaphoreGive(g_state_mutex);
+        ESP_LOGW(TAG, "Run queue full, ignoring start request");
         return false;
     }
 
-    // Prepare request
+    uint32_t index = 0;
+    while (index < g_run_queue_length &&
+           g_run_queue[index].priority >= request->priority) {
+        index++;
+    }
+    memmove(&g_run_queue[index + 1],
+            &g_run_queue[index],
+            (g_run_queue_length - index) * sizeof(vm_program_request_t));
+    g_run_queue[index] = *request;
+    g_run_queue_length++;
+    xEventGroupClearBits(g_halt_event_group, IDLE_BIT);
+
+    bool running = run_in_progress();
+    bool preempt = running && index == 0 && request->priority > g_running_priority;
+    if (preempt && !g_preempt_requested) {
+        g_preempt_requested = true;
+        xEventGroupSetBits(g_halt_event_group, HALT_BIT);
+    }
+    uint32_t position = index + ((running && !g_preempt_requested) ? 1 : 0);
+    xSemaphoreGive(g_state_mutex);
+
+    xTaskNotifyGive(g_vm_task_handle);
+
+    ESP_LOGI(TAG,
+             "Program start request queued at position %lu%s",
+             (unsigned long)position,
+             preempt ? ", preempting the running program" : "");
+    if (out_position != NULL) {
+        *out_position = position;
+    }
+    return true;
+}
+
+bool vm_task_start_program(const uint8_t *program,
+                           uint32_t program_size,
+                           vm_program_release_callback_t release_callback,
+                           void *program_arg,
+                           vm_verification_t *verification,
+                           vm_run_priority_t priority,
+                           vm_execution_complete_callback_t completion_callback,
+                           void *completion_callback_arg,
+                           uint32_t *out_position) {
     vm_program_request_t request = {.program = program,
                                     .program_size = program_size,
+                                    .cacheable = false,
+                                    .program_hash = 0,
+                                    .stream_wait_callback = NULL,
+                                    .release_callback = release_callback,
+                                    .program_arg = program_arg,
+                                    .verification = verification,
+                                    .priority = priority,
                                     .completion_callback = completion_callback,
                                     .completion_callback_arg = completion_callback_arg};
+    return queue_program_request(&request, out_position);
+}
 
-    // Send request to queue (non-blocking)
-    BaseType_t ret = xQueueSend(g_program_queue, &request, 0);
-    if (ret != pdTRUE) {
-        ESP_LOGE(TAG, "Failed to queue program start request");
+bool vm_task_start_cached_program(const uint8_t *program,
+                                  uint32_t program_size,
+                                  uint32_t program_hash,
+                                  vm_program_release_callback_t release_callback,
+                                  void *program_arg,
+                                  vm_run_priority_t priority,
+                                  vm_execution_complete_callback_t completion_callback,
+                                  void *completion_callback_arg,
+                                  uint32_t *out_position) {
+    vm_program_request_t request = {.program = program,
+                                    .program_size = program_size,
+                                    .cacheable = true,
+                                    .program_hash = program_hash,
+                                    .stream_wait_callback = NULL,
+                                    .release_callback = release_callback,
+                                    .program_arg = program_arg,
+                                    .verification = NULL,
+                                    .priority = priority,
+                                    .completion_callback = completion_callback,
+                                    .completion_callback_arg = completion_callback_arg};
+    return queue_program_request(&request, out_position);
+}
+
+bool vm_task_start_streaming_program(
+    const uint8_t *program,
+    uint32_t program_size,
+    vm_stream_wait_callback_t stream_wait_callback,
+    vm_program_release_callback_t release_callback,
+    void *program_arg,
+    vm_run_priority_t priority,
+    vm_execution_complete_callback_t completion_callback,
+    void *completion_callback_arg,
+    uint32_t *out_position) {
+    if (stream_wait_callback == NULL) {
+        ESP_LOGE(TAG, "Stream wait callback cannot be NULL");
         return false;
     }
 
-    ESP_LOGI(TAG, "Program start request queued");
-    return true;
+    vm_program_request_t request = {.program = program,
+                                    .program_size = program_size,
+                                    .cacheable = false,
+                                    .program_hash = 0,
+                                    .stream_wait_callback = stream_wait_callback,
+                                    .release_callback = release_callback,
+                                    .program_arg = program_arg,
+                                    .verification = NULL,
+                                    .priority = priority,
+                                    .completion_callback = completion_callback,
+                                    .completion_callback_arg = completion_callback_arg};
+    return queue_program_request(&request, out_position);
 }
 
 bool vm_task_is_running(void) {
@@ -228,11 +674,37 @@ bool vm_task_is_running(void) {
         return false;
     }
 
+    return (xEventGroupGetBits(g_halt_event_group) & RUNNING_BIT) != 0;
+}
+
+bool vm_task_is_busy(void) {
+    if (g_vm_task_handle == NULL) {
+        return false;
+    }
+
+    return (xEventGroupGetBits(g_halt_event_group) & IDLE_BIT) == 0;
+}
+
+bool vm_task_wait_idle(uint32_t timeout_ms) {
+    if (g_vm_task_handle == NULL) {
+        return true;
+    }
+
+    EventBits_t bits = xEventGroupWaitBits(
+        g_halt_event_group, IDLE_BIT, pdFALSE, pdFALSE, pdMS_TO_TICKS(timeout_ms));
+    return (bits & IDLE_BIT) != 0;
+}
+
+uint32_t vm_task_get_queue_length(void) {
+    if (g_vm_task_handle == NULL) {
+        return 0;
+    }
+
     xSemaphoreTake(g_state_mutex, portMAX_DELAY);
-    bool running = (g_task_state == VM_TASK_STATE_RUNNING);
+    uint32_t length = g_run_queue_length;
     xSemaphoreGive(g_state_mutex);
 
-    return running;
+    return length;
 }
 
 bool vm_task_halt(void) {
@@ -240,14 +712,116 @@ bool vm_task_halt(void) {
         return true;
     }
 
-    // Signal halt via event group
-    xEventGroupSetBits(g_halt_event_group, HALT_BIT);
+    // Drop queued runs - their programs may be about to be overwritten - and signal
+    // the running one to halt. Queued runs never start, so their completion
+    // callbacks are not invoked; their programs are released once the mutex is
+    // given back.
+    vm_program_request_t dropped[VM_TASK_QUEUE_DEPTH];
+    xSemaphoreTake(g_state_mutex, portMAX_DELAY);
+    uint32_t dropped_count = g_run_queue_length;
+    if (g_run_queue_length > 0) {
+        ESP_LOGI(TAG, "Dropping %lu queued runs", (unsigned long)g_run_queue_length);
+        memcpy(dropped, g_run_queue, g_run_queue_length * sizeof(vm_program_request_t));
+        g_run_queue_length = 0;
+    }
+    g_preempt_requested = false;
+    bool running = run_in_progress();
+    if (running) {
+        xEventGroupClearBits(g_halt_event_group, FINISHED_BIT);
+        xEventGroupSetBits(g_halt_event_group, HALT_BIT);
+    } else {
+        xEventGroupSetBits(g_halt_event_group, IDLE_BIT);
+    }
+    xSemaphoreGive(g_state_mutex);
+
+    for (uint32_t i = 0; i < dropped_count; i++) {
+        release_program(&dropped[i]);
+    }
 
-    // Wait for task to reach idle state
-    while (vm_task_is_running()) {
-        vTaskDelay(pdMS_TO_TICKS(10));
+    // Wait for the halted run to end; it stops within one VM step
+    if (running) {
+        xEventGroupWaitBits(
+            g_halt_event_group, FINISHED_BIT, pdFALSE, pdFALSE, portMAX_DELAY);
     }
 
     ESP_LOGI(TAG, "Program halted");
     return true;
 }
+
+size_t vm_task_get_profile_image(uint8_t *buffer, size_t buffer_size) {
+    if (g_vm_task_handle == NULL || buffer == NULL) {
+        return 0;
+    }
+
+    xSemaphoreTake(g_state_mutex, portMAX_DELAY);
+    if (g_profile == NULL || run_in_progress()) {
+        xSemaphoreGive(g_state_mutex);
+        return 0;
+    }
+
+    const vm_profile_t *profile = g_profile;
+    size_t image_size = VM_TASK_PROFILE_HEADER_SIZE +
+                        VM_PROFILE_OPCODE_SLOTS * VM_TASK_PROFILE_OPCODE_SIZE +
+                        profile->pc_entries * VM_TASK_PROFILE_PC_SIZE;
+    if (buffer_size < image_size) {
+        xSemaphoreGive(g_state_mutex);
+        return 0;
+    }
+
+    memcpy(buffer, VM_TASK_PROFILE_MAGIC, 4);
+    buffer[4] = VM_TASK_PROFILE_VERSION;
+    buffer[5] = VM_PROFILE_OPCODE_BASE;
+    buffer[6] = VM_PROFILE_OPCODE_SLOTS;
+    buffer[7] = 0;
+    bu_write_u32_le(&buffer[8], 4, g_profile_program_hash);
+    bu_write_u32_le(&buffer[12], 4, g_profile_program_size);
+    bu_write_u32_le(&buffer[16], 4, g_profile_runs);
+    bu_write_u32_le(&buffer[20], 4, profile->instructions);
+    bu_write_u32_le(&buffer[24], 4, esp_rom_get_cpu_ticks_per_us());
+    bu_write_u32_le(&buffer[28], 4, VM_PROFILE_PC_SAMPLE_PERIOD);
+    bu_write_u32_le(&buffer[32], 4, profile->pc_dropped);
+    bu_write_u32_le(&buffer[36], 4, profile->wait_count);
+    bu_write_u32_le(&buffer[40], 4, (uint32_t)profile->wait_error_min_us);
+    bu_write_u32_le(&buffer[44], 4, (uint32_t)profile->wait_error_max_us);
+    bu_write_u32_le(&buffer[48], 4, (uint32_t)profile->wait_error_sum_us);
+    bu_write_u32_le(&buffer[52], 4, (uint32_t)(profile->wait_error_sum_us >> 32));
+    bu_write_u32_le(&buffer[56], 4, profile->pc_entries);
+
+    uint8_t *out = &buffer[VM_TASK_PROFILE_HEADER_SIZE];
+    for (uint32_t i = 0; i < VM_PROFILE_OPCODE_SLOTS; i++) {
+        const vm_profile_opcode_t *counter = &profile->opcodes[i];
+        bu_write_u32_le(&out[0], 4, counter->count);
+        bu_write_u32_le(&out[4], 4, (uint32_t)counter->cycles);
+        bu_write_u32_le(&out[8], 4, (uint32_t)(counter->cycles >> 32));
+        out += VM_TASK_PROFILE_OPCODE_SIZE;
+    }
+    for (uint32_t i = 0; i < VM_PROFILE_PC_SLOTS; i++) {
+        const vm_profile_pc_t *entry = &profile->pcs[i];
+        if (entry->hits == 0 && entry->waits == 0) {
+            continue;
+        }
+        bu_write_u32_le(&out[0], 4, entry->pc);
+        bu_write_u32_le(&out[4], 4, entry->hits);
+        bu_write_u32_le(&out[8], 4, entry->waits);
+        bu_write_u32_le(&out[12], 4, (uint32_t)entry->wait_error_max_us);
+        out += VM_TASK_PROFILE_PC_SIZE;
+    }
+    xSemaphoreGive(g_state_mutex);
+
+    return image_size;
+}
+
+void vm_task_reset_profile(void) {
+    if (g_vm_task_handle == NULL) {
+        return;
+    }
+
+    xSemaphoreTake(g_state_mutex, portMAX_DELAY);
+    if (run_in_progress()) {
+        g_profile_reset_pending = true;
+    } else if (g_profile != NULL) {
+        vm_profile_reset(g_profile);
+        g_profile_runs = 0;
+    }
+    xSemaphoreGive(g_state_mutex);
+}
@@ -4,50 +4,172 @@
 #include <stdbool.h>
 #include <stddef.h>
 #include <stdint.h>
+#include "odkeyscript_vm.h"
 
 #ifdef __cplusplus
 extern "C" {
 #endif
 
+// Largest image vm_task_get_profile_image() produces (full opcode and PC tables)
+#define VM_TASK_PROFILE_IMAGE_MAX_SIZE 4540
+
 /**
- * @brief Callback function type for sending HID keyboard reports.
+ * @brief Callback function type for scheduling HID keyboard reports.
+ * @param deadline_us esp_timer_get_time() value at which the report should be sent
  * @param modifier Modifier key to send (or 0 to release all modifiers)
  * @param keys Array of keycodes to send (can be NULL to release all keys)
- * @param count Number of keycodes in the array (0-6, more than 6 will be truncated)
+ * @param count Number of keycodes in the array (0-16)
  * @return true on success, false on failure
+ * @note The VM task runs ahead of real time, so reports are scheduled before their
+ * deadline. Deadlines never decrease.
  */
-typedef bool (*vm_hid_send_callback_t)(uint8_t modifier,
+typedef bool (*vm_hid_send_callback_t)(int64_t deadline_us,
+                                       uint8_t modifier,
                                        const uint8_t *keys,
                                        uint8_t count);
 
+/**
+ * @brief Callback function type for discarding scheduled HID reports not yet sent
+ */
+typedef void (*vm_hid_cancel_callback_t)(void);
+
 /**
  * @brief Callback function type for program execution completion
  * @param arg Optional argument passed to the callback
  */
 typedef void (*vm_execution_complete_callback_t)(void *arg);
 
+/**
+ * @brief Callback function type for releasing a program the VM task is done with
+ * @param arg Program argument given with the start request
+ * @note Called once for every queued start request: when its run ends, or when it
+ * is dropped from the queue without running. It is called before the completion
+ * callback.
+ */
+typedef void (*vm_program_release_callback_t)(void *arg);
+
+/**
+ * @brief Callback function type for waiting on a streaming program's data
+ * @param arg Program argument given with the start request
+ * @param needed Number of program bytes, from the start, to wait for
+ * @param available Output: number of program bytes written so far
+ * @param timeout_ms Maximum time to wait
+ * @return false if the stream failed and will never reach needed bytes; true
+ * otherwise, including on timeout
+ */
+typedef bool (*vm_stream_wait_callback_t)(void *arg,
+                                          uint32_t needed,
+                                          uint32_t *available,
+                                          uint32_t timeout_ms);
+
+/**
+ * @brief Run priority of a program start request
+ * @note Queued requests run highest priority first, in arrival order within a
+ * priority. A request that outranks the running program preempts it.
+ */
+typedef enum {
+    VM_RUN_PRIORITY_LOW,
+    VM_RUN_PRIORITY_NORMAL,
+    VM_RUN_PRIORITY_HIGH,
+} vm_run_priority_t;
+
 /**
  * @brief Initialize the VM task module
- * @param hid_send_callback Callback function for sending HID keyboard reports
+ * @param hid_send_callback Callback function for scheduling HID keyboard reports
+ * @param hid_cancel_callback Callback function for discarding scheduled reports on halt
  * @return true on success, false on failure
  */
-bool vm_task_init(vm_hid_send_callback_t hid_send_callback);
+bool vm_task_init(vm_hid_send_callback_t hid_send_callback,
+                  vm_hid_cancel_callback_t hid_cancel_callback);
 
 /**
- * @brief Start a program execution in the VM task
- * @param program Pointer to program bytecode (must remain valid during execution)
+ * @brief Queue a program execution in the VM task
+ * @param program Pointer to program bytecode (must remain valid until released)
  * @param program_size Size of program in bytes
+ * @param release_callback Optional callback invoked once the program is no longer
+ * needed
+ * @param program_arg Argument passed to the release callback
+ * @param verification Optional verification result kept with the program (must
+ * remain valid until released). The first run fills it in and later runs start
+ * without verifying the program again.
+ * @param priority Run priority
  * @param completion_callback Optional callback invoked when program execution completes
  * @param completion_callback_arg Optional argument passed to the completion callback
- * @return true if request was queued successfully, false if already running or error
+ * @param out_position Optional output: number of runs that will execute first (0 if
+ * it starts right away)
+ * @return true if request was queued successfully, false if the queue is full or error
  * @note The completion callback is invoked when the program execution completes,
- * regardless of success or failure; however, it is not invoked if the program execution
- * is interrupted by a halt request via vm_task_halt().
+ * regardless of success or failure, including when it is halted or preempted; it is
+ * not invoked for queued runs dropped by vm_task_halt(). A preempted run releases
+ * all keys and is not resumed.
+ * @note If the request is not queued the release callback is not invoked, and the
+ * caller still owns the program.
  */
 bool vm_task_start_program(const uint8_t *program,
                            uint32_t program_size,
+                           vm_program_release_callback_t release_callback,
+                           void *program_arg,
+                           vm_verification_t *verification,
+                           vm_run_priority_t priority,
                            vm_execution_complete_callback_t completion_callback,
-                           void *completion_callback_arg);
+                           void *completion_callback_arg,
+                           uint32_t *out_position);
+
+/**
+ * @brief Queue a program execution in the VM task, using the decoded program cache
+ * @param program Pointer to program bytecode (must remain valid until released)
+ * @param program_size Size of program in bytes
+ * @param program_hash Hash of the program bytecode, used as the cache key
+ * @param release_callback Optional callback invoked once the program is no longer
+ * needed
+ * @param program_arg Argument passed to the release callback
+ * @param priority Run priority
+ * @param completion_callback Optional callback invoked when program execution completes
+ * @param completion_callback_arg Optional argument passed to the completion callback
+ * @param out_position Optional output: number of runs that will execute first
+ * @return true if request was queued successfully, false if the queue is full or error
+ * @note The program is decoded into PSRAM the first time a given hash is run; later
+ * runs with the same hash execute from the cached copy without touching the bytecode.
+ * Programs whose decoded form does not fit the cache run from bytecode. The cache
+ * holds its own copy, so the bytecode may be released once the run ends.
+ */
+bool vm_task_start_cached_program(const uint8_t *program,
+                                  uint32_t program_size,
+                                  uint32_t program_hash,
+                                  vm_program_release_callback_t release_callback,
+                                  void *program_arg,
+                                  vm_run_priority_t priority,
+                                  vm_execution_complete_callback_t completion_callback,
+                                  void *completion_callback_arg,
+                                  uint32_t *out_position);
+
+/**
+ * @brief Queue executing a program while it is still being written
+ * @param program Pointer to the program buffer (must remain valid until released)
+ * @param program_size Size the program will have once fully written
+ * @param stream_wait_callback Callback used to wait for more of the program
+ * @param release_callback Optional callback invoked once the program is no longer
+ * needed
+ * @param program_arg Argument passed to the stream wait and release callbacks
+ * @param priority Run priority
+ * @param completion_callback Optional callback invoked when program execution completes
+ * @param completion_callback_arg Optional argument passed to the completion callback
+ * @param out_position Optional output: number of runs that will execute first
+ * @return true if request was queued successfully, false if the queue is full or error
+ * @note When execution catches up with the written data the VM task blocks until
+ * more arrives; halt requests still interrupt it. If the write fails, the program
+ * stops with an error.
+ */
+bool vm_task_start_streaming_program(
+    const uint8_t *program,
+    uint32_t program_size,
+    vm_stream_wait_callback_t stream_wait_callback,
+    vm_program_release_callback_t release_callback,
+    void *program_arg,
+    vm_run_priority_t priority,
+    vm_execution_complete_callback_t completion_callback,
+    void *completion_callback_arg,
+    uint32_t *out_position);
 
 /**
  * @brief Check if a program is currently running
@@ -56,11 +178,49 @@ bool vm_task_start_program(const uint8_t *program,
 bool vm_task_is_running(void);
 
 /**
- * @brief Halt the currently running program
- * @note This function blocks until the program has stopped
+ * @brief Check if a program is running or queued
+ * @return true if a program is running or waiting in the run queue
+ */
+bool vm_task_is_busy(void);
+
+/**
+ * @brief Wait until no program is running or queued
+ * @param timeout_ms Maximum time to wait (0 to check without blocking)
+ * @return true if the VM task is idle, false on timeout
+ */
+bool vm_task_wait_idle(uint32_t timeout_ms);
+
+/**
+ * @brief Get the number of runs waiting in the run queue
+ * @return Number of queued runs, not counting the running program
+ */
+uint32_t vm_task_get_queue_length(void);
+
+/**
+ * @brief Halt the currently running program and drop all queued runs
+ * @note This function blocks until the program has stopped, which takes at most one
+ * VM step
  */
 bool vm_task_halt(void);
 
+/**
+ * @brief Serialize the VM profile
+ * @param buffer Buffer to hold the image (VM_TASK_PROFILE_IMAGE_MAX_SIZE always fits)
+ * @param buffer_size Size of the buffer
+ * @return Size of the image, or 0 if no profile has been recorded, a program is
+ * running, or the buffer is too small
+ * @note Runs are profiled while the NVS key vm_profile is nonzero. The profile
+ * covers the runs of one program and starts over when a different program runs.
+ * See the README for the image layout.
+ */
+size_t vm_task_get_profile_image(uint8_t *buffer, size_t buffer_size);
+
+/**
+ * @brief Clear the VM profile
+ * @note If a program is running, the profile is cleared when the next run starts
+ */
+void vm_task_reset_profile(void);
+
 #ifdef __cplusplus
 }
 #endif
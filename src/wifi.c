@@ -4,7 +4,9 @@
 #include "esp_log.h"
 #include "esp_netif.h"
 #include "esp_wifi.h"
+#include "nvs_config.h"
 #include "nvs_odkey.h"
+#include "power.h"
 
 static const char *TAG = "wifi";
 
@@ -43,22 +45,13 @@ static void wifi_event_handler(void *arg,
 
 // Get WiFi credentials from NVS or use defaults
 static bool load_wifi_configuration(struct wifi_config_t *config) {
-    nvs_handle_t nvs_handle;
-    esp_err_t err;
     size_t required_size;
 
     memset(config, 0, sizeof(*config));
 
-    // Try to open NVS
-    err = nvs_open(NVS_NAMESPACE, NVS_READONLY, &nvs_handle);
-    if (err != ESP_OK) {
-        ESP_LOGE(TAG, "Failed to open NVS");
-        return false;
-    }
-
     // Try to get SSID
     required_size = sizeof(config->ssid);
-    err = nvs_get_str(nvs_handle, NVS_KEY_WIFI_SSID, config->ssid, &required_size);
+    esp_err_t err = nvs_config_get_str(NVS_KEY_WIFI_SSID, config->ssid, &required_size);
     if (err == ESP_OK) {
         ESP_LOGI(TAG, "Found SSID in NVS: %s", config->ssid);
     } else {
@@ -68,8 +61,7 @@ static bool load_wifi_configuration(struct wifi_config_t *config) {
 
     // Try to get password
     required_size = sizeof(config->password);
-    err = nvs_get_str(
-        nvs_handle, NVS_KEY_WIFI_PASSWORD, config->password, &required_size);
+    err = nvs_config_get_str(NVS_KEY_WIFI_PASSWORD, config->password, &required_size);
     if (err == ESP_OK) {
         ESP_LOGI(TAG, "Found password in NVS");
     } else {
@@ -77,10 +69,62 @@ static bool load_wifi_configuration(struct wifi_config_t *config) {
         strcpy(config->password, WIFI_PASSWORD_DEFAULT);
     }
 
-    nvs_close(nvs_handle);
     return true;
 }
 
+// Copy the loaded credentials into the station configuration
+static void apply_wifi_credentials(wifi_config_t *wifi_config) {
+    strncpy((char *)wifi_config->sta.ssid,
+            g_wifi_config.ssid,
+            sizeof(wifi_config->sta.ssid) - 1);
+    strncpy((char *)wifi_config->sta.password,
+            g_wifi_config.password,
+            sizeof(wifi_config->sta.password) - 1);
+    wifi_config->sta.ssid[sizeof(wifi_config->sta.ssid) - 1] = '\0';
+    wifi_config->sta.password[sizeof(wifi_config->sta.password) - 1] = '\0';
+}
+
+// Reconnect with changed credentials. The disconnect event handler connects again
+// with the new configuration.
+static void wifi_config_changed(const char *key, void *arg) {
+    (void)key;
+    (void)arg;
+
+    if (!load_wifi_configuration(&g_wifi_config) ||
+        strcmp(g_wifi_config.ssid, "") == 0 ||
+        strcmp(g_wifi_config.password, "") == 0) {
+        ESP_LOGW(TAG, "WiFi SSID or password is empty, keeping the current network");
+        return;
+    }
+
+    wifi_config_t wifi_config;
+    if (esp_wifi_get_config(WIFI_IF_STA, &wifi_config) != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to get WiFi configuration");
+        return;
+    }
+
+    // The SSID and password usually change together and report one change each
+    if (strncmp((const char *)wifi_config.sta.ssid,
+                g_wifi_config.ssid,
+                sizeof(wifi_config.sta.ssid)) == 0 &&
+        strncmp((const char *)wifi_config.sta.password,
+                g_wifi_config.password,
+                sizeof(wifi_config.sta.password)) == 0) {
+        return;
+    }
+
+    memset(wifi_config.sta.ssid, 0, sizeof(wifi_config.sta.ssid));
+    memset(wifi_config.sta.password, 0, sizeof(wifi_config.sta.password));
+    apply_wifi_credentials(&wifi_config);
+    if (esp_wifi_set_config(WIFI_IF_STA, &wifi_config) != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to apply new WiFi credentials");
+        return;
+    }
+
+    ESP_LOGI(TAG, "WiFi credentials changed, reconnecting to %s", g_wifi_config.ssid);
+    esp_wifi_disconnect();
+}
+
 // Initialize WiFi in station mode (without starting)
 static esp_err_t wifi_init_sta(void) {
     esp_netif_create_default_wifi_sta();
@@ -104,18 +148,14 @@ static esp_err_t wifi_init_sta(void) {
     };
 
     // Copy credentials to wifi_config
-    strncpy((char *)wifi_config.sta.ssid,
-            g_wifi_config.ssid,
-            sizeof(wifi_config.sta.ssid) - 1);
-    strncpy((char *)wifi_config.sta.password,
-            g_wifi_config.password,
-            sizeof(wifi_config.sta.password) - 1);
-    wifi_config.sta.ssid[sizeof(wifi_config.sta.ssid) - 1] = '\0';
-    wifi_config.sta.password[sizeof(wifi_config.sta.password) - 1] = '\0';
+    apply_wifi_credentials(&wifi_config);
 
     ESP_ERROR_CHECK(esp_wifi_set_mode(WIFI_MODE_STA));
     ESP_ERROR_CHECK(esp_wifi_set_config(WIFI_IF_STA, &wifi_config));
 
+    // Modem sleep follows the power profile
+    power_apply_wifi_sleep();
+
     ESP_LOGI(TAG, "WiFi station mode initialized for %s", g_wifi_config.ssid);
     return ESP_OK;
 }
@@ -148,6 +188,10 @@ bool wifi_init(void) {
         return false;
     }
 
+    // Switch networks without a reboot
+    nvs_config_add_change_callback(NVS_KEY_WIFI_SSID, wifi_config_changed, NULL);
+    nvs_config_add_change_callback(NVS_KEY_WIFI_PASSWORD, wifi_config_changed, NULL);
+
     ESP_LOGI(TAG, "WiFi module initialized");
     initialized = true;
     return true;
@@ -0,0 +1,73 @@
+#!/usr/bin/env python3
+"""
+Build the VM benchmark sample corpus
+
+Compiles the scripts in odkey_tools/scripts and writes them, plus the compressed
+form of those that compression shrinks, as a C header for the VM benchmarks.
+"""
+
+import argparse
+import sys
+from pathlib import Path
+
+REPO = Path(__file__).resolve().parents[2]
+DEFAULT_OUTPUT = REPO / "test" / "test_vm_benchmark" / "vm_bench_samples.h"
+
+# The compiler package has no dependencies outside the standard library, unlike the
+# rest of odkey_tools, so import it on its own
+sys.path.insert(0, str(REPO / "odkey_tools" / "odkey"))
+from odkeyscript.odkeyscript_compiler import Compiler  # noqa: E402
+
+
+def c_array(name: str, data: bytes) -> str:
+    """Format bytes as a C array definition"""
+    lines = [f"static const uint8_t {name}[] = {{"]
+    for i in range(0, len(data), 12):
+        lines.append("    " + " ".join(f"0x{b:02X}," for b in data[i : i + 12]))
+    lines.append("};")
+    return "\n".join(lines)
+
+
+def main() -> int:
+    parser = argparse.ArgumentParser(description=__doc__)
+    parser.add_argument("--output", type=Path, default=DEFAULT_OUTPUT)
+    args = parser.parse_args()
+
+    samples = []
+    for script in sorted((REPO / "odkey_tools" / "scripts").glob("*.odk")):
+        source = script.read_text()
+        samples.append((script.stem, Compiler().compile(source)))
+        compressed = Compiler(compress=True).compile(source)
+        if compressed != samples[-1][1]:
+            samples.append((f"{script.stem}.lz4", compressed))
+
+    out = [
+        "// Generated from odkey_tools/scripts by test/host/build_corpus.py",
+        "#ifndef VM_BENCH_SAMPLES_H",
+        "#define VM_BENCH_SAMPLES_H",
+        "",
+        "#include <stdint.h>",
+        '#include "vm_bench.h"',
+        "",
+    ]
+    for name, data in samples:
+        out.append(c_array("g_sample_" + name.replace(".", "_"), data))
+        out.append("")
+    out.append("static const vm_bench_program_t g_vm_bench_samples[] = {")
+    for name, _ in samples:
+        array = "g_sample_" + name.replace(".", "_")
+        out.append(f'    {{"{name}", {array}, sizeof({array})}},')
+    out.append("};")
+    out.append("")
+    out.append("#define VM_BENCH_SAMPLE_COUNT \\")
+    out.append("    (sizeof(g_vm_bench_samples) / sizeof(g_vm_bench_samples[0]))")
+    out.append("")
+    out.append("#endif  // VM_BENCH_SAMPLES_H")
+
+    args.output.parent.mkdir(parents=True, exist_ok=True)
+    args.output.write_text("\n".join(out) + "\n")
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,548 @@
+#!/usr/bin/env python3
+"""
+Differential fuzzing of the ODKeyScript compiler and VM
+
+Generates random ODKeyScript programs, compiles each with several compiler options,
+runs the bytecode through the host-built VM (vm_trace) in every execution mode, and
+compares the HID reports it sends, with their times, against a reference model of
+the language. Records compile time and VM throughput for each program size.
+"""
+
+import argparse
+import random
+import subprocess
+import sys
+import tempfile
+import time
+from dataclasses import dataclass, field
+from pathlib import Path
+from typing import Dict, List, Optional, Set, Tuple
+
+REPO = Path(__file__).resolve().parents[2]
+DEFAULT_VM_TRACE = REPO / "build" / "host" / "vm_trace"
+
+# The compiler package has no dependencies outside the standard library, unlike the
+# rest of odkey_tools, so import it on its own
+sys.path.insert(0, str(REPO / "odkey_tools" / "odkey"))
+from odkeyscript.odkeyscript_compiler import CompileError, Compiler  # noqa: E402
+
+# HID usage IDs of the key names the generator uses, written out here rather than
+# taken from the compiler so the model checks its key table too
+KEYS = {
+    **{chr(ord("A") + i): 0x04 + i for i in range(26)},
+    **{str((i + 1) % 10): 0x1E + i for i in range(10)},
+    "ENTER": 0x28,
+    "ESCAPE": 0x29,
+    "TAB": 0x2B,
+    "SPACE": 0x2C,
+    "F1": 0x3A,
+    "F12": 0x45,
+    "RIGHT": 0x4F,
+    "UP": 0x52,
+    "KP_1": 0x59,
+    "LEFTSHIFT": 0xE1,
+    "MEDIA_MUTE": 0xEE,
+}
+MODIFIERS = {
+    "M_LEFTCTRL": 0x01,
+    "M_LEFTSHIFT": 0x02,
+    "M_LEFTALT": 0x04,
+    "M_LEFTGUI": 0x08,
+    "M_RIGHTCTRL": 0x10,
+    "M_RIGHTSHIFT": 0x20,
+    "M_RIGHTALT": 0x40,
+    "M_RIGHTGUI": 0x80,
+}
+SHIFT = MODIFIERS["M_LEFTSHIFT"]
+
+# (modifier, key) typed for each character the generator puts in strings
+CHARACTERS = {
+    **{chr(ord("a") + i): (0, 0x04 + i) for i in range(26)},
+    **{chr(ord("A") + i): (SHIFT, 0x04 + i) for i in range(26)},
+    **{str((i + 1) % 10): (0, 0x1E + i) for i in range(10)},
+    " ": (0, 0x2C),
+    "\n": (0, 0x28),
+    "\t": (0, 0x2B),
+    "!": (SHIFT, 0x1E),
+    "?": (SHIFT, 0x38),
+    "-": (0, 0x2D),
+    ".": (0, 0x37),
+    ",": (0, 0x36),
+    '"': (SHIFT, 0x34),
+    "\\": (0, 0x31),
+}
+ESCAPES = {"\n": "\\n", "\t": "\\t", '"': '\\"', "\\": "\\\\"}
+
+# With legacy loops each repeat statement takes one of the VM's 255 counters
+MAX_REPEATS = 200
+# Largest repeat count legacy loops can hold; longer loops only pause
+LEGACY_MAX_COUNT = 65535
+
+# Compiler options each program is compiled with
+VARIANTS = {
+    "default": {},
+    "unoptimized": {"optimize": False},
+    "compressed": {"compress": True},
+    "fast_type": {"fast_type": True},
+    "legacy_loops": {"legacy_loops": True},
+}
+
+Report = Tuple[int, int, Tuple[int, ...]]
+
+
+@dataclass
+class Statement:
+    """One generated statement; repeat statements have a body"""
+
+    command: str
+    modifiers: List[str] = field(default_factory=list)
+    keys: List[str] = field(default_factory=list)
+    value: int = 0
+    text: str = ""
+    body: List["Statement"] = field(default_factory=list)
+    # press_time and interkey_time in effect, filled in by bind_times()
+    press_ms: int = 0
+    interkey_ms: int = 0
+
+
+class Generator:
+    """Random ODKeyScript program generator"""
+
+    def __init__(self, rng: random.Random) -> None:
+        self.rng = rng
+        self.repeats = 0
+
+    def program(self, size: int) -> List[Statement]:
+        """Generate a program of about size statements"""
+        self.repeats = 0
+        statements: List[Statement] = []
+        remaining = size
+        while remaining > 0:
+            statement = self.statement(0)
+            statements.append(statement)
+            remaining -= count_statements([statement])
+        return statements
+
+    def statement(self, depth: int) -> Statement:
+        rng = self.rng
+        choice = rng.random()
+        if choice < 0.08 and depth < 3 and self.repeats < MAX_REPEATS:
+            self.repeats += 1
+            if rng.random() < 0.05:
+                count = rng.randint(LEGACY_MAX_COUNT + 1, 100000)
+                body = [Statement("pause", value=rng.randint(1, 3))]
+                return Statement("repeat", value=count, body=body)
+            count = rng.choice([0, 1, 2, 3, 5])
+            body = [self.statement(depth + 1) for _ in range(rng.randint(0, 4))]
+            return Statement("repeat", value=count, body=body)
+        if choice < 0.25:
+            return Statement("type", text=self.text())
+        if choice < 0.45:
+            return Statement(
+                "press",
+                modifiers=self.modifiers(),
+                keys=self.keys(1, rng.choice([1, 1, 1, 2, 3])),
+            )
+        if choice < 0.6:
+            return Statement("keydn", modifiers=self.modifiers(), keys=self.keys(0, 6))
+        if choice < 0.72:
+            # A keyup of nothing is a bare keyup, which releases everything
+            modifiers = self.modifiers() if rng.random() < 0.5 else []
+            return Statement("keyup", modifiers=modifiers, keys=self.keys(0, 3))
+        if choice < 0.86:
+            return Statement("pause", value=self.time())
+        command = rng.choice(["press_time", "interkey_time"])
+        return Statement(command, value=self.time())
+
+    def modifiers(self) -> List[str]:
+        return self.rng.sample(sorted(MODIFIERS), self.rng.choice([0, 0, 1, 2]))
+
+    def keys(self, minimum: int, maximum: int) -> List[str]:
+        rng = self.rng
+        # Keys may repeat; the VM keeps a set of pressed keys
+        return [rng.choice(sorted(KEYS)) for _ in range(rng.randint(minimum, maximum))]
+
+    def text(self) -> str:
+        rng = self.rng
+        length = rng.choice([0, 1, 2, 5, 20, rng.randint(200, 600)])
+        return "".join(rng.choice(sorted(CHARACTERS)) for _ in range(length))
+
+    def time(self) -> int:
+        return self.rng.choice([0, 0, 1, 10, 30, 50, 100, 65535])
+
+
+def bind_times(
+    statements: List[Statement], press_ms: int = 30, interkey_ms: int = 30
+) -> Tuple[int, int]:
+    """Record the press and interkey times each statement runs with
+
+    A press_time or interkey_time applies to the commands that follow it in the
+    source, so a change inside a repeat body does not reach the start of the body.
+    """
+    for statement in statements:
+        if statement.command == "press_time":
+            press_ms = statement.value
+        elif statement.command == "interkey_time":
+            interkey_ms = statement.value
+        statement.press_ms = press_ms
+        statement.interkey_ms = interkey_ms
+        press_ms, interkey_ms = bind_times(statement.body, press_ms, interkey_ms)
+    return press_ms, interkey_ms
+
+
+def count_statements(statements: List[Statement]) -> int:
+    return sum(1 + count_statements(s.body) for s in statements)
+
+
+def max_repeat_count(statements: List[Statement]) -> int:
+    return max(
+        (
+            max(statement.value, max_repeat_count(statement.body))
+            for statement in statements
+            if statement.command == "repeat"
+        ),
+        default=0,
+    )
+
+
+def render(statements: List[Statement], rng: random.Random, indent: int = 0) -> str:
+    """Render statements as ODKeyScript source, with a few comments"""
+    lines: List[str] = []
+    pad = "    " * indent
+    for statement in statements:
+        if rng.random() < 0.05:
+            lines.append(f"{pad}# comment")
+        if statement.command == "repeat":
+            lines.append(f"{pad}repeat {statement.value} {{")
+            lines.append(render(statement.body, rng, indent + 1))
+            lines.append(f"{pad}}}")
+            continue
+        if statement.command == "type":
+            text = "".join(ESCAPES.get(char, char) for char in statement.text)
+            line = f'type "{text}"'
+        elif statement.command in ("press", "keydn", "keyup"):
+            line = " ".join([statement.command] + statement.modifiers + statement.keys)
+        else:
+            line = f"{statement.command} {statement.value}"
+        if rng.random() < 0.05:
+            line += " # trailing comment"
+        lines.append(pad + line)
+    return "\n".join(line for line in lines if line)
+
+
+class Model:
+    """Reference model of the reports an ODKeyScript program sends, from the
+    language documentation (ODKeyScript.md) rather than from the bytecode"""
+
+    def __init__(self, fast_type: bool) -> None:
+        self.fast_type = fast_type
+        self.time_ms = 0
+        self.modifier = 0
+        self.keys: Set[int] = set()
+        self.reports: List[Report] = []
+
+    def run(self, statements: List[Statement]) -> List[Report]:
+        bind_times(statements)
+        self.execute(statements)
+        self.release_all()
+        return self.reports
+
+    def report(self) -> None:
+        self.reports.append((self.time_ms, self.modifier, tuple(sorted(self.keys))))
+
+    def key_down(self, modifier: int, keys: List[int]) -> None:
+        # A keydn replaces whatever was held
+        self.modifier = modifier
+        self.keys = set(keys)
+        self.report()
+
+    def key_up(self, modifier: int, keys: List[int]) -> None:
+        self.modifier &= ~modifier
+        self.keys -= set(keys)
+        self.report()
+
+    def release_all(self) -> None:
+        if self.modifier or self.keys:
+            self.modifier = 0
+            self.keys = set()
+            self.report()
+
+    def execute(self, statements: List[Statement]) -> None:
+        for statement in statements:
+            command = statement.command
+            modifier = 0
+            for name in statement.modifiers:
+                modifier |= MODIFIERS[name]
+            keys = [KEYS[name] for name in statement.keys]
+
+            if command == "pause":
+                self.time_ms += statement.value
+            elif command == "keydn":
+                self.key_down(modifier, keys)
+            elif command == "keyup":
+                if modifier or keys:
+                    self.key_up(modifier, keys)
+                else:
+                    self.release_all()
+            elif command == "press":
+                self.key_down(modifier, keys)
+                self.time_ms += statement.press_ms
+                self.key_up(modifier, keys)
+                self.time_ms += statement.interkey_ms
+            elif command == "type":
+                self.type(statement)
+            elif command == "repeat":
+                # The loop test follows the body, so repeat 0 runs it once
+                for _ in range(max(statement.value, 1)):
+                    self.execute(statement.body)
+
+    def type(self, statement: Statement) -> None:
+        text = statement.text
+        if self.fast_type:
+            # Each character is pressed over the previous one without waits
+            previous = None
+            for char in text:
+                modifier, key = CHARACTERS[char]
+                if key == previous:
+                    self.release_all()
+                self.key_down(modifier, [key])
+                previous = key
+            if text:
+                self.release_all()
+            return
+
+        for index, char in enumerate(text):
+            modifier, key = CHARACTERS[char]
+            self.key_down(modifier, [key])
+            self.time_ms += statement.press_ms
+            self.key_up(modifier, [key])
+            if index < len(text) - 1:
+                self.time_ms += statement.interkey_ms
+
+
+@dataclass
+class Run:
+    """One vm_trace run of a program in one execution mode"""
+
+    mode: str
+    error: int
+    instructions: int
+    steps: int
+    runs: int
+    elapsed_us: int
+    reports: List[Report] = field(default_factory=list)
+
+
+def trace(vm_trace: Path, paths: List[Path], min_time_us: int) -> Dict[str, List[Run]]:
+    """Run programs through vm_trace and parse its output"""
+    command = [str(vm_trace), "--min-time-us", str(min_time_us)]
+    output = subprocess.run(
+        command + [str(path) for path in paths],
+        check=True,
+        capture_output=True,
+        text=True,
+    ).stdout
+
+    runs: Dict[str, List[Run]] = {}
+    program: List[Run] = []
+    for line in output.splitlines():
+        fields = line.split()
+        if fields[0] == "program":
+            program = runs.setdefault(fields[1], [])
+        elif fields[0] == "run":
+            mode, error, instructions, steps, _, count, elapsed = fields[1:]
+            program.append(
+                Run(
+                    mode,
+                    int(error),
+                    int(instructions),
+                    int(steps),
+                    int(count),
+                    int(elapsed),
+                )
+            )
+        elif fields[0] == "report":
+            values = [int(value) for value in fields[1:]]
+            program[-1].reports.append((values[0], values[1], tuple(values[2:])))
+    return runs
+
+
+def held_reports(reports: List[Report]) -> List[Report]:
+    """Drop reports replaced at the same time by a report of a superset of their
+    keys and modifiers, which the optimizer may remove since the host never sees
+    those keys held without the rest"""
+    held: List[Report] = []
+    for index, report in enumerate(reports):
+        if index + 1 < len(reports):
+            time_ms, modifier, keys = reports[index + 1]
+            if (
+                time_ms == report[0]
+                and report[1] & ~modifier == 0
+                and set(report[2]) <= set(keys)
+            ):
+                continue
+        held.append(report)
+    return held
+
+
+def first_difference(expected: List[Report], actual: List[Report]) -> str:
+    for index, (want, got) in enumerate(zip(expected, actual)):
+        if want != got:
+            return f"report {index}: expected {want}, got {got}"
+    return f"expected {len(expected)} reports, got {len(actual)}"
+
+
+@dataclass
+class SizeResult:
+    """Totals for the programs of one size"""
+
+    programs: int = 0
+    bytes: int = 0
+    reports: int = 0
+    compile_s: float = 0.0
+    instructions: Dict[str, int] = field(default_factory=dict)
+    elapsed_us: Dict[str, int] = field(default_factory=dict)
+    failures: List[str] = field(default_factory=list)
+
+
+def fuzz_size(
+    size: int,
+    programs: int,
+    rng: random.Random,
+    vm_trace: Path,
+    min_time_us: int,
+    work_dir: Path,
+) -> SizeResult:
+    result = SizeResult()
+    expected: Dict[str, List[Report]] = {}
+    paths: List[Path] = []
+
+    for index in range(programs):
+        statements = Generator(rng).program(size)
+        source = render(statements, rng)
+        source_path = work_dir / f"size{size}_{index}.odk"
+        source_path.write_text(source + "\n")
+        result.programs += 1
+        long_loops = max_repeat_count(statements) > LEGACY_MAX_COUNT
+
+        for variant, options in VARIANTS.items():
+            if long_loops and options.get("legacy_loops", False):
+                continue
+            start = time.perf_counter()
+            try:
+                compiler = Compiler(**options)
+                bytecode = compiler.compile(source)
+            except (CompileError, ValueError) as e:
+                result.failures.append(f"{source_path} ({variant}): compile error {e}")
+                continue
+            if variant == "default":
+                result.compile_s += time.perf_counter() - start
+                result.bytes += len(bytecode)
+
+            path = work_dir / f"size{size}_{index}_{variant}.bin"
+            path.write_bytes(bytecode)
+            paths.append(path)
+            expected[str(path)] = Model(options.get("fast_type", False)).run(
+                statements
+            )
+            if variant == "default":
+                result.reports += len(expected[str(path)])
+
+    for path, runs in trace(vm_trace, paths, min_time_us).items():
+        for run in runs:
+            if run.error != 0:
+                result.failures.append(f"{path} ({run.mode}): VM error {run.error}")
+                continue
+            if held_reports(run.reports) != held_reports(expected[path]):
+                difference = first_difference(
+                    held_reports(expected[path]), held_reports(run.reports)
+                )
+                result.failures.append(f"{path} ({run.mode}): {difference}")
+                continue
+            if path.endswith("_default.bin"):
+                total = run.instructions * run.runs
+                result.instructions[run.mode] = (
+                    result.instructions.get(run.mode, 0) + total
+                )
+                result.elapsed_us[run.mode] = (
+                    result.elapsed_us.get(run.mode, 0) + run.elapsed_us
+                )
+    return result
+
+
+def main() -> int:
+    parser = argparse.ArgumentParser(description=__doc__)
+    parser.add_argument("--vm-trace", type=Path, default=DEFAULT_VM_TRACE)
+    parser.add_argument("--seed", type=int, default=None)
+    parser.add_argument(
+        "--sizes", default="10,100,1000", help="Statements per program, by corpus"
+    )
+    parser.add_argument("--programs", type=int, default=20, help="Programs per size")
+    parser.add_argument(
+        "--min-time-ms",
+        type=float,
+        default=0,
+        help="Run each program for at least this long to time the VM",
+    )
+    parser.add_argument(
+        "--keep", type=Path, default=None, help="Keep the programs in this directory"
+    )
+    args = parser.parse_args()
+
+    seed = args.seed if args.seed is not None else random.randrange(1 << 32)
+    rng = random.Random(seed)
+    print(f"Seed {seed}")
+
+    temp: Optional[tempfile.TemporaryDirectory] = None
+    if args.keep is not None:
+        work_dir = args.keep
+        work_dir.mkdir(parents=True, exist_ok=True)
+    else:
+        temp = tempfile.TemporaryDirectory(prefix="odkey_fuzz_")
+        work_dir = Path(temp.name)
+
+    modes = ["bytecode", "decoded", "streamed", "verified"]
+    print(
+        f"{'Size':>6} {'Programs':>8} {'Bytes':>8} {'Reports':>8} {'Compile ms':>10} "
+        + " ".join(f"{mode + ' Mi/s':>14}" for mode in modes)
+    )
+    failures: List[str] = []
+    for size in [int(size) for size in args.sizes.split(",")]:
+        result = fuzz_size(
+            size,
+            args.programs,
+            rng,
+            args.vm_trace,
+            int(args.min_time_ms * 1000),
+            work_dir,
+        )
+        rates = []
+        for mode in modes:
+            elapsed_us = result.elapsed_us.get(mode, 0)
+            instructions = result.instructions.get(mode, 0)
+            rates.append(instructions / elapsed_us if elapsed_us else 0.0)
+        print(
+            f"{size:>6} {result.programs:>8} {result.bytes // result.programs:>8} "
+            f"{result.reports // result.programs:>8} "
+            f"{result.compile_s * 1000 / result.programs:>10.2f} "
+            + " ".join(f"{rate:>14.2f}" for rate in rates)
+        )
+        failures.extend(result.failures)
+
+    for failure in failures[:20]:
+        print(f"FAIL {failure}")
+    if len(failures) > 20:
+        print(f"... {len(failures) - 20} more failures")
+    if failures:
+        if temp is not None:
+            # Keep the failing programs for a look
+            kept = Path(tempfile.mkdtemp(prefix="odkey_fuzz_failed_"))
+            for path in Path(temp.name).iterdir():
+                (kept / path.name).write_bytes(path.read_bytes())
+            print(f"Programs kept in {kept} (rerun with --seed {seed})")
+        return 1
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,348 @@
+// Host test of the NVS configuration cache
+//
+// Runs nvs_config.c on an in-memory NVS store (the FreeRTOS and ESP-IDF headers
+// come from stubs/). Checks that more keys than the cache starts with are loaded
+// at boot, can be added, read back and erased, and are committed to the store.
+//
+//   nvs_config_test
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "nvs_config.h"
+
+// Enough keys to grow the cache twice
+#define TEST_KEY_COUNT (3 * NVS_CONFIG_INITIAL_ENTRIES)
+#define STORE_CAPACITY (4 * TEST_KEY_COUNT)
+
+// In-memory NVS store
+typedef struct {
+    char key[NVS_KEY_NAME_MAX_SIZE];  // Empty for a free item
+    nvs_type_t type;
+    uint64_t integer;
+    uint8_t data[64];  // String (with its NUL) or blob value
+    size_t length;
+} store_item_t;
+
+static store_item_t g_store[STORE_CAPACITY];
+static int g_commits = 0;
+static int g_failures = 0;
+
+#define CHECK(condition, ...)                                    \
+    do {                                                         \
+        if (!(condition)) {                                      \
+            fprintf(stderr, "FAIL %s:%d: ", __FILE__, __LINE__); \
+            fprintf(stderr, __VA_ARGS__);                        \
+            fprintf(stderr, "\n");                               \
+            g_failures++;                                        \
+        }                                                        \
+    } while (0)
+
+const char *esp_err_to_name(esp_err_t code) {
+    static char name[16];
+    snprintf(name, sizeof(name), "0x%x", code);
+    return name;
+}
+
+static store_item_t *store_find(const char *key) {
+    for (size_t i = 0; i < STORE_CAPACITY; i++) {
+        if (g_store[i].key[0] != '\0' && strcmp(g_store[i].key, key) == 0) {
+            return &g_store[i];
+        }
+    }
+    return NULL;
+}
+
+static esp_err_t store_set(const char *key,
+                           nvs_type_t type,
+                           uint64_t integer,
+                           const void *data,
+                           size_t length) {
+    store_item_t *item = store_find(key);
+    for (size_t i = 0; item == NULL && i < STORE_CAPACITY; i++) {
+        if (g_store[i].key[0] == '\0') {
+            item = &g_store[i];
+            strcpy(item->key, key);
+        }
+    }
+    if (item == NULL || length > sizeof(item->data)) {
+        return ESP_ERR_NVS_NOT_ENOUGH_SPACE;
+    }
+    if (item->type != 0 && item->type != type) {
+        return ESP_ERR_NVS_TYPE_MISMATCH;
+    }
+    item->type = type;
+    item->integer = integer;
+    memcpy(item->data, data, length);
+    item->length = length;
+    return ESP_OK;
+}
+
+static esp_err_t store_get(const char *key,
+                           nvs_type_t type,
+                           uint64_t *out_integer,
+                           void *out_data,
+                           size_t *length) {
+    store_item_t *item = store_find(key);
+    if (item == NULL || item->type != type) {
+        return ESP_ERR_NVS_NOT_FOUND;
+    }
+    if (out_integer != NULL) {
+        *out_integer = item->integer;
+        return ESP_OK;
+    }
+    if (out_data != NULL && *length < item->length) {
+        return ESP_ERR_NVS_INVALID_LENGTH;
+    }
+    if (out_data != NULL) {
+        memcpy(out_data, item->data, item->length);
+    }
+    *length = item->length;
+    return ESP_OK;
+}
+
+esp_err_t nvs_open(const char *namespace_name,
+                   nvs_open_mode_t open_mode,
+                   nvs_handle_t *out_handle) {
+    (void)namespace_name;
+    (void)open_mode;
+    *out_handle = 1;
+    return ESP_OK;
+}
+
+void nvs_close(nvs_handle_t handle) {
+    (void)handle;
+}
+
+esp_err_t nvs_commit(nvs_handle_t handle) {
+    (void)handle;
+    g_commits++;
+    return ESP_OK;
+}
+
+esp_err_t nvs_erase_key(nvs_handle_t handle, const char *key) {
+    (void)handle;
+    store_item_t *item = store_find(key);
+    if (item == NULL) {
+        return ESP_ERR_NVS_NOT_FOUND;
+    }
+    memset(item, 0, sizeof(*item));
+    return ESP_OK;
+}
+
+#define STORE_INTEGER_ACCESSORS(suffix, c_type, nvs_type)                     \
+    esp_err_t nvs_get_##suffix(nvs_handle_t handle, const char *key,         \
+                               c_type *out_value) {                           \
+        (void)handle;                                                         \
+        uint64_t value;                                                       \
+        esp_err_t err = store_get(key, nvs_type, &value, NULL, NULL);         \
+        if (err == ESP_OK) {                                                  \
+            *out_value = (c_type)value;                                       \
+        }                                                                     \
+        return err;                                                           \
+    }                                                                         \
+    esp_err_t nvs_set_##suffix(nvs_handle_t handle, const char *key,         \
+                               c_type value) {                                \
+        (void)handle;                                                         \
+        return store_set(key, nvs_type, (uint64_t)value, NULL, 0);            \
+    }
+
+STORE_INTEGER_ACCESSORS(u8, uint8_t, NVS_TYPE_U8)
+STORE_INTEGER_ACCESSORS(i8, int8_t, NVS_TYPE_I8)
+STORE_INTEGER_ACCESSORS(u16, uint16_t, NVS_TYPE_U16)
+STORE_INTEGER_ACCESSORS(i16, int16_t, NVS_TYPE_I16)
+STORE_INTEGER_ACCESSORS(u32, uint32_t, NVS_TYPE_U32)
+STORE_INTEGER_ACCESSORS(i32, int32_t, NVS_TYPE_I32)
+STORE_INTEGER_ACCESSORS(u64, uint64_t, NVS_TYPE_U64)
+STORE_INTEGER_ACCESSORS(i64, int64_t, NVS_TYPE_I64)
+
+esp_err_t nvs_get_str(nvs_handle_t handle,
+                      const char *key,
+                      char *out_value,
+                      size_t *length) {
+    (void)handle;
+    return store_get(key, NVS_TYPE_STR, NULL, out_value, length);
+}
+
+esp_err_t nvs_get_blob(nvs_handle_t handle,
+                       const char *key,
+                       void *out_value,
+                       size_t *length) {
+    (void)handle;
+    return store_get(key, NVS_TYPE_BLOB, NULL, out_value, length);
+}
+
+esp_err_t nvs_set_str(nvs_handle_t handle, const char *key, const char *value) {
+    (void)handle;
+    return store_set(key, NVS_TYPE_STR, 0, value, strlen(value) + 1);
+}
+
+esp_err_t nvs_set_blob(nvs_handle_t handle,
+                       const char *key,
+                       const void *value,
+                       size_t length) {
+    (void)handle;
+    return store_set(key, NVS_TYPE_BLOB, 0, value, length);
+}
+
+// An iterator is the index of the next store item, plus one (0 is NULL)
+static esp_err_t store_iterate(size_t start, nvs_iterator_t *iterator) {
+    for (size_t i = start; i < STORE_CAPACITY; i++) {
+        if (g_store[i].key[0] != '\0') {
+            *iterator = (nvs_iterator_t)(uintptr_t)(i + 1);
+            return ESP_OK;
+        }
+    }
+    *iterator = NULL;
+    return ESP_ERR_NVS_NOT_FOUND;
+}
+
+esp_err_t nvs_entry_find(const char *part_name,
+                         const char *namespace_name,
+                         nvs_type_t type,
+                         nvs_iterator_t *output_iterator) {
+    (void)part_name;
+    (void)namespace_name;
+    (void)type;
+    return store_iterate(0, output_iterator);
+}
+
+esp_err_t nvs_entry_next(nvs_iterator_t *iterator) {
+    return store_iterate((size_t)(uintptr_t)*iterator, iterator);
+}
+
+esp_err_t nvs_entry_info(nvs_iterator_t iterator, nvs_entry_info_t *out_info) {
+    const store_item_t *item = &g_store[(size_t)(uintptr_t)iterator - 1];
+    memset(out_info, 0, sizeof(*out_info));
+    strcpy(out_info->key, item->key);
+    out_info->type = item->type;
+    return ESP_OK;
+}
+
+void nvs_release_iterator(nvs_iterator_t iterator) {
+    (void)iterator;
+}
+
+static void make_key(char *key, const char *prefix, int index) {
+    snprintf(key, NVS_KEY_NAME_MAX_SIZE, "%s%d", prefix, index);
+}
+
+// Keys already in NVS at boot are all loaded, however many there are
+static void test_load(void) {
+    char key[NVS_KEY_NAME_MAX_SIZE];
+    for (int i = 0; i < TEST_KEY_COUNT; i++) {
+        make_key(key, "boot", i);
+        if (i % 2 == 0) {
+            nvs_set_u32(1, key, 1000 + i);
+        } else {
+            char value[16];
+            snprintf(value, sizeof(value), "value%d", i);
+            nvs_set_str(1, key, value);
+        }
+    }
+
+    CHECK(nvs_config_init(), "init failed");
+
+    for (int i = 0; i < TEST_KEY_COUNT; i++) {
+        make_key(key, "boot", i);
+        if (i % 2 == 0) {
+            uint32_t value = 0;
+            esp_err_t err = nvs_config_get_u32(key, &value);
+            CHECK(err == ESP_OK && value == (uint32_t)(1000 + i),
+                  "boot key %s: err 0x%x, value %" PRIu32,
+                  key,
+                  err,
+                  value);
+        } else {
+            char value[16] = "";
+            char expected[16];
+            size_t length = sizeof(value);
+            snprintf(expected, sizeof(expected), "value%d", i);
+            esp_err_t err = nvs_config_get_str(key, value, &length);
+            CHECK(err == ESP_OK && strcmp(value, expected) == 0,
+                  "boot key %s: err 0x%x, value '%s'",
+                  key,
+                  err,
+                  value);
+        }
+    }
+}
+
+// New keys can be set beyond the initial size, read back and committed
+static void test_set(void) {
+    char key[NVS_KEY_NAME_MAX_SIZE];
+    for (int i = 0; i < TEST_KEY_COUNT; i++) {
+        make_key(key, "user", i);
+        uint8_t blob[3] = {(uint8_t)i, (uint8_t)(i >> 8), 0xA5};
+        esp_err_t err = (i % 2 == 0) ? nvs_config_set_i64(key, -i)
+                                     : nvs_config_set_blob(key, blob, sizeof(blob));
+        CHECK(err == ESP_OK, "set %s: err 0x%x", key, err);
+    }
+
+    for (int i = 0; i < TEST_KEY_COUNT; i++) {
+        make_key(key, "user", i);
+        if (i % 2 == 0) {
+            int64_t value = 1;
+            esp_err_t err = nvs_config_get_i64(key, &value);
+            CHECK(err == ESP_OK && value == -i,
+                  "get %s: err 0x%x, value %" PRId64,
+                  key,
+                  err,
+                  value);
+        } else {
+            uint8_t value[3] = {0};
+            size_t length = sizeof(value);
+            esp_err_t err = nvs_config_get_blob(key, value, &length);
+            CHECK(err == ESP_OK && length == 3 && value[0] == (uint8_t)i &&
+                      value[2] == 0xA5,
+                  "get %s: err 0x%x, length %zu",
+                  key,
+                  err,
+                  length);
+        }
+    }
+
+    int commits = g_commits;
+    CHECK(nvs_config_commit() == ESP_OK, "commit failed");
+    CHECK(g_commits == commits + 1, "expected one NVS commit");
+    for (int i = 0; i < TEST_KEY_COUNT; i++) {
+        make_key(key, "user", i);
+        CHECK(store_find(key) != NULL, "%s not committed to NVS", key);
+    }
+}
+
+// Erased keys leave NVS on the next commit and free their cache entries
+static void test_erase(void) {
+    char key[NVS_KEY_NAME_MAX_SIZE];
+    for (int i = 0; i < TEST_KEY_COUNT; i++) {
+        make_key(key, "boot", i);
+        CHECK(nvs_config_erase_key(key) == ESP_OK, "erase %s failed", key);
+    }
+    CHECK(nvs_config_commit() == ESP_OK, "commit failed");
+
+    for (int i = 0; i < TEST_KEY_COUNT; i++) {
+        make_key(key, "boot", i);
+        nvs_type_t type;
+        CHECK(nvs_config_find_key(key, &type) == ESP_ERR_NVS_NOT_FOUND,
+              "%s still cached",
+              key);
+        CHECK(store_find(key) == NULL, "%s still in NVS", key);
+
+        make_key(key, "user", i);
+        CHECK(nvs_config_find_key(key, &type) == ESP_OK, "%s lost", key);
+    }
+}
+
+int main(void) {
+    test_load();
+    test_set();
+    test_erase();
+
+    if (g_failures > 0) {
+        fprintf(stderr, "%d check(s) failed\n", g_failures);
+        return 1;
+    }
+    printf("nvs_config: all checks passed\n");
+    return 0;
+}
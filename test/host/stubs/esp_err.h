@@ -0,0 +1,16 @@
+// Host stand-in for the parts of ESP-IDF's esp_err.h used by the tested modules
+#ifndef ESP_ERR_H
+#define ESP_ERR_H
+
+#include <stdint.h>
+
+typedef int esp_err_t;
+
+#define ESP_OK 0
+#define ESP_FAIL -1
+#define ESP_ERR_NO_MEM 0x101
+#define ESP_ERR_INVALID_ARG 0x102
+
+const char *esp_err_to_name(esp_err_t code);
+
+#endif  // ESP_ERR_H
@@ -0,0 +1,39 @@
+// Host stand-in for FreeRTOS tasks (see FreeRTOS.h)
+#ifndef TASK_H
+#define TASK_H
+
+#include "freertos/FreeRTOS.h"
+
+typedef void *TaskHandle_t;
+typedef void (*TaskFunction_t)(void *);
+
+static inline BaseType_t xTaskCreate(TaskFunction_t function,
+                                     const char *name,
+                                     uint32_t stack_size,
+                                     void *arg,
+                                     UBaseType_t priority,
+                                     TaskHandle_t *out_handle) {
+    (void)function;
+    (void)name;
+    (void)stack_size;
+    (void)arg;
+    (void)priority;
+    *out_handle = (TaskHandle_t)1;
+    return pdPASS;
+}
+
+static inline void xTaskNotifyGive(TaskHandle_t task) {
+    (void)task;
+}
+
+static inline uint32_t ulTaskNotifyTake(BaseType_t clear, TickType_t ticks) {
+    (void)clear;
+    (void)ticks;
+    return 0;
+}
+
+static inline TickType_t xTaskGetTickCount(void) {
+    return 0;
+}
+
+#endif  // TASK_H
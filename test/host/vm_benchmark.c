@@ -0,0 +1,189 @@
+// Host benchmark of the ODKeyScript VM
+//
+// Runs the sample corpus, synthetic type/repeat programs and any bytecode files
+// given on the command line in every execution mode, and prints the interpretation
+// rate of each, in instructions and in VM steps (which count each TYPE character).
+// Fails if a program errors, if the modes send different reports, or if a rate
+// falls below --min-ips.
+//
+//   vm_benchmark [--min-ips N] [--timeline NAME] [program.bin ...]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "odkeyscript_vm.h"
+#include "odkeyscript_vm_port.h"
+#include "vm_bench.h"
+#include "vm_bench_samples.h"
+
+#define MAX_PROGRAMS 64
+#define TIMELINE_CAPACITY 32
+
+#define SYNTHETIC_TYPE_CHARS 65536
+#define SYNTHETIC_REPEAT_OUTER 100
+#define SYNTHETIC_REPEAT_INNER 1000
+
+static vm_context_t g_ctx;
+static vm_bench_report_t g_timeline[TIMELINE_CAPACITY];
+
+static uint8_t *read_file(const char *path, uint32_t *out_size) {
+    FILE *file = fopen(path, "rb");
+    if (file == NULL) {
+        return NULL;
+    }
+    fseek(file, 0, SEEK_END);
+    long size = ftell(file);
+    fseek(file, 0, SEEK_SET);
+    uint8_t *data = (size > 0) ? malloc(size) : NULL;
+    if (data != NULL && fread(data, 1, size, file) != (size_t)size) {
+        free(data);
+        data = NULL;
+    }
+    fclose(file);
+    *out_size = (uint32_t)size;
+    return data;
+}
+
+static void print_timeline(const vm_bench_result_t *result) {
+    uint32_t count =
+        result->reports < TIMELINE_CAPACITY ? result->reports : TIMELINE_CAPACITY;
+    for (uint32_t i = 0; i < count; i++) {
+        const vm_bench_report_t *report = &g_timeline[i];
+        printf("    %8lu ms  modifier 0x%02X  keys",
+               (unsigned long)report->time_ms,
+               report->modifier);
+        for (uint32_t k = 0; k < report->key_count && k < VM_BENCH_REPORT_KEYS; k++) {
+            printf(" 0x%02X", report->keys[k]);
+        }
+        printf("\n");
+    }
+    if (result->reports > count) {
+        printf("    ... %lu more reports\n", (unsigned long)(result->reports - count));
+    }
+}
+
+int main(int argc, char **argv) {
+    double min_ips = 0.0;
+    const char *timeline_name = NULL;
+    vm_bench_program_t programs[MAX_PROGRAMS];
+    uint32_t program_count = 0;
+
+    for (uint32_t i = 0; i < VM_BENCH_SAMPLE_COUNT; i++) {
+        programs[program_count++] = g_vm_bench_samples[i];
+    }
+
+    uint32_t type_size, repeat_size, counters_size;
+    uint8_t *type_program = vm_bench_build_type(SYNTHETIC_TYPE_CHARS, &type_size);
+    uint8_t *repeat_program = vm_bench_build_repeat(
+        SYNTHETIC_REPEAT_OUTER, SYNTHETIC_REPEAT_INNER, false, &repeat_size);
+    uint8_t *counters_program = vm_bench_build_repeat(
+        SYNTHETIC_REPEAT_OUTER, SYNTHETIC_REPEAT_INNER, true, &counters_size);
+    if (type_program == NULL || repeat_program == NULL || counters_program == NULL) {
+        fprintf(stderr, "Failed to build synthetic programs\n");
+        return 1;
+    }
+    programs[program_count++] =
+        (vm_bench_program_t){"synthetic_type", type_program, type_size};
+    programs[program_count++] =
+        (vm_bench_program_t){"synthetic_repeat", repeat_program, repeat_size};
+    programs[program_count++] =
+        (vm_bench_program_t){"synthetic_counters", counters_program, counters_size};
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--min-ips") == 0 && i + 1 < argc) {
+            min_ips = atof(argv[++i]);
+        } else if (strcmp(argv[i], "--timeline") == 0 && i + 1 < argc) {
+            timeline_name = argv[++i];
+        } else if (argv[i][0] == '-') {
+            fprintf(stderr,
+                    "Usage: %s [--min-ips N] [--timeline NAME] [program.bin ...]\n",
+                    argv[0]);
+            return 1;
+        } else if (program_count < MAX_PROGRAMS) {
+            uint32_t size;
+            uint8_t *data = read_file(argv[i], &size);
+            if (data == NULL) {
+                fprintf(stderr, "Failed to read %s\n", argv[i]);
+                return 1;
+            }
+            programs[program_count++] = (vm_bench_program_t){argv[i], data, size};
+        }
+    }
+
+    vm_init(&g_ctx);
+    printf("%-18s %-8s %8s %9s %7s %8s %11s %9s %9s\n",
+           "Program",
+           "Mode",
+           "Bytes",
+           "Instr",
+           "B/instr",
+           "Reports",
+           "Program ms",
+           "Minstr/s",
+           "Msteps/s");
+
+    int failures = 0;
+    for (uint32_t i = 0; i < program_count; i++) {
+        const vm_bench_program_t *program = &programs[i];
+        vm_bench_result_t results[VM_BENCH_MODE_COUNT];
+        for (int mode = 0; mode < VM_BENCH_MODE_COUNT; mode++) {
+            vm_bench_result_t *result = &results[mode];
+            if (!vm_bench_mode_supported(program, (vm_bench_mode_t)mode)) {
+                continue;
+            }
+            bool ok = vm_bench_run(&g_ctx,
+                                   program,
+                                   (vm_bench_mode_t)mode,
+                                   VM_BENCH_MIN_TIME_US,
+                                   result,
+                                   g_timeline,
+                                   TIMELINE_CAPACITY);
+            if (!ok) {
+                printf("%-18s %-8s failed: %s\n",
+                       program->name,
+                       vm_bench_mode_name((vm_bench_mode_t)mode),
+                       vm_error_to_string(result->error));
+                failures++;
+                continue;
+            }
+
+            double ips = vm_bench_instructions_per_sec(result);
+            printf("%-18s %-8s %8lu %9lu %7.2f %8lu %11llu %9.2f %9.2f\n",
+                   program->name,
+                   vm_bench_mode_name((vm_bench_mode_t)mode),
+                   (unsigned long)program->program_size,
+                   (unsigned long)result->instructions,
+                   result->instructions
+                       ? (double)program->program_size / result->instructions
+                       : 0.0,
+                   (unsigned long)result->reports,
+                   (unsigned long long)result->program_time_ms,
+                   ips / 1e6,
+                   vm_bench_steps_per_sec(result) / 1e6);
+            if (ips < min_ips) {
+                printf("  below --min-ips %.0f\n", min_ips);
+                failures++;
+            }
+            if (timeline_name != NULL && strcmp(timeline_name, program->name) == 0 &&
+                mode == VM_BENCH_MODE_BYTECODE) {
+                print_timeline(result);
+            }
+
+            const vm_bench_result_t *reference = &results[VM_BENCH_MODE_BYTECODE];
+            if (mode != VM_BENCH_MODE_BYTECODE && reference->error == VM_ERROR_NONE &&
+                (reference->timeline_hash != result->timeline_hash ||
+                 reference->reports != result->reports)) {
+                printf("  %s: bytecode and %s runs sent different reports\n",
+                       program->name,
+                       vm_bench_mode_name((vm_bench_mode_t)mode));
+                failures++;
+            }
+        }
+    }
+
+    VM_FREE(type_program);
+    VM_FREE(repeat_program);
+    VM_FREE(counters_program);
+    vm_deinit(&g_ctx);
+    return failures == 0 ? 0 : 1;
+}
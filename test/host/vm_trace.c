@@ -0,0 +1,132 @@
+// Run bytecode files through the VM and print the reports they send
+//
+// Each program is run in every execution mode it supports. For each run one line
+// describes the run and one line follows per report sent, times in program ms:
+//
+//   program <path>
+//   run <mode> <vm_error_t> <instructions> <steps> <reports> <runs> <elapsed_us>
+//   report <time_ms> <modifier> [<key> ...]
+//
+// Used by fuzz_vm.py to compare the VM against its reference model.
+//
+//   vm_trace [--min-time-us N] program.bin ...
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "odkeyscript_vm.h"
+#include "vm_bench.h"
+
+#define INITIAL_TIMELINE_CAPACITY 1024
+
+static vm_context_t g_ctx;
+
+static uint8_t *read_file(const char *path, uint32_t *out_size) {
+    FILE *file = fopen(path, "rb");
+    if (file == NULL) {
+        return NULL;
+    }
+    fseek(file, 0, SEEK_END);
+    long size = ftell(file);
+    fseek(file, 0, SEEK_SET);
+    uint8_t *data = (size > 0) ? malloc(size) : NULL;
+    if (data != NULL && fread(data, 1, size, file) != (size_t)size) {
+        free(data);
+        data = NULL;
+    }
+    fclose(file);
+    *out_size = (uint32_t)size;
+    return data;
+}
+
+int main(int argc, char **argv) {
+    uint64_t min_time_us = 0;
+    uint32_t capacity = INITIAL_TIMELINE_CAPACITY;
+    vm_bench_report_t *timeline = malloc(capacity * sizeof(*timeline));
+    if (timeline == NULL) {
+        return 1;
+    }
+
+    vm_init(&g_ctx);
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--min-time-us") == 0 && i + 1 < argc) {
+            min_time_us = strtoull(argv[++i], NULL, 10);
+            continue;
+        }
+        if (argv[i][0] == '-') {
+            fprintf(stderr, "Usage: %s [--min-time-us N] program.bin ...\n", argv[0]);
+            return 1;
+        }
+
+        vm_bench_program_t program = {argv[i], NULL, 0};
+        uint8_t *data = read_file(argv[i], &program.program_size);
+        if (data == NULL) {
+            fprintf(stderr, "Failed to read %s\n", argv[i]);
+            return 1;
+        }
+        program.program = data;
+        printf("program %s\n", argv[i]);
+
+        for (int mode = 0; mode < VM_BENCH_MODE_COUNT; mode++) {
+            if (!vm_bench_mode_supported(&program, (vm_bench_mode_t)mode)) {
+                continue;
+            }
+            vm_bench_result_t result;
+            vm_bench_run(&g_ctx,
+                         &program,
+                         (vm_bench_mode_t)mode,
+                         min_time_us,
+                         &result,
+                         timeline,
+                         capacity);
+            if (result.error == VM_ERROR_NONE && result.reports > capacity) {
+                // Run again with room for every report
+                vm_bench_report_t *larger =
+                    realloc(timeline, result.reports * sizeof(*timeline));
+                if (larger == NULL) {
+                    fprintf(stderr,
+                            "Out of memory for %lu reports\n",
+                            (unsigned long)result.reports);
+                    return 1;
+                }
+                timeline = larger;
+                capacity = result.reports;
+                vm_bench_run(&g_ctx,
+                             &program,
+                             (vm_bench_mode_t)mode,
+                             min_time_us,
+                             &result,
+                             timeline,
+                             capacity);
+            }
+
+            printf("run %s %d %lu %lu %lu %lu %llu\n",
+                   vm_bench_mode_name((vm_bench_mode_t)mode),
+                   (int)result.error,
+                   (unsigned long)result.instructions,
+                   (unsigned long)result.steps,
+                   (unsigned long)result.reports,
+                   (unsigned long)result.runs,
+                   (unsigned long long)result.elapsed_us);
+            uint32_t count = result.reports < capacity ? result.reports : capacity;
+            for (uint32_t r = 0; r < count; r++) {
+                const vm_bench_report_t *report = &timeline[r];
+                uint32_t keys = report->key_count < VM_BENCH_REPORT_KEYS
+                                    ? report->key_count
+                                    : VM_BENCH_REPORT_KEYS;
+                printf("report %lu %u",
+                       (unsigned long)report->time_ms,
+                       report->modifier);
+                for (uint32_t k = 0; k < keys; k++) {
+                    printf(" %u", report->keys[k]);
+                }
+                printf("\n");
+            }
+        }
+        free(data);
+    }
+
+    free(timeline);
+    vm_deinit(&g_ctx);
+    return 0;
+}
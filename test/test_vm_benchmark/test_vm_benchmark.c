@@ -0,0 +1,101 @@
+// On-target benchmark of the ODKeyScript VM
+//
+// Runs the same programs as the host benchmark (test/host) so interpretation rates
+// can be compared between the two.
+//
+//   pio test -f test_vm_benchmark
+
+#include <stdio.h>
+#include "odkeyscript_vm.h"
+#include "odkeyscript_vm_port.h"
+#include "unity.h"
+#include "vm_bench.h"
+#include "vm_bench_samples.h"
+
+#define SYNTHETIC_TYPE_CHARS 4096
+#define SYNTHETIC_REPEAT_OUTER 10
+#define SYNTHETIC_REPEAT_INNER 1000
+
+static vm_context_t g_ctx;
+
+void setUp(void) {
+    vm_init(&g_ctx);
+}
+
+void tearDown(void) {
+    vm_deinit(&g_ctx);
+}
+
+// Run a program in every mode, print its rates and check that every mode sends the
+// same reports
+static void bench_program(const vm_bench_program_t *program) {
+    vm_bench_result_t results[VM_BENCH_MODE_COUNT];
+    for (int mode = 0; mode < VM_BENCH_MODE_COUNT; mode++) {
+        vm_bench_result_t *result = &results[mode];
+        if (!vm_bench_mode_supported(program, (vm_bench_mode_t)mode)) {
+            continue;
+        }
+        bool ok = vm_bench_run(&g_ctx,
+                               program,
+                               (vm_bench_mode_t)mode,
+                               VM_BENCH_MIN_TIME_US,
+                               result,
+                               NULL,
+                               0);
+        TEST_ASSERT_TRUE_MESSAGE(ok, vm_error_to_string(result->error));
+        printf("%-18s %-8s %8lu bytes %9lu instr %10.0f instr/s %10.0f steps/s\n",
+               program->name,
+               vm_bench_mode_name((vm_bench_mode_t)mode),
+               (unsigned long)program->program_size,
+               (unsigned long)result->instructions,
+               vm_bench_instructions_per_sec(result),
+               vm_bench_steps_per_sec(result));
+        if (mode != VM_BENCH_MODE_BYTECODE) {
+            const vm_bench_result_t *reference = &results[VM_BENCH_MODE_BYTECODE];
+            TEST_ASSERT_EQUAL_UINT32(reference->reports, result->reports);
+            TEST_ASSERT_EQUAL_HEX32(reference->timeline_hash, result->timeline_hash);
+        }
+    }
+}
+
+static void test_samples(void) {
+    for (uint32_t i = 0; i < VM_BENCH_SAMPLE_COUNT; i++) {
+        bench_program(&g_vm_bench_samples[i]);
+    }
+}
+
+static void test_synthetic_type(void) {
+    vm_bench_program_t program = {"synthetic_type", NULL, 0};
+    uint8_t *data = vm_bench_build_type(SYNTHETIC_TYPE_CHARS, &program.program_size);
+    TEST_ASSERT_NOT_NULL(data);
+    program.program = data;
+    bench_program(&program);
+    VM_FREE(data);
+}
+
+static void bench_repeat(const char *name, bool legacy) {
+    vm_bench_program_t program = {name, NULL, 0};
+    uint8_t *data = vm_bench_build_repeat(
+        SYNTHETIC_REPEAT_OUTER, SYNTHETIC_REPEAT_INNER, legacy, &program.program_size);
+    TEST_ASSERT_NOT_NULL(data);
+    program.program = data;
+    bench_program(&program);
+    VM_FREE(data);
+}
+
+static void test_synthetic_repeat(void) {
+    bench_repeat("synthetic_repeat", false);
+}
+
+static void test_synthetic_counters(void) {
+    bench_repeat("synthetic_counters", true);
+}
+
+void app_main(void) {
+    UNITY_BEGIN();
+    RUN_TEST(test_samples);
+    RUN_TEST(test_synthetic_type);
+    RUN_TEST(test_synthetic_repeat);
+    RUN_TEST(test_synthetic_counters);
+    UNITY_END();
+}
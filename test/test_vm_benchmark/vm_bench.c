@@ -0,0 +1,324 @@
+#include "vm_bench.h"
+#include <string.h>
+#include "odkeyscript_vm_port.h"
+
+#ifndef ODKEYSCRIPT_VM_HOST
+#include "esp_timer.h"
+#endif
+
+// Opcodes used by the synthetic programs (matching the VM)
+#define BENCH_OPCODE_SET_COUNTER 0x14
+#define BENCH_OPCODE_DEC 0x15
+#define BENCH_OPCODE_JNZ 0x16
+#define BENCH_OPCODE_PRESS 0x17
+#define BENCH_OPCODE_TYPE 0x18
+#define BENCH_OPCODE_PUSH_LOOP 0x19
+#define BENCH_OPCODE_NEXT 0x1A
+
+#define BENCH_TYPE_MAX_CHARS 255
+#define BENCH_PRESS_MS 30
+#define BENCH_GAP_MS 30
+
+// State of the run in progress, updated by the VM callbacks
+static struct {
+    uint64_t time_ms;
+    uint32_t reports;
+    uint32_t hash;
+    vm_bench_report_t *timeline;
+    uint32_t timeline_capacity;
+    uint32_t stream_size;
+} g_run;
+
+static uint64_t now_us(void) {
+#ifdef ODKEYSCRIPT_VM_HOST
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000u + (uint64_t)now.tv_nsec / 1000u;
+#else
+    return (uint64_t)esp_timer_get_time();
+#endif
+}
+
+// FNV-1a, so that runs can be compared without keeping every report
+static uint32_t hash_bytes(uint32_t hash, const void *data, size_t size) {
+    const uint8_t *bytes = data;
+    for (size_t i = 0; i < size; i++) {
+        hash = (hash ^ bytes[i]) * 16777619u;
+    }
+    return hash;
+}
+
+static bool bench_hid_callback(uint8_t modifier, const uint8_t *keys, uint8_t count) {
+    uint32_t time_ms = (uint32_t)g_run.time_ms;
+    g_run.hash = hash_bytes(g_run.hash, &time_ms, sizeof(time_ms));
+    g_run.hash = hash_bytes(g_run.hash, &modifier, sizeof(modifier));
+    g_run.hash = hash_bytes(g_run.hash, &count, sizeof(count));
+    if (keys != NULL) {
+        g_run.hash = hash_bytes(g_run.hash, keys, count);
+    }
+
+    if (g_run.reports < g_run.timeline_capacity) {
+        vm_bench_report_t *report = &g_run.timeline[g_run.reports];
+        memset(report, 0, sizeof(*report));
+        report->time_ms = time_ms;
+        report->modifier = modifier;
+        report->key_count = count;
+        if (keys != NULL) {
+            memcpy(report->keys,
+                   keys,
+                   count < VM_BENCH_REPORT_KEYS ? count : VM_BENCH_REPORT_KEYS);
+        }
+    }
+    g_run.reports++;
+    return true;
+}
+
+static void bench_delay_callback(uint16_t ms) {
+    g_run.time_ms += ms;
+}
+
+// The whole program is already written, so every wait returns right away
+static bool bench_stream_callback(uint32_t needed, uint32_t *available) {
+    (void)needed;
+    *available = g_run.stream_size;
+    return true;
+}
+
+// Run a started program to completion
+static vm_error_t run_to_completion(vm_context_t *ctx, uint32_t *out_steps) {
+    uint32_t steps = 0;
+    while (vm_running(ctx)) {
+        vm_error_t error = vm_step(ctx);
+        steps++;
+        if (error != VM_ERROR_NONE) {
+            return error;
+        }
+    }
+    *out_steps = steps;
+    return vm_has_error(ctx) ? ctx->error : VM_ERROR_NONE;
+}
+
+bool vm_bench_mode_supported(const vm_bench_program_t *program, vm_bench_mode_t mode) {
+    return mode != VM_BENCH_MODE_STREAMED ||
+           !vm_is_compressed(program->program, program->program_size);
+}
+
+bool vm_bench_run(vm_context_t *ctx,
+                  const vm_bench_program_t *program,
+                  vm_bench_mode_t mode,
+                  uint64_t min_time_us,
+                  vm_bench_result_t *result,
+                  vm_bench_report_t *timeline,
+                  uint32_t timeline_capacity) {
+    memset(result, 0, sizeof(*result));
+
+    vm_decoded_program_t decoded = {0};
+    vm_verification_t verification = {0};
+    if (mode == VM_BENCH_MODE_DECODED) {
+        result->error = vm_decode(
+            program->program, program->program_size, 0, SIZE_MAX, &decoded);
+        if (result->error != VM_ERROR_NONE) {
+            return false;
+        }
+    }
+
+    uint32_t steps = 0;
+    uint64_t start_us = now_us();
+    do {
+        memset(&g_run, 0, sizeof(g_run));
+        g_run.hash = 2166136261u;
+        if (result->runs == 0) {
+            g_run.timeline = timeline;
+            g_run.timeline_capacity = (timeline != NULL) ? timeline_capacity : 0;
+        }
+
+        if (mode == VM_BENCH_MODE_DECODED) {
+            result->error = vm_start_decoded(
+                ctx, &decoded, bench_hid_callback, bench_delay_callback);
+        } else if (mode == VM_BENCH_MODE_STREAMED) {
+            g_run.stream_size = program->program_size;
+            result->error = vm_start_streaming(ctx,
+                                               program->program,
+                                               program->program_size,
+                                               bench_hid_callback,
+                                               bench_delay_callback,
+                                               bench_stream_callback);
+        } else if (mode == VM_BENCH_MODE_VERIFIED) {
+            result->error = vm_start_with_verification(ctx,
+                                                       program->program,
+                                                       program->program_size,
+                                                       &verification,
+                                                       bench_hid_callback,
+                                                       bench_delay_callback);
+        } else {
+            result->error = vm_start(ctx,
+                                     program->program,
+                                     program->program_size,
+                                     bench_hid_callback,
+                                     bench_delay_callback);
+        }
+        if (result->error == VM_ERROR_NONE) {
+            result->error = run_to_completion(ctx, &steps);
+        }
+        if (result->error != VM_ERROR_NONE) {
+            break;
+        }
+
+        if (result->runs == 0) {
+            vm_get_stats(ctx, &result->instructions, NULL, NULL);
+            result->steps = steps;
+            result->reports = g_run.reports;
+            result->program_time_ms = g_run.time_ms;
+            result->timeline_hash = g_run.hash;
+        }
+        result->runs++;
+    } while (now_us() - start_us < min_time_us);
+    result->elapsed_us = now_us() - start_us;
+
+    vm_decoded_free(&decoded);
+    return result->error == VM_ERROR_NONE;
+}
+
+double vm_bench_instructions_per_sec(const vm_bench_result_t *result) {
+    if (result->elapsed_us == 0) {
+        return 0.0;
+    }
+    return (double)result->instructions * result->runs * 1e6 / result->elapsed_us;
+}
+
+double vm_bench_steps_per_sec(const vm_bench_result_t *result) {
+    if (result->elapsed_us == 0) {
+        return 0.0;
+    }
+    return (double)result->steps * result->runs * 1e6 / result->elapsed_us;
+}
+
+uint8_t *vm_bench_build_type(uint32_t characters, uint32_t *out_size) {
+    uint32_t instructions =
+        (characters + BENCH_TYPE_MAX_CHARS - 1) / BENCH_TYPE_MAX_CHARS;
+    uint32_t size = instructions * 6 + characters * 2;
+    uint8_t *program = VM_MALLOC(size > 0 ? size : 1);
+    if (program == NULL) {
+        return NULL;
+    }
+
+    uint8_t *out = program;
+    for (uint32_t typed = 0; typed < characters;) {
+        uint32_t count = characters - typed;
+        if (count > BENCH_TYPE_MAX_CHARS) {
+            count = BENCH_TYPE_MAX_CHARS;
+        }
+        *out++ = BENCH_OPCODE_TYPE;
+        *out++ = BENCH_PRESS_MS & 0xFF;
+        *out++ = BENCH_PRESS_MS >> 8;
+        *out++ = BENCH_GAP_MS & 0xFF;
+        *out++ = BENCH_GAP_MS >> 8;
+        *out++ = (uint8_t)count;
+        for (uint32_t i = 0; i < count; i++, typed++) {
+            *out++ = (typed % 7 == 0) ? 0x02 : 0x00;  // Left shift now and then
+            *out++ = 0x04 + typed % 26;               // A-Z
+        }
+    }
+
+    *out_size = size;
+    return program;
+}
+
+// Append little-endian values to a program being built
+static uint8_t *put_u16(uint8_t *out, uint16_t value) {
+    *out++ = value & 0xFF;
+    *out++ = value >> 8;
+    return out;
+}
+
+static uint8_t *put_u32(uint8_t *out, uint32_t value) {
+    out = put_u16(out, value & 0xFFFF);
+    return put_u16(out, value >> 16);
+}
+
+// Append a PRESS of A to a program being built
+static uint8_t *put_press(uint8_t *out) {
+    *out++ = BENCH_OPCODE_PRESS;
+    *out++ = 0x00;
+    *out++ = 0x04;
+    out = put_u16(out, BENCH_PRESS_MS);
+    return put_u16(out, BENCH_GAP_MS);
+}
+
+uint8_t *vm_bench_build_repeat(uint16_t outer,
+                               uint16_t inner,
+                               bool legacy,
+                               uint32_t *out_size) {
+    if (!legacy) {
+        // PUSH_LOOP outer
+        // outer_loop: PUSH_LOOP inner
+        // inner_loop: PRESS A; NEXT inner_loop
+        //             NEXT outer_loop
+        const uint32_t size = 5 + 5 + 7 + 5 + 5;
+        uint8_t *program = VM_MALLOC(size);
+        if (program == NULL) {
+            return NULL;
+        }
+
+        uint8_t *out = program;
+        *out++ = BENCH_OPCODE_PUSH_LOOP;
+        out = put_u32(out, outer);
+        uint32_t outer_loop = out - program;
+        *out++ = BENCH_OPCODE_PUSH_LOOP;
+        out = put_u32(out, inner);
+        uint32_t inner_loop = out - program;
+        out = put_press(out);
+        *out++ = BENCH_OPCODE_NEXT;
+        out = put_u32(out, inner_loop);
+        *out++ = BENCH_OPCODE_NEXT;
+        out = put_u32(out, outer_loop);
+
+        *out_size = size;
+        return program;
+    }
+
+    // SET_COUNTER 0 outer
+    // outer_loop: SET_COUNTER 1 inner
+    // inner_loop: PRESS A; DEC 1; JNZ inner_loop
+    //             DEC 0; JNZ outer_loop
+    const uint32_t size = 4 + 4 + 7 + 2 + 5 + 2 + 5;
+    uint8_t *program = VM_MALLOC(size);
+    if (program == NULL) {
+        return NULL;
+    }
+
+    uint8_t *out = program;
+    *out++ = BENCH_OPCODE_SET_COUNTER;
+    *out++ = 0;
+    out = put_u16(out, outer);
+    uint32_t outer_loop = out - program;
+    *out++ = BENCH_OPCODE_SET_COUNTER;
+    *out++ = 1;
+    out = put_u16(out, inner);
+    uint32_t inner_loop = out - program;
+    out = put_press(out);
+    *out++ = BENCH_OPCODE_DEC;
+    *out++ = 1;
+    *out++ = BENCH_OPCODE_JNZ;
+    out = put_u32(out, inner_loop);
+    *out++ = BENCH_OPCODE_DEC;
+    *out++ = 0;
+    *out++ = BENCH_OPCODE_JNZ;
+    out = put_u32(out, outer_loop);
+
+    *out_size = size;
+    return program;
+}
+
+const char *vm_bench_mode_name(vm_bench_mode_t mode) {
+    switch (mode) {
+    case VM_BENCH_MODE_DECODED:
+        return "decoded";
+    case VM_BENCH_MODE_STREAMED:
+        return "streamed";
+    case VM_BENCH_MODE_VERIFIED:
+        return "verified";
+    default:
+        return "bytecode";
+    }
+}
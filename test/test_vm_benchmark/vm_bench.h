@@ -0,0 +1,127 @@
+#ifndef VM_BENCH_H
+#define VM_BENCH_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "odkeyscript_vm.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Each program runs repeatedly for at least this long by default
+#define VM_BENCH_MIN_TIME_US (200 * 1000)
+
+// Keys kept per report in a recorded timeline
+#define VM_BENCH_REPORT_KEYS VM_MAX_KEYS_PRESSED
+
+// Benchmark program
+typedef struct {
+    const char *name;
+    const uint8_t *program;
+    uint32_t program_size;
+} vm_bench_program_t;
+
+// How a program is executed
+typedef enum {
+    VM_BENCH_MODE_BYTECODE,  // vm_start() every run, as for uncached programs
+    VM_BENCH_MODE_DECODED,   // vm_decode() once, then vm_start_decoded() every run
+    VM_BENCH_MODE_STREAMED,  // vm_start_streaming(), executed with runtime checks
+    VM_BENCH_MODE_VERIFIED,  // vm_start_with_verification(), verifying only once
+} vm_bench_mode_t;
+
+#define VM_BENCH_MODE_COUNT 4
+
+// HID report sent by a program, at the program time it was sent
+typedef struct {
+    uint32_t time_ms;
+    uint8_t modifier;
+    uint8_t key_count;
+    uint8_t keys[VM_BENCH_REPORT_KEYS];
+} vm_bench_report_t;
+
+// Result of benchmarking one program in one mode
+typedef struct {
+    vm_error_t error;
+    uint32_t runs;
+    uint32_t instructions;     // Per run
+    uint32_t steps;            // vm_step() calls per run (one per TYPE character)
+    uint32_t reports;          // Per run
+    uint64_t program_time_ms;  // Sum of the waits of a run
+    uint32_t timeline_hash;    // Hash of every report of a run, with its time
+    uint64_t elapsed_us;       // Wall time of all runs
+} vm_bench_result_t;
+
+/**
+ * @brief Check whether a program can be executed in a mode
+ * @return false for compressed programs in VM_BENCH_MODE_STREAMED
+ */
+bool vm_bench_mode_supported(const vm_bench_program_t *program, vm_bench_mode_t mode);
+
+/**
+ * @brief Run a program repeatedly for at least min_time_us
+ * @param ctx VM context to run in (must be initialized)
+ * @param program Program to run
+ * @param mode How to execute it
+ * @param min_time_us Minimum wall time of all runs (0 runs the program once)
+ * @param result Output: result (result->error is the first error, if any)
+ * @param timeline Optional output: the first reports of a run
+ * @param timeline_capacity Reports timeline can hold
+ * @return true if every run completed without error
+ * @note Waits advance a virtual clock instead of sleeping, so only interpretation
+ * time is measured
+ */
+bool vm_bench_run(vm_context_t *ctx,
+                  const vm_bench_program_t *program,
+                  vm_bench_mode_t mode,
+                  uint64_t min_time_us,
+                  vm_bench_result_t *result,
+                  vm_bench_report_t *timeline,
+                  uint32_t timeline_capacity);
+
+/**
+ * @brief Get the interpretation rate of a result
+ * @return Instructions per second
+ */
+double vm_bench_instructions_per_sec(const vm_bench_result_t *result);
+
+/**
+ * @brief Get the step rate of a result, which unlike the instruction rate counts
+ * each character of a TYPE
+ * @return vm_step() calls per second
+ */
+double vm_bench_steps_per_sec(const vm_bench_result_t *result);
+
+/**
+ * @brief Build a program that types a long string with TYPE instructions
+ * @param characters Characters to type
+ * @param out_size Output: program size in bytes
+ * @return Program allocated with VM_MALLOC() (release with VM_FREE()), or NULL
+ */
+uint8_t *vm_bench_build_type(uint32_t characters, uint32_t *out_size);
+
+/**
+ * @brief Build a program of two nested repeat loops around a PRESS
+ * @param outer Iterations of the outer loop
+ * @param inner Iterations of the inner loop
+ * @param legacy Loop with SET_COUNTER/DEC/JNZ instead of PUSH_LOOP/NEXT
+ * @param out_size Output: program size in bytes
+ * @return Program allocated with VM_MALLOC() (release with VM_FREE()), or NULL
+ */
+uint8_t *vm_bench_build_repeat(uint16_t outer,
+                               uint16_t inner,
+                               bool legacy,
+                               uint32_t *out_size);
+
+/**
+ * @brief Get the name of a mode
+ * @return "bytecode", "decoded" or "streamed"
+ */
+const char *vm_bench_mode_name(vm_bench_mode_t mode);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  // VM_BENCH_H
@@ -0,0 +1,474 @@
+// Generated from odkey_tools/scripts by test/host/build_corpus.py
+#ifndef VM_BENCH_SAMPLES_H
+#define VM_BENCH_SAMPLES_H
+
+#include <stdint.h>
+#include "vm_bench.h"
+
+static const uint8_t g_sample_default[] = {
+    0x17, 0x02, 0x12, 0x14, 0x00, 0x14, 0x00, 0x17, 0x02, 0x07, 0x14, 0x00,
+    0x14, 0x00,
+};
+
+static const uint8_t g_sample_is_this_okay[] = {
+    0x18, 0x14, 0x00, 0x14, 0x00, 0x55, 0x02, 0x0C, 0x00, 0x2C, 0x00, 0x13,
+    0x00, 0x0F, 0x00, 0x18, 0x00, 0x0A, 0x00, 0x0A, 0x00, 0x08, 0x00, 0x07,
+    0x00, 0x2C, 0x00, 0x16, 0x00, 0x12, 0x00, 0x10, 0x00, 0x08, 0x00, 0x17,
+    0x00, 0x0B, 0x00, 0x0C, 0x00, 0x11, 0x00, 0x0A, 0x00, 0x2C, 0x00, 0x17,
+    0x00, 0x0B, 0x00, 0x04, 0x00, 0x17, 0x00, 0x2C, 0x02, 0x0D, 0x00, 0x08,
+    0x00, 0x15, 0x00, 0x15, 0x00, 0x1C, 0x00, 0x2C, 0x00, 0x0A, 0x00, 0x04,
+    0x00, 0x19, 0x00, 0x08, 0x00, 0x2C, 0x00, 0x10, 0x00, 0x08, 0x00, 0x2C,
+    0x00, 0x0C, 0x00, 0x11, 0x00, 0x17, 0x00, 0x12, 0x00, 0x2C, 0x00, 0x10,
+    0x00, 0x1C, 0x00, 0x2C, 0x00, 0x06, 0x00, 0x12, 0x00, 0x10, 0x00, 0x13,
+    0x00, 0x18, 0x00, 0x17, 0x00, 0x08, 0x00, 0x15, 0x00, 0x37, 0x00, 0x2C,
+    0x02, 0x17, 0x00, 0x0B, 0x00, 0x04, 0x00, 0x17, 0x00, 0x2C, 0x00, 0x16,
+    0x00, 0x0B, 0x00, 0x12, 0x00, 0x18, 0x00, 0x0F, 0x00, 0x07, 0x00, 0x2C,
+    0x00, 0x05, 0x00, 0x08, 0x00, 0x2C, 0x00, 0x12, 0x00, 0x0E, 0x00, 0x04,
+    0x00, 0x1C, 0x00, 0x36, 0x00, 0x2C, 0x00, 0x15, 0x00, 0x0C, 0x00, 0x0A,
+    0x00, 0x0B, 0x00, 0x17, 0x02, 0x38, 0x00, 0x28,
+};
+
+static const uint8_t g_sample_mochi[] = {
+    0x18, 0x14, 0x00, 0x14, 0x00, 0x14, 0x02, 0x11, 0x00, 0x12, 0x00, 0x13,
+    0x00, 0x08, 0x00, 0x37, 0x00, 0x2C, 0x02, 0x0B, 0x00, 0x08, 0x00, 0x15,
+    0x00, 0x08, 0x00, 0x2C, 0x00, 0x1A, 0x00, 0x08, 0x00, 0x2C, 0x00, 0x0A,
+    0x00, 0x12, 0x00, 0x37, 0x00, 0x37, 0x00, 0x37, 0x00, 0x28, 0x18, 0x14,
+    0x00, 0x14, 0x00, 0x1C, 0x02, 0x0C, 0x00, 0x34, 0x00, 0x10, 0x00, 0x2C,
+    0x02, 0x12, 0x02, 0x07, 0x00, 0x2C, 0x00, 0x04, 0x00, 0x11, 0x00, 0x07,
+    0x00, 0x2C, 0x02, 0x0C, 0x00, 0x34, 0x00, 0x10, 0x00, 0x2C, 0x00, 0x0B,
+    0x00, 0x08, 0x00, 0x15, 0x00, 0x08, 0x00, 0x2C, 0x00, 0x17, 0x00, 0x12,
+    0x00, 0x2C, 0x00, 0x16, 0x00, 0x04, 0x00, 0x1C, 0x00, 0x36, 0x00, 0x28,
+    0x18, 0x14, 0x00, 0x14, 0x00, 0x24, 0x02, 0x0C, 0x00, 0x2C, 0x00, 0x0F,
+    0x00, 0x12, 0x00, 0x19, 0x00, 0x08, 0x00, 0x2C, 0x00, 0x10, 0x00, 0x12,
+    0x00, 0x06, 0x00, 0x0B, 0x00, 0x0C, 0x00, 0x2C, 0x00, 0x07, 0x00, 0x12,
+    0x00, 0x11, 0x00, 0x18, 0x00, 0x17, 0x00, 0x16, 0x00, 0x2C, 0x00, 0x0C,
+    0x00, 0x11, 0x00, 0x2C, 0x00, 0x04, 0x00, 0x2C, 0x00, 0x10, 0x00, 0x04,
+    0x00, 0x0D, 0x00, 0x12, 0x00, 0x15, 0x00, 0x2C, 0x00, 0x1A, 0x00, 0x04,
+    0x00, 0x1C, 0x00, 0x37, 0x00, 0x28, 0x18, 0x14, 0x00, 0x14, 0x00, 0x1F,
+    0x02, 0x18, 0x00, 0x05, 0x00, 0x08, 0x00, 0x36, 0x00, 0x2C, 0x00, 0x10,
+    0x00, 0x04, 0x00, 0x17, 0x00, 0x06, 0x00, 0x0B, 0x00, 0x04, 0x00, 0x36,
+    0x00, 0x2C, 0x00, 0x05, 0x00, 0x0F, 0x00, 0x04, 0x00, 0x06, 0x00, 0x0E,
+    0x00, 0x2C, 0x00, 0x16, 0x00, 0x08, 0x00, 0x16, 0x00, 0x04, 0x00, 0x10,
+    0x00, 0x08, 0x00, 0x2C, 0x00, 0x17, 0x00, 0x12, 0x00, 0x12, 0x00, 0x36,
+    0x00, 0x28, 0x18, 0x14, 0x00, 0x14, 0x00, 0x2B, 0x02, 0x0C, 0x00, 0x34,
+    0x00, 0x10, 0x00, 0x2C, 0x00, 0x0A, 0x00, 0x12, 0x00, 0x11, 0x00, 0x11,
+    0x00, 0x04, 0x00, 0x2C, 0x00, 0x05, 0x00, 0x18, 0x00, 0x1C, 0x00, 0x2C,
+    0x00, 0x10, 0x00, 0x12, 0x00, 0x06, 0x00, 0x0B, 0x00, 0x0C, 0x00, 0x2C,
+    0x00, 0x07, 0x00, 0x12, 0x00, 0x11, 0x00, 0x18, 0x00, 0x17, 0x00, 0x16,
+    0x00, 0x2C, 0x00, 0x09, 0x00, 0x12, 0x00, 0x15, 0x00, 0x2C, 0x00, 0x04,
+    0x00, 0x0F, 0x00, 0x0F, 0x00, 0x2C, 0x00, 0x12, 0x00, 0x09, 0x00, 0x2C,
+    0x00, 0x1C, 0x00, 0x12, 0x00, 0x18, 0x02, 0x1E, 0x00, 0x28, 0x18, 0x14,
+    0x00, 0x14, 0x00, 0x25, 0x02, 0x16, 0x00, 0x17, 0x00, 0x08, 0x00, 0x13,
+    0x00, 0x2C, 0x00, 0x0C, 0x00, 0x11, 0x00, 0x2C, 0x00, 0x17, 0x00, 0x0B,
+    0x00, 0x08, 0x00, 0x2C, 0x00, 0x16, 0x00, 0x0B, 0x00, 0x12, 0x00, 0x13,
+    0x00, 0x36, 0x00, 0x2C, 0x00, 0x09, 0x00, 0x08, 0x00, 0x08, 0x00, 0x0F,
+    0x00, 0x0C, 0x00, 0x11, 0x00, 0x34, 0x00, 0x2C, 0x00, 0x0E, 0x00, 0x0C,
+    0x00, 0x11, 0x00, 0x07, 0x00, 0x04, 0x00, 0x2C, 0x00, 0x09, 0x00, 0x0F,
+    0x00, 0x1C, 0x00, 0x36, 0x00, 0x28, 0x18, 0x14, 0x00, 0x14, 0x00, 0x23,
+    0x02, 0x05, 0x00, 0x12, 0x00, 0x1B, 0x00, 0x2C, 0x00, 0x12, 0x00, 0x09,
+    0x00, 0x2C, 0x00, 0x17, 0x00, 0x1A, 0x00, 0x08, 0x00, 0x0F, 0x00, 0x19,
+    0x00, 0x08, 0x00, 0x2C, 0x00, 0x04, 0x00, 0x11, 0x00, 0x07, 0x00, 0x2C,
+    0x02, 0x0C, 0x00, 0x2C, 0x00, 0x07, 0x00, 0x12, 0x00, 0x11, 0x00, 0x34,
+    0x00, 0x17, 0x00, 0x2C, 0x00, 0x04, 0x00, 0x16, 0x00, 0x0E, 0x00, 0x2C,
+    0x00, 0x1A, 0x00, 0x0B, 0x00, 0x1C, 0x00, 0x37, 0x00, 0x28, 0x18, 0x14,
+    0x00, 0x14, 0x00, 0x20, 0x02, 0x0A, 0x00, 0x0F, 0x00, 0x04, 0x00, 0x1D,
+    0x00, 0x08, 0x00, 0x2C, 0x00, 0x16, 0x00, 0x12, 0x00, 0x2C, 0x00, 0x16,
+    0x00, 0x0B, 0x00, 0x0C, 0x00, 0x11, 0x00, 0x1C, 0x00, 0x36, 0x00, 0x2C,
+    0x00, 0x16, 0x00, 0x12, 0x00, 0x09, 0x00, 0x17, 0x00, 0x2C, 0x00, 0x04,
+    0x00, 0x11, 0x00, 0x07, 0x00, 0x2C, 0x00, 0x15, 0x00, 0x12, 0x00, 0x18,
+    0x00, 0x11, 0x00, 0x07, 0x00, 0x36, 0x00, 0x28, 0x18, 0x14, 0x00, 0x14,
+    0x00, 0x23, 0x02, 0x05, 0x00, 0x0C, 0x00, 0x17, 0x00, 0x08, 0x00, 0x2C,
+    0x00, 0x17, 0x00, 0x0B, 0x00, 0x04, 0x00, 0x17, 0x00, 0x2C, 0x00, 0x06,
+    0x00, 0x0B, 0x00, 0x08, 0x00, 0x1A, 0x00, 0x2C, 0x00, 0x05, 0x00, 0x08,
+    0x00, 0x16, 0x00, 0x17, 0x00, 0x2C, 0x00, 0x17, 0x00, 0x04, 0x00, 0x16,
+    0x00, 0x17, 0x00, 0x08, 0x00, 0x2C, 0x00, 0x0C, 0x00, 0x11, 0x00, 0x2C,
+    0x00, 0x17, 0x00, 0x12, 0x00, 0x1A, 0x00, 0x11, 0x00, 0x37, 0x00, 0x28,
+    0x18, 0x14, 0x00, 0x14, 0x00, 0x22, 0x02, 0x13, 0x00, 0x12, 0x00, 0x1A,
+    0x00, 0x07, 0x00, 0x08, 0x00, 0x15, 0x00, 0x08, 0x00, 0x07, 0x00, 0x2C,
+    0x00, 0x16, 0x00, 0x18, 0x00, 0x0A, 0x00, 0x04, 0x00, 0x15, 0x00, 0x36,
+    0x00, 0x2C, 0x00, 0x16, 0x00, 0x17, 0x00, 0x18, 0x00, 0x06, 0x00, 0x0E,
+    0x00, 0x2C, 0x00, 0x12, 0x00, 0x11, 0x00, 0x2C, 0x00, 0x10, 0x00, 0x1C,
+    0x00, 0x2C, 0x00, 0x09, 0x00, 0x04, 0x00, 0x06, 0x00, 0x08, 0x00, 0x36,
+    0x00, 0x28, 0x18, 0x14, 0x00, 0x14, 0x00, 0x25, 0x02, 0x0C, 0x00, 0x34,
+    0x00, 0x10, 0x00, 0x2C, 0x00, 0x17, 0x00, 0x0B, 0x00, 0x08, 0x00, 0x2C,
+    0x00, 0x10, 0x00, 0x12, 0x00, 0x06, 0x00, 0x0B, 0x00, 0x0C, 0x00, 0x2C,
+    0x00, 0x10, 0x00, 0x04, 0x00, 0x11, 0x00, 0x36, 0x00, 0x2C, 0x02, 0x0C,
+    0x00, 0x2C, 0x00, 0x12, 0x00, 0x1A, 0x00, 0x11, 0x00, 0x2C, 0x00, 0x17,
+    0x00, 0x0B, 0x00, 0x0C, 0x00, 0x16, 0x00, 0x2C, 0x00, 0x13, 0x00, 0x0F,
+    0x00, 0x04, 0x00, 0x06, 0x00, 0x08, 0x00, 0x37, 0x00, 0x28, 0x18, 0x14,
+    0x00, 0x14, 0x00, 0x28, 0x02, 0x06, 0x00, 0x12, 0x00, 0x09, 0x00, 0x09,
+    0x00, 0x08, 0x00, 0x08, 0x00, 0x2C, 0x00, 0x0C, 0x00, 0x11, 0x00, 0x2C,
+    0x00, 0x12, 0x00, 0x11, 0x00, 0x08, 0x00, 0x2C, 0x00, 0x0B, 0x00, 0x04,
+    0x00, 0x11, 0x00, 0x07, 0x00, 0x36, 0x00, 0x2C, 0x00, 0x07, 0x00, 0x12,
+    0x00, 0x11, 0x00, 0x18, 0x00, 0x17, 0x00, 0x2C, 0x00, 0x0C, 0x00, 0x11,
+    0x00, 0x2C, 0x00, 0x17, 0x00, 0x0B, 0x00, 0x08, 0x00, 0x2C, 0x00, 0x12,
+    0x00, 0x17, 0x00, 0x0B, 0x00, 0x08, 0x00, 0x15, 0x00, 0x36, 0x00, 0x28,
+    0x18, 0x14, 0x00, 0x14, 0x00, 0x32, 0x02, 0x16, 0x00, 0x0B, 0x00, 0x04,
+    0x00, 0x15, 0x00, 0x0C, 0x00, 0x11, 0x00, 0x0A, 0x00, 0x2C, 0x00, 0x1A,
+    0x00, 0x0C, 0x00, 0x17, 0x00, 0x0B, 0x00, 0x2C, 0x00, 0x10, 0x00, 0x1C,
+    0x00, 0x2C, 0x00, 0x17, 0x00, 0x08, 0x00, 0x04, 0x00, 0x10, 0x00, 0x2C,
+    0x00, 0x0F, 0x00, 0x0C, 0x00, 0x0E, 0x00, 0x08, 0x00, 0x2C, 0x02, 0x0C,
+    0x00, 0x34, 0x00, 0x10, 0x00, 0x2C, 0x00, 0x1C, 0x00, 0x12, 0x00, 0x18,
+    0x00, 0x15, 0x00, 0x2C, 0x00, 0x07, 0x00, 0x12, 0x00, 0x11, 0x00, 0x18,
+    0x00, 0x17, 0x00, 0x2C, 0x00, 0x05, 0x00, 0x15, 0x00, 0x12, 0x00, 0x17,
+    0x00, 0x0B, 0x00, 0x08, 0x00, 0x15, 0x00, 0x37, 0x00, 0x28, 0x18, 0x14,
+    0x00, 0x14, 0x00, 0x24, 0x02, 0x15, 0x00, 0x0C, 0x00, 0x11, 0x00, 0x0A,
+    0x00, 0x2D, 0x00, 0x16, 0x00, 0x0B, 0x00, 0x04, 0x00, 0x13, 0x00, 0x08,
+    0x00, 0x07, 0x00, 0x2C, 0x00, 0x0D, 0x00, 0x12, 0x00, 0x1C, 0x00, 0x36,
+    0x00, 0x2C, 0x00, 0x0C, 0x00, 0x17, 0x00, 0x34, 0x00, 0x16, 0x00, 0x2C,
+    0x00, 0x05, 0x00, 0x12, 0x00, 0x18, 0x00, 0x11, 0x00, 0x06, 0x00, 0x1C,
+    0x00, 0x2C, 0x00, 0x05, 0x00, 0x0F, 0x00, 0x0C, 0x00, 0x16, 0x00, 0x16,
+    0x00, 0x36, 0x00, 0x28, 0x18, 0x14, 0x00, 0x14, 0x00, 0x27, 0x02, 0x16,
+    0x00, 0x0E, 0x00, 0x0C, 0x00, 0x13, 0x00, 0x2C, 0x00, 0x17, 0x00, 0x0B,
+    0x00, 0x08, 0x00, 0x2C, 0x00, 0x06, 0x00, 0x15, 0x00, 0x12, 0x00, 0x11,
+    0x00, 0x18, 0x00, 0x17, 0x00, 0x16, 0x00, 0x36, 0x00, 0x2C, 0x00, 0x17,
+    0x00, 0x0B, 0x00, 0x08, 0x00, 0x1C, 0x00, 0x2C, 0x00, 0x06, 0x00, 0x04,
+    0x00, 0x11, 0x00, 0x34, 0x00, 0x17, 0x00, 0x2C, 0x00, 0x17, 0x00, 0x12,
+    0x00, 0x13, 0x00, 0x2C, 0x00, 0x17, 0x00, 0x0B, 0x00, 0x0C, 0x00, 0x16,
+    0x00, 0x37, 0x00, 0x28, 0x18, 0x14, 0x00, 0x14, 0x00, 0x33, 0x02, 0x1A,
+    0x00, 0x0B, 0x00, 0x08, 0x00, 0x11, 0x00, 0x2C, 0x00, 0x17, 0x00, 0x0B,
+    0x00, 0x08, 0x00, 0x2C, 0x00, 0x05, 0x00, 0x12, 0x00, 0x1B, 0x00, 0x2C,
+    0x00, 0x0B, 0x00, 0x0C, 0x00, 0x17, 0x00, 0x16, 0x00, 0x2C, 0x00, 0x17,
+    0x00, 0x0B, 0x00, 0x08, 0x00, 0x2C, 0x00, 0x17, 0x00, 0x04, 0x00, 0x05,
+    0x00, 0x0F, 0x00, 0x08, 0x00, 0x36, 0x00, 0x2C, 0x00, 0x1C, 0x00, 0x12,
+    0x00, 0x18, 0x00, 0x34, 0x00, 0x0F, 0x00, 0x0F, 0x00, 0x2C, 0x00, 0x04,
+    0x00, 0x0F, 0x00, 0x0F, 0x00, 0x2C, 0x00, 0x16, 0x00, 0x04, 0x00, 0x1C,
+    0x00, 0x2C, 0x02, 0x34, 0x00, 0x07, 0x00, 0x04, 0x00, 0x11, 0x00, 0x0A,
+    0x00, 0x36, 0x00, 0x28, 0x18, 0x14, 0x00, 0x14, 0x00, 0x29, 0x02, 0x12,
+    0x02, 0x07, 0x00, 0x2C, 0x00, 0x05, 0x00, 0x15, 0x00, 0x12, 0x00, 0x18,
+    0x00, 0x0A, 0x00, 0x0B, 0x00, 0x17, 0x00, 0x2C, 0x00, 0x17, 0x00, 0x0B,
+    0x00, 0x08, 0x00, 0x2C, 0x00, 0x10, 0x00, 0x12, 0x00, 0x06, 0x00, 0x0B,
+    0x00, 0x0C, 0x00, 0x36, 0x00, 0x2C, 0x00, 0x17, 0x00, 0x0B, 0x00, 0x04,
+    0x00, 0x17, 0x00, 0x2C, 0x00, 0x06, 0x00, 0x0B, 0x00, 0x08, 0x00, 0x1A,
+    0x00, 0x1C, 0x00, 0x2C, 0x00, 0x17, 0x00, 0x0B, 0x00, 0x04, 0x00, 0x11,
+    0x00, 0x0A, 0x02, 0x1E, 0x02, 0x34, 0x00, 0x28,
+};
+
+static const uint8_t g_sample_mochi_lz4[] = {
+    0x4F, 0x44, 0x4B, 0x5A, 0x01, 0x00, 0x01, 0x00, 0x48, 0x05, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0xF1, 0x0F, 0x18, 0x14,
+    0x00, 0x14, 0x00, 0x14, 0x02, 0x11, 0x00, 0x12, 0x00, 0x13, 0x00, 0x08,
+    0x00, 0x37, 0x00, 0x2C, 0x02, 0x0B, 0x00, 0x08, 0x00, 0x15, 0x00, 0x08,
+    0x00, 0x2C, 0x00, 0x1A, 0x06, 0x00, 0x51, 0x0A, 0x00, 0x12, 0x00, 0x37,
+    0x02, 0x00, 0x11, 0x28, 0x2E, 0x00, 0xF4, 0x08, 0x1C, 0x02, 0x0C, 0x00,
+    0x34, 0x00, 0x10, 0x00, 0x2C, 0x02, 0x12, 0x02, 0x07, 0x00, 0x2C, 0x00,
+    0x04, 0x00, 0x11, 0x00, 0x07, 0x00, 0x2C, 0x16, 0x00, 0x16, 0x00, 0x40,
+    0x00, 0xD3, 0x17, 0x00, 0x12, 0x00, 0x2C, 0x00, 0x16, 0x00, 0x04, 0x00,
+    0x1C, 0x00, 0x36, 0x3E, 0x00, 0xB1, 0x24, 0x02, 0x0C, 0x00, 0x2C, 0x00,
+    0x0F, 0x00, 0x12, 0x00, 0x19, 0x24, 0x00, 0x80, 0x10, 0x00, 0x12, 0x00,
+    0x06, 0x00, 0x0B, 0x00, 0x16, 0x00, 0xF1, 0x02, 0x07, 0x00, 0x12, 0x00,
+    0x11, 0x00, 0x18, 0x00, 0x17, 0x00, 0x16, 0x00, 0x2C, 0x00, 0x0C, 0x00,
+    0x11, 0x5E, 0x00, 0x00, 0x24, 0x00, 0x71, 0x04, 0x00, 0x0D, 0x00, 0x12,
+    0x00, 0x15, 0x94, 0x00, 0x00, 0x4E, 0x00, 0x04, 0x8C, 0x00, 0x93, 0x1F,
+    0x02, 0x18, 0x00, 0x05, 0x00, 0x08, 0x00, 0x36, 0x26, 0x00, 0x11, 0x17,
+    0x4C, 0x00, 0x11, 0x04, 0x10, 0x00, 0x91, 0x05, 0x00, 0x0F, 0x00, 0x04,
+    0x00, 0x06, 0x00, 0x0E, 0x84, 0x00, 0x11, 0x08, 0x88, 0x00, 0x11, 0x10,
+    0x74, 0x00, 0x00, 0x98, 0x00, 0x15, 0x12, 0x92, 0x00, 0x15, 0x2B, 0xBA,
+    0x00, 0x00, 0xEA, 0x00, 0x31, 0x11, 0x00, 0x11, 0x74, 0x00, 0x51, 0x05,
+    0x00, 0x18, 0x00, 0x1C, 0x56, 0x00, 0x0F, 0xA0, 0x00, 0x05, 0x13, 0x09,
+    0x92, 0x00, 0xF3, 0x06, 0x04, 0x00, 0x0F, 0x00, 0x0F, 0x00, 0x2C, 0x00,
+    0x12, 0x00, 0x09, 0x00, 0x2C, 0x00, 0x1C, 0x00, 0x12, 0x00, 0x18, 0x02,
+    0x1E, 0x5C, 0x00, 0x95, 0x25, 0x02, 0x16, 0x00, 0x17, 0x00, 0x08, 0x00,
+    0x13, 0xD0, 0x00, 0x11, 0x17, 0x20, 0x01, 0x00, 0x92, 0x00, 0x11, 0x0B,
+    0x74, 0x01, 0x00, 0xAA, 0x00, 0x71, 0x09, 0x00, 0x08, 0x00, 0x08, 0x00,
+    0x0F, 0x22, 0x00, 0x51, 0x34, 0x00, 0x2C, 0x00, 0x0E, 0x0A, 0x00, 0x11,
+    0x07, 0x88, 0x00, 0x37, 0x09, 0x00, 0x0F, 0x3E, 0x01, 0x75, 0x23, 0x02,
+    0x05, 0x00, 0x12, 0x00, 0x1B, 0x6E, 0x00, 0x11, 0x17, 0xA4, 0x01, 0x13,
+    0x0F, 0x4C, 0x01, 0x06, 0x8A, 0x01, 0x04, 0xAC, 0x00, 0x31, 0x34, 0x00,
+    0x17, 0x18, 0x00, 0x11, 0x16, 0x06, 0x01, 0x37, 0x1A, 0x00, 0x0B, 0x3C,
+    0x01, 0x31, 0x20, 0x02, 0x0A, 0x22, 0x01, 0x11, 0x1D, 0x3C, 0x00, 0x13,
+    0x16, 0xAC, 0x01, 0x00, 0xEA, 0x00, 0x11, 0x11, 0x72, 0x00, 0x00, 0x0E,
+    0x00, 0x00, 0x66, 0x00, 0x02, 0x42, 0x00, 0x01, 0x5A, 0x00, 0x20, 0x00,
+    0x15, 0xDE, 0x00, 0x01, 0x0C, 0x00, 0x08, 0x92, 0x00, 0x11, 0x0C, 0xE4,
+    0x00, 0x00, 0x8E, 0x00, 0x00, 0x7C, 0x01, 0x00, 0x30, 0x00, 0x00, 0x32,
+    0x01, 0x31, 0x08, 0x00, 0x1A, 0x48, 0x01, 0x00, 0x7A, 0x01, 0x00, 0x14,
+    0x00, 0x11, 0x17, 0x88, 0x00, 0x02, 0x2A, 0x00, 0x00, 0x64, 0x00, 0x00,
+    0x12, 0x00, 0x55, 0x12, 0x00, 0x1A, 0x00, 0x11, 0x92, 0x00, 0x31, 0x22,
+    0x02, 0x13, 0x12, 0x00, 0x13, 0x07, 0x42, 0x02, 0x00, 0x72, 0x00, 0x93,
+    0x16, 0x00, 0x18, 0x00, 0x0A, 0x00, 0x04, 0x00, 0x15, 0x92, 0x00, 0x33,
+    0x17, 0x00, 0x18, 0xD4, 0x01, 0x00, 0xE0, 0x00, 0x00, 0xA0, 0x01, 0x00,
+    0xA6, 0x01, 0x11, 0x09, 0xEA, 0x01, 0x00, 0x08, 0x02, 0x02, 0x4A, 0x00,
+    0x15, 0x25, 0xD4, 0x01, 0x00, 0x94, 0x00, 0x00, 0x72, 0x00, 0x08, 0xC8,
+    0x01, 0x00, 0x2A, 0x02, 0x10, 0x11, 0x50, 0x00, 0x01, 0x2A, 0x01, 0x00,
+    0x72, 0x00, 0x00, 0x4A, 0x00, 0x00, 0x2A, 0x00, 0x11, 0x0C, 0xDA, 0x01,
+    0x11, 0x13, 0x18, 0x01, 0x00, 0x50, 0x00, 0x04, 0x9A, 0x00, 0x31, 0x28,
+    0x02, 0x06, 0x0C, 0x01, 0x02, 0xAA, 0x01, 0x04, 0xC0, 0x00, 0x00, 0x82,
+    0x00, 0x00, 0x0E, 0x00, 0x00, 0xF6, 0x00, 0x02, 0x14, 0x01, 0x04, 0x78,
+    0x01, 0x00, 0x24, 0x02, 0x04, 0x26, 0x00, 0x00, 0x58, 0x00, 0x00, 0x26,
+    0x00, 0x13, 0x12, 0x0A, 0x00, 0x00, 0xCA, 0x00, 0x02, 0x56, 0x00, 0x20,
+    0x32, 0x02, 0x70, 0x01, 0x00, 0xDC, 0x00, 0x00, 0x2A, 0x00, 0x11, 0x0A,
+    0xA2, 0x01, 0x00, 0x4C, 0x01, 0x11, 0x0B, 0xA4, 0x00, 0x00, 0xD8, 0x00,
+    0x00, 0x2E, 0x01, 0x00, 0xB6, 0x02, 0x00, 0x32, 0x03, 0x30, 0x0C, 0x00,
+    0x0E, 0x48, 0x00, 0x05, 0xDA, 0x00, 0x01, 0x6A, 0x02, 0x01, 0x82, 0x02,
+    0x08, 0x74, 0x00, 0x11, 0x05, 0xA4, 0x01, 0x00, 0x44, 0x00, 0x00, 0x6A,
+    0x00, 0x04, 0xC0, 0x00, 0x24, 0x24, 0x02, 0x64, 0x00, 0x11, 0x2D, 0xE4,
+    0x01, 0x11, 0x04, 0xEE, 0x03, 0x00, 0x60, 0x01, 0x00, 0x58, 0x03, 0x02,
+    0xEE, 0x01, 0x00, 0x7A, 0x00, 0x11, 0x34, 0x00, 0x01, 0x00, 0x64, 0x02,
+    0x00, 0xE6, 0x01, 0x11, 0x06, 0x84, 0x00, 0x00, 0x48, 0x03, 0x00, 0x18,
+    0x01, 0x15, 0x16, 0xB8, 0x00, 0x20, 0x27, 0x02, 0x50, 0x02, 0x11, 0x0C,
+    0xD6, 0x02, 0x02, 0x6A, 0x00, 0x00, 0xF2, 0x01, 0x00, 0x78, 0x00, 0x02,
+    0x86, 0x00, 0x00, 0x2A, 0x00, 0x04, 0x1A, 0x00, 0x00, 0x42, 0x00, 0x11,
+    0x06, 0x20, 0x01, 0x02, 0x8C, 0x02, 0x00, 0xF4, 0x01, 0x04, 0x38, 0x00,
+    0x00, 0x56, 0x00, 0x04, 0xA2, 0x00, 0x20, 0x33, 0x02, 0x9E, 0x02, 0x19,
+    0x08, 0x32, 0x01, 0x00, 0x88, 0x00, 0x00, 0xEC, 0x02, 0x00, 0x2A, 0x00,
+    0x00, 0x56, 0x00, 0x06, 0x1A, 0x00, 0x00, 0x4C, 0x02, 0x00, 0x98, 0x00,
+    0x00, 0xF2, 0x01, 0x04, 0x0A, 0x01, 0x13, 0x34, 0x88, 0x03, 0x04, 0x90,
+    0x03, 0x00, 0xF0, 0x03, 0x51, 0x1C, 0x00, 0x2C, 0x02, 0x34, 0x4A, 0x03,
+    0x00, 0xFC, 0x00, 0x04, 0xC0, 0x00, 0x13, 0x29, 0xBA, 0x04, 0x02, 0x2C,
+    0x01, 0x00, 0x60, 0x02, 0x13, 0x0B, 0x9C, 0x00, 0x02, 0x5E, 0x00, 0x06,
+    0x2C, 0x02, 0x00, 0x5E, 0x00, 0x00, 0x16, 0x00, 0x0A, 0xD6, 0x02, 0x00,
+    0xD4, 0x00, 0x02, 0x16, 0x00, 0x90, 0x11, 0x00, 0x0A, 0x02, 0x1E, 0x02,
+    0x34, 0x00, 0x28,
+};
+
+static const uint8_t g_sample_mochi_se[] = {
+    0x18, 0x14, 0x00, 0x14, 0x00, 0x13, 0x02, 0x11, 0x00, 0x12, 0x00, 0x13,
+    0x00, 0x08, 0x00, 0x37, 0x00, 0x2C, 0x02, 0x0B, 0x00, 0x08, 0x00, 0x15,
+    0x00, 0x08, 0x00, 0x2C, 0x00, 0x1A, 0x00, 0x08, 0x00, 0x2C, 0x00, 0x0A,
+    0x00, 0x12, 0x00, 0x37, 0x00, 0x37, 0x00, 0x37, 0x17, 0x02, 0x28, 0x14,
+    0x00, 0x14, 0x00, 0x18, 0x14, 0x00, 0x14, 0x00, 0x1B, 0x02, 0x0C, 0x00,
+    0x34, 0x00, 0x10, 0x00, 0x2C, 0x02, 0x12, 0x02, 0x07, 0x00, 0x2C, 0x00,
+    0x04, 0x00, 0x11, 0x00, 0x07, 0x00, 0x2C, 0x02, 0x0C, 0x00, 0x34, 0x00,
+    0x10, 0x00, 0x2C, 0x00, 0x0B, 0x00, 0x08, 0x00, 0x15, 0x00, 0x08, 0x00,
+    0x2C, 0x00, 0x17, 0x00, 0x12, 0x00, 0x2C, 0x00, 0x16, 0x00, 0x04, 0x00,
+    0x1C, 0x00, 0x36, 0x17, 0x02, 0x28, 0x14, 0x00, 0x14, 0x00, 0x18, 0x14,
+    0x00, 0x14, 0x00, 0x23, 0x02, 0x0C, 0x00, 0x2C, 0x00, 0x0F, 0x00, 0x12,
+    0x00, 0x19, 0x00, 0x08, 0x00, 0x2C, 0x00, 0x10, 0x00, 0x12, 0x00, 0x06,
+    0x00, 0x0B, 0x00, 0x0C, 0x00, 0x2C, 0x00, 0x07, 0x00, 0x12, 0x00, 0x11,
+    0x00, 0x18, 0x00, 0x17, 0x00, 0x16, 0x00, 0x2C, 0x00, 0x0C, 0x00, 0x11,
+    0x00, 0x2C, 0x00, 0x04, 0x00, 0x2C, 0x00, 0x10, 0x00, 0x04, 0x00, 0x0D,
+    0x00, 0x12, 0x00, 0x15, 0x00, 0x2C, 0x00, 0x1A, 0x00, 0x04, 0x00, 0x1C,
+    0x00, 0x37, 0x17, 0x02, 0x28, 0x14, 0x00, 0x14, 0x00, 0x18, 0x14, 0x00,
+    0x14, 0x00, 0x1E, 0x02, 0x18, 0x00, 0x05, 0x00, 0x08, 0x00, 0x36, 0x00,
+    0x2C, 0x00, 0x10, 0x00, 0x04, 0x00, 0x17, 0x00, 0x06, 0x00, 0x0B, 0x00,
+    0x04, 0x00, 0x36, 0x00, 0x2C, 0x00, 0x05, 0x00, 0x0F, 0x00, 0x04, 0x00,
+    0x06, 0x00, 0x0E, 0x00, 0x2C, 0x00, 0x16, 0x00, 0x08, 0x00, 0x16, 0x00,
+    0x04, 0x00, 0x10, 0x00, 0x08, 0x00, 0x2C, 0x00, 0x17, 0x00, 0x12, 0x00,
+    0x12, 0x00, 0x36, 0x17, 0x02, 0x28, 0x14, 0x00, 0x14, 0x00, 0x18, 0x14,
+    0x00, 0x14, 0x00, 0x2A, 0x02, 0x0C, 0x00, 0x34, 0x00, 0x10, 0x00, 0x2C,
+    0x00, 0x0A, 0x00, 0x12, 0x00, 0x11, 0x00, 0x11, 0x00, 0x04, 0x00, 0x2C,
+    0x00, 0x05, 0x00, 0x18, 0x00, 0x1C, 0x00, 0x2C, 0x00, 0x10, 0x00, 0x12,
+    0x00, 0x06, 0x00, 0x0B, 0x00, 0x0C, 0x00, 0x2C, 0x00, 0x07, 0x00, 0x12,
+    0x00, 0x11, 0x00, 0x18, 0x00, 0x17, 0x00, 0x16, 0x00, 0x2C, 0x00, 0x09,
+    0x00, 0x12, 0x00, 0x15, 0x00, 0x2C, 0x00, 0x04, 0x00, 0x0F, 0x00, 0x0F,
+    0x00, 0x2C, 0x00, 0x12, 0x00, 0x09, 0x00, 0x2C, 0x00, 0x1C, 0x00, 0x12,
+    0x00, 0x18, 0x02, 0x1E, 0x17, 0x02, 0x28, 0x14, 0x00, 0x14, 0x00, 0x18,
+    0x14, 0x00, 0x14, 0x00, 0x24, 0x02, 0x16, 0x00, 0x17, 0x00, 0x08, 0x00,
+    0x13, 0x00, 0x2C, 0x00, 0x0C, 0x00, 0x11, 0x00, 0x2C, 0x00, 0x17, 0x00,
+    0x0B, 0x00, 0x08, 0x00, 0x2C, 0x00, 0x16, 0x00, 0x0B, 0x00, 0x12, 0x00,
+    0x13, 0x00, 0x36, 0x00, 0x2C, 0x00, 0x09, 0x00, 0x08, 0x00, 0x08, 0x00,
+    0x0F, 0x00, 0x0C, 0x00, 0x11, 0x00, 0x34, 0x00, 0x2C, 0x00, 0x0E, 0x00,
+    0x0C, 0x00, 0x11, 0x00, 0x07, 0x00, 0x04, 0x00, 0x2C, 0x00, 0x09, 0x00,
+    0x0F, 0x00, 0x1C, 0x00, 0x36, 0x17, 0x02, 0x28, 0x14, 0x00, 0x14, 0x00,
+    0x18, 0x14, 0x00, 0x14, 0x00, 0x22, 0x02, 0x05, 0x00, 0x12, 0x00, 0x1B,
+    0x00, 0x2C, 0x00, 0x12, 0x00, 0x09, 0x00, 0x2C, 0x00, 0x17, 0x00, 0x1A,
+    0x00, 0x08, 0x00, 0x0F, 0x00, 0x19, 0x00, 0x08, 0x00, 0x2C, 0x00, 0x04,
+    0x00, 0x11, 0x00, 0x07, 0x00, 0x2C, 0x02, 0x0C, 0x00, 0x2C, 0x00, 0x07,
+    0x00, 0x12, 0x00, 0x11, 0x00, 0x34, 0x00, 0x17, 0x00, 0x2C, 0x00, 0x04,
+    0x00, 0x16, 0x00, 0x0E, 0x00, 0x2C, 0x00, 0x1A, 0x00, 0x0B, 0x00, 0x1C,
+    0x00, 0x37, 0x17, 0x02, 0x28, 0x14, 0x00, 0x14, 0x00, 0x18, 0x14, 0x00,
+    0x14, 0x00, 0x1F, 0x02, 0x0A, 0x00, 0x0F, 0x00, 0x04, 0x00, 0x1D, 0x00,
+    0x08, 0x00, 0x2C, 0x00, 0x16, 0x00, 0x12, 0x00, 0x2C, 0x00, 0x16, 0x00,
+    0x0B, 0x00, 0x0C, 0x00, 0x11, 0x00, 0x1C, 0x00, 0x36, 0x00, 0x2C, 0x00,
+    0x16, 0x00, 0x12, 0x00, 0x09, 0x00, 0x17, 0x00, 0x2C, 0x00, 0x04, 0x00,
+    0x11, 0x00, 0x07, 0x00, 0x2C, 0x00, 0x15, 0x00, 0x12, 0x00, 0x18, 0x00,
+    0x11, 0x00, 0x07, 0x00, 0x36, 0x17, 0x02, 0x28, 0x14, 0x00, 0x14, 0x00,
+    0x18, 0x14, 0x00, 0x14, 0x00, 0x22, 0x02, 0x05, 0x00, 0x0C, 0x00, 0x17,
+    0x00, 0x08, 0x00, 0x2C, 0x00, 0x17, 0x00, 0x0B, 0x00, 0x04, 0x00, 0x17,
+    0x00, 0x2C, 0x00, 0x06, 0x00, 0x0B, 0x00, 0x08, 0x00, 0x1A, 0x00, 0x2C,
+    0x00, 0x05, 0x00, 0x08, 0x00, 0x16, 0x00, 0x17, 0x00, 0x2C, 0x00, 0x17,
+    0x00, 0x04, 0x00, 0x16, 0x00, 0x17, 0x00, 0x08, 0x00, 0x2C, 0x00, 0x0C,
+    0x00, 0x11, 0x00, 0x2C, 0x00, 0x17, 0x00, 0x12, 0x00, 0x1A, 0x00, 0x11,
+    0x00, 0x37, 0x17, 0x02, 0x28, 0x14, 0x00, 0x14, 0x00, 0x18, 0x14, 0x00,
+    0x14, 0x00, 0x21, 0x02, 0x13, 0x00, 0x12, 0x00, 0x1A, 0x00, 0x07, 0x00,
+    0x08, 0x00, 0x15, 0x00, 0x08, 0x00, 0x07, 0x00, 0x2C, 0x00, 0x16, 0x00,
+    0x18, 0x00, 0x0A, 0x00, 0x04, 0x00, 0x15, 0x00, 0x36, 0x00, 0x2C, 0x00,
+    0x16, 0x00, 0x17, 0x00, 0x18, 0x00, 0x06, 0x00, 0x0E, 0x00, 0x2C, 0x00,
+    0x12, 0x00, 0x11, 0x00, 0x2C, 0x00, 0x10, 0x00, 0x1C, 0x00, 0x2C, 0x00,
+    0x09, 0x00, 0x04, 0x00, 0x06, 0x00, 0x08, 0x00, 0x36, 0x17, 0x02, 0x28,
+    0x14, 0x00, 0x14, 0x00, 0x18, 0x14, 0x00, 0x14, 0x00, 0x24, 0x02, 0x0C,
+    0x00, 0x34, 0x00, 0x10, 0x00, 0x2C, 0x00, 0x17, 0x00, 0x0B, 0x00, 0x08,
+    0x00, 0x2C, 0x00, 0x10, 0x00, 0x12, 0x00, 0x06, 0x00, 0x0B, 0x00, 0x0C,
+    0x00, 0x2C, 0x00, 0x10, 0x00, 0x04, 0x00, 0x11, 0x00, 0x36, 0x00, 0x2C,
+    0x02, 0x0C, 0x00, 0x2C, 0x00, 0x12, 0x00, 0x1A, 0x00, 0x11, 0x00, 0x2C,
+    0x00, 0x17, 0x00, 0x0B, 0x00, 0x0C, 0x00, 0x16, 0x00, 0x2C, 0x00, 0x13,
+    0x00, 0x0F, 0x00, 0x04, 0x00, 0x06, 0x00, 0x08, 0x00, 0x37, 0x17, 0x02,
+    0x28, 0x14, 0x00, 0x14, 0x00, 0x18, 0x14, 0x00, 0x14, 0x00, 0x27, 0x02,
+    0x06, 0x00, 0x12, 0x00, 0x09, 0x00, 0x09, 0x00, 0x08, 0x00, 0x08, 0x00,
+    0x2C, 0x00, 0x0C, 0x00, 0x11, 0x00, 0x2C, 0x00, 0x12, 0x00, 0x11, 0x00,
+    0x08, 0x00, 0x2C, 0x00, 0x0B, 0x00, 0x04, 0x00, 0x11, 0x00, 0x07, 0x00,
+    0x36, 0x00, 0x2C, 0x00, 0x07, 0x00, 0x12, 0x00, 0x11, 0x00, 0x18, 0x00,
+    0x17, 0x00, 0x2C, 0x00, 0x0C, 0x00, 0x11, 0x00, 0x2C, 0x00, 0x17, 0x00,
+    0x0B, 0x00, 0x08, 0x00, 0x2C, 0x00, 0x12, 0x00, 0x17, 0x00, 0x0B, 0x00,
+    0x08, 0x00, 0x15, 0x00, 0x36, 0x17, 0x02, 0x28, 0x14, 0x00, 0x14, 0x00,
+    0x18, 0x14, 0x00, 0x14, 0x00, 0x31, 0x02, 0x16, 0x00, 0x0B, 0x00, 0x04,
+    0x00, 0x15, 0x00, 0x0C, 0x00, 0x11, 0x00, 0x0A, 0x00, 0x2C, 0x00, 0x1A,
+    0x00, 0x0C, 0x00, 0x17, 0x00, 0x0B, 0x00, 0x2C, 0x00, 0x10, 0x00, 0x1C,
+    0x00, 0x2C, 0x00, 0x17, 0x00, 0x08, 0x00, 0x04, 0x00, 0x10, 0x00, 0x2C,
+    0x00, 0x0F, 0x00, 0x0C, 0x00, 0x0E, 0x00, 0x08, 0x00, 0x2C, 0x02, 0x0C,
+    0x00, 0x34, 0x00, 0x10, 0x00, 0x2C, 0x00, 0x1C, 0x00, 0x12, 0x00, 0x18,
+    0x00, 0x15, 0x00, 0x2C, 0x00, 0x07, 0x00, 0x12, 0x00, 0x11, 0x00, 0x18,
+    0x00, 0x17, 0x00, 0x2C, 0x00, 0x05, 0x00, 0x15, 0x00, 0x12, 0x00, 0x17,
+    0x00, 0x0B, 0x00, 0x08, 0x00, 0x15, 0x00, 0x37, 0x17, 0x02, 0x28, 0x14,
+    0x00, 0x14, 0x00, 0x18, 0x14, 0x00, 0x14, 0x00, 0x23, 0x02, 0x15, 0x00,
+    0x0C, 0x00, 0x11, 0x00, 0x0A, 0x00, 0x2D, 0x00, 0x16, 0x00, 0x0B, 0x00,
+    0x04, 0x00, 0x13, 0x00, 0x08, 0x00, 0x07, 0x00, 0x2C, 0x00, 0x0D, 0x00,
+    0x12, 0x00, 0x1C, 0x00, 0x36, 0x00, 0x2C, 0x00, 0x0C, 0x00, 0x17, 0x00,
+    0x34, 0x00, 0x16, 0x00, 0x2C, 0x00, 0x05, 0x00, 0x12, 0x00, 0x18, 0x00,
+    0x11, 0x00, 0x06, 0x00, 0x1C, 0x00, 0x2C, 0x00, 0x05, 0x00, 0x0F, 0x00,
+    0x0C, 0x00, 0x16, 0x00, 0x16, 0x00, 0x36, 0x17, 0x02, 0x28, 0x14, 0x00,
+    0x14, 0x00, 0x18, 0x14, 0x00, 0x14, 0x00, 0x26, 0x02, 0x16, 0x00, 0x0E,
+    0x00, 0x0C, 0x00, 0x13, 0x00, 0x2C, 0x00, 0x17, 0x00, 0x0B, 0x00, 0x08,
+    0x00, 0x2C, 0x00, 0x06, 0x00, 0x15, 0x00, 0x12, 0x00, 0x11, 0x00, 0x18,
+    0x00, 0x17, 0x00, 0x16, 0x00, 0x36, 0x00, 0x2C, 0x00, 0x17, 0x00, 0x0B,
+    0x00, 0x08, 0x00, 0x1C, 0x00, 0x2C, 0x00, 0x06, 0x00, 0x04, 0x00, 0x11,
+    0x00, 0x34, 0x00, 0x17, 0x00, 0x2C, 0x00, 0x17, 0x00, 0x12, 0x00, 0x13,
+    0x00, 0x2C, 0x00, 0x17, 0x00, 0x0B, 0x00, 0x0C, 0x00, 0x16, 0x00, 0x37,
+    0x17, 0x02, 0x28, 0x14, 0x00, 0x14, 0x00, 0x18, 0x14, 0x00, 0x14, 0x00,
+    0x32, 0x02, 0x1A, 0x00, 0x0B, 0x00, 0x08, 0x00, 0x11, 0x00, 0x2C, 0x00,
+    0x17, 0x00, 0x0B, 0x00, 0x08, 0x00, 0x2C, 0x00, 0x05, 0x00, 0x12, 0x00,
+    0x1B, 0x00, 0x2C, 0x00, 0x0B, 0x00, 0x0C, 0x00, 0x17, 0x00, 0x16, 0x00,
+    0x2C, 0x00, 0x17, 0x00, 0x0B, 0x00, 0x08, 0x00, 0x2C, 0x00, 0x17, 0x00,
+    0x04, 0x00, 0x05, 0x00, 0x0F, 0x00, 0x08, 0x00, 0x36, 0x00, 0x2C, 0x00,
+    0x1C, 0x00, 0x12, 0x00, 0x18, 0x00, 0x34, 0x00, 0x0F, 0x00, 0x0F, 0x00,
+    0x2C, 0x00, 0x04, 0x00, 0x0F, 0x00, 0x0F, 0x00, 0x2C, 0x00, 0x16, 0x00,
+    0x04, 0x00, 0x1C, 0x00, 0x2C, 0x02, 0x34, 0x00, 0x07, 0x00, 0x04, 0x00,
+    0x11, 0x00, 0x0A, 0x00, 0x36, 0x17, 0x02, 0x28, 0x14, 0x00, 0x14, 0x00,
+    0x18, 0x14, 0x00, 0x14, 0x00, 0x28, 0x02, 0x12, 0x02, 0x07, 0x00, 0x2C,
+    0x00, 0x05, 0x00, 0x15, 0x00, 0x12, 0x00, 0x18, 0x00, 0x0A, 0x00, 0x0B,
+    0x00, 0x17, 0x00, 0x2C, 0x00, 0x17, 0x00, 0x0B, 0x00, 0x08, 0x00, 0x2C,
+    0x00, 0x10, 0x00, 0x12, 0x00, 0x06, 0x00, 0x0B, 0x00, 0x0C, 0x00, 0x36,
+    0x00, 0x2C, 0x00, 0x17, 0x00, 0x0B, 0x00, 0x04, 0x00, 0x17, 0x00, 0x2C,
+    0x00, 0x06, 0x00, 0x0B, 0x00, 0x08, 0x00, 0x1A, 0x00, 0x1C, 0x00, 0x2C,
+    0x00, 0x17, 0x00, 0x0B, 0x00, 0x04, 0x00, 0x11, 0x00, 0x0A, 0x02, 0x1E,
+    0x02, 0x34, 0x17, 0x02, 0x28, 0x14, 0x00, 0x14, 0x00,
+};
+
+static const uint8_t g_sample_mochi_se_lz4[] = {
+    0x4F, 0x44, 0x4B, 0x5A, 0x01, 0x00, 0x01, 0x00, 0x9D, 0x05, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0xF1, 0x0F, 0x18, 0x14,
+    0x00, 0x14, 0x00, 0x13, 0x02, 0x11, 0x00, 0x12, 0x00, 0x13, 0x00, 0x08,
+    0x00, 0x37, 0x00, 0x2C, 0x02, 0x0B, 0x00, 0x08, 0x00, 0x15, 0x00, 0x08,
+    0x00, 0x2C, 0x00, 0x1A, 0x06, 0x00, 0x50, 0x0A, 0x00, 0x12, 0x00, 0x37,
+    0x02, 0x00, 0x30, 0x17, 0x02, 0x28, 0x2E, 0x00, 0x01, 0x33, 0x00, 0xF4,
+    0x08, 0x1B, 0x02, 0x0C, 0x00, 0x34, 0x00, 0x10, 0x00, 0x2C, 0x02, 0x12,
+    0x02, 0x07, 0x00, 0x2C, 0x00, 0x04, 0x00, 0x11, 0x00, 0x07, 0x00, 0x2C,
+    0x16, 0x00, 0x16, 0x00, 0x45, 0x00, 0xD8, 0x17, 0x00, 0x12, 0x00, 0x2C,
+    0x00, 0x16, 0x00, 0x04, 0x00, 0x1C, 0x00, 0x36, 0x43, 0x00, 0xB1, 0x23,
+    0x02, 0x0C, 0x00, 0x2C, 0x00, 0x0F, 0x00, 0x12, 0x00, 0x19, 0x29, 0x00,
+    0x80, 0x10, 0x00, 0x12, 0x00, 0x06, 0x00, 0x0B, 0x00, 0x16, 0x00, 0xF1,
+    0x02, 0x07, 0x00, 0x12, 0x00, 0x11, 0x00, 0x18, 0x00, 0x17, 0x00, 0x16,
+    0x00, 0x2C, 0x00, 0x0C, 0x00, 0x11, 0x63, 0x00, 0x00, 0x24, 0x00, 0x71,
+    0x04, 0x00, 0x0D, 0x00, 0x12, 0x00, 0x15, 0x9E, 0x00, 0x00, 0x53, 0x00,
+    0x09, 0x96, 0x00, 0x93, 0x1E, 0x02, 0x18, 0x00, 0x05, 0x00, 0x08, 0x00,
+    0x36, 0x2B, 0x00, 0x11, 0x17, 0x51, 0x00, 0x11, 0x04, 0x10, 0x00, 0x91,
+    0x05, 0x00, 0x0F, 0x00, 0x04, 0x00, 0x06, 0x00, 0x0E, 0x8E, 0x00, 0x11,
+    0x08, 0x92, 0x00, 0x11, 0x10, 0x79, 0x00, 0x00, 0xA2, 0x00, 0x1A, 0x12,
+    0x9C, 0x00, 0x15, 0x2A, 0xC9, 0x00, 0x00, 0xFE, 0x00, 0x31, 0x11, 0x00,
+    0x11, 0x7E, 0x00, 0x51, 0x05, 0x00, 0x18, 0x00, 0x1C, 0x5B, 0x00, 0x0F,
+    0xAA, 0x00, 0x05, 0x13, 0x09, 0x9C, 0x00, 0xF8, 0x06, 0x04, 0x00, 0x0F,
+    0x00, 0x0F, 0x00, 0x2C, 0x00, 0x12, 0x00, 0x09, 0x00, 0x2C, 0x00, 0x1C,
+    0x00, 0x12, 0x00, 0x18, 0x02, 0x1E, 0x61, 0x00, 0x95, 0x24, 0x02, 0x16,
+    0x00, 0x17, 0x00, 0x08, 0x00, 0x13, 0xDF, 0x00, 0x11, 0x17, 0x34, 0x01,
+    0x00, 0x9C, 0x00, 0x11, 0x0B, 0x8D, 0x01, 0x00, 0xB4, 0x00, 0x71, 0x09,
+    0x00, 0x08, 0x00, 0x08, 0x00, 0x0F, 0x22, 0x00, 0x51, 0x34, 0x00, 0x2C,
+    0x00, 0x0E, 0x0A, 0x00, 0x11, 0x07, 0x8D, 0x00, 0x3C, 0x09, 0x00, 0x0F,
+    0x52, 0x01, 0x75, 0x22, 0x02, 0x05, 0x00, 0x12, 0x00, 0x1B, 0x78, 0x00,
+    0x11, 0x17, 0xC2, 0x01, 0x13, 0x0F, 0x60, 0x01, 0x06, 0xA3, 0x01, 0x04,
+    0xB6, 0x00, 0x31, 0x34, 0x00, 0x17, 0x18, 0x00, 0x11, 0x16, 0x15, 0x01,
+    0x3C, 0x1A, 0x00, 0x0B, 0x50, 0x01, 0x31, 0x1F, 0x02, 0x0A, 0x36, 0x01,
+    0x11, 0x1D, 0x41, 0x00, 0x13, 0x16, 0xCA, 0x01, 0x00, 0xF9, 0x00, 0x10,
+    0x11, 0x7C, 0x00, 0x01, 0x0E, 0x00, 0x00, 0x6B, 0x00, 0x02, 0x47, 0x00,
+    0x01, 0x5F, 0x00, 0x20, 0x00, 0x15, 0xED, 0x00, 0x01, 0x0C, 0x00, 0x0D,
+    0x9C, 0x00, 0x11, 0x0C, 0xF3, 0x00, 0x00, 0x98, 0x00, 0x00, 0x95, 0x01,
+    0x00, 0x35, 0x00, 0x00, 0x46, 0x01, 0x31, 0x08, 0x00, 0x1A, 0x5C, 0x01,
+    0x00, 0x93, 0x01, 0x00, 0x14, 0x00, 0x11, 0x17, 0x92, 0x00, 0x02, 0x2A,
+    0x00, 0x00, 0x69, 0x00, 0x00, 0x12, 0x00, 0x5A, 0x12, 0x00, 0x1A, 0x00,
+    0x11, 0x9C, 0x00, 0x31, 0x21, 0x02, 0x13, 0x17, 0x00, 0x13, 0x07, 0x6A,
+    0x02, 0x00, 0x7C, 0x00, 0x93, 0x16, 0x00, 0x18, 0x00, 0x0A, 0x00, 0x04,
+    0x00, 0x15, 0x9C, 0x00, 0x33, 0x17, 0x00, 0x18, 0xF2, 0x01, 0x00, 0xEF,
+    0x00, 0x00, 0xB9, 0x01, 0x00, 0xBF, 0x01, 0x11, 0x09, 0x08, 0x02, 0x1A,
+    0x08, 0xA0, 0x00, 0x15, 0x24, 0xF2, 0x01, 0x00, 0x9E, 0x00, 0x00, 0x7C,
+    0x00, 0x08, 0xE6, 0x01, 0x00, 0x4D, 0x02, 0x10, 0x11, 0x55, 0x00, 0x01,
+    0x3E, 0x01, 0x00, 0x77, 0x00, 0x00, 0x4F, 0x00, 0x00, 0x2A, 0x00, 0x11,
+    0x0C, 0xF8, 0x01, 0x11, 0x13, 0x27, 0x01, 0x00, 0x55, 0x00, 0x09, 0xA4,
+    0x00, 0x31, 0x27, 0x02, 0x06, 0x20, 0x01, 0x02, 0xC8, 0x01, 0x04, 0xCF,
+    0x00, 0x00, 0x8C, 0x00, 0x00, 0x0E, 0x00, 0x00, 0x05, 0x01, 0x01, 0x28,
+    0x01, 0x05, 0x91, 0x01, 0x00, 0x47, 0x02, 0x04, 0x26, 0x00, 0x00, 0x5D,
+    0x00, 0x00, 0x26, 0x00, 0x13, 0x12, 0x0A, 0x00, 0x1A, 0x15, 0xB0, 0x00,
+    0x20, 0x31, 0x02, 0x89, 0x01, 0x00, 0xEB, 0x00, 0x00, 0x2F, 0x00, 0x11,
+    0x0A, 0xC0, 0x01, 0x00, 0x60, 0x01, 0x11, 0x0B, 0xAE, 0x00, 0x00, 0xE7,
+    0x00, 0x00, 0x42, 0x01, 0x00, 0xE3, 0x02, 0x00, 0x64, 0x03, 0x30, 0x0C,
+    0x00, 0x0E, 0x4D, 0x00, 0x05, 0xE4, 0x00, 0x01, 0x92, 0x02, 0x01, 0xAA,
+    0x02, 0x08, 0x79, 0x00, 0x11, 0x05, 0xBD, 0x01, 0x00, 0x44, 0x00, 0x00,
+    0x6F, 0x00, 0x09, 0xCA, 0x00, 0x24, 0x23, 0x02, 0x69, 0x00, 0x11, 0x2D,
+    0x02, 0x02, 0x11, 0x04, 0x2F, 0x04, 0x00, 0x74, 0x01, 0x00, 0x8F, 0x03,
+    0x02, 0x0C, 0x02, 0x00, 0x7F, 0x00, 0x11, 0x34, 0x0F, 0x01, 0x00, 0x87,
+    0x02, 0x00, 0x04, 0x02, 0x11, 0x06, 0x89, 0x00, 0x00, 0x7A, 0x03, 0x00,
+    0x27, 0x01, 0x1A, 0x16, 0xC2, 0x00, 0x20, 0x26, 0x02, 0x78, 0x02, 0x11,
+    0x0C, 0x03, 0x03, 0x02, 0x74, 0x00, 0x00, 0x10, 0x02, 0x00, 0x82, 0x00,
+    0x02, 0x90, 0x00, 0x11, 0x16, 0x55, 0x00, 0x02, 0x1A, 0x00, 0x00, 0x47,
+    0x00, 0x11, 0x06, 0x2F, 0x01, 0x02, 0xB4, 0x02, 0x00, 0x12, 0x02, 0x04,
+    0x38, 0x00, 0x00, 0x5B, 0x00, 0x09, 0xAC, 0x00, 0x20, 0x32, 0x02, 0xCB,
+    0x02, 0x19, 0x08, 0x46, 0x01, 0x00, 0x92, 0x00, 0x00, 0x19, 0x03, 0x00,
+    0x2F, 0x00, 0x00, 0x5B, 0x00, 0x06, 0x1A, 0x00, 0x00, 0x6F, 0x02, 0x00,
+    0xA2, 0x00, 0x02, 0x36, 0x04, 0x02, 0x19, 0x01, 0x13, 0x34, 0xBF, 0x03,
+    0x04, 0xC7, 0x03, 0x00, 0x2C, 0x04, 0x51, 0x1C, 0x00, 0x2C, 0x02, 0x34,
+    0x7C, 0x03, 0x00, 0x06, 0x01, 0x09, 0xCA, 0x00, 0x13, 0x28, 0x05, 0x05,
+    0x02, 0x40, 0x01, 0x00, 0x83, 0x02, 0x13, 0x0B, 0xA6, 0x00, 0x02, 0x63,
+    0x00, 0x06, 0x4A, 0x02, 0x00, 0x63, 0x00, 0x00, 0x16, 0x00, 0x0A, 0xFE,
+    0x02, 0x00, 0xDE, 0x00, 0x02, 0x16, 0x00, 0xE0, 0x11, 0x00, 0x0A, 0x02,
+    0x1E, 0x02, 0x34, 0x17, 0x02, 0x28, 0x14, 0x00, 0x14, 0x00,
+};
+
+static const uint8_t g_sample_open_channel[] = {
+    0x17, 0x08, 0x11, 0x14, 0x00, 0x78, 0x00, 0x18, 0x14, 0x00, 0x14, 0x00,
+    0x0C, 0x02, 0x20, 0x00, 0x1A, 0x00, 0x04, 0x00, 0x17, 0x00, 0x08, 0x00,
+    0x15, 0x00, 0x06, 0x00, 0x12, 0x00, 0x12, 0x00, 0x0F, 0x00, 0x08, 0x00,
+    0x15, 0x13, 0xF4, 0x01, 0x17, 0x00, 0x28, 0x14, 0x00, 0x14, 0x00,
+};
+
+static const uint8_t g_sample_open_slack[] = {
+    0x17, 0x08, 0x2C, 0x14, 0x00, 0x0E, 0x01, 0x18, 0x14, 0x00, 0x14, 0x00,
+    0x05, 0x02, 0x16, 0x00, 0x0F, 0x00, 0x04, 0x00, 0x06, 0x00, 0x0E, 0x13,
+    0xF4, 0x01, 0x17, 0x00, 0x28, 0x14, 0x00, 0x08, 0x02,
+};
+
+static const uint8_t g_sample_sample[] = {
+    0x18, 0x32, 0x00, 0x32, 0x00, 0x0D, 0x02, 0x0B, 0x00, 0x08, 0x00, 0x0F,
+    0x00, 0x0F, 0x00, 0x12, 0x00, 0x36, 0x00, 0x2C, 0x02, 0x1A, 0x00, 0x12,
+    0x00, 0x15, 0x00, 0x0F, 0x00, 0x07, 0x02, 0x1E, 0x17, 0x00, 0x28, 0x32,
+    0x00, 0x32, 0x00, 0x10, 0x02, 0x03, 0x04, 0x05, 0x06, 0x13, 0xC8, 0x00,
+    0x12, 0x19, 0x03, 0x00, 0x00, 0x00, 0x17, 0x00, 0x51, 0x32, 0x00, 0x96,
+    0x00, 0x1A, 0x36, 0x00, 0x00, 0x00, 0x19, 0x02, 0x00, 0x00, 0x00, 0x17,
+    0x00, 0x04, 0x32, 0x00, 0x32, 0x00, 0x19, 0x03, 0x00, 0x00, 0x00, 0x17,
+    0x00, 0x05, 0x32, 0x00, 0x32, 0x00, 0x1A, 0x53, 0x00, 0x00, 0x00, 0x17,
+    0x00, 0x06, 0x32, 0x00, 0x32, 0x00, 0x1A, 0x47, 0x00, 0x00, 0x00, 0x18,
+    0x64, 0x00, 0x32, 0x00, 0x0B, 0x02, 0x16, 0x00, 0x0F, 0x00, 0x12, 0x00,
+    0x1A, 0x00, 0x2C, 0x00, 0x17, 0x00, 0x1C, 0x00, 0x13, 0x00, 0x0C, 0x00,
+    0x11, 0x00, 0x0A, 0x18, 0x1E, 0x00, 0x32, 0x00, 0x0B, 0x02, 0x09, 0x00,
+    0x04, 0x00, 0x16, 0x00, 0x17, 0x00, 0x2C, 0x00, 0x17, 0x00, 0x1C, 0x00,
+    0x13, 0x00, 0x0C, 0x00, 0x11, 0x00, 0x0A,
+};
+
+static const uint8_t g_sample_shift_enter[] = {
+    0x17, 0x02, 0x28, 0x14, 0x00, 0x14, 0x00,
+};
+
+static const vm_bench_program_t g_vm_bench_samples[] = {
+    {"default", g_sample_default, sizeof(g_sample_default)},
+    {"is_this_okay", g_sample_is_this_okay, sizeof(g_sample_is_this_okay)},
+    {"mochi", g_sample_mochi, sizeof(g_sample_mochi)},
+    {"mochi.lz4", g_sample_mochi_lz4, sizeof(g_sample_mochi_lz4)},
+    {"mochi_se", g_sample_mochi_se, sizeof(g_sample_mochi_se)},
+    {"mochi_se.lz4", g_sample_mochi_se_lz4, sizeof(g_sample_mochi_se_lz4)},
+    {"open_channel", g_sample_open_channel, sizeof(g_sample_open_channel)},
+    {"open_slack", g_sample_open_slack, sizeof(g_sample_open_slack)},
+    {"sample", g_sample_sample, sizeof(g_sample_sample)},
+    {"shift_enter", g_sample_shift_enter, sizeof(g_sample_shift_enter)},
+};
+
+#define VM_BENCH_SAMPLE_COUNT \
+    (sizeof(g_vm_bench_samples) / sizeof(g_vm_bench_samples[0]))
+
+#endif  // VM_BENCH_SAMPLES_H